@@ -45,23 +45,272 @@
    SAVESETTINGS[]
             Saves the current camera configuration as the new camera default settings.
 
+   SCIP transport:
+        By default, commands/responses travel over the EosMain named pipes.
+        Setting "scip_transport = unix_seqpacket" in adimec_edt.cfg also opens
+        a local SOCK_SEQPACKET socket (scip_socket_path) that accepts up to
+        scip_socket_max_clients clients.  Each socket message holds one or
+        more complete newline-separated commands; responses go back to the
+        client that sent the command.  Unsolicited messages (deferred
+        replies, pushes) still go to the named pipe and also to every
+        socket client.
+
+   SCIP output queue:
+        Responses are queued and written by a flusher thread with
+        non-blocking I/O, so a slow SCIP main can't stall the serial link.
+        scip_output_queue_depth sets the per-channel depth (0 = old
+        synchronous writes).  When a channel is full, telemetry is dropped
+        per scip_output_overflow (drop_oldest/drop_newest); command replies
+        are never dropped.  Instead, once a channel holds 4x the depth in
+        unread replies, its commands are not read until it drains.
+        The responses of one dispatch cycle go out in one writev() (or one
+        MQTT publish); scip_output_linger_us bounds the added latency.
+
+   Correlation tags and asynchronous commands:
+        A command's last argument may be a tag: "#id" (e.g. GETGAIN[#17] or
+        SETGAIN[500,#17]).  Every response to that command is sent with
+        the tag appended after the closing bracket: "SS002|GAIN[500]#17".
+        A tag written "#!id" makes the command asynchronous: the controller
+        answers ACCEPTED[CMD]#id at once (or BUSY[CMD]#id if
+        scip_async_queue_depth commands are already pending), runs the
+        command in order on a worker thread, and finishes with the
+        command's own tagged responses followed by COMPLETE[CMD,OK|ERROR]#id.
+
+   Query deadlines:
+        A "~ms" argument (before or after the tag, e.g. GETTEMP[~500,#17])
+        gives a camera query (GETGAIN, GETTEMP, GET_IMGFMT, ...) a deadline;
+        scip_query_stale_ms sets default windows per command.  A query that
+        waited longer than that before it could run is answered with the
+        newest response we have for it (or TIMEOUT[CMD] if there is none)
+        instead of going to the camera.  Set commands are never dropped,
+        and those that change the camera clear the response cache.
+        In-process commands (STATS, GET_AE, FOCUS, ...) always run.
+        Socket commands are timed from receipt; named-pipe commands from
+        the start of the dispatch cycle (RunBase() doesn't timestamp them).
+
+   In-process capture:
+        With capture_enable=1 the controller also grabs frames itself
+        (EosAdimecCapture) from the EDT DMA ring or a synthetic source.
+        With video_output_enable=1 each frame is converted straight from
+        Bayer to I420/NV12, white balance included, and written to a FIFO
+        for the linked_video streamer (EosAdimecVideoOutput).
+        With frame_ring_enable=1 every frame is also published in shared
+        memory (EosAdimecFrameRing) with its sequence, timestamps, bit
+        depth and the IT/gain/frame period/IMGFMT in effect, for any
+        number of local readers (EosAdimecFrameRingReader).
+
+   Settings versions:
+        Each successful SETGAIN/SETIT/SETFP/SETOR/SET_IMGFMT/SETRGB bumps a
+        settings version and also answers SETTINGS_VERSION[N].  With
+        capture on, every frame is tagged with the version in effect,
+        worked out from the serial send/ACK times, the frame period and
+        integration time, and the frame timestamp
+        (EosAdimecSettingsTracker).
+
+   Auto-exposure (capture on):
+        SET_AE[0|1]             -- run the in-process AE loop
+        SET_AE_TARGET[pct]      -- target mean level, % of full scale (1-99)
+        SET_AE_ROI[x,y,w,h]     -- metering ROI in pixels (w,h 0 = whole frame)
+        SET_AE_RATE[hz]         -- max loop iterations per second (1-100)
+        GET_AE[]                -- AE[enable=..,target=..,...,mean=..,it=..,gain=..]
+        The loop (EosAdimecAutoExposure) meters a luminance histogram of
+        the ROI and sets the integration time first, then the gain, within
+        the SETIT/SETGAIN ranges.  It meters the first frame taken with its
+        last change, so it steps once per frame (at most at the loop rate).
+        It sends @IT/@GA itself: no SCIP responses, but each change bumps
+        the settings version.  A manual SETIT/SETGAIN is overridden on the
+        next iteration while AE is on.
+
+   White balance (capture on):
+        AWB_ONCE[]              -- correct once: AWB_ONCE[STARTED], then
+                                   AWB_ONCE[CONVERGED|NOT_CONVERGED,r,g,b]
+        SET_AWB[off|continuous] -- keep correcting
+        SET_AWB_METHOD[gray_world|white_patch]
+        SET_AWB_HYST[pct]       -- only correct past this error (1-50)
+        SET_AWB_RATE[hz]        -- max loop iterations per second (1-100)
+        GET_AWB[]               -- AWB[mode=..,method=..,...,r=..,g=..,b=..]
+        The loop (EosAdimecAutoWhiteBalance) sums the raw Bayer channels
+        and sends @WB itself, within the SETRGB range; like AE, each change
+        bumps the settings version without a SCIP response.  SETRGB and
+        GETRGB are R,G,B; the camera's B,G,R order stays in
+        WbToCamera()/WbFromCamera().
+
+   Frame statistics (capture on, frame_stats_enable=1):
+        FRAME_STATS[]           -- latest: FRAME_STATS[seq=..,version=..,ms=..,
+                                   r_mean=..,r_min=..,r_max=..,r_sat=..,r_black=..,
+                                   g_...,b_...] (sat/black in %), or
+                                   FRAME_STATS[none] before the first one
+        FRAME_STATS[r|g|b]      -- that channel's histogram in 32 bins:
+                                   FRAME_STATS[r,seq,c0,...,c31]
+        SET_FRAME_STATS_DECIMATION[n] -- every nth frame (1-10000)
+        SET_FRAME_STATS_PUSH[ms]      -- push FRAME_STATS[...] every ms
+                                         (0 = off, max 3600000)
+        EosAdimecFrameStats works on the raw Bayer frame, split into row
+        bands across its worker threads, with SIMD row kernels.  It keeps
+        256 bins per channel; SCIP gets 32 (8 summed) to fit a response.
+
+   Focus score (capture on, focus_enable=1):
+        FOCUS[]                 -- latest: FOCUS[seq=..,version=..,changing=..,
+                                   method=..,score=..,roi=x;y;w;h,ms=..], or
+                                   FOCUS[none] before the first one
+        SET_FOCUS_METHOD[tenengrad|laplacian]
+        SET_FOCUS_ROI[x,y,w,h]  -- pixels (w,h 0 = whole frame)
+        SET_FOCUS_PUSH[0|1]     -- push FOCUS[...] for every frame scored
+        EosAdimecFocus scores every frame on the capture thread from the
+        green channel of the ROI.  Every score also goes to the
+        focus_shm_name segment (EosAdimecFocusLayout.h), where the paired
+        lens controller can poll it without a SCIP round trip; changing=1
+        means a SET was in flight during that exposure.
+
+   Pre-trigger recorder (capture on, recorder_enable=1):
+        TRIGGER_SAVE[pre_s,post_s] -- save the pre_s seconds before now
+                                   and the post_s seconds after:
+                                   TRIGGER_SAVE[STARTED,id,pre_frames,path],
+                                   then TRIGGER_SAVE[DONE,id,frames,pre_frames,
+                                   dropped,path] or TRIGGER_SAVE[FAILED,id,error,path]
+        GET_RECORDER[]          -- RECORDER[slots=..,span_s=..,mb=..,...]
+        EosAdimecRecorder keeps raw frames in RAM (recorder_seconds at the
+        frame period, within the memory budget) and writes a trigger's frames from a niced
+        thread; capture never waits for the disk.  One save at a time
+        (ERROR_TRIGGER_SAVE[busy]).  File layout: EosAdimecRecordingLayout.h.
+
+   Snapshots (capture on, snapshot_enable=1):
+        SNAPSHOT[png|jpeg]      -- one still: SNAPSHOT[STARTED,id], then
+                                   SNAPSHOT[DONE,id,path,seq,wall_time,wait_ms,
+                                   encode_ms] or SNAPSHOT[FAILED,id,error], both
+                                   to the requester with its #id tag
+        EosAdimecSnapshot copies the next frame exposed after the command
+        and encodes it on its own thread (PNG: 16-bit RGB; JPEG: 8-bit,
+        libjpeg-turbo) to snapshot_dir, tmpfs by default.  With
+        snapshot_trigger_mode set, that serial command goes to the camera
+        first and snapshot_stream_mode after.  One at a time
+        (ERROR_SNAPSHOT[snapshot_in_progress]).
+
+   Downscaled previews (capture on, preview_enable=1):
+        GET_PREVIEW[]           -- PREVIEW[levels=2;4;8,size=800x600;400x300;
+                                   200x150,format=..,decimation=..,published=..,
+                                   skipped=..,ms=..,shm=..]
+        SET_PREVIEW_DECIMATION[n] -- every nth frame (1-10000)
+        EosAdimecPreview bins every nth frame straight from Bayer (2x2
+        quads, SIMD) to 1/2, 1/4 and/or 1/8 size, converts to I420/NV12 and
+        publishes to preview_shm_name (EosAdimecPreviewLayout.h).
+
+   Raw frame archive (capture on):
+        SET_ARCHIVE[1]          -- start a new archive: ARCHIVE[1,dir]
+        SET_ARCHIVE[0]          -- close it: ARCHIVE[0]
+        GET_ARCHIVE[]           -- ARCHIVE[on=1,dir=..,frames=..,skipped=..,...]
+        archive_enable=1 starts one with capture.  EosAdimecArchive writes
+        every frame into preallocated segment files with a time index
+        (EosAdimecArchiveLayout.h); capture only copies into a RAM staging
+        ring.  EosAdimecArchiveReader finds frames by time or sequence;
+        bin/EosAdimecArchiveTool.x lists and extracts ranges.
+
+   Dark/flat correction (capture on):
+        CAPTURE_DARK[n]         -- average the next n frames (lens capped)
+                                   into the dark of their bucket:
+                                   CAPTURE_DARK[STARTED,n], then
+                                   CAPTURE_DARK[DONE,bucket,frames,mean,path]
+                                   or CAPTURE_DARK[FAILED,bucket,error]
+        CAPTURE_FLAT[n]         -- the same under even light, for the flat
+                                   (needs the bucket's dark first)
+        SET_CORRECTION[0|1]     -- correct frames or not: CORRECTION[0|1]
+        GET_CORRECTION[]        -- CORRECTION[on=..,darks=..,flats=..,
+                                   bucket=..,dark=..,flat=..,ms=..,...]
+        EosAdimecCorrection keeps references in correction_dir per bucket
+        (bit depth, SETGAIN step, integration time octave) and corrects
+        each frame, as the pipeline's correction stage, with the
+        references nearest its own settings.  One capture at a time
+        (ERROR_CAPTURE_DARK[busy]).  File layout:
+        EosAdimecCorrectionLayout.h.
+
+   Video tone map (capture on, video_output_enable=1):
+        SET_TONEMAP[curve]      -- off, linear, gamma, log or equalize
+        SET_TONEMAP_GAMMA[g], SET_TONEMAP_LOG[a], SET_TONEMAP_GAIN[g],
+        SET_TONEMAP_BLACK[pct]  -- curve parameters
+        GET_TONEMAP[]           -- TONEMAP[curve=..,gamma=..,...,builds=..]
+        EosAdimecToneMap maps the video output's 10/12-bit values to 8
+        bits through a LUT, so the preview gets the dynamic range without
+        SETOR[8]; every other consumer still gets full-depth frames.
+
+   Tile executor (capture on):
+        Correction, the video output and frame statistics cut each frame
+        into tiles of about tile_kb (with halo rows for the demosaic) on
+        one EosAdimecTileExecutor: tile_threads work-stealing workers,
+        pinned to tile_cpus, with the capture thread helping.  Frames
+        still reach each consumer in capture order.  STATS[] reports
+        tile_workers, tile_pinned, tile_jobs, tile_stolen and tile_ms.
+
+   Frame-processing graph (capture on):
+        GET_PIPELINE[]          -- PIPELINE[stage:input:frames:fps:ms,...]
+                                   for each stage in the graph
+        The [pipeline] section of the config (EosAdimecPipeline.h) says
+        which stages run and whether each takes raw ("capture") or
+        corrected frames; stages left out are never built.  Without it
+        the *_enable keys pick the stages, as before.
+
+   Frame pools (capture on):
+        GET_FRAME_POOLS[]       -- FRAME_POOLS[budget_mb=..,free_mb=..,
+                                   reserved_mb=..,refused=..,
+                                   name:slots:in_use:high_water:failed:mb:huge:locked,...]
+        The frame buffers of correction, the video output, the archive
+        and the recorder are EosAdimecFramePool slots, mapped and faulted
+        in when the stage starts (frame_pool_hugepages: 2 MB pages,
+        frame_pool_mlock: locked), out of 3/4 of max_mem_mb less the DMA
+        ring; a stage that does not fit does not start.  STATS[] reports
+        pool_mb, pool_free_mb and pool_failed.
+
+   Thread placement:
+        thread_<role>_cpus, thread_<role>_policy (other|fifo) and
+        thread_<role>_priority set where each role's threads run: dispatch
+        (command loop, SCIP socket server, reply flusher), serial (async
+        command worker, AE, AWB), capture, processing (tile workers, video
+        writer, push threads).  Each thread applies its role when it
+        starts; STATS[] reports what it got as
+        thr_<role>=<policy>:<priority>:<cpus> and the refusals as thr_failed.
+
+   Packed frames:
+        frame_ring_packed, recorder_packed and archive_packed store each
+        frame packed to its bit depth (8, 10p or 12p per SETOR, picked per
+        frame) instead of 16-bit words: meta.nPixelFormat says which.
+        EosAdimecPack has the SIMD pack/unpack kernels; readers link it to
+        get 16-bit words back.
+
+   FIRST_FRAME[N]:
+        The first frame captured with settings version N (or later):
+        FIRST_FRAME[N,sequence,wall_time,ack_to_frame_ms], or
+        FIRST_FRAME[N,PENDING] until there is one, or FIRST_FRAME[N,UNKNOWN].
+
+   STATS[]:
+        Report controller counters, one STATS[subsystem,name=value,...] line
+        per subsystem: outq (depth, writes, drops, stalls), async (pending
+        commands, stale queries answered from cache/TIMEOUT), capture
+        (frames/fps/timeouts/overruns/drops), then one line for each stage
+        that is on (video, ring, recorder, snapshot, preview, archive,
+        correction, tile, pool), threads and scip.
+
  */
 #pragma once
 
 #include <stdio.h>  
 #include <fcntl.h>  
 #include <stdarg.h>
+#include <stdint.h>
 #include <sys/timeb.h>
 
 
 #include <boost/thread/thread.hpp>
 #include <boost/thread/mutex.hpp>
+#include <boost/thread/recursive_mutex.hpp>
+#include <boost/thread/condition_variable.hpp>
 #include <boost/thread/locks.hpp>
 #include <boost/bind.hpp>
 
 #include <memory>
 #include <functional>
 #include <atomic>
+#include <deque>
+#include <set>
+#include <algorithm>
 
 
 extern "C" {
@@ -77,6 +326,27 @@ extern "C" {
 
 #include "CamLinkComms.h"
 
+#include "EosAdimecConfiguration.h"
+#include "EosAdimecSeqPacketServer.h"
+#include "EosAdimecOutputQueue.h"
+#include "EosAdimecCapture.h"
+#include "EosAdimecVideoOutput.h"
+#include "EosAdimecFrameRing.h"
+#include "EosAdimecSettingsTracker.h"
+#include "EosAdimecAutoExposure.h"
+#include "EosAdimecAutoWhiteBalance.h"
+#include "EosAdimecFrameStats.h"
+#include "EosAdimecFocus.h"
+#include "EosAdimecRecorder.h"
+#include "EosAdimecSnapshot.h"
+#include "EosAdimecPreview.h"
+#include "EosAdimecArchive.h"
+#include "EosAdimecCorrection.h"
+#include "EosAdimecTileExecutor.h"
+#include "EosAdimecPipeline.h"
+#include "EosAdimecFramePool.h"
+#include "EosAdimecPack.h"
+
 typedef unsigned char BYTE;
 
 /*Adimec message flags. These values are specific to the Adimec camera. The extra A is 
@@ -157,6 +427,15 @@ class EosAdimec : public EosDevice
       guarantee that it never gets too big. */
   static const size_t MAX_LEFTOVER_CHARS=256;  /**  Max# chars to carry over to next read. */
   static const size_t MAX_BUFFER_SIZE=16384;   /**  Max allowable input command buffer size. */
+
+  /** SCIP socket-server poll interval (also bounds shutdown latency) */
+  static const int SOCKET_POLL_MS=200;
+
+  /** Camera SETIT and SETGAIN ranges (checked here and used by auto-exposure) */
+  static const int MIN_INTEGRATION_TIME=1;
+  static const int MAX_INTEGRATION_TIME=4000;
+  static const int MIN_GAIN=100;
+  static const int MAX_GAIN=800;
   
   /**
      A "do-nothing" stub for this device. 
@@ -201,6 +480,65 @@ class EosAdimec : public EosDevice
 
   protected:
   bool m_bSaveSettingsOnExit;
+
+  /** Correlation tag prefixes (last command argument) */
+  static const char REPLY_TAG_PREFIX='#';
+  static const char ASYNC_TAG_MARK='!';
+  static const size_t MAX_REPLY_TAG_LEN=32;
+  static const char DEADLINE_PREFIX='~';
+
+  /** Where ShipToSCIP() sends its output */
+  enum E_REPLY_ROUTE
+  {
+      eReplyRouteDefault,  // Unsolicited message: use the configured transport
+      eReplyRoutePipe,     // Reply to a command that came in on the named pipe
+      eReplyRouteSocket    // Reply to a command from socket client m_nReplyClientFd
+  };
+
+  /** Trailing option arguments of one command ("#id", "#!id", "~ms") */
+  struct CommandOptions
+  {
+      std::string strReplyTag;   // "" if none
+      bool bAsync;
+      int nDeadlineMs;           // -1: use scip_query_stale_ms
+      uint64_t nArrivalMs;       // GetMonotonicMs() when the command arrived
+  };
+
+  /** An asynchronous command waiting for the worker thread */
+  struct AsyncCommand
+  {
+      std::vector<std::string> vStrCmd;   // Options already removed
+      E_REPLY_ROUTE eReplyRoute;
+      int nReplyClientFd;
+      CommandOptions options;
+  };
+
+  /** What a SCIP command does to the camera */
+  enum E_COMMAND_KIND
+  {
+      eCommandQuery,       // Reads camera state over the serial link: cached, may go stale
+      eCommandSet,         // Changes camera state: clears the query cache
+      eCommandLocal        // Controller state only (status, loops, pipeline): neither
+  };
+
+  typedef boost::function<int (EosAdimec*, const std::vector<std::string>&)> CommandFn;
+
+  /** One m_mapCommandTemplate entry */
+  struct CommandEntry
+  {
+      CommandEntry(void) : eKind(eCommandLocal) {};
+      CommandEntry(CommandFn fnIn, const E_COMMAND_KIND eKindIn) : fnCommand(fnIn), eKind(eKindIn) {};
+
+      CommandFn fnCommand;
+      E_COMMAND_KIND eKind;
+  };
+
+  /** Newest response to one query (command + args) */
+  struct CachedQuery
+  {
+      std::string strResponse;   // Formatted, untagged
+      uint64_t nTimeMs;
+  };
   
   // ##########################################################
   // #### Begin pure virtual fcns inherited from EosDevice. ###
@@ -346,6 +684,51 @@ class EosAdimec : public EosDevice
   int _FptrSetImageFormat(const std::vector<std::string>& vStrArgs);
   int _FptrGetImageFormat(const std::vector<std::string>& vStrArgs);
 
+  // STATS[] -- controller counters
+  int _FptrGetStats(const std::vector<std::string>& vStrArgs);
+
+  // FIRST_FRAME[nVersion] -- first frame with a settings version
+  int _FptrGetFirstFrame(const std::vector<std::string>& vStrArgs);
+
+  // SET_AE[0|1],SET_AE_TARGET[pct],SET_AE_ROI[x,y,w,h],SET_AE_RATE[hz],GET_AE[]
+  int _FptrSetAutoExposure(const std::vector<std::string>& vStrArgs);
+  int _FptrGetAutoExposure(const std::vector<std::string>& vStrArgs);
+
+  // AWB_ONCE[],SET_AWB[mode],SET_AWB_METHOD[m],SET_AWB_HYST[pct],SET_AWB_RATE[hz],GET_AWB[]
+  int _FptrAutoWhiteBalanceOnce(const std::vector<std::string>& vStrArgs);
+  int _FptrSetAutoWhiteBalance(const std::vector<std::string>& vStrArgs);
+  int _FptrGetAutoWhiteBalance(const std::vector<std::string>& vStrArgs);
+
+  // FRAME_STATS[],FRAME_STATS[r|g|b],SET_FRAME_STATS_DECIMATION[n],SET_FRAME_STATS_PUSH[ms]
+  int _FptrGetFrameStats(const std::vector<std::string>& vStrArgs);
+  int _FptrSetFrameStats(const std::vector<std::string>& vStrArgs);
+
+  // FOCUS[],SET_FOCUS_METHOD[m],SET_FOCUS_ROI[x,y,w,h],SET_FOCUS_PUSH[0|1]
+  int _FptrGetFocus(const std::vector<std::string>& vStrArgs);
+  int _FptrSetFocus(const std::vector<std::string>& vStrArgs);
+
+  // TRIGGER_SAVE[pre_s,post_s],GET_RECORDER[]
+  int _FptrTriggerSave(const std::vector<std::string>& vStrArgs);
+  int _FptrGetRecorder(const std::vector<std::string>& vStrArgs);
+
+  // SNAPSHOT[png|jpeg]
+  int _FptrSnapshot(const std::vector<std::string>& vStrArgs);
+
+  // GET_PREVIEW[],SET_PREVIEW_DECIMATION[n]
+  int _FptrGetPreview(const std::vector<std::string>& vStrArgs);
+  int _FptrSetPreview(const std::vector<std::string>& vStrArgs);
+
+  // GET_ARCHIVE[],SET_ARCHIVE[0|1]
+  int _FptrGetArchive(const std::vector<std::string>& vStrArgs);
+  int _FptrSetArchive(const std::vector<std::string>& vStrArgs);
+  int _FptrCaptureReference(const std::vector<std::string>& vStrArgs);
+  int _FptrGetCorrection(const std::vector<std::string>& vStrArgs);
+  int _FptrSetCorrection(const std::vector<std::string>& vStrArgs);
+  int _FptrSetToneMap(const std::vector<std::string>& vStrArgs);
+  int _FptrGetToneMap(const std::vector<std::string>& vStrArgs);
+  int _FptrGetPipeline(const std::vector<std::string>& vStrArgs);
+  int _FptrGetFramePools(const std::vector<std::string>& vStrArgs);
+
   // ################################################
   // ###### BOOST FUNCTION POINTERS END #############
   // ################################################
@@ -398,6 +781,200 @@ class EosAdimec : public EosDevice
   */
  void ShipToSCIP(std::string strMsg,std::string strValue);
 
+ /**
+    Send an already-formatted SCIP message along the current reply route.
+    @return UNIX_ERROR_STATUS if a reply could not be sent (client gone)
+  */
+ int ShipRawToSCIP(const std::string& strMsgIn);
+
+ /**
+    Send a formatted SCIP message along the given route (no tagging).
+    With the output queue on it only queues; without it the caller holds
+    m_mtxDispatch.
+  */
+ int SendToSCIP(const std::string& strMsg, const E_REPLY_ROUTE eRoute, const int nClientFd);
+
+ /**
+    Unsolicited message from a push thread (frame stats, focus).  With
+    the output queue on it is queued as telemetry without m_mtxDispatch,
+    so it never waits behind a command's serial I/O.
+  */
+ void PushToSCIP(const std::string& strMsg, const std::string& strValue);
+
+ /** "SS002|KEY[value]\n" */
+ std::string FormatScipMsg(const std::string& strMsg, const std::string& strValue) const;
+
+ /**
+    Look up and execute one tokenized SCIP command (command name + args).
+    Serialized on m_mtxDispatch: commands can come from both the
+    named pipe (RunBase() thread), the socket-server thread, and the
+    async worker.  A trailing "#id"/"#!id" tag argument is removed first.
+    @return handler status, or UNIX_ERROR_STATUS for unknown commands
+  */
+ int DispatchCommand(const std::vector<std::string>& vStrCmdIn);
+
+ /**
+    Split one SCIP command string, e.g. "SS002|setgain[500]", into
+    {"SETGAIN","500"}.  Commands addressed to another device are ignored.
+    @return number of tokens (0 if nothing to execute)
+  */
+ int TokenizeScipCommand(const std::string& strCmdIn,
+                         std::vector<std::string>& vStrCmd);
+
+ /** DispatchCommand() after the option arguments have been removed */
+ int DispatchParsedCommand(const std::vector<std::string>& vStrCmd,
+                           const CommandOptions& options);
+
+ /** Run a camera query, or answer it from the cache if it missed its deadline */
+ int DispatchQuery(const std::vector<std::string>& vStrCmd,
+                   const CommandOptions& options);
+
+ /** Remove trailing "#id", "#!id", and "~ms" arguments into options */
+ void ParseCommandOptions(std::vector<std::string>& vStrCmd, CommandOptions& options);
+
+ /** Default staleness window for a query (0 = never stale) */
+ int GetQueryStaleMs(const std::string& strCmd);
+
+ static uint64_t GetMonotonicMs(void);
+
+ /** Append "#id" to every line of a formatted SCIP message */
+ std::string TagScipMessage(const std::string& strMsg, const std::string& strTag);
+
+ /** Queue a "#!id" command for the worker thread and ship ACCEPTED/BUSY */
+ int QueueAsyncCommand(const std::vector<std::string>& vStrCmd, const CommandOptions& options);
+
+ /** Asynchronous-command worker thread */
+ int StartAsyncWorker(void);
+ void StopAsyncWorker(void);
+ void AsyncWorkerThread(void);
+
+ /** Number of asynchronous commands not yet completed */
+ size_t GetAsyncPending(void);
+
+ /** Set up every constructor's transport/thread members the same way */
+ void InitControllerMembers(void);
+
+ /** Open the SOCK_SEQPACKET socket and start its thread (unix_seqpacket only) */
+ int StartScipSocketServer(void);
+ void StopScipSocketServer(void);
+
+ /** Socket-server thread: read client messages and dispatch their commands */
+ void ScipSocketServerThread(void);
+
+ /** Create the SCIP output queue and its named-pipe channel (depth>0 only) */
+ int StartOutputQueue(void);
+ void StopOutputQueue(void);
+
+ /** Output-queue opener for the to-main FIFO: non-blocking, write-only */
+ int OpenScipPipeNonBlocking(void);
+
+ /** Output-queue writer for transports we can only reach through m_pPipeComms */
+ int WritePipeComms(const std::string& strMsg);
+
+ /** Create the frame source and start the capture engine (capture_enable=1 only) */
+ int StartCapture(void);
+ void StopCapture(void);
+
+ /** Attach the YUV video output to the capture engine (video_output_enable=1 only) */
+ int StartVideoOutput(void);
+ void StopVideoOutput(void);
+
+ /** Attach the shared-memory frame ring to the capture engine (frame_ring_enable=1 only) */
+ int StartFrameRing(void);
+ void StopFrameRing(void);
+
+ /** Attach the auto-exposure loop to the capture engine (capture_enable=1 only) */
+ int StartAutoExposure(void);
+ void StopAutoExposure(void);
+
+ /** Auto-exposure ApplyFn: command IT and gain over the serial link */
+ int ApplyAutoExposure(const int nIntegrationTime, const int nGain, uint32_t& nVersion);
+
+ /** Attach the white-balance loop to the capture engine (capture_enable=1 only) */
+ int StartAutoWhiteBalance(void);
+ void StopAutoWhiteBalance(void);
+
+ /** White-balance loop hooks: @WB, @WB? and the end of an AWB_ONCE[] run */
+ int ApplyAutoWhiteBalance(const int anRgb[3], uint32_t& nVersion);
+ int QueryAutoWhiteBalance(int anRgb[3], uint32_t& nVersion);
+ void OnAutoWhiteBalanceDone(const bool bConverged, const int anRgb[3]);
+
+ /** Attach the frame statistics stage to the capture engine (frame_stats_enable=1) */
+ int StartFrameStats(void);
+ void StopFrameStats(void);
+
+ /** Frame statistics push thread: FRAME_STATS[...] unsolicited */
+ void PushFrameStats(const EosAdimecFrameStats::FrameStats& stats);
+
+ /** seq=..,version=..,ms=..,r_mean=..,r_min=..,...,b_black=.. */
+ static std::string FormatFrameStats(const EosAdimecFrameStats::FrameStats& stats);
+
+ /** Attach the focus score to the capture engine (focus_enable=1) */
+ int StartFocus(void);
+ void StopFocus(void);
+
+ /** Focus push thread: FOCUS[...] unsolicited */
+ void PushFocus(const EosAdimecFocus::FocusResult& result);
+
+ /** seq=..,version=..,changing=..,method=..,score=..,roi=x;y;w;h,ms=.. */
+ static std::string FormatFocus(const EosAdimecFocus::FocusResult& result);
+
+ /** Attach the pre-trigger recorder to the capture engine (recorder_enable=1) */
+ int StartRecorder(void);
+ void StopRecorder(void);
+
+ /** Camera (or synthetic source) frame period, 0 if unknown */
+ uint64_t GetFramePeriodNs(void);
+
+ /** Recorder saver thread: the end of a TRIGGER_SAVE */
+ void OnRecorderSaveDone(const EosAdimecRecorder::SaveResult& result);
+
+ /** Attach the snapshot stage to the capture engine (snapshot_enable=1) */
+ int StartSnapshot(void);
+ void StopSnapshot(void);
+
+ /** Snapshot encoder thread: the end of a SNAPSHOT, on the requester's route */
+ void OnSnapshotDone(const EosAdimecSnapshot::SnapshotResult& result);
+
+ /** Send snapshot_stream_mode (leave triggered mode) */
+ void RestoreSnapshotStreamMode(void);
+
+ /** Attach the preview stage to the capture engine (preview_enable=1) */
+ int StartPreview(void);
+ void StopPreview(void);
+
+ /** Start a new archive / close it (archive_enable=1 or SET_ARCHIVE[]) */
+ int StartArchive(void);
+ void StopArchive(void);
+
+ /** Attach the dark/flat correction as the pipeline's correction stage */
+ int StartCorrection(void);
+ void StopCorrection(void);
+
+ /** Correction reference thread: the end of a CAPTURE_DARK/CAPTURE_FLAT */
+ void OnCorrectionCaptureDone(const EosAdimecCorrection::CaptureResult& result);
+
+ /**
+    The camera orders white balance B,G,R (@WBb;g;r, and "b,g,r" back
+    from @WB?); everything above the serial link is R,G,B.
+  */
+ static std::string WbToCamera(const std::vector<std::string>& vStrRgb);
+ static bool WbFromCamera(const std::string& strCamera, std::vector<std::string>& vStrRgb);
+
+ /** A camera setting was ACKed: commit a new settings version */
+ void UpdateFrameSettings(void);
+
+ /** A SET sent with PdvSerialWriteSetting() failed: drop its pending change */
+ void AbandonFrameSettings(void);
+
+ /** SETTINGS_VERSION[N] after a successful SET */
+ void ShipSettingsVersion(void);
+
+ /** Socket-server hooks: give each client its own output channel */
+ bool CanReadScipSocketClient(int nClientFd);
+ void OnScipSocketClientAccepted(int nClientFd);
+ void OnScipSocketClientDropped(int nClientFd);
+
  /**
     Compose a SCIP-format device-response message.
   */
@@ -474,11 +1051,51 @@ class EosAdimec : public EosDevice
  int HandleGetImageFormat(const std::vector<std::string>& vStrArgs);
  int HandleSetImageFormat(const std::vector<std::string>& vStrArgs);
 
+ int HandleGetStats(const std::vector<std::string>& vStrArgs);
+
+ int HandleGetFirstFrame(const std::vector<std::string>& vStrArgs);
+
+ int HandleSetAutoExposure(const std::vector<std::string>& vStrArgs);
+ int HandleGetAutoExposure(const std::vector<std::string>& vStrArgs);
+
+ int HandleAutoWhiteBalanceOnce(const std::vector<std::string>& vStrArgs);
+ int HandleSetAutoWhiteBalance(const std::vector<std::string>& vStrArgs);
+ int HandleGetAutoWhiteBalance(const std::vector<std::string>& vStrArgs);
+
+ int HandleGetFrameStats(const std::vector<std::string>& vStrArgs);
+ int HandleSetFrameStats(const std::vector<std::string>& vStrArgs);
+
+ int HandleGetFocus(const std::vector<std::string>& vStrArgs);
+ int HandleSetFocus(const std::vector<std::string>& vStrArgs);
+
+ int HandleTriggerSave(const std::vector<std::string>& vStrArgs);
+ int HandleGetRecorder(const std::vector<std::string>& vStrArgs);
+
+ int HandleSnapshot(const std::vector<std::string>& vStrArgs);
+
+ int HandleGetPreview(const std::vector<std::string>& vStrArgs);
+ int HandleSetPreview(const std::vector<std::string>& vStrArgs);
+
+ int HandleGetArchive(const std::vector<std::string>& vStrArgs);
+ int HandleSetArchive(const std::vector<std::string>& vStrArgs);
+
+ int HandleCaptureReference(const std::vector<std::string>& vStrArgs);
+ int HandleGetCorrection(const std::vector<std::string>& vStrArgs);
+ int HandleSetCorrection(const std::vector<std::string>& vStrArgs);
+
+ int HandleSetToneMap(const std::vector<std::string>& vStrArgs);
+ int HandleGetToneMap(const std::vector<std::string>& vStrArgs);
+ int HandleGetPipeline(const std::vector<std::string>& vStrArgs);
+ int HandleGetFramePools(const std::vector<std::string>& vStrArgs);
+
  // Calls Euresys clSerial fcns to force a reconnect.
  /// int ResetSerialConnection(void);
 
  int PdvSerialWrite(const std::string& strCmd);
  int PdvSerialRead(std::string& strResp);
+
+ /** PdvSerialWrite() of a SET: also marks a settings change pending */
+ int PdvSerialWriteSetting(const std::string& strCmd);
  
  int m_nTimeOutCount;
 
@@ -487,14 +1104,114 @@ class EosAdimec : public EosDevice
   /** Info read from Adimec configuration file. */
   EosSlaveCameraConfigInfo m_EosSensorConfigInfo;
 
+  /** Adimec-only keys read from the same configuration file. */
+  EosAdimecConfigInfo m_EosAdimecConfigInfo;
+
+  /** Serializes command dispatch (and so serial-port access) across threads */
+  boost::recursive_mutex m_mtxDispatch;
+
+  /** Reply route for the command currently being dispatched */
+  E_REPLY_ROUTE m_eReplyRoute;
+  int m_nReplyClientFd;
+  std::string m_strReplyTag;   // "" if the command had no correlation tag
+
+  /** Asynchronous ("#!id") commands, executed in order by m_pAsyncThread */
+  std::deque<AsyncCommand> m_dqAsyncCommands;
+  boost::mutex m_mtxAsync;
+  boost::condition_variable m_cvAsync;
+  boost::thread* m_pAsyncThread;
+  std::atomic<bool> m_abAsyncThreadStop;
+  bool m_bAsyncBusy;           // Worker is executing a command (guarded by m_mtxAsync)
+
+  /** Query deadlines (guarded by m_mtxDispatch) */
+  uint64_t m_nCommandArrivalMs;   // Arrival time of the command being dispatched
+  uint64_t m_nPipeCycleStartMs;   // Start of the current named-pipe dispatch cycle
+  uint64_t m_nPipeLastDoneMs;     // When the last named-pipe command finished
+  std::map<std::string, CachedQuery> m_mapQueryCache;   // "GETGAIN" etc. --> response
+  bool m_bCaptureQuery;           // ShipRawToSCIP() appends to m_strQueryCapture
+  std::string m_strQueryCapture;
+  unsigned long m_nStaleFromCache;
+  unsigned long m_nStaleTimeouts;
+
+  /** SOCK_SEQPACKET SCIP transport (NULL unless scip_transport=unix_seqpacket) */
+  EosAdimecSeqPacketServer* m_pSeqPacketServer;
+  boost::thread* m_pSocketThread;
+  std::atomic<bool> m_abSocketThreadStop;
+
+  /** Named pipe EosDevice-->EosMain (for the output queue's own non-blocking fd) */
+  std::string m_strScipPipeToMain;
+
+  /** Non-blocking SCIP output queue (NULL if scip_output_queue_depth=0) */
+  EosAdimecOutputQueue* m_pOutputQueue;
+
+  /** In-process frame capture (NULL unless capture_enable=1) */
+  EosAdimecCapture* m_pCapture;
+
+  /** YUV frames for linked_video (NULL unless video_output_enable=1) */
+  EosAdimecVideoOutput* m_pVideoOutput;
+
+  /** Shared-memory frame ring (NULL unless frame_ring_enable=1) */
+  EosAdimecFrameRing* m_pFrameRing;
+
+  /** Camera settings known to be in effect (from successful SET commands; -1 = unknown) */
+  EosAdimecFrameSettings m_frameSettings;
+
+  /** Settings versions --> frames (NULL unless capturing; guarded by m_mtxDispatch) */
+  EosAdimecSettingsTracker* m_pSettingsTracker;
+
+  /** Auto-exposure loop (NULL unless capturing) */
+  EosAdimecAutoExposure* m_pAutoExposure;
+
+  /** White-balance loop (NULL unless capturing) */
+  EosAdimecAutoWhiteBalance* m_pAutoWhiteBalance;
+
+  /** Frame statistics stage (NULL unless capturing with frame_stats_enable=1) */
+  EosAdimecFrameStats* m_pFrameStats;
+
+  /** Focus score (NULL unless capturing with focus_enable=1) */
+  EosAdimecFocus* m_pFocus;
+
+  /** Pre-trigger recorder (NULL unless capturing with recorder_enable=1) */
+  EosAdimecRecorder* m_pRecorder;
+
+  /** Still frames (NULL unless capturing with snapshot_enable=1) */
+  EosAdimecSnapshot* m_pSnapshot;
+
+  /** Reply route and tag of the running SNAPSHOT (guarded by m_mtxDispatch) */
+  E_REPLY_ROUTE m_eSnapshotRoute;
+  int m_nSnapshotClientFd;
+  std::string m_strSnapshotTag;
+
+  /** Downscaled previews (NULL unless capturing with preview_enable=1) */
+  EosAdimecPreview* m_pPreview;
+
+  /** Raw frame archive (NULL unless archiving) */
+  EosAdimecArchive* m_pArchive;
+
+  /** Dark/flat correction (NULL unless capturing) */
+  EosAdimecCorrection* m_pCorrection;
+
+  /** Shared by the per-frame stages (NULL unless capturing) */
+  EosAdimecTileExecutor* m_pTileExecutor;
+
+  /** The stages' frame graph (NULL unless capturing), and its capture consumer ID */
+  EosAdimecPipeline* m_pPipeline;
+  int m_nPipelineConsumerId;
+
+  /** CLOCK_MONOTONIC of the last serial write and read, for UpdateFrameSettings() */
+  uint64_t m_nSerialWriteNs;
+  uint64_t m_nSerialReadNs;
+
+  /** EDT channel, from [slavecamera] channel */
+  int m_nEdtChannel;
+
   /**
      This creates the mapping between SCIP commands and device-controller
      command functions.  Each command fcn takes a vector of strings as
      an arg list.  The first vector element is the name of the SCIP command;
-     the remaining vector elements are the SCIP command args. */
-  std::map<std::string, 
-    boost::function<int (EosAdimec*, const std::vector<std::string>&) > > 
-    m_mapCommandTemplate;
+     the remaining vector elements are the SCIP command args.  Each
+     command is also marked as a camera query, a camera set, or local. */
+  std::map<std::string, CommandEntry> m_mapCommandTemplate;
 
 };
 
@@ -0,0 +1,164 @@
+/**
+   Raw frame archive: every frame to disk at full rate, indexed by time
+   (layout in EosAdimecArchiveLayout.h; read with EosAdimecArchiveReader,
+   which maps the segments).
+
+   The capture thread copies each frame into a staging slot in RAM (a
+   frame pool, EosAdimecFramePool: page aligned and faulted in at
+   Start(), so the copy is a plain memcpy: no system call, no page fault,
+   no allocation).  A
+   flusher thread (niced) writes the staged records into preallocated
+   segment files with O_DIRECT, straight from the staging ring, so the
+   archive does not pass through (or crowd) the page cache.  It makes
+   them durable (fdatasync) and only then appends their index entries.
+
+   Writing into a shared mapping of the segment was tried and rejected:
+   every first touch of a page is a filesystem fault on the capture
+   thread (ext4: 14 ms per 1600x1200 frame, stalls over 250 ms while
+   write-back runs).
+
+   The capture thread never waits for the disk: if the staging ring is
+   full (disk too slow), or archive_max_gb is reached, the frame is
+   skipped and counted.  Where O_DIRECT is not supported (tmpfs) the
+   flusher falls back to buffered writes and drops the pages behind it.
+   Packed (archive_packed), the copy packs each frame to its bit depth
+   (EosAdimecPack): 12-bit frames take 3/4 of the disk bandwidth.
+ */
+#pragma once
+
+#include <stdint.h>
+
+#include <atomic>
+#include <deque>
+#include <string>
+
+#include <boost/thread/thread.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/condition_variable.hpp>
+
+#include "EosAdimecFrameSource.h"
+#include "EosAdimecFramePool.h"
+#include "EosAdimecArchiveLayout.h"
+
+class EosAdimecArchive
+{
+  public:
+
+    /** Archive counters */
+    struct ArchiveStats
+    {
+        std::string strDir;         // This archive's directory
+        unsigned long nSegments;    // Segment files created
+        unsigned long nFrames;      // Frames on disk and indexed
+        uint64_t nBytes;            // Record bytes on disk
+        unsigned long nStaged;      // Copied in, not on disk yet
+        unsigned long nSkipped;     // Staging ring full, archive full or failed
+        unsigned long nTooBig;      // Bigger than a staging slot
+        bool bDirect;               // Writing with O_DIRECT
+        bool bFull;                 // nMaxBytes reached
+        bool bFailed;               // Disk error: archiving stopped
+        std::string strError;
+        double dFlushMs;            // Last batch: write + fdatasync + index
+    };
+
+    /**
+       @param strBaseDir -- each Start() makes a new archive directory here
+       @param strPrefix -- archive directory name prefix
+       @param nSegmentBytes -- preallocated size of each segment
+       @param nMaxBytes -- stop archiving past this many segment bytes (0 = no limit)
+       @param nStagingFrames -- frames the staging ring holds
+       @param bPacked -- archive frames packed to their bit depth
+     */
+    EosAdimecArchive(const std::string& strBaseDir, const std::string& strPrefix,
+                     const size_t nSegmentBytes, const uint64_t nMaxBytes,
+                     const int nStagingFrames, const bool bPacked);
+    virtual ~EosAdimecArchive(void);
+
+    /**
+       Create the archive directory, its index and the first segment,
+       allocate the staging ring, and start the flusher.
+       @param nFrameBytes -- largest frame (EosAdimecCapture::GetFrameBytes(), or
+                            EosAdimecPack::MaxPackedBytes() of it if packed)
+       @return UNIX_OK_STATUS or UNIX_ERROR_STATUS
+     */
+    int Start(const size_t nFrameBytes);
+
+    /** Write out what is staged and close everything (after the consumer is removed) */
+    void Stop(void);
+
+    /** Capture consumer: copy the frame into the staging ring */
+    void OnFrame(const EosAdimecRawFrame& frame);
+
+    ArchiveStats GetStats(void);
+
+    /** RAM the staging slots take (after Start()) */
+    size_t GetStagingBytes(void) const {return m_pPool ? m_pPool->GetBytes() : 0;};
+
+    /** RAM a staging ring of nStagingFrames frames of nFrameBytes takes (before Start()) */
+    static size_t StagingBytes(const size_t nFrameBytes, const int nStagingFrames);
+
+  protected:
+
+    /** A staged frame */
+    struct Pending
+    {
+        int nSlot;
+        size_t nRecordBytes;        // Meta + data, rounded to RECORD_ALIGN
+        EosAdimecArchiveIndexEntry entry;   // nSegment/nOffset set by the flusher
+    };
+
+    /** Close the current segment (if any) and open the next (flusher) */
+    bool NextSegment(void);
+
+    /** Write the segment header, trim the file to what was used, close */
+    void CloseSegment(void);
+
+    /** pwrite() all of it at nOffset on the current segment */
+    bool WriteSegment(const void* pData, const size_t nBytes, const uint64_t nOffset);
+
+    void FlusherThread(void);
+
+    /** Write a batch of staged frames, make it durable, index it */
+    void FlushBatch(std::deque<Pending>& dqBatch);
+
+    void Fail(const std::string& strError);
+
+    std::string m_strBaseDir;
+    std::string m_strPrefix;
+    size_t m_nSegmentBytes;
+    uint64_t m_nMaxBytes;
+    int m_nStagingFrames;
+    bool m_bPacked;
+
+    std::string m_strDir;
+    int m_nIndexFd;
+
+    /** Staging: m_nStagingFrames slots of m_nSlotBytes */
+    size_t m_nSlotBytes;
+    EosAdimecFramePool* m_pPool;
+
+    /** Flusher only: the segment being written */
+    int m_nSegmentFd;
+    uint32_t m_nSegment;
+    uint64_t m_nSegmentOffset;      // Next record
+    uint64_t m_nSegmentFrames;
+    bool m_bDirect;
+    uint8_t* m_pHeaderBlock;        // RECORD_ALIGN bytes, aligned for O_DIRECT
+
+    boost::thread* m_pFlusherThread;
+    std::atomic<bool> m_abStop;
+    std::atomic<bool> m_abFailed;
+
+    /** Guards everything below */
+    boost::mutex m_mtxArchive;
+    boost::condition_variable m_cvArchive;
+    std::deque<Pending> m_dqPending;
+    unsigned long m_nSegments;
+    unsigned long m_nFrames;
+    uint64_t m_nBytes;
+    unsigned long m_nSkipped;
+    unsigned long m_nTooBig;
+    bool m_bFull;
+    std::string m_strError;
+    double m_dFlushMs;
+};
@@ -0,0 +1,82 @@
+/**
+   On-disk layout of a raw frame archive (EosAdimecArchive, writer;
+   EosAdimecArchiveReader, readers).  Plain structs only, like
+   EosAdimecFrameRingLayout.h, so review tools can read archives without
+   boost or EDT headers.
+
+   An archive is one directory:
+      index.eidx        EosAdimecArchiveIndexHeader, then one
+                        EosAdimecArchiveIndexEntry per frame, in capture
+                        order (nSequence and nTimeNs increase)
+      seg_000000.eseg   segments, numbered from 0
+      seg_000001.eseg
+      ...
+
+   A segment is:
+      EosAdimecArchiveSegmentHeader             (nHeaderBytes, page aligned)
+      then per frame, each record page aligned:
+         EosAdimecFrameMeta                     (nFrameMetaBytes)
+         pixel data                             (meta.nDataBytes)
+
+   Pixel data is as in the frame ring: one 16-bit word per pixel,
+   LSB-aligned, nWidth words per row, Bayer order per the meta flags, or
+   packed per meta.nPixelFormat (archive_packed; see EosAdimecPack.h).
+
+   The index is the commit record: an entry is appended only once its
+   frame is on disk, so every indexed frame can be read, even from a
+   live archive (re-read the index to see new frames).  A segment's
+   nFrames and nUsedBytes are written when it is closed; the last
+   segment of an archive that was not stopped cleanly keeps 0 and its
+   preallocated size, and the index still says what is in it.
+ */
+#pragma once
+
+#include <stdint.h>
+
+#include "EosAdimecFrameRingLayout.h"
+
+struct EosAdimecArchiveIndexHeader
+{
+    uint32_t nMagic;
+    uint32_t nVersion;
+    uint32_t nHeaderBytes;          // Offset of the first entry
+    uint32_t nEntryBytes;           // sizeof(EosAdimecArchiveIndexEntry) when written
+    int64_t nStartWallSec;          // CLOCK_REALTIME when the archive was created
+    int64_t nStartWallNsec;
+    uint64_t nSegmentBytes;         // Preallocated size of each segment
+};
+
+struct EosAdimecArchiveIndexEntry
+{
+    uint64_t nSequence;             // As in the frame meta
+    uint64_t nTimeNs;               // CLOCK_MONOTONIC
+    int64_t nWallSec;               // CLOCK_REALTIME
+    int64_t nWallNsec;
+    uint32_t nSegment;              // seg_<nSegment>.eseg
+    uint32_t nSettingsVersion;      // meta.settings.nVersion
+    uint64_t nOffset;               // Record (meta) offset in the segment
+    uint64_t nDataBytes;            // Pixel bytes after the meta
+};
+
+struct EosAdimecArchiveSegmentHeader
+{
+    uint32_t nMagic;
+    uint32_t nVersion;
+    uint32_t nSegment;
+    uint32_t nHeaderBytes;          // Offset of the first record
+    uint32_t nFrameMetaBytes;       // sizeof(EosAdimecFrameMeta) when written
+    uint32_t nPad;
+    uint64_t nFrames;               // Records (0 until closed)
+    uint64_t nUsedBytes;            // File size once closed (0 until closed)
+};
+
+/** Archive constants */
+struct EosAdimecArchiveConst
+{
+    static const uint32_t INDEX_MAGIC=0x49524145;     // "EARI"
+    static const uint32_t SEGMENT_MAGIC=0x53524145;   // "EARS"
+    static const uint32_t VERSION=2;
+
+    /** Record alignment in a segment */
+    static const uint32_t RECORD_ALIGN=4096;
+};
@@ -0,0 +1,85 @@
+/**
+   Reader side of the raw frame archive (see EosAdimecArchiveLayout.h).
+   No boost or EDT dependencies: link EosAdimecArchiveReader.o into
+   review tools (EosAdimecArchiveTool is one).
+
+      EosAdimecArchiveReader reader;
+      reader.Open("/var/tmp/eosadimec_ss002_archive/ss002_20261019_120000");
+      size_t nFirst=reader.FindTime(nStartNs);
+      size_t nEnd=reader.FindTime(nEndNs);
+      for(size_t iframe=nFirst; iframe<nEnd; iframe++)
+      {
+          EosAdimecArchiveReader::FrameView view;
+          if(0==reader.ReadFrame(iframe,view))
+              ... view.pData, view.meta ...
+      }
+
+   The index is memory-mapped and searched in place (binary search, no
+   scan), and segments are mapped as frames in them are read.  Refresh()
+   picks up frames a live archive has indexed since.
+ */
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include <string>
+
+#include "EosAdimecArchiveLayout.h"
+
+class EosAdimecArchiveReader
+{
+  public:
+
+    /** A frame in a mapped segment */
+    struct FrameView
+    {
+        EosAdimecFrameMeta meta;
+        const uint16_t* pData;      // Valid until a frame from another segment is read, or Close()
+                                    // (packed bytes if meta.nPixelFormat!=0)
+    };
+
+    EosAdimecArchiveReader(void);
+    virtual ~EosAdimecArchiveReader(void);
+
+    /** Map the archive's index.  0 on success, -1 on error. */
+    int Open(const std::string& strDir);
+    void Close(void);
+
+    /** Re-map the index if the writer has added frames.  0 or -1. */
+    int Refresh(void);
+
+    const EosAdimecArchiveIndexHeader& GetHeader(void) const {return *m_pHeader;};
+    size_t GetFrameCount(void) const {return m_nFrames;};
+    const EosAdimecArchiveIndexEntry& GetEntry(const size_t nFrame) const {return m_pEntries[nFrame];};
+
+    /**
+       First frame at or after a time, or with at least a sequence number.
+       @return the frame number, or GetFrameCount() if there is none
+     */
+    size_t FindTime(const uint64_t nTimeNs) const;                      // CLOCK_MONOTONIC
+    size_t FindWallTime(const int64_t nWallSec, const int64_t nWallNsec) const;
+    size_t FindSequence(const uint64_t nSequence) const;
+
+    /** Map frame nFrame.  0, or -1 if its segment is missing or short. */
+    int ReadFrame(const size_t nFrame, FrameView& view);
+
+  protected:
+
+    int MapSegment(const uint32_t nSegment);
+    void UnmapSegment(void);
+
+    std::string m_strDir;
+
+    int m_nIndexFd;
+    uint8_t* m_pIndex;
+    size_t m_nIndexBytes;
+    const EosAdimecArchiveIndexHeader* m_pHeader;
+    const EosAdimecArchiveIndexEntry* m_pEntries;
+    size_t m_nFrames;
+
+    /** The segment last read from */
+    int64_t m_nSegment;             // -1 = none
+    uint8_t* m_pSegment;
+    size_t m_nSegmentBytes;
+};
@@ -0,0 +1,132 @@
+/**
+   In-process auto-exposure.
+
+   A capture consumer meters frames (a luminance histogram of the metering
+   ROI, from 2x2 Bayer quads) and a loop thread steers the exposure
+   (integration time x gain) toward a target mean level.  Integration time
+   goes first: gain only rises above its minimum once the integration time
+   is at its limit (the frame period, or the camera maximum), and comes
+   down first.  The exposure is never raised so far that the 95th
+   percentile of the histogram would saturate.
+
+   Each iteration meters the first frame that was exposed entirely with
+   the last commanded settings (EosAdimecSettingsTracker: frame version
+   >= commanded version, not changing).  The loop therefore settles in one
+   frame per step instead of waiting out a few frame periods.  The loop
+   rate caps how often it commands the camera.
+
+   The camera is commanded through an ApplyFn supplied by the controller
+   (serial @IT/@GA under its dispatch lock).  It returns the new settings
+   version.  The limits passed in are the ones the controller enforces
+   for SETIT/SETGAIN.
+ */
+#pragma once
+
+#include <stdint.h>
+
+#include <atomic>
+
+#include <boost/thread/thread.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/function.hpp>
+
+#include "EosAdimecFrameSource.h"
+
+class EosAdimecAutoExposure
+{
+  public:
+
+    /** Settable through SCIP */
+    struct AeParams
+    {
+        bool bEnable;
+        int nTargetPct;             // Target mean level, % of full scale (1-99)
+        int nRoiX;                  // Metering ROI (pixels; nRoiW/nRoiH 0 = whole frame)
+        int nRoiY;
+        int nRoiW;
+        int nRoiH;
+        int nRateHz;                // Max loop iterations per second (1-100)
+    };
+
+    /** Loop state and counters */
+    struct AeStatus
+    {
+        bool bConverged;            // Last metered level within the deadband
+        double dMeanPct;            // Last metered mean level
+        double dSaturatedPct;       // Last metered share of saturated pixels
+        int nIntegrationTime;       // Last commanded (-1 = none yet)
+        int nGain;
+        unsigned long nIterations;  // Frames metered
+        unsigned long nCommands;    // Exposure changes sent
+        unsigned long nErrors;      // Changes the camera refused
+    };
+
+    /**
+       Command IT and gain.
+       @param nVersion -- out: settings version once applied
+       @return UNIX_OK_STATUS or UNIX_ERROR_STATUS
+     */
+    typedef boost::function<int (const int nIntegrationTime, const int nGain,
+                                 uint32_t& nVersion)> ApplyFn;
+
+    /**
+       @param fnApply -- commands the camera
+       @param nItMin, nItMax -- integration time range (SETIT units)
+       @param nGainMin, nGainMax -- gain range (SETGAIN units, 100 = x1)
+     */
+    EosAdimecAutoExposure(ApplyFn fnApply, const int nItMin, const int nItMax,
+                          const int nGainMin, const int nGainMax);
+
+    virtual ~EosAdimecAutoExposure(void);
+
+    int Start(void);
+    void Stop(void);
+
+    /** Capture consumer: meter the frame if the loop is waiting for one */
+    void OnFrame(const EosAdimecRawFrame& frame);
+
+    void SetParams(const AeParams& params);
+    AeParams GetParams(void);
+
+    AeStatus GetStatus(void);
+
+  protected:
+
+    /** One metered frame */
+    struct Metering
+    {
+        double dMeanPct;
+        double dSaturatedPct;
+        double dHighPct;            // Highlight percentile level, % of full scale
+        EosAdimecFrameSettings settings;
+    };
+
+    /** Loop thread: meter, work out the new exposure, command it */
+    void LoopThread(void);
+
+    /** One loop step.  Returns false if the camera refused the change. */
+    bool Step(const Metering& metering);
+
+    /** Luminance histogram (8-bit bins) of the ROI */
+    void Meter(const EosAdimecRawFrame& frame, const AeParams& params, Metering& metering);
+
+    ApplyFn m_fnApply;
+    int m_nItMin;
+    int m_nItMax;
+    int m_nGainMin;
+    int m_nGainMax;
+
+    boost::thread* m_pLoopThread;
+    std::atomic<bool> m_abStop;
+
+    /** Guards everything below */
+    boost::mutex m_mtxAe;
+    boost::condition_variable m_cvAe;
+    AeParams m_params;
+    AeStatus m_status;
+    bool m_bWantFrame;            // Loop waits for a metered frame
+    uint32_t m_nWaitVersion;      // ... with at least this settings version
+    bool m_bHaveMetering;
+    Metering m_metering;
+};
@@ -0,0 +1,172 @@
+/**
+   In-process automatic white balance.
+
+   A capture consumer sums R, G and B over the raw Bayer quads of a frame
+   (EosAdimecBayer::SumChannels(), SIMD) and a loop thread works out the
+   camera white-balance gains (@WB, 100-399 per channel) that would bring
+   the frame to neutral:
+
+      gray world  -- the average of the frame is gray
+      white patch -- the brightest quads (top 5%) are white
+
+   Quads with a clipped pixel are left out of both.  The correction is a
+   ratio per channel against green (red' = red * G/R, blue' = blue * G/B);
+   green stays put unless red or blue would leave 100-399, in which case
+   all three are rescaled to fit.
+
+   Hysteresis: a correction is only sent once red or blue is off by more
+   than the hysteresis percentage; the loop then keeps correcting until
+   both are within a quarter of it.  Continuous mode doesn't chatter on
+   noise, and a drift has to be real before the camera is touched.
+
+   Once mode corrects until settled (or AWB_ONCE_MAX_STEPS), then turns
+   itself off and reports through the DoneFn.
+
+   Like EosAdimecAutoExposure, each iteration meters the first frame
+   taken with its last change (settings version, not changing).  The
+   camera is commanded through an ApplyFn supplied by the controller
+   (serial @WB under its dispatch lock); gains are in R,G,B order here,
+   the controller puts them in the camera's B,G,R order.
+ */
+#pragma once
+
+#include <stdint.h>
+
+#include <atomic>
+#include <string>
+
+#include <boost/thread/thread.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/function.hpp>
+
+#include "EosAdimecFrameSource.h"
+
+class EosAdimecAutoWhiteBalance
+{
+  public:
+
+    enum E_AWB_MODE
+    {
+        eAwbOff,
+        eAwbOnce,               // Correct until settled, then off
+        eAwbContinuous
+    };
+
+    enum E_AWB_METHOD
+    {
+        eAwbGrayWorld,
+        eAwbWhitePatch
+    };
+
+    /** Settable through SCIP */
+    struct AwbParams
+    {
+        E_AWB_MODE eMode;
+        E_AWB_METHOD eMethod;
+        int nHysteresisPct;         // Correct only past this error (1-50)
+        int nRateHz;                // Max loop iterations per second (1-100)
+        int nBlackLevel;            // Subtracted from the channel means (raw counts)
+    };
+
+    /** Loop state and counters */
+    struct AwbStatus
+    {
+        bool bConverged;            // Last metering within the hysteresis
+        double dRedError;           // Last metering: G/R and G/B, 1.0 = neutral
+        double dBlueError;
+        unsigned long nQuads;       // Quads the last metering used
+        int anRgb[3];               // Last commanded (-1 = none yet)
+        unsigned long nIterations;  // Frames metered
+        unsigned long nCommands;    // Gain changes sent
+        unsigned long nErrors;      // Changes the camera refused
+    };
+
+    /**
+       Command the gains (R,G,B order).
+       @param nVersion -- out: settings version once applied
+       @return UNIX_OK_STATUS or UNIX_ERROR_STATUS
+     */
+    typedef boost::function<int (const int anRgb[3], uint32_t& nVersion)> ApplyFn;
+
+    /**
+       Read the camera gains when the frame settings don't have them.
+       @return UNIX_OK_STATUS or UNIX_ERROR_STATUS
+     */
+    typedef boost::function<int (int anRgb[3], uint32_t& nVersion)> QueryFn;
+
+    /** A once run is over: settled or not, and the gains it left */
+    typedef boost::function<void (const bool bConverged, const int anRgb[3])> DoneFn;
+
+    /**
+       @param nGainMin, nGainMax -- @WB range (SETRGB units)
+     */
+    EosAdimecAutoWhiteBalance(ApplyFn fnApply, QueryFn fnQuery, DoneFn fnDone,
+                              const int nGainMin, const int nGainMax);
+
+    virtual ~EosAdimecAutoWhiteBalance(void);
+
+    int Start(void);
+    void Stop(void);
+
+    /** Capture consumer: meter the frame if the loop is waiting for one */
+    void OnFrame(const EosAdimecRawFrame& frame);
+
+    void SetParams(const AwbParams& params);
+    AwbParams GetParams(void);
+
+    /** Start a once run (whatever the mode was) */
+    void RunOnce(void);
+
+    AwbStatus GetStatus(void);
+
+    /** "off"/"once"/"continuous" --> mode.  Returns false for other strings. */
+    static bool ModeFromString(const std::string& strMode, E_AWB_MODE& eMode);
+    static std::string ModeName(const E_AWB_MODE eMode);
+
+    /** "gray_world"/"white_patch" --> method.  Returns false for other strings. */
+    static bool MethodFromString(const std::string& strMethod, E_AWB_METHOD& eMethod);
+    static std::string MethodName(const E_AWB_METHOD eMethod);
+
+  protected:
+
+    /** One metered frame: channel means, black level off */
+    struct Metering
+    {
+        double dRed;
+        double dGreen;
+        double dBlue;
+        unsigned long nQuads;
+        EosAdimecFrameSettings settings;
+    };
+
+    /** Loop thread: meter, work out the new gains, command them */
+    void LoopThread(void);
+
+    /** One loop step */
+    void Step(const Metering& metering);
+
+    /** Channel means over the quads the method picks */
+    void Meter(const EosAdimecRawFrame& frame, const AwbParams& params, Metering& metering);
+
+    ApplyFn m_fnApply;
+    QueryFn m_fnQuery;
+    DoneFn m_fnDone;
+    int m_nGainMin;
+    int m_nGainMax;
+
+    boost::thread* m_pLoopThread;
+    std::atomic<bool> m_abStop;
+
+    /** Guards everything below */
+    boost::mutex m_mtxAwb;
+    boost::condition_variable m_cvAwb;
+    AwbParams m_params;
+    AwbStatus m_status;
+    bool m_bCorrecting;           // Past the hysteresis, not settled yet
+    int m_nOnceSteps;             // Steps into the current once run
+    bool m_bWantFrame;            // Loop waits for a metered frame
+    uint32_t m_nWaitVersion;      // ... with at least this settings version
+    bool m_bHaveMetering;
+    Metering m_metering;
+};
@@ -0,0 +1,169 @@
+/**
+   Bayer demosaic for the raw 10/12-bit frames from EosAdimecCapture.
+
+   Replaces libpdv's scalar BGGR_WORD decoding.  Input is one 16-bit word
+   per pixel (LSB-aligned); output is three 16-bit planes (R, G, B) at the
+   input bit depth.
+
+   Methods:
+      bilinear   -- missing colors are the average of their nearest
+                    same-color neighbors.
+      edge-aware -- green at red/blue sites is interpolated along the
+                    direction with the smaller gradient (first difference of
+                    green plus second difference of the center color), which
+                    removes most of the zipper artifacts on edges.  Red/blue
+                    are bilinear.
+
+   The Bayer order is given the way the EDT cam files give it:
+      bRedRowFirst     -- kbs_red_row_first: row 0 holds red (else blue)
+      bGreenPixelFirst -- kbs_green_pixel_first: row 0 starts with green
+
+   SSE4.1 and AVX2 kernels are picked at run time (GetBestSimdLevel());
+   all levels give bit-identical output (rounding averages throughout),
+   so the scalar kernel is also the reference.  See EosAdimecBayerBench.
+
+   SumChannels() gives white-balance statistics straight from the raw
+   frame (no demosaic): per-channel sums over whole 2x2 quads.
+ */
+#pragma once
+
+#include <stdint.h>
+#include <string>
+
+class EosAdimecBayer
+{
+  public:
+
+    enum E_DEMOSAIC_METHOD
+    {
+        eDemosaicBilinear,
+        eDemosaicEdgeAware
+    };
+
+    enum E_SIMD_LEVEL
+    {
+        eSimdScalar,
+        eSimdSse4,
+        eSimdAvx2,
+        eSimdAuto       // GetBestSimdLevel()
+    };
+
+    /** Raw Bayer input */
+    struct BayerImage
+    {
+        const uint16_t* pData;
+        int nWidth;
+        int nHeight;
+        int nStride;            // Words per row
+        int nBitDepth;          // Bits above this are masked off
+        bool bRedRowFirst;
+        bool bGreenPixelFirst;
+    };
+
+    /** Per-channel sums over 2x2 quads */
+    struct ChannelSums
+    {
+        uint64_t nRed;
+        uint64_t nGreen;        // Both greens of each quad
+        uint64_t nBlue;
+        uint64_t nQuads;        // Quads counted
+    };
+
+    /** Planar RGB output (caller-allocated, nStride words per row each) */
+    struct RgbPlanes
+    {
+        uint16_t* pR;
+        uint16_t* pG;
+        uint16_t* pB;
+        int nStride;
+        int nFirstRow;          // Image row held in row 0 (0 = whole frame; else a band)
+    };
+
+    /**
+       Demosaic a whole frame.
+       @return 0 on success, -1 on bad arguments (e.g. smaller than 4x4)
+     */
+    static int Demosaic(const BayerImage& raw, RgbPlanes& rgb,
+                        const E_DEMOSAIC_METHOD eMethod,
+                        const E_SIMD_LEVEL eLevel=eSimdAuto);
+
+    /**
+       Demosaic rows [nRowBegin, nRowEnd) only (tiles/threads).  Reads up
+       to two rows above and below the range.
+     */
+    static int DemosaicRows(const BayerImage& raw, RgbPlanes& rgb,
+                            const E_DEMOSAIC_METHOD eMethod,
+                            const int nRowBegin, const int nRowEnd,
+                            const E_SIMD_LEVEL eLevel=eSimdAuto);
+
+    /**
+       Sum R, G, B over the 2x2 quads of rows [nRowBegin, nRowEnd) (rounded
+       to row pairs) whose four pixels add up to at least nMinQuadSum and
+       are all below nClipLevel.  Gray world: nMinQuadSum=0; white patch:
+       the brightest quads only.  Quads with a clipped pixel would skew
+       the ratios, so they are always left out.
+       @return 0 on success, -1 on bad arguments
+     */
+    static int SumChannels(const BayerImage& raw, const int nRowBegin, const int nRowEnd,
+                           const uint32_t nMinQuadSum, const uint32_t nClipLevel,
+                           ChannelSums& sums, const E_SIMD_LEVEL eLevel=eSimdAuto);
+
+    /** Best level this CPU supports */
+    static E_SIMD_LEVEL GetBestSimdLevel(void);
+
+    /** "scalar", "sse4", "avx2" */
+    static std::string SimdLevelName(const E_SIMD_LEVEL eLevel);
+
+    /** "bilinear"/"edge" --> method.  Returns false for other strings. */
+    static bool MethodFromString(const std::string& strMethod, E_DEMOSAIC_METHOD& eMethod);
+
+    /** Row y holds red (else blue) */
+    static bool IsRedRow(const BayerImage& raw, const int nRow)
+    {
+        return (((nRow&1)==0)==raw.bRedRowFirst);
+    }
+
+    /** Column 0 of row y is green */
+    static bool IsGreenFirstInRow(const BayerImage& raw, const int nRow)
+    {
+        return IsRedRow(raw,nRow) ? raw.bGreenPixelFirst : !raw.bGreenPixelFirst;
+    }
+
+  protected:
+
+    /** Any pixel, any position (borders); reflects coordinates at the edges */
+    static void DemosaicPixelScalar(const BayerImage& raw, RgbPlanes& rgb,
+                                    const E_DEMOSAIC_METHOD eMethod,
+                                    const int nRow, const int nCol);
+
+    /** Columns [nColBegin, nColEnd) of an interior row (2 <= row < height-2) */
+    static void DemosaicRowScalar(const BayerImage& raw, RgbPlanes& rgb,
+                                  const E_DEMOSAIC_METHOD eMethod, const int nRow,
+                                  const int nColBegin, const int nColEnd);
+
+    /** SIMD kernels: return the first column they did not do */
+    static int DemosaicRowSse4(const BayerImage& raw, RgbPlanes& rgb,
+                               const E_DEMOSAIC_METHOD eMethod, const int nRow,
+                               const int nColBegin, const int nColEnd);
+    static int DemosaicRowAvx2(const BayerImage& raw, RgbPlanes& rgb,
+                               const E_DEMOSAIC_METHOD eMethod, const int nRow,
+                               const int nColBegin, const int nColEnd);
+
+    /**
+       Quads [nQuadBegin, nQuadEnd) of one row pair, added to anSums
+       (row 0 even/odd columns, row 1 even/odd columns) and nQuads.
+       SIMD kernels return the first quad they did not do.
+     */
+    static void SumQuadsScalar(const uint16_t* pRow0, const uint16_t* pRow1,
+                               const uint32_t nMask, const int nQuadBegin, const int nQuadEnd,
+                               const uint32_t nMinQuadSum, const uint32_t nClipLevel,
+                               uint64_t anSums[4], uint64_t& nQuads);
+    static int SumQuadsSse4(const uint16_t* pRow0, const uint16_t* pRow1,
+                            const uint32_t nMask, const int nQuadBegin, const int nQuadEnd,
+                            const uint32_t nMinQuadSum, const uint32_t nClipLevel,
+                            uint64_t anSums[4], uint64_t& nQuads);
+    static int SumQuadsAvx2(const uint16_t* pRow0, const uint16_t* pRow1,
+                            const uint32_t nMask, const int nQuadBegin, const int nQuadEnd,
+                            const uint32_t nMinQuadSum, const uint32_t nClipLevel,
+                            uint64_t anSums[4], uint64_t& nQuads);
+};
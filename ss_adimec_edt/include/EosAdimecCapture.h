@@ -0,0 +1,112 @@
+/**
+   In-process frame capture engine.
+
+   Runs one capture thread that pulls frames from an EosAdimecFrameSource
+   (EDT DMA ring or synthetic) continuously.  Each frame is handed, in
+   place, to every registered consumer on the capture thread; the buffer
+   goes back to the ring when the last consumer returns.  Consumers that
+   need the frame longer must copy what they need.
+
+   Counters:
+      frames   -- frames delivered
+      timeouts -- waits that ran past capture_timeout_ms
+      overruns -- frames the grabber flagged as overrun
+      dropped  -- frames lost to a full ring (the source's nDropped)
+      errors   -- source failures
+ */
+#pragma once
+
+#include <stdint.h>
+
+#include <map>
+#include <string>
+#include <atomic>
+
+#include <boost/thread/thread.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/function.hpp>
+
+#include "EosAdimecFrameSource.h"
+#include "EosAdimecSettingsTracker.h"
+
+class EosAdimecCapture
+{
+  public:
+
+    /** Capture counters */
+    struct CaptureStats
+    {
+        bool bRunning;
+        unsigned long nFrames;
+        unsigned long nTimeouts;
+        unsigned long nOverruns;
+        unsigned long nDropped;
+        unsigned long nErrors;
+        uint64_t nLastSequence;
+        uint64_t nLastTimeNs;
+        double dFps;              // Smoothed delivered frame rate
+    };
+
+    typedef boost::function<void (const EosAdimecRawFrame&)> FrameConsumer;
+
+    /**
+       @param pSource -- frame source (the engine owns and deletes it)
+       @param nRingBuffers -- number of ring buffers
+       @param nTimeoutMs -- frame wait timeout
+     */
+    EosAdimecCapture(EosAdimecFrameSource* pSource, const int nRingBuffers,
+                     const int nTimeoutMs);
+
+    /** Stops capture and deletes the source */
+    virtual ~EosAdimecCapture(void);
+
+    /**
+       Open the source and start the capture thread.
+       @param nMaxRingBytes -- refuse to start if the ring would be bigger (0 = no limit)
+     */
+    int Start(const size_t nMaxRingBytes);
+    void Stop(void);
+
+    /**
+       Tag frames with the settings from pTracker (not owned; NULL = all
+       unknown).  Call before Start().
+     */
+    void SetSettingsTracker(EosAdimecSettingsTracker* pTracker);
+
+    /**
+       Register a frame consumer.  Called on the capture thread for every
+       frame; keep it short.
+       @return consumer ID for RemoveFrameConsumer()
+     */
+    int AddFrameConsumer(FrameConsumer fnConsumer);
+    void RemoveFrameConsumer(const int nConsumerId);
+
+    CaptureStats GetStats(void);
+
+    /** "edt" or "synthetic" */
+    std::string GetSourceName(void);
+
+    /** Bytes in one source frame (0 before Start()) */
+    size_t GetFrameBytes(void);
+
+  protected:
+
+    /** Capture thread main loop */
+    void CaptureThread(void);
+
+    EosAdimecFrameSource* m_pSource;
+    int m_nRingBuffers;
+    int m_nTimeoutMs;
+    EosAdimecSettingsTracker* m_pSettingsTracker;
+
+    boost::thread* m_pCaptureThread;
+    std::atomic<bool> m_abStop;
+
+    /** Guards m_mapConsumers (held while they run) */
+    boost::mutex m_mtxConsumers;
+    std::map<int, FrameConsumer> m_mapConsumers;
+    int m_nNextConsumerId;
+
+    boost::mutex m_mtxStats;
+    CaptureStats m_stats;
+};
@@ -0,0 +1,277 @@
+/**
+   Reads the Adimec-controller-specific keys out of the device
+   configuration file (i.e. adimec_edt.cfg).
+
+   The common [slavecamera] keys (id, channel, listening_port, etc.)
+   are still extracted by EosSlaveCameraConfiguration.  This class only
+   picks up the extra keys that the common configuration classes
+   don't know about, so that adding an Adimec-only option doesn't
+   require a change to the shared SCIP configuration code.
+
+   Unknown keys are ignored (EosSlaveCameraConfiguration owns them).
+   Bad values for the keys handled here will throw an EosException so
+   that the config-checking mode (EosAdimecEdtMain.x adimec_edt.cfg)
+   catches them.
+ */
+#pragma once
+
+#include <string>
+#include <map>
+#include <vector>
+
+#include "EosAdimecThreadPlacement.h"
+
+/**
+   Adimec-only configuration info.
+ */
+struct EosAdimecConfigInfo
+{
+    /** Device ID ([slavecamera] id) -- used to build default names. */
+    int nDeviceId;
+
+    /** SCIP command/response transport: "namedpipe" or "unix_seqpacket" */
+    std::string strScipTransport;
+
+    /** Path of the SOCK_SEQPACKET listening socket (unix_seqpacket only) */
+    std::string strScipSocketPath;
+
+    /** Max# simultaneous local socket clients (unix_seqpacket only) */
+    int nScipSocketMaxClients;
+
+    /** Per-channel SCIP output queue depth; 0 = write synchronously (old behavior) */
+    int nScipOutputQueueDepth;
+
+    /** How long the output queue holds a finished dispatch cycle for the next command (us) */
+    int nScipOutputLingerUs;
+
+    /** Output queue overflow policy: "drop_oldest" or "drop_newest" (telemetry only) */
+    std::string strScipOutputOverflow;
+
+    /** Max# asynchronous ("#!id") commands pending before BUSY */
+    int nScipAsyncQueueDepth;
+
+    /** Default query staleness windows (ms): command --> window, "*" = any other query */
+    std::map<std::string, int> mapQueryStaleMs;
+
+    /** In-process frame capture (EosAdimecCapture) */
+    bool bCaptureEnable;
+    std::string strCaptureSource;     // "edt" or "synthetic"
+    int nCaptureRingBuffers;
+    int nCaptureTimeoutMs;
+    int nCaptureEdtUnit;              // EDT board; the channel is [slavecamera] channel
+
+    /** Synthetic frame source (capture_source=synthetic only) */
+    int nCaptureSynthWidth;
+    int nCaptureSynthHeight;
+    int nCaptureSynthBitDepth;
+    int nCaptureSynthFps;
+    bool bCaptureSynthRedRowFirst;
+    bool bCaptureSynthGreenPixelFirst;
+
+    /** Tile executor for the per-frame stages (EosAdimecTileExecutor; capture_enable=1 only) */
+    int nTileThreads;                     // 0 = one per core, less one
+    std::vector<int> vnTileCpus;          // Empty = not pinned
+    int nTileKb;
+
+    /** Frame buffers of the stages (EosAdimecFramePool; capture_enable=1 only) */
+    bool bFramePoolHugePages;
+    bool bFramePoolMlock;
+
+    /** CPUs and scheduling per thread role (thread_<role>_cpus/_policy/_priority) */
+    EosAdimecThreadPlacement::Placement aThreadPlacements[EosAdimecThreadPlacement::NUM_ROLES];
+
+    /** YUV frames for the linked_video streamer (EosAdimecVideoOutput; capture_enable=1 only) */
+    bool bVideoOutputEnable;
+    std::string strVideoOutputFifo;
+    std::string strVideoOutputFormat;     // "i420" or "nv12"
+    std::string strVideoOutputDemosaic;   // "bilinear" or "edge"
+    double adVideoWbGains[3];             // R, G, B
+    std::string strVideoToneMap;          // off, linear, gamma, log or equalize
+    double dVideoToneGamma;
+    double dVideoToneLog;                 // Log curve strength
+    double dVideoToneGain;                // Before the curve
+    double dVideoToneBlackPct;            // Of full scale
+
+    /** Shared-memory frame ring for local readers (EosAdimecFrameRing; capture_enable=1 only) */
+    bool bFrameRingEnable;
+    std::string strFrameRingShmName;
+    std::string strFrameRingSocketPath;
+    int nFrameRingSlots;
+    int nFrameRingMaxReaders;
+    bool bFrameRingPacked;                // Frames packed to their bit depth (EosAdimecPack)
+
+    /** Per-frame settings tagging (EosAdimecSettingsTracker) */
+    int nFrameSettingsTimeUnitUs;         // @FP/@IT unit
+    int nFrameSettingsMarginUs;           // Frame timestamp slack
+
+    /** Auto-exposure start-up values (EosAdimecAutoExposure; capture_enable=1 only) */
+    bool bAeEnable;
+    int nAeTargetPct;                     // % of full scale
+    int anAeRoi[4];                       // x, y, w, h (w/h 0 = whole frame)
+    int nAeRateHz;
+
+    /** White-balance start-up values (EosAdimecAutoWhiteBalance; capture_enable=1 only) */
+    std::string strAwbMode;               // "off" or "continuous"
+    std::string strAwbMethod;             // "gray_world" or "white_patch"
+    int nAwbHysteresisPct;
+    int nAwbRateHz;
+    int nAwbBlackLevel;                   // Raw counts
+
+    /** Frame statistics (EosAdimecFrameStats; capture_enable=1 only) */
+    bool bFrameStatsEnable;
+    int nFrameStatsDecimation;            // Every Nth frame
+    int nFrameStatsPushMs;                // 0 = no pushes
+
+    /** Focus score (EosAdimecFocus; capture_enable=1 only) */
+    bool bFocusEnable;
+    std::string strFocusMethod;           // "tenengrad" or "laplacian"
+    int anFocusRoi[4];                    // x, y, w, h (w/h 0 = whole frame)
+    bool bFocusPush;                      // FOCUS[...] unsolicited for every score
+    std::string strFocusShmName;          // POSIX shm name of the scores
+    int nFocusHistory;                    // Scores kept in the segment
+
+    /** Pre-trigger recorder (EosAdimecRecorder; capture_enable=1 only) */
+    bool bRecorderEnable;
+    int nRecorderSeconds;                 // Keep this much in RAM
+    int nRecorderMaxMb;                   // RAM cap (0 = what max_mem_mb leaves)
+    int nRecorderMaxPostS;                // TRIGGER_SAVE post_s limit
+    std::string strRecorderDir;           // Recordings go here
+    bool bRecorderPacked;                 // Frames packed to their bit depth
+
+    /** Still frames (EosAdimecSnapshot; capture_enable=1 only) */
+    bool bSnapshotEnable;
+    std::string strSnapshotDir;           // Snapshots go here
+    std::string strSnapshotDemosaic;      // "bilinear" or "edge"
+    int nSnapshotJpegQuality;             // 1-100
+    int nSnapshotPngLevel;                // zlib level, 0-9
+    int nSnapshotKeep;                    // Newest files kept
+    int nSnapshotTimeoutMs;               // No frame by then: FAILED
+    std::string strSnapshotTriggerMode;   // Serial command before (empty = free running)
+    std::string strSnapshotStreamMode;    // ... and after, back to streaming
+
+    /** Downscaled previews (EosAdimecPreview; capture_enable=1 only) */
+    bool bPreviewEnable;
+    std::vector<int> vnPreviewScales;     // 2, 4 and/or 8, ascending
+    int nPreviewDecimation;               // Every Nth frame
+    std::string strPreviewFormat;         // "i420" or "nv12"
+    std::string strPreviewShmName;        // POSIX shm name of the previews
+
+    /** Raw frame archive (EosAdimecArchive; capture_enable=1 only) */
+    bool bArchiveEnable;                  // Archive from capture start (else SET_ARCHIVE[1])
+    std::string strArchiveDir;            // One archive directory per start goes here
+    int nArchiveSegmentMb;                // Preallocated segment file size
+    int nArchiveMaxGb;                    // Stop archiving past this (0 = disk full)
+    int nArchiveStagingFrames;            // RAM staging ring, frames
+    bool bArchivePacked;                  // Frames packed to their bit depth
+
+    /** Dark/flat correction (EosAdimecCorrection; capture_enable=1 only) */
+    bool bCorrectionEnable;               // Correct from capture start (else SET_CORRECTION[1])
+    std::string strCorrectionDir;         // References are kept here
+    int nCorrectionGainStep;              // SETGAIN bucket width
+    int nCorrectionMaxFrames;             // CAPTURE_DARK/CAPTURE_FLAT frame limit
+
+    /** Process memory cap in MB ([slavecamera] max_mem_mb) */
+    int nMaxMemMb;
+
+    /**
+       Frame-processing graph (EosAdimecPipeline; capture_enable=1 only):
+       stage --> input ("capture" or a transform stage), from [pipeline]
+       or, without that section, from the *_enable keys
+     */
+    bool bPipelineDeclared;
+    std::map<std::string, std::string> mapPipeline;
+};
+
+class EosAdimecConfiguration
+{
+  public:
+
+    /**
+       @param strConfigFile -- name of device configuration file
+     */
+    EosAdimecConfiguration(const std::string& strConfigFile);
+
+    virtual ~EosAdimecConfiguration(void){};
+
+    /**
+       Validate and return the Adimec-only configuration info.
+     */
+    EosAdimecConfigInfo ExtractConfigInfo(void);
+
+    /** Legal scip_transport values */
+    static const std::string TRANSPORT_NAMEDPIPE;
+    static const std::string TRANSPORT_UNIX_SEQPACKET;
+
+    /** Section that declares the frame-processing graph */
+    static const std::string SECTION_PIPELINE;
+
+    /** Legal capture_source values */
+    static const std::string CAPTURE_SOURCE_EDT;
+    static const std::string CAPTURE_SOURCE_SYNTHETIC;
+
+  protected:
+
+    /**
+       Load every "key = value" line into m_mapKeyValue as
+       "section.key" --> "value".
+     */
+    void ReadConfigFile(void);
+
+    /**
+       Copy each [pipeline] "stage.param" key to [slavecamera] as
+       "stage_param", so the stage keys below see it.  Throws for an
+       unknown stage.
+     */
+    void ApplyPipelineParams(void);
+
+    /** [pipeline] stages/inputs (or the *_enable keys) --> configInfo.mapPipeline */
+    void ExtractPipeline(EosAdimecConfigInfo& configInfo);
+
+    /** Look up a key; return strDefault if it isn't there. */
+    std::string GetString(const std::string& strSection,
+                          const std::string& strKey,
+                          const std::string& strDefault);
+
+    /** Integer lookup; throws EosException for non-numeric values. */
+    int GetInt(const std::string& strSection,
+               const std::string& strKey,
+               const int nDefault);
+
+    /** Integer lookup with a range check; throws EosException if out of range. */
+    int GetInt(const std::string& strSection,
+               const std::string& strKey,
+               const int nDefault,
+               const int nMin,
+               const int nMax);
+
+    /** Number lookup with a range check; throws EosException if bad or out of range. */
+    double GetDouble(const std::string& strSection,
+                     const std::string& strKey,
+                     const double dDefault,
+                     const double dMin,
+                     const double dMax);
+
+    /** Accepts 1/0, y/n, yes/no, true/false, on/off */
+    bool GetBool(const std::string& strSection,
+                 const std::string& strKey,
+                 const bool bDefault);
+
+    /** "x,y,w,h" (pixels, each >= 0); default 0,0,0,0 (whole frame) */
+    void GetRoi(const std::string& strSection,
+                const std::string& strKey,
+                int anRoi[4]);
+
+    /** Throw an EosException that names the offending key. */
+    void ThrowBadValue(const std::string& strSection,
+                       const std::string& strKey,
+                       const std::string& strValue,
+                       const std::string& strExpected);
+
+    std::string m_strConfigFile;
+
+    /** "section.key" --> "value" */
+    std::map<std::string, std::string> m_mapKeyValue;
+
+    /** Section that holds the camera keys */
+    static const std::string SECTION_CAMERA;
+};
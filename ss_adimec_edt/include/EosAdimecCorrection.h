@@ -0,0 +1,254 @@
+/**
+   Dark-frame and flat-field correction of raw frames.
+
+   The camera's own correction (SET_PIXC, @DPE) only replaces defective
+   pixels.  This stage removes the fixed-pattern offset (dark) and the
+   per-pixel response and vignetting (flat) left over, per pixel:
+
+      out = min((raw - dark) * gain, full scale)
+      gain = mean(flat of that Bayer position) / flat
+
+   References are taken with CAPTURE_DARK[n]/CAPTURE_FLAT[n] (a flat
+   needs the dark of its bucket first): the next n frames are averaged
+   on the capture thread (not corrected meanwhile), then a niced thread
+   builds the reference, swaps it in and writes it to correction_dir
+   (EosAdimecCorrectionLayout.h), where Start() finds it again next
+   time.  Dark current and fixed-pattern noise move with gain
+   and exposure, so references are kept per bucket: bit depth, SETGAIN
+   rounded to a step, and the integration time octave.  Each frame is
+   corrected with the references of its own bucket (from the settings
+   the capture engine tagged it with), or the nearest bucket with the
+   same bit depth and size when its own has none.  A frame with no
+   usable reference passes through uncorrected (counted).
+
+   References, and the all-zero/unity stand-ins used when a bucket has
+   none, come out of the frame-pool budget (EosAdimecFramePool).  One
+   that does not fit is not installed (CAPTURE_xxx fails no_memory).
+
+   Runs as the pipeline's correction stage, so every stage fed from it
+   sees the corrected frame, in tiles on the shared tile executor; the
+   kernels are SSE4.1/AVX2 with a scalar reference (same output), picked
+   with EosAdimecBayer's SIMD level.  Bit depths up to 12 (gain in Q12,
+   applied with a 16-bit high multiply).
+ */
+#pragma once
+
+#include <stdint.h>
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include <boost/function.hpp>
+#include <boost/thread/thread.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/condition_variable.hpp>
+
+#include "EosAdimecFrameSource.h"
+#include "EosAdimecFramePool.h"
+#include "EosAdimecCorrectionLayout.h"
+#include "EosAdimecBayer.h"
+#include "EosAdimecTileExecutor.h"
+
+class EosAdimecCorrection
+{
+  public:
+
+    enum E_KIND
+    {
+        eKindDark=EosAdimecCorrectionConst::KIND_DARK,
+        eKindFlat=EosAdimecCorrectionConst::KIND_FLAT
+    };
+
+    /** Correction counters and the references picked for the last frame */
+    struct CorrectionStats
+    {
+        bool bEnable;
+        size_t nDarks;              // References in RAM
+        size_t nFlats;
+        size_t nBytes;              // ... and the RAM they take
+        std::string strBucket;      // Last frame's bucket
+        std::string strDark;        // Bucket of the dark used ("none")
+        std::string strFlat;        // Bucket of the flat used ("none")
+        unsigned long nCorrected;
+        unsigned long nUncorrected; // Enabled, but no usable reference
+        double dApplyMs;            // Last frame
+        bool bCapturing;
+        E_KIND eCapturing;
+        int nCaptured;              // Frames averaged so far
+        int nCaptureFrames;         // ... of this many
+    };
+
+    /** End of a CAPTURE_DARK/CAPTURE_FLAT */
+    struct CaptureResult
+    {
+        E_KIND eKind;
+        bool bOk;
+        std::string strBucket;
+        std::string strError;       // !bOk only
+        std::string strPath;
+        int nFrames;
+        double dMean;               // Mean level (dark) or signal (flat)
+    };
+
+    typedef boost::function<void (const CaptureResult& result)> DoneFn;
+
+    /**
+       @param strDir -- references are kept here (created if missing)
+       @param nGainStep -- SETGAIN bucket width
+       @param pExecutor -- splits frames into tiles (NULL = all on the capture thread)
+     */
+    EosAdimecCorrection(DoneFn fnDone, const std::string& strDir, const int nGainStep,
+                        EosAdimecTileExecutor* pExecutor);
+    virtual ~EosAdimecCorrection(void);
+
+    /**
+       Load the references in strDir and start the reference thread.
+       @param nFrameBytes -- largest frame (EosAdimecCapture::GetFrameBytes())
+     */
+    int Start(const size_t nFrameBytes);
+    void Stop(void);
+
+    /** Pipeline frame filter: average into a reference, or correct */
+    void OnFrame(EosAdimecRawFrame& frame);
+
+    /** Correct frames (references are taken either way) */
+    void SetEnable(const bool bEnable);
+
+    /**
+       Average the next nFrames frames into a reference for their bucket.
+       @param strError -- out: why not (one capture at a time)
+       @return UNIX_OK_STATUS or UNIX_ERROR_STATUS
+     */
+    int BeginCapture(const E_KIND eKind, const int nFrames, std::string& strError);
+
+    CorrectionStats GetStats(void);
+
+    /** "b12_g400_o5" (-1 = unknown) */
+    static std::string BucketName(const int nBitDepth, const int nGainBucket, const int nItOctave);
+
+    /** "dark"/"flat" */
+    static std::string KindName(const E_KIND eKind);
+
+  protected:
+
+    /** Bit depth, gain bucket, integration time octave */
+    struct Bucket
+    {
+        int nBitDepth;
+        int nGain;
+        int nOctave;
+
+        bool operator<(const Bucket& other) const
+        {
+            if(nBitDepth!=other.nBitDepth)
+                return nBitDepth<other.nBitDepth;
+            if(nGain!=other.nGain)
+                return nGain<other.nGain;
+            return nOctave<other.nOctave;
+        }
+    };
+
+    /** A reference in RAM */
+    struct Reference
+    {
+        EosAdimecCorrectionHeader header;
+        std::vector<uint16_t> vData;    // Dark: level.  Flat: Q12 gain.
+    };
+
+    typedef std::map<Bucket, Reference*> RefMap;
+
+    /** The capture being averaged */
+    struct Capture
+    {
+        bool bActive;
+        bool bComplete;             // Handed to the reference thread
+        E_KIND eKind;
+        int nFrames;
+        int nDone;
+        Bucket bucket;
+        int nWidth;
+        int nHeight;
+        EosAdimecFrameSettings settings;
+        std::vector<uint32_t> vSum;
+        std::string strError;       // Set: failed
+    };
+
+    Bucket BucketOf(const EosAdimecRawFrame& frame) const;
+
+    /** Closest reference of the same bit depth and size in mapRefs, or NULL */
+    static const Reference* FindReference(const RefMap& mapRefs, const Bucket& bucket,
+                                          const int nWidth, const int nHeight);
+
+    /** Correct tile's rows of frame into m_pOut */
+    void CorrectTile(const EosAdimecRawFrame* pFrame, const uint16_t* pDark,
+                     const uint16_t* pGain, const uint16_t nMask,
+                     const EosAdimecBayer::E_SIMD_LEVEL eLevel,
+                     const EosAdimecTileExecutor::Tile& tile);
+
+    /** Add one frame to m_capture (m_mtxCorrection held) */
+    void Accumulate(const EosAdimecRawFrame& frame);
+
+    void ReferenceThread(void);
+
+    /**
+       Average m_capture into a reference (m_mtxCorrection not held).
+       @param vPixels -- out: what goes to disk (dark level, flat signal)
+       @return NULL, and strError, if it is no good
+     */
+    Reference* BuildReference(std::vector<uint16_t>& vPixels, std::string& strError);
+
+    /** Flat signal --> Q12 gain, normalized per Bayer position */
+    static void FlatToGain(const uint16_t* pFlat, const int nWidth, const int nHeight,
+                           std::vector<uint16_t>& vGain);
+
+    /**
+       Swap a reference in (m_mtxCorrection held).  Its RAM comes out of
+       the frame-pool budget; one that does not fit is deleted.
+       @return false if it did not fit
+     */
+    bool Install(Reference* pReference);
+
+    std::string ReferencePath(const EosAdimecCorrectionHeader& header) const;
+    bool SaveReference(const Reference& reference, const std::vector<uint16_t>& vPixels,
+                       std::string& strPath);
+    void LoadReferences(void);
+
+    DoneFn m_fnDone;
+    std::string m_strDir;
+    int m_nGainStep;
+    EosAdimecTileExecutor* m_pExecutor;
+
+    boost::thread* m_pReferenceThread;
+
+    /** Guards everything below (held while a frame is corrected) */
+    boost::mutex m_mtxCorrection;
+    boost::condition_variable m_cvCorrection;
+    bool m_bStop;
+    bool m_bEnable;
+    RefMap m_mapDarks;
+    RefMap m_mapFlats;
+    uint64_t m_nGeneration;         // Bumped by Install()
+    Capture m_capture;
+
+    /** Capture thread: corrected pixels (a one-slot frame pool), and the references picked */
+    EosAdimecFramePool* m_pOutPool;
+    uint16_t* m_pOut;
+    size_t m_nOutPixels;
+    std::vector<uint16_t> m_vZero;
+    std::vector<uint16_t> m_vUnity;
+    size_t m_nReservedBytes;        // Of the budget: m_vZero, m_vUnity and the references
+    uint32_t m_nPickedVersion;
+    uint64_t m_nPickedGeneration;
+    int m_nPickedWidth;
+    int m_nPickedHeight;
+    int m_nPickedBitDepth;
+    bool m_bPicked;
+    Bucket m_pickedBucket;
+    const Reference* m_pDark;
+    const Reference* m_pFlat;
+
+    unsigned long m_nCorrected;
+    unsigned long m_nUncorrected;
+    double m_dApplyMs;
+};
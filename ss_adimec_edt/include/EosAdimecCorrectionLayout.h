@@ -0,0 +1,47 @@
+/**
+   On-disk layout of a dark or flat reference (EosAdimecCorrection).
+   Plain structs only, like EosAdimecFrameRingLayout.h, so review tools
+   can read references without boost or EDT headers.
+
+   One file per reference, <kind>_b<bits>_g<gain>_o<octave>.ecor in
+   correction_dir (see EosAdimecCorrection::BucketName()):
+      EosAdimecCorrectionHeader                 (nHeaderBytes)
+      nWidth*nHeight 16-bit words, rows back to back
+
+   A dark holds the mean raw level of each pixel with no light.  A flat
+   holds the mean signal of each pixel under even light, less the dark
+   of its bucket (which must be taken first) as it was then, so it stays
+   valid if the dark is retaken.
+ */
+#pragma once
+
+#include <stdint.h>
+
+#include "EosAdimecFrameRingLayout.h"
+
+struct EosAdimecCorrectionHeader
+{
+    uint32_t nMagic;
+    uint32_t nVersion;
+    uint32_t nHeaderBytes;          // Offset of the pixels
+    uint32_t nKind;                 // EosAdimecCorrectionConst::KIND_DARK/KIND_FLAT
+    int32_t nWidth;
+    int32_t nHeight;
+    int32_t nBitDepth;
+    int32_t nGainBucket;            // SETGAIN value rounded to correction_gain_step (-1 unknown)
+    int32_t nItOctave;              // floor(log2(SETIT value)) (-1 unknown)
+    uint32_t nFrames;               // Frames averaged
+    int64_t nWallSec;               // CLOCK_REALTIME when taken
+    double dMean;                   // Mean of the pixels
+    EosAdimecFrameSettings settings;    // First frame's settings
+};
+
+/** Reference constants */
+struct EosAdimecCorrectionConst
+{
+    static const uint32_t MAGIC=0x52434145;   // "EACR"
+    static const uint32_t VERSION=1;
+
+    static const uint32_t KIND_DARK=0;
+    static const uint32_t KIND_FLAT=1;
+};
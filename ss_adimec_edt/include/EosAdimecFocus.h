@@ -0,0 +1,149 @@
+/**
+   Per-frame focus score, for autofocus sweeps by the paired lens
+   controller.
+
+   A capture consumer scores every frame on the green channel of an ROI:
+   each 2x2 Bayer quad gives one green value (the sum of its two greens,
+   scaled to 10 bits per pixel whatever the bit depth), and the score is
+   taken over that half-resolution green plane:
+
+      tenengrad -- mean of gx^2 + gy^2 (3x3 Sobel)
+      laplacian -- variance of the 4-neighbour Laplacian
+
+   Both rise as the image sharpens; the absolute value depends on the
+   scene, the ROI and the exposure, so a sweep compares scores of one
+   ROI and method against each other.  The green plane and both row
+   kernels have SSE4.1/AVX2 versions picked at run time like
+   EosAdimecBayer; all levels give the same score.
+
+   The score is computed on the capture thread, so it is out as soon as
+   the frame is.  It goes to a shared-memory segment
+   (EosAdimecFocusLayout.h) and, if pushes are on, to a PushFn called
+   from a push thread (which only ever sends the newest score).
+ */
+#pragma once
+
+#include <stdint.h>
+#include <time.h>
+
+#include <atomic>
+#include <string>
+#include <vector>
+
+#include <boost/thread/thread.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/function.hpp>
+
+#include "EosAdimecBayer.h"
+#include "EosAdimecFrameSource.h"
+#include "EosAdimecFocusLayout.h"
+
+class EosAdimecFocus
+{
+  public:
+
+    enum E_FOCUS_METHOD
+    {
+        eFocusTenengrad,
+        eFocusLaplacian
+    };
+
+    /** Settable through SCIP */
+    struct FocusParams
+    {
+        E_FOCUS_METHOD eMethod;
+        int nRoiX;                  // Pixels; nRoiW/nRoiH 0 = whole frame
+        int nRoiY;
+        int nRoiW;
+        int nRoiH;
+        bool bPush;                 // Hand every score to the PushFn
+    };
+
+    struct FocusResult
+    {
+        uint64_t nSequence;
+        uint64_t nTimeNs;
+        struct timespec tsWall;
+        uint32_t nSettingsVersion;
+        bool bSettingsChanging;
+        E_FOCUS_METHOD eMethod;
+        int anRoi[4];               // Scored ROI: on whole quads, clipped to the frame
+        double dScore;
+        double dComputeMs;
+    };
+
+    /** Push thread: the newest score */
+    typedef boost::function<void (const FocusResult& result)> PushFn;
+
+    /**
+       @param strShmName -- POSIX shm name for the scores ("" = none)
+       @param nHistory -- scores kept in the segment
+     */
+    EosAdimecFocus(PushFn fnPush, const std::string& strShmName, const int nHistory,
+                   const EosAdimecBayer::E_SIMD_LEVEL eLevel=EosAdimecBayer::eSimdAuto);
+    virtual ~EosAdimecFocus(void);
+
+    /** Create the segment and start the push thread */
+    int Start(void);
+    void Stop(void);
+
+    /** Capture consumer: score the frame */
+    void OnFrame(const EosAdimecRawFrame& frame);
+
+    void SetParams(const FocusParams& params);
+    FocusParams GetParams(void);
+
+    /** Latest score; false if there is none yet */
+    bool GetLatest(FocusResult& result);
+
+    /**
+       Score of an ROI (pixels, 0 size = whole frame).
+       @param anRoi -- in: requested; out: what was scored
+       @param vGreen -- scratch for the green plane
+       @return 0, or -1 if the ROI has under 3x3 quads or the bit depth is outside 8-15
+     */
+    static int Score(const EosAdimecBayer::BayerImage& raw, int anRoi[4],
+                     const E_FOCUS_METHOD eMethod, const EosAdimecBayer::E_SIMD_LEVEL eLevel,
+                     std::vector<int16_t>& vGreen, double& dScore);
+
+    /** "tenengrad"/"laplacian" --> method.  Returns false for other strings. */
+    static bool MethodFromString(const std::string& strMethod, E_FOCUS_METHOD& eMethod);
+    static std::string MethodName(const E_FOCUS_METHOD eMethod);
+
+  protected:
+
+    int OpenSegment(void);
+    void CloseSegment(void);
+
+    /** Next record in the segment (capture thread) */
+    void PublishToSegment(const FocusResult& result);
+
+    void PushThread(void);
+
+    PushFn m_fnPush;
+    std::string m_strShmName;
+    int m_nHistory;
+    EosAdimecBayer::E_SIMD_LEVEL m_eLevel;
+
+    /** Segment (capture thread writes it once open) */
+    int m_nShmFd;
+    size_t m_nSegmentBytes;
+    uint8_t* m_pSegment;
+    EosAdimecFocusHeader* m_pHeader;
+    EosAdimecFocusRecord* m_pRecords;
+
+    /** Capture thread only */
+    std::vector<int16_t> m_vGreen;
+
+    boost::thread* m_pPushThread;
+    std::atomic<bool> m_abStop;
+
+    /** Guards everything below */
+    boost::mutex m_mtxFocus;
+    boost::condition_variable m_cvFocus;
+    FocusParams m_params;
+    bool m_bHaveResult;
+    FocusResult m_latest;
+    bool m_bPushPending;            // m_latest not pushed yet
+};
@@ -0,0 +1,62 @@
+/**
+   Shared-memory layout of the focus scores (EosAdimecFocus, publisher).
+   Plain structs only, so that the paired lens controller (or any other
+   process on the host) can include this without boost or EDT headers.
+
+   The segment is:
+      EosAdimecFocusHeader
+      EosAdimecFocusRecord[nHistory]            (at nRecordOffset)
+
+   Score n (1, 2, ...) goes in record (n-1) % nHistory; nPublished is n
+   once it is complete.  Each record is a seqlock on nStamp: 0 while it
+   is being rewritten, else the n it holds.  To read the latest score:
+
+      n = nPublished (acquire); nothing yet if 0
+      record = records[(n-1) % nHistory]
+      s1 = record.nStamp (acquire); copy the record;
+      atomic_thread_fence(acquire); s2 = record.nStamp
+      good if s1 == s2 and s1 != 0, else read again
+
+   A reader that polls nPublished sees each score as soon as the frame
+   is scored; the history lets a slower reader catch up on the scores of
+   a sweep (a stamp other than the n expected means it was overwritten).
+ */
+#pragma once
+
+#include <stdint.h>
+
+#include <atomic>
+
+static_assert(ATOMIC_LLONG_LOCK_FREE==2,"the focus segment needs lock-free 64-bit atomics");
+
+struct EosAdimecFocusRecord
+{
+    std::atomic<uint64_t> nStamp;   // 0 = being rewritten, else the score number
+    uint64_t nSequence;             // Capture sequence of the scored frame
+    uint64_t nTimeNs;               // CLOCK_MONOTONIC at frame done
+    int64_t nWallSec;               // CLOCK_REALTIME at frame done
+    int64_t nWallNsec;
+    uint32_t nSettingsVersion;      // See EosAdimecSettingsTracker
+    uint8_t bSettingsChanging;      // A SET was in flight during the exposure
+    uint8_t nMethod;                // EosAdimecFocus::E_FOCUS_METHOD
+    uint16_t nPad;
+    int32_t anRoi[4];               // x, y, w, h actually scored (pixels)
+    double dScore;                  // Higher = sharper; only compare like with like
+};
+
+struct EosAdimecFocusHeader
+{
+    uint32_t nMagic;
+    uint32_t nVersion;
+    uint32_t nHistory;
+    int32_t nPublisherPid;
+    uint64_t nRecordOffset;
+    std::atomic<uint64_t> nPublished;   // Scores published
+};
+
+/** Focus segment constants */
+struct EosAdimecFocusConst
+{
+    static const uint32_t MAGIC=0x46464145;   // "EAFF"
+    static const uint32_t VERSION=1;
+};
@@ -0,0 +1,133 @@
+/**
+   Preallocated frame buffers.
+
+   Nothing on a frame path may allocate a 1600x1200 frame per frame, and
+   the process has to stay inside max_mem_mb.  A stage that keeps frames
+   (correction output, video output, archive staging, recorder) takes a
+   pool of fixed-size slots when it starts: one anonymous mapping, every
+   slot page aligned (SIMD loads and O_DIRECT writes straight from it),
+   faulted in up front and, with frame_pool_mlock, locked, so a copy into
+   a slot never waits on the pager.  With frame_pool_hugepages the
+   mapping is asked for in 2 MB pages (MAP_HUGETLB: far fewer TLB misses
+   walking a frame); if the kernel has none to give, normal pages are
+   used and GET_FRAME_POOLS[] says so.
+
+   Every pool comes out of one process budget, set when capture starts:
+   3/4 of max_mem_mb, less the DMA ring and whatever else is Reserve()d
+   (the frame ring's shared segment).  A pool that does not fit does not
+   start.
+
+   Acquire() and Release() hand out slots by index under a short lock.
+   Each pool's occupancy and high-water mark go to GET_FRAME_POOLS[].
+ */
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include <string>
+#include <vector>
+
+#include <boost/thread/mutex.hpp>
+
+class EosAdimecFramePool
+{
+  public:
+
+    /** One pool's use */
+    struct PoolStats
+    {
+        std::string strName;
+        int nSlots;
+        size_t nSlotBytes;          // Slot stride: the size asked for, page rounded
+        int nInUse;
+        int nHighWater;             // Most slots in use at once
+        unsigned long nAcquired;
+        unsigned long nFailed;      // Acquire() with every slot in use
+        size_t nBytes;              // Mapped
+        bool bHugePages;            // Backed by 2 MB pages
+        bool bLocked;               // mlock()ed
+    };
+
+    /** The process budget */
+    struct BudgetStats
+    {
+        size_t nBudgetBytes;
+        size_t nPoolBytes;          // Taken by pools
+        size_t nReservedBytes;      // Taken by Reserve()
+        unsigned long nRefused;     // Pools that did not fit
+    };
+
+    /**
+       @param strName -- for GET_FRAME_POOLS[]
+       @param nSlotBytes -- bytes a slot must hold
+     */
+    EosAdimecFramePool(const std::string& strName, const size_t nSlotBytes, const int nSlots);
+    virtual ~EosAdimecFramePool(void);
+
+    /**
+       Map, fault in and (frame_pool_mlock) lock every slot, out of the budget.
+       @return UNIX_ERROR_STATUS if it does not fit or cannot be mapped
+     */
+    int Start(void);
+
+    /** A free slot, or -1 if all are in use */
+    int Acquire(void);
+    void Release(const int nSlot);
+
+    /** nSlot's bytes (page aligned), after Start() */
+    uint8_t* GetSlot(const int nSlot) const {return m_pBase+(size_t)nSlot*m_nSlotBytes;};
+    size_t GetSlotBytes(void) const {return m_nSlotBytes;};
+    int GetNumSlots(void) const {return m_nSlots;};
+    size_t GetBytes(void) const {return m_nBytes;};
+
+    PoolStats GetStats(void);
+
+    /** Set the process budget and how pools started from now on are backed */
+    static void Configure(const size_t nBudgetBytes, const bool bHugePages, const bool bLock);
+
+    /** Take memory a pool does not own out of the budget; false if it does not fit */
+    static bool Reserve(const size_t nBytes);
+    static void Unreserve(const size_t nBytes);
+
+    /** Budget not taken yet */
+    static size_t GetFreeBytes(void);
+
+    /** Bytes a slot of nBytes takes in a pool */
+    static size_t SlotStride(const size_t nBytes);
+
+    /** Every started pool, in start order */
+    static std::vector<PoolStats> GetAllStats(void);
+    static BudgetStats GetBudgetStats(void);
+
+  protected:
+
+    /** Take it out of the budget; false if it does not fit (s_mtxBudget held) */
+    static bool Charge(const size_t nBytes);
+
+    std::string m_strName;
+    size_t m_nSlotBytes;
+    int m_nSlots;
+    size_t m_nBytes;
+    uint8_t* m_pBase;
+    bool m_bHugePages;
+    bool m_bLocked;
+
+    /** Guards everything below */
+    boost::mutex m_mtxPool;
+    std::vector<int> m_vnFree;      // Free slots: the last released (still cached) goes first
+    int m_nInUse;
+    int m_nHighWater;
+    unsigned long m_nAcquired;
+    unsigned long m_nFailed;
+
+    /** Guards the budget and the started pools */
+    static boost::mutex s_mtxBudget;
+    static size_t s_nBudgetBytes;
+    static size_t s_nPoolBytes;
+    static size_t s_nReservedBytes;
+    static unsigned long s_nRefused;
+    static bool s_bHugePages;
+    static bool s_bLock;
+    static std::vector<EosAdimecFramePool*> s_vpPools;
+};
@@ -0,0 +1,125 @@
+/**
+   Shared-memory frame ring: publishes captured frames to local readers.
+
+   Only one process can own an EDT channel, so the controller captures
+   (EosAdimecCapture) and publishes every frame here.  The video streamer
+   and analytics read the same frames from shared memory, without copies
+   and without touching the grabber.
+
+   Readers connect to a SOCK_SEQPACKET socket (frame_ring_socket).  The
+   handshake gives each one a reader index and, by SCM_RIGHTS, the shm
+   segment fd and an eventfd.  The eventfd is incremented once per
+   published frame.  See EosAdimecFrameRingLayout.h for the segment layout
+   and the slot reference protocol, and EosAdimecFrameRingReader for the
+   reader side.
+
+   Publish() runs on the capture thread.  It copies the frame out of the
+   DMA ring (which the driver owns and reuses) into a free slot once.
+   Readers then use it in place.  If every slot other than the latest is
+   held by readers, the frame is skipped for the ring (counted).  Frames
+   larger than a slot (e.g. after an IMGFMT change) are counted too.
+   Packed (frame_ring_packed), the copy packs each frame to its bit depth
+   (EosAdimecPack), which cuts the slots to 3/4 or less.
+ */
+#pragma once
+
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+#include <atomic>
+
+#include <boost/thread/thread.hpp>
+#include <boost/thread/mutex.hpp>
+
+#include "EosAdimecFrameSource.h"
+#include "EosAdimecFrameRingLayout.h"
+
+class EosAdimecFrameRing
+{
+  public:
+
+    /** Frame ring counters */
+    struct FrameRingStats
+    {
+        size_t nReaders;
+        unsigned long nPublished;
+        unsigned long nSkipped;       // Every free slot held by readers
+        unsigned long nTooBig;        // Frame bigger than a slot
+    };
+
+    /**
+       @param strShmName -- POSIX shm name ("/eosadimec_ss002_frames")
+       @param strSocketPath -- reader handshake socket
+       @param nNumSlots -- slots in the ring (at least 2)
+       @param nMaxReaders -- max# simultaneous readers (1..MAX_READERS)
+       @param bPacked -- publish frames packed to their bit depth
+     */
+    EosAdimecFrameRing(const std::string& strShmName, const std::string& strSocketPath,
+                       const int nNumSlots, const int nMaxReaders, const bool bPacked);
+
+    virtual ~EosAdimecFrameRing(void);
+
+    /**
+       Create the segment and the socket, and start accepting readers.
+       @param nMaxFrameBytes -- slot size (rounded up to a page; packed,
+                                EosAdimecPack::MaxPackedBytes() is enough)
+     */
+    int Open(const size_t nMaxFrameBytes);
+    void Close(void);
+
+    /** Capture consumer: copy the frame into a free slot and notify readers */
+    void Publish(const EosAdimecRawFrame& frame);
+
+    FrameRingStats GetStats(void);
+
+    /** Whole segment size (header, slot table, data) */
+    size_t GetSegmentBytes(void) const {return m_nSegmentBytes;};
+
+    /** Segment size for a given slot count and frame size */
+    static size_t ComputeSegmentBytes(const int nNumSlots, const size_t nMaxFrameBytes);
+
+  protected:
+
+    /** One connected reader */
+    struct ReaderInfo
+    {
+        int nSocketFd;      // -1 = index free
+        int nEventFd;
+    };
+
+    /** Accept readers and notice the ones that hang up */
+    void ServerThread(void);
+
+    /** Accept one reader and send it the handshake */
+    void AcceptReader(void);
+
+    /** Close a reader and clear its references.  Call with m_mtxReaders held. */
+    void DropReader(const int nIndex);
+
+    /** Claim a slot other than the latest with no references; -1 if none */
+    int ClaimSlot(void);
+
+    std::string m_strShmName;
+    std::string m_strSocketPath;
+    int m_nNumSlots;
+    int m_nMaxReaders;
+    bool m_bPacked;
+
+    int m_nShmFd;
+    uint8_t* m_pSegment;
+    size_t m_nSegmentBytes;
+    size_t m_nSlotBytes;
+    EosAdimecFrameRingHeader* m_pHeader;
+    EosAdimecFrameSlot* m_pSlots;
+
+    int m_nListenFd;
+    boost::thread* m_pServerThread;
+    std::atomic<bool> m_abStop;
+
+    /** Guards m_vReaders */
+    boost::mutex m_mtxReaders;
+    std::vector<ReaderInfo> m_vReaders;
+
+    std::atomic<unsigned long> m_anTooBig;
+};
@@ -0,0 +1,118 @@
+/**
+   Shared-memory layout of the frame ring (EosAdimecFrameRing, publisher;
+   EosAdimecFrameRingReader, readers).  Plain structs only, so that
+   analytics programs can include this without boost or EDT headers.
+
+   The segment is:
+      EosAdimecFrameRingHeader
+      EosAdimecFrameSlot[nNumSlots]             (at nSlotTableOffset)
+      slot data, nSlotBytes each, page aligned  (at nDataOffset)
+
+   Slot references: each reader gets a reader index when it connects;
+   bit <index> of a slot's nRefBits says that reader holds the slot.  The
+   publisher only rewrites a slot whose nRefBits is 0, and marks it with
+   REF_WRITER_BIT while it does.  A reader that finds REF_WRITER_BIT set
+   when it sets its bit takes the bit back and retries.  When a reader
+   disconnects (or dies), the publisher clears its bit in every slot, so
+   a crashed reader cannot pin a slot.
+
+   The newest complete frame is in slot nLatestSlot; nLatestSequence
+   changes after the slot is complete.  The publisher never rewrites
+   the latest slot.
+
+   Pixel data: one 16-bit word per pixel, LSB-aligned, nWidth words per
+   row (no padding), Bayer order per bRedRowFirst/bGreenPixelFirst.  With
+   frame_ring_packed, frames are packed to their bit depth instead
+   (meta.nPixelFormat, see EosAdimecPack.h; EosAdimecPack::Unpack()).
+ */
+#pragma once
+
+#include <stdint.h>
+
+#include <atomic>
+
+static_assert(ATOMIC_LLONG_LOCK_FREE==2,"the frame ring needs lock-free 64-bit atomics");
+
+/** Camera settings in effect for a frame (-1 = unknown) */
+struct EosAdimecFrameSettings
+{
+    int32_t nIntegrationTime;   // SETIT value
+    int32_t nGain;              // SETGAIN value (100-800)
+    int32_t nFramePeriod;       // SETFP value
+    int32_t nImgFmtOffset;      // IMGFMT vertical offset
+    int32_t nImgFmtLines;       // IMGFMT vertical size
+    int32_t nImgFmtBinning;     // IMGFMT vertical binning
+    int32_t nOutputBits;        // SETOR value (8/10/12)
+    int32_t nWbRed;             // SETRGB values (100-399), R,G,B order
+    int32_t nWbGreen;
+    int32_t nWbBlue;
+    uint32_t nVersion;          // Bumped each time a setting changes
+};
+
+/** Per-frame metadata */
+struct EosAdimecFrameMeta
+{
+    uint64_t nSequence;         // Capture sequence
+    uint64_t nTimeNs;           // CLOCK_MONOTONIC at frame done
+    int64_t nWallSec;           // CLOCK_REALTIME at frame done
+    int64_t nWallNsec;
+    int32_t nWidth;
+    int32_t nHeight;
+    int32_t nBitDepth;
+    uint8_t bRedRowFirst;
+    uint8_t bGreenPixelFirst;
+    uint8_t bOverrun;
+    uint8_t bSettingsChanging;  // A SET was in flight: settings may be the old or new ones
+    uint32_t nPixelFormat;      // EosAdimecPack::E_PIXEL_FORMAT (0 = 16-bit words)
+    uint32_t nDropped;          // Frames the source lost just before this one
+    uint64_t nDataBytes;        // EosAdimecPack::PackedFrameBytes() (nWidth*nHeight*2 unpacked)
+    EosAdimecFrameSettings settings;    // See EosAdimecSettingsTracker
+};
+
+struct EosAdimecFrameSlot
+{
+    /** Bit i: reader i holds the slot.  REF_WRITER_BIT: being rewritten. */
+    std::atomic<uint64_t> nRefBits;
+    EosAdimecFrameMeta meta;
+};
+
+struct EosAdimecFrameRingHeader
+{
+    uint32_t nMagic;
+    uint32_t nVersion;
+    uint32_t nNumSlots;
+    uint32_t nMaxReaders;
+    uint64_t nSlotBytes;
+    uint64_t nSlotTableOffset;
+    uint64_t nDataOffset;
+    int32_t nPublisherPid;
+    uint32_t nPad;
+
+    std::atomic<int32_t> nLatestSlot;         // -1 until the first frame
+    std::atomic<uint64_t> nLatestSequence;
+    std::atomic<uint64_t> nPublished;         // Frames published
+    std::atomic<uint64_t> nSkipped;           // Frames not published: every slot held
+};
+
+/** Frame ring constants */
+struct EosAdimecFrameRingConst
+{
+    static const uint32_t MAGIC=0x52464145;   // "EAFR"
+    static const uint32_t VERSION=4;
+
+    /** Set in nRefBits while the publisher rewrites a slot */
+    static const uint64_t REF_WRITER_BIT=(1ull<<63);
+
+    /** Reader indexes 0..MAX_READERS-1 */
+    static const uint32_t MAX_READERS=32;
+
+    /** Handshake message (publisher --> reader), sent with the shm and eventfd fds */
+    struct Handshake
+    {
+        uint32_t nMagic;
+        uint32_t nVersion;
+        uint32_t nReaderIndex;
+        uint32_t nPad;
+        uint64_t nSegmentBytes;
+    };
+};
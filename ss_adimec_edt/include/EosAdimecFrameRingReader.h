@@ -0,0 +1,87 @@
+/**
+   Reader side of the shared-memory frame ring (see EosAdimecFrameRing.h).
+   No boost or EDT dependencies: link EosAdimecFrameRingReader.o into
+   the streamer or an analytics program.
+
+      EosAdimecFrameRingReader reader;
+      reader.Connect("/tmp/eosadimec_ss002_frames.sock");
+      uint64_t nLast=0;
+      while(reader.WaitFrame(1000)>=0)
+      {
+          EosAdimecFrameRingReader::FrameView view;
+          if(reader.AcquireLatest(view,nLast))
+          {
+              ... view.pData, view.meta ...
+              nLast=view.meta.nSequence;
+              reader.Release(view);
+          }
+      }
+
+   A held frame is never rewritten, but holding frames keeps the
+   publisher from using their slots: release each one promptly.  Several
+   frames may be held at once; each reader can hold a given slot once.
+ */
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include <string>
+
+#include "EosAdimecFrameRingLayout.h"
+
+class EosAdimecFrameRingReader
+{
+  public:
+
+    /** A held frame */
+    struct FrameView
+    {
+        EosAdimecFrameMeta meta;    // Copied at acquire time
+        const uint16_t* pData;      // In the shared segment, valid until Release()
+                                    // (packed bytes if meta.nPixelFormat!=0)
+        int nSlot;                  // -1 = not held
+    };
+
+    EosAdimecFrameRingReader(void);
+    virtual ~EosAdimecFrameRingReader(void);
+
+    /** Connect to the publisher and map the segment.  0 on success, -1 on error. */
+    int Connect(const std::string& strSocketPath);
+    void Disconnect(void);
+
+    /** Becomes readable when a frame is published (for the caller's own poll loop) */
+    int GetEventFd(void) const {return m_nEventFd;};
+
+    /**
+       Wait for a new frame.
+       @return 1 frame(s) published, 0 timeout, -1 publisher gone
+     */
+    int WaitFrame(const int nTimeoutMs);
+
+    /**
+       Hold the latest frame, if its sequence is greater than nNewerThan.
+       @return false if there is none (or none newer)
+     */
+    bool AcquireLatest(FrameView& view, const uint64_t nNewerThan=0);
+
+    /** Let the publisher reuse the slot */
+    void Release(FrameView& view);
+
+    /** Frames published / skipped by the publisher so far */
+    uint64_t GetPublished(void) const;
+    uint64_t GetSkipped(void) const;
+
+    int GetReaderIndex(void) const {return m_nReaderIndex;};
+
+  protected:
+
+    int m_nSocketFd;
+    int m_nEventFd;
+    int m_nReaderIndex;
+
+    uint8_t* m_pSegment;
+    size_t m_nSegmentBytes;
+    EosAdimecFrameRingHeader* m_pHeader;
+    EosAdimecFrameSlot* m_pSlots;
+};
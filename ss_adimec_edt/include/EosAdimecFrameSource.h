@@ -0,0 +1,198 @@
+/**
+   Frame sources for the in-process capture engine (EosAdimecCapture).
+
+   A frame source owns a ring of pre-allocated frame buffers and fills
+   them continuously.  WaitFrame() hands out the oldest filled buffer in
+   place (no copy); ReleaseFrame() gives it back to the ring.
+
+      EosAdimecFrameSourceEdt       -- EDT grabber via libpdv (DMA ring from
+                                       pdv_multibuf()).  Not built with
+                                       -D_BUILD_NO_EDT_.
+      EosAdimecFrameSourceSynthetic -- generated Bayer test frames at a fixed
+                                       rate, for running without a grabber.
+
+   Frames are raw Bayer: one 16-bit word per pixel, LSB-aligned,
+   nBitDepth (10 or 12) significant bits.
+
+   EDT frames are stamped with the driver's DMA-done time, not the time
+   the capture thread woke up.  Frames the camera sent while no buffer
+   was armed never reach the driver, so the EDT source estimates them
+   from gaps in those stamps (nDropped); overruns and timeouts are
+   counted apart from drops.
+ */
+#pragma once
+
+#include <stdint.h>
+#include <time.h>
+
+#include <string>
+#include <vector>
+
+#include "EosAdimecFrameRingLayout.h"
+
+/** One raw frame, still in its source's ring buffer */
+struct EosAdimecRawFrame
+{
+    const uint16_t* pData;    // nWidth*nHeight words (nStride words per row)
+    int nWidth;
+    int nHeight;
+    int nStride;              // Words per row
+    int nBitDepth;            // Significant bits per word
+    bool bRedRowFirst;        // EDT kbs_red_row_first
+    bool bGreenPixelFirst;    // EDT kbs_green_pixel_first
+    int nRingIndex;           // Which ring buffer (for ReleaseFrame())
+    uint64_t nSequence;       // Source frame counter (EDT: images delivered, from 1)
+    uint32_t nDropped;        // Frames the source lost just before this one
+    uint64_t nTimeNs;         // CLOCK_MONOTONIC when the frame was done
+    struct timespec tsWall;   // CLOCK_REALTIME when the frame was done
+    bool bOverrun;            // Source reported a DMA overrun on this frame
+
+    /** Set by the capture engine (EosAdimecSettingsTracker), not the source */
+    EosAdimecFrameSettings settings;  // In effect for this frame
+    bool bSettingsChanging;           // A SET was in flight during the exposure
+};
+
+class EosAdimecFrameSource
+{
+  public:
+
+    virtual ~EosAdimecFrameSource(void){};
+
+    /** Allocate the ring.  @return UNIX_OK_STATUS or UNIX_ERROR_STATUS */
+    virtual int Open(const int nRingBuffers)=0;
+    virtual void Close(void)=0;
+
+    /** Begin/end continuous acquisition into the ring */
+    virtual int Start(void)=0;
+    virtual void Stop(void)=0;
+
+    /**
+       Wait for the next frame.
+       @return 1 = frame, 0 = timeout, -1 = error
+     */
+    virtual int WaitFrame(EosAdimecRawFrame& frame, const int nTimeoutMs)=0;
+
+    /** Return a WaitFrame() buffer to the ring */
+    virtual void ReleaseFrame(const EosAdimecRawFrame& frame)=0;
+
+    /** Bytes per ring buffer (valid after Open()) */
+    virtual size_t GetFrameBytes(void)=0;
+
+    /**
+       Bytes per ring buffer from the source geometry, before Open()
+       allocates the ring.  @return 0 if the geometry can't be had
+     */
+    virtual size_t ProbeFrameBytes(void)=0;
+
+    virtual std::string GetName(void)=0;
+
+    /** Fill in the CLOCK_MONOTONIC/CLOCK_REALTIME stamps of a frame */
+    static void StampFrame(EosAdimecRawFrame& frame);
+
+    /**
+       Frame --> the metadata the ring, recorder and archive store with it.
+       @param nPixelFormat -- EosAdimecPack::E_PIXEL_FORMAT of the stored data
+       @param nDataBytes -- stored data bytes
+     */
+    static void FillMeta(const EosAdimecRawFrame& frame, const uint32_t nPixelFormat,
+                         const uint64_t nDataBytes, EosAdimecFrameMeta& meta);
+};
+
+#ifndef _BUILD_NO_EDT_
+/**
+   libpdv DMA ring.  Geometry, bit depth, and Bayer order come from the
+   cam file loaded by initcam (see scripts/edt-config-adimec.sh).  The
+   images are taken raw, i.e. before libpdv's own BGGR_WORD decoding.
+ */
+class EosAdimecFrameSourceEdt : public EosAdimecFrameSource
+{
+  public:
+
+    EosAdimecFrameSourceEdt(const int nUnit, const int nChannel);
+    virtual ~EosAdimecFrameSourceEdt(void);
+
+    virtual int Open(const int nRingBuffers);
+    virtual void Close(void);
+    virtual int Start(void);
+    virtual void Stop(void);
+    virtual int WaitFrame(EosAdimecRawFrame& frame, const int nTimeoutMs);
+    virtual void ReleaseFrame(const EosAdimecRawFrame& frame);
+    virtual size_t GetFrameBytes(void);
+    virtual size_t ProbeFrameBytes(void);
+    virtual std::string GetName(void){return "edt";};
+
+  protected:
+
+    /** pdv_open_channel() and the geometry checks; no ring yet */
+    int OpenChannel(void);
+
+    /** frame's done time from the driver's stamp (wall seconds, nanoseconds) */
+    void StampFromDriver(EosAdimecRawFrame& frame, const unsigned int nSec,
+                         const unsigned int nNsec);
+
+    /** Frames lost just before one done at nDoneNs */
+    uint32_t EstimateDropped(const uint64_t nDoneNs);
+
+    int m_nUnit;
+    int m_nChannel;
+    void* m_pPdvDev;          // PdvDev* (edtinc.h stays out of this header)
+    int m_nRingBuffers;
+    int m_nTimeoutMs;         // Last value given to pdv_set_timeout()
+    bool m_bStarted;
+
+    int m_nWidth;
+    int m_nHeight;
+    int m_nBitDepth;
+    bool m_bRedRowFirst;
+    bool m_bGreenPixelFirst;
+
+    uint64_t m_nDoneCount;    // Frames handed out so far
+
+    /** Drop estimate from the driver timestamps (0 = none yet) */
+    uint64_t m_nLastDoneNs;   // Previous frame's done time
+    uint64_t m_nIntervalNs;   // Smoothed frame interval
+};
+#endif
+
+/**
+   Generated frames: a moving color ramp in the configured Bayer order,
+   delivered at nFps.
+ */
+class EosAdimecFrameSourceSynthetic : public EosAdimecFrameSource
+{
+  public:
+
+    EosAdimecFrameSourceSynthetic(const int nWidth, const int nHeight, const int nBitDepth,
+                                  const int nFps, const bool bRedRowFirst,
+                                  const bool bGreenPixelFirst);
+    virtual ~EosAdimecFrameSourceSynthetic(void);
+
+    virtual int Open(const int nRingBuffers);
+    virtual void Close(void);
+    virtual int Start(void);
+    virtual void Stop(void);
+    virtual int WaitFrame(EosAdimecRawFrame& frame, const int nTimeoutMs);
+    virtual void ReleaseFrame(const EosAdimecRawFrame& frame);
+    virtual size_t GetFrameBytes(void);
+    virtual size_t ProbeFrameBytes(void){return GetFrameBytes();};
+    virtual std::string GetName(void){return "synthetic";};
+
+  protected:
+
+    void Generate(uint16_t* pData, const uint64_t nSequence);
+
+    int m_nWidth;
+    int m_nHeight;
+    int m_nBitDepth;
+    int m_nFps;
+    bool m_bRedRowFirst;
+    bool m_bGreenPixelFirst;
+
+    std::vector<uint16_t*> m_vpBuffers;
+    std::vector<bool> m_vbInUse;
+    size_t m_nNext;
+    bool m_bStarted;
+
+    uint64_t m_nSequence;
+    uint64_t m_nNextFrameNs;  // CLOCK_MONOTONIC due time of the next frame
+};
@@ -0,0 +1,151 @@
+/**
+   Per-frame image statistics from the raw Bayer data.
+
+   For each of R, G (both greens) and B: a 256-bin histogram (full scale
+   / 256), mean, min, max, and the share of saturated (>= 98% of full
+   scale) and black (< 2% of full scale) pixels.  Computed on every
+   decimation-th frame as a capture consumer.
+
+   The frame is cut into tiles of rows on the shared tile executor (the
+   capture thread helps) and the per-tile results are merged.  The row kernels (SSE4.1/AVX2, picked at run time like
+   EosAdimecBayer) do the mask/shift/min/max/sum/threshold work 8 or 16
+   pixels at a time and leave only the histogram increments scalar, into
+   separate even/odd-column histograms so neighbouring pixels don't wait
+   on each other.
+
+   The latest result is kept for queries; a push thread hands it to a
+   PushFn every push period (0 = no pushes) if a newer one is there.
+ */
+#pragma once
+
+#include <stdint.h>
+#include <time.h>
+
+#include <atomic>
+#include <vector>
+
+#include <boost/thread/thread.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/function.hpp>
+
+#include "EosAdimecBayer.h"
+#include "EosAdimecFrameSource.h"
+#include "EosAdimecTileExecutor.h"
+
+class EosAdimecFrameStats
+{
+  public:
+
+    enum E_CHANNEL
+    {
+        eChannelRed,
+        eChannelGreen,
+        eChannelBlue,
+        NUM_CHANNELS
+    };
+
+    static const int HIST_BINS=256;
+
+    struct ChannelStats
+    {
+        uint64_t nPixels;
+        double dMean;
+        int nMin;
+        int nMax;
+        double dSaturatedPct;
+        double dBlackPct;
+        uint32_t anHist[HIST_BINS];
+    };
+
+    struct FrameStats
+    {
+        uint64_t nSequence;
+        struct timespec tsWall;
+        uint32_t nSettingsVersion;
+        int nWidth;
+        int nHeight;
+        int nBitDepth;
+        double dComputeMs;          // Wall time for this frame
+        ChannelStats aChannels[NUM_CHANNELS];
+    };
+
+    /** Push thread: a result newer than the last one pushed */
+    typedef boost::function<void (const FrameStats& stats)> PushFn;
+
+    /**
+       @param pExecutor -- splits frames into tiles (NULL = all on the calling thread)
+       @param eLevel -- SIMD level for the row kernels
+     */
+    EosAdimecFrameStats(PushFn fnPush, EosAdimecTileExecutor* pExecutor,
+                        const EosAdimecBayer::E_SIMD_LEVEL eLevel=EosAdimecBayer::eSimdAuto);
+    virtual ~EosAdimecFrameStats(void);
+
+    /** Start the push thread */
+    int Start(void);
+    void Stop(void);
+
+    /** Capture consumer: every decimation-th frame */
+    void OnFrame(const EosAdimecRawFrame& frame);
+
+    /**
+       Statistics of a whole frame, on the calling thread plus the tile
+       executor (one caller at a time).
+       @return 0, or -1 for a bit depth outside 8-15 or a frame under 2x2
+     */
+    int Compute(const EosAdimecBayer::BayerImage& raw, FrameStats& stats);
+
+    /** Latest result; false if there is none yet */
+    bool GetLatest(FrameStats& stats);
+
+    void SetDecimation(const int nDecimation);
+    int GetDecimation(void);
+
+    void SetPushMs(const int nPushMs);
+    int GetPushMs(void);
+
+  protected:
+
+    /** One tile: sums per Bayer position (row parity*2 + column parity) */
+    struct Accum
+    {
+        uint64_t anSum[4];
+        uint64_t anCount[4];
+        uint64_t anSaturated[4];
+        uint64_t anBlack[4];
+        uint32_t anMin[4];
+        uint32_t anMax[4];
+        uint32_t aanHist[4][HIST_BINS];
+    };
+
+    /** Rows [nRowBegin, nRowEnd) into accum (cleared first) */
+    static void AccumulateRows(const EosAdimecBayer::BayerImage& raw, const int nRowBegin,
+                               const int nRowEnd, const EosAdimecBayer::E_SIMD_LEVEL eLevel,
+                               Accum& accum);
+
+    /** Executor TileFn: tile's rows into m_vAccum[tile.nIndex] */
+    void AccumulateTile(const EosAdimecBayer::BayerImage* pRaw,
+                        const EosAdimecTileExecutor::Tile& tile);
+
+    void PushThread(void);
+
+    PushFn m_fnPush;
+    EosAdimecTileExecutor* m_pExecutor;
+    EosAdimecBayer::E_SIMD_LEVEL m_eLevel;
+
+    boost::thread* m_pPushThread;
+    std::atomic<bool> m_abStop;
+
+    /** Capture thread only (and the tiles of its current frame) */
+    uint64_t m_nFrameCount;
+    std::vector<Accum> m_vAccum;       // One per tile
+
+    /** Guards everything below */
+    boost::mutex m_mtxStats;
+    boost::condition_variable m_cvStats;
+    int m_nDecimation;
+    int m_nPushMs;
+    bool m_bHaveStats;
+    FrameStats m_latest;
+    bool m_bPushPending;               // m_latest not pushed yet
+};
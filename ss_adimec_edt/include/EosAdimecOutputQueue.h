@@ -0,0 +1,230 @@
+/**
+   Bounded, non-blocking SCIP response output queue.
+
+   ShipToSCIP() used to write straight into the named pipe.  If SCIP main
+   stopped draining the pipe, the write blocked inside a Handle*() method
+   and the camera serial link stalled with it.  Now ShipToSCIP() only
+   enqueues.  A flusher thread writes each channel with non-blocking I/O
+   and waits for POLLOUT when a channel is full.
+
+   Each output channel (the to-main named pipe, or one SCIP socket client)
+   has its own bounded queue.  Messages are either
+      replies   -- the response to a command; never dropped.  A channel
+                   holding REPLY_BACKLOG_FACTOR x depth replies is
+                   backlogged (IsReplyBacklogged()): the caller stops
+                   reading that channel's commands until it drains, so
+                   input is throttled instead of replies piling up.
+      telemetry -- unsolicited status; dropped per the overflow policy
+                   when the channel is at its configured depth.
+
+   Output is batched per dispatch cycle: the dispatcher Cork()s the
+   channel a command came in on while it executes the commands from one
+   input buffer and Uncork()s it afterward.  Only that channel is held;
+   the others (and their telemetry) keep flowing.  The flusher then writes
+   everything queued on a channel with one writev() (FIFO), one sendmmsg()
+   (SOCK_SEQPACKET, boundaries kept), or one concatenated write through
+   the channel's write function (MQTT).  A channel that reaches its depth
+   is flushed even while corked.
+ */
+#pragma once
+
+#include <string>
+#include <deque>
+#include <map>
+#include <atomic>
+
+#include <boost/thread/thread.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/thread_time.hpp>
+#include <boost/function.hpp>
+
+class EosAdimecOutputQueue
+{
+  public:
+
+    enum E_MSG_CLASS
+    {
+        eMsgReply,
+        eMsgTelemetry
+    };
+
+    enum E_OVERFLOW_POLICY
+    {
+        eDropOldestTelemetry,  // Make room by discarding the oldest queued telemetry
+        eDropNewestTelemetry   // Discard the telemetry message being enqueued
+    };
+
+    enum E_CHANNEL_TYPE
+    {
+        eChannelStream,   // Byte stream (FIFO): partial writes are resumed
+        eChannelPacket    // SOCK_SEQPACKET: one packet per message
+    };
+
+    /** Queue counters (summed over all channels) */
+    struct OutputQueueStats
+    {
+        size_t nDepth;              // Messages currently queued
+        size_t nHighWater;          // Max# messages ever queued on one channel
+        unsigned long nEnqueued;
+        unsigned long nWritten;
+        unsigned long nTelemetryDropped;
+        unsigned long nRepliesDropped;  // Only for a channel that is gone
+        unsigned long nStalls;          // Times a channel returned EAGAIN
+        unsigned long nWriteCalls;      // write/writev/sendmmsg/fnWrite calls
+    };
+
+    /** Replies queued past this factor x depth hold the channel's input */
+    static const size_t REPLY_BACKLOG_FACTOR=4;
+
+    /** Channel ID of the to-main named pipe (socket channels use the client fd) */
+    static const int PIPE_CHANNEL_ID=-1;
+
+    /**
+       @param nMaxDepth -- per-channel queue depth (telemetry limit)
+       @param ePolicy -- what to drop when a channel is full
+     */
+    EosAdimecOutputQueue(const size_t nMaxDepth, const E_OVERFLOW_POLICY ePolicy);
+
+    /** Stops the flusher; closes fds the queue opened itself */
+    virtual ~EosAdimecOutputQueue(void);
+
+    /** Start/stop the flusher thread */
+    int Start(void);
+    void Stop(void);
+
+    /**
+       Add a channel that the queue writes with non-blocking I/O.
+       @param nChannelId -- PIPE_CHANNEL_ID or a socket client fd
+       @param eType -- stream or packet semantics
+       @param nFd -- fd to write (-1 if fnOpen will supply it)
+       @param fnOpen -- (optional) opens/re-opens the fd and returns it
+                        (or -1); the queue owns fds that it opens.
+     */
+    void AddChannel(const int nChannelId, const E_CHANNEL_TYPE eType, const int nFd,
+                    boost::function<int (void)> fnOpen=boost::function<int (void)>());
+
+    /**
+       Add a channel that is flushed through a (possibly blocking)
+       write function, e.g. the MQTT publisher.  It blocks only the flusher.
+     */
+    void AddChannel(const int nChannelId,
+                    boost::function<int (const std::string&)> fnWrite);
+
+    /** Discard a channel and everything queued on it (e.g. client hung up) */
+    void RemoveChannel(const int nChannelId);
+
+    /**
+       Hold a channel's output until the matching Uncork().  Calls nest;
+       a channel that doesn't exist is ignored.
+     */
+    void Cork(const int nChannelId);
+
+    /**
+       Release one Cork() of the channel.  With nLingerUs>0, keep holding
+       its output for that long so that a Cork() arriving right behind
+       (next command of the same input buffer) continues the same batch.
+     */
+    void Uncork(const int nChannelId, const int nLingerUs=0);
+
+    /**
+       Queue one message.  Never blocks.  Replies are always queued while
+       the channel exists.
+       @return UNIX_OK_STATUS if queued, UNIX_ERROR_STATUS if dropped or no such channel
+     */
+    int Enqueue(const int nChannelId, const std::string& strMsg, const E_MSG_CLASS eClass);
+
+    /** Queue one message on every channel (unsolicited output).  Never blocks. */
+    void Broadcast(const std::string& strMsg, const E_MSG_CLASS eClass);
+
+    /** True while the channel holds REPLY_BACKLOG_FACTOR x depth replies or more */
+    bool IsReplyBacklogged(const int nChannelId);
+
+    /**
+       Wait up to nTimeoutMs for a channel to stop being backlogged.
+       @return true if it is not (or no longer exists)
+     */
+    bool WaitReplyRoom(const int nChannelId, const int nTimeoutMs);
+
+    OutputQueueStats GetStats(void);
+
+    /** "drop_oldest" or "drop_newest" --> policy.  Returns false for other strings. */
+    static bool PolicyFromString(const std::string& strPolicy, E_OVERFLOW_POLICY& ePolicy);
+
+  protected:
+
+    struct OutputEntry
+    {
+        std::string strMsg;
+        size_t nOffset;        // Bytes already written (stream partial writes)
+        E_MSG_CLASS eClass;
+    };
+
+    struct OutputChannel
+    {
+        E_CHANNEL_TYPE eType;
+        int nFd;
+        bool bOwnsFd;
+        boost::function<int (void)> fnOpen;
+        boost::function<int (const std::string&)> fnWrite;
+        time_t tLastOpenTry;
+        bool bBlocked;          // Last write returned EAGAIN; wait for POLLOUT
+        std::deque<OutputEntry> dqEntries;
+
+        /** Cork state */
+        int nCorkDepth;
+        boost::system_time tCorkUntil;
+        bool bCorkBreak;        // Hit its depth while corked: flush now
+    };
+
+    /** Everything taken off one callback channel in one pass */
+    struct CallbackBatch
+    {
+        boost::function<int (const std::string&)> fnWrite;
+        std::string strBatch;
+        size_t nMsgs;
+    };
+
+    /** Flusher thread main loop */
+    void FlushThread(void);
+
+    /**
+       Write as much of one fd channel as will go without blocking.
+       Called with m_mtxQueue held.
+     */
+    void FlushFdChannel(OutputChannel& channel);
+
+    /** Enqueue()/Broadcast() on one channel.  Called with m_mtxQueue held. */
+    int EnqueueEntry(OutputChannel& channel, const std::string& strMsg, const E_MSG_CLASS eClass);
+
+    /** Make room per the overflow policy.  Called with m_mtxQueue held. */
+    bool MakeRoom(OutputChannel& channel, const E_MSG_CLASS eClass);
+
+    /** Called with m_mtxQueue held */
+    bool IsReplyBacklogged(const OutputChannel& channel) const;
+
+    void CloseChannelFd(OutputChannel& channel);
+
+    /** Set up a new channel's state.  Called with m_mtxQueue held. */
+    void InitChannel(OutputChannel& channel);
+
+    /** Wake the flusher out of poll() */
+    void Wake(void);
+
+    /** Max# messages per sendmmsg() */
+    static const unsigned int MAX_MSGS_PER_SEND=64;
+
+    size_t m_nMaxDepth;
+    E_OVERFLOW_POLICY m_ePolicy;
+
+    boost::mutex m_mtxQueue;
+    boost::condition_variable m_cvQueue;
+    boost::condition_variable m_cvRoom;    // Flusher wrote, or a channel went away
+    std::map<int, OutputChannel> m_mapChannels;
+
+    OutputQueueStats m_stats;
+
+    int m_nWakeFd;   // eventfd
+    std::atomic<bool> m_abStop;
+    boost::thread* m_pFlushThread;
+};
@@ -0,0 +1,103 @@
+/**
+   Packed pixel formats for raw frames.
+
+   Frames come off the camera as one 16-bit word per pixel, LSB-aligned,
+   whatever the output bit depth (SETOR 8/10/12).  Stored or shipped
+   that way, 10- and 12-bit data wastes 37% and 25% of the bytes.  The
+   packed formats hold only the significant bits:
+
+      ePixel16   -- 16-bit words, as captured (2 bytes per pixel)
+      ePixel8    -- 1 byte per pixel
+      ePixel10p  -- 4 pixels in 5 bytes
+      ePixel12p  -- 2 pixels in 3 bytes
+
+   10p/12p are the GenICam Mono10p/Mono12p bit order: pixels are
+   concatenated LSB first, so pixel i occupies bits [i*N, i*N+N) of the
+   little-endian bit stream.  Each row starts on a byte boundary
+   (PackedRowBytes()); for widths that are a multiple of 4, as on every
+   Adimec mode, that is the same as one stream for the whole frame.
+
+   Pack() drops bits above the format's depth; Unpack() gives back the
+   LSB-aligned 16-bit words.  Both have SSE4.1/AVX2 versions picked
+   with EosAdimecBayer's SIMD level; all levels give identical output.
+   No boost or EDT dependencies: frame ring and archive readers link
+   EosAdimecPack.o and EosAdimecBayer.o to unpack.
+ */
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include <string>
+
+#include "EosAdimecBayer.h"
+
+class EosAdimecPack
+{
+  public:
+
+    /** EosAdimecFrameMeta::nPixelFormat */
+    enum E_PIXEL_FORMAT
+    {
+        ePixel16=0,
+        ePixel8=1,
+        ePixel10p=2,
+        ePixel12p=3
+    };
+
+    /** Smallest format that holds nBitDepth bits (ePixel16 above 12) */
+    static E_PIXEL_FORMAT FormatForBitDepth(const int nBitDepth);
+
+    /** Significant bits a format holds (16, 8, 10, 12) */
+    static int FormatBits(const E_PIXEL_FORMAT eFormat);
+
+    static size_t PackedRowBytes(const int nWidth, const E_PIXEL_FORMAT eFormat);
+    static size_t PackedFrameBytes(const int nWidth, const int nHeight,
+                                   const E_PIXEL_FORMAT eFormat);
+
+    /**
+       Largest packed frame (8, 10p or 12p) of a frame that is nFrameBytes
+       as 16-bit words, for even widths (every Bayer mode): 12p's 3/4.
+       Packed buffers are sized with this; a 16-bit (> 12 bit) frame
+       doesn't fit.
+     */
+    static size_t MaxPackedBytes(const size_t nFrameBytes);
+
+    /**
+       16-bit words --> eFormat, rows back to back.
+       @param nStride -- words per source row
+       @return bytes written (PackedFrameBytes())
+     */
+    static size_t Pack(const uint16_t* pSrc, const int nWidth, const int nHeight, const int nStride,
+                       const E_PIXEL_FORMAT eFormat, uint8_t* pDst,
+                       const EosAdimecBayer::E_SIMD_LEVEL eLevel=EosAdimecBayer::eSimdAuto);
+
+    /**
+       eFormat --> 16-bit words, nWidth per row (no padding).
+       @return bytes read (PackedFrameBytes())
+     */
+    static size_t Unpack(const uint8_t* pSrc, const int nWidth, const int nHeight,
+                         const E_PIXEL_FORMAT eFormat, uint16_t* pDst,
+                         const EosAdimecBayer::E_SIMD_LEVEL eLevel=EosAdimecBayer::eSimdAuto);
+
+    /** "16"/"8"/"10p"/"12p" */
+    static std::string FormatName(const E_PIXEL_FORMAT eFormat);
+
+  protected:
+
+    // One row each.  The SIMD versions return the first pixel they did
+    // not do (a multiple of the group size); the scalar loop finishes.
+    static void PackRowScalar(const uint16_t* pSrc, const int nPixelBegin, const int nWidth,
+                              const E_PIXEL_FORMAT eFormat, uint8_t* pDst);
+    static void UnpackRowScalar(const uint8_t* pSrc, const int nPixelBegin, const int nWidth,
+                                const E_PIXEL_FORMAT eFormat, uint16_t* pDst);
+
+    static int PackRowSse4(const uint16_t* pSrc, const int nWidth, const E_PIXEL_FORMAT eFormat,
+                           uint8_t* pDst);
+    static int PackRowAvx2(const uint16_t* pSrc, const int nWidth, const E_PIXEL_FORMAT eFormat,
+                           uint8_t* pDst);
+    static int UnpackRowSse4(const uint8_t* pSrc, const int nWidth, const E_PIXEL_FORMAT eFormat,
+                             uint16_t* pDst);
+    static int UnpackRowAvx2(const uint8_t* pSrc, const int nWidth, const E_PIXEL_FORMAT eFormat,
+                             uint16_t* pDst);
+};
@@ -0,0 +1,159 @@
+/**
+   Per-frame processing graph.
+
+   Sites want different chains (record only, record plus preview,
+   analytics only), and a stage nobody uses should cost nothing.  The
+   [pipeline] section of the device configuration declares the stages
+   and where each takes its frames from:
+
+      [pipeline]
+      stages = correction, video_output, recorder
+      recorder.input = capture         ## raw frames
+      video_output.format = nv12       ## = [slavecamera] video_output_format
+
+   An input is "capture" (raw frames) or a transform stage (correction:
+   its output, corrected frames).  A stage with no input line takes the
+   corrected frames when correction is in the graph, raw frames
+   otherwise.  stage.param lines are that stage's [slavecamera]
+   stage_param keys.  Without a [pipeline] section the graph is the old
+   one: correction, ae and awb, archive (SET_ARCHIVE[]) and whatever
+   *_enable keys are on, all after correction.
+
+   The graph is fixed when capture starts.  The pipeline is the capture
+   engine's only consumer: for each frame it walks the graph from the
+   capture node, calling each attached stage in turn (transforms on a
+   copy of the frame, their children with the result).  Stages not in
+   the graph are never built or called; a transform that is in the graph
+   but not attached passes frames through.
+
+   Each stage's frames, rate and time per frame are counted for
+   GET_PIPELINE[].
+ */
+#pragma once
+
+#include <stdint.h>
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include <boost/thread/mutex.hpp>
+#include <boost/function.hpp>
+
+#include "EosAdimecCapture.h"
+
+class EosAdimecPipeline
+{
+  public:
+
+    /** Stages, in the order siblings are called */
+    enum E_STAGE
+    {
+        eStageCorrection,
+        eStageVideoOutput,
+        eStageFrameRing,
+        eStageAutoExposure,
+        eStageAutoWhiteBalance,
+        eStageFrameStats,
+        eStageFocus,
+        eStageArchive,
+        eStageRecorder,
+        eStageSnapshot,
+        eStagePreview,
+        NUM_STAGES
+    };
+
+    /** Input of a stage fed by the capture engine */
+    static const int INPUT_CAPTURE=-1;
+
+    /** Input of a stage not in the graph */
+    static const int NOT_IN_GRAPH=-2;
+
+    /** stage name --> input name, as declared */
+    typedef std::map<std::string, std::string> GraphSpec;
+
+    /** Per-stage input: INPUT_CAPTURE, NOT_IN_GRAPH or a transform stage */
+    typedef std::vector<int> Graph;
+
+    /** Transform stage handler: may point pData at its own buffer */
+    typedef boost::function<void (EosAdimecRawFrame&)> FrameFilter;
+
+    /** One stage's throughput */
+    struct StageStats
+    {
+        E_STAGE eStage;
+        int nInput;
+        bool bAttached;
+        unsigned long nFrames;
+        double dFps;                // Smoothed
+        double dMs;                 // Smoothed time per frame
+    };
+
+    /** @param graph -- from ParseGraph() */
+    EosAdimecPipeline(const Graph& graph);
+    virtual ~EosAdimecPipeline(void);
+
+    bool HasStage(const E_STAGE eStage) const;
+
+    /**
+       Attach a stage's frame handler; it replaces any earlier one.
+       Detach() waits for a frame in progress.
+       @return false if the stage is not in the graph
+     */
+    bool Attach(const E_STAGE eStage, EosAdimecCapture::FrameConsumer fnConsumer);
+    bool AttachFilter(const E_STAGE eStage, FrameFilter fnFilter);
+    void Detach(const E_STAGE eStage);
+
+    /** Capture consumer: run the graph on one frame */
+    void OnFrame(const EosAdimecRawFrame& frame);
+
+    /** Stages in the graph, in stage order */
+    std::vector<StageStats> GetStats(void);
+
+    /**
+       Check a declared graph and resolve it: every stage known, every
+       input "capture" or a transform in the graph, no cycles.
+       @return false, and strError, if it is no good
+     */
+    static bool ParseGraph(const GraphSpec& spec, Graph& graph, std::string& strError);
+
+    /** Transforms change the frame their children get */
+    static bool IsTransform(const E_STAGE eStage);
+
+    /** "correction", "video_output", "frame_ring", "ae", "awb", "frame_stats", ... */
+    static std::string StageName(const E_STAGE eStage);
+    static bool StageFromString(const std::string& strStage, E_STAGE& eStage);
+
+    /** "capture" or the stage name */
+    static std::string InputName(const int nInput);
+
+  protected:
+
+    /** A stage's place in the graph and its handler */
+    struct Stage
+    {
+        int nInput;
+        std::vector<int> vnChildren;            // In stage order
+        EosAdimecCapture::FrameConsumer fnConsumer;
+        FrameFilter fnFilter;
+    };
+
+    /** Frames from node nNode (INPUT_CAPTURE or a transform) to its children */
+    void Deliver(const int nNode, const EosAdimecRawFrame& frame);
+
+    /** Add one call of eStage to its stats */
+    void Count(const E_STAGE eStage, const uint64_t nStartNs, const uint64_t nEndNs);
+
+    /** Guards the handlers (held while a frame runs) */
+    boost::mutex m_mtxStages;
+    Stage m_aStages[NUM_STAGES];
+    std::vector<int> m_vnCaptureChildren;
+
+    /** Guards the stats */
+    boost::mutex m_mtxStats;
+    bool m_abAttached[NUM_STAGES];
+    unsigned long m_anFrames[NUM_STAGES];
+    uint64_t m_anLastNs[NUM_STAGES];
+    double m_adFps[NUM_STAGES];
+    double m_adMs[NUM_STAGES];
+};
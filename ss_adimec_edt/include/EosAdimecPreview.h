@@ -0,0 +1,148 @@
+/**
+   Downscaled previews for remote operators on slow links.
+
+   A capture consumer that takes every preview_decimation-th frame and
+   makes 1/2, 1/4 and/or 1/8 resolution copies of it without a demosaic:
+
+      1/2  -- each 2x2 Bayer quad becomes one RGB pixel (R and B as they
+              are, G the mean of the two greens)
+      1/4  -- the 1/2 image halved again (mean of each 2x2 block)
+      1/8  -- the 1/4 image halved
+
+   so a 1600x1200 frame gives 800x600, 400x300 and 200x150.  The binning
+   and halving kernels have SSE4.1/AVX2 versions picked at run time like
+   EosAdimecBayer; all levels give the same output.  Each level then goes
+   through the video output's color conversion (EosAdimecYuv::ConvertRgb,
+   with video_output_wb_gains and no tone map: a plain shift to 8 bits)
+   to I420 or NV12.  Width and height are rounded down to even at each
+   level.
+
+   The work is done on the capture thread, but only on the frames taken,
+   and is a small fraction of a full-size conversion (the raw frame is
+   read once, no full RGB frame is made).  The previews go to a
+   shared-memory segment (EosAdimecPreviewLayout.h) that a relay to the
+   remote link reads; the intermediate RGB planes are a frame pool.
+ */
+#pragma once
+
+#include <stdint.h>
+
+#include <atomic>
+#include <string>
+#include <vector>
+
+#include <boost/thread/mutex.hpp>
+
+#include "EosAdimecBayer.h"
+#include "EosAdimecYuv.h"
+#include "EosAdimecFrameSource.h"
+#include "EosAdimecFramePool.h"
+#include "EosAdimecPreviewLayout.h"
+
+class EosAdimecPreview
+{
+  public:
+
+    /** Preview counters */
+    struct PreviewStats
+    {
+        int nDecimation;
+        unsigned long nPublished;   // Previews published (all levels)
+        unsigned long nSkipped;     // Frames taken but not usable (size, bit depth)
+        double dMs;                 // Smoothed time per preview, all levels
+        int anWidth[EosAdimecPreviewConst::MAX_LEVELS];     // Of the last preview
+        int anHeight[EosAdimecPreviewConst::MAX_LEVELS];
+    };
+
+    /** Slots per level in the segment */
+    static const int SLOTS=4;
+
+    /**
+       @param strShmName -- POSIX shm name of the segment
+       @param vnScales -- levels published: 2, 4 and/or 8, ascending, no repeats
+       @param nDecimation -- every Nth frame
+     */
+    EosAdimecPreview(const std::string& strShmName, const std::vector<int>& vnScales,
+                     const int nDecimation, const EosAdimecYuv::E_YUV_FORMAT eFormat,
+                     const EosAdimecYuv::WbGains& gains,
+                     const EosAdimecBayer::E_SIMD_LEVEL eLevel=EosAdimecBayer::eSimdAuto);
+    virtual ~EosAdimecPreview(void);
+
+    /**
+       Take the plane pool and create the segment.
+       @param nFrameBytes -- largest frame (EosAdimecCapture::GetFrameBytes())
+     */
+    int Start(const size_t nFrameBytes);
+    void Stop(void);
+
+    /** Capture consumer: every Nth frame, make and publish the previews */
+    void OnFrame(const EosAdimecRawFrame& frame);
+
+    void SetDecimation(const int nDecimation);
+
+    PreviewStats GetStats(void);
+
+    /** Segment bytes (for the memory budget); 0 before Start() */
+    size_t GetSegmentBytes(void) const {return m_nSegmentBytes;};
+
+    /** Segment size for these levels and frame size, before Start() */
+    static size_t ComputeSegmentBytes(const std::vector<int>& vnScales, const size_t nFrameBytes);
+
+    const std::vector<int>& GetScales(void) const {return m_vnScales;};
+    EosAdimecYuv::E_YUV_FORMAT GetFormat(void) const {return m_eFormat;};
+
+    /**
+       Bayer quads --> R, G, B planes at half size: quads [0, nWidth) x
+       [0, nHeight) (nWidth, nHeight no more than half the frame's).
+       @return 0, or -1 if the bit depth is outside 8-15
+     */
+    static int BinQuads(const EosAdimecBayer::BayerImage& raw, const int nWidth,
+                        const int nHeight, EosAdimecBayer::RgbPlanes& rgb,
+                        const EosAdimecBayer::E_SIMD_LEVEL eLevel);
+
+    /** R, G, B planes halved each way: mean of each 2x2 block (nWidth, nHeight of the output) */
+    static void Halve(const EosAdimecBayer::RgbPlanes& rgbIn, const int nWidth,
+                      const int nHeight, EosAdimecBayer::RgbPlanes& rgbOut,
+                      const EosAdimecBayer::E_SIMD_LEVEL eLevel);
+
+    /** "2,4,8" --> ascending scales.  False for anything but 2, 4 and 8. */
+    static bool ScalesFromString(const std::string& strScales, std::vector<int>& vnScales);
+
+  protected:
+
+    /** Fill in the levels (up to vnScales.size()); @return segment bytes */
+    static size_t LayoutLevels(const std::vector<int>& vnScales, const size_t nFramePixels,
+                               EosAdimecPreviewLevel aLevels[]);
+
+    int OpenSegment(const size_t nFramePixels);
+    void CloseSegment(void);
+
+    /** Convert the level's planes into the next slot of the level */
+    void PublishLevel(const int nLevel, const uint64_t nStamp, EosAdimecBayer::RgbPlanes& rgb,
+                      const int nWidth, const int nHeight, const EosAdimecRawFrame& frame);
+
+    std::string m_strShmName;
+    std::vector<int> m_vnScales;
+    EosAdimecYuv::E_YUV_FORMAT m_eFormat;
+    EosAdimecYuv::WbGains m_gains;
+    EosAdimecBayer::E_SIMD_LEVEL m_eLevel;
+    std::atomic<int> m_anDecimation;
+
+    /** Segment (capture thread writes it once open) */
+    int m_nShmFd;
+    size_t m_nSegmentBytes;
+    uint8_t* m_pSegment;
+    EosAdimecPreviewHeader* m_pHeader;
+
+    /** RGB planes of every level from 1/2 down to the smallest published */
+    EosAdimecFramePool* m_pPool;
+    uint16_t* m_pPlanes;
+    size_t m_nFramePixels;              // Largest frame the planes are sized for
+
+    /** Capture thread only */
+    unsigned long m_nFrames;
+
+    /** Guards the stats */
+    boost::mutex m_mtxPreview;
+    PreviewStats m_stats;
+};
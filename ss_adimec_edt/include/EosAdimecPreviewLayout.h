@@ -0,0 +1,81 @@
+/**
+   Shared-memory layout of the downscaled previews (EosAdimecPreview,
+   publisher).  Plain structs only, so that a preview relay (or any other
+   process on the host) can include this without boost or EDT headers.
+
+   The segment is:
+      EosAdimecPreviewHeader
+      per level (aLevels[0..nLevels)), at its nSlotOffset:
+         nSlots slots of nSlotBytes, each
+            EosAdimecPreviewFrame
+            YUV frame                           (at nDataOffset in the slot)
+
+   Preview n (1, 2, ...) goes in slot (n-1) % nSlots of every level;
+   nPublished is n once all its levels are complete.  Each slot is a
+   seqlock on nStamp: 0 while it is being rewritten, else the n it holds.
+   To read the latest preview at one level:
+
+      n = nPublished (acquire); nothing yet if 0
+      slot = level.nSlotOffset + ((n-1) % nSlots)*level.nSlotBytes
+      s1 = frame.nStamp (acquire); copy the frame header and nBytes of data;
+      atomic_thread_fence(acquire); s2 = frame.nStamp
+      good if s1 == s2 and s1 != 0, else read again
+
+   The data is 8-bit I420 or NV12 (nFormat), nWidth x nHeight, planes
+   back to back with no row padding, as the video output writes it.
+ */
+#pragma once
+
+#include <stdint.h>
+
+#include <atomic>
+
+static_assert(ATOMIC_LLONG_LOCK_FREE==2,"the preview segment needs lock-free 64-bit atomics");
+
+/** Preview segment constants */
+struct EosAdimecPreviewConst
+{
+    static const uint32_t MAGIC=0x50504145;   // "EAPP"
+    static const uint32_t VERSION=1;
+    static const uint32_t MAX_LEVELS=3;       // 1/2, 1/4, 1/8
+};
+
+/** Slot header */
+struct EosAdimecPreviewFrame
+{
+    std::atomic<uint64_t> nStamp;   // 0 = being rewritten, else the preview number
+    uint64_t nSequence;             // Capture sequence of the source frame
+    uint64_t nTimeNs;               // CLOCK_MONOTONIC at frame done
+    int64_t nWallSec;               // CLOCK_REALTIME at frame done
+    int64_t nWallNsec;
+    uint32_t nSettingsVersion;      // See EosAdimecSettingsTracker
+    uint8_t bSettingsChanging;      // A SET was in flight during the exposure
+    uint8_t nFormat;                // EosAdimecYuv::E_YUV_FORMAT: 0 = I420, 1 = NV12
+    uint16_t nBitDepth;             // Of the source frame
+    uint32_t nWidth;
+    uint32_t nHeight;
+    uint64_t nBytes;                // Frame data (w*h*3/2)
+};
+
+/** One resolution */
+struct EosAdimecPreviewLevel
+{
+    uint32_t nScale;                // 2, 4 or 8: 1/nScale of the frame each way
+    uint32_t nPad;
+    uint64_t nSlotOffset;           // First slot, from the segment start
+    uint64_t nSlotBytes;            // Slot stride
+    uint64_t nDataOffset;           // Frame data, from the slot start
+    uint64_t nMaxBytes;             // Largest frame a slot holds
+};
+
+struct EosAdimecPreviewHeader
+{
+    uint32_t nMagic;
+    uint32_t nVersion;
+    uint32_t nLevels;
+    uint32_t nSlots;
+    int32_t nPublisherPid;
+    uint32_t nPad;
+    EosAdimecPreviewLevel aLevels[EosAdimecPreviewConst::MAX_LEVELS];
+    std::atomic<uint64_t> nPublished;   // Previews published
+};
@@ -0,0 +1,170 @@
+/**
+   Pre-trigger recorder: the last few seconds of raw Bayer frames in RAM,
+   saved to disk on demand (TRIGGER_SAVE[pre_s,post_s]).
+
+   A capture consumer copies every frame into a RAM slot.  Slots are
+   added as frames come in until they cover the configured duration or
+   use up the memory limit, whichever comes first; after that the oldest
+   slot is reused.  The slots are a frame pool (EosAdimecFramePool),
+   mapped and faulted in at Start(), so the capture thread never
+   allocates; a slot is taken from the pool the first time it is needed,
+   so the pool's high-water mark is what the span really takes.
+
+   A trigger holds every slot from the last pre_s seconds, and the
+   frames of the next post_s seconds as they arrive, and a saver thread
+   (niced, so capture keeps its CPU) writes them oldest first to one
+   recording file (EosAdimecRecordingLayout.h), freeing each slot once it
+   is on disk.  The capture thread never waits for the saver: if the next
+   frame has no slot (all held), it is not recorded, and counted as
+   dropped if it was in the post-trigger window.  One save at a time.
+   Packed (recorder_packed), each frame is packed to its bit depth as it
+   is copied (EosAdimecPack), so the same RAM holds 4/3 or more frames.
+
+   The outcome goes to a DoneFn from the saver thread.
+ */
+#pragma once
+
+#include <stdint.h>
+
+#include <atomic>
+#include <deque>
+#include <string>
+#include <vector>
+
+#include <boost/thread/thread.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/function.hpp>
+
+#include "EosAdimecFrameSource.h"
+#include "EosAdimecFramePool.h"
+#include "EosAdimecRecordingLayout.h"
+
+class EosAdimecRecorder
+{
+  public:
+
+    /** Recorder counters */
+    struct RecorderStats
+    {
+        int nMaxSlots;              // Memory limit / frame size
+        int nSlots;                 // Slots in use so far
+        int nHeld;                  // Slots waiting for the saver
+        double dSpanSec;            // Oldest to newest frame in RAM
+        size_t nBytes;              // RAM the slots in use take
+        unsigned long nRecorded;    // Frames copied in
+        unsigned long nSkipped;     // Frames with no free slot
+        unsigned long nTooBig;      // Frames bigger than a slot
+        bool bSaving;
+        unsigned long nSaves;       // Recordings finished
+        unsigned long nSaveErrors;  // ... of which failed
+    };
+
+    /** End of one save */
+    struct SaveResult
+    {
+        uint64_t nTriggerId;
+        bool bOk;
+        std::string strPath;
+        std::string strError;       // !bOk only
+        unsigned long nFrames;      // Written
+        unsigned long nPreFrames;
+        unsigned long nDropped;     // Post-trigger frames not recorded
+        double dWriteSec;           // Trigger to file closed
+    };
+
+    typedef boost::function<void (const SaveResult& result)> DoneFn;
+
+    /**
+       @param strDir -- recordings go here (created if missing)
+       @param strPrefix -- file name prefix
+       @param nSeconds -- keep at most this much in RAM
+       @param nMaxBytes -- RAM for the slots
+       @param bPacked -- keep frames packed to their bit depth (more fit)
+     */
+    EosAdimecRecorder(DoneFn fnDone, const std::string& strDir, const std::string& strPrefix,
+                      const int nSeconds, const size_t nMaxBytes, const bool bPacked);
+    virtual ~EosAdimecRecorder(void);
+
+    /**
+       Reserve the slots and start the saver thread.
+       @param nFrameBytes -- largest frame (EosAdimecCapture::GetFrameBytes(), or
+                            EosAdimecPack::MaxPackedBytes() of it if packed)
+       @return UNIX_ERROR_STATUS if nMaxBytes doesn't hold two frames
+     */
+    int Start(const size_t nFrameBytes);
+    void Stop(void);
+
+    /** Capture consumer: copy the frame into a slot */
+    void OnFrame(const EosAdimecRawFrame& frame);
+
+    /**
+       Freeze the last dPreSec seconds and record dPostSec more.
+       @param nTriggerId, strPath -- out: what the DoneFn will report
+       @param nPreFrames -- out: frames held from before the trigger
+       @param strError -- out: why not (a save is running, nothing to save)
+       @return UNIX_OK_STATUS or UNIX_ERROR_STATUS
+     */
+    int TriggerSave(const double dPreSec, const double dPostSec, uint64_t& nTriggerId,
+                    std::string& strPath, unsigned long& nPreFrames, std::string& strError);
+
+    RecorderStats GetStats(void);
+
+  protected:
+
+    struct Slot
+    {
+        EosAdimecFrameMeta meta;
+        uint8_t* pData;             // From the pool once first used
+        bool bValid;                // Holds a complete frame (not while copying in)
+        bool bHeld;                 // Queued for the saver
+    };
+
+    /** The save in progress */
+    struct Save
+    {
+        EosAdimecRecordingHeader header;
+        std::string strPath;
+        uint64_t nEndNs;            // Post-trigger window end (CLOCK_MONOTONIC)
+        bool bPostDone;             // A frame past nEndNs came in
+        std::deque<int> dqSlots;    // Held slots, oldest first
+    };
+
+    /** Slot for the next frame, or -1 (m_mtxRecorder held) */
+    int ClaimSlot(void);
+
+    void SaverThread(void);
+
+    /**
+       Write m_save to its file (m_mtxRecorder held on entry and exit;
+       dropped while writing).
+     */
+    void WriteSave(boost::unique_lock<boost::mutex>& lock, SaveResult& result);
+
+    DoneFn m_fnDone;
+    std::string m_strDir;
+    std::string m_strPrefix;
+    uint64_t m_nSpanNs;
+    size_t m_nMaxBytes;
+    bool m_bPacked;
+
+    size_t m_nSlotBytes;
+    EosAdimecFramePool* m_pPool;
+
+    boost::thread* m_pSaverThread;
+    std::atomic<bool> m_abStop;
+
+    /** Guards everything below */
+    boost::mutex m_mtxRecorder;
+    boost::condition_variable m_cvRecorder;
+    std::vector<Slot> m_vSlots;     // m_vSlots.size() = max slots
+    int m_nSlotsUsed;               // Slots [0, m_nSlotsUsed) have been used
+    unsigned long m_nRecorded;
+    unsigned long m_nSkipped;
+    unsigned long m_nTooBig;
+    uint64_t m_nNextTriggerId;
+    bool m_bSaving;
+    Save m_save;
+    unsigned long m_nSaves;
+    unsigned long m_nSaveErrors;
+};
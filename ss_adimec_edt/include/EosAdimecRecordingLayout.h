@@ -0,0 +1,48 @@
+/**
+   On-disk layout of a TRIGGER_SAVE recording (EosAdimecRecorder).
+   Plain structs only, like EosAdimecFrameRingLayout.h, so review tools
+   can read recordings without boost or EDT headers.
+
+   A recording is one file:
+      EosAdimecRecordingHeader                  (nHeaderBytes)
+      then per frame, in capture order:
+         EosAdimecFrameMeta                     (nFrameMetaBytes)
+         pixel data                             (meta.nDataBytes)
+
+   Pixel data is as in the frame ring: one 16-bit word per pixel,
+   LSB-aligned, nWidth words per row, Bayer order per the meta flags, or
+   packed per meta.nPixelFormat (recorder_packed; see EosAdimecPack.h).
+
+   nFrames and nDropped are written when the recording is closed; a file
+   with nFrames == 0 and frames after the header was cut short (walk the
+   frames until the file ends).
+ */
+#pragma once
+
+#include <stdint.h>
+
+#include "EosAdimecFrameRingLayout.h"
+
+struct EosAdimecRecordingHeader
+{
+    uint32_t nMagic;
+    uint32_t nVersion;
+    uint32_t nHeaderBytes;          // Offset of the first frame
+    uint32_t nFrameMetaBytes;       // sizeof(EosAdimecFrameMeta) when written
+    uint64_t nTriggerId;
+    uint64_t nTriggerTimeNs;        // CLOCK_MONOTONIC of the trigger (same clock as meta.nTimeNs)
+    int64_t nTriggerWallSec;        // CLOCK_REALTIME of the trigger
+    int64_t nTriggerWallNsec;
+    uint32_t nPreMs;                // Window asked for
+    uint32_t nPostMs;
+    uint64_t nFrames;               // Frames in the file (0 until closed)
+    uint64_t nPreFrames;            // ... of which from before the trigger
+    uint64_t nDropped;              // Post-trigger frames with no free RAM slot
+};
+
+/** Recording constants */
+struct EosAdimecRecordingConst
+{
+    static const uint32_t MAGIC=0x43524145;   // "EARC"
+    static const uint32_t VERSION=2;
+};
@@ -0,0 +1,121 @@
+/**
+   A local (AF_UNIX) SOCK_SEQPACKET listening socket for SCIP
+   command/response traffic.
+
+   Unlike the named-pipe transport, SOCK_SEQPACKET preserves message
+   boundaries: every recv() returns exactly one client message, so a
+   command never has to be reassembled from a "leftover" partial read.
+   Several local clients can be connected at once; each response is
+   sent back to the client that issued the command.  Client sockets are
+   non-blocking: a client that stops reading until its socket buffer is
+   full is disconnected rather than allowed to stall the sender.
+
+   This class only moves bytes.  It does not parse SCIP commands.
+ */
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include <boost/thread/mutex.hpp>
+#include <boost/function.hpp>
+
+/** One message read from one client. */
+struct EosAdimecSeqPacketMsg
+{
+    int nClientFd;
+    std::string strMsg;
+};
+
+class EosAdimecSeqPacketServer
+{
+  public:
+
+    /**
+       @param strSocketPath -- filesystem path of the listening socket
+       @param nMaxClients -- max# simultaneously-connected clients
+     */
+    EosAdimecSeqPacketServer(const std::string& strSocketPath,
+                             const int nMaxClients);
+
+    /** Closes all clients and removes the socket file */
+    virtual ~EosAdimecSeqPacketServer(void);
+
+    /** Largest client message we will accept (matches EosAdimec::MAX_BUFFER_SIZE) */
+    static const size_t MAX_MSG_SIZE=16384;
+
+    /**
+       Create, bind, and listen.  A stale socket file left behind by
+       a previous run is removed first.
+       @return UNIX_OK_STATUS or UNIX_ERROR_STATUS
+     */
+    int Open(void);
+
+    /** Close the listening socket and all client connections. */
+    void Close(void);
+
+    /**
+       Wait up to nTimeoutMs for socket activity.  Accepts new clients,
+       drops disconnected ones, and appends every complete client message
+       to vMsgs.
+       @return number of messages appended, or UNIX_ERROR_STATUS
+     */
+    int Poll(std::vector<EosAdimecSeqPacketMsg>& vMsgs, const int nTimeoutMs);
+
+    /**
+       Send one message to one client, without blocking.
+       @return UNIX_OK_STATUS or UNIX_ERROR_STATUS (client gone or
+               evicted for not keeping up)
+     */
+    int Send(const int nClientFd, const std::string& strMsg);
+
+    /**
+       Send one message to every connected client.
+       @return number of clients that the message was sent to.
+     */
+    int Broadcast(const std::string& strMsg);
+
+    /** Number of connected clients */
+    size_t GetNumClients(void);
+
+    /** fds of the connected clients */
+    std::vector<int> GetClientFds(void);
+
+    /**
+       Optional hooks, called with the client fd when a client connects
+       (before it is listed) and just before a disconnected client's fd
+       is closed (after it is unlisted).  Called without the client lock,
+       so they may take locks that are held around Send()/Broadcast().
+     */
+    void SetClientCallbacks(boost::function<void (int)> fnAccepted,
+                            boost::function<void (int)> fnDropped);
+
+    /**
+       Optional: a client for which fnCanRead(fd) is false is not read
+       (its commands wait in its socket) until a later Poll() finds it
+       true.  Hang-ups are still noticed.  Called without the client lock.
+     */
+    void SetReadFilter(boost::function<bool (int)> fnCanRead);
+
+    const std::string& GetSocketPath(void) const {return m_strSocketPath;};
+
+  protected:
+
+    void AcceptClient(void);
+    void DropClient(const int nClientFd);
+
+    /** Non-blocking send; a client that can't take it is shut down */
+    int SendOrEvict(const int nClientFd, const std::string& strMsg);
+
+    std::string m_strSocketPath;
+    int m_nMaxClients;
+    int m_nListenFd;
+
+    /** Guards m_vnClientFds (Poll() and Send() run on different threads) */
+    boost::mutex m_mtxClients;
+    std::vector<int> m_vnClientFds;
+
+    boost::function<void (int)> m_fnClientAccepted;
+    boost::function<void (int)> m_fnClientDropped;
+    boost::function<bool (int)> m_fnCanRead;
+};
@@ -0,0 +1,122 @@
+/**
+   Which camera settings were in effect for each captured frame.
+
+   Every SET (IT, gain, frame period, IMGFMT, output bits) marks a change
+   pending when its serial command is sent (BeginChange()).  The ACK
+   commits a new settings version, with the send and ACK times; an error
+   abandons the change.  The capture engine calls TagFrame() for each
+   frame before any consumer sees it.
+
+   A version applies to a frame if it was ACKed before the frame's
+   exposure could have started.  The earliest exposure start is estimated
+   from the frame-done timestamp:
+
+      done - (frame period + integration time) - margin
+
+   so readout plus transfer must fit in one frame period.  Unknown
+   periods (-1) fall back to the measured frame interval.  A frame whose
+   exposure overlaps a SET that was sent but not yet ACKed, or one that
+   is still pending, is flagged bSettingsChanging: it may have the old or
+   the new values.
+
+   Versions are cumulative, so the first frame of version N is the first
+   frame tagged N or later that is not changing.  A control loop can use
+   that frame, or any later one, straight away instead of waiting out a
+   few frame periods.
+ */
+#pragma once
+
+#include <stdint.h>
+
+#include <deque>
+
+#include <boost/thread/mutex.hpp>
+
+#include "EosAdimecFrameSource.h"
+
+class EosAdimecSettingsTracker
+{
+  public:
+
+    /** GetFirstFrame() results */
+    enum E_FIRST_FRAME
+    {
+        eFirstFrameFound,       // info is valid
+        eFirstFramePending,     // No frame with these settings yet
+        eFirstFrameUnknown      // Not issued yet, or too old to remember
+    };
+
+    /** The first frame with a given settings version */
+    struct FirstFrameInfo
+    {
+        uint64_t nSequence;
+        uint64_t nTimeNs;           // CLOCK_MONOTONIC, frame done
+        struct timespec tsWall;     // CLOCK_REALTIME, frame done
+        uint64_t nAckNs;            // CLOCK_MONOTONIC, camera ACK
+    };
+
+    /**
+       @param initial -- settings (and version) in effect now
+       @param nTimeUnitNs -- camera frame period/integration time unit
+       @param nMarginNs -- slack for frame-done timestamp jitter
+     */
+    EosAdimecSettingsTracker(const EosAdimecFrameSettings& initial, const uint64_t nTimeUnitNs,
+                             const uint64_t nMarginNs);
+    virtual ~EosAdimecSettingsTracker(void);
+
+    /**
+       A SET command went to the camera at nSendNs; frames done after
+       that are changing until Commit() or AbandonChange().
+     */
+    void BeginChange(const uint64_t nSendNs);
+
+    /**
+       Record a new settings version (settings.nVersion must increase)
+       and end the pending change.
+       @param nSendNs -- when the SET command went to the camera
+       @param nAckNs -- when the camera ACKed it
+     */
+    void Commit(const EosAdimecFrameSettings& settings, const uint64_t nSendNs,
+                const uint64_t nAckNs);
+
+    /** The pending SET failed: no new version */
+    void AbandonChange(void);
+
+    /** Fill in frame.settings and frame.bSettingsChanging (capture thread) */
+    void TagFrame(EosAdimecRawFrame& frame);
+
+    /** The first frame with settings version nVersion (or later) */
+    E_FIRST_FRAME GetFirstFrame(const uint32_t nVersion, FirstFrameInfo& info);
+
+    /** Newest committed version */
+    uint32_t GetVersion(void);
+
+  protected:
+
+    /** Longest exposure + readout a version allows (ns) */
+    uint64_t GetSpanNs(const EosAdimecFrameSettings& settings);
+
+    /** One committed version */
+    struct Entry
+    {
+        EosAdimecFrameSettings settings;
+        uint64_t nSendNs;
+        uint64_t nAckNs;
+        bool bSeen;             // first frame found
+        FirstFrameInfo first;
+    };
+
+    /** Versions older than this many are forgotten */
+    static const size_t MAX_HISTORY=64;
+
+    uint64_t m_nTimeUnitNs;
+    uint64_t m_nMarginNs;
+
+    /** Guards everything below */
+    boost::mutex m_mtxHistory;
+    std::deque<Entry> m_dqHistory;      // Oldest first; never empty
+    uint64_t m_nPendingSendNs;          // Send time of the pending SET, 0 = none
+    uint32_t m_nPrevTagVersion;         // Version of the previous frame
+    uint64_t m_nPrevFrameNs;
+    uint64_t m_nFrameIntervalNs;        // Measured, 0 until two frames
+};
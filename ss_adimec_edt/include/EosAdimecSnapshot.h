@@ -0,0 +1,187 @@
+/**
+   Single still frames on demand (SNAPSHOT[png|jpeg]).
+
+   Without this a client that wants one picture has to read the whole
+   video stream.  A capture consumer that does nothing until a snapshot
+   is requested, then copies the next complete frame into a preallocated
+   slot (a frame pool, EosAdimecFramePool) and hands it to an encoder
+   thread.  "Complete" means its exposure started after the request: it
+   is done at least one measured frame interval after it, and was not
+   overrun or caught by a SET in flight.  In triggered mode the camera
+   sends nothing until it is triggered, so the first frame that comes
+   is taken.
+
+   The encoder demosaics BAND_ROWS rows at a time (EosAdimecBayer, SIMD)
+   into a band that stays in cache and feeds them straight to the
+   encoder row by row, so there is never a full RGB frame:
+
+      png   -- 16-bit RGB, every captured bit kept (an sBIT chunk says
+               how many are real), zlib level snapshot_png_level
+      jpeg  -- 8-bit RGB through libjpeg-turbo (SIMD color conversion
+               and DCT), quality snapshot_jpeg_quality
+
+   Colors are as captured: no white-balance gains or tone map (the
+   camera's SETRGB is already in the frame).
+
+   The file is written under a temporary name and renamed, so a reader
+   never sees part of one; with the directory on tmpfs (/dev/shm, the
+   default) it never touches a disk.  The newest snapshot_keep files are
+   kept.  One snapshot at a time; the outcome goes to a DoneFn from the
+   encoder thread.  A request no frame answers within the timeout fails.
+ */
+#pragma once
+
+#include <stdint.h>
+#include <time.h>
+
+#include <atomic>
+#include <deque>
+#include <string>
+#include <vector>
+
+#include <boost/thread/thread.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/function.hpp>
+
+#include "EosAdimecFrameSource.h"
+#include "EosAdimecFramePool.h"
+#include "EosAdimecBayer.h"
+
+class EosAdimecSnapshot
+{
+  public:
+
+    enum E_FORMAT
+    {
+        eFormatPng,
+        eFormatJpeg
+    };
+
+    /** Snapshot counters */
+    struct SnapshotStats
+    {
+        bool bBusy;                 // A request is waiting or encoding
+        unsigned long nTaken;       // Files written
+        unsigned long nFailed;      // Timeouts and encode/write errors
+        unsigned long nSkipped;     // Frames passed over as not complete
+        double dEncodeMs;           // Last encode and write
+    };
+
+    /** End of one snapshot */
+    struct SnapshotResult
+    {
+        uint64_t nId;
+        bool bOk;
+        std::string strPath;
+        std::string strError;       // !bOk only
+        E_FORMAT eFormat;
+        bool bTriggered;
+        uint64_t nSequence;         // Of the frame
+        struct timespec tsWall;     // CLOCK_REALTIME, frame done
+        double dWaitMs;             // Request to frame done
+        double dEncodeMs;
+    };
+
+    typedef boost::function<void (const SnapshotResult& result)> DoneFn;
+
+    /** Rows demosaiced per band */
+    static const int BAND_ROWS=8;
+
+    /**
+       @param strDir -- snapshots go here (created if missing)
+       @param strPrefix -- file name prefix
+       @param nJpegQuality -- 1-100
+       @param nPngLevel -- zlib level, 0-9
+       @param nKeep -- newest files kept
+       @param nTimeoutMs -- a request with no frame by then fails
+     */
+    EosAdimecSnapshot(DoneFn fnDone, const std::string& strDir, const std::string& strPrefix,
+                      const EosAdimecBayer::E_DEMOSAIC_METHOD eMethod, const int nJpegQuality,
+                      const int nPngLevel, const int nKeep, const int nTimeoutMs);
+    virtual ~EosAdimecSnapshot(void);
+
+    /**
+       Take the frame slot and start the encoder thread.
+       @param nFrameBytes -- largest frame (EosAdimecCapture::GetFrameBytes())
+     */
+    int Start(const size_t nFrameBytes);
+    void Stop(void);
+
+    /** Capture consumer: copy the frame if a snapshot is waiting for it */
+    void OnFrame(const EosAdimecRawFrame& frame);
+
+    /**
+       Take the next complete frame (bTriggered: the next frame at all).
+       @param nId -- out: what the DoneFn will report
+       @param strError -- out: why not (one is already running)
+       @return UNIX_OK_STATUS or UNIX_ERROR_STATUS
+     */
+    int Request(const E_FORMAT eFormat, const bool bTriggered, uint64_t& nId,
+                std::string& strError);
+
+    SnapshotStats GetStats(void);
+
+    /** "png"/"jpeg" (or "jpg") --> format.  False for other strings. */
+    static bool FormatFromString(const std::string& strFormat, E_FORMAT& eFormat);
+    static std::string FormatName(const E_FORMAT eFormat);
+
+  protected:
+
+    /** Request states */
+    enum E_STATE
+    {
+        eStateIdle,
+        eStateArmed,                // Waiting for a frame
+        eStateEncoding              // Frame in the slot
+    };
+
+    void EncoderThread(void);
+
+    /** Demosaic rows [nRowBegin, nRowEnd) of the slot's frame into m_vBand */
+    int DemosaicBand(const EosAdimecBayer::BayerImage& raw, const int nRowBegin,
+                     const int nRowEnd);
+
+    /** Encode the slot's frame to strPath.  False, and strError, on failure. */
+    bool WritePng(const std::string& strPath, std::string& strError);
+    bool WriteJpeg(const std::string& strPath, std::string& strError);
+
+    /** Unlink the oldest files past m_nKeep */
+    void Prune(const std::string& strPath);
+
+    DoneFn m_fnDone;
+    std::string m_strDir;
+    std::string m_strPrefix;
+    EosAdimecBayer::E_DEMOSAIC_METHOD m_eMethod;
+    int m_nJpegQuality;
+    int m_nPngLevel;
+    int m_nKeep;
+    int m_nTimeoutMs;
+
+    boost::thread* m_pEncoderThread;
+    std::atomic<bool> m_abStop;
+
+    /** The frame, raw and packed rows (nWidth words each) */
+    EosAdimecFramePool* m_pPool;
+    uint16_t* m_pFrame;
+    size_t m_nFrameBytes;
+
+    /** Encoder thread only */
+    std::vector<uint16_t> m_vBand;      // Demosaiced R, G, B planes of one band
+    std::vector<uint8_t> m_vRow;        // One interleaved output row
+    std::deque<std::string> m_dqFiles;  // Written, oldest first
+
+    /** Capture thread only */
+    uint64_t m_nPrevFrameNs;            // Done time of the previous frame
+    uint64_t m_nFrameIntervalNs;        // Measured, 0 until two frames
+
+    /** Guards everything below */
+    boost::mutex m_mtxSnapshot;
+    boost::condition_variable m_cvSnapshot;
+    std::atomic<int> m_aeState;         // E_STATE; read unlocked by OnFrame()
+    uint64_t m_nNextId;
+    SnapshotResult m_request;           // The one armed or encoding
+    uint64_t m_nArmNs;                  // CLOCK_MONOTONIC of the request
+    EosAdimecRawFrame m_frame;          // Slot's frame (pData = m_pFrame)
+    SnapshotStats m_stats;
+};
@@ -0,0 +1,108 @@
+/**
+   CPU affinity and scheduling policy per thread role.
+
+   On a host shared with video encoders the controller's threads get
+   migrated and preempted, and command latency follows.  Each thread says
+   which role it plays when it starts, and gets that role's CPUs, policy
+   and priority from the [slavecamera] thread_<role>_* keys:
+
+      dispatch    -- the command loop, the SCIP socket server and the
+                     reply flusher (control plane)
+      serial      -- camera serial traffic off the command loop: the
+                     async command worker, auto exposure and white balance
+      capture     -- the capture engine's thread
+      processing  -- tile executor workers (tile_cpus still pins each to
+                     one CPU of the set), the video writer and the stages'
+                     push threads
+
+   Policy "other" (SCHED_OTHER: priority is the nice value, -20 to 19) or
+   "fifo" (SCHED_FIFO, priority 1-99; needs CAP_SYS_NICE or an RLIMIT_RTPRIO
+   that allows it).  No CPUs means wherever the process may run.
+
+   Threads inherit their creator's settings, so the disk writers that must
+   stay out of the way (archive flusher, recorder saver, correction
+   references) go back to SCHED_OTHER on the process's CPUs with
+   ApplyBackground() before they nice themselves.
+
+   A setting the kernel refuses is logged and counted, and the thread
+   carries on with what it has: what each role really got is read back
+   for STATS[].
+ */
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include <boost/thread/mutex.hpp>
+
+class EosAdimecThreadPlacement
+{
+  public:
+
+    enum E_ROLE
+    {
+        eRoleDispatch,
+        eRoleSerial,
+        eRoleCapture,
+        eRoleProcessing,
+        NUM_ROLES
+    };
+
+    enum E_POLICY
+    {
+        ePolicyOther,               // SCHED_OTHER
+        ePolicyFifo                 // SCHED_FIFO
+    };
+
+    /** Where a role's threads run */
+    struct Placement
+    {
+        std::vector<int> vnCpus;    // Empty = the process's CPUs
+        E_POLICY ePolicy;
+        int nPriority;              // fifo: 1-99; other: nice, -20-19
+    };
+
+    /** What a role's threads got, read back from the last one to apply it */
+    struct Effective
+    {
+        int nThreads;               // Threads that applied the role
+        int nFailed;                // ... and did not get all of it
+        E_POLICY ePolicy;
+        int nPriority;
+        std::string strCpus;        // "0-3+6"
+        std::string strError;       // Last refusal
+    };
+
+    /** Set a role's placement; the first call also notes the process's CPUs */
+    static void Configure(const E_ROLE eRole, const Placement& placement);
+
+    /**
+       Give the calling thread eRole's placement (nothing before Configure()).
+       @return false if any of it was refused
+     */
+    static bool Apply(const E_ROLE eRole);
+
+    /** SCHED_OTHER on the process's CPUs, at nice nNice, for the calling thread */
+    static void ApplyBackground(const int nNice);
+
+    static Effective GetEffective(const E_ROLE eRole);
+
+    /** Priority range of a policy */
+    static bool IsValidPriority(const E_POLICY ePolicy, const int nPriority);
+
+    /** "dispatch", "serial", "capture", "processing" */
+    static std::string RoleName(const E_ROLE eRole);
+
+    /** "other" or "fifo" */
+    static std::string PolicyName(const E_POLICY ePolicy);
+    static bool PolicyFromString(const std::string& strPolicy, E_POLICY& ePolicy);
+
+  protected:
+
+    /** Guards everything below */
+    static boost::mutex s_mtxPlacement;
+    static bool s_bConfigured;
+    static std::vector<int> s_vnProcessCpus;
+    static Placement s_aPlacements[NUM_ROLES];
+    static Effective s_aEffective[NUM_ROLES];
+};
@@ -0,0 +1,190 @@
+/**
+   Tile executor for per-frame processing stages.
+
+   One capture thread cannot demosaic, correct, tone map and take
+   statistics of every 1600x1200 frame at the camera's top rate.  A stage
+   hands each frame to this executor as a job over rows [0, nHeight); the
+   job is cut into tiles of whole rows, about tile_kb each so a tile's
+   input and output stay in L2, every tile a multiple of nAlign rows
+   (2 keeps the Bayer phase).  A tile also names the rows a neighborhood
+   kernel may read around it (nHalo rows each side, clipped to the frame).
+
+   Each worker has its own deque of tiles.  A job's tiles are dealt out in
+   contiguous runs, one per worker, so neighbouring tiles share a core's
+   cache.  A worker takes from the back of its own deque and, once that is
+   empty, steals from the front of the others', so a core held up by
+   interrupts or a heavier part of the frame gets help.  The thread waiting
+   in Run() steals too.  Workers can be pinned to cores (tile_cpus).
+
+   Submit() returns at once, so jobs can overlap (the next frame's tiles
+   start while the last frame's stragglers finish); their DoneFns are
+   called in submission order, one at a time, from whichever thread
+   finished the job.  Run() is Submit() and wait, which keeps frame order
+   for the stages on the capture thread.  The stage owns the frame's
+   buffers until its DoneFn (or Run()) returns.
+
+   Tile.nSlot says which thread runs the tile (0..GetNumSlots()-1; Run()
+   callers share the last one), for per-thread scratch.  A stage must not
+   call Run() from two threads at once.
+ */
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include <atomic>
+#include <deque>
+#include <string>
+#include <vector>
+
+#include <boost/function.hpp>
+#include <boost/thread/thread.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/condition_variable.hpp>
+
+class EosAdimecTileExecutor
+{
+  public:
+
+    /** How a job is tiled */
+    struct JobSpec
+    {
+        int nHeight;            // Rows in the frame
+        size_t nRowBytes;       // Bytes a row's work touches (input and output)
+        int nAlign;             // Tiles start on a multiple of this many rows
+        int nHalo;              // Rows a kernel reads beyond its tile, each side
+    };
+
+    /** One tile of a job */
+    struct Tile
+    {
+        int nIndex;             // 0..GetTileCount()-1, top to bottom
+        int nRowBegin;          // Rows to produce: [nRowBegin, nRowEnd)
+        int nRowEnd;
+        int nHaloBegin;         // Rows that may be read: [nHaloBegin, nHaloEnd)
+        int nHaloEnd;
+        int nSlot;              // Thread running it, for scratch
+    };
+
+    typedef boost::function<void (const Tile& tile)> TileFn;
+    typedef boost::function<void (void)> DoneFn;
+
+    /** Executor counters */
+    struct ExecutorStats
+    {
+        int nWorkers;
+        int nPinned;                // Workers pinned to a core
+        unsigned long nJobs;
+        unsigned long nTiles;
+        unsigned long nStolen;      // Tiles run by a thread they were not dealt to
+        unsigned long nCallerTiles; // ... of which by Run() callers
+        double dJobMs;              // Smoothed submit-to-done time
+    };
+
+    /**
+       @param nWorkers -- pool threads besides the Run() callers (0 = one per core, less one)
+       @param vnCpus -- worker i is pinned to vnCpus[i % size] (empty = not pinned)
+       @param nTileBytes -- target tile size
+     */
+    EosAdimecTileExecutor(const int nWorkers, const std::vector<int>& vnCpus,
+                          const size_t nTileBytes);
+    virtual ~EosAdimecTileExecutor(void);
+
+    /** Start the workers.  Stop() only once no stage is using the executor. */
+    int Start(void);
+    void Stop(void);
+
+    /**
+       Queue a job.  With no workers it runs on the calling thread before
+       returning.
+       @param fnDone -- called once every tile has run and every earlier job is done (may be empty)
+     */
+    void Submit(const JobSpec& spec, TileFn fnTile, DoneFn fnDone);
+
+    /** Submit() and wait for this job (and so all earlier ones), running tiles meanwhile */
+    void Run(const JobSpec& spec, TileFn fnTile);
+
+    /** Tiles spec is cut into */
+    int GetTileCount(const JobSpec& spec) const;
+
+    /** Scratch slots a stage needs: workers, plus one for Run() callers */
+    int GetNumSlots(void) const {return m_nWorkers+1;};
+
+    ExecutorStats GetStats(void);
+
+    /** "2,3,6-7" --> {2,3,6,7}; "" --> {}.  False for anything else. */
+    static bool ParseCpus(const std::string& strCpus, std::vector<int>& vnCpus);
+
+  protected:
+
+    /** A job in flight */
+    struct Job
+    {
+        JobSpec spec;
+        TileFn fnTile;
+        DoneFn fnDone;
+        int nTiles;
+        int nRowsPerTile;
+        std::atomic<int> anLeft;    // Tiles not run yet
+        bool bDone;                 // All tiles run (m_mtxOrder)
+        bool bDelivered;            // DoneFn called, or Run() may return (m_mtxOrder)
+        bool bWaited;               // Run() deletes it, not the deliverer
+        uint64_t nSubmitNs;
+    };
+
+    /** A tile waiting in a deque */
+    struct TileRef
+    {
+        Job* pJob;
+        int nTile;
+        int nDealtTo;
+    };
+
+    /** One worker's tiles */
+    struct TileQueue
+    {
+        boost::mutex mtx;
+        std::deque<TileRef> dqTiles;
+    };
+
+    /** Rows per tile for spec */
+    int RowsPerTile(const JobSpec& spec) const;
+
+    Job* NewJob(const JobSpec& spec, TileFn fnTile, DoneFn fnDone, const bool bWaited);
+
+    /** Deal pJob's tiles to the workers' deques and wake them */
+    void Enqueue(Job* pJob);
+
+    /** Own deque's back, else another's front (nSlot == m_nWorkers: steal only) */
+    bool TakeTile(const int nSlot, TileRef& ref);
+
+    void RunTile(const TileRef& ref, const int nSlot);
+
+    /** pJob's last tile ran: deliver every finished job at the head, in order */
+    void FinishJob(Job* pJob);
+
+    void WorkerThread(const int nSlot);
+
+    int m_nWorkers;
+    std::vector<int> m_vnCpus;
+    size_t m_nTileBytes;
+
+    std::vector<boost::thread*> m_vpWorkers;
+    std::vector<TileQueue*> m_vpQueues;    // One per worker
+    std::atomic<bool> m_abStop;
+
+    /** Wakes idle workers */
+    boost::mutex m_mtxWork;
+    boost::condition_variable m_cvWork;
+    std::atomic<int> m_anQueued;            // Tiles in the deques
+
+    /** Jobs in submission order, and their delivery */
+    boost::mutex m_mtxOrder;
+    boost::condition_variable m_cvOrder;
+    std::deque<Job*> m_dqJobs;
+    bool m_bDelivering;
+
+    /** Guards the stats */
+    boost::mutex m_mtxStats;
+    ExecutorStats m_stats;
+};
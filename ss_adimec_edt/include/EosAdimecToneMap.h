@@ -0,0 +1,142 @@
+/**
+   Tone mapping of 10/12-bit frames to 8 bits for display.
+
+   SETOR[8] gets 8-bit frames from the camera, but then every consumer
+   (recorder, archive, frame ring) loses the low bits too.  This stage
+   leaves capture at full depth and maps only the video output: a LUT of
+   (1<<bit depth) entries, 0-255 each, applied to the demosaiced R, G and
+   B planes after the white-balance gains (EosAdimecYuv::ConvertRgb()).
+
+   Curves, on x = (v/full scale - black)*gain clipped to 0..1:
+      off        -- no LUT: the plain bit shift EosAdimecYuv always did
+      linear     -- 255*x
+      gamma      -- 255*x^(1/gamma)
+      log        -- 255*log(1+a*x)/log(1+a), a = log strength
+      equalize   -- histogram equalization of the raw frame (gain and
+                    black are not used), clipped at EQ_CLIP times the
+                    mean bin so noise in flat areas is not stretched,
+                    and smoothed over frames (EQ_RATE_PCT) so it does not
+                    flicker.
+
+   The LUT is rebuilt on the capture thread only when it has to be: a
+   parameter change, a new bit depth, and for equalize every frame from a
+   decimated histogram.  A SETGAIN/SETIT change (frame settings) starts
+   the equalize smoothing over, so the curve follows the new exposure at
+   once instead of fading to it.
+
+   ApplyRow() looks values up with AVX2 gathers (8 per instruction) or
+   scalar; both give the same output.
+ */
+#pragma once
+
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+
+#include <boost/thread/mutex.hpp>
+
+#include "EosAdimecFrameSource.h"
+#include "EosAdimecBayer.h"
+
+class EosAdimecToneMap
+{
+  public:
+
+    enum E_CURVE
+    {
+        eCurveOff,
+        eCurveLinear,
+        eCurveGamma,
+        eCurveLog,
+        eCurveEqualize
+    };
+
+    /** Curve parameters */
+    struct ToneParams
+    {
+        E_CURVE eCurve;
+        double dGamma;          // 1-5
+        double dLogStrength;    // 1-10000
+        double dGain;           // 0.1-64, before the curve
+        double dBlackPct;       // 0-50, of full scale, taken off before the gain
+    };
+
+    /** LUT builds */
+    struct ToneStats
+    {
+        int nBitDepth;              // Of the current LUT (0 = none)
+        unsigned long nBuilds;
+        double dBuildMs;            // Last build
+        unsigned long nResets;      // Equalize restarted for new settings
+    };
+
+    /** Largest bit depth mapped */
+    static const int MAX_BIT_DEPTH=12;
+
+    /** Equalize: clip bins at this many times the mean bin */
+    static const int EQ_CLIP=4;
+
+    /** Equalize: weight of the newest frame's curve, percent */
+    static const int EQ_RATE_PCT=25;
+
+    /** Equalize: histogram every this many rows (odd: both Bayer rows) */
+    static const int EQ_ROW_STEP=3;
+
+    EosAdimecToneMap(void);
+    virtual ~EosAdimecToneMap(void);
+
+    void SetParams(const ToneParams& params);
+    ToneParams GetParams(void);
+    ToneStats GetStats(void);
+
+    /**
+       Capture thread: the LUT for this frame, rebuilt if needed.
+       @return (1<<frame.nBitDepth) entries (plus one of padding for the
+               gathers), or NULL for curve off or an unsupported bit depth
+     */
+    const uint16_t* Update(const EosAdimecRawFrame& frame);
+
+    /**
+       pRow[i] = pLut[min(pRow[i], nMax)] in place.
+       @param nMax -- last LUT entry ((1<<bit depth)-1)
+     */
+    static void ApplyRow(uint16_t* pRow, const int nWidth, const uint16_t* pLut,
+                         const uint32_t nMax,
+                         const EosAdimecBayer::E_SIMD_LEVEL eLevel=EosAdimecBayer::eSimdAuto);
+
+    /**
+       Fill vLut ((1<<nBitDepth)+1 entries) for a non-equalize curve.
+       Exposed for EosAdimecBayerBench.
+     */
+    static void BuildCurve(const ToneParams& params, const int nBitDepth,
+                           std::vector<uint16_t>& vLut);
+
+    /** "off"/"linear"/"gamma"/"log"/"equalize" --> curve.  False for other strings. */
+    static bool CurveFromString(const std::string& strCurve, E_CURVE& eCurve);
+    static std::string CurveName(const E_CURVE eCurve);
+
+  protected:
+
+    /** Decimated histogram of frame --> m_vHist */
+    void Histogram(const EosAdimecRawFrame& frame);
+
+    /** m_vHist --> smoothed equalize curve --> m_vLut */
+    void BuildEqualize(const bool bReset);
+
+    /** Guards the params and stats */
+    boost::mutex m_mtxParams;
+    ToneParams m_params;
+    uint64_t m_nParamsVersion;
+    ToneStats m_stats;
+
+    /** Capture thread only */
+    std::vector<uint16_t> m_vLut;
+    std::vector<uint32_t> m_vHist;
+    std::vector<float> m_vEqualize;     // Smoothed equalize curve, 0-255
+    uint64_t m_nLutVersion;
+    int m_nLutBitDepth;
+    E_CURVE m_eLutCurve;
+    int32_t m_nSettingsGain;
+    int32_t m_nSettingsIt;
+};
@@ -0,0 +1,28 @@
+/**
+   Small helpers shared by the capture consumers.
+
+   MonotonicNs() is the timebase of frames (EosAdimecRawFrame::nTimeNs),
+   settings commits and every stage's timing.  WriteAll() and MakeDirs()
+   are for the stages that write files (recorder, archive, snapshot,
+   correction references).
+ */
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include <string>
+
+class EosAdimecUtil
+{
+  public:
+
+    /** CLOCK_MONOTONIC in ns */
+    static uint64_t MonotonicNs(void);
+
+    /** write() all of it, retrying on EINTR; false on error (errno set) */
+    static bool WriteAll(const int nFd, const void* pData, const size_t nBytes);
+
+    /** mkdir -p (mode 0750); a directory that can't be made shows up at the first open */
+    static void MakeDirs(const std::string& strDir);
+};
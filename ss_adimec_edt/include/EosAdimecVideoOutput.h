@@ -0,0 +1,145 @@
+/**
+   YUV frames for the linked_video streamer.
+
+   A capture consumer (EosAdimecCapture) that converts every raw frame
+   with the fused Bayer --> I420/NV12 kernel (EosAdimecYuv) and writes it
+   to a named pipe the streamer reads, e.g.
+
+      gst-launch-1.0 filesrc location=/tmp/eosadimec_ss002_video.yuv !
+          rawvideoparse format=i420 width=1600 height=1200 framerate=30/1 ! ...
+
+   (see scripts/gst-launch-adimec-yuv.sh).  This replaces edtpdvsrc !
+   videoconvert while in-process capture owns the EDT channel.
+
+   Three frame buffers (a frame pool, EosAdimecFramePool, taken at
+   Start()): the capture thread converts into one, a writer
+   thread writes another, and the newest finished frame waits in the
+   third.  A frame that is still waiting when the next one is finished is
+   replaced (counted as dropped), so a slow reader never stalls capture
+   and the reader always gets whole frames.  No conversion is done while
+   no reader has the pipe open.
+
+   The conversion is cut into tiles on the shared tile executor (the
+   capture thread helps), each thread with its own band buffer.
+
+   White-balance gains and the tone map (EosAdimecToneMap: 10/12-bit to
+   8-bit curve) can be changed at any time; they apply from the next
+   frame.  Capture itself stays at full depth.
+ */
+#pragma once
+
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+#include <atomic>
+
+#include <boost/thread/thread.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/condition_variable.hpp>
+
+#include "EosAdimecFrameSource.h"
+#include "EosAdimecFramePool.h"
+#include "EosAdimecYuv.h"
+#include "EosAdimecToneMap.h"
+#include "EosAdimecTileExecutor.h"
+
+class EosAdimecVideoOutput
+{
+  public:
+
+    /** Video output counters */
+    struct VideoOutputStats
+    {
+        bool bReaderConnected;
+        unsigned long nConverted;     // Frames converted
+        unsigned long nWritten;       // Frames written whole
+        unsigned long nDropped;       // Replaced before the writer got to them
+        unsigned long nErrors;        // Reader went away mid-frame, bad frame size
+        double dConvertMs;            // Smoothed conversion time
+    };
+
+    /**
+       @param strFifoPath -- named pipe to write (created if missing)
+       @param eFormat -- I420 or NV12
+       @param eMethod -- demosaic method
+       @param pExecutor -- splits frames into tiles (NULL = all on the capture thread)
+     */
+    EosAdimecVideoOutput(const std::string& strFifoPath,
+                         const EosAdimecYuv::E_YUV_FORMAT eFormat,
+                         const EosAdimecBayer::E_DEMOSAIC_METHOD eMethod,
+                         EosAdimecTileExecutor* pExecutor);
+
+    virtual ~EosAdimecVideoOutput(void);
+
+    /**
+       Create the FIFO, take the frame buffers and start the writer thread
+       @param nMaxPixels -- biggest frame to convert
+     */
+    int Start(const size_t nMaxPixels);
+    void Stop(void);
+
+    /** Capture consumer: convert the frame and hand it to the writer */
+    void OnFrame(const EosAdimecRawFrame& frame);
+
+    /** White-balance gains (1.0 = unity, 0-8) */
+    void SetWbGains(const EosAdimecYuv::WbGains& gains);
+    EosAdimecYuv::WbGains GetWbGains(void);
+
+    /** Tone-map curve (EosAdimecToneMap) */
+    void SetToneParams(const EosAdimecToneMap::ToneParams& params);
+    EosAdimecToneMap::ToneParams GetToneParams(void);
+    EosAdimecToneMap::ToneStats GetToneStats(void);
+
+    VideoOutputStats GetStats(void);
+
+    EosAdimecYuv::E_YUV_FORMAT GetFormat(void) const {return m_eFormat;};
+
+  protected:
+
+    /** Frame buffers */
+    static const int NUM_BUFFERS=3;
+
+    /** Executor TileFn: convert tile's rows, counting failures in m_anTileErrors */
+    void ConvertTile(const EosAdimecBayer::BayerImage* pRaw, EosAdimecYuv::YuvImage* pYuv,
+                     const EosAdimecYuv::WbGains gains, const uint16_t* pToneLut,
+                     const EosAdimecTileExecutor::Tile& tile);
+
+    /** Writer thread: wait for a finished frame, write it whole */
+    void WriterThread(void);
+
+    /** Open the FIFO for writing if a reader is there.  Returns the fd or -1. */
+    int OpenFifo(void);
+
+    /** Write one frame; false if the reader went away or we are stopping */
+    bool WriteFrame(const int nFd, const uint8_t* pFrame, const size_t nFrameBytes);
+
+    std::string m_strFifoPath;
+    EosAdimecYuv::E_YUV_FORMAT m_eFormat;
+    EosAdimecBayer::E_DEMOSAIC_METHOD m_eMethod;
+    EosAdimecTileExecutor* m_pExecutor;
+
+    boost::thread* m_pWriterThread;
+    std::atomic<bool> m_abStop;
+    std::atomic<bool> m_abReaderConnected;
+
+    /** Demosaic band buffers, one per executor slot (the capture thread's frame only) */
+    std::vector<std::vector<uint16_t> > m_vvScratch;
+    std::atomic<int> m_anTileErrors;
+
+    /** LUT for the frame being converted (locks its own params) */
+    EosAdimecToneMap m_toneMap;
+
+    /** Guards the buffer indexes, gains and stats */
+    boost::mutex m_mtxFrames;
+    boost::condition_variable m_cvFrames;
+    EosAdimecFramePool* m_pPool;
+    uint8_t* m_apFrames[NUM_BUFFERS];
+    size_t m_anFrameBytes[NUM_BUFFERS];
+    int m_nFillIndex;         // Capture thread converts into this one
+    int m_nPendingIndex;      // Newest finished frame, or -1
+    int m_nWritingIndex;      // Being written, or -1
+
+    EosAdimecYuv::WbGains m_gains;
+    VideoOutputStats m_stats;
+};
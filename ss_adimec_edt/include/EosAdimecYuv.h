@@ -0,0 +1,128 @@
+/**
+   Fused Bayer --> I420/NV12 conversion for the video streamer.
+
+   The gst path (edtpdvsrc ! videoconvert) decodes Bayer to a full RGB
+   frame and then walks that frame again to make YUV for the encoder.
+   ConvertBayer() instead demosaics a band of BAND_ROWS rows into a small
+   scratch buffer that stays in cache, applies the white-balance gains
+   there, and writes 8-bit Y and 2x2-subsampled chroma straight from it.
+   Each raw frame is read once and each YUV frame written once.
+
+   Color: BT.601 limited range (Y 16-235, U/V 16-240), which is what
+   videoconvert assumes for frames of this size.  Chroma is the average
+   of each 2x2 block.  Width and height must be even.
+
+   White balance: per-channel gains in Q12 (GAIN_ONE = 1.0), applied to
+   the demosaiced values before the color conversion and clipped at the
+   sensor full scale.
+
+   Tone map: with a LUT (EosAdimecToneMap), the gained R, G and B values
+   are mapped to 0-255 through it before the color conversion, in place
+   of the plain shift down to 8 bits.
+
+   The gain, luma and chroma loops have SSE4.1 versions, picked with the
+   demosaic's SIMD level; all levels give identical output.
+
+   ConvertRgb() is the second half of the fused kernel on its own (full
+   RGB frame in, YUV out); it is the two-pass reference used by
+   EosAdimecBayerBench.  Both paths give identical output.
+ */
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include <string>
+#include <vector>
+
+#include "EosAdimecBayer.h"
+
+class EosAdimecYuv
+{
+  public:
+
+    enum E_YUV_FORMAT
+    {
+        eYuvI420,       // Y plane, U plane, V plane
+        eYuvNV12        // Y plane, interleaved UV plane
+    };
+
+    /** White-balance gains, Q12 */
+    struct WbGains
+    {
+        uint32_t nR;
+        uint32_t nG;
+        uint32_t nB;
+    };
+
+    /** 8-bit YUV output planes.  NV12 uses pU for the UV plane; pV is unused. */
+    struct YuvImage
+    {
+        uint8_t* pY;
+        uint8_t* pU;
+        uint8_t* pV;
+        int nStrideY;       // Bytes per Y row
+        int nStrideUV;      // Bytes per U/V (or UV) row
+    };
+
+    /** 1.0 in Q12 */
+    static const uint32_t GAIN_ONE=4096;
+
+    /** Largest gain accepted (8.0) */
+    static const uint32_t GAIN_MAX=8*GAIN_ONE;
+
+    /** Rows demosaiced per band (even) */
+    static const int BAND_ROWS=8;
+
+    /**
+       Raw Bayer --> YUV, one pass.
+       @param vScratch -- band buffer; resized on first use, keep it between frames
+       @param pToneLut -- (1<<bit depth)+1 entries of 0-255 (EosAdimecToneMap), or NULL
+       @return 0 on success, -1 on bad arguments (odd size, gains out of range)
+     */
+    static int ConvertBayer(const EosAdimecBayer::BayerImage& raw, YuvImage& yuv,
+                            const E_YUV_FORMAT eFormat, const WbGains& gains,
+                            const EosAdimecBayer::E_DEMOSAIC_METHOD eMethod,
+                            std::vector<uint16_t>& vScratch,
+                            const EosAdimecBayer::E_SIMD_LEVEL eLevel=EosAdimecBayer::eSimdAuto,
+                            const uint16_t* pToneLut=NULL);
+
+    /**
+       ConvertBayer() of rows [nRowBegin, nRowEnd) only (both even), for
+       tiles converted on several threads; each thread needs its own vScratch.
+     */
+    static int ConvertBayerRows(const EosAdimecBayer::BayerImage& raw, YuvImage& yuv,
+                                const E_YUV_FORMAT eFormat, const WbGains& gains,
+                                const EosAdimecBayer::E_DEMOSAIC_METHOD eMethod,
+                                const int nRowBegin, const int nRowEnd,
+                                std::vector<uint16_t>& vScratch,
+                                const EosAdimecBayer::E_SIMD_LEVEL eLevel=EosAdimecBayer::eSimdAuto,
+                                const uint16_t* pToneLut=NULL);
+
+    /**
+       Demosaiced RGB rows [nRowBegin, nRowEnd) --> YUV.  The rows are
+       read from rgb (rgb.nFirstRow applies); nRowBegin/nRowEnd must be even.
+       The gains (and pToneLut) are applied to the rgb rows in place.
+     */
+    static int ConvertRgb(EosAdimecBayer::RgbPlanes& rgb, const int nWidth, const int nBitDepth,
+                          const int nRowBegin, const int nRowEnd, YuvImage& yuv,
+                          const E_YUV_FORMAT eFormat, const WbGains& gains,
+                          const EosAdimecBayer::E_SIMD_LEVEL eLevel=EosAdimecBayer::eSimdAuto,
+                          const uint16_t* pToneLut=NULL);
+
+    /** Bytes in one frame (w*h*3/2) */
+    static size_t GetFrameBytes(const int nWidth, const int nHeight);
+
+    /** Point the planes of yuv into one contiguous frame buffer */
+    static void SetPlanes(uint8_t* pFrame, const int nWidth, const int nHeight,
+                          const E_YUV_FORMAT eFormat, YuvImage& yuv);
+
+    /** Gain (e.g. 1.25) --> Q12; false if outside 0..8 */
+    static bool GainFromDouble(const double dGain, uint32_t& nGain);
+
+    /** "i420"/"nv12" --> format.  Returns false for other strings. */
+    static bool FormatFromString(const std::string& strFormat, E_YUV_FORMAT& eFormat);
+
+    /** "i420", "nv12" */
+    static std::string FormatName(const E_YUV_FORMAT eFormat);
+};
@@ -0,0 +1,22 @@
+#!/bin/bash
+## Example gst-launch script for the in-process capture's YUV output
+## (capture_enable = 1, video_output_enable = 1 in adimec_edt.cfg).
+## EosAdimecEdtMain.x owns the EDT channel then, so edtpdvsrc can't be used;
+## the frames are already I420/NV12 and need no videoconvert.
+##
+## Usage: gst-launch-adimec-yuv.sh [fifo [format [width height [fps]]]]
+
+FIFO=${1:-/tmp/eosadimec_ss002_video.yuv}
+FORMAT=${2:-i420}
+WIDTH=${3:-1600}
+HEIGHT=${4:-1200}
+FPS=${5:-30}
+
+if [ ! -p "$FIFO" ]; then
+    echo "$FIFO is not there yet; is EosAdimecEdtMain.x running with video_output_enable = 1?"
+    exit 1
+fi
+
+gst-launch-1.0 filesrc location="$FIFO" ! \
+    rawvideoparse format="$FORMAT" width="$WIDTH" height="$HEIGHT" framerate="$FPS"/1 ! \
+    queue ! autovideosink
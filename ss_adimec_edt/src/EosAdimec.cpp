@@ -6,7 +6,10 @@
  * gain, digital offset, and rgb white balance values in the camera. 
  */
 
+#include <sys/stat.h>
+
 #include "EosAdimec.h"
+#include "EosAdimecUtil.h"
 
 using namespace std::placeholders;
 
@@ -17,6 +20,7 @@ EosAdimec::EosAdimec(const std::string& strConfigFile)
     m_strConfigFile=strConfigFile;
 
     // Set these to avoid destructor ugliness
+    InitControllerMembers();
     m_pAdimec=NULL;
     m_pEosBaseConfigInfo=NULL;
     m_bSaveSettingsOnExit=false;
@@ -35,6 +39,10 @@ EosAdimec::EosAdimec(const std::string& strConfigFile)
     // RWM need this to access the proper device profile.
     m_strEosDeviceModel = m_EosSensorConfigInfo.strDeviceModel;
 
+    // Validate the Adimec-only keys too (throws on bad values).
+    EosAdimecConfiguration adimecConfiguration(strConfigFile);
+    m_EosAdimecConfigInfo = adimecConfiguration.ExtractConfigInfo();
+
     bool bProfile=ExtractDeviceProfileBase();
     if(!bProfile)
     {
@@ -60,6 +68,8 @@ EosAdimec::EosAdimec(const std::string& strConfigFile,
 {
 
     m_abShutdownFlag=false;
+
+    InitControllerMembers();
     
     EosSlaveCameraConfiguration*  pSensorConfig =
         new EosSlaveCameraConfiguration(strConfigFile);
@@ -68,6 +78,11 @@ EosAdimec::EosAdimec(const std::string& strConfigFile,
 
     delete pSensorConfig;
 
+    EosAdimecConfiguration adimecConfiguration(strConfigFile);
+    m_EosAdimecConfigInfo = adimecConfiguration.ExtractConfigInfo();
+
+    m_strScipPipeToMain=strNamedPipeToMain;
+
     m_strEosDeviceType=std::string("SS");
 
     m_strEosDeviceModel=m_EosSensorConfigInfo.strDeviceModel;
@@ -79,6 +94,8 @@ EosAdimec::EosAdimec(const std::string& strConfigFile,
 
     m_pAdimec=new EosAdimec::AdimecValues();
 
+    m_nEdtChannel=m_EosSensorConfigInfo.nEdtChannel;
+
     // RWM new 2022/03/15
     m_pSerialComms = new CamLinkCommsEdt(m_EosSensorConfigInfo.nEdtChannel);
     m_pSerialComms->InitConnection();
@@ -120,6 +137,8 @@ EosAdimec::EosAdimec(const std::string& strConfigFile,
 // Not for operational use
 EosAdimec::EosAdimec() : EosDevice()
 {
+    InitControllerMembers();
+
     m_strEosDeviceType=std::string("SS");
 
     //m_circBufAdimecFirst.set_capacity(FIRST_QUEUE_SIZE);
@@ -150,6 +169,8 @@ EosAdimec::EosAdimec(const int nDeviceId,
                 bUseExistingNamedPipes,bCommandLineMode,eCommType)
 {
     std::cerr<<"Constructing EosAdimec "<<std::endl;
+
+    InitControllerMembers();
     
     //m_circBufAdimecFirst.set_capacity(FIRST_QUEUE_SIZE);
     //m_circBufAdimecSecond.set_capacity(SECOND_QUEUE_SIZE);
@@ -172,6 +193,13 @@ EosAdimec::EosAdimec(const int nDeviceId,
 
 EosAdimec::~EosAdimec(void)
 {
+    // Stop taking socket/async commands before the serial port goes away,
+    // then capture (its consumers still push), then the output queue.
+    StopAsyncWorker();
+    StopScipSocketServer();
+    StopCapture();
+    StopOutputQueue();
+
     /*Need to store the camera settings if SCIP gets power cycled*/
     /* Only if the save settings on exit flag is true */
     if(m_bSaveSettingsOnExit)
@@ -190,6 +218,162 @@ EosAdimec::~EosAdimec(void)
     return;
 }
 
+// Every constructor calls this first so that the destructor
+// never sees uninitialized transport/thread pointers.
+void EosAdimec::InitControllerMembers(void)
+{
+    m_pSerialComms=NULL;
+
+    m_EosAdimecConfigInfo.nDeviceId=0;
+    m_EosAdimecConfigInfo.strScipTransport=EosAdimecConfiguration::TRANSPORT_NAMEDPIPE;
+    m_EosAdimecConfigInfo.strScipSocketPath.clear();
+    m_EosAdimecConfigInfo.nScipSocketMaxClients=0;
+    m_EosAdimecConfigInfo.nScipOutputQueueDepth=0;
+    m_EosAdimecConfigInfo.nScipOutputLingerUs=0;
+    m_EosAdimecConfigInfo.nScipAsyncQueueDepth=1;
+    m_EosAdimecConfigInfo.mapQueryStaleMs.clear();
+    m_EosAdimecConfigInfo.strScipOutputOverflow="drop_oldest";
+    m_EosAdimecConfigInfo.bCaptureEnable=false;
+    m_EosAdimecConfigInfo.strCaptureSource=EosAdimecConfiguration::CAPTURE_SOURCE_EDT;
+    m_EosAdimecConfigInfo.nCaptureRingBuffers=0;
+    m_EosAdimecConfigInfo.nCaptureTimeoutMs=0;
+    m_EosAdimecConfigInfo.bVideoOutputEnable=false;
+    m_EosAdimecConfigInfo.strVideoToneMap="off";
+    m_EosAdimecConfigInfo.dVideoToneGamma=2.2;
+    m_EosAdimecConfigInfo.dVideoToneLog=100.0;
+    m_EosAdimecConfigInfo.dVideoToneGain=1.0;
+    m_EosAdimecConfigInfo.dVideoToneBlackPct=0.0;
+    m_EosAdimecConfigInfo.nTileThreads=0;
+    m_EosAdimecConfigInfo.vnTileCpus.clear();
+    m_EosAdimecConfigInfo.nTileKb=256;
+    m_EosAdimecConfigInfo.bFramePoolHugePages=false;
+    m_EosAdimecConfigInfo.bFramePoolMlock=false;
+    for(auto & ixPlacement: m_EosAdimecConfigInfo.aThreadPlacements)
+    {
+        ixPlacement.vnCpus.clear();
+        ixPlacement.ePolicy=EosAdimecThreadPlacement::ePolicyOther;
+        ixPlacement.nPriority=0;
+    }
+    m_EosAdimecConfigInfo.bPipelineDeclared=false;
+    m_EosAdimecConfigInfo.mapPipeline.clear();
+    m_EosAdimecConfigInfo.mapPipeline["correction"]="";
+    m_EosAdimecConfigInfo.mapPipeline["ae"]="";
+    m_EosAdimecConfigInfo.mapPipeline["awb"]="";
+    m_EosAdimecConfigInfo.mapPipeline["archive"]="";
+    m_EosAdimecConfigInfo.bFrameRingEnable=false;
+    m_EosAdimecConfigInfo.bFrameRingPacked=false;
+    m_EosAdimecConfigInfo.nFrameSettingsTimeUnitUs=20;
+    m_EosAdimecConfigInfo.nFrameSettingsMarginUs=500;
+    m_EosAdimecConfigInfo.bAeEnable=false;
+    m_EosAdimecConfigInfo.nAeTargetPct=40;
+    m_EosAdimecConfigInfo.anAeRoi[0]=0;
+    m_EosAdimecConfigInfo.anAeRoi[1]=0;
+    m_EosAdimecConfigInfo.anAeRoi[2]=0;
+    m_EosAdimecConfigInfo.anAeRoi[3]=0;
+    m_EosAdimecConfigInfo.nAeRateHz=5;
+    m_EosAdimecConfigInfo.strAwbMode="off";
+    m_EosAdimecConfigInfo.strAwbMethod="gray_world";
+    m_EosAdimecConfigInfo.nAwbHysteresisPct=5;
+    m_EosAdimecConfigInfo.nAwbRateHz=2;
+    m_EosAdimecConfigInfo.nAwbBlackLevel=0;
+    m_EosAdimecConfigInfo.bFrameStatsEnable=false;
+    m_EosAdimecConfigInfo.nFrameStatsDecimation=10;
+    m_EosAdimecConfigInfo.nFrameStatsPushMs=0;
+    m_EosAdimecConfigInfo.bFocusEnable=false;
+    m_EosAdimecConfigInfo.strFocusMethod="tenengrad";
+    m_EosAdimecConfigInfo.anFocusRoi[0]=0;
+    m_EosAdimecConfigInfo.anFocusRoi[1]=0;
+    m_EosAdimecConfigInfo.anFocusRoi[2]=0;
+    m_EosAdimecConfigInfo.anFocusRoi[3]=0;
+    m_EosAdimecConfigInfo.bFocusPush=false;
+    m_EosAdimecConfigInfo.nFocusHistory=256;
+    m_EosAdimecConfigInfo.bRecorderEnable=false;
+    m_EosAdimecConfigInfo.nRecorderSeconds=10;
+    m_EosAdimecConfigInfo.nRecorderMaxMb=0;
+    m_EosAdimecConfigInfo.nRecorderMaxPostS=60;
+    m_EosAdimecConfigInfo.bRecorderPacked=false;
+    m_EosAdimecConfigInfo.bSnapshotEnable=false;
+    m_EosAdimecConfigInfo.strSnapshotDemosaic="edge";
+    m_EosAdimecConfigInfo.nSnapshotJpegQuality=90;
+    m_EosAdimecConfigInfo.nSnapshotPngLevel=1;
+    m_EosAdimecConfigInfo.nSnapshotKeep=8;
+    m_EosAdimecConfigInfo.nSnapshotTimeoutMs=2000;
+    m_EosAdimecConfigInfo.strSnapshotStreamMode="@MO4";
+    m_EosAdimecConfigInfo.bPreviewEnable=false;
+    m_EosAdimecConfigInfo.vnPreviewScales.clear();
+    m_EosAdimecConfigInfo.vnPreviewScales.push_back(2);
+    m_EosAdimecConfigInfo.vnPreviewScales.push_back(4);
+    m_EosAdimecConfigInfo.vnPreviewScales.push_back(8);
+    m_EosAdimecConfigInfo.nPreviewDecimation=6;
+    m_EosAdimecConfigInfo.strPreviewFormat="i420";
+    m_EosAdimecConfigInfo.bArchiveEnable=false;
+    m_EosAdimecConfigInfo.nArchiveSegmentMb=256;
+    m_EosAdimecConfigInfo.nArchiveMaxGb=0;
+    m_EosAdimecConfigInfo.nArchiveStagingFrames=16;
+    m_EosAdimecConfigInfo.bArchivePacked=false;
+    m_EosAdimecConfigInfo.bCorrectionEnable=false;
+    m_EosAdimecConfigInfo.nCorrectionGainStep=100;
+    m_EosAdimecConfigInfo.nCorrectionMaxFrames=64;
+    m_EosAdimecConfigInfo.nMaxMemMb=0;
+
+    m_eReplyRoute=eReplyRouteDefault;
+    m_nReplyClientFd=-1;
+    m_strReplyTag.clear();
+
+    m_pCapture=NULL;
+    m_nEdtChannel=0;
+    m_pVideoOutput=NULL;
+    m_pFrameRing=NULL;
+
+    m_frameSettings.nIntegrationTime=-1;
+    m_frameSettings.nGain=-1;
+    m_frameSettings.nFramePeriod=-1;
+    m_frameSettings.nImgFmtOffset=-1;
+    m_frameSettings.nImgFmtLines=-1;
+    m_frameSettings.nImgFmtBinning=-1;
+    m_frameSettings.nOutputBits=-1;
+    m_frameSettings.nWbRed=-1;
+    m_frameSettings.nWbGreen=-1;
+    m_frameSettings.nWbBlue=-1;
+    m_frameSettings.nVersion=0;
+    m_pSettingsTracker=NULL;
+    m_pAutoExposure=NULL;
+    m_pAutoWhiteBalance=NULL;
+    m_pFrameStats=NULL;
+    m_pFocus=NULL;
+    m_pRecorder=NULL;
+    m_pSnapshot=NULL;
+    m_eSnapshotRoute=eReplyRouteDefault;
+    m_nSnapshotClientFd=-1;
+    m_pPreview=NULL;
+    m_pArchive=NULL;
+    m_pCorrection=NULL;
+    m_pTileExecutor=NULL;
+    m_pPipeline=NULL;
+    m_nPipelineConsumerId=0;
+    m_nSerialWriteNs=0;
+    m_nSerialReadNs=0;
+
+    m_pAsyncThread=NULL;
+    m_abAsyncThreadStop=false;
+    m_bAsyncBusy=false;
+
+    m_nCommandArrivalMs=GetMonotonicMs();
+    m_nPipeCycleStartMs=m_nCommandArrivalMs;
+    m_nPipeLastDoneMs=0;
+    m_bCaptureQuery=false;
+    m_nStaleFromCache=0;
+    m_nStaleTimeouts=0;
+
+    m_pSeqPacketServer=NULL;
+    m_pSocketThread=NULL;
+    m_abSocketThreadStop=false;
+
+    m_pOutputQueue=NULL;
+
+    return;
+}
+
 // For the power-controller device, a "do nothing" stub.
 void EosAdimec::InitializeDevice(void)
 {
@@ -202,6 +386,15 @@ void EosAdimec::InitializeDevice(void)
     // So initialization that depends on device profile info must be put here,
     // not in the constructor.
 
+    // This is the command loop's thread; every thread started from here
+    // on takes its own role's placement.
+    for(int irole=0; irole<EosAdimecThreadPlacement::NUM_ROLES; irole++)
+    {
+        EosAdimecThreadPlacement::Configure((EosAdimecThreadPlacement::E_ROLE)irole,
+                                            m_EosAdimecConfigInfo.aThreadPlacements[irole]);
+    }
+    EosAdimecThreadPlacement::Apply(EosAdimecThreadPlacement::eRoleDispatch);
+
     // Give the device a little time after connecting before we proceed.
     ::usleep(100000);
 
@@ -228,6 +421,22 @@ void EosAdimec::InitializeDevice(void)
         // so catch(...) here (and carry on) out of an abundance of caution.
     }
 
+    // Output queue first: socket clients get their channels from it.
+    StartOutputQueue();
+    StartAsyncWorker();
+
+    if(m_EosAdimecConfigInfo.bCaptureEnable)
+    {
+        StartCapture();
+    }
+
+    // The named pipes are always up (EosDevice owns them); the socket
+    // transport is opened in addition when the config file asks for it.
+    if(m_EosAdimecConfigInfo.strScipTransport==EosAdimecConfiguration::TRANSPORT_UNIX_SEQPACKET)
+    {
+        StartScipSocketServer();
+    }
+
     return;
 };
 
@@ -237,121 +446,211 @@ void EosAdimec::InitCommandTemplate(void)
 {
     //Query valid commands
     m_mapCommandTemplate[EosCmd::INFO] =
-        &EosAdimec::_FptrListCommandInfo;
+        CommandEntry(&EosAdimec::_FptrListCommandInfo,eCommandLocal);
 
     m_mapCommandTemplate[EosCmd::PROBE] =
-        &EosAdimec::_FptrProbe;
+        CommandEntry(&EosAdimec::_FptrProbe,eCommandLocal);
 
     m_mapCommandTemplate[EosCmd::DISABLE_PROBE] =
-        &EosAdimec::_FptrDisableProbe;
+        CommandEntry(&EosAdimec::_FptrDisableProbe,eCommandLocal);
 
     m_mapCommandTemplate[EosCmd::PROBE_DISABLE] =
-        &EosAdimec::_FptrDisableProbe;
+        CommandEntry(&EosAdimec::_FptrDisableProbe,eCommandLocal);
 
     m_mapCommandTemplate[EosCmd::RECONNECT] =
-        &EosAdimec::_FptrReconnect;
+        CommandEntry(&EosAdimec::_FptrReconnect,eCommandSet);
 
     m_mapCommandTemplate[EosCmd::LOADFACTORYSETTINGS] =
-        &EosAdimec::_FptrLoadFactoryDefaults;
+        CommandEntry(&EosAdimec::_FptrLoadFactoryDefaults,eCommandSet);
 
     m_mapCommandTemplate["LFS"] =
-        &EosAdimec::_FptrLoadFactoryDefaults;
+        CommandEntry(&EosAdimec::_FptrLoadFactoryDefaults,eCommandSet);
     m_mapCommandTemplate["LFD"] =
-        &EosAdimec::_FptrLoadFactoryDefaults;
+        CommandEntry(&EosAdimec::_FptrLoadFactoryDefaults,eCommandSet);
 
     m_mapCommandTemplate[EosCmd::RESTOREFACTORYSETTINGS] =
-        &EosAdimec::_FptrRestoreFactoryDefaults;
+        CommandEntry(&EosAdimec::_FptrRestoreFactoryDefaults,eCommandSet);
 
     m_mapCommandTemplate[EosCmd::SAVESETTINGSONEXIT] =
-        &EosAdimec::_FptrSaveSettingsOnExitMode;
+        CommandEntry(&EosAdimec::_FptrSaveSettingsOnExitMode,eCommandLocal);
 
     m_mapCommandTemplate["SSOE"] =
-        &EosAdimec::_FptrSaveSettingsOnExitMode;
+        CommandEntry(&EosAdimec::_FptrSaveSettingsOnExitMode,eCommandLocal);
     
     // Set Adimec Digital FineGain Level
     m_mapCommandTemplate[EosCmd::SETGAIN] =
-        &EosAdimec::_FptrSetGainLevel;
+        CommandEntry(&EosAdimec::_FptrSetGainLevel,eCommandSet);
 
     // Set Adimec Output Offset
     m_mapCommandTemplate[EosCmd::SETOFFSET] =
-        &EosAdimec::_FptrSetOffsetLevel;
+        CommandEntry(&EosAdimec::_FptrSetOffsetLevel,eCommandSet);
   
     // Set Adimec White Balance Gain
     m_mapCommandTemplate[EosCmd::SETRGB] =
-        &EosAdimec::_FptrSetRGBLevel;
+        CommandEntry(&EosAdimec::_FptrSetRGBLevel,eCommandSet);
     
     // Query Adimec Digital Fine Gain level
     m_mapCommandTemplate[EosCmd::GETGAIN] =
-        &EosAdimec::_FptrGetLevel;
+        CommandEntry(&EosAdimec::_FptrGetLevel,eCommandQuery);
     
     //Query Adimec Output Offset
     m_mapCommandTemplate[EosCmd::GETOFFSET]=
-        &EosAdimec::_FptrGetLevel;
+        CommandEntry(&EosAdimec::_FptrGetLevel,eCommandQuery);
     
     //Query Adimec White Balance
     m_mapCommandTemplate[EosCmd::GETRGB] =
-        &EosAdimec::_FptrGetLevel;
+        CommandEntry(&EosAdimec::_FptrGetLevel,eCommandQuery);
     
     //Save Current Camera Settings
     m_mapCommandTemplate[EosCmd::SAVESETTINGS]=
-        &EosAdimec::_FptrSaveSettings;
+        CommandEntry(&EosAdimec::_FptrSaveSettings,eCommandLocal);
     
     //Save Current Camera Output Resolution
     m_mapCommandTemplate[EosCmd::SETOPR]=
-        &EosAdimec::_FptrSetOutputResolution;
+        CommandEntry(&EosAdimec::_FptrSetOutputResolution,eCommandSet);
     
     m_mapCommandTemplate[EosCmd::GETOPR]=
-        &EosAdimec::_FptrGetOutputResolution;
+        CommandEntry(&EosAdimec::_FptrGetOutputResolution,eCommandQuery);
 
     // Set/get camera frame period (1-4000)
     m_mapCommandTemplate[EosCmd::SET_FRAMEPERIOD]=
-        &EosAdimec::_FptrSetFramePeriod;
+        CommandEntry(&EosAdimec::_FptrSetFramePeriod,eCommandSet);
     
     m_mapCommandTemplate[EosCmd::GET_FRAMEPERIOD]=
-        &EosAdimec::_FptrGetFramePeriod;
+        CommandEntry(&EosAdimec::_FptrGetFramePeriod,eCommandQuery);
 
     // Set/get camera integration time (1-4000)
     m_mapCommandTemplate[EosCmd::SET_INTTIME]=
-        &EosAdimec::_FptrSetIntegrationTime;
+        CommandEntry(&EosAdimec::_FptrSetIntegrationTime,eCommandSet);
     
     m_mapCommandTemplate[EosCmd::GET_INTTIME]=
-        &EosAdimec::_FptrGetIntegrationTime;
+        CommandEntry(&EosAdimec::_FptrGetIntegrationTime,eCommandQuery);
 
     m_mapCommandTemplate["GETTEMP"]=
-        &EosAdimec::_FptrGetTemperature;
+        CommandEntry(&EosAdimec::_FptrGetTemperature,eCommandQuery);
     m_mapCommandTemplate["GET_TEMP"]=
-        &EosAdimec::_FptrGetTemperature;
+        CommandEntry(&EosAdimec::_FptrGetTemperature,eCommandQuery);
 
     m_mapCommandTemplate["SET_PIXC"]=
-        &EosAdimec::_FptrSetPixelCorrect;
+        CommandEntry(&EosAdimec::_FptrSetPixelCorrect,eCommandSet);
     m_mapCommandTemplate["SET_PIXCORRECT"]=
-        &EosAdimec::_FptrSetPixelCorrect;
+        CommandEntry(&EosAdimec::_FptrSetPixelCorrect,eCommandSet);
 
     m_mapCommandTemplate["GET_PIXC"]=
-        &EosAdimec::_FptrGetPixelCorrect;
+        CommandEntry(&EosAdimec::_FptrGetPixelCorrect,eCommandQuery);
     m_mapCommandTemplate["GET_PIXCORRECT"]=
-        &EosAdimec::_FptrGetPixelCorrect;
+        CommandEntry(&EosAdimec::_FptrGetPixelCorrect,eCommandQuery);
 
     m_mapCommandTemplate["SETAGCORRECT"]=
-        &EosAdimec::_FptrSetAgCorrect;
+        CommandEntry(&EosAdimec::_FptrSetAgCorrect,eCommandSet);
     m_mapCommandTemplate["SET_AGC"]=
-        &EosAdimec::_FptrSetAgCorrect;
+        CommandEntry(&EosAdimec::_FptrSetAgCorrect,eCommandSet);
     m_mapCommandTemplate["SET_AGCORRECT"]=
-        &EosAdimec::_FptrSetAgCorrect;
+        CommandEntry(&EosAdimec::_FptrSetAgCorrect,eCommandSet);
 
     m_mapCommandTemplate["GETAGCORRECT"]=
-        &EosAdimec::_FptrGetAgCorrect;
+        CommandEntry(&EosAdimec::_FptrGetAgCorrect,eCommandQuery);
     m_mapCommandTemplate["GET_AGC"]=
-        &EosAdimec::_FptrGetAgCorrect;
+        CommandEntry(&EosAdimec::_FptrGetAgCorrect,eCommandQuery);
     m_mapCommandTemplate["GET_AGCORRECT"]=
-        &EosAdimec::_FptrGetAgCorrect;
+        CommandEntry(&EosAdimec::_FptrGetAgCorrect,eCommandQuery);
 
     m_mapCommandTemplate["GET_IMGFMT"]=
-        &EosAdimec::_FptrGetImageFormat;
+        CommandEntry(&EosAdimec::_FptrGetImageFormat,eCommandQuery);
 
     m_mapCommandTemplate["SET_IMGFMT"]=
-        &EosAdimec::_FptrSetImageFormat;
-    
+        CommandEntry(&EosAdimec::_FptrSetImageFormat,eCommandSet);
+
+    m_mapCommandTemplate["STATS"]=
+        CommandEntry(&EosAdimec::_FptrGetStats,eCommandLocal);
+
+    m_mapCommandTemplate["FIRST_FRAME"]=
+        CommandEntry(&EosAdimec::_FptrGetFirstFrame,eCommandLocal);
+
+    m_mapCommandTemplate["SET_AE"]=
+        CommandEntry(&EosAdimec::_FptrSetAutoExposure,eCommandLocal);
+    m_mapCommandTemplate["SET_AE_TARGET"]=
+        CommandEntry(&EosAdimec::_FptrSetAutoExposure,eCommandLocal);
+    m_mapCommandTemplate["SET_AE_ROI"]=
+        CommandEntry(&EosAdimec::_FptrSetAutoExposure,eCommandLocal);
+    m_mapCommandTemplate["SET_AE_RATE"]=
+        CommandEntry(&EosAdimec::_FptrSetAutoExposure,eCommandLocal);
+    m_mapCommandTemplate["GET_AE"]=
+        CommandEntry(&EosAdimec::_FptrGetAutoExposure,eCommandLocal);
+
+    m_mapCommandTemplate["AWB_ONCE"]=
+        CommandEntry(&EosAdimec::_FptrAutoWhiteBalanceOnce,eCommandLocal);
+    m_mapCommandTemplate["SET_AWB"]=
+        CommandEntry(&EosAdimec::_FptrSetAutoWhiteBalance,eCommandLocal);
+    m_mapCommandTemplate["SET_AWB_METHOD"]=
+        CommandEntry(&EosAdimec::_FptrSetAutoWhiteBalance,eCommandLocal);
+    m_mapCommandTemplate["SET_AWB_HYST"]=
+        CommandEntry(&EosAdimec::_FptrSetAutoWhiteBalance,eCommandLocal);
+    m_mapCommandTemplate["SET_AWB_RATE"]=
+        CommandEntry(&EosAdimec::_FptrSetAutoWhiteBalance,eCommandLocal);
+    m_mapCommandTemplate["GET_AWB"]=
+        CommandEntry(&EosAdimec::_FptrGetAutoWhiteBalance,eCommandLocal);
+
+    m_mapCommandTemplate["FRAME_STATS"]=
+        CommandEntry(&EosAdimec::_FptrGetFrameStats,eCommandLocal);
+    m_mapCommandTemplate["SET_FRAME_STATS_DECIMATION"]=
+        CommandEntry(&EosAdimec::_FptrSetFrameStats,eCommandLocal);
+    m_mapCommandTemplate["SET_FRAME_STATS_PUSH"]=
+        CommandEntry(&EosAdimec::_FptrSetFrameStats,eCommandLocal);
+
+    m_mapCommandTemplate["FOCUS"]=
+        CommandEntry(&EosAdimec::_FptrGetFocus,eCommandLocal);
+    m_mapCommandTemplate["SET_FOCUS_METHOD"]=
+        CommandEntry(&EosAdimec::_FptrSetFocus,eCommandLocal);
+    m_mapCommandTemplate["SET_FOCUS_ROI"]=
+        CommandEntry(&EosAdimec::_FptrSetFocus,eCommandLocal);
+    m_mapCommandTemplate["SET_FOCUS_PUSH"]=
+        CommandEntry(&EosAdimec::_FptrSetFocus,eCommandLocal);
+
+    m_mapCommandTemplate["TRIGGER_SAVE"]=
+        CommandEntry(&EosAdimec::_FptrTriggerSave,eCommandLocal);
+    m_mapCommandTemplate["GET_RECORDER"]=
+        CommandEntry(&EosAdimec::_FptrGetRecorder,eCommandLocal);
+
+    m_mapCommandTemplate["SNAPSHOT"]=
+        CommandEntry(&EosAdimec::_FptrSnapshot,eCommandLocal);
+
+    m_mapCommandTemplate["GET_PREVIEW"]=
+        CommandEntry(&EosAdimec::_FptrGetPreview,eCommandLocal);
+    m_mapCommandTemplate["SET_PREVIEW_DECIMATION"]=
+        CommandEntry(&EosAdimec::_FptrSetPreview,eCommandLocal);
+
+    m_mapCommandTemplate["GET_ARCHIVE"]=
+        CommandEntry(&EosAdimec::_FptrGetArchive,eCommandLocal);
+    m_mapCommandTemplate["SET_ARCHIVE"]=
+        CommandEntry(&EosAdimec::_FptrSetArchive,eCommandLocal);
+
+    m_mapCommandTemplate["CAPTURE_DARK"]=
+        CommandEntry(&EosAdimec::_FptrCaptureReference,eCommandLocal);
+    m_mapCommandTemplate["CAPTURE_FLAT"]=
+        CommandEntry(&EosAdimec::_FptrCaptureReference,eCommandLocal);
+    m_mapCommandTemplate["GET_CORRECTION"]=
+        CommandEntry(&EosAdimec::_FptrGetCorrection,eCommandLocal);
+    m_mapCommandTemplate["SET_CORRECTION"]=
+        CommandEntry(&EosAdimec::_FptrSetCorrection,eCommandLocal);
+
+    m_mapCommandTemplate["SET_TONEMAP"]=
+        CommandEntry(&EosAdimec::_FptrSetToneMap,eCommandLocal);
+    m_mapCommandTemplate["SET_TONEMAP_GAMMA"]=
+        CommandEntry(&EosAdimec::_FptrSetToneMap,eCommandLocal);
+    m_mapCommandTemplate["SET_TONEMAP_LOG"]=
+        CommandEntry(&EosAdimec::_FptrSetToneMap,eCommandLocal);
+    m_mapCommandTemplate["SET_TONEMAP_GAIN"]=
+        CommandEntry(&EosAdimec::_FptrSetToneMap,eCommandLocal);
+    m_mapCommandTemplate["SET_TONEMAP_BLACK"]=
+        CommandEntry(&EosAdimec::_FptrSetToneMap,eCommandLocal);
+    m_mapCommandTemplate["GET_TONEMAP"]=
+        CommandEntry(&EosAdimec::_FptrGetToneMap,eCommandLocal);
+    m_mapCommandTemplate["GET_PIPELINE"]=
+        CommandEntry(&EosAdimec::_FptrGetPipeline,eCommandLocal);
+    m_mapCommandTemplate["GET_FRAME_POOLS"]=
+        CommandEntry(&EosAdimec::_FptrGetFramePools,eCommandLocal);
+
     return;
 }
 
@@ -372,36 +671,128 @@ int EosAdimec::DeviceSafeMode(void)
 // Translate SCIP commands into device-specific commands
 int EosAdimec::TranslateGenericCommand(void)
 {
+    // Arrival: before the back-pressure wait and the dispatch lock, so
+    // neither counts against the command's deadline or stale-query age.
+    uint64_t nNowMs=GetMonotonicMs();
+
+    // Back-pressure: while SCIP main leaves our replies unread, take no
+    // more of its commands (RunBase() doesn't read the pipe meanwhile).
+    if(m_pOutputQueue && m_pOutputQueue->IsReplyBacklogged(EosAdimecOutputQueue::PIPE_CHANNEL_ID))
+    {
+        std::cerr<<__FUNCTION__<<"(): SCIP main is not reading replies; holding commands"
+                 <<std::endl;
+        while(!m_abShutdownFlag)
+        {
+            if(m_pOutputQueue->WaitReplyRoom(EosAdimecOutputQueue::PIPE_CHANNEL_ID,SOCKET_POLL_MS))
+                break;
+        }
+    }
+
+    boost::lock_guard<boost::recursive_mutex> lock(m_mtxDispatch);
+
+    // Named-pipe command: reply on the named pipe.
+    m_eReplyRoute=eReplyRoutePipe;
+    m_nReplyClientFd=-1;
+
+    // RunBase() doesn't tell us when it read the command.  A command
+    // that follows the previous one within the output linger is from the
+    // same input buffer, so it arrived when that dispatch cycle started.
+    uint64_t nGapMs=(m_EosAdimecConfigInfo.nScipOutputLingerUs+999)/1000;
+    if(nNowMs>m_nPipeLastDoneMs+((nGapMs>0) ? nGapMs : 1))
+        m_nPipeCycleStartMs=nNowMs;
+    m_nCommandArrivalMs=m_nPipeCycleStartMs;
+
+    // RunBase() hands us one command at a time, so we can't see where an
+    // input buffer ends.  Hold the pipe's output and let it linger briefly
+    // after each command; the next command of the same buffer re-corks
+    // before the linger expires, and the whole cycle goes out in one write.
+    if(m_pOutputQueue)
+        m_pOutputQueue->Cork(EosAdimecOutputQueue::PIPE_CHANNEL_ID);
+
+    int nStatus=DispatchCommand(m_vStrGenericCommand);
+
+    if(m_pOutputQueue)
+        m_pOutputQueue->Uncork(EosAdimecOutputQueue::PIPE_CHANNEL_ID,
+                               m_EosAdimecConfigInfo.nScipOutputLingerUs);
+
+    m_nPipeLastDoneMs=GetMonotonicMs();
+    m_eReplyRoute=eReplyRouteDefault;
+
+    return nStatus;
+}
+
+// Execute one tokenized command.  Works on a copy of the
+// command tokens so that the socket-server thread never
+// touches m_vStrGenericCommand.
+int EosAdimec::DispatchCommand(const std::vector<std::string>& vStrCmdIn)
+{
+    boost::lock_guard<boost::recursive_mutex> lock(m_mtxDispatch);
+
+    std::vector<std::string> vStrCmd(vStrCmdIn);
+    CommandOptions options;
+    ParseCommandOptions(vStrCmd,options);
+
+    return DispatchParsedCommand(vStrCmd,options);
+}
+
+int EosAdimec::DispatchParsedCommand(const std::vector<std::string>& vStrCmd,
+                                     const CommandOptions& options)
+{
+    boost::lock_guard<boost::recursive_mutex> lock(m_mtxDispatch);
+
+    // A tagged command's responses carry its tag; restore the caller's
+    // tag afterward.
+    const std::string strCallerTag=m_strReplyTag;
+    if(!options.strReplyTag.empty())
+        m_strReplyTag=options.strReplyTag;
+
+    int nStatus=UNIX_ERROR_STATUS;
   
     try
     {
     
-        if(m_vStrGenericCommand.size()<1)
+        if(vStrCmd.size()<1)
         {
             // Nothing to parse
-            return UNIX_ERROR_STATUS;
+            nStatus=UNIX_ERROR_STATUS;
         }
-    
         // Check to see if we have this generic command in our template
-        if(m_mapCommandTemplate.find(m_vStrGenericCommand[0]) != m_mapCommandTemplate.end())
+        else if(m_mapCommandTemplate.find(vStrCmd[0]) != m_mapCommandTemplate.end())
         {
-            int nRetVal;
-      
-            // Each generic command is mapped to an associated device-specific command via
-            // boost::function
-            nRetVal=m_mapCommandTemplate[m_vStrGenericCommand[0]](this,m_vStrGenericCommand);
-      
+            const CommandEntry& command=m_mapCommandTemplate[vStrCmd[0]];
+            if(options.bAsync)
+            {
+                nStatus=QueueAsyncCommand(vStrCmd,options);
+            }
+            else if(eCommandQuery!=command.eKind)
+            {
+                // Sets always run, and a camera set makes every cached
+                // query answer suspect.
+                if(eCommandSet==command.eKind)
+                    m_mapQueryCache.clear();
+
+                // Each generic command is mapped to an associated device-specific command via
+                // boost::function
+                nStatus=command.fnCommand(this,vStrCmd);
+
+                // A SET that failed leaves no change pending.
+                AbandonFrameSettings();
+            }
+            else
+            {
+                nStatus=DispatchQuery(vStrCmd,options);
+            }
       
             // Capture time that the valid command was received/parsed
             // RWM 2020/03/19 moved to base class:SetTimeOfLastCommandBase();
-      
-            return nRetVal;
         }
         else
         {
-            // Generic command not found.
-            // Do nothing and return an error value.
-            return UNIX_ERROR_STATUS;
+            // Generic command not found.  Socket clients get told;
+            // the named-pipe path keeps its old (silent) behavior.
+            if(eReplyRouteSocket==m_eReplyRoute)
+                ShipToSCIP("INVALID_COMMAND",vStrCmd[0]);
+            nStatus=UNIX_ERROR_STATUS;
         }
     }
     catch(EosDeviceException &excep)
@@ -416,18 +807,145 @@ int EosAdimec::TranslateGenericCommand(void)
                 strExcept[istr]='_';
         }
     
-        if(m_pPipeComms!=NULL)
-            m_pPipeComms->Write(strExcept+std::string(" \n"));
+        ShipRawToSCIP(strExcept+std::string(" \n"));
     
-        return UNIX_ERROR_STATUS;
+        AbandonFrameSettings();
+        nStatus=UNIX_ERROR_STATUS;
     }
     catch(...)
     {
         // Catch any other exception that might otherwise crash the app
-        return UNIX_ERROR_STATUS;
+        AbandonFrameSettings();
+        nStatus=UNIX_ERROR_STATUS;
     }
+
+    m_bCaptureQuery=false;
+    m_strReplyTag=strCallerTag;
   
-    return UNIX_OK_STATUS;
+    return nStatus;
+}
+
+// A query that waited past its deadline is answered from the newest
+// response we have for it, or with TIMEOUT[CMD] -- it never costs a
+// serial round trip.  A query that runs refreshes the cache.
+int EosAdimec::DispatchQuery(const std::vector<std::string>& vStrCmd,
+                             const CommandOptions& options)
+{
+    std::string strKey=boost::join(vStrCmd,",");
+
+    int nDeadlineMs=(options.nDeadlineMs>=0) ? options.nDeadlineMs : GetQueryStaleMs(vStrCmd[0]);
+    if(nDeadlineMs>0)
+    {
+        uint64_t nAgeMs=GetMonotonicMs()-options.nArrivalMs;
+        if(nAgeMs>(uint64_t)nDeadlineMs)
+        {
+            std::map<std::string,CachedQuery>::const_iterator icache=m_mapQueryCache.find(strKey);
+            if(icache!=m_mapQueryCache.end())
+            {
+                m_nStaleFromCache++;
+                ShipRawToSCIP(icache->second.strResponse);
+                return UNIX_OK_STATUS;
+            }
+
+            m_nStaleTimeouts++;
+            ShipToSCIP("TIMEOUT",vStrCmd[0]);
+            return UNIX_ERROR_STATUS;
+        }
+    }
+
+    m_bCaptureQuery=true;
+    m_strQueryCapture.clear();
+
+    int nStatus=m_mapCommandTemplate[vStrCmd[0]].fnCommand(this,vStrCmd);
+
+    m_bCaptureQuery=false;
+    if((UNIX_ERROR_STATUS!=nStatus) && !m_strQueryCapture.empty())
+    {
+        CachedQuery cached;
+        cached.strResponse=m_strQueryCapture;
+        cached.nTimeMs=GetMonotonicMs();
+        m_mapQueryCache[strKey]=cached;
+    }
+
+    return nStatus;
+}
+
+// scip_query_stale_ms: the command's own window, else "*", else 0 (never stale).
+int EosAdimec::GetQueryStaleMs(const std::string& strCmd)
+{
+    std::map<std::string,int>::const_iterator istale=
+        m_EosAdimecConfigInfo.mapQueryStaleMs.find(strCmd);
+    if(istale==m_EosAdimecConfigInfo.mapQueryStaleMs.end())
+        istale=m_EosAdimecConfigInfo.mapQueryStaleMs.find("*");
+    if(istale==m_EosAdimecConfigInfo.mapQueryStaleMs.end())
+        return 0;
+
+    return istale->second;
+}
+
+// Milliseconds since an arbitrary point; immune to clock changes.
+uint64_t EosAdimec::GetMonotonicMs(void)
+{
+    return EosAdimecUtil::MonotonicNs()/1000000;
+}
+
+// Strip trailing option arguments, in either order:
+//    "#17"  -- correlation tag; "#!17" also makes the command asynchronous
+//    "~250" -- deadline: answer a query from cache (or TIMEOUT) if it
+//              waited more than 250 ms before running
+void EosAdimec::ParseCommandOptions(std::vector<std::string>& vStrCmd,
+                                    CommandOptions& options)
+{
+    options.strReplyTag.clear();
+    options.bAsync=false;
+    options.nDeadlineMs=-1;
+    options.nArrivalMs=m_nCommandArrivalMs;
+
+    while((vStrCmd.size()>=2) && !vStrCmd.back().empty())
+    {
+        const std::string& strArg=vStrCmd.back();
+
+        if((REPLY_TAG_PREFIX==strArg[0]) && options.strReplyTag.empty())
+        {
+            std::string strTag=strArg.substr(1);
+            if(!strTag.empty() && (ASYNC_TAG_MARK==strTag[0]))
+            {
+                options.bAsync=true;
+                strTag.erase(0,1);
+            }
+
+            // Tags go back out inside SCIP responses: keep them to safe characters.
+            for(unsigned int istr=0; istr<strTag.size(); istr++)
+            {
+                if(!::isalnum((unsigned char)strTag[istr]) && ('_'!=strTag[istr]) &&
+                   ('-'!=strTag[istr]) && ('.'!=strTag[istr]))
+                    strTag[istr]='_';
+            }
+            if(strTag.size()>MAX_REPLY_TAG_LEN)
+                strTag.resize(MAX_REPLY_TAG_LEN);
+
+            options.strReplyTag=strTag;
+        }
+        else if((DEADLINE_PREFIX==strArg[0]) && (options.nDeadlineMs<0))
+        {
+            try
+            {
+                options.nDeadlineMs=std::max(0,boost::lexical_cast<int>(strArg.substr(1)));
+            }
+            catch(...)
+            {
+                break; // Not an option after all; leave it for the handler
+            }
+        }
+        else
+        {
+            break;
+        }
+
+        vStrCmd.pop_back();
+    }
+
+    return;
 }
 
 
@@ -436,8 +954,7 @@ int EosAdimec::TranslateGenericCommand(void)
 
 //prints out all implemented device commands. Pulled from EosPower
 int EosAdimec::_FptrListCommandInfo(const std::vector<std::string> &vStrArgs){
-    std::map<std::string, 
-             boost::function<int (EosAdimec*, const std::vector<std::string>&) > >::iterator imm;
+    std::map<std::string, CommandEntry>::iterator imm;
     
     char cBuf[BUFLEN+1]; // More than big enough
     ::memset(cBuf,'\0',BUFLEN);
@@ -454,7 +971,7 @@ int EosAdimec::_FptrListCommandInfo(const std::vector<std::string> &vStrArgs){
         // Ship the SCIP message up to the remote client
         //nBytes=AddMessageToRecvQueue(strResp);
         //m_vStrGenericResponse.push_back(std::string(cBuf));
-        m_pPipeComms->Write(std::string(cBuf));
+        ShipRawToSCIP(std::string(cBuf));
     }
     
     return NO_RESPONSE_STATUS;
@@ -923,1084 +1440,4367 @@ int EosAdimec::_FptrSetImageFormat(const std::vector<std::string>& vStrArgs)
     return nStatus;
 }
 
-// ######################## END BOOST FUNCTION PTRS (For Command Map) ####################/
-
-
-
-/*Function that queries the camera and builds the internal struct that tracks the values
-  Designed to be called in the constuctor so that we always know what the current 
-  settings of the camera are*/
-int EosAdimec::InitAdimecStruct()
+// STATS[]
+int EosAdimec::_FptrGetStats(const std::vector<std::string>& vStrArgs)
 {
-    int nStatus = UNIX_ERROR_STATUS;
-    std::string strCmd,strResp;
-
-    /*Checking the current Output Resolution of the Adimec. Not adding this to
-      get level as OR should not change after initialization and we don't want 
-      * to give visibility to it. */
-    strCmd="@OR?";
-    PdvSerialWrite(strCmd);
-    PdvSerialRead(strResp); // Clear out the Adimec buffer
-    
-    strResp="";
-    strCmd="@GA?";
-    PdvSerialWrite(strCmd);
-    nStatus=PdvSerialRead(strResp);
-    if(nStatus==UNIX_OK_STATUS)
-        m_pAdimec->strGain=strResp;            
-    
-    strResp="";
-    PdvSerialWrite("@OFS?");
-    nStatus=PdvSerialRead(strResp);
-    if(nStatus==UNIX_OK_STATUS)
-    {
-        m_pAdimec->strOffset=strResp;
-    }
-    
-    PdvSerialWrite("@WB?");
-    nStatus=PdvSerialRead(strResp); 
-    if(nStatus==UNIX_OK_STATUS)
+    int nStatus=UNIX_ERROR_STATUS;
+    try
     {
-        if(strResp.size()>0)
+        if (vStrArgs.size()!=1)
         {
-            std::vector<std::string> vstrSplit;
-            boost::split(vstrSplit,strResp,boost::is_any_of(","));
-            for(unsigned int i=0;i<vstrSplit.size();i++){
-                m_pAdimec->strRGB[i]=vstrSplit.at(i);
-            }
+            ShipToSCIP(EosResp::ARGERROR,"");
+            return UNIX_ERROR_STATUS;
         }
-        
+        nStatus=HandleGetStats(vStrArgs);
+    }
+    catch(...)
+    {
+        nStatus=UNIX_ERROR_STATUS;
     }
     return nStatus;
 }
 
-/**
-   Sends a command to the Adimec instructing it to save its settings.
-   Composes a SCIP-format device response message and sends that
-   response up the main controller.
-*/
-int EosAdimec::SaveSettings(){
+// FIRST_FRAME[nVersion]
+int EosAdimec::_FptrGetFirstFrame(const std::vector<std::string>& vStrArgs)
+{
     int nStatus=UNIX_ERROR_STATUS;
-    std::string strCmd="@SC";
-    std::string strResp;
-    
-    // Have gotten error responses on the first
-    // savesettings try, so do it twice here to make sure
-    // that settings get saved.
-    int nStatus_wr=PdvSerialWrite(strCmd);
-
-    PdvSerialRead(strResp); // Clear out the adimec buffer.
-    
-    std::this_thread::sleep_for(std::chrono::milliseconds(200));
-    
-    nStatus_wr=PdvSerialWrite(strCmd);
-
-    // Read just to clear out the camlink send buffer
-    PdvSerialRead(strResp); // Clear out Adimec buffer
-    
-    if(nStatus_wr==UNIX_OK_STATUS){
-        ShipToSCIP(EosResp::SAVEDSETTINGS,"");
+    try
+    {
+        if (vStrArgs.size()!=2)
+        {
+            ShipToSCIP(EosResp::ARGERROR,"");
+            return UNIX_ERROR_STATUS;
+        }
+        nStatus=HandleGetFirstFrame(vStrArgs);
     }
-    else{
-        ShipToSCIP(EosResp::ERRORSAVINGSETTINGS,"");
+    catch(...)
+    {
+        nStatus=UNIX_ERROR_STATUS;
     }
-
     return nStatus;
 }
 
-
-// Force a serial-port reconnect
-int EosAdimec::HandleReconnect(const std::vector<std::string>& vStrArgs)
+// SET_AE[0|1], SET_AE_TARGET[pct], SET_AE_ROI[x,y,w,h], SET_AE_RATE[hz]
+int EosAdimec::_FptrSetAutoExposure(const std::vector<std::string>& vStrArgs)
 {
-    // RWM MOD 2022/03/15
-    // int nStatus=ResetSerialConnection();
-    int nStatus=m_pSerialComms->ResetConnection();
-    
-    ShipToSCIP(EosResp::RECONNECTING,"");
-    // No response to read when the camera is reconnected.
-
-
+    int nStatus=UNIX_ERROR_STATUS;
+    try
+    {
+        size_t nArgs=(vStrArgs[0]=="SET_AE_ROI") ? 5 : 2;
+        if (vStrArgs.size()!=nArgs)
+        {
+            ShipToSCIP(EosResp::ARGERROR,"");
+            return UNIX_ERROR_STATUS;
+        }
+        nStatus=HandleSetAutoExposure(vStrArgs);
+    }
+    catch(...)
+    {
+        nStatus=UNIX_ERROR_STATUS;
+    }
     return nStatus;
 }
 
-/**
-   Calls the requisite functions to retrieve the 
-   current gain/offset/rgb settings.
-   Composes a SCIP-format device response message and sends that
-   response up the main controller.
-*/
-int EosAdimec::HandleGetLevel(const std::vector<std::string>& vStrArgs)
+// GET_AE[]
+int EosAdimec::_FptrGetAutoExposure(const std::vector<std::string>& vStrArgs)
 {
     int nStatus=UNIX_ERROR_STATUS;
-    char cCmdChar=vStrArgs[0].at(3);
-    std::string strValue, strCmd, strResp;
-    
-    bool bValid=false;
-
-    nStatus=GetLevel(cCmdChar,strCmd,strResp);
-    if(nStatus==UNIX_OK_STATUS)
-    {    
-        PdvSerialWrite(strCmd);
-        nStatus = PdvSerialRead(strValue); 
-
-        // RGB is a special case -- 3 vals returned.
-        if(strResp==EosResp::RGBPOS)
+    try
+    {
+        if (vStrArgs.size()!=1)
         {
-            // A kluge: The Adimec reports colors in BGR order, but we
-            // want to send out RGBPOS[R,G,B] because that's what Sentinel
-            // is expecting.
-            if(strValue.size()>0)
-            {
-                std::string strValueRev=strValue;
-                std::vector<std::string>vStrValueRev;
-                boost::split(vStrValueRev,strValueRev,boost::is_any_of(","));
-                if(vStrValueRev.size()>=3)
-                {
-                    strValue.clear();
-                    strValue+=vStrValueRev.at(2)+",";
-                    strValue+=vStrValueRev.at(1)+",";
-                    strValue+=vStrValueRev.at(0);
-                    bValid=true;
-                }
-            }
-            if(bValid)
-            {
-                ShipToSCIP(strResp,strValue);
-            }
-            else
-            {
-                ShipToSCIP(EosResp::ERRORGETTINGVALUE,"");
-            }
-            return nStatus;
+            ShipToSCIP(EosResp::ARGERROR,"");
+            return UNIX_ERROR_STATUS;
         }
-        // Not RGB -- must be gain or offset.
-        // single value will be returned as strValue
-        // (i.e. not multiple comma-separated values)
-        if(UNIX_OK_STATUS==nStatus)
-            ShipToSCIP(strResp,strValue);
-        else
-            ShipToSCIP(EosResp::ERRORGETTINGVALUE,"");
-        
+        nStatus=HandleGetAutoExposure(vStrArgs);
+    }
+    catch(...)
+    {
+        nStatus=UNIX_ERROR_STATUS;
     }
-
     return nStatus;
 }
 
-/**
-   Wrapper around SetGainLevel -- translates std::vector<std::string> args
-   into the format needed for SetGainLevel
-   Sends the set-gain command to the Adimec.
-   Composes a SCIP-format device response message and sends that
-   response up the main controller.
-*/
-int EosAdimec::HandleSetGainLevel(const std::vector<std::string>& vStrArgs){
-    std::string strGainVal,strGainMsg, strResp;
-    int nStatus=UNIX_ERROR_STATUS,nTempGain=0;
-
+// AWB_ONCE[]
+int EosAdimec::_FptrAutoWhiteBalanceOnce(const std::vector<std::string>& vStrArgs)
+{
+    int nStatus=UNIX_ERROR_STATUS;
     try
     {
-        nTempGain=boost::lexical_cast<int>(vStrArgs[1]);
-        strGainVal=vStrArgs[1];
-        SetGainLevel(nTempGain,strGainMsg,strGainVal);
-        
-        PdvSerialWrite(strGainMsg);
-        nStatus=PdvSerialRead(strResp);
+        if (vStrArgs.size()!=1)
+        {
+            ShipToSCIP(EosResp::ARGERROR,"");
+            return UNIX_ERROR_STATUS;
+        }
+        nStatus=HandleAutoWhiteBalanceOnce(vStrArgs);
     }
-    //catching a possible lexical_cast exception
     catch(...)
     {
         nStatus=UNIX_ERROR_STATUS;
     }
-    if(nStatus==UNIX_OK_STATUS)
+    return nStatus;
+}
+
+// SET_AWB[off|continuous], SET_AWB_METHOD[gray_world|white_patch],
+// SET_AWB_HYST[pct], SET_AWB_RATE[hz]
+int EosAdimec::_FptrSetAutoWhiteBalance(const std::vector<std::string>& vStrArgs)
+{
+    int nStatus=UNIX_ERROR_STATUS;
+    try
     {
-        ShipToSCIP(EosResp::GAINPOS,strGainVal);
+        if (vStrArgs.size()!=2)
+        {
+            ShipToSCIP(EosResp::ARGERROR,"");
+            return UNIX_ERROR_STATUS;
+        }
+        nStatus=HandleSetAutoWhiteBalance(vStrArgs);
     }
-    else
+    catch(...)
     {
-        ShipToSCIP(EosResp::ERRORSETTINGGAIN,"100-800");
+        nStatus=UNIX_ERROR_STATUS;
     }
     return nStatus;
-
 }
 
-int EosAdimec::HandleSetResolution(const std::vector<std::string>& vStrArgs){
-    int nStatus = UNIX_ERROR_STATUS;
-    int nTempResolution;
-    std::string strResolutionValue, strResolutionMsg, strResp;
-
-    try{
-        nTempResolution = boost::lexical_cast<int>(vStrArgs[1]);
-        strResolutionValue = std::to_string(nTempResolution);
-        nStatus=SetResolution(nTempResolution, strResolutionMsg, strResolutionValue);
-        PdvSerialWrite(strResolutionMsg);
-        nStatus=PdvSerialRead(strResp);
+// GET_AWB[]
+int EosAdimec::_FptrGetAutoWhiteBalance(const std::vector<std::string>& vStrArgs)
+{
+    int nStatus=UNIX_ERROR_STATUS;
+    try
+    {
+        if (vStrArgs.size()!=1)
+        {
+            ShipToSCIP(EosResp::ARGERROR,"");
+            return UNIX_ERROR_STATUS;
+        }
+        nStatus=HandleGetAutoWhiteBalance(vStrArgs);
     }
     catch(...)
     {
         nStatus=UNIX_ERROR_STATUS;
     }
-    if(nStatus==UNIX_OK_STATUS)
+    return nStatus;
+}
+
+// FRAME_STATS[] or FRAME_STATS[r|g|b]
+int EosAdimec::_FptrGetFrameStats(const std::vector<std::string>& vStrArgs)
+{
+    int nStatus=UNIX_ERROR_STATUS;
+    try
     {
-        ShipToSCIP(EosResp::OUTPUTRESOLUTION,strResolutionValue);
+        if ((vStrArgs.size()!=1) && (vStrArgs.size()!=2))
+        {
+            ShipToSCIP(EosResp::ARGERROR,"");
+            return UNIX_ERROR_STATUS;
+        }
+        nStatus=HandleGetFrameStats(vStrArgs);
     }
-    else
+    catch(...)
     {
-        ShipToSCIP(EosResp::ERRORSETTINGRESOLUTION,"8,10,12");
+        nStatus=UNIX_ERROR_STATUS;
     }
     return nStatus;
 }
-int EosAdimec::HandleGetResolution(const std::vector<std::string>& vStrArgs){
-    int nStatus = UNIX_ERROR_STATUS;
-    std::string strResolutionMsg, strResp;
 
-    try{
-        strResolutionMsg="@OR?";
-        PdvSerialWrite(strResolutionMsg);
-        nStatus=PdvSerialRead(strResp);
-    }
-    catch(...){
-        nStatus=UNIX_ERROR_STATUS;
-    }
-    if(nStatus!=UNIX_OK_STATUS)
+// SET_FRAME_STATS_DECIMATION[n], SET_FRAME_STATS_PUSH[ms]
+int EosAdimec::_FptrSetFrameStats(const std::vector<std::string>& vStrArgs)
+{
+    int nStatus=UNIX_ERROR_STATUS;
+    try
     {
-        ShipToSCIP(EosResp::ERRORGETTINGRESOLUTION,"8,10,12");
+        if (vStrArgs.size()!=2)
+        {
+            ShipToSCIP(EosResp::ARGERROR,"");
+            return UNIX_ERROR_STATUS;
+        }
+        nStatus=HandleSetFrameStats(vStrArgs);
     }
-    else
+    catch(...)
     {
-        ShipToSCIP("OPR",strResp);
+        nStatus=UNIX_ERROR_STATUS;
     }
-    
     return nStatus;
 }
 
-/**
-   Wrapper around SetRGBLevel -- translates std::vector<std::string> args
-   into the format needed for SetRGBLevel.  
-   Sends the set-rgb command to the Adimec.
-   Composes a SCIP-format device response message and sends that
-   response up the main controller.
-*/
-int EosAdimec::HandleSetRGBLevel(const std::vector<std::string>& vStrArgs){
+// FOCUS[]
+int EosAdimec::_FptrGetFocus(const std::vector<std::string>& vStrArgs)
+{
     int nStatus=UNIX_ERROR_STATUS;
-    std::string strNewRGB;
-    std::string strScipRGB, strResp;
-
-    try{
-        nStatus=SetRGBLevel(vStrArgs,strNewRGB);
-        if(nStatus==UNIX_OK_STATUS)
+    try
+    {
+        if (vStrArgs.size()!=1)
         {
-            PdvSerialWrite(strNewRGB);
-            nStatus=PdvSerialRead(strResp);
-            if(nStatus==UNIX_OK_STATUS){
-                strScipRGB=vStrArgs.at(1)+","+vStrArgs.at(2)+","+vStrArgs.at(3);
-                ShipToSCIP(EosResp::RGB,strScipRGB);
-            }
-        }
-        if(nStatus==UNIX_ERROR_STATUS){
-            ShipToSCIP(EosResp::ERRORSETTINGRGB,"100-399,100-399,100-399");
+            ShipToSCIP(EosResp::ARGERROR,"");
+            return UNIX_ERROR_STATUS;
         }
+        nStatus=HandleGetFocus(vStrArgs);
     }
-    catch(...){
+    catch(...)
+    {
         nStatus=UNIX_ERROR_STATUS;
     }
     return nStatus;
-    
 }
 
-/**
-   Wrapper around SetOffsetLevel -- translates std::vector<std::string> args
-   into the format needed for SetOffsetLevel
-   Sends the set-offset command to the Adimec.
-   Composes a SCIP-format device response message and sends that
-   response up the main controller.
-*/
-int EosAdimec::HandleSetOffsetLevel(const std::vector<std::string>& vStrArgs){
+// SET_FOCUS_METHOD[tenengrad|laplacian], SET_FOCUS_ROI[x,y,w,h], SET_FOCUS_PUSH[0|1]
+int EosAdimec::_FptrSetFocus(const std::vector<std::string>& vStrArgs)
+{
     int nStatus=UNIX_ERROR_STATUS;
-    std::string strOffsetCmd, strResp;
-    
-    nStatus=SetOffsetLevel(vStrArgs[1],strOffsetCmd);
-    if(nStatus==UNIX_OK_STATUS)
+    try
     {
-        PdvSerialWrite(strOffsetCmd);
-
-        nStatus = PdvSerialRead(strResp); 
-
-        if(nStatus==UNIX_OK_STATUS)
+        size_t nArgs=(vStrArgs[0]=="SET_FOCUS_ROI") ? 5 : 2;
+        if (vStrArgs.size()!=nArgs)
         {
-            ShipToSCIP(EosResp::OFFSETPOS,vStrArgs[1]);
+            ShipToSCIP(EosResp::ARGERROR,"");
+            return UNIX_ERROR_STATUS;
         }
+        nStatus=HandleSetFocus(vStrArgs);
     }
-    else{
-        ShipToSCIP(EosResp::ERRORSETTINGOFFSET,"20-4095");
+    catch(...)
+    {
+        nStatus=UNIX_ERROR_STATUS;
     }
-    
     return nStatus;
 }
 
-int EosAdimec::HandleGetFramePeriod(const std::vector<std::string>& vStrArgs)
+// TRIGGER_SAVE[pre_s,post_s]
+int EosAdimec::_FptrTriggerSave(const std::vector<std::string>& vStrArgs)
 {
-    int nStatus = UNIX_ERROR_STATUS;
-    std::string strResp;
-    std::string strFramePeriodCmd;
-    std::string strFramePeriod,strMinFramePeriod;
-
-    try{
-        strFramePeriodCmd="@FM?";
-        PdvSerialWrite(strFramePeriodCmd);
-        strMinFramePeriod.clear();
-        nStatus=PdvSerialRead(strResp);
-
-        strMinFramePeriod=strResp;
-        
-        strFramePeriodCmd="@FP?";
-        PdvSerialWrite(strFramePeriodCmd);
-        strFramePeriod.clear();
-        PdvSerialRead(strResp); 
-
-        strFramePeriod=strResp;
-    }
-    catch(...){
-        nStatus=UNIX_ERROR_STATUS;
-    }
-    if(nStatus!=UNIX_OK_STATUS)
+    int nStatus=UNIX_ERROR_STATUS;
+    try
     {
-        ShipToSCIP(EosResp::ERRORGETTINGFP,"1-4000");
+        if (vStrArgs.size()!=3)
+        {
+            ShipToSCIP(EosResp::ARGERROR,"");
+            return UNIX_ERROR_STATUS;
+        }
+        nStatus=HandleTriggerSave(vStrArgs);
     }
-    else
+    catch(...)
     {
-        ShipToSCIP(EosResp::FRAME_PERIOD,strFramePeriod);
-        ShipToSCIP("MIN_FRAME_PERIOD",strMinFramePeriod);
+        nStatus=UNIX_ERROR_STATUS;
     }
-
     return nStatus;
 }
 
-int EosAdimec::HandleSetFramePeriod(const std::vector<std::string>& vStrArgs)
+// GET_RECORDER[]
+int EosAdimec::_FptrGetRecorder(const std::vector<std::string>& vStrArgs)
 {
     int nStatus=UNIX_ERROR_STATUS;
-    std::string strFpCmd, strResp;
-
-    nStatus=SetFramePeriod(vStrArgs[1],strFpCmd);
-    if(nStatus==UNIX_OK_STATUS)
+    try
     {
-        PdvSerialWrite(strFpCmd);
-
-        nStatus=PdvSerialRead(strResp);
-
-        if(nStatus==UNIX_OK_STATUS){
-            ShipToSCIP(EosResp::FRAME_PERIOD,vStrArgs[1]);
+        if (vStrArgs.size()!=1)
+        {
+            ShipToSCIP(EosResp::ARGERROR,"");
+            return UNIX_ERROR_STATUS;
         }
+        nStatus=HandleGetRecorder(vStrArgs);
     }
-    else{
-        ShipToSCIP(EosResp::ERRORSETTINGFP,"1-4000");
+    catch(...)
+    {
+        nStatus=UNIX_ERROR_STATUS;
     }
-    
     return nStatus;
 }
 
-int EosAdimec::HandleGetIntegrationTime(const std::vector<std::string>& vStrArgs)
+// SNAPSHOT[png|jpeg]
+int EosAdimec::_FptrSnapshot(const std::vector<std::string>& vStrArgs)
 {
-    int nStatus = UNIX_ERROR_STATUS;
-    std::string strIntegrationTimeMsg, strResp;
-    
-    try{
-        strIntegrationTimeMsg="@IT?";
-        PdvSerialWrite(strIntegrationTimeMsg);
-        nStatus = PdvSerialRead(strResp); 
+    int nStatus=UNIX_ERROR_STATUS;
+    try
+    {
+        if (vStrArgs.size()!=2)
+        {
+            ShipToSCIP(EosResp::ARGERROR,"");
+            return UNIX_ERROR_STATUS;
+        }
+        nStatus=HandleSnapshot(vStrArgs);
     }
     catch(...)
     {
         nStatus=UNIX_ERROR_STATUS;
     }
+    return nStatus;
+}
 
-    if(nStatus!=UNIX_OK_STATUS)
+// GET_PREVIEW[]
+int EosAdimec::_FptrGetPreview(const std::vector<std::string>& vStrArgs)
+{
+    int nStatus=UNIX_ERROR_STATUS;
+    try
     {
-        ShipToSCIP(EosResp::ERRORGETTINGIT,"1-4000");
+        if (vStrArgs.size()!=1)
+        {
+            ShipToSCIP(EosResp::ARGERROR,"");
+            return UNIX_ERROR_STATUS;
+        }
+        nStatus=HandleGetPreview(vStrArgs);
     }
-    else
+    catch(...)
     {
-        ShipToSCIP(EosResp::INT_TIME,strResp);
+        nStatus=UNIX_ERROR_STATUS;
     }
-
     return nStatus;
 }
 
-int EosAdimec::HandleSetIntegrationTime(const std::vector<std::string>& vStrArgs)
+// SET_PREVIEW_DECIMATION[n]
+int EosAdimec::_FptrSetPreview(const std::vector<std::string>& vStrArgs)
 {
     int nStatus=UNIX_ERROR_STATUS;
-    std::string strItCmd, strResp;
-    
-    nStatus=SetIntegrationTime(vStrArgs[1],strItCmd);
-
-    if(nStatus==UNIX_OK_STATUS)
-    {
-        PdvSerialWrite(strItCmd);
-
-        nStatus = PdvSerialRead(strResp); 
-    }
-
-    if(nStatus==UNIX_OK_STATUS)
+    try
     {
-        ShipToSCIP(EosResp::INT_TIME,vStrArgs[1]);
+        if (vStrArgs.size()!=2)
+        {
+            ShipToSCIP(EosResp::ARGERROR,"");
+            return UNIX_ERROR_STATUS;
+        }
+        nStatus=HandleSetPreview(vStrArgs);
     }
-    else
+    catch(...)
     {
-        ShipToSCIP(EosResp::ERRORSETTINGIT,"1-4000");
+        nStatus=UNIX_ERROR_STATUS;
     }
-
     return nStatus;
 }
 
-int EosAdimec::HandleGetTemperature(const std::vector<std::string>& vStrArgs)
+// GET_ARCHIVE[]
+int EosAdimec::_FptrGetArchive(const std::vector<std::string>& vStrArgs)
 {
-    int nStatus = UNIX_ERROR_STATUS;
-    std::string strResp;
-    std::string strGetTempCmd, strTempResp;
-
+    int nStatus=UNIX_ERROR_STATUS;
     try
     {
-        strGetTempCmd="@TM?";
-        PdvSerialWrite(strGetTempCmd);
-
-        nStatus = PdvSerialRead(strResp); 
-        strTempResp=strResp;
+        if (vStrArgs.size()!=1)
+        {
+            ShipToSCIP(EosResp::ARGERROR,"");
+            return UNIX_ERROR_STATUS;
+        }
+        nStatus=HandleGetArchive(vStrArgs);
     }
     catch(...)
     {
         nStatus=UNIX_ERROR_STATUS;
     }
+    return nStatus;
+}
 
-    if(nStatus!=UNIX_OK_STATUS)
+// SET_ARCHIVE[0|1]
+int EosAdimec::_FptrSetArchive(const std::vector<std::string>& vStrArgs)
+{
+    int nStatus=UNIX_ERROR_STATUS;
+    try
     {
-        ShipToSCIP("ERROR_GETTING_TEMP","");
+        if (vStrArgs.size()!=2)
+        {
+            ShipToSCIP(EosResp::ARGERROR,"");
+            return UNIX_ERROR_STATUS;
+        }
+        nStatus=HandleSetArchive(vStrArgs);
     }
-    else
+    catch(...)
     {
-        ShipToSCIP("TEMP",strTempResp);
+        nStatus=UNIX_ERROR_STATUS;
     }
     return nStatus;
 }
 
-int EosAdimec::HandleGetPixelCorrect(const std::vector<std::string>& vStrArgs)
+// CAPTURE_DARK[n], CAPTURE_FLAT[n]
+int EosAdimec::_FptrCaptureReference(const std::vector<std::string>& vStrArgs)
 {
-    int nStatus = UNIX_ERROR_STATUS;
-    std::string strResp;
-    std::string strGetPixCmd,strGetNumPixCmd;
-    std::string strPixResp,strNumPixResp;
-
-    try{
-        strGetPixCmd="@DPE?";
-        PdvSerialWrite(strGetPixCmd);
-
-        std::vector<char> vBuff;
-        int nLength=0;
-        nStatus = PdvSerialRead(strResp); 
-        strPixResp=strResp;
-
-        strGetNumPixCmd="@DP?0";
-        PdvSerialWrite(strGetNumPixCmd);
-
-        nStatus=PdvSerialRead(strResp); 
-        strNumPixResp=strResp;
+    int nStatus=UNIX_ERROR_STATUS;
+    try
+    {
+        if (vStrArgs.size()!=2)
+        {
+            ShipToSCIP(EosResp::ARGERROR,"");
+            return UNIX_ERROR_STATUS;
+        }
+        nStatus=HandleCaptureReference(vStrArgs);
     }
     catch(...)
     {
         nStatus=UNIX_ERROR_STATUS;
     }
-    if(nStatus!=UNIX_OK_STATUS)
-    {
-        ShipToSCIP("ERROR_GETTING_PIXC","");
-    }
-    else
-    {
-        ShipToSCIP("PIXCORRECT",strPixResp);
-        ShipToSCIP("NUMPIXCORRECT",strNumPixResp);
-    }
     return nStatus;
 }
 
-int EosAdimec::HandleSetAgCorrect(const std::vector<std::string>& vStrArgs)
+// GET_CORRECTION[]
+int EosAdimec::_FptrGetCorrection(const std::vector<std::string>& vStrArgs)
 {
-    int nStatus = UNIX_ERROR_STATUS;
-    std::string strResp;
-    std::string strSetAgCmd, strAgResp;
-    
+    int nStatus=UNIX_ERROR_STATUS;
     try
     {
-        std::string strAgCorrect=vStrArgs.at(1);
-        int nAgCorrect=boost::lexical_cast<int>(strAgCorrect);
-        if((nAgCorrect<-2047)||(nAgCorrect>2047))
+        if (vStrArgs.size()!=1)
         {
-            ShipToSCIP("ERROR_SETTING_AGCORRECT","-2047-2047");
+            ShipToSCIP(EosResp::ARGERROR,"");
             return UNIX_ERROR_STATUS;
         }
-        strSetAgCmd="@AG"+strAgCorrect;
-        PdvSerialWrite(strSetAgCmd);
-
-        nStatus = PdvSerialRead(strResp); // Clear out Adimec buffer
-        strAgResp=strResp;
+        nStatus=HandleGetCorrection(vStrArgs);
     }
     catch(...)
     {
-        nStatus= UNIX_ERROR_STATUS;
-    }
-    if(nStatus!=UNIX_OK_STATUS)
-    {
-        ShipToSCIP("ERROR_SETTING_AGCORRECT","-2047-2047");
-    }
-    else
-    {
-        ShipToSCIP("AGCORRECT",strAgResp);
+        nStatus=UNIX_ERROR_STATUS;
     }
-
     return nStatus;
 }
 
-int EosAdimec::HandleGetAgCorrect(const std::vector<std::string>& vStrArgs)
+// SET_CORRECTION[0|1]
+int EosAdimec::_FptrSetCorrection(const std::vector<std::string>& vStrArgs)
 {
-    int nStatus = UNIX_ERROR_STATUS;
-    std::string strResp;
-    std::string strGetAgCmd;
-    std::string strAgResp;
-
+    int nStatus=UNIX_ERROR_STATUS;
     try
     {
-        strGetAgCmd="@AG?";
-        PdvSerialWrite(strGetAgCmd);
-
-        nStatus = PdvSerialRead(strResp); 
-        strAgResp=strResp;
+        if (vStrArgs.size()!=2)
+        {
+            ShipToSCIP(EosResp::ARGERROR,"");
+            return UNIX_ERROR_STATUS;
+        }
+        nStatus=HandleSetCorrection(vStrArgs);
     }
     catch(...)
     {
         nStatus=UNIX_ERROR_STATUS;
     }
-    if(nStatus!=UNIX_OK_STATUS)
+    return nStatus;
+}
+
+// SET_TONEMAP[curve], SET_TONEMAP_GAMMA[g], SET_TONEMAP_LOG[a],
+// SET_TONEMAP_GAIN[g], SET_TONEMAP_BLACK[pct]
+int EosAdimec::_FptrSetToneMap(const std::vector<std::string>& vStrArgs)
+{
+    int nStatus=UNIX_ERROR_STATUS;
+    try
     {
-        ShipToSCIP("ERROR_GETTING_AGCORRECT","");
+        if (vStrArgs.size()!=2)
+        {
+            ShipToSCIP(EosResp::ARGERROR,"");
+            return UNIX_ERROR_STATUS;
+        }
+        nStatus=HandleSetToneMap(vStrArgs);
     }
-    else
+    catch(...)
     {
-        ShipToSCIP("AGCORRECT",strAgResp);
+        nStatus=UNIX_ERROR_STATUS;
     }
     return nStatus;
 }
 
-int EosAdimec::HandleSetPixelCorrect(const std::vector<std::string>& vStrArgs)
+// GET_TONEMAP[]
+int EosAdimec::_FptrGetToneMap(const std::vector<std::string>& vStrArgs)
 {
-    int nStatus = UNIX_ERROR_STATUS;
-    std::string strResp;
-    std::string strGetPixCmd, strPixResp;
-    
+    int nStatus=UNIX_ERROR_STATUS;
     try
     {
-        std::string strPixMode=vStrArgs.at(1);
-        if((strPixMode!="0")&&(strPixMode!="1"))
+        if (vStrArgs.size()!=1)
         {
-            ShipToSCIP("ERROR_GETPIXC","0-1");
+            ShipToSCIP(EosResp::ARGERROR,"");
             return UNIX_ERROR_STATUS;
         }
-        strGetPixCmd="@DPE"+strPixMode;
-        PdvSerialWrite(strGetPixCmd);
-
-        nStatus = PdvSerialRead(strResp); // Clear out Adimec buffer
-        strPixResp=strResp;
+        nStatus=HandleGetToneMap(vStrArgs);
     }
     catch(...)
     {
-        ShipToSCIP("ERROR_GETTING_PIXC","");
         nStatus=UNIX_ERROR_STATUS;
     }
-    if(nStatus!=UNIX_OK_STATUS)
+    return nStatus;
+}
+
+// GET_PIPELINE[]
+int EosAdimec::_FptrGetPipeline(const std::vector<std::string>& vStrArgs)
+{
+    int nStatus=UNIX_ERROR_STATUS;
+    try
     {
-        ShipToSCIP("ERROR_GETTING_PIXC","");
+        if (vStrArgs.size()!=1)
+        {
+            ShipToSCIP(EosResp::ARGERROR,"");
+            return UNIX_ERROR_STATUS;
+        }
+        nStatus=HandleGetPipeline(vStrArgs);
     }
-    else
+    catch(...)
     {
-        ShipToSCIP("PIXCORRECT",strPixResp);
+        nStatus=UNIX_ERROR_STATUS;
     }
     return nStatus;
 }
 
-int EosAdimec::HandleGetImageFormat(const std::vector<std::string>& vStrArgs)
+// GET_FRAME_POOLS[]
+int EosAdimec::_FptrGetFramePools(const std::vector<std::string>& vStrArgs)
 {
-    int nStatus = UNIX_ERROR_STATUS;
-
-    std::string strGetImgFmtCmd;
-    std::string strResp;
-    std::string strImgFmtResp;
-
-    
-    
+    int nStatus=UNIX_ERROR_STATUS;
     try
     {
-        strGetImgFmtCmd="@FM?";
-        PdvSerialWrite(strGetImgFmtCmd);
-
-        nStatus = PdvSerialRead(strResp); 
-        strImgFmtResp=strResp;
+        if (vStrArgs.size()!=1)
+        {
+            ShipToSCIP(EosResp::ARGERROR,"");
+            return UNIX_ERROR_STATUS;
+        }
+        nStatus=HandleGetFramePools(vStrArgs);
     }
     catch(...)
     {
         nStatus=UNIX_ERROR_STATUS;
     }
-    if(nStatus!=UNIX_OK_STATUS)
-    {
-        ShipToSCIP("ERROR_GETTING_IMGFMT","");
-    }
-    else
-    {
-        std::vector<std::string> vStrImgFmtResp0,vStrImgFmtResp;
-        
-        boost::split(vStrImgFmtResp0,strImgFmtResp,boost::is_any_of("@;+"));
+    return nStatus;
+}
 
-        // Tokenize the adimec FMx;y;z response to get x,y,z
-        for(auto & ivec:vStrImgFmtResp0)
-        {
-            // Get rid of zero-length tokens
-            if(ivec.size()>0)
+// ######################## END BOOST FUNCTION PTRS (For Command Map) ####################/
+
+
+
+/*Function that queries the camera and builds the internal struct that tracks the values
+  Designed to be called in the constuctor so that we always know what the current 
+  settings of the camera are*/
+int EosAdimec::InitAdimecStruct()
+{
+    int nStatus = UNIX_ERROR_STATUS;
+    std::string strCmd,strResp;
+
+    /*Checking the current Output Resolution of the Adimec. Not adding this to
+      get level as OR should not change after initialization and we don't want 
+      * to give visibility to it. */
+    strCmd="@OR?";
+    PdvSerialWrite(strCmd);
+    PdvSerialRead(strResp); // Clear out the Adimec buffer
+    
+    strResp="";
+    strCmd="@GA?";
+    PdvSerialWrite(strCmd);
+    nStatus=PdvSerialRead(strResp);
+    if(nStatus==UNIX_OK_STATUS)
+        m_pAdimec->strGain=strResp;            
+    
+    strResp="";
+    PdvSerialWrite("@OFS?");
+    nStatus=PdvSerialRead(strResp);
+    if(nStatus==UNIX_OK_STATUS)
+    {
+        m_pAdimec->strOffset=strResp;
+    }
+    
+    PdvSerialWrite("@WB?");
+    nStatus=PdvSerialRead(strResp); 
+    if(nStatus==UNIX_OK_STATUS)
+    {
+        std::vector<std::string> vstrSplit;
+        if(WbFromCamera(strResp,vstrSplit))
+        {
+            for(unsigned int i=0;i<vstrSplit.size();i++){
+                m_pAdimec->strRGB[i]=vstrSplit.at(i);
+            }
+        }
+        
+    }
+    return nStatus;
+}
+
+/**
+   Sends a command to the Adimec instructing it to save its settings.
+   Composes a SCIP-format device response message and sends that
+   response up the main controller.
+*/
+int EosAdimec::SaveSettings(){
+    int nStatus=UNIX_ERROR_STATUS;
+    std::string strCmd="@SC";
+    std::string strResp;
+    
+    // Have gotten error responses on the first
+    // savesettings try, so do it twice here to make sure
+    // that settings get saved.
+    int nStatus_wr=PdvSerialWrite(strCmd);
+
+    PdvSerialRead(strResp); // Clear out the adimec buffer.
+    
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+    
+    nStatus_wr=PdvSerialWrite(strCmd);
+
+    // Read just to clear out the camlink send buffer
+    PdvSerialRead(strResp); // Clear out Adimec buffer
+    
+    if(nStatus_wr==UNIX_OK_STATUS){
+        ShipToSCIP(EosResp::SAVEDSETTINGS,"");
+    }
+    else{
+        ShipToSCIP(EosResp::ERRORSAVINGSETTINGS,"");
+    }
+
+    return nStatus;
+}
+
+
+// Force a serial-port reconnect
+int EosAdimec::HandleReconnect(const std::vector<std::string>& vStrArgs)
+{
+    // RWM MOD 2022/03/15
+    // int nStatus=ResetSerialConnection();
+    int nStatus=m_pSerialComms->ResetConnection();
+    
+    ShipToSCIP(EosResp::RECONNECTING,"");
+    // No response to read when the camera is reconnected.
+
+
+    return nStatus;
+}
+
+/**
+   Calls the requisite functions to retrieve the 
+   current gain/offset/rgb settings.
+   Composes a SCIP-format device response message and sends that
+   response up the main controller.
+*/
+int EosAdimec::HandleGetLevel(const std::vector<std::string>& vStrArgs)
+{
+    int nStatus=UNIX_ERROR_STATUS;
+    char cCmdChar=vStrArgs[0].at(3);
+    std::string strValue, strCmd, strResp;
+    
+    bool bValid=false;
+
+    nStatus=GetLevel(cCmdChar,strCmd,strResp);
+    if(nStatus==UNIX_OK_STATUS)
+    {    
+        PdvSerialWrite(strCmd);
+        nStatus = PdvSerialRead(strValue); 
+
+        // RGB is a special case -- 3 vals returned, and the Adimec
+        // reports them B,G,R.  Sentinel expects RGBPOS[R,G,B].
+        if(strResp==EosResp::RGBPOS)
+        {
+            std::vector<std::string> vStrRgb;
+            if(WbFromCamera(strValue,vStrRgb))
             {
-                vStrImgFmtResp.push_back(ivec);
-                std::cout<<__FUNCTION__<<"(): ivec="<<ivec<<std::endl;
+                strValue=vStrRgb.at(0)+","+vStrRgb.at(1)+","+vStrRgb.at(2);
+                bValid=true;
+            }
+            if(bValid)
+            {
+                ShipToSCIP(strResp,strValue);
+            }
+            else
+            {
+                ShipToSCIP(EosResp::ERRORGETTINGVALUE,"");
+            }
+            return nStatus;
+        }
+        // Not RGB -- must be gain or offset.
+        // single value will be returned as strValue
+        // (i.e. not multiple comma-separated values)
+        if(UNIX_OK_STATUS==nStatus)
+            ShipToSCIP(strResp,strValue);
+        else
+            ShipToSCIP(EosResp::ERRORGETTINGVALUE,"");
+        
+    }
+
+    return nStatus;
+}
+
+/**
+   Wrapper around SetGainLevel -- translates std::vector<std::string> args
+   into the format needed for SetGainLevel
+   Sends the set-gain command to the Adimec.
+   Composes a SCIP-format device response message and sends that
+   response up the main controller.
+*/
+int EosAdimec::HandleSetGainLevel(const std::vector<std::string>& vStrArgs){
+    std::string strGainVal,strGainMsg, strResp;
+    int nStatus=UNIX_ERROR_STATUS,nTempGain=0;
+    bool bWritten=false;
+
+    try
+    {
+        nTempGain=boost::lexical_cast<int>(vStrArgs[1]);
+        strGainVal=vStrArgs[1];
+        // Out of range: nothing goes to the camera
+        nStatus=SetGainLevel(nTempGain,strGainMsg,strGainVal);
+        if(nStatus==UNIX_OK_STATUS)
+        {
+            PdvSerialWriteSetting(strGainMsg);
+            bWritten=true;
+            nStatus=PdvSerialRead(strResp);
+        }
+    }
+    //catching a possible lexical_cast exception
+    catch(...)
+    {
+        nStatus=UNIX_ERROR_STATUS;
+    }
+    if(nStatus==UNIX_OK_STATUS)
+    {
+        m_frameSettings.nGain=nTempGain;
+        UpdateFrameSettings();
+        ShipToSCIP(EosResp::GAINPOS,strGainVal);
+        ShipSettingsVersion();
+    }
+    else
+    {
+        if(bWritten)
+            AbandonFrameSettings();
+        ShipToSCIP(EosResp::ERRORSETTINGGAIN,"100-800");
+    }
+    return nStatus;
+
+}
+
+int EosAdimec::HandleSetResolution(const std::vector<std::string>& vStrArgs){
+    int nStatus = UNIX_ERROR_STATUS;
+    int nTempResolution;
+    bool bWritten=false;
+    std::string strResolutionValue, strResolutionMsg, strResp;
+
+    try{
+        nTempResolution = boost::lexical_cast<int>(vStrArgs[1]);
+        strResolutionValue = std::to_string(nTempResolution);
+        nStatus=SetResolution(nTempResolution, strResolutionMsg, strResolutionValue);
+        if(nStatus==UNIX_OK_STATUS)
+        {
+            PdvSerialWriteSetting(strResolutionMsg);
+            bWritten=true;
+            nStatus=PdvSerialRead(strResp);
+        }
+    }
+    catch(...)
+    {
+        nStatus=UNIX_ERROR_STATUS;
+    }
+    if(nStatus==UNIX_OK_STATUS)
+    {
+        m_frameSettings.nOutputBits=nTempResolution;
+        UpdateFrameSettings();
+        ShipToSCIP(EosResp::OUTPUTRESOLUTION,strResolutionValue);
+        ShipSettingsVersion();
+    }
+    else
+    {
+        if(bWritten)
+            AbandonFrameSettings();
+        ShipToSCIP(EosResp::ERRORSETTINGRESOLUTION,"8,10,12");
+    }
+    return nStatus;
+}
+int EosAdimec::HandleGetResolution(const std::vector<std::string>& vStrArgs){
+    int nStatus = UNIX_ERROR_STATUS;
+    std::string strResolutionMsg, strResp;
+
+    try{
+        strResolutionMsg="@OR?";
+        PdvSerialWrite(strResolutionMsg);
+        nStatus=PdvSerialRead(strResp);
+    }
+    catch(...){
+        nStatus=UNIX_ERROR_STATUS;
+    }
+    if(nStatus!=UNIX_OK_STATUS)
+    {
+        ShipToSCIP(EosResp::ERRORGETTINGRESOLUTION,"8,10,12");
+    }
+    else
+    {
+        ShipToSCIP("OPR",strResp);
+    }
+    
+    return nStatus;
+}
+
+/**
+   Wrapper around SetRGBLevel -- translates std::vector<std::string> args
+   into the format needed for SetRGBLevel.  
+   Sends the set-rgb command to the Adimec.
+   Composes a SCIP-format device response message and sends that
+   response up the main controller.
+*/
+int EosAdimec::HandleSetRGBLevel(const std::vector<std::string>& vStrArgs){
+    int nStatus=UNIX_ERROR_STATUS;
+    std::string strNewRGB;
+    std::string strScipRGB, strResp;
+
+    try{
+        nStatus=SetRGBLevel(vStrArgs,strNewRGB);
+        if(nStatus==UNIX_OK_STATUS)
+        {
+            PdvSerialWriteSetting(strNewRGB);
+            nStatus=PdvSerialRead(strResp);
+            if(nStatus==UNIX_OK_STATUS){
+                m_frameSettings.nWbRed=boost::lexical_cast<int>(vStrArgs.at(1));
+                m_frameSettings.nWbGreen=boost::lexical_cast<int>(vStrArgs.at(2));
+                m_frameSettings.nWbBlue=boost::lexical_cast<int>(vStrArgs.at(3));
+                UpdateFrameSettings();
+                strScipRGB=vStrArgs.at(1)+","+vStrArgs.at(2)+","+vStrArgs.at(3);
+                ShipToSCIP(EosResp::RGB,strScipRGB);
+                ShipSettingsVersion();
+            }
+            else{
+                AbandonFrameSettings();
+            }
+        }
+        if(nStatus==UNIX_ERROR_STATUS){
+            ShipToSCIP(EosResp::ERRORSETTINGRGB,"100-399,100-399,100-399");
+        }
+    }
+    catch(...){
+        nStatus=UNIX_ERROR_STATUS;
+    }
+    return nStatus;
+    
+}
+
+/**
+   Wrapper around SetOffsetLevel -- translates std::vector<std::string> args
+   into the format needed for SetOffsetLevel
+   Sends the set-offset command to the Adimec.
+   Composes a SCIP-format device response message and sends that
+   response up the main controller.
+*/
+int EosAdimec::HandleSetOffsetLevel(const std::vector<std::string>& vStrArgs){
+    int nStatus=UNIX_ERROR_STATUS;
+    std::string strOffsetCmd, strResp;
+    
+    nStatus=SetOffsetLevel(vStrArgs[1],strOffsetCmd);
+    if(nStatus==UNIX_OK_STATUS)
+    {
+        PdvSerialWrite(strOffsetCmd);
+
+        nStatus = PdvSerialRead(strResp); 
+
+        if(nStatus==UNIX_OK_STATUS)
+        {
+            ShipToSCIP(EosResp::OFFSETPOS,vStrArgs[1]);
+        }
+    }
+    else{
+        ShipToSCIP(EosResp::ERRORSETTINGOFFSET,"20-4095");
+    }
+    
+    return nStatus;
+}
+
+int EosAdimec::HandleGetFramePeriod(const std::vector<std::string>& vStrArgs)
+{
+    int nStatus = UNIX_ERROR_STATUS;
+    std::string strResp;
+    std::string strFramePeriodCmd;
+    std::string strFramePeriod,strMinFramePeriod;
+
+    try{
+        strFramePeriodCmd="@FM?";
+        PdvSerialWrite(strFramePeriodCmd);
+        strMinFramePeriod.clear();
+        nStatus=PdvSerialRead(strResp);
+
+        strMinFramePeriod=strResp;
+        
+        strFramePeriodCmd="@FP?";
+        PdvSerialWrite(strFramePeriodCmd);
+        strFramePeriod.clear();
+        PdvSerialRead(strResp); 
+
+        strFramePeriod=strResp;
+    }
+    catch(...){
+        nStatus=UNIX_ERROR_STATUS;
+    }
+    if(nStatus!=UNIX_OK_STATUS)
+    {
+        ShipToSCIP(EosResp::ERRORGETTINGFP,"1-4000");
+    }
+    else
+    {
+        ShipToSCIP(EosResp::FRAME_PERIOD,strFramePeriod);
+        ShipToSCIP("MIN_FRAME_PERIOD",strMinFramePeriod);
+    }
+
+    return nStatus;
+}
+
+int EosAdimec::HandleSetFramePeriod(const std::vector<std::string>& vStrArgs)
+{
+    int nStatus=UNIX_ERROR_STATUS;
+    std::string strFpCmd, strResp;
+
+    nStatus=SetFramePeriod(vStrArgs[1],strFpCmd);
+    if(nStatus==UNIX_OK_STATUS)
+    {
+        PdvSerialWriteSetting(strFpCmd);
+
+        nStatus=PdvSerialRead(strResp);
+
+        if(nStatus==UNIX_OK_STATUS){
+            m_frameSettings.nFramePeriod=boost::lexical_cast<int>(vStrArgs[1]);
+            UpdateFrameSettings();
+            ShipToSCIP(EosResp::FRAME_PERIOD,vStrArgs[1]);
+            ShipSettingsVersion();
+        }
+        else{
+            AbandonFrameSettings();
+        }
+    }
+    else{
+        ShipToSCIP(EosResp::ERRORSETTINGFP,"1-4000");
+    }
+    
+    return nStatus;
+}
+
+int EosAdimec::HandleGetIntegrationTime(const std::vector<std::string>& vStrArgs)
+{
+    int nStatus = UNIX_ERROR_STATUS;
+    std::string strIntegrationTimeMsg, strResp;
+    
+    try{
+        strIntegrationTimeMsg="@IT?";
+        PdvSerialWrite(strIntegrationTimeMsg);
+        nStatus = PdvSerialRead(strResp); 
+    }
+    catch(...)
+    {
+        nStatus=UNIX_ERROR_STATUS;
+    }
+
+    if(nStatus!=UNIX_OK_STATUS)
+    {
+        ShipToSCIP(EosResp::ERRORGETTINGIT,"1-4000");
+    }
+    else
+    {
+        ShipToSCIP(EosResp::INT_TIME,strResp);
+    }
+
+    return nStatus;
+}
+
+int EosAdimec::HandleSetIntegrationTime(const std::vector<std::string>& vStrArgs)
+{
+    int nStatus=UNIX_ERROR_STATUS;
+    std::string strItCmd, strResp;
+    
+    nStatus=SetIntegrationTime(vStrArgs[1],strItCmd);
+
+    if(nStatus==UNIX_OK_STATUS)
+    {
+        PdvSerialWriteSetting(strItCmd);
+
+        nStatus = PdvSerialRead(strResp); 
+        if(nStatus!=UNIX_OK_STATUS)
+            AbandonFrameSettings();
+    }
+
+    if(nStatus==UNIX_OK_STATUS)
+    {
+        m_frameSettings.nIntegrationTime=boost::lexical_cast<int>(vStrArgs[1]);
+        UpdateFrameSettings();
+        ShipToSCIP(EosResp::INT_TIME,vStrArgs[1]);
+        ShipSettingsVersion();
+    }
+    else
+    {
+        ShipToSCIP(EosResp::ERRORSETTINGIT,"1-4000");
+    }
+
+    return nStatus;
+}
+
+int EosAdimec::HandleGetTemperature(const std::vector<std::string>& vStrArgs)
+{
+    int nStatus = UNIX_ERROR_STATUS;
+    std::string strResp;
+    std::string strGetTempCmd, strTempResp;
+
+    try
+    {
+        strGetTempCmd="@TM?";
+        PdvSerialWrite(strGetTempCmd);
+
+        nStatus = PdvSerialRead(strResp); 
+        strTempResp=strResp;
+    }
+    catch(...)
+    {
+        nStatus=UNIX_ERROR_STATUS;
+    }
+
+    if(nStatus!=UNIX_OK_STATUS)
+    {
+        ShipToSCIP("ERROR_GETTING_TEMP","");
+    }
+    else
+    {
+        ShipToSCIP("TEMP",strTempResp);
+    }
+    return nStatus;
+}
+
+int EosAdimec::HandleGetPixelCorrect(const std::vector<std::string>& vStrArgs)
+{
+    int nStatus = UNIX_ERROR_STATUS;
+    std::string strResp;
+    std::string strGetPixCmd,strGetNumPixCmd;
+    std::string strPixResp,strNumPixResp;
+
+    try{
+        strGetPixCmd="@DPE?";
+        PdvSerialWrite(strGetPixCmd);
+
+        std::vector<char> vBuff;
+        int nLength=0;
+        nStatus = PdvSerialRead(strResp); 
+        strPixResp=strResp;
+
+        strGetNumPixCmd="@DP?0";
+        PdvSerialWrite(strGetNumPixCmd);
+
+        nStatus=PdvSerialRead(strResp); 
+        strNumPixResp=strResp;
+    }
+    catch(...)
+    {
+        nStatus=UNIX_ERROR_STATUS;
+    }
+    if(nStatus!=UNIX_OK_STATUS)
+    {
+        ShipToSCIP("ERROR_GETTING_PIXC","");
+    }
+    else
+    {
+        ShipToSCIP("PIXCORRECT",strPixResp);
+        ShipToSCIP("NUMPIXCORRECT",strNumPixResp);
+    }
+    return nStatus;
+}
+
+int EosAdimec::HandleSetAgCorrect(const std::vector<std::string>& vStrArgs)
+{
+    int nStatus = UNIX_ERROR_STATUS;
+    std::string strResp;
+    std::string strSetAgCmd, strAgResp;
+    
+    try
+    {
+        std::string strAgCorrect=vStrArgs.at(1);
+        int nAgCorrect=boost::lexical_cast<int>(strAgCorrect);
+        if((nAgCorrect<-2047)||(nAgCorrect>2047))
+        {
+            ShipToSCIP("ERROR_SETTING_AGCORRECT","-2047-2047");
+            return UNIX_ERROR_STATUS;
+        }
+        strSetAgCmd="@AG"+strAgCorrect;
+        PdvSerialWrite(strSetAgCmd);
+
+        nStatus = PdvSerialRead(strResp); // Clear out Adimec buffer
+        strAgResp=strResp;
+    }
+    catch(...)
+    {
+        nStatus= UNIX_ERROR_STATUS;
+    }
+    if(nStatus!=UNIX_OK_STATUS)
+    {
+        ShipToSCIP("ERROR_SETTING_AGCORRECT","-2047-2047");
+    }
+    else
+    {
+        ShipToSCIP("AGCORRECT",strAgResp);
+    }
+
+    return nStatus;
+}
+
+int EosAdimec::HandleGetAgCorrect(const std::vector<std::string>& vStrArgs)
+{
+    int nStatus = UNIX_ERROR_STATUS;
+    std::string strResp;
+    std::string strGetAgCmd;
+    std::string strAgResp;
+
+    try
+    {
+        strGetAgCmd="@AG?";
+        PdvSerialWrite(strGetAgCmd);
+
+        nStatus = PdvSerialRead(strResp); 
+        strAgResp=strResp;
+    }
+    catch(...)
+    {
+        nStatus=UNIX_ERROR_STATUS;
+    }
+    if(nStatus!=UNIX_OK_STATUS)
+    {
+        ShipToSCIP("ERROR_GETTING_AGCORRECT","");
+    }
+    else
+    {
+        ShipToSCIP("AGCORRECT",strAgResp);
+    }
+    return nStatus;
+}
+
+int EosAdimec::HandleSetPixelCorrect(const std::vector<std::string>& vStrArgs)
+{
+    int nStatus = UNIX_ERROR_STATUS;
+    std::string strResp;
+    std::string strGetPixCmd, strPixResp;
+    
+    try
+    {
+        std::string strPixMode=vStrArgs.at(1);
+        if((strPixMode!="0")&&(strPixMode!="1"))
+        {
+            ShipToSCIP("ERROR_GETPIXC","0-1");
+            return UNIX_ERROR_STATUS;
+        }
+        strGetPixCmd="@DPE"+strPixMode;
+        PdvSerialWrite(strGetPixCmd);
+
+        nStatus = PdvSerialRead(strResp); // Clear out Adimec buffer
+        strPixResp=strResp;
+    }
+    catch(...)
+    {
+        ShipToSCIP("ERROR_GETTING_PIXC","");
+        nStatus=UNIX_ERROR_STATUS;
+    }
+    if(nStatus!=UNIX_OK_STATUS)
+    {
+        ShipToSCIP("ERROR_GETTING_PIXC","");
+    }
+    else
+    {
+        ShipToSCIP("PIXCORRECT",strPixResp);
+    }
+    return nStatus;
+}
+
+int EosAdimec::HandleGetImageFormat(const std::vector<std::string>& vStrArgs)
+{
+    int nStatus = UNIX_ERROR_STATUS;
+
+    std::string strGetImgFmtCmd;
+    std::string strResp;
+    std::string strImgFmtResp;
+
+    
+    
+    try
+    {
+        strGetImgFmtCmd="@FM?";
+        PdvSerialWrite(strGetImgFmtCmd);
+
+        nStatus = PdvSerialRead(strResp); 
+        strImgFmtResp=strResp;
+    }
+    catch(...)
+    {
+        nStatus=UNIX_ERROR_STATUS;
+    }
+    if(nStatus!=UNIX_OK_STATUS)
+    {
+        ShipToSCIP("ERROR_GETTING_IMGFMT","");
+    }
+    else
+    {
+        std::vector<std::string> vStrImgFmtResp0,vStrImgFmtResp;
+        
+        boost::split(vStrImgFmtResp0,strImgFmtResp,boost::is_any_of("@;+"));
+
+        // Tokenize the adimec FMx;y;z response to get x,y,z
+        for(auto & ivec:vStrImgFmtResp0)
+        {
+            // Get rid of zero-length tokens
+            if(ivec.size()>0)
+            {
+                vStrImgFmtResp.push_back(ivec);
+                std::cout<<__FUNCTION__<<"(): ivec="<<ivec<<std::endl;
+
+            }
+        }
+        if(vStrImgFmtResp.size()>=1)
+        {
+            // Need to reformat with "," delimiters
+            ShipToSCIP("IMGFMT",vStrImgFmtResp.at(0));
+        }
+    }
+    return nStatus;
+}
+
+int EosAdimec::HandleSetImageFormat(const std::vector<std::string>& vStrArgs)
+{
+    int nStatus = UNIX_ERROR_STATUS;
+    std::string strResp;
+    std::string strSetImgFmtCmd, strImgFmtResp;
+
+    std::string strImgFmtX;
+    std::string strImgFmtY;
+    std::string strImgFmtZ;
+
+    if(vStrArgs.size()>=4)
+    {
+        strImgFmtX=vStrArgs.at(1); // Vertical Image offset
+        strImgFmtY=vStrArgs.at(2); // Vertical Image size 
+        strImgFmtZ=vStrArgs.at(3); // Vertical binning factor
+    }
+    else
+    {
+        return UNIX_ERROR_STATUS;
+    }
+
+    
+    try
+    {
+        strImgFmtX=vStrArgs.at(1); // Vertical Image offset
+        strImgFmtY=vStrArgs.at(2); // Vertical Image size 
+        strImgFmtZ=vStrArgs.at(3); // Vertical binning factor
+        int nImgFmtX=boost::lexical_cast<int>(strImgFmtX);
+
+        // Vertical offset must be even # scans
+        if((nImgFmtX % 2) != 0)
+        {
+            nImgFmtX+=1;
+            strImgFmtX=boost::lexical_cast<std::string>(nImgFmtX);
+        }
+        
+        int nImgFmtY=boost::lexical_cast<int>(strImgFmtY);
+        if(nImgFmtY<128)
+        {
+            nImgFmtY=128;
+            strImgFmtY=boost::lexical_cast<std::string>(nImgFmtY);
+        }
+        
+        int nImgFmtZ=boost::lexical_cast<int>(strImgFmtZ);
+
+        strSetImgFmtCmd="FM"+strImgFmtX+";"+strImgFmtY+";"+strImgFmtZ;
+        PdvSerialWriteSetting(strSetImgFmtCmd);
+
+        nStatus = PdvSerialRead(strResp);
+        strImgFmtResp=strResp;
+
+        if(nStatus==UNIX_OK_STATUS)
+        {
+            m_frameSettings.nImgFmtOffset=nImgFmtX;
+            m_frameSettings.nImgFmtLines=nImgFmtY;
+            m_frameSettings.nImgFmtBinning=nImgFmtZ;
+            UpdateFrameSettings();
+        }
+        else
+        {
+            AbandonFrameSettings();
+        }
+    }
+    catch(...)
+    {
+        nStatus= UNIX_ERROR_STATUS;
+    }
+    if(nStatus!=UNIX_OK_STATUS)
+    {
+        ShipToSCIP("ERROR_SETTING_IMGFMT","-2047-2047");
+    }
+    else
+    {
+        ShipToSCIP("IMGFMT",strImgFmtResp);
+        ShipSettingsVersion();
+    }
+
+    return nStatus;
+}
+
+// One STATS[subsystem,name=value,...] line per subsystem, so that no line
+// outgrows the reply buffer however many stages are on.
+int EosAdimec::HandleGetStats(const std::vector<std::string>& vStrArgs)
+{
+    char cBuf[BUFLEN+1];
+    ::memset(cBuf,'\0',BUFLEN);
+
+    if(m_pOutputQueue)
+    {
+        EosAdimecOutputQueue::OutputQueueStats outqStats=m_pOutputQueue->GetStats();
+        ::snprintf(cBuf,BUFLEN-1,
+                   "outq_depth=%lu,outq_hwm=%lu,outq_written=%lu,outq_writes=%lu,"
+                   "outq_tlm_dropped=%lu,outq_reply_dropped=%lu,outq_stalls=%lu",
+                   (unsigned long)outqStats.nDepth,(unsigned long)outqStats.nHighWater,
+                   outqStats.nWritten,outqStats.nWriteCalls,outqStats.nTelemetryDropped,
+                   outqStats.nRepliesDropped,outqStats.nStalls);
+        ShipToSCIP("STATS",std::string("outq,")+cBuf);
+    }
+    else
+    {
+        ShipToSCIP("STATS","outq,outq=off");
+    }
+
+    ::snprintf(cBuf,BUFLEN-1,"async,async_pending=%lu,stale_cached=%lu,stale_timeout=%lu",
+               (unsigned long)GetAsyncPending(),m_nStaleFromCache,m_nStaleTimeouts);
+    ShipToSCIP("STATS",cBuf);
+
+    if(m_pCapture)
+    {
+        EosAdimecCapture::CaptureStats capStats=m_pCapture->GetStats();
+        ::snprintf(cBuf,BUFLEN-1,
+                   "capture,cap_source=%s,cap_running=%d,cap_frames=%lu,cap_fps=%.1f,"
+                   "cap_timeouts=%lu,cap_overruns=%lu,cap_dropped=%lu,cap_errors=%lu",
+                   m_pCapture->GetSourceName().c_str(),capStats.bRunning ? 1 : 0,
+                   capStats.nFrames,capStats.dFps,capStats.nTimeouts,
+                   capStats.nOverruns,capStats.nDropped,capStats.nErrors);
+        ShipToSCIP("STATS",cBuf);
+    }
+    else
+    {
+        ShipToSCIP("STATS","capture,capture=off");
+    }
+
+    if(m_pVideoOutput)
+    {
+        EosAdimecVideoOutput::VideoOutputStats videoStats=m_pVideoOutput->GetStats();
+        ::snprintf(cBuf,BUFLEN-1,
+                   "video,video_format=%s,video_reader=%d,video_converted=%lu,video_written=%lu,"
+                   "video_dropped=%lu,video_errors=%lu,video_convert_ms=%.2f",
+                   EosAdimecYuv::FormatName(m_pVideoOutput->GetFormat()).c_str(),
+                   videoStats.bReaderConnected ? 1 : 0,videoStats.nConverted,
+                   videoStats.nWritten,videoStats.nDropped,videoStats.nErrors,
+                   videoStats.dConvertMs);
+        ShipToSCIP("STATS",std::string(cBuf)+",video_tonemap="+
+                   EosAdimecToneMap::CurveName(m_pVideoOutput->GetToneParams().eCurve));
+    }
+
+    if(m_pFrameRing)
+    {
+        EosAdimecFrameRing::FrameRingStats ringStats=m_pFrameRing->GetStats();
+        ::snprintf(cBuf,BUFLEN-1,
+                   "ring,ring_readers=%lu,ring_published=%lu,ring_skipped=%lu,ring_too_big=%lu",
+                   (unsigned long)ringStats.nReaders,ringStats.nPublished,
+                   ringStats.nSkipped,ringStats.nTooBig);
+        ShipToSCIP("STATS",cBuf);
+    }
+
+    if(m_pRecorder)
+    {
+        EosAdimecRecorder::RecorderStats recStats=m_pRecorder->GetStats();
+        ::snprintf(cBuf,BUFLEN-1,"recorder,rec_span_s=%.1f,rec_skipped=%lu,rec_saving=%d",
+                   recStats.dSpanSec,recStats.nSkipped,recStats.bSaving ? 1 : 0);
+        ShipToSCIP("STATS",cBuf);
+    }
+
+    if(m_pSnapshot)
+    {
+        EosAdimecSnapshot::SnapshotStats snapStats=m_pSnapshot->GetStats();
+        ::snprintf(cBuf,BUFLEN-1,"snapshot,snap_taken=%lu,snap_failed=%lu,snap_ms=%.1f",
+                   snapStats.nTaken,snapStats.nFailed,snapStats.dEncodeMs);
+        ShipToSCIP("STATS",cBuf);
+    }
+
+    if(m_pPreview)
+    {
+        EosAdimecPreview::PreviewStats prevStats=m_pPreview->GetStats();
+        ::snprintf(cBuf,BUFLEN-1,"preview,prev_published=%lu,prev_ms=%.2f",
+                   prevStats.nPublished,prevStats.dMs);
+        ShipToSCIP("STATS",cBuf);
+    }
+
+    if(m_pArchive)
+    {
+        EosAdimecArchive::ArchiveStats arcStats=m_pArchive->GetStats();
+        ::snprintf(cBuf,BUFLEN-1,"archive,arc_frames=%lu,arc_staged=%lu,arc_skipped=%lu",
+                   arcStats.nFrames,arcStats.nStaged,arcStats.nSkipped);
+        ShipToSCIP("STATS",cBuf);
+    }
+
+    if(m_pCorrection)
+    {
+        EosAdimecCorrection::CorrectionStats corStats=m_pCorrection->GetStats();
+        ::snprintf(cBuf,BUFLEN-1,"correction,cor_on=%d,cor_uncorrected=%lu,cor_ms=%.2f",
+                   corStats.bEnable ? 1 : 0,corStats.nUncorrected,corStats.dApplyMs);
+        ShipToSCIP("STATS",cBuf);
+    }
+
+    if(m_pTileExecutor)
+    {
+        EosAdimecTileExecutor::ExecutorStats tileStats=m_pTileExecutor->GetStats();
+        ::snprintf(cBuf,BUFLEN-1,"tile,tile_workers=%d,tile_pinned=%d,tile_jobs=%lu,tile_stolen=%lu,"
+                   "tile_ms=%.2f",tileStats.nWorkers,tileStats.nPinned,tileStats.nJobs,
+                   tileStats.nStolen,tileStats.dJobMs);
+        ShipToSCIP("STATS",cBuf);
+    }
+
+    if(m_pCapture)
+    {
+        EosAdimecFramePool::BudgetStats budget=EosAdimecFramePool::GetBudgetStats();
+        unsigned long nPoolFailed=0;
+        for(auto & ixPool: EosAdimecFramePool::GetAllStats())
+            nPoolFailed+=ixPool.nFailed;
+        ::snprintf(cBuf,BUFLEN-1,"pool,pool_mb=%lu,pool_free_mb=%lu,pool_failed=%lu",
+                   (unsigned long)(budget.nPoolBytes>>20),
+                   (unsigned long)(EosAdimecFramePool::GetFreeBytes()>>20),nPoolFailed);
+        ShipToSCIP("STATS",cBuf);
+    }
+
+    // thr_<role>=<policy>:<priority>:<cpus>, as the role's threads really run
+    std::string strThreads="threads";
+    int nThreadFailed=0;
+    for(int irole=0; irole<EosAdimecThreadPlacement::NUM_ROLES; irole++)
+    {
+        EosAdimecThreadPlacement::E_ROLE eRole=(EosAdimecThreadPlacement::E_ROLE)irole;
+        EosAdimecThreadPlacement::Effective effective=EosAdimecThreadPlacement::GetEffective(eRole);
+        if(0==effective.nThreads)
+            continue;
+        ::snprintf(cBuf,BUFLEN-1,",thr_%s=%s:%d:%s",
+                   EosAdimecThreadPlacement::RoleName(eRole).c_str(),
+                   EosAdimecThreadPlacement::PolicyName(effective.ePolicy).c_str(),
+                   effective.nPriority,effective.strCpus.c_str());
+        strThreads+=cBuf;
+        nThreadFailed+=effective.nFailed;
+    }
+    ::snprintf(cBuf,BUFLEN-1,",thr_failed=%d",nThreadFailed);
+    strThreads+=cBuf;
+    ShipToSCIP("STATS",strThreads);
+
+    if(m_pSeqPacketServer)
+    {
+        ::snprintf(cBuf,BUFLEN-1,"scip,scip_clients=%lu",
+                   (unsigned long)m_pSeqPacketServer->GetNumClients());
+        ShipToSCIP("STATS",cBuf);
+    }
+
+    return UNIX_OK_STATUS;
+}
+
+// AE[0|1], AE_TARGET[pct], AE_ROI[x,y,w,h] or AE_RATE[hz]; the values are
+// checked here, the loop picks them up on its next iteration.
+int EosAdimec::HandleSetAutoExposure(const std::vector<std::string>& vStrArgs)
+{
+    const std::string& strCmd=vStrArgs[0];
+    const std::string strResp=strCmd.substr(4);     // SET_AE_ROI --> AE_ROI
+    const std::string strError="ERROR_SETTING_"+strResp;
+
+    if(NULL==m_pAutoExposure)
+    {
+        ShipToSCIP(strError,"capture_enable=0");
+        return UNIX_ERROR_STATUS;
+    }
+
+    EosAdimecAutoExposure::AeParams params=m_pAutoExposure->GetParams();
+    std::vector<int> vnValues;
+    try
+    {
+        for(size_t iarg=1; iarg<vStrArgs.size(); iarg++)
+            vnValues.push_back(boost::lexical_cast<int>(vStrArgs[iarg]));
+    }
+    catch(...)
+    {
+        vnValues.clear();
+    }
+
+    std::string strRange;
+    bool bOk=false;
+    if(strCmd=="SET_AE")
+    {
+        strRange="0,1";
+        bOk=(1==vnValues.size()) && ((0==vnValues[0]) || (1==vnValues[0]));
+        if(bOk)
+            params.bEnable=(1==vnValues[0]);
+    }
+    else if(strCmd=="SET_AE_TARGET")
+    {
+        strRange="1-99";
+        bOk=(1==vnValues.size()) && (vnValues[0]>=1) && (vnValues[0]<=99);
+        if(bOk)
+            params.nTargetPct=vnValues[0];
+    }
+    else if(strCmd=="SET_AE_ROI")
+    {
+        strRange="x,y,w,h >= 0";
+        bOk=(4==vnValues.size()) && (*std::min_element(vnValues.begin(),vnValues.end())>=0);
+        if(bOk)
+        {
+            params.nRoiX=vnValues[0];
+            params.nRoiY=vnValues[1];
+            params.nRoiW=vnValues[2];
+            params.nRoiH=vnValues[3];
+        }
+    }
+    else
+    {
+        strRange="1-100";
+        bOk=(1==vnValues.size()) && (vnValues[0]>=1) && (vnValues[0]<=100);
+        if(bOk)
+            params.nRateHz=vnValues[0];
+    }
+
+    if(!bOk)
+    {
+        ShipToSCIP(strError,strRange);
+        return UNIX_ERROR_STATUS;
+    }
+
+    m_pAutoExposure->SetParams(params);
+
+    std::string strValue=vStrArgs[1];
+    for(size_t iarg=2; iarg<vStrArgs.size(); iarg++)
+        strValue+=","+vStrArgs[iarg];
+    ShipToSCIP(strResp,strValue);
+
+    return UNIX_OK_STATUS;
+}
+
+// AE[enable=..,target=..,roi_x=..,...,converged=..,mean=..,saturated=..,it=..,gain=..,...]
+int EosAdimec::HandleGetAutoExposure(const std::vector<std::string>& vStrArgs)
+{
+    if(NULL==m_pAutoExposure)
+    {
+        ShipToSCIP("AE","capture=off");
+        return UNIX_OK_STATUS;
+    }
+
+    EosAdimecAutoExposure::AeParams params=m_pAutoExposure->GetParams();
+    EosAdimecAutoExposure::AeStatus status=m_pAutoExposure->GetStatus();
+
+    char cBuf[BUFLEN+1];
+    ::memset(cBuf,'\0',BUFLEN);
+    ::snprintf(cBuf,BUFLEN-1,
+               "enable=%d,target=%d,roi_x=%d,roi_y=%d,roi_w=%d,roi_h=%d,rate=%d,"
+               "converged=%d,mean=%.1f,saturated=%.1f,it=%d,gain=%d,"
+               "iterations=%lu,commands=%lu,errors=%lu",
+               params.bEnable ? 1 : 0,params.nTargetPct,params.nRoiX,params.nRoiY,
+               params.nRoiW,params.nRoiH,params.nRateHz,status.bConverged ? 1 : 0,
+               status.dMeanPct,status.dSaturatedPct,status.nIntegrationTime,status.nGain,
+               status.nIterations,status.nCommands,status.nErrors);
+    ShipToSCIP("AE",cBuf);
+
+    return UNIX_OK_STATUS;
+}
+
+// AWB_ONCE[STARTED] now; OnAutoWhiteBalanceDone() reports the outcome.
+int EosAdimec::HandleAutoWhiteBalanceOnce(const std::vector<std::string>& vStrArgs)
+{
+    if(NULL==m_pAutoWhiteBalance)
+    {
+        ShipToSCIP("ERROR_AWB_ONCE","capture_enable=0");
+        return UNIX_ERROR_STATUS;
+    }
+
+    m_pAutoWhiteBalance->RunOnce();
+    ShipToSCIP("AWB_ONCE","STARTED");
+
+    return UNIX_OK_STATUS;
+}
+
+// AWB[mode], AWB_METHOD[method], AWB_HYST[pct] or AWB_RATE[hz]
+int EosAdimec::HandleSetAutoWhiteBalance(const std::vector<std::string>& vStrArgs)
+{
+    const std::string& strCmd=vStrArgs[0];
+    const std::string strResp=strCmd.substr(4);     // SET_AWB_HYST --> AWB_HYST
+    const std::string strError="ERROR_SETTING_"+strResp;
+
+    if(NULL==m_pAutoWhiteBalance)
+    {
+        ShipToSCIP(strError,"capture_enable=0");
+        return UNIX_ERROR_STATUS;
+    }
+
+    EosAdimecAutoWhiteBalance::AwbParams params=m_pAutoWhiteBalance->GetParams();
+    const std::string strValue=boost::to_lower_copy(vStrArgs[1]);
+    int nValue=-1;
+    try
+    {
+        nValue=boost::lexical_cast<int>(strValue);
+    }
+    catch(...)
+    {
+        nValue=-1;
+    }
+
+    std::string strRange;
+    bool bOk=false;
+    if(strCmd=="SET_AWB")
+    {
+        // A once run is started with AWB_ONCE[]
+        strRange="off,continuous";
+        EosAdimecAutoWhiteBalance::E_AWB_MODE eMode;
+        bOk=EosAdimecAutoWhiteBalance::ModeFromString(strValue,eMode) &&
+            (EosAdimecAutoWhiteBalance::eAwbOnce!=eMode);
+        if(bOk)
+            params.eMode=eMode;
+    }
+    else if(strCmd=="SET_AWB_METHOD")
+    {
+        strRange="gray_world,white_patch";
+        bOk=EosAdimecAutoWhiteBalance::MethodFromString(strValue,params.eMethod);
+    }
+    else if(strCmd=="SET_AWB_HYST")
+    {
+        strRange="1-50";
+        bOk=(nValue>=1) && (nValue<=50);
+        if(bOk)
+            params.nHysteresisPct=nValue;
+    }
+    else
+    {
+        strRange="1-100";
+        bOk=(nValue>=1) && (nValue<=100);
+        if(bOk)
+            params.nRateHz=nValue;
+    }
+
+    if(!bOk)
+    {
+        ShipToSCIP(strError,strRange);
+        return UNIX_ERROR_STATUS;
+    }
+
+    m_pAutoWhiteBalance->SetParams(params);
+    ShipToSCIP(strResp,strValue);
+
+    return UNIX_OK_STATUS;
+}
+
+// AWB[mode=..,method=..,hyst=..,rate=..,converged=..,g_r=..,g_b=..,quads=..,r=..,g=..,b=..,...]
+int EosAdimec::HandleGetAutoWhiteBalance(const std::vector<std::string>& vStrArgs)
+{
+    if(NULL==m_pAutoWhiteBalance)
+    {
+        ShipToSCIP("AWB","capture=off");
+        return UNIX_OK_STATUS;
+    }
+
+    EosAdimecAutoWhiteBalance::AwbParams params=m_pAutoWhiteBalance->GetParams();
+    EosAdimecAutoWhiteBalance::AwbStatus status=m_pAutoWhiteBalance->GetStatus();
+
+    char cBuf[BUFLEN+1];
+    ::memset(cBuf,'\0',BUFLEN);
+    ::snprintf(cBuf,BUFLEN-1,
+               "mode=%s,method=%s,hyst=%d,rate=%d,converged=%d,g_r=%.3f,g_b=%.3f,"
+               "quads=%lu,r=%d,g=%d,b=%d,iterations=%lu,commands=%lu,errors=%lu",
+               EosAdimecAutoWhiteBalance::ModeName(params.eMode).c_str(),
+               EosAdimecAutoWhiteBalance::MethodName(params.eMethod).c_str(),
+               params.nHysteresisPct,params.nRateHz,status.bConverged ? 1 : 0,
+               status.dRedError,status.dBlueError,status.nQuads,status.anRgb[0],
+               status.anRgb[1],status.anRgb[2],status.nIterations,status.nCommands,
+               status.nErrors);
+    ShipToSCIP("AWB",cBuf);
+
+    return UNIX_OK_STATUS;
+}
+
+// FRAME_STATS[seq=..,...] (latest), FRAME_STATS[r|g|b,seq,c0,...,c31]
+// (one channel's histogram, 8 bins summed per value), or
+// FRAME_STATS[none] before the first result.
+int EosAdimec::HandleGetFrameStats(const std::vector<std::string>& vStrArgs)
+{
+    if(NULL==m_pFrameStats)
+    {
+        ShipToSCIP("FRAME_STATS",(NULL==m_pCapture) ? "capture=off" : "frame_stats_enable=0");
+        return UNIX_OK_STATUS;
+    }
+
+    int nChannel=-1;
+    if(vStrArgs.size()>1)
+    {
+        const std::string strChannel=boost::to_lower_copy(vStrArgs[1]);
+        if(strChannel=="r")
+            nChannel=EosAdimecFrameStats::eChannelRed;
+        else if(strChannel=="g")
+            nChannel=EosAdimecFrameStats::eChannelGreen;
+        else if(strChannel=="b")
+            nChannel=EosAdimecFrameStats::eChannelBlue;
+        else
+        {
+            ShipToSCIP("ERROR_FRAME_STATS","r,g,b");
+            return UNIX_ERROR_STATUS;
+        }
+    }
+
+    EosAdimecFrameStats::FrameStats stats;
+    if(!m_pFrameStats->GetLatest(stats))
+    {
+        ShipToSCIP("FRAME_STATS","none");
+        return UNIX_OK_STATUS;
+    }
+
+    if(nChannel<0)
+    {
+        ShipToSCIP("FRAME_STATS",FormatFrameStats(stats));
+        return UNIX_OK_STATUS;
+    }
+
+    const int nGroup=EosAdimecFrameStats::HIST_BINS/32;
+    const EosAdimecFrameStats::ChannelStats& chan=stats.aChannels[nChannel];
+    std::string strHist=boost::to_lower_copy(vStrArgs[1])+","+
+                        boost::lexical_cast<std::string>(stats.nSequence);
+    for(int ibin=0; ibin<EosAdimecFrameStats::HIST_BINS; ibin+=nGroup)
+    {
+        uint64_t nCount=0;
+        for(int igroup=0; igroup<nGroup; igroup++)
+            nCount+=chan.anHist[ibin+igroup];
+        strHist+=","+boost::lexical_cast<std::string>(nCount);
+    }
+    ShipToSCIP("FRAME_STATS",strHist);
+
+    return UNIX_OK_STATUS;
+}
+
+// FRAME_STATS_DECIMATION[n] or FRAME_STATS_PUSH[ms]
+int EosAdimec::HandleSetFrameStats(const std::vector<std::string>& vStrArgs)
+{
+    const std::string& strCmd=vStrArgs[0];
+    const std::string strResp=strCmd.substr(4);     // SET_FRAME_STATS_PUSH --> FRAME_STATS_PUSH
+    const std::string strError="ERROR_SETTING_"+strResp;
+
+    if(NULL==m_pFrameStats)
+    {
+        ShipToSCIP(strError,(NULL==m_pCapture) ? "capture_enable=0" : "frame_stats_enable=0");
+        return UNIX_ERROR_STATUS;
+    }
+
+    int nValue=-1;
+    try
+    {
+        nValue=boost::lexical_cast<int>(boost::trim_copy(vStrArgs[1]));
+    }
+    catch(...)
+    {
+        nValue=-1;
+    }
+
+    if(strCmd=="SET_FRAME_STATS_DECIMATION")
+    {
+        if((nValue<1) || (nValue>10000))
+        {
+            ShipToSCIP(strError,"1-10000");
+            return UNIX_ERROR_STATUS;
+        }
+        m_pFrameStats->SetDecimation(nValue);
+    }
+    else
+    {
+        if((nValue<0) || (nValue>3600000))
+        {
+            ShipToSCIP(strError,"0-3600000");
+            return UNIX_ERROR_STATUS;
+        }
+        m_pFrameStats->SetPushMs(nValue);
+    }
+
+    ShipToSCIP(strResp,boost::lexical_cast<std::string>(nValue));
+
+    return UNIX_OK_STATUS;
+}
+
+// FOCUS[seq=..,version=..,changing=..,method=..,score=..,roi=x;y;w;h,ms=..],
+// or FOCUS[none] before the first score.
+int EosAdimec::HandleGetFocus(const std::vector<std::string>& vStrArgs)
+{
+    if(NULL==m_pFocus)
+    {
+        ShipToSCIP("FOCUS",(NULL==m_pCapture) ? "capture=off" : "focus_enable=0");
+        return UNIX_OK_STATUS;
+    }
+
+    EosAdimecFocus::FocusResult result;
+    if(!m_pFocus->GetLatest(result))
+    {
+        ShipToSCIP("FOCUS","none");
+        return UNIX_OK_STATUS;
+    }
+
+    ShipToSCIP("FOCUS",FormatFocus(result));
+
+    return UNIX_OK_STATUS;
+}
+
+// FOCUS_METHOD[method], FOCUS_ROI[x,y,w,h] or FOCUS_PUSH[0|1]
+int EosAdimec::HandleSetFocus(const std::vector<std::string>& vStrArgs)
+{
+    const std::string& strCmd=vStrArgs[0];
+    const std::string strResp=strCmd.substr(4);     // SET_FOCUS_ROI --> FOCUS_ROI
+    const std::string strError="ERROR_SETTING_"+strResp;
+
+    if(NULL==m_pFocus)
+    {
+        ShipToSCIP(strError,(NULL==m_pCapture) ? "capture_enable=0" : "focus_enable=0");
+        return UNIX_ERROR_STATUS;
+    }
+
+    EosAdimecFocus::FocusParams params=m_pFocus->GetParams();
+    std::vector<std::string> vStrValues(vStrArgs.begin()+1,vStrArgs.end());
+    for(auto & istr: vStrValues)
+        istr=boost::to_lower_copy(boost::trim_copy(istr));
+
+    std::vector<int> vnValues;
+    try
+    {
+        for(auto & istr: vStrValues)
+            vnValues.push_back(boost::lexical_cast<int>(istr));
+    }
+    catch(...)
+    {
+        vnValues.clear();
+    }
+
+    std::string strRange;
+    bool bOk=false;
+    if(strCmd=="SET_FOCUS_METHOD")
+    {
+        strRange="tenengrad,laplacian";
+        bOk=EosAdimecFocus::MethodFromString(vStrValues[0],params.eMethod);
+    }
+    else if(strCmd=="SET_FOCUS_ROI")
+    {
+        strRange="x,y,w,h >= 0";
+        bOk=(4==vnValues.size()) && (*std::min_element(vnValues.begin(),vnValues.end())>=0);
+        if(bOk)
+        {
+            params.nRoiX=vnValues[0];
+            params.nRoiY=vnValues[1];
+            params.nRoiW=vnValues[2];
+            params.nRoiH=vnValues[3];
+        }
+    }
+    else
+    {
+        strRange="0,1";
+        bOk=(1==vnValues.size()) && ((0==vnValues[0]) || (1==vnValues[0]));
+        if(bOk)
+            params.bPush=(1==vnValues[0]);
+    }
+
+    if(!bOk)
+    {
+        ShipToSCIP(strError,strRange);
+        return UNIX_ERROR_STATUS;
+    }
+
+    m_pFocus->SetParams(params);
+    ShipToSCIP(strResp,boost::join(vStrValues,","));
+
+    return UNIX_OK_STATUS;
+}
+
+// TRIGGER_SAVE[STARTED,id,pre_frames,path] now; OnRecorderSaveDone()
+// reports the outcome.
+int EosAdimec::HandleTriggerSave(const std::vector<std::string>& vStrArgs)
+{
+    if(NULL==m_pRecorder)
+    {
+        ShipToSCIP("ERROR_TRIGGER_SAVE",(NULL==m_pCapture) ? "capture_enable=0" : "recorder_enable=0");
+        return UNIX_ERROR_STATUS;
+    }
+
+    double dPreSec=-1.0, dPostSec=-1.0;
+    try
+    {
+        dPreSec=boost::lexical_cast<double>(boost::trim_copy(vStrArgs[1]));
+        dPostSec=boost::lexical_cast<double>(boost::trim_copy(vStrArgs[2]));
+    }
+    catch(...)
+    {
+        dPreSec=-1.0;
+    }
+
+    if((dPreSec<0.0) || (dPreSec>m_EosAdimecConfigInfo.nRecorderSeconds) ||
+       (dPostSec<0.0) || (dPostSec>m_EosAdimecConfigInfo.nRecorderMaxPostS))
+    {
+        char cBuf[BUFLEN+1];
+        ::memset(cBuf,'\0',BUFLEN);
+        ::snprintf(cBuf,BUFLEN-1,"pre_s 0-%d,post_s 0-%d",m_EosAdimecConfigInfo.nRecorderSeconds,
+                   m_EosAdimecConfigInfo.nRecorderMaxPostS);
+        ShipToSCIP("ERROR_TRIGGER_SAVE",cBuf);
+        return UNIX_ERROR_STATUS;
+    }
+
+    uint64_t nTriggerId=0;
+    std::string strPath, strError;
+    unsigned long nPreFrames=0;
+    if(UNIX_OK_STATUS!=m_pRecorder->TriggerSave(dPreSec,dPostSec,nTriggerId,strPath,
+                                                nPreFrames,strError))
+    {
+        ShipToSCIP("ERROR_TRIGGER_SAVE",strError);
+        return UNIX_ERROR_STATUS;
+    }
+
+    char cBuf[BUFLEN+1];
+    ::memset(cBuf,'\0',BUFLEN);
+    ::snprintf(cBuf,BUFLEN-1,"STARTED,%llu,%lu,%s",(unsigned long long)nTriggerId,nPreFrames,
+               strPath.c_str());
+    ShipToSCIP("TRIGGER_SAVE",cBuf);
+
+    return UNIX_OK_STATUS;
+}
+
+// RECORDER[slots=..,max_slots=..,span_s=..,mb=..,recorded=..,skipped=..,...]
+int EosAdimec::HandleGetRecorder(const std::vector<std::string>& vStrArgs)
+{
+    if(NULL==m_pRecorder)
+    {
+        ShipToSCIP("RECORDER",(NULL==m_pCapture) ? "capture=off" : "recorder_enable=0");
+        return UNIX_OK_STATUS;
+    }
+
+    EosAdimecRecorder::RecorderStats stats=m_pRecorder->GetStats();
+
+    char cBuf[BUFLEN+1];
+    ::memset(cBuf,'\0',BUFLEN);
+    ::snprintf(cBuf,BUFLEN-1,
+               "slots=%d,max_slots=%d,held=%d,span_s=%.2f,mb=%lu,recorded=%lu,skipped=%lu,"
+               "too_big=%lu,saving=%d,saves=%lu,save_errors=%lu",
+               stats.nSlots,stats.nMaxSlots,stats.nHeld,stats.dSpanSec,
+               (unsigned long)(stats.nBytes>>20),stats.nRecorded,stats.nSkipped,stats.nTooBig,
+               stats.bSaving ? 1 : 0,stats.nSaves,stats.nSaveErrors);
+    ShipToSCIP("RECORDER",cBuf);
+
+    return UNIX_OK_STATUS;
+}
+
+// SNAPSHOT[STARTED,id] now; OnSnapshotDone() reports the outcome.
+int EosAdimec::HandleSnapshot(const std::vector<std::string>& vStrArgs)
+{
+    if(NULL==m_pSnapshot)
+    {
+        ShipToSCIP("ERROR_SNAPSHOT",(NULL==m_pCapture) ? "capture_enable=0" : "snapshot_enable=0");
+        return UNIX_ERROR_STATUS;
+    }
+
+    EosAdimecSnapshot::E_FORMAT eFormat;
+    if(!EosAdimecSnapshot::FormatFromString(vStrArgs[1],eFormat))
+    {
+        ShipToSCIP("ERROR_SNAPSHOT","png|jpeg");
+        return UNIX_ERROR_STATUS;
+    }
+
+    // Triggered: the camera leaves streaming until OnSnapshotDone().
+    bool bTriggered=!m_EosAdimecConfigInfo.strSnapshotTriggerMode.empty();
+    bool bTriggerWritten=false;
+    if(bTriggered && !m_pSnapshot->GetStats().bBusy)
+    {
+        std::string strResp;
+        PdvSerialWrite(m_EosAdimecConfigInfo.strSnapshotTriggerMode);
+        bTriggerWritten=true;
+        if(UNIX_OK_STATUS!=PdvSerialRead(strResp))
+        {
+            RestoreSnapshotStreamMode();
+            ShipToSCIP("ERROR_SNAPSHOT","trigger_mode");
+            return UNIX_ERROR_STATUS;
+        }
+    }
+
+    uint64_t nId=0;
+    std::string strError;
+    if(UNIX_OK_STATUS!=m_pSnapshot->Request(eFormat,bTriggered,nId,strError))
+    {
+        if(bTriggerWritten)
+            RestoreSnapshotStreamMode();
+        std::replace(strError.begin(),strError.end(),' ','_');
+        ShipToSCIP("ERROR_SNAPSHOT",strError);
+        return UNIX_ERROR_STATUS;
+    }
+
+    // OnSnapshotDone() can't run before this: it needs m_mtxDispatch.
+    m_eSnapshotRoute=m_eReplyRoute;
+    m_nSnapshotClientFd=m_nReplyClientFd;
+    m_strSnapshotTag=m_strReplyTag;
+
+    char cBuf[BUFLEN+1];
+    ::memset(cBuf,'\0',BUFLEN);
+    ::snprintf(cBuf,BUFLEN-1,"STARTED,%llu",(unsigned long long)nId);
+    ShipToSCIP("SNAPSHOT",cBuf);
+
+    return UNIX_OK_STATUS;
+}
+
+// PREVIEW[levels=2;4;8,size=800x600;400x300;200x150,format=..,decimation=..,
+// published=..,skipped=..,ms=..,shm=..]; size is 0x0 before the first preview.
+int EosAdimec::HandleGetPreview(const std::vector<std::string>& vStrArgs)
+{
+    if(NULL==m_pPreview)
+    {
+        ShipToSCIP("PREVIEW",(NULL==m_pCapture) ? "capture=off" : "preview_enable=0");
+        return UNIX_OK_STATUS;
+    }
+
+    EosAdimecPreview::PreviewStats stats=m_pPreview->GetStats();
+    const std::vector<int>& vnScales=m_pPreview->GetScales();
+
+    std::string strLevels, strSizes;
+    for(size_t ilevel=0; ilevel<vnScales.size(); ilevel++)
+    {
+        if(ilevel)
+        {
+            strLevels+=";";
+            strSizes+=";";
+        }
+        strLevels+=boost::lexical_cast<std::string>(vnScales[ilevel]);
+        strSizes+=boost::lexical_cast<std::string>(stats.anWidth[ilevel])+"x"+
+                  boost::lexical_cast<std::string>(stats.anHeight[ilevel]);
+    }
+
+    char cBuf[BUFLEN+1];
+    ::memset(cBuf,'\0',BUFLEN);
+    ::snprintf(cBuf,BUFLEN-1,
+               "levels=%s,size=%s,format=%s,decimation=%d,published=%lu,skipped=%lu,"
+               "ms=%.2f,shm=%s",
+               strLevels.c_str(),strSizes.c_str(),
+               EosAdimecYuv::FormatName(m_pPreview->GetFormat()).c_str(),stats.nDecimation,
+               stats.nPublished,stats.nSkipped,stats.dMs,
+               m_EosAdimecConfigInfo.strPreviewShmName.c_str());
+    ShipToSCIP("PREVIEW",cBuf);
+
+    return UNIX_OK_STATUS;
+}
+
+// PREVIEW_DECIMATION[n]
+int EosAdimec::HandleSetPreview(const std::vector<std::string>& vStrArgs)
+{
+    if(NULL==m_pPreview)
+    {
+        ShipToSCIP("ERROR_SETTING_PREVIEW_DECIMATION",
+                   (NULL==m_pCapture) ? "capture_enable=0" : "preview_enable=0");
+        return UNIX_ERROR_STATUS;
+    }
+
+    int nValue=-1;
+    try
+    {
+        nValue=boost::lexical_cast<int>(boost::trim_copy(vStrArgs[1]));
+    }
+    catch(...)
+    {
+        nValue=-1;
+    }
+    if((nValue<1) || (nValue>10000))
+    {
+        ShipToSCIP("ERROR_SETTING_PREVIEW_DECIMATION","1-10000");
+        return UNIX_ERROR_STATUS;
+    }
+
+    m_pPreview->SetDecimation(nValue);
+    ShipToSCIP("PREVIEW_DECIMATION",boost::lexical_cast<std::string>(nValue));
+
+    return UNIX_OK_STATUS;
+}
+
+// ARCHIVE[on=1,dir=..,segments=..,frames=..,mb=..,staged=..,skipped=..,...]
+// or ARCHIVE[on=0]
+int EosAdimec::HandleGetArchive(const std::vector<std::string>& vStrArgs)
+{
+    if(NULL==m_pArchive)
+    {
+        ShipToSCIP("ARCHIVE",(NULL==m_pCapture) ? "on=0,capture=off" : "on=0");
+        return UNIX_OK_STATUS;
+    }
+
+    EosAdimecArchive::ArchiveStats stats=m_pArchive->GetStats();
+
+    char cBuf[BUFLEN+1];
+    ::memset(cBuf,'\0',BUFLEN);
+    ::snprintf(cBuf,BUFLEN-1,
+               "on=1,dir=%s,segments=%lu,frames=%lu,mb=%llu,staged=%lu,skipped=%lu,too_big=%lu,"
+               "direct=%d,full=%d,failed=%d,flush_ms=%.1f",
+               stats.strDir.c_str(),stats.nSegments,stats.nFrames,
+               (unsigned long long)(stats.nBytes>>20),stats.nStaged,stats.nSkipped,stats.nTooBig,
+               stats.bDirect ? 1 : 0,stats.bFull ? 1 : 0,stats.bFailed ? 1 : 0,stats.dFlushMs);
+    ShipToSCIP("ARCHIVE",cBuf);
+
+    return UNIX_OK_STATUS;
+}
+
+// ARCHIVE[1,dir] (a new archive) or ARCHIVE[0]
+int EosAdimec::HandleSetArchive(const std::vector<std::string>& vStrArgs)
+{
+    const std::string strValue=boost::trim_copy(vStrArgs[1]);
+
+    if(NULL==m_pCapture)
+    {
+        ShipToSCIP("ERROR_SETTING_ARCHIVE","capture_enable=0");
+        return UNIX_ERROR_STATUS;
+    }
+    if((strValue!="0") && (strValue!="1"))
+    {
+        ShipToSCIP("ERROR_SETTING_ARCHIVE","0-1");
+        return UNIX_ERROR_STATUS;
+    }
+
+    if(strValue=="0")
+    {
+        StopArchive();
+        ShipToSCIP("ARCHIVE","0");
+        return UNIX_OK_STATUS;
+    }
+
+    if(!m_pPipeline->HasStage(EosAdimecPipeline::eStageArchive))
+    {
+        ShipToSCIP("ERROR_SETTING_ARCHIVE","not_in_pipeline");
+        return UNIX_ERROR_STATUS;
+    }
+    if((NULL==m_pArchive) && (UNIX_OK_STATUS!=StartArchive()))
+    {
+        ShipToSCIP("ERROR_SETTING_ARCHIVE","start_failed");
+        return UNIX_ERROR_STATUS;
+    }
+    ShipToSCIP("ARCHIVE","1,"+m_pArchive->GetStats().strDir);
+
+    return UNIX_OK_STATUS;
+}
+
+// CAPTURE_DARK[STARTED,n] now; OnCorrectionCaptureDone() reports the
+// outcome.  Same for CAPTURE_FLAT.
+int EosAdimec::HandleCaptureReference(const std::vector<std::string>& vStrArgs)
+{
+    const bool bFlat=(vStrArgs[0]=="CAPTURE_FLAT");
+    const std::string strResp=bFlat ? "CAPTURE_FLAT" : "CAPTURE_DARK";
+
+    if(NULL==m_pCorrection)
+    {
+        ShipToSCIP("ERROR_"+strResp,"capture_enable=0");
+        return UNIX_ERROR_STATUS;
+    }
+
+    int nFrames=0;
+    try
+    {
+        nFrames=boost::lexical_cast<int>(boost::trim_copy(vStrArgs[1]));
+    }
+    catch(...)
+    {
+        nFrames=0;
+    }
+
+    if((nFrames<1) || (nFrames>m_EosAdimecConfigInfo.nCorrectionMaxFrames))
+    {
+        ShipToSCIP("ERROR_"+strResp,"1-"+std::to_string(m_EosAdimecConfigInfo.nCorrectionMaxFrames));
+        return UNIX_ERROR_STATUS;
+    }
+
+    std::string strError;
+    if(UNIX_OK_STATUS!=m_pCorrection->BeginCapture(bFlat ? EosAdimecCorrection::eKindFlat :
+                                                   EosAdimecCorrection::eKindDark,
+                                                   nFrames,strError))
+    {
+        ShipToSCIP("ERROR_"+strResp,strError);
+        return UNIX_ERROR_STATUS;
+    }
+    ShipToSCIP(strResp,"STARTED,"+std::to_string(nFrames));
+
+    return UNIX_OK_STATUS;
+}
+
+// CORRECTION[on=..,darks=..,flats=..,mb=..,bucket=..,dark=..,flat=..,...]
+int EosAdimec::HandleGetCorrection(const std::vector<std::string>& vStrArgs)
+{
+    if(NULL==m_pCorrection)
+    {
+        ShipToSCIP("CORRECTION","on=0,capture=off");
+        return UNIX_OK_STATUS;
+    }
+
+    EosAdimecCorrection::CorrectionStats stats=m_pCorrection->GetStats();
+
+    char cBuf[BUFLEN+1];
+    ::memset(cBuf,'\0',BUFLEN);
+    ::snprintf(cBuf,BUFLEN-1,
+               "on=%d,darks=%lu,flats=%lu,mb=%.1f,bucket=%s,dark=%s,flat=%s,"
+               "corrected=%lu,uncorrected=%lu,ms=%.2f,capturing=%s,captured=%d/%d",
+               stats.bEnable ? 1 : 0,(unsigned long)stats.nDarks,(unsigned long)stats.nFlats,
+               (double)stats.nBytes/(1<<20),stats.strBucket.c_str(),stats.strDark.c_str(),
+               stats.strFlat.c_str(),stats.nCorrected,stats.nUncorrected,stats.dApplyMs,
+               stats.bCapturing ? EosAdimecCorrection::KindName(stats.eCapturing).c_str() : "none",
+               stats.nCaptured,stats.nCaptureFrames);
+    ShipToSCIP("CORRECTION",cBuf);
+
+    return UNIX_OK_STATUS;
+}
+
+// CORRECTION[0|1]
+int EosAdimec::HandleSetCorrection(const std::vector<std::string>& vStrArgs)
+{
+    const std::string strValue=boost::trim_copy(vStrArgs[1]);
+
+    if(NULL==m_pCorrection)
+    {
+        ShipToSCIP("ERROR_SETTING_CORRECTION","capture_enable=0");
+        return UNIX_ERROR_STATUS;
+    }
+    if((strValue!="0") && (strValue!="1"))
+    {
+        ShipToSCIP("ERROR_SETTING_CORRECTION","0-1");
+        return UNIX_ERROR_STATUS;
+    }
+
+    m_pCorrection->SetEnable(strValue=="1");
+    ShipToSCIP("CORRECTION",strValue);
+
+    return UNIX_OK_STATUS;
+}
+
+// TONEMAP[curve], TONEMAP_GAMMA[g], TONEMAP_LOG[a], TONEMAP_GAIN[g] or
+// TONEMAP_BLACK[pct]
+int EosAdimec::HandleSetToneMap(const std::vector<std::string>& vStrArgs)
+{
+    const std::string& strCmd=vStrArgs[0];
+    const std::string strResp=strCmd.substr(4);     // SET_TONEMAP_GAIN --> TONEMAP_GAIN
+    const std::string strError="ERROR_SETTING_"+strResp;
+
+    if(NULL==m_pVideoOutput)
+    {
+        ShipToSCIP(strError,(NULL==m_pCapture) ? "capture_enable=0" : "video_output_enable=0");
+        return UNIX_ERROR_STATUS;
+    }
+
+    EosAdimecToneMap::ToneParams params=m_pVideoOutput->GetToneParams();
+    const std::string strValue=boost::to_lower_copy(boost::trim_copy(vStrArgs[1]));
+    double dValue=-1.0;
+    try
+    {
+        dValue=boost::lexical_cast<double>(strValue);
+    }
+    catch(...)
+    {
+        dValue=-1.0;
+    }
+
+    std::string strRange;
+    bool bOk=false;
+    if(strCmd=="SET_TONEMAP")
+    {
+        strRange="off,linear,gamma,log,equalize";
+        bOk=EosAdimecToneMap::CurveFromString(strValue,params.eCurve);
+    }
+    else if(strCmd=="SET_TONEMAP_GAMMA")
+    {
+        strRange="1-5";
+        bOk=(dValue>=1.0) && (dValue<=5.0);
+        if(bOk)
+            params.dGamma=dValue;
+    }
+    else if(strCmd=="SET_TONEMAP_LOG")
+    {
+        strRange="1-10000";
+        bOk=(dValue>=1.0) && (dValue<=10000.0);
+        if(bOk)
+            params.dLogStrength=dValue;
+    }
+    else if(strCmd=="SET_TONEMAP_GAIN")
+    {
+        strRange="0.1-64";
+        bOk=(dValue>=0.1) && (dValue<=64.0);
+        if(bOk)
+            params.dGain=dValue;
+    }
+    else
+    {
+        strRange="0-50";
+        bOk=(dValue>=0.0) && (dValue<=50.0);
+        if(bOk)
+            params.dBlackPct=dValue;
+    }
+
+    if(!bOk)
+    {
+        ShipToSCIP(strError,strRange);
+        return UNIX_ERROR_STATUS;
+    }
+
+    m_pVideoOutput->SetToneParams(params);
+    ShipToSCIP(strResp,strValue);
+
+    return UNIX_OK_STATUS;
+}
+
+// TONEMAP[curve=..,gamma=..,log=..,gain=..,black=..,bits=..,builds=..,build_ms=..,resets=..]
+int EosAdimec::HandleGetToneMap(const std::vector<std::string>& vStrArgs)
+{
+    if(NULL==m_pVideoOutput)
+    {
+        ShipToSCIP("TONEMAP",(NULL==m_pCapture) ? "capture=off" : "video_output_enable=0");
+        return UNIX_OK_STATUS;
+    }
+
+    EosAdimecToneMap::ToneParams params=m_pVideoOutput->GetToneParams();
+    EosAdimecToneMap::ToneStats stats=m_pVideoOutput->GetToneStats();
+
+    char cBuf[BUFLEN+1];
+    ::memset(cBuf,'\0',BUFLEN);
+    ::snprintf(cBuf,BUFLEN-1,
+               "curve=%s,gamma=%.2f,log=%.1f,gain=%.2f,black=%.1f,bits=%d,builds=%lu,"
+               "build_ms=%.3f,resets=%lu",
+               EosAdimecToneMap::CurveName(params.eCurve).c_str(),params.dGamma,
+               params.dLogStrength,params.dGain,params.dBlackPct,stats.nBitDepth,stats.nBuilds,
+               stats.dBuildMs,stats.nResets);
+    ShipToSCIP("TONEMAP",cBuf);
+
+    return UNIX_OK_STATUS;
+}
+
+// PIPELINE[stage:input:frames:fps:ms,...] for the stages in the graph
+// (frames 0 for one that did not start), or PIPELINE[capture=off]
+int EosAdimec::HandleGetPipeline(const std::vector<std::string>& vStrArgs)
+{
+    if(NULL==m_pPipeline)
+    {
+        ShipToSCIP("PIPELINE","capture=off");
+        return UNIX_OK_STATUS;
+    }
+
+    std::vector<EosAdimecPipeline::StageStats> vStats=m_pPipeline->GetStats();
+
+    std::string strPipeline;
+    char cBuf[BUFLEN+1];
+    for(auto & ixStage: vStats)
+    {
+        ::memset(cBuf,'\0',BUFLEN);
+        ::snprintf(cBuf,BUFLEN-1,"%s%s:%s:%lu:%.1f:%.2f",strPipeline.empty() ? "" : ",",
+                   EosAdimecPipeline::StageName(ixStage.eStage).c_str(),
+                   EosAdimecPipeline::InputName(ixStage.nInput).c_str(),ixStage.nFrames,
+                   ixStage.dFps,ixStage.dMs);
+        strPipeline+=cBuf;
+    }
+    ShipToSCIP("PIPELINE",strPipeline);
+
+    return UNIX_OK_STATUS;
+}
+
+// FRAME_POOLS[budget_mb=..,free_mb=..,reserved_mb=..,refused=..,
+//             name:slots:in_use:high_water:failed:mb:huge:locked,...]
+int EosAdimec::HandleGetFramePools(const std::vector<std::string>& vStrArgs)
+{
+    if(NULL==m_pCapture)
+    {
+        ShipToSCIP("FRAME_POOLS","capture=off");
+        return UNIX_OK_STATUS;
+    }
+
+    EosAdimecFramePool::BudgetStats budget=EosAdimecFramePool::GetBudgetStats();
+    std::vector<EosAdimecFramePool::PoolStats> vStats=EosAdimecFramePool::GetAllStats();
+
+    char cBuf[BUFLEN+1];
+    ::memset(cBuf,'\0',BUFLEN);
+    ::snprintf(cBuf,BUFLEN-1,"budget_mb=%lu,free_mb=%lu,reserved_mb=%lu,refused=%lu",
+               (unsigned long)(budget.nBudgetBytes>>20),
+               (unsigned long)(EosAdimecFramePool::GetFreeBytes()>>20),
+               (unsigned long)(budget.nReservedBytes>>20),budget.nRefused);
+    std::string strPools=cBuf;
+    for(auto & ixPool: vStats)
+    {
+        ::memset(cBuf,'\0',BUFLEN);
+        ::snprintf(cBuf,BUFLEN-1,",%s:%d:%d:%d:%lu:%.1f:%d:%d",ixPool.strName.c_str(),
+                   ixPool.nSlots,ixPool.nInUse,ixPool.nHighWater,ixPool.nFailed,
+                   ixPool.nBytes/1048576.0,ixPool.bHugePages ? 1 : 0,ixPool.bLocked ? 1 : 0);
+        strPools+=cBuf;
+    }
+    ShipToSCIP("FRAME_POOLS",strPools);
+
+    return UNIX_OK_STATUS;
+}
+
+// FIRST_FRAME[N,sequence,wall_time,ack_to_frame_ms], FIRST_FRAME[N,PENDING]
+// or FIRST_FRAME[N,UNKNOWN] (not issued, too old, or capture off)
+int EosAdimec::HandleGetFirstFrame(const std::vector<std::string>& vStrArgs)
+{
+    uint32_t nVersion=0;
+    try
+    {
+        nVersion=boost::lexical_cast<uint32_t>(vStrArgs[1]);
+    }
+    catch(...)
+    {
+        ShipToSCIP(EosResp::ARGERROR,"");
+        return UNIX_ERROR_STATUS;
+    }
+
+    char cBuf[BUFLEN+1];
+    ::memset(cBuf,'\0',BUFLEN);
+
+    EosAdimecSettingsTracker::FirstFrameInfo info;
+    EosAdimecSettingsTracker::E_FIRST_FRAME eResult=EosAdimecSettingsTracker::eFirstFrameUnknown;
+    if(m_pSettingsTracker)
+        eResult=m_pSettingsTracker->GetFirstFrame(nVersion,info);
+
+    if(EosAdimecSettingsTracker::eFirstFrameFound==eResult)
+    {
+        ::snprintf(cBuf,BUFLEN-1,"%u,%llu,%lld.%06ld,%.3f",nVersion,
+                   (unsigned long long)info.nSequence,(long long)info.tsWall.tv_sec,
+                   (long)(info.tsWall.tv_nsec/1000),
+                   ((double)info.nTimeNs-(double)info.nAckNs)/1.0e6);
+    }
+    else
+    {
+        ::snprintf(cBuf,BUFLEN-1,"%u,%s",nVersion,
+                   (EosAdimecSettingsTracker::eFirstFramePending==eResult) ? "PENDING" : "UNKNOWN");
+    }
+
+    ShipToSCIP("FIRST_FRAME",cBuf);
+
+    return UNIX_OK_STATUS;
+}
+
+// Return an index value for the baudrate
+int EosAdimec::BaudRate2Id (int nBaudRate)
+{
+    switch(nBaudRate)
+    {
+        case 9600:
+            return CL_BAUDRATE_9600;
+        case 19200:
+            return CL_BAUDRATE_19200;
+        case 38400:
+            return CL_BAUDRATE_38400;
+        case 57600:
+            return CL_BAUDRATE_57600;
+        case 115200:
+            return CL_BAUDRATE_115200;
+        case 230400:
+            return CL_BAUDRATE_230400;
+        case 460800:
+            return CL_BAUDRATE_460800;
+        case 921600:
+            return CL_BAUDRATE_921600;
+        default:
+            return 0;
+    }
+}
+
+
+/**
+   Diagnostic function to check the response messages from the camera
+*/
+void EosAdimec::PrintAdimecResponse(char cBuff[],int nLength){
+    for (int i=0;i<nLength;i++){
+        if(cBuff[i]==AACK){
+            printf("<ACK> ");
+        }
+        else if(cBuff[i]==ANAK){
+            printf("<NAK> ");
+        }
+        else if(cBuff[i]==ASTX){
+            printf("<STX> ");
+        }
+        else if(cBuff[i]==AETX){
+            printf("<ETX> ");
+        }
+        else{
+            printf("%c ",cBuff[i]);
+        }
+    }
+}
+
+
+/**
+   Strips out transmission flags and changes message delimiters into a form that can 
+   be sent on through to SCIP. Device response will be stored in strResp
+*/
+int EosAdimec::ComposeDevResp(const char cBuff[]/*input*/, int nLength/*input*/,
+                              std::string& strResp/*output*/)
+{
+    int nStatus = UNIX_ERROR_STATUS;
+
+    printf ("%s\r\n",cBuff);
+    for (int i=0;i<nLength;i++){
+        if(cBuff[i]==AACK){
+            nStatus=UNIX_OK_STATUS;
+        }
+        else if(cBuff[i]==ANAK){
+            nStatus=UNIX_ERROR_STATUS;
+        }
+        else if(cBuff[i]==ASTX){
+        }
+        else if(cBuff[i]==AETX){
+        }
+        else if(cBuff[i]=='+'){
+        }
+        else if(cBuff[i]==';'){
+            strResp+=',';
+        }
+        else{
+            strResp+=cBuff[i];
+        }
+    }
+    return nStatus;
+    
+}
+
+
+
+/**
+   Validates that new Offset value is in the correct range and also checks that 
+   it exceeds the minimum value based on the current gain setting and output resolution. 
+
+   The manual for the Adimec provides a formula to calculate a dynamic offset but the 
+   usable domain of the function is incredibly small for the range of values we would 
+   provide it. The domain goes negative in less than 2 one/hundreths of a gain setting. 
+   Therefore we have set the minimum offset value to the ceiling of possible minimum 
+   offset values. The formula and preset values are presented here for future reference. 
+   
+   Formula:
+   Minimum Offset >= OutputResolutionScalar *(100- CurrentGain) + (20*CurrentGain)/100
+   Formula provided by Adimec operating and technical manual. 
+
+   OutputResolutionScalars:
+   12 bits = 40.95
+   10 bits = 10.23
+   8 bits = 255
+*/
+int EosAdimec::ValidateOffset(int nTempOffset){
+    int nMinOffset=20;
+    if((nTempOffset>=nMinOffset && nTempOffset<=4095)){
+        return UNIX_OK_STATUS;
+    } 
+    return UNIX_ERROR_STATUS;    
+}
+
+
+/**
+   Checks that the received White Balance RGB values are within an acceptable range. 
+   Also sets the RGB values of the internal Adimec struct
+*/
+int EosAdimec::ValidateRGB(const std::vector<std::string>& vStrArgs){
+    int nStatus=UNIX_ERROR_STATUS;
+    int nTempRGB;
+    try{
+        for(int i=1;i<4;i++){
+            nTempRGB=boost::lexical_cast<int>(vStrArgs[i]);
+            if(nTempRGB<100||nTempRGB>399){
+                nStatus=UNIX_ERROR_STATUS;
+                break;
+            }
+            m_pAdimec->strRGB[i-1]=vStrArgs[i];
+            nStatus=UNIX_OK_STATUS;
+        }
+    }
+    catch(...){
+        return UNIX_ERROR_STATUS;
+    }
+    return nStatus;
+}
+
+// Validate frame period setting.
+int EosAdimec::ValidateFramePeriod(int nFramePeriod){
+    int nMinFramePeriod=1;
+    int nMaxFramePeriod=4000;
+    if((nFramePeriod>=nMinFramePeriod && nFramePeriod<=nMaxFramePeriod)){
+        return UNIX_OK_STATUS;
+    } 
+    return UNIX_ERROR_STATUS;    
+}
+
+// Validate frame integration time
+int EosAdimec::ValidateIntegrationTime(int nIntegrationTime){
+    if((nIntegrationTime>=MIN_INTEGRATION_TIME && nIntegrationTime<=MAX_INTEGRATION_TIME)){
+        return UNIX_OK_STATUS;
+    } 
+    return UNIX_ERROR_STATUS;    
+}
+
+/**
+   Method to formulate and send messages up to SCIP. Takes a string as the 
+   command that will be sent as well as a string that contains the message value.
+   sample SCIP msg: pp500|<strMsg>[<strValue>]
+*/
+void EosAdimec::ShipToSCIP(std::string strMsg, std::string strValue){
+    
+    // Ship the SCIP message up to the remote client;
+    ShipRawToSCIP(FormatScipMsg(strMsg,strValue));
+}
+
+std::string EosAdimec::FormatScipMsg(const std::string& strMsg, const std::string& strValue) const
+{
+    char cBuf[BUFLEN+1]; // More than big enough
+    ::memset(cBuf,'\0',BUFLEN);
+
+    ::snprintf(cBuf,BUFLEN-1,
+               "SS%3.3d|%s[%s]\n",
+               m_nAdimecId,strMsg.c_str(),strValue.c_str());
+
+    return std::string(cBuf);
+}
+
+void EosAdimec::PushToSCIP(const std::string& strMsg, const std::string& strValue)
+{
+    const std::string strScipMsg=FormatScipMsg(strMsg,strValue);
+
+    if(m_pOutputQueue)
+    {
+        SendToSCIP(strScipMsg,eReplyRouteDefault,-1);
+        return;
+    }
+
+    // Synchronous output shares the transports with the command replies.
+    boost::lock_guard<boost::recursive_mutex> lock(m_mtxDispatch);
+    SendToSCIP(strScipMsg,eReplyRouteDefault,-1);
+
+    return;
+}
+
+/**
+   Route a formatted SCIP message: replies go back the way the command
+   came in; unsolicited messages go out on the configured transport.
+*/
+int EosAdimec::ShipRawToSCIP(const std::string& strMsgIn)
+{
+    // Replies to a tagged command carry its tag; unsolicited messages don't.
+    const std::string strMsg=
+        (m_strReplyTag.empty() || (eReplyRouteDefault==m_eReplyRoute)) ?
+        strMsgIn : TagScipMessage(strMsgIn,m_strReplyTag);
+
+    // Keep the untagged response of a query for stale-query answers.
+    if(m_bCaptureQuery && (eReplyRouteDefault!=m_eReplyRoute))
+        m_strQueryCapture+=strMsgIn;
+
+    return SendToSCIP(strMsg,m_eReplyRoute,m_nReplyClientFd);
+}
+
+int EosAdimec::SendToSCIP(const std::string& strMsg, const E_REPLY_ROUTE eRoute,
+                          const int nClientFd)
+{
+    // Queued output: never blocks the caller.
+    if(m_pOutputQueue)
+    {
+        int nChannelId=EosAdimecOutputQueue::PIPE_CHANNEL_ID;
+        switch(eRoute)
+        {
+            case eReplyRouteSocket:
+                nChannelId=nClientFd;
+                break;
+            case eReplyRouteDefault:
+                // Unsolicited: the SCIP main (pipe) and every socket client
+                m_pOutputQueue->Broadcast(strMsg,EosAdimecOutputQueue::eMsgTelemetry);
+                return UNIX_OK_STATUS;
+            case eReplyRoutePipe:
+            default:
+                break;
+        }
+
+        // Replies are never dropped while their channel exists; this
+        // fails only if the client has gone away.
+        if(UNIX_OK_STATUS!=m_pOutputQueue->Enqueue(nChannelId,strMsg,
+                                                   EosAdimecOutputQueue::eMsgReply))
+        {
+            std::cerr<<__FUNCTION__<<"(): reply not queued, channel "<<nChannelId
+                     <<" is gone: "<<strMsg;
+            return UNIX_ERROR_STATUS;
+        }
+        return UNIX_OK_STATUS;
+    }
+
+    // Synchronous output (scip_output_queue_depth=0)
+    switch(eRoute)
+    {
+        case eReplyRouteSocket:
+            if(m_pSeqPacketServer)
+                return m_pSeqPacketServer->Send(nClientFd,strMsg);
+            return UNIX_ERROR_STATUS;
+        case eReplyRouteDefault:
+            if(m_pSeqPacketServer)
+                m_pSeqPacketServer->Broadcast(strMsg);
+            break;
+        case eReplyRoutePipe:
+        default:
+            break;
+    }
+
+    if(m_pPipeComms!=NULL)
+        m_pPipeComms->Write(strMsg);
+
+    return UNIX_OK_STATUS;
+}
+
+// "SS002|GAIN[500]\n" --> "SS002|GAIN[500]#17\n" (each line of a multi-line message)
+std::string EosAdimec::TagScipMessage(const std::string& strMsg, const std::string& strTag)
+{
+    const std::string strSuffix=std::string(1,REPLY_TAG_PREFIX)+strTag;
+
+    std::string strTagged;
+    size_t nStart=0;
+    size_t nEol;
+    while((nEol=strMsg.find('\n',nStart))!=std::string::npos)
+    {
+        std::string strLine=strMsg.substr(nStart,nEol-nStart);
+        boost::trim_right(strLine);
+        strTagged+=strLine+strSuffix+"\n";
+        nStart=nEol+1;
+    }
+    if(nStart<strMsg.size())
+        strTagged+=boost::trim_right_copy(strMsg.substr(nStart))+strSuffix;
+
+    return strTagged;
+}
+
+/**
+   Sets the device command and SCIP response message when a setting is queried. 
+   Determines which setting to query based off of the 4th letter in the SCIP command. All 
+   SCIP query commands follow this form:
+   GET<CAMERASETTING> with current choices being:
+   GAIN,RGB,OFFSET
+   If support for more settings is needed than the switch statement might need to change to
+   a more robust method like a map. 
+*/
+int EosAdimec::GetLevel(const char cValue,std::string& strCmd, std::string& strResp){
+    int nStatus=UNIX_OK_STATUS;
+    switch (cValue){
+        case 'G':
+            strCmd="@GA?";
+            strResp=EosResp::GAINPOS;
+            break;
+        case 'R':
+            strCmd="@WB?";
+            strResp=EosResp::RGBPOS;
+            break;
+        case 'O':
+            strCmd="@OFS?";
+            strResp=EosResp::OFFSETPOS;
+            break;
+        default:
+            nStatus=UNIX_ERROR_STATUS;
+    }
+    return nStatus;
+}
+
+/**
+   Compose an Adimec set-rgb command.
+   strArgs contains the r,g,and b values.
+   strNewRgb is the command to be sent to the adimec.
+*/
+int EosAdimec::SetRGBLevel(const std::vector<std::string>& vStrArgs,std::string& strNewRGB){
+    int nStatus=UNIX_ERROR_STATUS;
+    int nValue=0;
+    try{
+        std::vector<std::string> vStrRgb;
+        for(int i=1;i<=3;i++){
+            nValue=boost::lexical_cast<int>(vStrArgs[i]);
+            if(nValue<100||nValue>399){
+                return UNIX_ERROR_STATUS;
+            }
+            vStrRgb.push_back(vStrArgs[i]);
+        }
+        for(int i=1;i<=3;i++){
+            m_pAdimec->strRGB[i-1]=vStrArgs[i];
+        }
+        strNewRGB=WbToCamera(vStrRgb)+"\r\n";
+        nStatus=UNIX_OK_STATUS;
+    }
+    catch(...){
+        return UNIX_ERROR_STATUS;
+    }
+
+    return nStatus;
+}
+
+// "@WBb;g;r" (no terminator) from R,G,B values
+std::string EosAdimec::WbToCamera(const std::vector<std::string>& vStrRgb)
+{
+    std::string strCmd="@WB";
+    for(int i=2;i>=0;i--){
+        strCmd+=vStrRgb.at(i);
+        if(i>0)
+            strCmd+=";";
+    }
+    return strCmd;
+}
+
+// "b,g,r" from @WB? --> R,G,B values.  False if there aren't three.
+bool EosAdimec::WbFromCamera(const std::string& strCamera, std::vector<std::string>& vStrRgb)
+{
+    vStrRgb.clear();
+    if(strCamera.empty())
+        return false;
+
+    std::vector<std::string> vStrBgr;
+    boost::split(vStrBgr,strCamera,boost::is_any_of(","));
+    if(vStrBgr.size()<3)
+        return false;
+
+    vStrRgb.push_back(vStrBgr.at(2));
+    vStrRgb.push_back(vStrBgr.at(1));
+    vStrRgb.push_back(vStrBgr.at(0));
+    return true;
+}
+
+/**
+   Compose an Adimec gain level command.
+   strGainMsg is the command to be sent to the Admec.
+   nTempGain and strGainValue are the gain level (int and string format).
+   nTempGain used to compare with min/max allowable gain levels.
+*/
+int EosAdimec::SetGainLevel(int nTempGain, std::string& strGainMsg,const std::string strGainValue){
+    if(nTempGain>=MIN_GAIN && nTempGain<=MAX_GAIN){
+        m_pAdimec->strGain=strGainValue;
+        strGainMsg = "@GA"+strGainValue;
+        return UNIX_OK_STATUS;
+    }
+    return UNIX_ERROR_STATUS;
+    
+}
+
+
+int EosAdimec::SetResolution(int nTempResolution, std::string& strResolutionMsg, const std::string strResolutionValue){
+    if(nTempResolution ==8 ||nTempResolution==10||nTempResolution==12){
+        m_pAdimec->strOutputRes=strResolutionValue;
+        strResolutionMsg = "@OR"+std::to_string(nTempResolution);
+        return UNIX_OK_STATUS;
+    }
+    return UNIX_ERROR_STATUS;
+}
+
+/**
+   Compose an Adimec set-offset command.
+   strNewValue is the new offset value.
+   strOffsetCmd is the set-offset command to be sent to the Adimec.
+*/
+int EosAdimec::SetOffsetLevel(const std::string& strNewValue, std::string& strOffsetCmd){
+    try{
+        int nTempOffset=boost::lexical_cast<int>(strNewValue);
+        if(ValidateOffset(nTempOffset)==UNIX_OK_STATUS){
+            strOffsetCmd="@OFS"+strNewValue;
+            m_pAdimec->strOffset=strNewValue;
+            return UNIX_OK_STATUS;
+        }
+    }
+    catch(...){
+        return UNIX_ERROR_STATUS;
+    }
+    return UNIX_ERROR_STATUS;
+}
+
+// Valid frame period values 1-4000
+int EosAdimec::SetFramePeriod(const std::string& strNewValue, std::string& strOffsetCmd){
+    try{
+        int nTempFp=boost::lexical_cast<int>(strNewValue);
+        if(ValidateFramePeriod(nTempFp)==UNIX_OK_STATUS){
+            strOffsetCmd="@FP"+strNewValue;
+            m_pAdimec->strFramePeriod=strNewValue;
+            return UNIX_OK_STATUS;
+        }
+    }
+    catch(...){
+        return UNIX_ERROR_STATUS;
+    }
+    return UNIX_ERROR_STATUS;
+}
+
+// Valid integration time values 1-4000
+int EosAdimec::SetIntegrationTime(const std::string& strNewValue, std::string& strItCmd){
+    try{
+        int nTempIt=boost::lexical_cast<int>(strNewValue);
+        if(ValidateIntegrationTime(nTempIt)==UNIX_OK_STATUS){
+            strItCmd="@IT"+strNewValue;
+            m_pAdimec->strIntegrationTime=strNewValue;
+            return UNIX_OK_STATUS;
+        }
+    }
+    catch(...){
+        return UNIX_ERROR_STATUS;
+    }
+    return UNIX_ERROR_STATUS;
+}
+
+
+int EosAdimec::PdvSerialWrite(const std::string& strCmdIn)
+{
+    int nStatus;
+    if(m_pSerialComms)
+    {
+        // Adimec needs newline termination
+        std::string strCmd=strCmdIn+"\r\n";
+        m_nSerialWriteNs=EosAdimecUtil::MonotonicNs();
+        nStatus=m_pSerialComms->SerialWrite(strCmd);
+    }
+    else
+        nStatus=UNIX_ERROR_STATUS;
+    return nStatus;
+}
+
+// A SET: the change is pending from now until UpdateFrameSettings()
+// (ACK) or AbandonFrameSettings() (error).
+int EosAdimec::PdvSerialWriteSetting(const std::string& strCmd)
+{
+    int nStatus=PdvSerialWrite(strCmd);
+    if(m_pSettingsTracker)
+        m_pSettingsTracker->BeginChange(m_nSerialWriteNs);
+    return nStatus;
+}
+
+int EosAdimec::PdvSerialRead(std::string& strResp)
+{
+    int nStatus;
+    std::vector<char> vBuff;
+    int nLength=0;
+    strResp="";
+    if(m_pSerialComms)
+    {
+        nStatus=m_pSerialComms->SerialRead(vBuff,nLength); // Clear out Adimec buffer
+        m_nSerialReadNs=EosAdimecUtil::MonotonicNs();
+        strResp.clear();
+        if(UNIX_OK_STATUS==nStatus)
+            ComposeDevResp(vBuff.data(),nLength,strResp);
+    }
+    else
+        nStatus=UNIX_ERROR_STATUS;
+
+    return nStatus;
+}
+
+// ######################## SCIP SOCKET TRANSPORT ##############################
+
+int EosAdimec::StartScipSocketServer(void)
+{
+    if(m_pSocketThread)
+        return UNIX_OK_STATUS; // Already running
+
+    m_pSeqPacketServer=new EosAdimecSeqPacketServer(m_EosAdimecConfigInfo.strScipSocketPath,
+                                                    m_EosAdimecConfigInfo.nScipSocketMaxClients);
+    if(UNIX_OK_STATUS!=m_pSeqPacketServer->Open())
+    {
+        // Carry on with the named pipes only -- don't take down the controller.
+        std::cerr<<__FUNCTION__<<"(): could not open SCIP socket "
+                 <<m_EosAdimecConfigInfo.strScipSocketPath<<std::endl;
+        delete m_pSeqPacketServer;
+        m_pSeqPacketServer=NULL;
+        return UNIX_ERROR_STATUS;
+    }
+
+    if(m_pOutputQueue)
+    {
+        m_pSeqPacketServer->SetClientCallbacks
+            (std::bind(&EosAdimec::OnScipSocketClientAccepted,this,std::placeholders::_1),
+             std::bind(&EosAdimec::OnScipSocketClientDropped,this,std::placeholders::_1));
+        m_pSeqPacketServer->SetReadFilter
+            (std::bind(&EosAdimec::CanReadScipSocketClient,this,std::placeholders::_1));
+    }
+
+    m_abSocketThreadStop=false;
+    m_pSocketThread=new boost::thread(boost::bind(&EosAdimec::ScipSocketServerThread,this));
+
+    return UNIX_OK_STATUS;
+}
+
+void EosAdimec::StopScipSocketServer(void)
+{
+    m_abSocketThreadStop=true;
+    if(m_pSocketThread)
+    {
+        m_pSocketThread->join();
+        delete m_pSocketThread;
+        m_pSocketThread=NULL;
+    }
+
+    boost::lock_guard<boost::recursive_mutex> lock(m_mtxDispatch);
+    if(m_pSeqPacketServer)
+    {
+        // Their fds close with the server; nothing may be queued on them.
+        if(m_pOutputQueue)
+        {
+            std::vector<int> vnClientFds=m_pSeqPacketServer->GetClientFds();
+            for(auto & ifd: vnClientFds)
+                m_pOutputQueue->RemoveChannel(ifd);
+        }
+        delete m_pSeqPacketServer;
+        m_pSeqPacketServer=NULL;
+    }
+
+    return;
+}
+
+// A client that isn't reading its replies doesn't get more commands read.
+bool EosAdimec::CanReadScipSocketClient(int nClientFd)
+{
+    return !m_pOutputQueue->IsReplyBacklogged(nClientFd);
+}
+
+void EosAdimec::OnScipSocketClientAccepted(int nClientFd)
+{
+    m_pOutputQueue->AddChannel(nClientFd,EosAdimecOutputQueue::eChannelPacket,nClientFd);
+    return;
+}
+
+void EosAdimec::OnScipSocketClientDropped(int nClientFd)
+{
+    // Not while a command is replying to this fd: the fd number
+    // may be handed to the next client that connects.
+    boost::lock_guard<boost::recursive_mutex> lock(m_mtxDispatch);
+
+    if(m_pOutputQueue)
+        m_pOutputQueue->RemoveChannel(nClientFd);
+
+    // A snapshot this client asked for ends as an unsolicited message.
+    if((eReplyRouteSocket==m_eSnapshotRoute) && (nClientFd==m_nSnapshotClientFd))
+    {
+        m_eSnapshotRoute=eReplyRouteDefault;
+        m_nSnapshotClientFd=-1;
+    }
+
+    // Nobody is left to hear this client's async completions.
+    boost::lock_guard<boost::mutex> lockAsync(m_mtxAsync);
+    for(std::deque<AsyncCommand>::iterator icmd=m_dqAsyncCommands.begin();
+        icmd!=m_dqAsyncCommands.end();)
+    {
+        if((eReplyRouteSocket==icmd->eReplyRoute) && (nClientFd==icmd->nReplyClientFd))
+            icmd=m_dqAsyncCommands.erase(icmd);
+        else
+            ++icmd;
+    }
+
+    return;
+}
+
+// ######################## ASYNCHRONOUS COMMANDS ##########################
+
+// Called from DispatchCommand() with m_mtxDispatch held.
+int EosAdimec::QueueAsyncCommand(const std::vector<std::string>& vStrCmd,
+                                 const CommandOptions& options)
+{
+    bool bQueued=false;
+    if(m_pAsyncThread)
+    {
+        boost::lock_guard<boost::mutex> lock(m_mtxAsync);
+        if(m_dqAsyncCommands.size()<(size_t)m_EosAdimecConfigInfo.nScipAsyncQueueDepth)
+        {
+            AsyncCommand asyncCmd;
+            asyncCmd.vStrCmd=vStrCmd;
+            asyncCmd.eReplyRoute=m_eReplyRoute;
+            asyncCmd.nReplyClientFd=m_nReplyClientFd;
+            asyncCmd.options=options;
+            asyncCmd.options.bAsync=false;
+            m_dqAsyncCommands.push_back(asyncCmd);
+            bQueued=true;
+        }
+    }
+
+    if(!bQueued)
+    {
+        ShipToSCIP("BUSY",vStrCmd[0]);
+        return UNIX_ERROR_STATUS;
+    }
+
+    // Queued before ACCEPTED goes out, but the worker can't reply
+    // until we release m_mtxDispatch -- so ACCEPTED is always first.
+    ShipToSCIP("ACCEPTED",vStrCmd[0]);
+    m_cvAsync.notify_one();
+
+    return UNIX_OK_STATUS;
+}
+
+int EosAdimec::StartAsyncWorker(void)
+{
+    if(m_pAsyncThread)
+        return UNIX_OK_STATUS;
+
+    m_abAsyncThreadStop=false;
+    m_pAsyncThread=new boost::thread(boost::bind(&EosAdimec::AsyncWorkerThread,this));
+
+    return UNIX_OK_STATUS;
+}
+
+void EosAdimec::StopAsyncWorker(void)
+{
+    {
+        boost::lock_guard<boost::mutex> lock(m_mtxAsync);
+        m_abAsyncThreadStop=true;
+    }
+    m_cvAsync.notify_all();
+
+    if(m_pAsyncThread)
+    {
+        m_pAsyncThread->join();
+        delete m_pAsyncThread;
+        m_pAsyncThread=NULL;
+    }
+
+    // Anything still pending is abandoned at shutdown.
+    boost::lock_guard<boost::mutex> lock(m_mtxAsync);
+    m_dqAsyncCommands.clear();
+
+    return;
+}
+
+// Runs async commands one at a time, in the order accepted, through the
+// same DispatchCommand() path (and serial port lock) as everything else.
+void EosAdimec::AsyncWorkerThread(void)
+{
+    EosAdimecThreadPlacement::Apply(EosAdimecThreadPlacement::eRoleSerial);
+
+    while(true)
+    {
+        AsyncCommand asyncCmd;
+        {
+            boost::unique_lock<boost::mutex> lock(m_mtxAsync);
+            m_bAsyncBusy=false;
+            while(m_dqAsyncCommands.empty() && !m_abAsyncThreadStop)
+                m_cvAsync.wait(lock);
+            if(m_abAsyncThreadStop)
+                break;
+
+            asyncCmd=m_dqAsyncCommands.front();
+            m_dqAsyncCommands.pop_front();
+            m_bAsyncBusy=true;
+        }
+
+        boost::lock_guard<boost::recursive_mutex> lock(m_mtxDispatch);
+
+        E_REPLY_ROUTE eSavedRoute=m_eReplyRoute;
+        int nSavedFd=m_nReplyClientFd;
+        std::string strSavedTag=m_strReplyTag;
+
+        m_eReplyRoute=asyncCmd.eReplyRoute;
+        m_nReplyClientFd=asyncCmd.nReplyClientFd;
+        m_strReplyTag=asyncCmd.options.strReplyTag;
+
+        // The command's responses and its COMPLETE go out together; other
+        // channels are not held meanwhile.
+        const int nChannelId=(eReplyRouteSocket==asyncCmd.eReplyRoute) ?
+            asyncCmd.nReplyClientFd : EosAdimecOutputQueue::PIPE_CHANNEL_ID;
+        if(m_pOutputQueue)
+            m_pOutputQueue->Cork(nChannelId);
+
+        // The deadline still counts from when the command arrived.
+        int nStatus=DispatchParsedCommand(asyncCmd.vStrCmd,asyncCmd.options);
+        ShipToSCIP("COMPLETE",asyncCmd.vStrCmd[0]+
+                   ((UNIX_ERROR_STATUS==nStatus) ? ",ERROR" : ",OK"));
+
+        if(m_pOutputQueue)
+            m_pOutputQueue->Uncork(nChannelId);
+
+        m_eReplyRoute=eSavedRoute;
+        m_nReplyClientFd=nSavedFd;
+        m_strReplyTag=strSavedTag;
+    }
+
+    return;
+}
+
+size_t EosAdimec::GetAsyncPending(void)
+{
+    boost::lock_guard<boost::mutex> lock(m_mtxAsync);
+    return m_dqAsyncCommands.size()+(m_bAsyncBusy ? 1 : 0);
+}
+
+// ######################## FRAME CAPTURE ##################################
+
+int EosAdimec::StartCapture(void)
+{
+    if(m_pCapture)
+        return UNIX_OK_STATUS;
+
+    EosAdimecFrameSource* pSource=NULL;
+    if(m_EosAdimecConfigInfo.strCaptureSource==EosAdimecConfiguration::CAPTURE_SOURCE_SYNTHETIC)
+    {
+        pSource=new EosAdimecFrameSourceSynthetic(m_EosAdimecConfigInfo.nCaptureSynthWidth,
+                                                  m_EosAdimecConfigInfo.nCaptureSynthHeight,
+                                                  m_EosAdimecConfigInfo.nCaptureSynthBitDepth,
+                                                  m_EosAdimecConfigInfo.nCaptureSynthFps,
+                                                  m_EosAdimecConfigInfo.bCaptureSynthRedRowFirst,
+                                                  m_EosAdimecConfigInfo.bCaptureSynthGreenPixelFirst);
+    }
+    else
+    {
+#ifndef _BUILD_NO_EDT_
+        pSource=new EosAdimecFrameSourceEdt(m_EosAdimecConfigInfo.nCaptureEdtUnit,m_nEdtChannel);
+#else
+        std::cerr<<__FUNCTION__<<"(): built with _BUILD_NO_EDT_; use capture_source = synthetic"
+                 <<std::endl;
+        return UNIX_ERROR_STATUS;
+#endif
+    }
+
+    {
+        boost::lock_guard<boost::recursive_mutex> lock(m_mtxDispatch);
+        m_pSettingsTracker=new EosAdimecSettingsTracker(
+            m_frameSettings,(uint64_t)m_EosAdimecConfigInfo.nFrameSettingsTimeUnitUs*1000,
+            (uint64_t)m_EosAdimecConfigInfo.nFrameSettingsMarginUs*1000);
+    }
+
+    m_pCapture=new EosAdimecCapture(pSource,m_EosAdimecConfigInfo.nCaptureRingBuffers,
+                                    m_EosAdimecConfigInfo.nCaptureTimeoutMs);
+    m_pCapture->SetSettingsTracker(m_pSettingsTracker);
+
+    // The DMA ring gets at most half of the process memory cap.
+    size_t nMaxRingBytes=((size_t)m_EosAdimecConfigInfo.nMaxMemMb<<20)/2;
+    if(UNIX_OK_STATUS!=m_pCapture->Start(nMaxRingBytes))
+    {
+        std::cerr<<__FUNCTION__<<"(): "<<pSource->GetName()<<" capture did not start"<<std::endl;
+        StopCapture();
+        return UNIX_ERROR_STATUS;
+    }
+
+    // The stages' frame pools and the frame ring share 3/4 of the process
+    // memory cap, less what the DMA ring took.
+    size_t nRingBytes=m_pCapture->GetFrameBytes()*m_EosAdimecConfigInfo.nCaptureRingBuffers;
+    size_t nPoolBudgetBytes=(((size_t)m_EosAdimecConfigInfo.nMaxMemMb<<20)/4)*3;
+    nPoolBudgetBytes=(nPoolBudgetBytes>nRingBytes) ? (nPoolBudgetBytes-nRingBytes) : 0;
+    EosAdimecFramePool::Configure(nPoolBudgetBytes,m_EosAdimecConfigInfo.bFramePoolHugePages,
+                                  m_EosAdimecConfigInfo.bFramePoolMlock);
+
+    // Before the stages that cut frames into tiles on it
+    m_pTileExecutor=new EosAdimecTileExecutor(m_EosAdimecConfigInfo.nTileThreads,
+                                              m_EosAdimecConfigInfo.vnTileCpus,
+                                              (size_t)m_EosAdimecConfigInfo.nTileKb<<10);
+    m_pTileExecutor->Start();
+
+    // The stages attach to the graph, not to the capture engine.
+    EosAdimecPipeline::Graph graph;
+    std::string strError;
+    EosAdimecPipeline::ParseGraph(m_EosAdimecConfigInfo.mapPipeline,graph,strError);
+    m_pPipeline=new EosAdimecPipeline(graph);
+    m_nPipelineConsumerId=m_pCapture->AddFrameConsumer(
+        std::bind(&EosAdimecPipeline::OnFrame,m_pPipeline,std::placeholders::_1));
+
+    // First, so the stages that take its output get corrected frames
+    StartCorrection();
+
+    if(m_EosAdimecConfigInfo.bVideoOutputEnable)
+    {
+        StartVideoOutput();
+    }
+
+    if(m_EosAdimecConfigInfo.bFrameRingEnable)
+    {
+        StartFrameRing();
+    }
+
+    StartAutoExposure();
+    StartAutoWhiteBalance();
+
+    if(m_EosAdimecConfigInfo.bFrameStatsEnable)
+    {
+        StartFrameStats();
+    }
+
+    if(m_EosAdimecConfigInfo.bFocusEnable)
+    {
+        StartFocus();
+    }
+
+    if(m_EosAdimecConfigInfo.bSnapshotEnable)
+    {
+        StartSnapshot();
+    }
+
+    if(m_EosAdimecConfigInfo.bPreviewEnable)
+    {
+        StartPreview();
+    }
+
+    // Before the recorder, which takes what memory is left
+    if(m_EosAdimecConfigInfo.bArchiveEnable)
+    {
+        StartArchive();
+    }
+
+    if(m_EosAdimecConfigInfo.bRecorderEnable)
+    {
+        StartRecorder();
+    }
+
+    return UNIX_OK_STATUS;
+}
+
+void EosAdimec::StopCapture(void)
+{
+    StopRecorder();
+    StopArchive();
+    StopPreview();
+    StopSnapshot();
+    StopFocus();
+    StopFrameStats();
+    StopAutoWhiteBalance();
+    StopAutoExposure();
+    StopFrameRing();
+    StopVideoOutput();
+    StopCorrection();
+
+    if(m_pPipeline)
+    {
+        m_pCapture->RemoveFrameConsumer(m_nPipelineConsumerId);
+        delete m_pPipeline;
+        m_pPipeline=NULL;
+    }
+
+    if(m_pTileExecutor)
+    {
+        delete m_pTileExecutor;
+        m_pTileExecutor=NULL;
+    }
+
+    if(m_pCapture)
+    {
+        delete m_pCapture;
+        m_pCapture=NULL;
+    }
+
+    boost::lock_guard<boost::recursive_mutex> lock(m_mtxDispatch);
+    if(m_pSettingsTracker)
+    {
+        delete m_pSettingsTracker;
+        m_pSettingsTracker=NULL;
+    }
+    return;
+}
+
+int EosAdimec::StartVideoOutput(void)
+{
+    if(m_pVideoOutput || (NULL==m_pCapture))
+        return UNIX_OK_STATUS;
+    if(!m_pPipeline->HasStage(EosAdimecPipeline::eStageVideoOutput))
+        return UNIX_ERROR_STATUS;
+
+    // Already validated by EosAdimecConfiguration
+    EosAdimecYuv::E_YUV_FORMAT eFormat=EosAdimecYuv::eYuvI420;
+    EosAdimecYuv::FormatFromString(m_EosAdimecConfigInfo.strVideoOutputFormat,eFormat);
+    EosAdimecBayer::E_DEMOSAIC_METHOD eMethod=EosAdimecBayer::eDemosaicEdgeAware;
+    EosAdimecBayer::MethodFromString(m_EosAdimecConfigInfo.strVideoOutputDemosaic,eMethod);
+
+    EosAdimecYuv::WbGains gains;
+    EosAdimecYuv::GainFromDouble(m_EosAdimecConfigInfo.adVideoWbGains[0],gains.nR);
+    EosAdimecYuv::GainFromDouble(m_EosAdimecConfigInfo.adVideoWbGains[1],gains.nG);
+    EosAdimecYuv::GainFromDouble(m_EosAdimecConfigInfo.adVideoWbGains[2],gains.nB);
+
+    EosAdimecToneMap::ToneParams toneParams;
+    toneParams.eCurve=EosAdimecToneMap::eCurveOff;
+    EosAdimecToneMap::CurveFromString(m_EosAdimecConfigInfo.strVideoToneMap,toneParams.eCurve);
+    toneParams.dGamma=m_EosAdimecConfigInfo.dVideoToneGamma;
+    toneParams.dLogStrength=m_EosAdimecConfigInfo.dVideoToneLog;
+    toneParams.dGain=m_EosAdimecConfigInfo.dVideoToneGain;
+    toneParams.dBlackPct=m_EosAdimecConfigInfo.dVideoToneBlackPct;
+
+    m_pVideoOutput=new EosAdimecVideoOutput(m_EosAdimecConfigInfo.strVideoOutputFifo,
+                                            eFormat,eMethod,m_pTileExecutor);
+    m_pVideoOutput->SetWbGains(gains);
+    m_pVideoOutput->SetToneParams(toneParams);
+
+    if(UNIX_OK_STATUS!=m_pVideoOutput->Start(m_pCapture->GetFrameBytes()/sizeof(uint16_t)))
+    {
+        delete m_pVideoOutput;
+        m_pVideoOutput=NULL;
+        return UNIX_ERROR_STATUS;
+    }
+
+    m_pPipeline->Attach(EosAdimecPipeline::eStageVideoOutput,
+        std::bind(&EosAdimecVideoOutput::OnFrame,m_pVideoOutput,std::placeholders::_1));
+
+    return UNIX_OK_STATUS;
+}
+
+void EosAdimec::StopVideoOutput(void)
+{
+    if(m_pVideoOutput)
+    {
+        // Returns once a frame in progress is through OnFrame().
+        if(m_pPipeline)
+            m_pPipeline->Detach(EosAdimecPipeline::eStageVideoOutput);
+
+        delete m_pVideoOutput;
+        m_pVideoOutput=NULL;
+    }
+    return;
+}
+
+int EosAdimec::StartFrameRing(void)
+{
+    if(m_pFrameRing || (NULL==m_pCapture))
+        return UNIX_OK_STATUS;
+    if(!m_pPipeline->HasStage(EosAdimecPipeline::eStageFrameRing))
+        return UNIX_ERROR_STATUS;
+
+    // The shared segment comes out of the frame-pool budget; Open()
+    // creates and maps it, so it has to fit first.
+    size_t nFrameBytes=m_pCapture->GetFrameBytes();
+    if(m_EosAdimecConfigInfo.bFrameRingPacked)
+        nFrameBytes=EosAdimecPack::MaxPackedBytes(nFrameBytes);
+    size_t nSegmentBytes=EosAdimecFrameRing::ComputeSegmentBytes(
+        m_EosAdimecConfigInfo.nFrameRingSlots,nFrameBytes);
+    if(!EosAdimecFramePool::Reserve(nSegmentBytes))
+    {
+        std::cerr<<__FUNCTION__<<"(): "<<m_EosAdimecConfigInfo.nFrameRingSlots
+                 <<" frame ring slots need "<<(nSegmentBytes>>20)
+                 <<" MB; that does not fit in the max_mem_mb budget"<<std::endl;
+        return UNIX_ERROR_STATUS;
+    }
+
+    m_pFrameRing=new EosAdimecFrameRing(m_EosAdimecConfigInfo.strFrameRingShmName,
+                                        m_EosAdimecConfigInfo.strFrameRingSocketPath,
+                                        m_EosAdimecConfigInfo.nFrameRingSlots,
+                                        m_EosAdimecConfigInfo.nFrameRingMaxReaders,
+                                        m_EosAdimecConfigInfo.bFrameRingPacked);
+    if(UNIX_OK_STATUS!=m_pFrameRing->Open(nFrameBytes))
+    {
+        EosAdimecFramePool::Unreserve(nSegmentBytes);
+        delete m_pFrameRing;
+        m_pFrameRing=NULL;
+        return UNIX_ERROR_STATUS;
+    }
+
+    m_pPipeline->Attach(EosAdimecPipeline::eStageFrameRing,
+        std::bind(&EosAdimecFrameRing::Publish,m_pFrameRing,std::placeholders::_1));
+
+    return UNIX_OK_STATUS;
+}
+
+void EosAdimec::StopFrameRing(void)
+{
+    if(m_pFrameRing)
+    {
+        if(m_pPipeline)
+            m_pPipeline->Detach(EosAdimecPipeline::eStageFrameRing);
+
+        EosAdimecFramePool::Unreserve(m_pFrameRing->GetSegmentBytes());
+        delete m_pFrameRing;
+        m_pFrameRing=NULL;
+    }
+    return;
+}
+
+// The loop is always there while capturing, so SET_AE[1] can start it.
+int EosAdimec::StartAutoExposure(void)
+{
+    if(m_pAutoExposure || (NULL==m_pCapture))
+        return UNIX_OK_STATUS;
+    if(!m_pPipeline->HasStage(EosAdimecPipeline::eStageAutoExposure))
+        return UNIX_ERROR_STATUS;
+
+    // The ranges ValidateIntegrationTime() and SetGainLevel() enforce
+    m_pAutoExposure=new EosAdimecAutoExposure(
+        std::bind(&EosAdimec::ApplyAutoExposure,this,std::placeholders::_1,
+                  std::placeholders::_2,std::placeholders::_3),
+        MIN_INTEGRATION_TIME,MAX_INTEGRATION_TIME,MIN_GAIN,MAX_GAIN);
+
+    EosAdimecAutoExposure::AeParams params;
+    params.bEnable=m_EosAdimecConfigInfo.bAeEnable;
+    params.nTargetPct=m_EosAdimecConfigInfo.nAeTargetPct;
+    params.nRoiX=m_EosAdimecConfigInfo.anAeRoi[0];
+    params.nRoiY=m_EosAdimecConfigInfo.anAeRoi[1];
+    params.nRoiW=m_EosAdimecConfigInfo.anAeRoi[2];
+    params.nRoiH=m_EosAdimecConfigInfo.anAeRoi[3];
+    params.nRateHz=m_EosAdimecConfigInfo.nAeRateHz;
+    m_pAutoExposure->SetParams(params);
+
+    m_pAutoExposure->Start();
+    m_pPipeline->Attach(EosAdimecPipeline::eStageAutoExposure,
+        std::bind(&EosAdimecAutoExposure::OnFrame,m_pAutoExposure,std::placeholders::_1));
+
+    return UNIX_OK_STATUS;
+}
+
+void EosAdimec::StopAutoExposure(void)
+{
+    if(m_pAutoExposure)
+    {
+        if(m_pPipeline)
+            m_pPipeline->Detach(EosAdimecPipeline::eStageAutoExposure);
+
+        delete m_pAutoExposure;
+        m_pAutoExposure=NULL;
+    }
+    return;
+}
+
+// Auto-exposure loop thread: @IT, then @GA, like SETIT/SETGAIN but
+// without SCIP responses.
+int EosAdimec::ApplyAutoExposure(const int nIntegrationTime, const int nGain, uint32_t& nVersion)
+{
+    boost::lock_guard<boost::recursive_mutex> lock(m_mtxDispatch);
+
+    int nStatus=UNIX_OK_STATUS;
+    std::string strCmd, strResp;
+
+    if(nIntegrationTime!=m_frameSettings.nIntegrationTime)
+    {
+        nStatus=SetIntegrationTime(boost::lexical_cast<std::string>(nIntegrationTime),strCmd);
+        if(UNIX_OK_STATUS==nStatus)
+        {
+            PdvSerialWriteSetting(strCmd);
+            nStatus=PdvSerialRead(strResp);
+        }
+        if(UNIX_OK_STATUS==nStatus)
+        {
+            m_mapQueryCache.clear();
+            m_frameSettings.nIntegrationTime=nIntegrationTime;
+            UpdateFrameSettings();
+        }
+    }
+
+    if((UNIX_OK_STATUS==nStatus) && (nGain!=m_frameSettings.nGain))
+    {
+        nStatus=SetGainLevel(nGain,strCmd,boost::lexical_cast<std::string>(nGain));
+        if(UNIX_OK_STATUS==nStatus)
+        {
+            PdvSerialWriteSetting(strCmd);
+            nStatus=PdvSerialRead(strResp);
+        }
+        if(UNIX_OK_STATUS==nStatus)
+        {
+            m_mapQueryCache.clear();
+            m_frameSettings.nGain=nGain;
+            UpdateFrameSettings();
+        }
+    }
+
+    if(UNIX_OK_STATUS!=nStatus)
+        AbandonFrameSettings();
+
+    nVersion=m_frameSettings.nVersion;
+    return nStatus;
+}
+
+// The loop is always there while capturing, so AWB_ONCE[] can run it.
+int EosAdimec::StartAutoWhiteBalance(void)
+{
+    if(m_pAutoWhiteBalance || (NULL==m_pCapture))
+        return UNIX_OK_STATUS;
+    if(!m_pPipeline->HasStage(EosAdimecPipeline::eStageAutoWhiteBalance))
+        return UNIX_ERROR_STATUS;
+
+    // The range SetRGBLevel() enforces
+    m_pAutoWhiteBalance=new EosAdimecAutoWhiteBalance(
+        std::bind(&EosAdimec::ApplyAutoWhiteBalance,this,std::placeholders::_1,
+                  std::placeholders::_2),
+        std::bind(&EosAdimec::QueryAutoWhiteBalance,this,std::placeholders::_1,
+                  std::placeholders::_2),
+        std::bind(&EosAdimec::OnAutoWhiteBalanceDone,this,std::placeholders::_1,
+                  std::placeholders::_2),100,399);
+
+    EosAdimecAutoWhiteBalance::AwbParams params;
+    EosAdimecAutoWhiteBalance::ModeFromString(m_EosAdimecConfigInfo.strAwbMode,params.eMode);
+    EosAdimecAutoWhiteBalance::MethodFromString(m_EosAdimecConfigInfo.strAwbMethod,params.eMethod);
+    params.nHysteresisPct=m_EosAdimecConfigInfo.nAwbHysteresisPct;
+    params.nRateHz=m_EosAdimecConfigInfo.nAwbRateHz;
+    params.nBlackLevel=m_EosAdimecConfigInfo.nAwbBlackLevel;
+    m_pAutoWhiteBalance->SetParams(params);
+
+    m_pAutoWhiteBalance->Start();
+    m_pPipeline->Attach(EosAdimecPipeline::eStageAutoWhiteBalance,
+        std::bind(&EosAdimecAutoWhiteBalance::OnFrame,m_pAutoWhiteBalance,std::placeholders::_1));
+
+    return UNIX_OK_STATUS;
+}
+
+void EosAdimec::StopAutoWhiteBalance(void)
+{
+    if(m_pAutoWhiteBalance)
+    {
+        if(m_pPipeline)
+            m_pPipeline->Detach(EosAdimecPipeline::eStageAutoWhiteBalance);
+
+        delete m_pAutoWhiteBalance;
+        m_pAutoWhiteBalance=NULL;
+    }
+    return;
+}
+
+// White-balance loop thread: @WB like SETRGB, without SCIP responses.
+int EosAdimec::ApplyAutoWhiteBalance(const int anRgb[3], uint32_t& nVersion)
+{
+    boost::lock_guard<boost::recursive_mutex> lock(m_mtxDispatch);
+
+    std::vector<std::string> vStrArgs(1,EosCmd::SETRGB);
+    for(int ichan=0; ichan<3; ichan++)
+        vStrArgs.push_back(boost::lexical_cast<std::string>(anRgb[ichan]));
+
+    std::string strCmd, strResp;
+    int nStatus=SetRGBLevel(vStrArgs,strCmd);
+    if(UNIX_OK_STATUS==nStatus)
+    {
+        PdvSerialWriteSetting(strCmd);
+        nStatus=PdvSerialRead(strResp);
+    }
+    if(UNIX_OK_STATUS==nStatus)
+    {
+        m_mapQueryCache.clear();
+        m_frameSettings.nWbRed=anRgb[0];
+        m_frameSettings.nWbGreen=anRgb[1];
+        m_frameSettings.nWbBlue=anRgb[2];
+        UpdateFrameSettings();
+    }
+    else
+    {
+        AbandonFrameSettings();
+    }
+
+    nVersion=m_frameSettings.nVersion;
+    return nStatus;
+}
+
+// White-balance loop thread: the gains were never SET since start-up.
+// Read them once; the new settings version carries them from then on.
+int EosAdimec::QueryAutoWhiteBalance(int anRgb[3], uint32_t& nVersion)
+{
+    boost::lock_guard<boost::recursive_mutex> lock(m_mtxDispatch);
+
+    std::string strResp;
+    PdvSerialWrite("@WB?");
+    int nStatus=PdvSerialRead(strResp);
+
+    std::vector<std::string> vStrRgb;
+    if((UNIX_OK_STATUS==nStatus) && WbFromCamera(strResp,vStrRgb))
+    {
+        try
+        {
+            for(int ichan=0; ichan<3; ichan++)
+                anRgb[ichan]=boost::lexical_cast<int>(boost::trim_copy(vStrRgb[ichan]));
+        }
+        catch(...)
+        {
+            nStatus=UNIX_ERROR_STATUS;
+        }
+    }
+    else
+    {
+        nStatus=UNIX_ERROR_STATUS;
+    }
+
+    if(UNIX_OK_STATUS==nStatus)
+    {
+        m_frameSettings.nWbRed=anRgb[0];
+        m_frameSettings.nWbGreen=anRgb[1];
+        m_frameSettings.nWbBlue=anRgb[2];
+        UpdateFrameSettings();
+    }
+
+    nVersion=m_frameSettings.nVersion;
+    return nStatus;
+}
+
+// White-balance loop thread, at the end of an AWB_ONCE[] run:
+// AWB_ONCE[CONVERGED|NOT_CONVERGED,r,g,b]
+void EosAdimec::OnAutoWhiteBalanceDone(const bool bConverged, const int anRgb[3])
+{
+    boost::lock_guard<boost::recursive_mutex> lock(m_mtxDispatch);
+
+    char cBuf[BUFLEN+1];
+    ::memset(cBuf,'\0',BUFLEN);
+    ::snprintf(cBuf,BUFLEN-1,"%s,%d,%d,%d",bConverged ? "CONVERGED" : "NOT_CONVERGED",
+               anRgb[0],anRgb[1],anRgb[2]);
+    ShipToSCIP("AWB_ONCE",cBuf);
+
+    return;
+}
+
+int EosAdimec::StartFrameStats(void)
+{
+    if(m_pFrameStats || (NULL==m_pCapture))
+        return UNIX_OK_STATUS;
+    if(!m_pPipeline->HasStage(EosAdimecPipeline::eStageFrameStats))
+        return UNIX_ERROR_STATUS;
+
+    m_pFrameStats=new EosAdimecFrameStats(
+        std::bind(&EosAdimec::PushFrameStats,this,std::placeholders::_1),
+        m_pTileExecutor);
+    m_pFrameStats->SetDecimation(m_EosAdimecConfigInfo.nFrameStatsDecimation);
+    m_pFrameStats->SetPushMs(m_EosAdimecConfigInfo.nFrameStatsPushMs);
+
+    m_pFrameStats->Start();
+    m_pPipeline->Attach(EosAdimecPipeline::eStageFrameStats,
+        std::bind(&EosAdimecFrameStats::OnFrame,m_pFrameStats,std::placeholders::_1));
+
+    return UNIX_OK_STATUS;
+}
+
+void EosAdimec::StopFrameStats(void)
+{
+    if(m_pFrameStats)
+    {
+        if(m_pPipeline)
+            m_pPipeline->Detach(EosAdimecPipeline::eStageFrameStats);
+
+        delete m_pFrameStats;
+        m_pFrameStats=NULL;
+    }
+    return;
+}
+
+// Frame statistics push thread: the same answer as FRAME_STATS[], unsolicited.
+void EosAdimec::PushFrameStats(const EosAdimecFrameStats::FrameStats& stats)
+{
+    PushToSCIP("FRAME_STATS",FormatFrameStats(stats));
+
+    return;
+}
+
+std::string EosAdimec::FormatFrameStats(const EosAdimecFrameStats::FrameStats& stats)
+{
+    static const char* const apszChannel[EosAdimecFrameStats::NUM_CHANNELS]={"r","g","b"};
+
+    char cBuf[BUFLEN+1];
+    ::memset(cBuf,'\0',BUFLEN);
+    int nLen=::snprintf(cBuf,BUFLEN-1,"seq=%llu,version=%u,ms=%.2f",
+                        (unsigned long long)stats.nSequence,stats.nSettingsVersion,
+                        stats.dComputeMs);
+    for(int ichan=0; (ichan<EosAdimecFrameStats::NUM_CHANNELS) && (nLen<BUFLEN-1); ichan++)
+    {
+        const EosAdimecFrameStats::ChannelStats& chan=stats.aChannels[ichan];
+        const char* pszChan=apszChannel[ichan];
+        nLen+=::snprintf(cBuf+nLen,BUFLEN-1-nLen,
+                         ",%s_mean=%.1f,%s_min=%d,%s_max=%d,%s_sat=%.3f,%s_black=%.3f",
+                         pszChan,chan.dMean,pszChan,chan.nMin,pszChan,chan.nMax,
+                         pszChan,chan.dSaturatedPct,pszChan,chan.dBlackPct);
+    }
+
+    return std::string(cBuf);
+}
+
+// A new archive directory each time
+int EosAdimec::StartArchive(void)
+{
+    if(m_pArchive || (NULL==m_pCapture))
+        return UNIX_OK_STATUS;
+    if(!m_pPipeline->HasStage(EosAdimecPipeline::eStageArchive))
+        return UNIX_ERROR_STATUS;
 
-            }
-        }
-        if(vStrImgFmtResp.size()>=1)
-        {
-            // Need to reformat with "," delimiters
-            ShipToSCIP("IMGFMT",vStrImgFmtResp.at(0));
-        }
+    char cBuf[64];
+    ::snprintf(cBuf,sizeof(cBuf)-1,"ss%3.3d",m_EosAdimecConfigInfo.nDeviceId);
+
+    m_pArchive=new EosAdimecArchive(m_EosAdimecConfigInfo.strArchiveDir,cBuf,
+                                    (size_t)m_EosAdimecConfigInfo.nArchiveSegmentMb<<20,
+                                    (uint64_t)m_EosAdimecConfigInfo.nArchiveMaxGb<<30,
+                                    m_EosAdimecConfigInfo.nArchiveStagingFrames,
+                                    m_EosAdimecConfigInfo.bArchivePacked);
+    size_t nFrameBytes=m_pCapture->GetFrameBytes();
+    if(m_EosAdimecConfigInfo.bArchivePacked)
+        nFrameBytes=EosAdimecPack::MaxPackedBytes(nFrameBytes);
+    if(UNIX_OK_STATUS!=m_pArchive->Start(nFrameBytes))
+    {
+        delete m_pArchive;
+        m_pArchive=NULL;
+        return UNIX_ERROR_STATUS;
     }
-    return nStatus;
+
+    m_pPipeline->Attach(EosAdimecPipeline::eStageArchive,
+        std::bind(&EosAdimecArchive::OnFrame,m_pArchive,std::placeholders::_1));
+
+    return UNIX_OK_STATUS;
 }
 
-int EosAdimec::HandleSetImageFormat(const std::vector<std::string>& vStrArgs)
+void EosAdimec::StopArchive(void)
 {
-    int nStatus = UNIX_ERROR_STATUS;
-    std::string strResp;
-    std::string strSetImgFmtCmd, strImgFmtResp;
+    if(m_pArchive)
+    {
+        if(m_pPipeline)
+            m_pPipeline->Detach(EosAdimecPipeline::eStageArchive);
 
-    std::string strImgFmtX;
-    std::string strImgFmtY;
-    std::string strImgFmtZ;
+        // Writes out what is staged first
+        delete m_pArchive;
+        m_pArchive=NULL;
+    }
+    return;
+}
 
-    if(vStrArgs.size()>=4)
+// The recorder's slots hold recorder_seconds of frames at the frame
+// period, within recorder_max_mb and what the DMA ring, the frame ring
+// segment, the archive staging ring and the correction references leave
+// of three quarters of the process memory cap (the last quarter is for
+// everything else).  They are faulted in at start, so with the frame
+// period unknown the recorder leaves room for what can start later: the
+// archive staging ring (SET_ARCHIVE[1]) and a dark and a flat reference.
+int EosAdimec::StartRecorder(void)
+{
+    if(m_pRecorder || (NULL==m_pCapture))
+        return UNIX_OK_STATUS;
+    if(!m_pPipeline->HasStage(EosAdimecPipeline::eStageRecorder))
+        return UNIX_ERROR_STATUS;
+
+    size_t nFrameBytes=m_pCapture->GetFrameBytes();
+    size_t nRecordBytes=m_EosAdimecConfigInfo.bRecorderPacked ?
+        EosAdimecPack::MaxPackedBytes(nFrameBytes) : nFrameBytes;
+    size_t nBudgetBytes=EosAdimecFramePool::GetFreeBytes();
+
+    uint64_t nPeriodNs=GetFramePeriodNs();
+    if(nPeriodNs>0)
     {
-        strImgFmtX=vStrArgs.at(1); // Vertical Image offset
-        strImgFmtY=vStrArgs.at(2); // Vertical Image size 
-        strImgFmtZ=vStrArgs.at(3); // Vertical binning factor
+        // One more for the frame being filled, one for rounding
+        uint64_t nFrames=(uint64_t)std::max(1,m_EosAdimecConfigInfo.nRecorderSeconds)*
+            1000000000ull/nPeriodNs+2;
+        nBudgetBytes=std::min(nBudgetBytes,
+                              (size_t)nFrames*EosAdimecFramePool::SlotStride(nRecordBytes));
     }
     else
     {
+        size_t nHeadroomBytes=0;
+        if((NULL==m_pArchive) && m_pPipeline->HasStage(EosAdimecPipeline::eStageArchive))
+        {
+            size_t nArchiveBytes=m_EosAdimecConfigInfo.bArchivePacked ?
+                EosAdimecPack::MaxPackedBytes(nFrameBytes) : nFrameBytes;
+            nHeadroomBytes+=EosAdimecArchive::StagingBytes(nArchiveBytes,
+                m_EosAdimecConfigInfo.nArchiveStagingFrames);
+        }
+        if(m_pCorrection)
+            nHeadroomBytes+=2*nFrameBytes;
+        nBudgetBytes=(nBudgetBytes>nHeadroomBytes) ? (nBudgetBytes-nHeadroomBytes) : 0;
+    }
+    if(m_EosAdimecConfigInfo.nRecorderMaxMb>0)
+        nBudgetBytes=std::min(nBudgetBytes,(size_t)m_EosAdimecConfigInfo.nRecorderMaxMb<<20);
+
+    char cBuf[64];
+    ::snprintf(cBuf,sizeof(cBuf)-1,"ss%3.3d",m_EosAdimecConfigInfo.nDeviceId);
+
+    m_pRecorder=new EosAdimecRecorder(
+        std::bind(&EosAdimec::OnRecorderSaveDone,this,std::placeholders::_1),
+        m_EosAdimecConfigInfo.strRecorderDir,cBuf,m_EosAdimecConfigInfo.nRecorderSeconds,
+        nBudgetBytes,m_EosAdimecConfigInfo.bRecorderPacked);
+    if(UNIX_OK_STATUS!=m_pRecorder->Start(nRecordBytes))
+    {
+        delete m_pRecorder;
+        m_pRecorder=NULL;
         return UNIX_ERROR_STATUS;
     }
 
-    
-    try
+    m_pPipeline->Attach(EosAdimecPipeline::eStageRecorder,
+        std::bind(&EosAdimecRecorder::OnFrame,m_pRecorder,std::placeholders::_1));
+
+    return UNIX_OK_STATUS;
+}
+
+void EosAdimec::StopRecorder(void)
+{
+    if(m_pRecorder)
     {
-        strImgFmtX=vStrArgs.at(1); // Vertical Image offset
-        strImgFmtY=vStrArgs.at(2); // Vertical Image size 
-        strImgFmtZ=vStrArgs.at(3); // Vertical binning factor
-        int nImgFmtX=boost::lexical_cast<int>(strImgFmtX);
+        if(m_pPipeline)
+            m_pPipeline->Detach(EosAdimecPipeline::eStageRecorder);
 
-        // Vertical offset must be even # scans
-        if((nImgFmtX % 2) != 0)
-        {
-            nImgFmtX+=1;
-            strImgFmtX=boost::lexical_cast<std::string>(nImgFmtX);
-        }
-        
-        int nImgFmtY=boost::lexical_cast<int>(strImgFmtY);
-        if(nImgFmtY<128)
+        delete m_pRecorder;
+        m_pRecorder=NULL;
+    }
+    return;
+}
+
+// SETFP's period, or the camera's own (@FP?) if there was no SETFP, in
+// frame_settings_time_unit_us units.
+uint64_t EosAdimec::GetFramePeriodNs(void)
+{
+    if(m_EosAdimecConfigInfo.strCaptureSource==EosAdimecConfiguration::CAPTURE_SOURCE_SYNTHETIC)
+        return 1000000000ull/std::max(1,m_EosAdimecConfigInfo.nCaptureSynthFps);
+
+    boost::lock_guard<boost::recursive_mutex> lock(m_mtxDispatch);
+    int nFramePeriod=m_frameSettings.nFramePeriod;
+    if(nFramePeriod<=0)
+    {
+        std::string strResp;
+        PdvSerialWrite("@FP?");
+        if(UNIX_OK_STATUS==PdvSerialRead(strResp))
         {
-            nImgFmtY=128;
-            strImgFmtY=boost::lexical_cast<std::string>(nImgFmtY);
+            try{
+                nFramePeriod=boost::lexical_cast<int>(strResp);
+            }
+            catch(...){
+                nFramePeriod=0;
+            }
         }
-        
-        int nImgFmtZ=boost::lexical_cast<int>(strImgFmtZ);
+    }
+    if(nFramePeriod<=0)
+        return 0;
+    return (uint64_t)nFramePeriod*m_EosAdimecConfigInfo.nFrameSettingsTimeUnitUs*1000;
+}
 
-        strSetImgFmtCmd="FM"+strImgFmtX+";"+strImgFmtY+";"+strImgFmtZ;
-        PdvSerialWrite(strSetImgFmtCmd);
+// Recorder saver thread, at the end of a TRIGGER_SAVE:
+// TRIGGER_SAVE[DONE,id,frames,pre_frames,dropped,path] or
+// TRIGGER_SAVE[FAILED,id,error,path]
+void EosAdimec::OnRecorderSaveDone(const EosAdimecRecorder::SaveResult& result)
+{
+    boost::lock_guard<boost::recursive_mutex> lock(m_mtxDispatch);
 
-        nStatus = PdvSerialRead(strResp);
-        strImgFmtResp=strResp;
-    }
-    catch(...)
+    char cBuf[BUFLEN+1];
+    ::memset(cBuf,'\0',BUFLEN);
+    if(result.bOk)
     {
-        nStatus= UNIX_ERROR_STATUS;
+        ::snprintf(cBuf,BUFLEN-1,"DONE,%llu,%lu,%lu,%lu,%s",
+                   (unsigned long long)result.nTriggerId,result.nFrames,result.nPreFrames,
+                   result.nDropped,result.strPath.c_str());
     }
-    if(nStatus!=UNIX_OK_STATUS)
+    else
     {
-        ShipToSCIP("ERROR_SETTING_IMGFMT","-2047-2047");
+        std::string strError=result.strError;
+        std::replace(strError.begin(),strError.end(),' ','_');
+        ::snprintf(cBuf,BUFLEN-1,"FAILED,%llu,%s,%s",(unsigned long long)result.nTriggerId,
+                   strError.c_str(),result.strPath.c_str());
     }
-    else
+    ShipToSCIP("TRIGGER_SAVE",cBuf);
+
+    return;
+}
+
+int EosAdimec::StartSnapshot(void)
+{
+    if(m_pSnapshot || (NULL==m_pCapture))
+        return UNIX_OK_STATUS;
+    if(!m_pPipeline->HasStage(EosAdimecPipeline::eStageSnapshot))
+        return UNIX_ERROR_STATUS;
+
+    EosAdimecBayer::E_DEMOSAIC_METHOD eMethod=EosAdimecBayer::eDemosaicEdgeAware;
+    EosAdimecBayer::MethodFromString(m_EosAdimecConfigInfo.strSnapshotDemosaic,eMethod);
+
+    char cBuf[64];
+    ::snprintf(cBuf,sizeof(cBuf)-1,"ss%3.3d",m_EosAdimecConfigInfo.nDeviceId);
+
+    m_pSnapshot=new EosAdimecSnapshot(
+        std::bind(&EosAdimec::OnSnapshotDone,this,std::placeholders::_1),
+        m_EosAdimecConfigInfo.strSnapshotDir,cBuf,eMethod,
+        m_EosAdimecConfigInfo.nSnapshotJpegQuality,m_EosAdimecConfigInfo.nSnapshotPngLevel,
+        m_EosAdimecConfigInfo.nSnapshotKeep,m_EosAdimecConfigInfo.nSnapshotTimeoutMs);
+    if(UNIX_OK_STATUS!=m_pSnapshot->Start(m_pCapture->GetFrameBytes()))
     {
-        ShipToSCIP("IMGFMT",strImgFmtResp);
+        delete m_pSnapshot;
+        m_pSnapshot=NULL;
+        return UNIX_ERROR_STATUS;
     }
 
-    return nStatus;
+    m_pPipeline->Attach(EosAdimecPipeline::eStageSnapshot,
+        std::bind(&EosAdimecSnapshot::OnFrame,m_pSnapshot,std::placeholders::_1));
+
+    return UNIX_OK_STATUS;
 }
 
-// Return an index value for the baudrate
-int EosAdimec::BaudRate2Id (int nBaudRate)
+void EosAdimec::StopSnapshot(void)
 {
-    switch(nBaudRate)
+    if(m_pSnapshot)
     {
-        case 9600:
-            return CL_BAUDRATE_9600;
-        case 19200:
-            return CL_BAUDRATE_19200;
-        case 38400:
-            return CL_BAUDRATE_38400;
-        case 57600:
-            return CL_BAUDRATE_57600;
-        case 115200:
-            return CL_BAUDRATE_115200;
-        case 230400:
-            return CL_BAUDRATE_230400;
-        case 460800:
-            return CL_BAUDRATE_460800;
-        case 921600:
-            return CL_BAUDRATE_921600;
-        default:
-            return 0;
+        if(m_pPipeline)
+            m_pPipeline->Detach(EosAdimecPipeline::eStageSnapshot);
+
+        delete m_pSnapshot;
+        m_pSnapshot=NULL;
     }
+    return;
 }
 
+// Snapshot encoder thread, at the end of a SNAPSHOT:
+// SNAPSHOT[DONE,id,path,seq,wall_time,wait_ms,encode_ms] or
+// SNAPSHOT[FAILED,id,error]
+void EosAdimec::OnSnapshotDone(const EosAdimecSnapshot::SnapshotResult& result)
+{
+    boost::lock_guard<boost::recursive_mutex> lock(m_mtxDispatch);
+
+    // Back to streaming before anyone else talks to the camera
+    if(result.bTriggered)
+        RestoreSnapshotStreamMode();
 
-/**
-   Diagnostic function to check the response messages from the camera
-*/
-void EosAdimec::PrintAdimecResponse(char cBuff[],int nLength){
-    for (int i=0;i<nLength;i++){
-        if(cBuff[i]==AACK){
-            printf("<ACK> ");
-        }
-        else if(cBuff[i]==ANAK){
-            printf("<NAK> ");
-        }
-        else if(cBuff[i]==ASTX){
-            printf("<STX> ");
-        }
-        else if(cBuff[i]==AETX){
-            printf("<ETX> ");
-        }
-        else{
-            printf("%c ",cBuff[i]);
-        }
+    // The outcome goes to whoever sent the SNAPSHOT, with its tag.
+    E_REPLY_ROUTE eSavedRoute=m_eReplyRoute;
+    int nSavedFd=m_nReplyClientFd;
+    std::string strSavedTag=m_strReplyTag;
+
+    m_eReplyRoute=m_eSnapshotRoute;
+    m_nReplyClientFd=m_nSnapshotClientFd;
+    m_strReplyTag=m_strSnapshotTag;
+
+    char cBuf[BUFLEN+1];
+    ::memset(cBuf,'\0',BUFLEN);
+    if(result.bOk)
+    {
+        ::snprintf(cBuf,BUFLEN-1,"DONE,%llu,%s,%llu,%lld.%06ld,%.1f,%.1f",
+                   (unsigned long long)result.nId,result.strPath.c_str(),
+                   (unsigned long long)result.nSequence,(long long)result.tsWall.tv_sec,
+                   (long)(result.tsWall.tv_nsec/1000),result.dWaitMs,result.dEncodeMs);
+    }
+    else
+    {
+        std::string strError=result.strError;
+        std::replace(strError.begin(),strError.end(),' ','_');
+        ::snprintf(cBuf,BUFLEN-1,"FAILED,%llu,%s",(unsigned long long)result.nId,
+                   strError.c_str());
     }
+    ShipToSCIP("SNAPSHOT",cBuf);
+
+    m_eReplyRoute=eSavedRoute;
+    m_nReplyClientFd=nSavedFd;
+    m_strReplyTag=strSavedTag;
+
+    return;
 }
 
+// Called with m_mtxDispatch held.
+void EosAdimec::RestoreSnapshotStreamMode(void)
+{
+    std::string strResp;
+    PdvSerialWrite(m_EosAdimecConfigInfo.strSnapshotStreamMode);
+    PdvSerialRead(strResp);
+    return;
+}
 
-/**
-   Strips out transmission flags and changes message delimiters into a form that can 
-   be sent on through to SCIP. Device response will be stored in strResp
-*/
-int EosAdimec::ComposeDevResp(const char cBuff[]/*input*/, int nLength/*input*/,
-                              std::string& strResp/*output*/)
+int EosAdimec::StartPreview(void)
 {
-    int nStatus = UNIX_ERROR_STATUS;
+    if(m_pPreview || (NULL==m_pCapture))
+        return UNIX_OK_STATUS;
+    if(!m_pPipeline->HasStage(EosAdimecPipeline::eStagePreview))
+        return UNIX_ERROR_STATUS;
 
-    printf ("%s\r\n",cBuff);
-    for (int i=0;i<nLength;i++){
-        if(cBuff[i]==AACK){
-            nStatus=UNIX_OK_STATUS;
-        }
-        else if(cBuff[i]==ANAK){
-            nStatus=UNIX_ERROR_STATUS;
-        }
-        else if(cBuff[i]==ASTX){
-        }
-        else if(cBuff[i]==AETX){
-        }
-        else if(cBuff[i]=='+'){
-        }
-        else if(cBuff[i]==';'){
-            strResp+=',';
-        }
-        else{
-            strResp+=cBuff[i];
-        }
+    // Already validated by EosAdimecConfiguration; the gains are the video output's.
+    EosAdimecYuv::E_YUV_FORMAT eFormat=EosAdimecYuv::eYuvI420;
+    EosAdimecYuv::FormatFromString(m_EosAdimecConfigInfo.strPreviewFormat,eFormat);
+    EosAdimecYuv::WbGains gains;
+    EosAdimecYuv::GainFromDouble(m_EosAdimecConfigInfo.adVideoWbGains[0],gains.nR);
+    EosAdimecYuv::GainFromDouble(m_EosAdimecConfigInfo.adVideoWbGains[1],gains.nG);
+    EosAdimecYuv::GainFromDouble(m_EosAdimecConfigInfo.adVideoWbGains[2],gains.nB);
+
+    // As for the frame ring: the segment must fit before Start() maps it.
+    size_t nSegmentBytes=EosAdimecPreview::ComputeSegmentBytes(
+        m_EosAdimecConfigInfo.vnPreviewScales,m_pCapture->GetFrameBytes());
+    if(!EosAdimecFramePool::Reserve(nSegmentBytes))
+    {
+        std::cerr<<__FUNCTION__<<"(): the "<<(nSegmentBytes>>20)
+                 <<" MB segment does not fit in the max_mem_mb budget"<<std::endl;
+        return UNIX_ERROR_STATUS;
     }
-    return nStatus;
-    
-}
 
+    m_pPreview=new EosAdimecPreview(m_EosAdimecConfigInfo.strPreviewShmName,
+                                    m_EosAdimecConfigInfo.vnPreviewScales,
+                                    m_EosAdimecConfigInfo.nPreviewDecimation,eFormat,gains);
+    if(UNIX_OK_STATUS!=m_pPreview->Start(m_pCapture->GetFrameBytes()))
+    {
+        EosAdimecFramePool::Unreserve(nSegmentBytes);
+        delete m_pPreview;
+        m_pPreview=NULL;
+        return UNIX_ERROR_STATUS;
+    }
 
+    m_pPipeline->Attach(EosAdimecPipeline::eStagePreview,
+        std::bind(&EosAdimecPreview::OnFrame,m_pPreview,std::placeholders::_1));
 
-/**
-   Validates that new Offset value is in the correct range and also checks that 
-   it exceeds the minimum value based on the current gain setting and output resolution. 
+    return UNIX_OK_STATUS;
+}
 
-   The manual for the Adimec provides a formula to calculate a dynamic offset but the 
-   usable domain of the function is incredibly small for the range of values we would 
-   provide it. The domain goes negative in less than 2 one/hundreths of a gain setting. 
-   Therefore we have set the minimum offset value to the ceiling of possible minimum 
-   offset values. The formula and preset values are presented here for future reference. 
-   
-   Formula:
-   Minimum Offset >= OutputResolutionScalar *(100- CurrentGain) + (20*CurrentGain)/100
-   Formula provided by Adimec operating and technical manual. 
+void EosAdimec::StopPreview(void)
+{
+    if(m_pPreview)
+    {
+        if(m_pPipeline)
+            m_pPipeline->Detach(EosAdimecPipeline::eStagePreview);
 
-   OutputResolutionScalars:
-   12 bits = 40.95
-   10 bits = 10.23
-   8 bits = 255
-*/
-int EosAdimec::ValidateOffset(int nTempOffset){
-    int nMinOffset=20;
-    if((nTempOffset>=nMinOffset && nTempOffset<=4095)){
-        return UNIX_OK_STATUS;
-    } 
-    return UNIX_ERROR_STATUS;    
+        EosAdimecFramePool::Unreserve(m_pPreview->GetSegmentBytes());
+        delete m_pPreview;
+        m_pPreview=NULL;
+    }
+    return;
 }
 
+int EosAdimec::StartCorrection(void)
+{
+    if(m_pCorrection || (NULL==m_pCapture))
+        return UNIX_OK_STATUS;
+    if(!m_pPipeline->HasStage(EosAdimecPipeline::eStageCorrection))
+        return UNIX_ERROR_STATUS;
 
-/**
-   Checks that the received White Balance RGB values are within an acceptable range. 
-   Also sets the RGB values of the internal Adimec struct
-*/
-int EosAdimec::ValidateRGB(const std::vector<std::string>& vStrArgs){
-    int nStatus=UNIX_ERROR_STATUS;
-    int nTempRGB;
-    try{
-        for(int i=1;i<4;i++){
-            nTempRGB=boost::lexical_cast<int>(vStrArgs[i]);
-            if(nTempRGB<100||nTempRGB>399){
-                nStatus=UNIX_ERROR_STATUS;
-                break;
-            }
-            m_pAdimec->strRGB[i-1]=vStrArgs[i];
-            nStatus=UNIX_OK_STATUS;
-        }
+    m_pCorrection=new EosAdimecCorrection(
+        std::bind(&EosAdimec::OnCorrectionCaptureDone,this,std::placeholders::_1),
+        m_EosAdimecConfigInfo.strCorrectionDir,m_EosAdimecConfigInfo.nCorrectionGainStep,
+        m_pTileExecutor);
+    if(UNIX_OK_STATUS!=m_pCorrection->Start(m_pCapture->GetFrameBytes()))
+    {
+        delete m_pCorrection;
+        m_pCorrection=NULL;
+        return UNIX_ERROR_STATUS;
+    }
+    m_pCorrection->SetEnable(m_EosAdimecConfigInfo.bCorrectionEnable);
+
+    m_pPipeline->AttachFilter(EosAdimecPipeline::eStageCorrection,
+        std::bind(&EosAdimecCorrection::OnFrame,m_pCorrection,std::placeholders::_1));
+    return UNIX_OK_STATUS;
+}
+
+void EosAdimec::StopCorrection(void)
+{
+    if(m_pCorrection)
+    {
+        if(m_pPipeline)
+            m_pPipeline->Detach(EosAdimecPipeline::eStageCorrection);
+
+        delete m_pCorrection;
+        m_pCorrection=NULL;
     }
-    catch(...){
-        return UNIX_ERROR_STATUS;
+    return;
+}
+
+// Correction reference thread, at the end of a CAPTURE_DARK/CAPTURE_FLAT:
+// CAPTURE_DARK[DONE,bucket,frames,mean,path] or
+// CAPTURE_DARK[FAILED,bucket,error]
+void EosAdimec::OnCorrectionCaptureDone(const EosAdimecCorrection::CaptureResult& result)
+{
+    boost::lock_guard<boost::recursive_mutex> lock(m_mtxDispatch);
+
+    const std::string strResp=(EosAdimecCorrection::eKindFlat==result.eKind) ?
+        "CAPTURE_FLAT" : "CAPTURE_DARK";
+
+    char cBuf[BUFLEN+1];
+    ::memset(cBuf,'\0',BUFLEN);
+    if(result.bOk)
+    {
+        ::snprintf(cBuf,BUFLEN-1,"DONE,%s,%d,%.1f,%s",result.strBucket.c_str(),result.nFrames,
+                   result.dMean,result.strPath.c_str());
     }
-    return nStatus;
+    else
+    {
+        std::string strError=result.strError;
+        std::replace(strError.begin(),strError.end(),' ','_');
+        ::snprintf(cBuf,BUFLEN-1,"FAILED,%s,%s",result.strBucket.c_str(),strError.c_str());
+    }
+    ShipToSCIP(strResp,cBuf);
+
+    return;
 }
 
-// Validate frame period setting.
-int EosAdimec::ValidateFramePeriod(int nFramePeriod){
-    int nMinFramePeriod=1;
-    int nMaxFramePeriod=4000;
-    if((nFramePeriod>=nMinFramePeriod && nFramePeriod<=nMaxFramePeriod)){
+int EosAdimec::StartFocus(void)
+{
+    if(m_pFocus || (NULL==m_pCapture))
         return UNIX_OK_STATUS;
-    } 
-    return UNIX_ERROR_STATUS;    
+    if(!m_pPipeline->HasStage(EosAdimecPipeline::eStageFocus))
+        return UNIX_ERROR_STATUS;
+
+    m_pFocus=new EosAdimecFocus(std::bind(&EosAdimec::PushFocus,this,std::placeholders::_1),
+                                m_EosAdimecConfigInfo.strFocusShmName,
+                                m_EosAdimecConfigInfo.nFocusHistory);
+
+    EosAdimecFocus::FocusParams params;
+    EosAdimecFocus::MethodFromString(m_EosAdimecConfigInfo.strFocusMethod,params.eMethod);
+    params.nRoiX=m_EosAdimecConfigInfo.anFocusRoi[0];
+    params.nRoiY=m_EosAdimecConfigInfo.anFocusRoi[1];
+    params.nRoiW=m_EosAdimecConfigInfo.anFocusRoi[2];
+    params.nRoiH=m_EosAdimecConfigInfo.anFocusRoi[3];
+    params.bPush=m_EosAdimecConfigInfo.bFocusPush;
+    m_pFocus->SetParams(params);
+
+    m_pFocus->Start();
+    m_pPipeline->Attach(EosAdimecPipeline::eStageFocus,
+        std::bind(&EosAdimecFocus::OnFrame,m_pFocus,std::placeholders::_1));
+
+    return UNIX_OK_STATUS;
 }
 
-// Validate frame integration time
-int EosAdimec::ValidateIntegrationTime(int nIntegrationTime){
-    int nMinIntegrationTime=1;
-    int nMaxIntegrationTime=4000;
-    if((nIntegrationTime>=nMinIntegrationTime && nIntegrationTime<=nMaxIntegrationTime)){
-        return UNIX_OK_STATUS;
-    } 
-    return UNIX_ERROR_STATUS;    
+void EosAdimec::StopFocus(void)
+{
+    if(m_pFocus)
+    {
+        if(m_pPipeline)
+            m_pPipeline->Detach(EosAdimecPipeline::eStageFocus);
+
+        delete m_pFocus;
+        m_pFocus=NULL;
+    }
+    return;
 }
 
-/**
-   Method to formulate and send messages up to SCIP. Takes a string as the 
-   command that will be sent as well as a string that contains the message value.
-   sample SCIP msg: pp500|<strMsg>[<strValue>]
-*/
-void EosAdimec::ShipToSCIP(std::string strMsg, std::string strValue){
-    
-    char cBuf[BUFLEN+1]; // More than big enough
-    ::memset(cBuf,'\0',BUFLEN);
-    std::string strResp;
-    
+// Focus push thread: the same answer as FOCUS[], unsolicited.
+void EosAdimec::PushFocus(const EosAdimecFocus::FocusResult& result)
+{
+    PushToSCIP("FOCUS",FormatFocus(result));
 
-    ::snprintf(cBuf,BUFLEN-1,
-               "SS%3.3d|%s[%s]\n",
-               m_nAdimecId,strMsg.c_str(),strValue.c_str());
+    return;
+}
 
-    strResp=std::string(cBuf);
+std::string EosAdimec::FormatFocus(const EosAdimecFocus::FocusResult& result)
+{
+    char cBuf[BUFLEN+1];
+    ::memset(cBuf,'\0',BUFLEN);
+    ::snprintf(cBuf,BUFLEN-1,"seq=%llu,version=%u,changing=%d,method=%s,score=%.6g,"
+               "roi=%d;%d;%d;%d,ms=%.3f",
+               (unsigned long long)result.nSequence,result.nSettingsVersion,
+               result.bSettingsChanging ? 1 : 0,
+               EosAdimecFocus::MethodName(result.eMethod).c_str(),result.dScore,
+               result.anRoi[0],result.anRoi[1],result.anRoi[2],result.anRoi[3],
+               result.dComputeMs);
+
+    return std::string(cBuf);
+}
 
-    // Ship the SCIP message up to the remote client;
-    m_pPipeComms->Write(std::string(cBuf));
-    
+// Called from the SET handlers (dispatch lock held) right after the
+// camera ACKs: the last serial write/read are the command and its ACK.
+void EosAdimec::UpdateFrameSettings(void)
+{
+    m_frameSettings.nVersion++;
+    if(m_pSettingsTracker)
+        m_pSettingsTracker->Commit(m_frameSettings,m_nSerialWriteNs,m_nSerialReadNs);
+    return;
+}
 
+// A SET that failed after PdvSerialWriteSetting() (dispatch lock held).
+// Nothing to do if it was committed.
+void EosAdimec::AbandonFrameSettings(void)
+{
+    if(m_pSettingsTracker)
+        m_pSettingsTracker->AbandonChange();
+    return;
 }
 
-/**
-   Sets the device command and SCIP response message when a setting is queried. 
-   Determines which setting to query based off of the 4th letter in the SCIP command. All 
-   SCIP query commands follow this form:
-   GET<CAMERASETTING> with current choices being:
-   GAIN,RGB,OFFSET
-   If support for more settings is needed than the switch statement might need to change to
-   a more robust method like a map. 
-*/
-int EosAdimec::GetLevel(const char cValue,std::string& strCmd, std::string& strResp){
-    int nStatus=UNIX_OK_STATUS;
-    switch (cValue){
-        case 'G':
-            strCmd="@GA?";
-            strResp=EosResp::GAINPOS;
-            break;
-        case 'R':
-            strCmd="@WB?";
-            strResp=EosResp::RGBPOS;
-            break;
-        case 'O':
-            strCmd="@OFS?";
-            strResp=EosResp::OFFSETPOS;
-            break;
-        default:
-            nStatus=UNIX_ERROR_STATUS;
-    }
-    return nStatus;
+// SETTINGS_VERSION[N], after a SET's own response: the version to ask
+// FIRST_FRAME[] about.
+void EosAdimec::ShipSettingsVersion(void)
+{
+    ShipToSCIP("SETTINGS_VERSION",boost::lexical_cast<std::string>(m_frameSettings.nVersion));
+    return;
 }
 
-/**
-   Compose an Adimec set-rgb command.
-   strArgs contains the r,g,and b values.
-   strNewRgb is the command to be sent to the adimec.
-*/
-int EosAdimec::SetRGBLevel(const std::vector<std::string>& vStrArgs,std::string& strNewRGB){
-    int nStatus=UNIX_ERROR_STATUS;
-    int nValue=0;
-    strNewRGB="@WB";
-    try{
-        for(int i=3;i>=1;i--){
-            nValue=boost::lexical_cast<int>(vStrArgs[i]);
-            if(nValue<100||nValue>399){
-                nStatus=UNIX_ERROR_STATUS;
-                break;
-            }
-            nStatus=UNIX_OK_STATUS;
-            m_pAdimec->strRGB[i-1]=vStrArgs[i];
-            strNewRGB+=vStrArgs[i];
-            if(i>1)
-            {
-                strNewRGB+=";";
-            }
-            else
-            {
-                strNewRGB+="\r\n";
-            }
-        }
-        std::cout<<__FUNCTION__<<"(): strNewRGB="<<strNewRGB<<std::endl;
+// ######################## SCIP OUTPUT QUEUE ##############################
+
+int EosAdimec::StartOutputQueue(void)
+{
+    if(m_pOutputQueue || (m_EosAdimecConfigInfo.nScipOutputQueueDepth<1))
+        return UNIX_OK_STATUS;
+
+    EosAdimecOutputQueue::E_OVERFLOW_POLICY ePolicy=
+        EosAdimecOutputQueue::eDropOldestTelemetry;
+    EosAdimecOutputQueue::PolicyFromString(m_EosAdimecConfigInfo.strScipOutputOverflow,ePolicy);
+
+    m_pOutputQueue=new EosAdimecOutputQueue(m_EosAdimecConfigInfo.nScipOutputQueueDepth,
+                                            ePolicy);
+
+#ifdef _BUILD_MQTT_
+    // No fd to poll for MQTT: publish from the flusher thread instead.
+    m_pOutputQueue->AddChannel(EosAdimecOutputQueue::PIPE_CHANNEL_ID,
+                               std::bind(&EosAdimec::WritePipeComms,this,std::placeholders::_1));
+#else
+    // Use our own non-blocking fd on the to-main FIFO so that a full
+    // pipe shows up as EAGAIN instead of a blocked Handle*() call.
+    struct stat statPipe;
+    if((::stat(m_strScipPipeToMain.c_str(),&statPipe)==0) && S_ISFIFO(statPipe.st_mode))
+    {
+        m_pOutputQueue->AddChannel(EosAdimecOutputQueue::PIPE_CHANNEL_ID,
+                                   EosAdimecOutputQueue::eChannelStream,-1,
+                                   boost::bind(&EosAdimec::OpenScipPipeNonBlocking,this));
     }
-    catch(...){
+    else
+    {
+        m_pOutputQueue->AddChannel(EosAdimecOutputQueue::PIPE_CHANNEL_ID,
+                                   std::bind(&EosAdimec::WritePipeComms,this,std::placeholders::_1));
+    }
+#endif
+
+    if(UNIX_OK_STATUS!=m_pOutputQueue->Start())
+    {
+        std::cerr<<__FUNCTION__<<"(): output queue not started; writing synchronously"<<std::endl;
+        delete m_pOutputQueue;
+        m_pOutputQueue=NULL;
         return UNIX_ERROR_STATUS;
     }
 
-    return nStatus;
+    return UNIX_OK_STATUS;
 }
 
-/**
-   Compose an Adimec gain level command.
-   strGainMsg is the command to be sent to the Admec.
-   nTempGain and strGainValue are the gain level (int and string format).
-   nTempGain used to compare with min/max allowable gain levels.
-*/
-int EosAdimec::SetGainLevel(int nTempGain, std::string& strGainMsg,const std::string strGainValue){
-    if(nTempGain>=100 && nTempGain<=800){
-        m_pAdimec->strGain=strGainValue;
-        strGainMsg = "@GA"+strGainValue;
-        return UNIX_OK_STATUS;
+void EosAdimec::StopOutputQueue(void)
+{
+    boost::lock_guard<boost::recursive_mutex> lock(m_mtxDispatch);
+    if(m_pOutputQueue)
+    {
+        delete m_pOutputQueue;
+        m_pOutputQueue=NULL;
     }
-    return UNIX_ERROR_STATUS;
-    
+    return;
 }
 
-
-int EosAdimec::SetResolution(int nTempResolution, std::string& strResolutionMsg, const std::string strResolutionValue){
-    if(nTempResolution ==8 ||nTempResolution==10||nTempResolution==12){
-        m_pAdimec->strOutputRes=strResolutionValue;
-        strResolutionMsg = "@OR"+std::to_string(nTempResolution);
-        return UNIX_OK_STATUS;
-    }
-    return UNIX_ERROR_STATUS;
+// ENXIO (-1) until SCIP main has the pipe open for reading;
+// the output queue keeps retrying.
+int EosAdimec::OpenScipPipeNonBlocking(void)
+{
+    return ::open(m_strScipPipeToMain.c_str(),O_WRONLY|O_NONBLOCK|O_CLOEXEC);
 }
 
-/**
-   Compose an Adimec set-offset command.
-   strNewValue is the new offset value.
-   strOffsetCmd is the set-offset command to be sent to the Adimec.
-*/
-int EosAdimec::SetOffsetLevel(const std::string& strNewValue, std::string& strOffsetCmd){
-    try{
-        int nTempOffset=boost::lexical_cast<int>(strNewValue);
-        if(ValidateOffset(nTempOffset)==UNIX_OK_STATUS){
-            strOffsetCmd="@OFS"+strNewValue;
-            m_pAdimec->strOffset=strNewValue;
-            return UNIX_OK_STATUS;
-        }
-    }
-    catch(...){
+int EosAdimec::WritePipeComms(const std::string& strMsg)
+{
+    if(NULL==m_pPipeComms)
         return UNIX_ERROR_STATUS;
-    }
-    return UNIX_ERROR_STATUS;
+
+    m_pPipeComms->Write(strMsg);
+
+    return UNIX_OK_STATUS;
 }
 
-// Valid frame period values 1-4000
-int EosAdimec::SetFramePeriod(const std::string& strNewValue, std::string& strOffsetCmd){
-    try{
-        int nTempFp=boost::lexical_cast<int>(strNewValue);
-        if(ValidateFramePeriod(nTempFp)==UNIX_OK_STATUS){
-            strOffsetCmd="@FP"+strNewValue;
-            m_pAdimec->strFramePeriod=strNewValue;
-            return UNIX_OK_STATUS;
+// Each seqpacket message is complete, so there is no leftover-partial-command
+// handling here (unlike the named-pipe reader).
+void EosAdimec::ScipSocketServerThread(void)
+{
+    EosAdimecThreadPlacement::Apply(EosAdimecThreadPlacement::eRoleDispatch);
+
+    std::vector<EosAdimecSeqPacketMsg> vMsgs;
+
+    while(!m_abSocketThreadStop && !m_abShutdownFlag)
+    {
+        vMsgs.clear();
+        if(m_pSeqPacketServer->Poll(vMsgs,SOCKET_POLL_MS)<0)
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(SOCKET_POLL_MS));
+            continue;
+        }
+        if(vMsgs.empty())
+            continue;
+
+        // Deadlines count from here, however long the dispatch lock takes.
+        uint64_t nArrivalMs=GetMonotonicMs();
+
+        // Everything received in this poll is one dispatch cycle: each
+        // client's responses go out together when we uncork it below.
+        // Only these clients' channels are held.
+        std::set<int> setClientFds;
+        for(auto & imsg: vMsgs)
+            setClientFds.insert(imsg.nClientFd);
+        if(m_pOutputQueue)
+        {
+            for(auto & ifd: setClientFds)
+                m_pOutputQueue->Cork(ifd);
         }
-    }
-    catch(...){
-        return UNIX_ERROR_STATUS;
-    }
-    return UNIX_ERROR_STATUS;
-}
 
-// Valid integration time values 1-4000
-int EosAdimec::SetIntegrationTime(const std::string& strNewValue, std::string& strItCmd){
-    try{
-        int nTempIt=boost::lexical_cast<int>(strNewValue);
-        if(ValidateIntegrationTime(nTempIt)==UNIX_OK_STATUS){
-            strItCmd="@IT"+strNewValue;
-            m_pAdimec->strIntegrationTime=strNewValue;
-            return UNIX_OK_STATUS;
+        for(auto & imsg: vMsgs)
+        {
+            std::vector<std::string> vStrLines;
+            boost::split(vStrLines,imsg.strMsg,boost::is_any_of("\n"));
+
+            for(auto & iline: vStrLines)
+            {
+                std::vector<std::string> vStrCmd;
+                if(TokenizeScipCommand(iline,vStrCmd)<1)
+                    continue;
+
+                boost::lock_guard<boost::recursive_mutex> lock(m_mtxDispatch);
+                m_eReplyRoute=eReplyRouteSocket;
+                m_nReplyClientFd=imsg.nClientFd;
+                m_nCommandArrivalMs=nArrivalMs;
+
+                DispatchCommand(vStrCmd);
+
+                m_eReplyRoute=eReplyRouteDefault;
+                m_nReplyClientFd=-1;
+            }
+        }
+
+        if(m_pOutputQueue)
+        {
+            for(auto & ifd: setClientFds)
+                m_pOutputQueue->Uncork(ifd);
         }
     }
-    catch(...){
-        return UNIX_ERROR_STATUS;
-    }
-    return UNIX_ERROR_STATUS;
-}
 
+    return;
+}
 
-int EosAdimec::PdvSerialWrite(const std::string& strCmdIn)
+// "SS002|setgain[500]" --> {"SETGAIN","500"}
+int EosAdimec::TokenizeScipCommand(const std::string& strCmdIn,
+                                   std::vector<std::string>& vStrCmd)
 {
-    int nStatus;
-    if(m_pSerialComms)
+    vStrCmd.clear();
+
+    std::string strCmd=boost::trim_copy(strCmdIn);
+    if(strCmd.empty())
+        return 0;
+
+    // Optional device-address prefix.  Ignore commands for other devices.
+    size_t nBar=strCmd.find('|');
+    if(nBar!=std::string::npos)
     {
-        // Adimec needs newline termination
-        std::string strCmd=strCmdIn+"\r\n";
-        nStatus=m_pSerialComms->SerialWrite(strCmd);
+        char cBuf[16];
+        ::snprintf(cBuf,sizeof(cBuf)-1,"SS%3.3d",m_nAdimecId);
+        std::string strAddr=boost::to_upper_copy(boost::trim_copy(strCmd.substr(0,nBar)));
+        if(strAddr!=std::string(cBuf))
+            return 0;
+        strCmd=strCmd.substr(nBar+1);
     }
-    else
-        nStatus=UNIX_ERROR_STATUS;
-    return nStatus;
-}
 
-int EosAdimec::PdvSerialRead(std::string& strResp)
-{
-    int nStatus;
-    std::vector<char> vBuff;
-    int nLength=0;
-    strResp="";
-    if(m_pSerialComms)
+    size_t nOpen=strCmd.find('[');
+    size_t nClose=strCmd.rfind(']');
+    if((nOpen==std::string::npos)||(nClose==std::string::npos)||(nClose<nOpen))
+        return 0;
+
+    std::string strName=boost::to_upper_copy(boost::trim_copy(strCmd.substr(0,nOpen)));
+    if(strName.empty())
+        return 0;
+    vStrCmd.push_back(strName);
+
+    std::string strArgs=strCmd.substr(nOpen+1,nClose-nOpen-1);
+    if(!boost::trim_copy(strArgs).empty())
     {
-        nStatus=m_pSerialComms->SerialRead(vBuff,nLength); // Clear out Adimec buffer
-        strResp.clear();
-        if(UNIX_OK_STATUS==nStatus)
-            ComposeDevResp(vBuff.data(),nLength,strResp);
+        std::vector<std::string> vStrArgs;
+        boost::split(vStrArgs,strArgs,boost::is_any_of(","));
+        for(auto & iarg: vStrArgs)
+            vStrCmd.push_back(boost::trim_copy(iarg));
     }
-    else
-        nStatus=UNIX_ERROR_STATUS;
 
-    return nStatus;
+    return vStrCmd.size();
 }
 
 // ######### Stuff Below is for Unit Testing (test/debugging only) #######################
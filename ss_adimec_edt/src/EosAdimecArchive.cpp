@@ -0,0 +1,535 @@
+/**
+ * Raw frame archive writer.  See EosAdimecArchive.h
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include <stdlib.h>
+
+#include <algorithm>
+#include <iostream>
+#include <vector>
+
+#include <boost/bind.hpp>
+#include <boost/thread/locks.hpp>
+
+#include "EosDevice.h"
+#include "EosAdimecArchive.h"
+#include "EosAdimecThreadPlacement.h"
+#include "EosAdimecPack.h"
+#include "EosAdimecUtil.h"
+
+// Flusher nice level: segment writes and fsyncs yield to capture.
+static const int ARCHIVE_FLUSHER_NICE=10;
+
+// Flusher wakeup with nothing staged, for Stop()
+static const int ARCHIVE_IDLE_WAIT_MS=200;
+
+// Round up to a whole record
+static size_t RecordRound(const size_t nBytes)
+{
+    const size_t nAlign=EosAdimecArchiveConst::RECORD_ALIGN;
+    return ((nBytes+nAlign-1)/nAlign)*nAlign;
+}
+
+static std::string SegmentPath(const std::string& strDir, const uint32_t nSegment)
+{
+    char cBuf[32];
+    ::snprintf(cBuf,sizeof(cBuf),"/seg_%06u.eseg",nSegment);
+    return strDir+cBuf;
+}
+
+EosAdimecArchive::EosAdimecArchive(const std::string& strBaseDir, const std::string& strPrefix,
+                                   const size_t nSegmentBytes, const uint64_t nMaxBytes,
+                                   const int nStagingFrames, const bool bPacked)
+{
+    m_strBaseDir=strBaseDir;
+    m_strPrefix=strPrefix;
+    m_nSegmentBytes=RecordRound(nSegmentBytes);
+    m_nMaxBytes=nMaxBytes;
+    m_nStagingFrames=std::max(2,nStagingFrames);
+    m_bPacked=bPacked;
+
+    m_nIndexFd=-1;
+
+    m_nSlotBytes=0;
+    m_pPool=NULL;
+
+    m_nSegmentFd=-1;
+    m_nSegment=0;
+    m_nSegmentOffset=0;
+    m_nSegmentFrames=0;
+    m_bDirect=false;
+    m_pHeaderBlock=NULL;
+
+    m_pFlusherThread=NULL;
+    m_abStop=false;
+    m_abFailed=false;
+
+    m_nSegments=0;
+    m_nFrames=0;
+    m_nBytes=0;
+    m_nSkipped=0;
+    m_nTooBig=0;
+    m_bFull=false;
+    m_dFlushMs=0.0;
+
+    return;
+}
+
+EosAdimecArchive::~EosAdimecArchive(void)
+{
+    Stop();
+    return;
+}
+
+size_t EosAdimecArchive::StagingBytes(const size_t nFrameBytes, const int nStagingFrames)
+{
+    size_t nSlotBytes=RecordRound(sizeof(EosAdimecFrameMeta)+nFrameBytes);
+    return (size_t)std::max(nStagingFrames,0)*EosAdimecFramePool::SlotStride(nSlotBytes);
+}
+
+int EosAdimecArchive::Start(const size_t nFrameBytes)
+{
+    if(m_pFlusherThread)
+        return UNIX_OK_STATUS;
+
+    const size_t nAlign=EosAdimecArchiveConst::RECORD_ALIGN;
+    m_nSlotBytes=RecordRound(sizeof(EosAdimecFrameMeta)+nFrameBytes);
+    if(m_nSegmentBytes<nAlign+m_nSlotBytes)
+    {
+        std::cerr<<__FUNCTION__<<"(): "<<(m_nSegmentBytes>>20)<<" MB segments don't hold a "
+                 <<(m_nSlotBytes>>10)<<" KB frame"<<std::endl;
+        return UNIX_ERROR_STATUS;
+    }
+
+    // Faulted in now: the capture thread's copy must not page-fault.
+    m_pPool=new EosAdimecFramePool("archive",m_nSlotBytes,m_nStagingFrames);
+    if((UNIX_OK_STATUS!=m_pPool->Start()) ||
+       (0!=::posix_memalign((void**)&m_pHeaderBlock,nAlign,nAlign)))
+    {
+        std::cerr<<__FUNCTION__<<"(): no memory for "<<m_nStagingFrames<<" staged frames"
+                 <<std::endl;
+        delete m_pPool;
+        m_pPool=NULL;
+        m_pHeaderBlock=NULL;
+        return UNIX_ERROR_STATUS;
+    }
+
+    // A new directory per archive: <base>/<prefix>_YYYYmmdd_HHMMSS (UTC)
+    struct timespec tsWall;
+    ::clock_gettime(CLOCK_REALTIME,&tsWall);
+    struct tm tmWall;
+    ::gmtime_r(&tsWall.tv_sec,&tmWall);
+    char cStamp[32];
+    ::strftime(cStamp,sizeof(cStamp),"%Y%m%d_%H%M%S",&tmWall);
+
+    EosAdimecUtil::MakeDirs(m_strBaseDir);
+    m_strDir=m_strBaseDir+"/"+m_strPrefix+"_"+cStamp;
+    for(int isuffix=2; (0!=::mkdir(m_strDir.c_str(),0750)); isuffix++)
+    {
+        if((EEXIST!=errno) || (isuffix>99))
+        {
+            std::cerr<<__FUNCTION__<<"(): "<<m_strDir<<": "<<::strerror(errno)<<std::endl;
+            Stop();
+            return UNIX_ERROR_STATUS;
+        }
+        m_strDir=m_strBaseDir+"/"+m_strPrefix+"_"+cStamp+"_"+std::to_string(isuffix);
+    }
+
+    EosAdimecArchiveIndexHeader header;
+    ::memset(&header,0,sizeof(header));
+    header.nMagic=EosAdimecArchiveConst::INDEX_MAGIC;
+    header.nVersion=EosAdimecArchiveConst::VERSION;
+    header.nHeaderBytes=sizeof(header);
+    header.nEntryBytes=sizeof(EosAdimecArchiveIndexEntry);
+    header.nStartWallSec=tsWall.tv_sec;
+    header.nStartWallNsec=tsWall.tv_nsec;
+    header.nSegmentBytes=m_nSegmentBytes;
+
+    std::string strIndex=m_strDir+"/index.eidx";
+    m_nIndexFd=::open(strIndex.c_str(),O_WRONLY|O_CREAT|O_EXCL|O_APPEND|O_CLOEXEC,0640);
+    if((m_nIndexFd<0) || !EosAdimecUtil::WriteAll(m_nIndexFd,&header,sizeof(header)))
+    {
+        std::cerr<<__FUNCTION__<<"(): "<<strIndex<<": "<<::strerror(errno)<<std::endl;
+        Stop();
+        return UNIX_ERROR_STATUS;
+    }
+
+    // The first segment now, so a bad directory or a full disk shows up here.
+    if(!NextSegment())
+    {
+        Stop();
+        return UNIX_ERROR_STATUS;
+    }
+
+    m_abStop=false;
+    m_pFlusherThread=new boost::thread(boost::bind(&EosAdimecArchive::FlusherThread,this));
+
+    return UNIX_OK_STATUS;
+}
+
+void EosAdimecArchive::Stop(void)
+{
+    if(m_pFlusherThread)
+    {
+        {
+            boost::lock_guard<boost::mutex> lock(m_mtxArchive);
+            m_abStop=true;
+            m_cvArchive.notify_all();
+        }
+
+        // The flusher writes out everything staged before it exits.
+        m_pFlusherThread->join();
+        delete m_pFlusherThread;
+        m_pFlusherThread=NULL;
+    }
+
+    CloseSegment();
+
+    if(m_nIndexFd>=0)
+    {
+        ::fdatasync(m_nIndexFd);
+        ::close(m_nIndexFd);
+        m_nIndexFd=-1;
+    }
+    if(m_pHeaderBlock)
+    {
+        ::free(m_pHeaderBlock);
+        m_pHeaderBlock=NULL;
+    }
+    if(m_pPool)
+    {
+        delete m_pPool;
+        m_pPool=NULL;
+    }
+
+    return;
+}
+
+void EosAdimecArchive::OnFrame(const EosAdimecRawFrame& frame)
+{
+    const EosAdimecPack::E_PIXEL_FORMAT eFormat=
+        m_bPacked ? EosAdimecPack::FormatForBitDepth(frame.nBitDepth) : EosAdimecPack::ePixel16;
+    const size_t nDataBytes=EosAdimecPack::PackedFrameBytes(frame.nWidth,frame.nHeight,eFormat);
+    const size_t nRecordBytes=RecordRound(sizeof(EosAdimecFrameMeta)+nDataBytes);
+
+    int nSlot=0;
+    {
+        boost::lock_guard<boost::mutex> lock(m_mtxArchive);
+        if(nRecordBytes>m_nSlotBytes)
+        {
+            m_nTooBig++;
+            return;
+        }
+        nSlot=(m_abFailed || m_bFull || (NULL==m_pPool)) ? -1 : m_pPool->Acquire();
+        if(nSlot<0)
+        {
+            m_nSkipped++;
+            return;
+        }
+    }
+
+    // Outside the lock: the slot is ours until the flusher has written it.
+    uint8_t* pRecord=m_pPool->GetSlot(nSlot);
+
+    EosAdimecFrameMeta meta;
+    ::memset(&meta,0,sizeof(meta));
+    EosAdimecFrameSource::FillMeta(frame,eFormat,nDataBytes,meta);
+    ::memcpy(pRecord,&meta,sizeof(meta));
+
+    uint8_t* pData=pRecord+sizeof(meta);
+    EosAdimecPack::Pack(frame.pData,frame.nWidth,frame.nHeight,frame.nStride,eFormat,pData);
+    // Don't write out whatever the slot held before.
+    ::memset(pData+nDataBytes,0,nRecordBytes-sizeof(meta)-nDataBytes);
+
+    Pending pending;
+    pending.nSlot=nSlot;
+    pending.nRecordBytes=nRecordBytes;
+    EosAdimecArchiveIndexEntry& entry=pending.entry;
+    entry.nSequence=meta.nSequence;
+    entry.nTimeNs=meta.nTimeNs;
+    entry.nWallSec=meta.nWallSec;
+    entry.nWallNsec=meta.nWallNsec;
+    entry.nSegment=0;
+    entry.nSettingsVersion=meta.settings.nVersion;
+    entry.nOffset=0;
+    entry.nDataBytes=nDataBytes;
+
+    boost::lock_guard<boost::mutex> lock(m_mtxArchive);
+    m_dqPending.push_back(pending);
+    m_cvArchive.notify_all();
+
+    return;
+}
+
+EosAdimecArchive::ArchiveStats EosAdimecArchive::GetStats(void)
+{
+    boost::lock_guard<boost::mutex> lock(m_mtxArchive);
+
+    ArchiveStats stats;
+    stats.strDir=m_strDir;
+    stats.nSegments=m_nSegments;
+    stats.nFrames=m_nFrames;
+    stats.nBytes=m_nBytes;
+    stats.nStaged=(m_pFlusherThread && m_pPool) ? m_pPool->GetStats().nInUse : 0;
+    stats.nSkipped=m_nSkipped;
+    stats.nTooBig=m_nTooBig;
+    stats.bDirect=m_bDirect;
+    stats.bFull=m_bFull;
+    stats.bFailed=m_abFailed;
+    stats.strError=m_strError;
+    stats.dFlushMs=m_dFlushMs;
+
+    return stats;
+}
+
+bool EosAdimecArchive::NextSegment(void)
+{
+    CloseSegment();
+
+    uint32_t nSegment=0;
+    {
+        boost::lock_guard<boost::mutex> lock(m_mtxArchive);
+        if((m_nMaxBytes>0) && ((uint64_t)(m_nSegments+1)*m_nSegmentBytes>m_nMaxBytes))
+        {
+            m_bFull=true;
+            return false;
+        }
+        nSegment=(uint32_t)m_nSegments;
+    }
+
+    std::string strPath=SegmentPath(m_strDir,nSegment);
+    bool bDirect=true;
+    int nFd=::open(strPath.c_str(),O_WRONLY|O_CREAT|O_EXCL|O_CLOEXEC|O_DIRECT,0640);
+    if((nFd<0) && (EINVAL==errno))
+    {
+        // No O_DIRECT on this filesystem
+        ::unlink(strPath.c_str());
+        bDirect=false;
+        nFd=::open(strPath.c_str(),O_WRONLY|O_CREAT|O_EXCL|O_CLOEXEC,0640);
+    }
+    if(nFd<0)
+    {
+        Fail(strPath+": "+::strerror(errno));
+        return false;
+    }
+
+    // Allocated up front: no block allocation while frames are written,
+    // and a full disk shows up here.
+    int nError=::posix_fallocate(nFd,0,m_nSegmentBytes);
+    if(0!=nError)
+    {
+        ::close(nFd);
+        ::unlink(strPath.c_str());
+        Fail(strPath+": "+::strerror(nError));
+        return false;
+    }
+
+    boost::unique_lock<boost::mutex> lock(m_mtxArchive);
+    m_bDirect=bDirect;
+    lock.unlock();
+
+    m_nSegmentFd=nFd;
+    m_nSegment=nSegment;
+    m_nSegmentOffset=EosAdimecArchiveConst::RECORD_ALIGN;
+    m_nSegmentFrames=0;
+
+    ::memset(m_pHeaderBlock,0,EosAdimecArchiveConst::RECORD_ALIGN);
+    EosAdimecArchiveSegmentHeader* pHeader=(EosAdimecArchiveSegmentHeader*)m_pHeaderBlock;
+    pHeader->nMagic=EosAdimecArchiveConst::SEGMENT_MAGIC;
+    pHeader->nVersion=EosAdimecArchiveConst::VERSION;
+    pHeader->nSegment=nSegment;
+    pHeader->nHeaderBytes=EosAdimecArchiveConst::RECORD_ALIGN;
+    pHeader->nFrameMetaBytes=sizeof(EosAdimecFrameMeta);
+    if(!WriteSegment(m_pHeaderBlock,EosAdimecArchiveConst::RECORD_ALIGN,0))
+    {
+        Fail(strPath+": "+::strerror(errno));
+        ::close(m_nSegmentFd);
+        m_nSegmentFd=-1;
+        return false;
+    }
+
+    lock.lock();
+    m_nSegments++;
+
+    return true;
+}
+
+void EosAdimecArchive::CloseSegment(void)
+{
+    if(m_nSegmentFd<0)
+        return;
+
+    EosAdimecArchiveSegmentHeader* pHeader=(EosAdimecArchiveSegmentHeader*)m_pHeaderBlock;
+    pHeader->nFrames=m_nSegmentFrames;
+    pHeader->nUsedBytes=m_nSegmentOffset;
+
+    // Give back the preallocated tail.
+    bool bOk=WriteSegment(m_pHeaderBlock,EosAdimecArchiveConst::RECORD_ALIGN,0) &&
+             (0==::ftruncate(m_nSegmentFd,m_nSegmentOffset)) && (0==::fdatasync(m_nSegmentFd));
+    if(!bOk)
+        Fail(SegmentPath(m_strDir,m_nSegment)+": "+::strerror(errno));
+    if(!m_bDirect)
+        ::posix_fadvise(m_nSegmentFd,0,0,POSIX_FADV_DONTNEED);
+    ::close(m_nSegmentFd);
+    m_nSegmentFd=-1;
+
+    return;
+}
+
+bool EosAdimecArchive::WriteSegment(const void* pData, const size_t nBytes, const uint64_t nOffset)
+{
+    const uint8_t* pByte=(const uint8_t*)pData;
+    size_t nDone=0;
+    while(nDone<nBytes)
+    {
+        ssize_t nWritten=::pwrite(m_nSegmentFd,pByte+nDone,nBytes-nDone,nOffset+nDone);
+        if(nWritten<0)
+        {
+            if(EINTR==errno)
+                continue;
+            return false;
+        }
+        nDone+=nWritten;
+    }
+    return true;
+}
+
+void EosAdimecArchive::FlusherThread(void)
+{
+    // Per-thread on Linux: only the flusher is niced.
+    EosAdimecThreadPlacement::ApplyBackground(ARCHIVE_FLUSHER_NICE);
+
+    boost::unique_lock<boost::mutex> lock(m_mtxArchive);
+    while(true)
+    {
+        if(!m_dqPending.empty())
+        {
+            std::deque<Pending> dqBatch;
+            dqBatch.swap(m_dqPending);
+
+            lock.unlock();
+            uint64_t nStartNs=EosAdimecUtil::MonotonicNs();
+            FlushBatch(dqBatch);
+            double dFlushMs=(EosAdimecUtil::MonotonicNs()-nStartNs)/1.0e6;
+            lock.lock();
+
+            for(auto & ipending: dqBatch)
+                m_pPool->Release(ipending.nSlot);
+            m_dFlushMs=dFlushMs;
+            continue;
+        }
+
+        if(m_abStop)
+            break;
+
+        m_cvArchive.timed_wait(lock,boost::get_system_time()+
+                               boost::posix_time::milliseconds(ARCHIVE_IDLE_WAIT_MS));
+    }
+    return;
+}
+
+void EosAdimecArchive::FlushBatch(std::deque<Pending>& dqBatch)
+{
+    // Entries are indexed only once their frames are durable, one
+    // segment at a time.
+    std::vector<EosAdimecArchiveIndexEntry> vCommit;
+    uint64_t nCommitBytes=0;
+    unsigned long nLost=0;
+    bool bOk=!m_abFailed;
+
+    for(size_t ipending=0; ipending<=dqBatch.size(); ipending++)
+    {
+        bool bLast=(ipending==dqBatch.size());
+        bool bSwitch=!bLast && bOk &&
+            ((m_nSegmentFd<0) ||
+             (m_nSegmentOffset+dqBatch[ipending].nRecordBytes>m_nSegmentBytes));
+
+        if((bLast || bSwitch || !bOk) && !vCommit.empty())
+        {
+            if(0!=::fdatasync(m_nSegmentFd))
+            {
+                Fail(SegmentPath(m_strDir,m_nSegment)+": "+::strerror(errno));
+                bOk=false;
+            }
+            if(!m_bDirect)
+                ::posix_fadvise(m_nSegmentFd,0,0,POSIX_FADV_DONTNEED);
+            if(bOk && !EosAdimecUtil::WriteAll(m_nIndexFd,vCommit.data(),
+                                vCommit.size()*sizeof(EosAdimecArchiveIndexEntry)))
+            {
+                Fail(m_strDir+"/index.eidx: "+::strerror(errno));
+                bOk=false;
+            }
+
+            boost::lock_guard<boost::mutex> lock(m_mtxArchive);
+            if(bOk)
+            {
+                m_nFrames+=vCommit.size();
+                m_nBytes+=nCommitBytes;
+            }
+            else
+            {
+                nLost+=vCommit.size();
+            }
+            vCommit.clear();
+            nCommitBytes=0;
+        }
+        if(bLast)
+            break;
+
+        if(bSwitch && !NextSegment())
+            bOk=false;
+        if(!bOk)
+        {
+            nLost++;
+            continue;
+        }
+
+        Pending& pending=dqBatch[ipending];
+        EosAdimecArchiveIndexEntry& entry=pending.entry;
+        entry.nSegment=m_nSegment;
+        entry.nOffset=m_nSegmentOffset;
+        if(!WriteSegment(m_pPool->GetSlot(pending.nSlot),pending.nRecordBytes,
+                         m_nSegmentOffset))
+        {
+            Fail(SegmentPath(m_strDir,m_nSegment)+": "+::strerror(errno));
+            bOk=false;
+            nLost++;
+            continue;
+        }
+        if(!m_bDirect)
+            ::sync_file_range(m_nSegmentFd,m_nSegmentOffset,pending.nRecordBytes,
+                              SYNC_FILE_RANGE_WRITE);
+
+        m_nSegmentOffset+=pending.nRecordBytes;
+        m_nSegmentFrames++;
+        nCommitBytes+=pending.nRecordBytes;
+        vCommit.push_back(entry);
+    }
+
+    if(nLost>0)
+    {
+        boost::lock_guard<boost::mutex> lock(m_mtxArchive);
+        m_nSkipped+=nLost;
+    }
+
+    return;
+}
+
+void EosAdimecArchive::Fail(const std::string& strError)
+{
+    std::cerr<<"EosAdimecArchive: "<<strError<<"; archiving stopped"<<std::endl;
+
+    boost::lock_guard<boost::mutex> lock(m_mtxArchive);
+    if(!m_abFailed)
+        m_strError=strError;
+    m_abFailed=true;
+    return;
+}
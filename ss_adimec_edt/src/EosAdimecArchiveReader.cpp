@@ -0,0 +1,221 @@
+/**
+ * Reader side of the raw frame archive.  See EosAdimecArchiveReader.h
+ */
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <algorithm>
+
+#include "EosAdimecArchiveReader.h"
+
+static bool TimeLess(const EosAdimecArchiveIndexEntry& entry, const uint64_t nTimeNs)
+{
+    return entry.nTimeNs<nTimeNs;
+}
+
+static bool WallLess(const EosAdimecArchiveIndexEntry& entry, const struct timespec& tsWall)
+{
+    return (entry.nWallSec<tsWall.tv_sec) ||
+           ((entry.nWallSec==tsWall.tv_sec) && (entry.nWallNsec<tsWall.tv_nsec));
+}
+
+static bool SequenceLess(const EosAdimecArchiveIndexEntry& entry, const uint64_t nSequence)
+{
+    return entry.nSequence<nSequence;
+}
+
+EosAdimecArchiveReader::EosAdimecArchiveReader(void)
+{
+    m_nIndexFd=-1;
+    m_pIndex=NULL;
+    m_nIndexBytes=0;
+    m_pHeader=NULL;
+    m_pEntries=NULL;
+    m_nFrames=0;
+
+    m_nSegment=-1;
+    m_pSegment=NULL;
+    m_nSegmentBytes=0;
+
+    return;
+}
+
+EosAdimecArchiveReader::~EosAdimecArchiveReader(void)
+{
+    Close();
+    return;
+}
+
+int EosAdimecArchiveReader::Open(const std::string& strDir)
+{
+    Close();
+
+    m_strDir=strDir;
+    m_nIndexFd=::open((strDir+"/index.eidx").c_str(),O_RDONLY|O_CLOEXEC);
+    if((m_nIndexFd<0) || (0!=Refresh()))
+    {
+        Close();
+        return -1;
+    }
+
+    if((m_pHeader->nMagic!=EosAdimecArchiveConst::INDEX_MAGIC) ||
+       (m_pHeader->nVersion!=EosAdimecArchiveConst::VERSION) ||
+       (m_pHeader->nEntryBytes!=sizeof(EosAdimecArchiveIndexEntry)) ||
+       (m_pHeader->nHeaderBytes<sizeof(EosAdimecArchiveIndexHeader)))
+    {
+        Close();
+        return -1;
+    }
+
+    return 0;
+}
+
+void EosAdimecArchiveReader::Close(void)
+{
+    UnmapSegment();
+
+    if(m_pIndex)
+    {
+        ::munmap(m_pIndex,m_nIndexBytes);
+        m_pIndex=NULL;
+    }
+    m_nIndexBytes=0;
+    m_pHeader=NULL;
+    m_pEntries=NULL;
+    m_nFrames=0;
+
+    if(m_nIndexFd>=0)
+    {
+        ::close(m_nIndexFd);
+        m_nIndexFd=-1;
+    }
+
+    return;
+}
+
+int EosAdimecArchiveReader::Refresh(void)
+{
+    if(m_nIndexFd<0)
+        return -1;
+
+    struct stat st;
+    if(0!=::fstat(m_nIndexFd,&st))
+        return -1;
+    size_t nBytes=(size_t)st.st_size;
+    if(nBytes<sizeof(EosAdimecArchiveIndexHeader))
+        return -1;
+    if(m_pIndex && (nBytes==m_nIndexBytes))
+        return 0;
+
+    void* pMap=::mmap(NULL,nBytes,PROT_READ,MAP_SHARED,m_nIndexFd,0);
+    if(MAP_FAILED==pMap)
+        return -1;
+    if(m_pIndex)
+        ::munmap(m_pIndex,m_nIndexBytes);
+
+    m_pIndex=(uint8_t*)pMap;
+    m_nIndexBytes=nBytes;
+    m_pHeader=(const EosAdimecArchiveIndexHeader*)m_pIndex;
+
+    // A live index may end in a half-written entry: leave it out.
+    size_t nHeaderBytes=std::min((size_t)m_pHeader->nHeaderBytes,nBytes);
+    m_pEntries=(const EosAdimecArchiveIndexEntry*)(m_pIndex+nHeaderBytes);
+    m_nFrames=(nBytes-nHeaderBytes)/sizeof(EosAdimecArchiveIndexEntry);
+
+    return 0;
+}
+
+size_t EosAdimecArchiveReader::FindTime(const uint64_t nTimeNs) const
+{
+    return std::lower_bound(m_pEntries,m_pEntries+m_nFrames,nTimeNs,TimeLess)-m_pEntries;
+}
+
+// Assumes the wall clock was not stepped back while recording.
+size_t EosAdimecArchiveReader::FindWallTime(const int64_t nWallSec, const int64_t nWallNsec) const
+{
+    struct timespec tsWall;
+    tsWall.tv_sec=nWallSec;
+    tsWall.tv_nsec=nWallNsec;
+    return std::lower_bound(m_pEntries,m_pEntries+m_nFrames,tsWall,WallLess)-m_pEntries;
+}
+
+size_t EosAdimecArchiveReader::FindSequence(const uint64_t nSequence) const
+{
+    return std::lower_bound(m_pEntries,m_pEntries+m_nFrames,nSequence,SequenceLess)-m_pEntries;
+}
+
+int EosAdimecArchiveReader::ReadFrame(const size_t nFrame, FrameView& view)
+{
+    if(nFrame>=m_nFrames)
+        return -1;
+
+    const EosAdimecArchiveIndexEntry& entry=m_pEntries[nFrame];
+    if((entry.nSegment!=m_nSegment) && (0!=MapSegment(entry.nSegment)))
+        return -1;
+
+    const EosAdimecArchiveSegmentHeader* pHeader=(const EosAdimecArchiveSegmentHeader*)m_pSegment;
+    size_t nMetaBytes=pHeader->nFrameMetaBytes;
+    if((nMetaBytes!=sizeof(EosAdimecFrameMeta)) ||
+       (entry.nOffset+nMetaBytes+entry.nDataBytes>m_nSegmentBytes))
+    {
+        return -1;
+    }
+
+    ::memcpy(&view.meta,m_pSegment+entry.nOffset,sizeof(view.meta));
+    if((view.meta.nSequence!=entry.nSequence) || (view.meta.nDataBytes!=entry.nDataBytes))
+        return -1;
+    view.pData=(const uint16_t*)(m_pSegment+entry.nOffset+nMetaBytes);
+
+    return 0;
+}
+
+int EosAdimecArchiveReader::MapSegment(const uint32_t nSegment)
+{
+    UnmapSegment();
+
+    char cBuf[32];
+    ::snprintf(cBuf,sizeof(cBuf),"/seg_%06u.eseg",nSegment);
+    int nFd=::open((m_strDir+cBuf).c_str(),O_RDONLY|O_CLOEXEC);
+    if(nFd<0)
+        return -1;
+
+    struct stat st;
+    void* pMap=MAP_FAILED;
+    if((0==::fstat(nFd,&st)) && ((size_t)st.st_size>=sizeof(EosAdimecArchiveSegmentHeader)))
+        pMap=::mmap(NULL,(size_t)st.st_size,PROT_READ,MAP_SHARED,nFd,0);
+    ::close(nFd);
+    if(MAP_FAILED==pMap)
+        return -1;
+
+    m_pSegment=(uint8_t*)pMap;
+    m_nSegmentBytes=(size_t)st.st_size;
+    ::madvise(m_pSegment,m_nSegmentBytes,MADV_SEQUENTIAL);
+
+    const EosAdimecArchiveSegmentHeader* pHeader=(const EosAdimecArchiveSegmentHeader*)m_pSegment;
+    if((pHeader->nMagic!=EosAdimecArchiveConst::SEGMENT_MAGIC) ||
+       (pHeader->nVersion!=EosAdimecArchiveConst::VERSION) || (pHeader->nSegment!=nSegment))
+    {
+        UnmapSegment();
+        return -1;
+    }
+    m_nSegment=nSegment;
+
+    return 0;
+}
+
+void EosAdimecArchiveReader::UnmapSegment(void)
+{
+    if(m_pSegment)
+    {
+        ::munmap(m_pSegment,m_nSegmentBytes);
+        m_pSegment=NULL;
+    }
+    m_nSegmentBytes=0;
+    m_nSegment=-1;
+    return;
+}
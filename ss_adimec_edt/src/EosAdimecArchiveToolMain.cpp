@@ -0,0 +1,204 @@
+/**
+   Command-line access to a raw frame archive (EosAdimecArchive).
+
+      EosAdimecArchiveTool.x info <archive_dir>
+      EosAdimecArchiveTool.x list <archive_dir> [from [to]]
+      EosAdimecArchiveTool.x extract <archive_dir> <from> <to> <out.eraw>
+
+   from/to pick frames through the index (no scan), both ends included:
+      12.5              seconds after the first frame
+      @1760000000.25    wall clock (seconds since the epoch, UTC)
+      #1234             capture sequence number
+
+   extract writes the frames as one recording file in the TRIGGER_SAVE
+   format (EosAdimecRecordingLayout.h, trigger id 0), so the same review
+   tools read both.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <iostream>
+#include <string>
+
+#include "EosAdimecArchiveReader.h"
+#include "EosAdimecRecordingLayout.h"
+
+static void Usage(const char* pcProgram)
+{
+    std::cerr<<"Usage: "<<pcProgram<<" info <archive_dir>"<<std::endl
+             <<"       "<<pcProgram<<" list <archive_dir> [from [to]]"<<std::endl
+             <<"       "<<pcProgram<<" extract <archive_dir> <from> <to> <out.eraw>"<<std::endl
+             <<"from/to: seconds after the first frame, @epoch_seconds or #sequence"<<std::endl;
+    return;
+}
+
+/**
+   First frame of the range starting at strTime (bEnd false), or the
+   frame after the range ending at strTime (bEnd true).  False if
+   strTime doesn't parse.
+ */
+static bool FindFrame(const EosAdimecArchiveReader& reader, const std::string& strTime,
+                      const bool bEnd, size_t& nFrame)
+{
+    char* pcEnd=NULL;
+    if(strTime.empty())
+        return false;
+
+    if('#'==strTime[0])
+    {
+        unsigned long long nSequence=::strtoull(strTime.c_str()+1,&pcEnd,10);
+        if((pcEnd==strTime.c_str()+1) || ('\0'!=*pcEnd))
+            return false;
+        nFrame=reader.FindSequence(nSequence+(bEnd ? 1 : 0));
+        return true;
+    }
+
+    bool bWall=('@'==strTime[0]);
+    const char* pcStart=strTime.c_str()+(bWall ? 1 : 0);
+    double dSec=::strtod(pcStart,&pcEnd);
+    if((pcEnd==pcStart) || ('\0'!=*pcEnd) || (dSec<0.0))
+        return false;
+
+    if(bWall)
+    {
+        int64_t nSec=(int64_t)dSec;
+        int64_t nNsec=(int64_t)((dSec-nSec)*1.0e9)+(bEnd ? 1 : 0);
+        nFrame=reader.FindWallTime(nSec+nNsec/1000000000,nNsec%1000000000);
+        return true;
+    }
+
+    uint64_t nFirstNs=(reader.GetFrameCount()>0) ? reader.GetEntry(0).nTimeNs : 0;
+    nFrame=reader.FindTime(nFirstNs+(uint64_t)(dSec*1.0e9)+(bEnd ? 1 : 0));
+    return true;
+}
+
+static void PrintEntry(const EosAdimecArchiveReader& reader, const size_t nFrame)
+{
+    const EosAdimecArchiveIndexEntry& entry=reader.GetEntry(nFrame);
+    double dRelSec=(entry.nTimeNs-reader.GetEntry(0).nTimeNs)/1.0e9;
+    ::printf("%8zu seq=%llu t=%.6f wall=%lld.%09lld settings=%u segment=%u offset=%llu\n",
+             nFrame,(unsigned long long)entry.nSequence,dRelSec,(long long)entry.nWallSec,
+             (long long)entry.nWallNsec,entry.nSettingsVersion,entry.nSegment,
+             (unsigned long long)entry.nOffset);
+    return;
+}
+
+static int Info(EosAdimecArchiveReader& reader)
+{
+    const EosAdimecArchiveIndexHeader& header=reader.GetHeader();
+    size_t nFrames=reader.GetFrameCount();
+
+    ::printf("started wall=%lld.%09lld segment_mb=%llu frames=%zu\n",
+             (long long)header.nStartWallSec,(long long)header.nStartWallNsec,
+             (unsigned long long)(header.nSegmentBytes>>20),nFrames);
+    if(0==nFrames)
+        return 0;
+
+    const EosAdimecArchiveIndexEntry& first=reader.GetEntry(0);
+    const EosAdimecArchiveIndexEntry& last=reader.GetEntry(nFrames-1);
+    double dSpanSec=(last.nTimeNs-first.nTimeNs)/1.0e9;
+    uint64_t nMissing=(last.nSequence-first.nSequence+1)-nFrames;
+    ::printf("sequence %llu-%llu (%llu missing), %.3f s, segments %u-%u\n",
+             (unsigned long long)first.nSequence,(unsigned long long)last.nSequence,
+             (unsigned long long)nMissing,dSpanSec,first.nSegment,last.nSegment);
+    PrintEntry(reader,0);
+    PrintEntry(reader,nFrames-1);
+    return 0;
+}
+
+static int Extract(EosAdimecArchiveReader& reader, const size_t nFirst, const size_t nEnd,
+                   const std::string& strOut)
+{
+    FILE* pFile=::fopen(strOut.c_str(),"wbx");
+    if(NULL==pFile)
+    {
+        ::perror(strOut.c_str());
+        return 1;
+    }
+
+    EosAdimecRecordingHeader header;
+    ::memset(&header,0,sizeof(header));
+    header.nMagic=EosAdimecRecordingConst::MAGIC;
+    header.nVersion=EosAdimecRecordingConst::VERSION;
+    header.nHeaderBytes=sizeof(header);
+    header.nFrameMetaBytes=sizeof(EosAdimecFrameMeta);
+    if(nFirst<nEnd)
+    {
+        const EosAdimecArchiveIndexEntry& first=reader.GetEntry(nFirst);
+        header.nTriggerTimeNs=first.nTimeNs;
+        header.nTriggerWallSec=first.nWallSec;
+        header.nTriggerWallNsec=first.nWallNsec;
+        header.nPostMs=(uint32_t)((reader.GetEntry(nEnd-1).nTimeNs-first.nTimeNs)/1000000);
+    }
+
+    bool bOk=(1==::fwrite(&header,sizeof(header),1,pFile));
+    uint64_t nFrames=0;
+    for(size_t iframe=nFirst; bOk && (iframe<nEnd); iframe++)
+    {
+        EosAdimecArchiveReader::FrameView view;
+        if(0!=reader.ReadFrame(iframe,view))
+        {
+            std::cerr<<"frame "<<iframe<<" unreadable, skipped"<<std::endl;
+            continue;
+        }
+        bOk=(1==::fwrite(&view.meta,sizeof(view.meta),1,pFile)) &&
+            (1==::fwrite(view.pData,view.meta.nDataBytes,1,pFile));
+        nFrames++;
+    }
+
+    header.nFrames=nFrames;
+    bOk=bOk && (0==::fseek(pFile,0,SEEK_SET)) && (1==::fwrite(&header,sizeof(header),1,pFile));
+    bOk=(0==::fclose(pFile)) && bOk;
+    if(!bOk)
+    {
+        ::perror(strOut.c_str());
+        return 1;
+    }
+
+    ::printf("%llu frames --> %s\n",(unsigned long long)nFrames,strOut.c_str());
+    return 0;
+}
+
+int main(int argc, char* argv[])
+{
+    if(argc<3)
+    {
+        Usage(argv[0]);
+        return 1;
+    }
+
+    std::string strCommand=argv[1];
+    EosAdimecArchiveReader reader;
+    if(0!=reader.Open(argv[2]))
+    {
+        std::cerr<<argv[2]<<": not an archive"<<std::endl;
+        return 1;
+    }
+
+    size_t nFirst=0;
+    size_t nEnd=reader.GetFrameCount();
+    if(((argc>3) && !FindFrame(reader,argv[3],false,nFirst)) ||
+       ((argc>4) && !FindFrame(reader,argv[4],true,nEnd)))
+    {
+        Usage(argv[0]);
+        return 1;
+    }
+
+    if(("info"==strCommand) && (3==argc))
+        return Info(reader);
+
+    if(("list"==strCommand) && (argc<=5))
+    {
+        for(size_t iframe=nFirst; iframe<nEnd; iframe++)
+            PrintEntry(reader,iframe);
+        return 0;
+    }
+
+    if(("extract"==strCommand) && (6==argc))
+        return Extract(reader,nFirst,nEnd,argv[5]);
+
+    Usage(argv[0]);
+    return 1;
+}
@@ -0,0 +1,348 @@
+/**
+ * In-process auto-exposure.  See EosAdimecAutoExposure.h
+ */
+
+#include <string.h>
+#include <math.h>
+
+#include <algorithm>
+
+#include <boost/bind.hpp>
+#include <boost/thread/locks.hpp>
+
+#include "EosDevice.h"
+#include "EosAdimecAutoExposure.h"
+#include "EosAdimecThreadPlacement.h"
+
+// Histogram bins (8-bit luminance)
+static const int AE_BINS=256;
+
+// Quads metered per frame, at most (the ROI is subsampled evenly)
+static const int AE_MAX_SAMPLES=16384;
+
+// A quad with any pixel at or above this share of full scale is saturated
+static const double AE_SATURATED_LEVEL=0.98;
+
+// No change while the metered level is within this ratio of the target
+static const double AE_DEADBAND=0.04;
+
+// Largest exposure change in one step (either way)
+static const double AE_MAX_STEP=4.0;
+
+// Highlights: never raise the exposure past where this percentile of the
+// histogram would saturate; above this share of saturated pixels (where
+// the percentile can't be measured), cut by at least AE_HIGHLIGHT_CUT.
+static const double AE_HIGHLIGHT_PERCENTILE=95.0;
+static const double AE_HIGHLIGHT_PCT=5.0;
+static const double AE_HIGHLIGHT_CUT=0.8;
+
+EosAdimecAutoExposure::EosAdimecAutoExposure(ApplyFn fnApply, const int nItMin, const int nItMax,
+                                             const int nGainMin, const int nGainMax)
+{
+    m_fnApply=fnApply;
+    m_nItMin=nItMin;
+    m_nItMax=nItMax;
+    m_nGainMin=nGainMin;
+    m_nGainMax=nGainMax;
+
+    m_pLoopThread=NULL;
+    m_abStop=false;
+
+    m_params.bEnable=false;
+    m_params.nTargetPct=40;
+    m_params.nRoiX=0;
+    m_params.nRoiY=0;
+    m_params.nRoiW=0;
+    m_params.nRoiH=0;
+    m_params.nRateHz=5;
+
+    ::memset(&m_status,0,sizeof(m_status));
+    m_status.nIntegrationTime=-1;
+    m_status.nGain=-1;
+
+    m_bWantFrame=false;
+    m_nWaitVersion=0;
+    m_bHaveMetering=false;
+    ::memset(&m_metering,0,sizeof(m_metering));
+
+    return;
+}
+
+EosAdimecAutoExposure::~EosAdimecAutoExposure(void)
+{
+    Stop();
+    return;
+}
+
+int EosAdimecAutoExposure::Start(void)
+{
+    if(m_pLoopThread)
+        return UNIX_OK_STATUS;
+
+    m_abStop=false;
+    m_pLoopThread=new boost::thread(boost::bind(&EosAdimecAutoExposure::LoopThread,this));
+
+    return UNIX_OK_STATUS;
+}
+
+void EosAdimecAutoExposure::Stop(void)
+{
+    {
+        boost::lock_guard<boost::mutex> lock(m_mtxAe);
+        m_abStop=true;
+        m_cvAe.notify_all();
+    }
+
+    if(m_pLoopThread)
+    {
+        m_pLoopThread->join();
+        delete m_pLoopThread;
+        m_pLoopThread=NULL;
+    }
+
+    return;
+}
+
+void EosAdimecAutoExposure::OnFrame(const EosAdimecRawFrame& frame)
+{
+    AeParams params;
+    {
+        boost::lock_guard<boost::mutex> lock(m_mtxAe);
+        if(!m_bWantFrame || frame.bSettingsChanging ||
+           (frame.settings.nVersion<m_nWaitVersion))
+            return;
+        params=m_params;
+    }
+
+    // Outside the lock: SetParams() and GetStatus() don't wait on the meter.
+    Metering metering;
+    Meter(frame,params,metering);
+
+    boost::lock_guard<boost::mutex> lock(m_mtxAe);
+    m_metering=metering;
+    m_bHaveMetering=true;
+    m_bWantFrame=false;
+    m_cvAe.notify_all();
+
+    return;
+}
+
+void EosAdimecAutoExposure::SetParams(const AeParams& params)
+{
+    boost::lock_guard<boost::mutex> lock(m_mtxAe);
+    m_params=params;
+    m_cvAe.notify_all();
+    return;
+}
+
+EosAdimecAutoExposure::AeParams EosAdimecAutoExposure::GetParams(void)
+{
+    boost::lock_guard<boost::mutex> lock(m_mtxAe);
+    return m_params;
+}
+
+EosAdimecAutoExposure::AeStatus EosAdimecAutoExposure::GetStatus(void)
+{
+    boost::lock_guard<boost::mutex> lock(m_mtxAe);
+    return m_status;
+}
+
+void EosAdimecAutoExposure::LoopThread(void)
+{
+    // Re-check the enable flag this often while disabled
+    static const int IDLE_WAIT_MS=200;
+
+    EosAdimecThreadPlacement::Apply(EosAdimecThreadPlacement::eRoleSerial);
+
+    boost::unique_lock<boost::mutex> lock(m_mtxAe);
+    while(!m_abStop)
+    {
+        if(!m_params.bEnable)
+        {
+            m_bWantFrame=false;
+            m_cvAe.timed_wait(lock,boost::get_system_time()+
+                              boost::posix_time::milliseconds(IDLE_WAIT_MS));
+            continue;
+        }
+
+        // Ask the capture thread for the next frame at the awaited version.
+        boost::system_time tNext=boost::get_system_time()+
+            boost::posix_time::microseconds(1000000/std::max(1,m_params.nRateHz));
+        m_bHaveMetering=false;
+        m_bWantFrame=true;
+        while(!m_abStop && m_params.bEnable && !m_bHaveMetering)
+            m_cvAe.timed_wait(lock,boost::get_system_time()+
+                              boost::posix_time::milliseconds(IDLE_WAIT_MS));
+        if(m_abStop || !m_bHaveMetering)
+            continue;
+
+        Metering metering=m_metering;
+
+        // The camera is commanded without our lock: the controller holds
+        // its dispatch lock around SCIP handlers that call SetParams().
+        lock.unlock();
+        Step(metering);
+        lock.lock();
+
+        // Loop rate
+        while(!m_abStop && m_params.bEnable && (boost::get_system_time()<tNext))
+            m_cvAe.timed_wait(lock,tNext);
+    }
+
+    m_bWantFrame=false;
+    return;
+}
+
+bool EosAdimecAutoExposure::Step(const Metering& metering)
+{
+    int nTargetPct;
+    {
+        boost::lock_guard<boost::mutex> lock(m_mtxAe);
+        nTargetPct=m_params.nTargetPct;
+        m_status.nIterations++;
+        m_status.dMeanPct=metering.dMeanPct;
+        m_status.dSaturatedPct=metering.dSaturatedPct;
+    }
+
+    // Integration time can't be longer than the frame period.
+    int nItMax=m_nItMax;
+    if((metering.settings.nFramePeriod>0) && (metering.settings.nFramePeriod<nItMax))
+        nItMax=std::max(m_nItMin,metering.settings.nFramePeriod);
+
+    int nIt=metering.settings.nIntegrationTime;
+    int nGain=metering.settings.nGain;
+
+    bool bConverged=false;
+    if((nIt<m_nItMin) || (nGain<m_nGainMin))
+    {
+        // Exposure unknown (never set since start-up): start from a
+        // quarter of the longest integration time at minimum gain.
+        nIt=std::max(m_nItMin,nItMax/4);
+        nGain=m_nGainMin;
+    }
+    else
+    {
+        double dRatio=(double)nTargetPct/std::max(metering.dMeanPct,0.5);
+        if(metering.dSaturatedPct>AE_HIGHLIGHT_PCT)
+            dRatio=std::min(dRatio,AE_HIGHLIGHT_CUT);
+        else
+            dRatio=std::min(dRatio,100.0*AE_SATURATED_LEVEL/std::max(metering.dHighPct,0.5));
+        dRatio=std::min(std::max(dRatio,1.0/AE_MAX_STEP),AE_MAX_STEP);
+
+        if(::fabs(dRatio-1.0)<AE_DEADBAND)
+        {
+            bConverged=true;
+        }
+        else
+        {
+            // Exposure in integration-time units at minimum gain.
+            double dExposure=(double)nIt*nGain/m_nGainMin*dRatio;
+            if(dExposure<=nItMax)
+            {
+                nIt=std::max(m_nItMin,(int)(dExposure+0.5));
+                nGain=m_nGainMin;
+            }
+            else
+            {
+                nIt=nItMax;
+                nGain=std::min(m_nGainMax,(int)(dExposure/nItMax*m_nGainMin+0.5));
+            }
+            bConverged=(nIt==metering.settings.nIntegrationTime) &&
+                (nGain==metering.settings.nGain);
+        }
+    }
+
+    bool bOk=true;
+    uint32_t nVersion=metering.settings.nVersion;
+    if(!bConverged)
+        bOk=(UNIX_OK_STATUS==m_fnApply(nIt,nGain,nVersion));
+
+    boost::lock_guard<boost::mutex> lock(m_mtxAe);
+    m_status.bConverged=bConverged;
+    if(!bConverged)
+    {
+        m_status.nCommands++;
+        if(bOk)
+        {
+            m_status.nIntegrationTime=nIt;
+            m_status.nGain=nGain;
+        }
+        else
+        {
+            m_status.nErrors++;
+        }
+    }
+    m_nWaitVersion=nVersion;
+
+    return bOk;
+}
+
+void EosAdimecAutoExposure::Meter(const EosAdimecRawFrame& frame, const AeParams& params,
+                                  Metering& metering)
+{
+    metering.settings=frame.settings;
+    metering.dMeanPct=0.0;
+    metering.dSaturatedPct=0.0;
+    metering.dHighPct=0.0;
+
+    // ROI on whole 2x2 quads, clipped to the frame
+    int nX=std::max(0,std::min(params.nRoiX,frame.nWidth-2))&~1;
+    int nY=std::max(0,std::min(params.nRoiY,frame.nHeight-2))&~1;
+    int nW=(params.nRoiW>0) ? params.nRoiW : frame.nWidth;
+    int nH=(params.nRoiH>0) ? params.nRoiH : frame.nHeight;
+    int nQuadsX=std::min(nW,frame.nWidth-nX)/2;
+    int nQuadsY=std::min(nH,frame.nHeight-nY)/2;
+    if((nQuadsX<1) || (nQuadsY<1))
+        return;
+
+    int nStep=1;
+    while(((nQuadsX+nStep-1)/nStep)*((nQuadsY+nStep-1)/nStep)>AE_MAX_SAMPLES)
+        nStep++;
+
+    const int nShift=std::max(0,frame.nBitDepth-8);
+    const int nSaturated=(int)(AE_SATURATED_LEVEL*((1<<frame.nBitDepth)-1));
+
+    unsigned long anHist[AE_BINS];
+    ::memset(anHist,0,sizeof(anHist));
+    unsigned long nSamples=0;
+    unsigned long nSaturatedSamples=0;
+
+    for(int iqy=0; iqy<nQuadsY; iqy+=nStep)
+    {
+        const uint16_t* pRow0=frame.pData+(size_t)(nY+2*iqy)*frame.nStride+nX;
+        const uint16_t* pRow1=pRow0+frame.nStride;
+        for(int iqx=0; iqx<nQuadsX; iqx+=nStep)
+        {
+            int n00=pRow0[2*iqx];
+            int n01=pRow0[2*iqx+1];
+            int n10=pRow1[2*iqx];
+            int n11=pRow1[2*iqx+1];
+
+            // R+2G+B over 4, whatever the Bayer order
+            int nLuma=((n00+n01+n10+n11)>>2)>>nShift;
+            anHist[std::min(nLuma,AE_BINS-1)]++;
+
+            if(std::max(std::max(n00,n01),std::max(n10,n11))>=nSaturated)
+                nSaturatedSamples++;
+            nSamples++;
+        }
+    }
+
+    double dSum=0.0;
+    unsigned long nHighRank=(unsigned long)(nSamples*AE_HIGHLIGHT_PERCENTILE/100.0);
+    unsigned long nBelow=0;
+    int nHighBin=-1;
+    for(int ibin=0; ibin<AE_BINS; ibin++)
+    {
+        dSum+=(double)ibin*anHist[ibin];
+        nBelow+=anHist[ibin];
+        if((nHighBin<0) && (nBelow>nHighRank))
+            nHighBin=ibin;
+    }
+
+    metering.dMeanPct=100.0*dSum/((double)nSamples*(AE_BINS-1));
+    metering.dSaturatedPct=100.0*nSaturatedSamples/nSamples;
+    metering.dHighPct=100.0*(nHighBin+1)/AE_BINS;
+
+    return;
+}
@@ -0,0 +1,449 @@
+/**
+ * In-process automatic white balance.  See EosAdimecAutoWhiteBalance.h
+ */
+
+#include <string.h>
+#include <math.h>
+
+#include <algorithm>
+
+#include <boost/bind.hpp>
+#include <boost/thread/locks.hpp>
+
+#include "EosDevice.h"
+#include "EosAdimecBayer.h"
+#include "EosAdimecAutoWhiteBalance.h"
+#include "EosAdimecThreadPlacement.h"
+
+// A quad with any pixel at or above this share of full scale is clipped
+static const double AWB_CLIP_LEVEL=0.98;
+
+// White patch: quads at or above this percentile of brightness
+static const double AWB_WHITE_PATCH_PERCENTILE=95.0;
+
+// Quads sampled for the white-patch threshold, at most
+static const int AWB_MAX_SAMPLES=16384;
+
+// Histogram bins for the white-patch threshold
+static const int AWB_BINS=256;
+
+// Too few usable quads to trust the ratios
+static const unsigned long AWB_MIN_QUADS=256;
+
+// Settled once red and blue are within this share of the hysteresis
+static const double AWB_SETTLE_FRACTION=0.25;
+
+// Largest gain change in one step (either way)
+static const double AWB_MAX_STEP=2.0;
+
+// A once run gives up after this many steps
+static const int AWB_ONCE_MAX_STEPS=8;
+
+EosAdimecAutoWhiteBalance::EosAdimecAutoWhiteBalance(ApplyFn fnApply, QueryFn fnQuery,
+                                                     DoneFn fnDone, const int nGainMin,
+                                                     const int nGainMax)
+{
+    m_fnApply=fnApply;
+    m_fnQuery=fnQuery;
+    m_fnDone=fnDone;
+    m_nGainMin=nGainMin;
+    m_nGainMax=nGainMax;
+
+    m_pLoopThread=NULL;
+    m_abStop=false;
+
+    m_params.eMode=eAwbOff;
+    m_params.eMethod=eAwbGrayWorld;
+    m_params.nHysteresisPct=5;
+    m_params.nRateHz=2;
+    m_params.nBlackLevel=0;
+
+    ::memset(&m_status,0,sizeof(m_status));
+    m_status.dRedError=1.0;
+    m_status.dBlueError=1.0;
+    for(int ichan=0; ichan<3; ichan++)
+        m_status.anRgb[ichan]=-1;
+
+    m_bCorrecting=false;
+    m_nOnceSteps=0;
+    m_bWantFrame=false;
+    m_nWaitVersion=0;
+    m_bHaveMetering=false;
+    ::memset(&m_metering,0,sizeof(m_metering));
+
+    return;
+}
+
+EosAdimecAutoWhiteBalance::~EosAdimecAutoWhiteBalance(void)
+{
+    Stop();
+    return;
+}
+
+int EosAdimecAutoWhiteBalance::Start(void)
+{
+    if(m_pLoopThread)
+        return UNIX_OK_STATUS;
+
+    m_abStop=false;
+    m_pLoopThread=new boost::thread(boost::bind(&EosAdimecAutoWhiteBalance::LoopThread,this));
+
+    return UNIX_OK_STATUS;
+}
+
+void EosAdimecAutoWhiteBalance::Stop(void)
+{
+    {
+        boost::lock_guard<boost::mutex> lock(m_mtxAwb);
+        m_abStop=true;
+        m_cvAwb.notify_all();
+    }
+
+    if(m_pLoopThread)
+    {
+        m_pLoopThread->join();
+        delete m_pLoopThread;
+        m_pLoopThread=NULL;
+    }
+
+    return;
+}
+
+void EosAdimecAutoWhiteBalance::OnFrame(const EosAdimecRawFrame& frame)
+{
+    AwbParams params;
+    {
+        boost::lock_guard<boost::mutex> lock(m_mtxAwb);
+        if(!m_bWantFrame || frame.bSettingsChanging ||
+           (frame.settings.nVersion<m_nWaitVersion))
+            return;
+        params=m_params;
+    }
+
+    // Outside the lock: SetParams() and GetStatus() don't wait on the meter.
+    Metering metering;
+    Meter(frame,params,metering);
+
+    boost::lock_guard<boost::mutex> lock(m_mtxAwb);
+    m_metering=metering;
+    m_bHaveMetering=true;
+    m_bWantFrame=false;
+    m_cvAwb.notify_all();
+
+    return;
+}
+
+void EosAdimecAutoWhiteBalance::SetParams(const AwbParams& params)
+{
+    boost::lock_guard<boost::mutex> lock(m_mtxAwb);
+    if((eAwbOnce==params.eMode) && (eAwbOnce!=m_params.eMode))
+        m_nOnceSteps=0;
+    m_params=params;
+    m_cvAwb.notify_all();
+    return;
+}
+
+EosAdimecAutoWhiteBalance::AwbParams EosAdimecAutoWhiteBalance::GetParams(void)
+{
+    boost::lock_guard<boost::mutex> lock(m_mtxAwb);
+    return m_params;
+}
+
+void EosAdimecAutoWhiteBalance::RunOnce(void)
+{
+    boost::lock_guard<boost::mutex> lock(m_mtxAwb);
+    m_params.eMode=eAwbOnce;
+    m_nOnceSteps=0;
+    m_cvAwb.notify_all();
+    return;
+}
+
+EosAdimecAutoWhiteBalance::AwbStatus EosAdimecAutoWhiteBalance::GetStatus(void)
+{
+    boost::lock_guard<boost::mutex> lock(m_mtxAwb);
+    return m_status;
+}
+
+bool EosAdimecAutoWhiteBalance::ModeFromString(const std::string& strMode, E_AWB_MODE& eMode)
+{
+    for(int imode=eAwbOff; imode<=eAwbContinuous; imode++)
+    {
+        if(strMode==ModeName((E_AWB_MODE)imode))
+        {
+            eMode=(E_AWB_MODE)imode;
+            return true;
+        }
+    }
+    return false;
+}
+
+std::string EosAdimecAutoWhiteBalance::ModeName(const E_AWB_MODE eMode)
+{
+    switch(eMode)
+    {
+        case eAwbOnce:          return "once";
+        case eAwbContinuous:    return "continuous";
+        default:                return "off";
+    }
+}
+
+bool EosAdimecAutoWhiteBalance::MethodFromString(const std::string& strMethod,
+                                                 E_AWB_METHOD& eMethod)
+{
+    if(strMethod==MethodName(eAwbGrayWorld))
+    {
+        eMethod=eAwbGrayWorld;
+        return true;
+    }
+    if(strMethod==MethodName(eAwbWhitePatch))
+    {
+        eMethod=eAwbWhitePatch;
+        return true;
+    }
+    return false;
+}
+
+std::string EosAdimecAutoWhiteBalance::MethodName(const E_AWB_METHOD eMethod)
+{
+    return (eAwbWhitePatch==eMethod) ? "white_patch" : "gray_world";
+}
+
+void EosAdimecAutoWhiteBalance::LoopThread(void)
+{
+    // Re-check the mode this often while off
+    static const int IDLE_WAIT_MS=200;
+
+    EosAdimecThreadPlacement::Apply(EosAdimecThreadPlacement::eRoleSerial);
+
+    boost::unique_lock<boost::mutex> lock(m_mtxAwb);
+    while(!m_abStop)
+    {
+        if(eAwbOff==m_params.eMode)
+        {
+            m_bWantFrame=false;
+            m_bCorrecting=false;
+            m_cvAwb.timed_wait(lock,boost::get_system_time()+
+                               boost::posix_time::milliseconds(IDLE_WAIT_MS));
+            continue;
+        }
+
+        // Ask the capture thread for the next frame at the awaited version.
+        boost::system_time tNext=boost::get_system_time()+
+            boost::posix_time::microseconds(1000000/std::max(1,m_params.nRateHz));
+        m_bHaveMetering=false;
+        m_bWantFrame=true;
+        while(!m_abStop && (eAwbOff!=m_params.eMode) && !m_bHaveMetering)
+            m_cvAwb.timed_wait(lock,boost::get_system_time()+
+                               boost::posix_time::milliseconds(IDLE_WAIT_MS));
+        if(m_abStop || !m_bHaveMetering)
+            continue;
+
+        Metering metering=m_metering;
+
+        // The camera is commanded without our lock (see EosAdimecAutoExposure).
+        lock.unlock();
+        Step(metering);
+        lock.lock();
+
+        // Loop rate
+        while(!m_abStop && (eAwbOff!=m_params.eMode) && (boost::get_system_time()<tNext))
+            m_cvAwb.timed_wait(lock,tNext);
+    }
+
+    m_bWantFrame=false;
+    return;
+}
+
+void EosAdimecAutoWhiteBalance::Step(const Metering& metering)
+{
+    AwbParams params;
+    bool bCorrecting;
+    {
+        boost::lock_guard<boost::mutex> lock(m_mtxAwb);
+        params=m_params;
+        bCorrecting=m_bCorrecting;
+        m_status.nIterations++;
+        m_status.nQuads=metering.nQuads;
+    }
+
+    // Current gains: from the frame, or the camera if never set since start-up.
+    uint32_t nVersion=metering.settings.nVersion;
+    int anRgb[3]={metering.settings.nWbRed,metering.settings.nWbGreen,
+                  metering.settings.nWbBlue};
+    bool bKnown=(*std::min_element(anRgb,anRgb+3)>=m_nGainMin) &&
+        (*std::max_element(anRgb,anRgb+3)<=m_nGainMax);
+    if(!bKnown && m_fnQuery)
+        bKnown=(UNIX_OK_STATUS==m_fnQuery(anRgb,nVersion)) &&
+            (*std::min_element(anRgb,anRgb+3)>=m_nGainMin) &&
+            (*std::max_element(anRgb,anRgb+3)<=m_nGainMax);
+
+    bool bMeasured=(metering.nQuads>=AWB_MIN_QUADS) && (metering.dRed>0.5) &&
+        (metering.dGreen>0.5) && (metering.dBlue>0.5);
+    double dRedError=bMeasured ? (metering.dGreen/metering.dRed) : 1.0;
+    double dBlueError=bMeasured ? (metering.dGreen/metering.dBlue) : 1.0;
+    double dWorstPct=100.0*std::max(::fabs(dRedError-1.0),::fabs(dBlueError-1.0));
+
+    // Hysteresis: start past the threshold, stop once well inside it.  A
+    // once run always settles.
+    if(dWorstPct>params.nHysteresisPct)
+        bCorrecting=true;
+    else if(dWorstPct<params.nHysteresisPct*AWB_SETTLE_FRACTION)
+        bCorrecting=false;
+    else if(eAwbOnce==params.eMode)
+        bCorrecting=true;
+
+    int anNew[3]={anRgb[0],anRgb[1],anRgb[2]};
+    bool bSend=false;
+    if(bKnown && bMeasured && bCorrecting)
+    {
+        double adGain[3];
+        adGain[0]=anRgb[0]*std::min(std::max(dRedError,1.0/AWB_MAX_STEP),AWB_MAX_STEP);
+        adGain[1]=anRgb[1];
+        adGain[2]=anRgb[2]*std::min(std::max(dBlueError,1.0/AWB_MAX_STEP),AWB_MAX_STEP);
+
+        // Green stays put unless red or blue leaves the range; then all
+        // three move together (the low end wins if the spread won't fit).
+        double dMin=*std::min_element(adGain,adGain+3);
+        double dMax=*std::max_element(adGain,adGain+3);
+        double dScale=1.0;
+        if(dMax>m_nGainMax)
+            dScale=m_nGainMax/dMax;
+        if(dMin*dScale<m_nGainMin)
+            dScale=m_nGainMin/dMin;
+        for(int ichan=0; ichan<3; ichan++)
+        {
+            anNew[ichan]=std::min(std::max((int)(adGain[ichan]*dScale+0.5),m_nGainMin),m_nGainMax);
+            bSend|=(anNew[ichan]!=anRgb[ichan]);
+        }
+
+        // Nothing left to change (rounding, or pinned at the range): stop
+        // until the error crosses the hysteresis again.
+        if(!bSend)
+            bCorrecting=false;
+    }
+
+    bool bOk=true;
+    if(bSend)
+        bOk=(UNIX_OK_STATUS==m_fnApply(anNew,nVersion));
+
+    bool bDone=false;
+    bool bConverged;
+    int anDone[3];
+    {
+        boost::lock_guard<boost::mutex> lock(m_mtxAwb);
+        bConverged=bMeasured && (dWorstPct<=params.nHysteresisPct);
+        m_status.bConverged=bConverged;
+        m_status.dRedError=dRedError;
+        m_status.dBlueError=dBlueError;
+        if(bSend)
+        {
+            m_status.nCommands++;
+            if(bOk)
+                std::copy(anNew,anNew+3,m_status.anRgb);
+            else
+                m_status.nErrors++;
+        }
+        m_bCorrecting=bCorrecting && bOk;
+        m_nWaitVersion=nVersion;
+
+        if(eAwbOnce==m_params.eMode)
+        {
+            m_nOnceSteps++;
+            if(!bSend || !bOk || (m_nOnceSteps>=AWB_ONCE_MAX_STEPS))
+            {
+                m_params.eMode=eAwbOff;
+                bDone=true;
+                bConverged=bConverged && !bSend;
+                const int* pnGains=(bSend && bOk) ? anNew : anRgb;
+                for(int ichan=0; ichan<3; ichan++)
+                    anDone[ichan]=bKnown ? pnGains[ichan] : -1;
+            }
+        }
+    }
+
+    if(bDone && m_fnDone)
+        m_fnDone(bConverged,anDone);
+
+    return;
+}
+
+void EosAdimecAutoWhiteBalance::Meter(const EosAdimecRawFrame& frame, const AwbParams& params,
+                                      Metering& metering)
+{
+    metering.settings=frame.settings;
+    metering.dRed=0.0;
+    metering.dGreen=0.0;
+    metering.dBlue=0.0;
+    metering.nQuads=0;
+
+    EosAdimecBayer::BayerImage raw;
+    raw.pData=frame.pData;
+    raw.nWidth=frame.nWidth;
+    raw.nHeight=frame.nHeight;
+    raw.nStride=frame.nStride;
+    raw.nBitDepth=frame.nBitDepth;
+    raw.bRedRowFirst=frame.bRedRowFirst;
+    raw.bGreenPixelFirst=frame.bGreenPixelFirst;
+    if((frame.nBitDepth<1) || (frame.nBitDepth>15))
+        return;
+
+    const int nFullScale=(1<<frame.nBitDepth)-1;
+    const uint32_t nClip=(uint32_t)(AWB_CLIP_LEVEL*nFullScale);
+
+    uint32_t nMinQuadSum=0;
+    if(eAwbWhitePatch==params.eMethod)
+    {
+        // Threshold: the percentile of unclipped quad sums, from a
+        // subsampled histogram.  The sums themselves come from every quad.
+        const int nQuadsX=frame.nWidth/2;
+        const int nQuadsY=frame.nHeight/2;
+        const int nShift=std::max(0,frame.nBitDepth+2-8);
+        int nStep=1;
+        while(((nQuadsX+nStep-1)/nStep)*((nQuadsY+nStep-1)/nStep)>AWB_MAX_SAMPLES)
+            nStep++;
+
+        unsigned long anHist[AWB_BINS];
+        ::memset(anHist,0,sizeof(anHist));
+        unsigned long nSamples=0;
+        const int nMask=nFullScale;
+        for(int iqy=0; iqy<nQuadsY; iqy+=nStep)
+        {
+            const uint16_t* pRow0=frame.pData+(size_t)(2*iqy)*frame.nStride;
+            const uint16_t* pRow1=pRow0+frame.nStride;
+            for(int iqx=0; iqx<nQuadsX; iqx+=nStep)
+            {
+                int n00=pRow0[2*iqx]&nMask, n01=pRow0[2*iqx+1]&nMask;
+                int n10=pRow1[2*iqx]&nMask, n11=pRow1[2*iqx+1]&nMask;
+                if(std::max(std::max(n00,n01),std::max(n10,n11))>=(int)nClip)
+                    continue;
+                anHist[std::min((n00+n01+n10+n11)>>nShift,AWB_BINS-1)]++;
+                nSamples++;
+            }
+        }
+
+        unsigned long nRank=(unsigned long)(nSamples*AWB_WHITE_PATCH_PERCENTILE/100.0);
+        unsigned long nBelow=0;
+        for(int ibin=0; ibin<AWB_BINS; ibin++)
+        {
+            nBelow+=anHist[ibin];
+            if(nBelow>nRank)
+            {
+                nMinQuadSum=(uint32_t)ibin<<nShift;
+                break;
+            }
+        }
+    }
+
+    EosAdimecBayer::ChannelSums sums;
+    if(0!=EosAdimecBayer::SumChannels(raw,0,frame.nHeight,nMinQuadSum,nClip,sums) ||
+       (0==sums.nQuads))
+        return;
+
+    double dQuads=(double)sums.nQuads;
+    metering.dRed=sums.nRed/dQuads-params.nBlackLevel;
+    metering.dGreen=sums.nGreen/(2.0*dQuads)-params.nBlackLevel;
+    metering.dBlue=sums.nBlue/dQuads-params.nBlackLevel;
+    metering.nQuads=sums.nQuads;
+
+    return;
+}
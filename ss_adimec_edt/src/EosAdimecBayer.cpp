@@ -0,0 +1,587 @@
+/**
+ * Bayer demosaic kernels.  See EosAdimecBayer.h
+ *
+ * Every kernel computes, for each pixel, the same five candidates:
+ *    C  = center,  H2 = avg(W,E),  V2 = avg(N,S),  X4 = avg(V2,H2),
+ *    D4 = avg(avg(NW,NE),avg(SW,SE))
+ * where avg(a,b)=(a+b+1)>>1 (i.e. pavgw), and then picks per site:
+ *
+ *                       row color      green          other color
+ *    row-color site     C              X4 (or Gedge)  D4
+ *    green site         H2             C              V2
+ *
+ * "Row color" is red on red rows and blue on blue rows.  Gedge picks H2
+ * or V2 by the smaller of
+ *    gH = |W-E| + |2C-WW-EE|,   gV = |N-S| + |2C-NN-SS|   (X4 on a tie).
+ */
+
+#include <stdlib.h>
+
+#include <algorithm>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define EOS_ADIMEC_BAYER_X86
+#endif
+
+#include "EosAdimecBayer.h"
+
+// Rounding average, same as _mm_avg_epu16()
+static inline uint32_t Avg2(const uint32_t nA, const uint32_t nB)
+{
+    return (nA+nB+1)>>1;
+}
+
+// Mirror at the edges without changing Bayer parity: -1 --> 1, n --> n-2
+static inline int Reflect(const int nIndex, const int nSize)
+{
+    if(nIndex<0)
+        return -nIndex;
+    if(nIndex>=nSize)
+        return 2*nSize-2-nIndex;
+    return nIndex;
+}
+
+// The per-pixel rule shared by the border and scalar-row paths.
+static inline void ComputePixel(const uint32_t nC,
+                                const uint32_t nW, const uint32_t nE,
+                                const uint32_t nN, const uint32_t nS,
+                                const uint32_t nNW, const uint32_t nNE,
+                                const uint32_t nSW, const uint32_t nSE,
+                                const uint32_t nWW, const uint32_t nEE,
+                                const uint32_t nNN, const uint32_t nSS,
+                                const bool bGreenSite,
+                                const EosAdimecBayer::E_DEMOSAIC_METHOD eMethod,
+                                uint32_t& nSame, uint32_t& nGreen, uint32_t& nOther)
+{
+    uint32_t nH2=Avg2(nW,nE);
+    uint32_t nV2=Avg2(nN,nS);
+
+    if(bGreenSite)
+    {
+        nSame=nH2;
+        nGreen=nC;
+        nOther=nV2;
+        return;
+    }
+
+    uint32_t nX4=Avg2(nV2,nH2);
+    nSame=nC;
+    nOther=Avg2(Avg2(nNW,nNE),Avg2(nSW,nSE));
+    nGreen=nX4;
+
+    if(EosAdimecBayer::eDemosaicEdgeAware==eMethod)
+    {
+        int nGradH=abs((int)nW-(int)nE)+abs(2*(int)nC-(int)nWW-(int)nEE);
+        int nGradV=abs((int)nN-(int)nS)+abs(2*(int)nC-(int)nNN-(int)nSS);
+        if(nGradH<nGradV)
+            nGreen=nH2;
+        else if(nGradV<nGradH)
+            nGreen=nV2;
+    }
+
+    return;
+}
+
+int EosAdimecBayer::Demosaic(const BayerImage& raw, RgbPlanes& rgb,
+                             const E_DEMOSAIC_METHOD eMethod,
+                             const E_SIMD_LEVEL eLevel)
+{
+    return DemosaicRows(raw,rgb,eMethod,0,raw.nHeight,eLevel);
+}
+
+int EosAdimecBayer::DemosaicRows(const BayerImage& raw, RgbPlanes& rgb,
+                                 const E_DEMOSAIC_METHOD eMethod,
+                                 const int nRowBegin, const int nRowEnd,
+                                 const E_SIMD_LEVEL eLevel)
+{
+    if((NULL==raw.pData) || (raw.nWidth<4) || (raw.nHeight<4) ||
+       (raw.nStride<raw.nWidth) || (raw.nBitDepth<1) || (raw.nBitDepth>15) ||
+       (NULL==rgb.pR) || (NULL==rgb.pG) || (NULL==rgb.pB) || (rgb.nStride<raw.nWidth) ||
+       (nRowBegin<0) || (nRowEnd>raw.nHeight) || (nRowBegin>nRowEnd) ||
+       (nRowBegin<rgb.nFirstRow))
+        return -1;
+
+    E_SIMD_LEVEL eUse=(eSimdAuto==eLevel) ? GetBestSimdLevel() : eLevel;
+
+    for(int irow=nRowBegin; irow<nRowEnd; irow++)
+    {
+        // Two-pixel border: reflected neighbors, scalar.
+        if((irow<2) || (irow>=raw.nHeight-2))
+        {
+            for(int icol=0; icol<raw.nWidth; icol++)
+                DemosaicPixelScalar(raw,rgb,eMethod,irow,icol);
+            continue;
+        }
+
+        DemosaicPixelScalar(raw,rgb,eMethod,irow,0);
+        DemosaicPixelScalar(raw,rgb,eMethod,irow,1);
+
+        // SIMD kernels need an even starting column (lane parity = column parity).
+        int nCol=2;
+        if(eSimdAvx2==eUse)
+            nCol=DemosaicRowAvx2(raw,rgb,eMethod,irow,nCol,raw.nWidth-2);
+        if((eSimdAvx2==eUse) || (eSimdSse4==eUse))
+            nCol=DemosaicRowSse4(raw,rgb,eMethod,irow,nCol,raw.nWidth-2);
+        DemosaicRowScalar(raw,rgb,eMethod,irow,nCol,raw.nWidth-2);
+
+        DemosaicPixelScalar(raw,rgb,eMethod,irow,raw.nWidth-2);
+        DemosaicPixelScalar(raw,rgb,eMethod,irow,raw.nWidth-1);
+    }
+
+    return 0;
+}
+
+int EosAdimecBayer::SumChannels(const BayerImage& raw, const int nRowBegin, const int nRowEnd,
+                                const uint32_t nMinQuadSum, const uint32_t nClipLevel,
+                                ChannelSums& sums, const E_SIMD_LEVEL eLevel)
+{
+    sums.nRed=0;
+    sums.nGreen=0;
+    sums.nBlue=0;
+    sums.nQuads=0;
+
+    if((NULL==raw.pData) || (raw.nWidth<2) || (raw.nHeight<2) ||
+       (raw.nStride<raw.nWidth) || (raw.nBitDepth<1) || (raw.nBitDepth>15) ||
+       (nRowBegin<0) || (nRowEnd>raw.nHeight) || (nRowBegin>nRowEnd))
+        return -1;
+
+    E_SIMD_LEVEL eUse=(eSimdAuto==eLevel) ? GetBestSimdLevel() : eLevel;
+    const uint32_t nMask=(1u<<raw.nBitDepth)-1;
+    const int nQuadsPerRow=raw.nWidth/2;
+
+    for(int irow=(nRowBegin&~1); irow+2<=nRowEnd; irow+=2)
+    {
+        const uint16_t* pRow0=raw.pData+(size_t)irow*raw.nStride;
+        const uint16_t* pRow1=pRow0+raw.nStride;
+
+        uint64_t anSums[4]={0,0,0,0};
+        int nQuad=0;
+        if(eSimdAvx2==eUse)
+            nQuad=SumQuadsAvx2(pRow0,pRow1,nMask,nQuad,nQuadsPerRow,nMinQuadSum,nClipLevel,
+                               anSums,sums.nQuads);
+        if((eSimdAvx2==eUse) || (eSimdSse4==eUse))
+            nQuad=SumQuadsSse4(pRow0,pRow1,nMask,nQuad,nQuadsPerRow,nMinQuadSum,nClipLevel,
+                               anSums,sums.nQuads);
+        SumQuadsScalar(pRow0,pRow1,nMask,nQuad,nQuadsPerRow,nMinQuadSum,nClipLevel,
+                       anSums,sums.nQuads);
+
+        // Row 0 holds red or blue plus green; row 1 the other color plus green.
+        bool bGreenEven=IsGreenFirstInRow(raw,irow);
+        uint64_t nColor0=bGreenEven ? anSums[1] : anSums[0];
+        uint64_t nColor1=bGreenEven ? anSums[2] : anSums[3];
+        sums.nGreen+=bGreenEven ? (anSums[0]+anSums[3]) : (anSums[1]+anSums[2]);
+        if(IsRedRow(raw,irow))
+        {
+            sums.nRed+=nColor0;
+            sums.nBlue+=nColor1;
+        }
+        else
+        {
+            sums.nBlue+=nColor0;
+            sums.nRed+=nColor1;
+        }
+    }
+
+    return 0;
+}
+
+void EosAdimecBayer::SumQuadsScalar(const uint16_t* pRow0, const uint16_t* pRow1,
+                                    const uint32_t nMask, const int nQuadBegin, const int nQuadEnd,
+                                    const uint32_t nMinQuadSum, const uint32_t nClipLevel,
+                                    uint64_t anSums[4], uint64_t& nQuads)
+{
+    for(int iquad=nQuadBegin; iquad<nQuadEnd; iquad++)
+    {
+        uint32_t n00=pRow0[2*iquad]&nMask, n01=pRow0[2*iquad+1]&nMask;
+        uint32_t n10=pRow1[2*iquad]&nMask, n11=pRow1[2*iquad+1]&nMask;
+
+        uint32_t nMax=std::max(std::max(n00,n01),std::max(n10,n11));
+        if((n00+n01+n10+n11<nMinQuadSum) || (nMax>=nClipLevel))
+            continue;
+
+        anSums[0]+=n00;
+        anSums[1]+=n01;
+        anSums[2]+=n10;
+        anSums[3]+=n11;
+        nQuads++;
+    }
+    return;
+}
+
+void EosAdimecBayer::DemosaicPixelScalar(const BayerImage& raw, RgbPlanes& rgb,
+                                         const E_DEMOSAIC_METHOD eMethod,
+                                         const int nRow, const int nCol)
+{
+    const uint32_t nMask=(1u<<raw.nBitDepth)-1;
+
+    #define PIX(dy,dx) (raw.pData[(size_t)Reflect(nRow+(dy),raw.nHeight)*raw.nStride+ \
+                                  Reflect(nCol+(dx),raw.nWidth)]&nMask)
+
+    bool bRedRow=IsRedRow(raw,nRow);
+    bool bGreenSite=(((nCol&1)==0)==IsGreenFirstInRow(raw,nRow));
+
+    uint32_t nSame, nGreen, nOther;
+    ComputePixel(PIX(0,0),PIX(0,-1),PIX(0,1),PIX(-1,0),PIX(1,0),
+                 PIX(-1,-1),PIX(-1,1),PIX(1,-1),PIX(1,1),
+                 PIX(0,-2),PIX(0,2),PIX(-2,0),PIX(2,0),
+                 bGreenSite,eMethod,nSame,nGreen,nOther);
+
+    #undef PIX
+
+    size_t nOut=(size_t)(nRow-rgb.nFirstRow)*rgb.nStride+nCol;
+    rgb.pG[nOut]=(uint16_t)nGreen;
+    (bRedRow ? rgb.pR : rgb.pB)[nOut]=(uint16_t)nSame;
+    (bRedRow ? rgb.pB : rgb.pR)[nOut]=(uint16_t)nOther;
+
+    return;
+}
+
+void EosAdimecBayer::DemosaicRowScalar(const BayerImage& raw, RgbPlanes& rgb,
+                                       const E_DEMOSAIC_METHOD eMethod, const int nRow,
+                                       const int nColBegin, const int nColEnd)
+{
+    const uint32_t nMask=(1u<<raw.nBitDepth)-1;
+    const int nS=raw.nStride;
+    const uint16_t* pRow=raw.pData+(size_t)nRow*nS;
+
+    bool bRedRow=IsRedRow(raw,nRow);
+    bool bGreenFirst=IsGreenFirstInRow(raw,nRow);
+
+    size_t nOutRow=(size_t)(nRow-rgb.nFirstRow)*rgb.nStride;
+    uint16_t* pSame=(bRedRow ? rgb.pR : rgb.pB)+nOutRow;
+    uint16_t* pOther=(bRedRow ? rgb.pB : rgb.pR)+nOutRow;
+    uint16_t* pGreen=rgb.pG+nOutRow;
+
+    for(int icol=nColBegin; icol<nColEnd; icol++)
+    {
+        const uint16_t* p=pRow+icol;
+        uint32_t nSame, nGreen, nOther;
+        ComputePixel(p[0]&nMask,p[-1]&nMask,p[1]&nMask,p[-nS]&nMask,p[nS]&nMask,
+                     p[-nS-1]&nMask,p[-nS+1]&nMask,p[nS-1]&nMask,p[nS+1]&nMask,
+                     p[-2]&nMask,p[2]&nMask,p[-2*nS]&nMask,p[2*nS]&nMask,
+                     (((icol&1)==0)==bGreenFirst),eMethod,nSame,nGreen,nOther);
+        pSame[icol]=(uint16_t)nSame;
+        pGreen[icol]=(uint16_t)nGreen;
+        pOther[icol]=(uint16_t)nOther;
+    }
+
+    return;
+}
+
+#ifdef EOS_ADIMEC_BAYER_X86
+
+__attribute__((target("sse4.1")))
+int EosAdimecBayer::DemosaicRowSse4(const BayerImage& raw, RgbPlanes& rgb,
+                                    const E_DEMOSAIC_METHOD eMethod, const int nRow,
+                                    const int nColBegin, const int nColEnd)
+{
+    const __m128i vMask=_mm_set1_epi16((short)((1u<<raw.nBitDepth)-1));
+    const int nS=raw.nStride;
+    const uint16_t* pRow=raw.pData+(size_t)nRow*nS;
+    const bool bEdge=(eDemosaicEdgeAware==eMethod);
+
+    bool bRedRow=IsRedRow(raw,nRow);
+    bool bGreenEven=IsGreenFirstInRow(raw,nRow);
+
+    size_t nOutRow=(size_t)(nRow-rgb.nFirstRow)*rgb.nStride;
+    uint16_t* pSame=(bRedRow ? rgb.pR : rgb.pB)+nOutRow;
+    uint16_t* pOther=(bRedRow ? rgb.pB : rgb.pR)+nOutRow;
+    uint16_t* pGreen=rgb.pG+nOutRow;
+
+    int icol=nColBegin;
+    for(; icol+8<=nColEnd; icol+=8)
+    {
+        const uint16_t* p=pRow+icol;
+        #define LD(off) _mm_and_si128(_mm_loadu_si128((const __m128i*)(p+(off))),vMask)
+
+        __m128i vC=LD(0);
+        __m128i vW=LD(-1), vE=LD(1), vN=LD(-nS), vS=LD(nS);
+        __m128i vH2=_mm_avg_epu16(vW,vE);
+        __m128i vV2=_mm_avg_epu16(vN,vS);
+        __m128i vX4=_mm_avg_epu16(vV2,vH2);
+        __m128i vD4=_mm_avg_epu16(_mm_avg_epu16(LD(-nS-1),LD(-nS+1)),
+                                  _mm_avg_epu16(LD(nS-1),LD(nS+1)));
+        __m128i vGi=vX4;
+        if(bEdge)
+        {
+            __m128i vC2=_mm_add_epi16(vC,vC);
+            __m128i vGradH=_mm_add_epi16(_mm_abs_epi16(_mm_sub_epi16(vW,vE)),
+                                         _mm_abs_epi16(_mm_sub_epi16(_mm_sub_epi16(vC2,LD(-2)),LD(2))));
+            __m128i vGradV=_mm_add_epi16(_mm_abs_epi16(_mm_sub_epi16(vN,vS)),
+                                         _mm_abs_epi16(_mm_sub_epi16(_mm_sub_epi16(vC2,LD(-2*nS)),LD(2*nS))));
+            vGi=_mm_blendv_epi8(vGi,vH2,_mm_cmpgt_epi16(vGradV,vGradH));
+            vGi=_mm_blendv_epi8(vGi,vV2,_mm_cmpgt_epi16(vGradH,vGradV));
+        }
+        #undef LD
+
+        __m128i vSame, vGreen, vOther;
+        if(bGreenEven)
+        {
+            vSame=_mm_blend_epi16(vH2,vC,0xAA);
+            vGreen=_mm_blend_epi16(vC,vGi,0xAA);
+            vOther=_mm_blend_epi16(vV2,vD4,0xAA);
+        }
+        else
+        {
+            vSame=_mm_blend_epi16(vC,vH2,0xAA);
+            vGreen=_mm_blend_epi16(vGi,vC,0xAA);
+            vOther=_mm_blend_epi16(vD4,vV2,0xAA);
+        }
+
+        _mm_storeu_si128((__m128i*)(pSame+icol),vSame);
+        _mm_storeu_si128((__m128i*)(pGreen+icol),vGreen);
+        _mm_storeu_si128((__m128i*)(pOther+icol),vOther);
+    }
+
+    return icol;
+}
+
+__attribute__((target("avx2")))
+int EosAdimecBayer::DemosaicRowAvx2(const BayerImage& raw, RgbPlanes& rgb,
+                                    const E_DEMOSAIC_METHOD eMethod, const int nRow,
+                                    const int nColBegin, const int nColEnd)
+{
+    const __m256i vMask=_mm256_set1_epi16((short)((1u<<raw.nBitDepth)-1));
+    const int nS=raw.nStride;
+    const uint16_t* pRow=raw.pData+(size_t)nRow*nS;
+    const bool bEdge=(eDemosaicEdgeAware==eMethod);
+
+    bool bRedRow=IsRedRow(raw,nRow);
+    bool bGreenEven=IsGreenFirstInRow(raw,nRow);
+
+    size_t nOutRow=(size_t)(nRow-rgb.nFirstRow)*rgb.nStride;
+    uint16_t* pSame=(bRedRow ? rgb.pR : rgb.pB)+nOutRow;
+    uint16_t* pOther=(bRedRow ? rgb.pB : rgb.pR)+nOutRow;
+    uint16_t* pGreen=rgb.pG+nOutRow;
+
+    int icol=nColBegin;
+    for(; icol+16<=nColEnd; icol+=16)
+    {
+        const uint16_t* p=pRow+icol;
+        #define LD(off) _mm256_and_si256(_mm256_loadu_si256((const __m256i*)(p+(off))),vMask)
+
+        __m256i vC=LD(0);
+        __m256i vW=LD(-1), vE=LD(1), vN=LD(-nS), vS=LD(nS);
+        __m256i vH2=_mm256_avg_epu16(vW,vE);
+        __m256i vV2=_mm256_avg_epu16(vN,vS);
+        __m256i vX4=_mm256_avg_epu16(vV2,vH2);
+        __m256i vD4=_mm256_avg_epu16(_mm256_avg_epu16(LD(-nS-1),LD(-nS+1)),
+                                     _mm256_avg_epu16(LD(nS-1),LD(nS+1)));
+        __m256i vGi=vX4;
+        if(bEdge)
+        {
+            __m256i vC2=_mm256_add_epi16(vC,vC);
+            __m256i vGradH=_mm256_add_epi16(_mm256_abs_epi16(_mm256_sub_epi16(vW,vE)),
+                                            _mm256_abs_epi16(_mm256_sub_epi16(_mm256_sub_epi16(vC2,LD(-2)),LD(2))));
+            __m256i vGradV=_mm256_add_epi16(_mm256_abs_epi16(_mm256_sub_epi16(vN,vS)),
+                                            _mm256_abs_epi16(_mm256_sub_epi16(_mm256_sub_epi16(vC2,LD(-2*nS)),LD(2*nS))));
+            vGi=_mm256_blendv_epi8(vGi,vH2,_mm256_cmpgt_epi16(vGradV,vGradH));
+            vGi=_mm256_blendv_epi8(vGi,vV2,_mm256_cmpgt_epi16(vGradH,vGradV));
+        }
+        #undef LD
+
+        // The blend immediate applies to each 128-bit half; both halves
+        // start on an even column, so 0xAA still means "odd columns".
+        __m256i vSame, vGreen, vOther;
+        if(bGreenEven)
+        {
+            vSame=_mm256_blend_epi16(vH2,vC,0xAA);
+            vGreen=_mm256_blend_epi16(vC,vGi,0xAA);
+            vOther=_mm256_blend_epi16(vV2,vD4,0xAA);
+        }
+        else
+        {
+            vSame=_mm256_blend_epi16(vC,vH2,0xAA);
+            vGreen=_mm256_blend_epi16(vGi,vC,0xAA);
+            vOther=_mm256_blend_epi16(vD4,vV2,0xAA);
+        }
+
+        _mm256_storeu_si256((__m256i*)(pSame+icol),vSame);
+        _mm256_storeu_si256((__m256i*)(pGreen+icol),vGreen);
+        _mm256_storeu_si256((__m256i*)(pOther+icol),vOther);
+    }
+
+    return icol;
+}
+
+EosAdimecBayer::E_SIMD_LEVEL EosAdimecBayer::GetBestSimdLevel(void)
+{
+    static const E_SIMD_LEVEL eBest=
+        __builtin_cpu_supports("avx2") ? eSimdAvx2 :
+        (__builtin_cpu_supports("sse4.1") ? eSimdSse4 : eSimdScalar);
+    return eBest;
+}
+
+// Four quads per step.  madd against 1,0/0,1 splits even and odd columns
+// into 32-bit lanes, one lane per quad; a quad's keep mask covers its lane.
+__attribute__((target("sse4.1")))
+int EosAdimecBayer::SumQuadsSse4(const uint16_t* pRow0, const uint16_t* pRow1,
+                                 const uint32_t nMask, const int nQuadBegin, const int nQuadEnd,
+                                 const uint32_t nMinQuadSum, const uint32_t nClipLevel,
+                                 uint64_t anSums[4], uint64_t& nQuads)
+{
+    const __m128i vMask=_mm_set1_epi16((short)nMask);
+    const __m128i vEven=_mm_set1_epi32(0x00000001);
+    const __m128i vOdd=_mm_set1_epi32(0x00010000);
+    const __m128i vOnes=_mm_set1_epi16(1);
+    const __m128i vLow16=_mm_set1_epi32(0xffff);
+    const __m128i vMinSum=_mm_set1_epi32((int)std::min(nMinQuadSum,0x7fffffffu)-1);
+    const __m128i vClip=_mm_set1_epi32((int)std::min(nClipLevel,0x7fffffffu));
+
+    // 32-bit lanes can't overflow: 15-bit pixels, at most 2^16 steps a row.
+    __m128i vAcc0=_mm_setzero_si128(), vAcc1=_mm_setzero_si128();
+    __m128i vAcc2=_mm_setzero_si128(), vAcc3=_mm_setzero_si128();
+    __m128i vCount=_mm_setzero_si128();
+
+    int iquad=nQuadBegin;
+    for(; iquad+4<=nQuadEnd; iquad+=4)
+    {
+        __m128i v0=_mm_and_si128(_mm_loadu_si128((const __m128i*)(pRow0+2*iquad)),vMask);
+        __m128i v1=_mm_and_si128(_mm_loadu_si128((const __m128i*)(pRow1+2*iquad)),vMask);
+
+        __m128i vSum=_mm_add_epi32(_mm_madd_epi16(v0,vOnes),_mm_madd_epi16(v1,vOnes));
+        __m128i vMax=_mm_max_epu16(v0,v1);
+        vMax=_mm_and_si128(_mm_max_epu16(vMax,_mm_srli_epi32(vMax,16)),vLow16);
+        __m128i vKeep=_mm_and_si128(_mm_cmpgt_epi32(vSum,vMinSum),_mm_cmpgt_epi32(vClip,vMax));
+
+        vAcc0=_mm_add_epi32(vAcc0,_mm_and_si128(_mm_madd_epi16(v0,vEven),vKeep));
+        vAcc1=_mm_add_epi32(vAcc1,_mm_and_si128(_mm_madd_epi16(v0,vOdd),vKeep));
+        vAcc2=_mm_add_epi32(vAcc2,_mm_and_si128(_mm_madd_epi16(v1,vEven),vKeep));
+        vAcc3=_mm_add_epi32(vAcc3,_mm_and_si128(_mm_madd_epi16(v1,vOdd),vKeep));
+        vCount=_mm_sub_epi32(vCount,vKeep);
+    }
+
+    uint32_t anLanes[4];
+    __m128i* apAcc[5]={&vAcc0,&vAcc1,&vAcc2,&vAcc3,&vCount};
+    for(int iacc=0; iacc<5; iacc++)
+    {
+        _mm_storeu_si128((__m128i*)anLanes,*apAcc[iacc]);
+        uint64_t nTotal=(uint64_t)anLanes[0]+anLanes[1]+anLanes[2]+anLanes[3];
+        if(iacc<4)
+            anSums[iacc]+=nTotal;
+        else
+            nQuads+=nTotal;
+    }
+
+    return iquad;
+}
+
+__attribute__((target("avx2")))
+int EosAdimecBayer::SumQuadsAvx2(const uint16_t* pRow0, const uint16_t* pRow1,
+                                 const uint32_t nMask, const int nQuadBegin, const int nQuadEnd,
+                                 const uint32_t nMinQuadSum, const uint32_t nClipLevel,
+                                 uint64_t anSums[4], uint64_t& nQuads)
+{
+    const __m256i vMask=_mm256_set1_epi16((short)nMask);
+    const __m256i vEven=_mm256_set1_epi32(0x00000001);
+    const __m256i vOdd=_mm256_set1_epi32(0x00010000);
+    const __m256i vOnes=_mm256_set1_epi16(1);
+    const __m256i vLow16=_mm256_set1_epi32(0xffff);
+    const __m256i vMinSum=_mm256_set1_epi32((int)std::min(nMinQuadSum,0x7fffffffu)-1);
+    const __m256i vClip=_mm256_set1_epi32((int)std::min(nClipLevel,0x7fffffffu));
+
+    __m256i vAcc0=_mm256_setzero_si256(), vAcc1=_mm256_setzero_si256();
+    __m256i vAcc2=_mm256_setzero_si256(), vAcc3=_mm256_setzero_si256();
+    __m256i vCount=_mm256_setzero_si256();
+
+    int iquad=nQuadBegin;
+    for(; iquad+8<=nQuadEnd; iquad+=8)
+    {
+        __m256i v0=_mm256_and_si256(_mm256_loadu_si256((const __m256i*)(pRow0+2*iquad)),vMask);
+        __m256i v1=_mm256_and_si256(_mm256_loadu_si256((const __m256i*)(pRow1+2*iquad)),vMask);
+
+        __m256i vSum=_mm256_add_epi32(_mm256_madd_epi16(v0,vOnes),_mm256_madd_epi16(v1,vOnes));
+        __m256i vMax=_mm256_max_epu16(v0,v1);
+        vMax=_mm256_and_si256(_mm256_max_epu16(vMax,_mm256_srli_epi32(vMax,16)),vLow16);
+        __m256i vKeep=_mm256_and_si256(_mm256_cmpgt_epi32(vSum,vMinSum),
+                                       _mm256_cmpgt_epi32(vClip,vMax));
+
+        vAcc0=_mm256_add_epi32(vAcc0,_mm256_and_si256(_mm256_madd_epi16(v0,vEven),vKeep));
+        vAcc1=_mm256_add_epi32(vAcc1,_mm256_and_si256(_mm256_madd_epi16(v0,vOdd),vKeep));
+        vAcc2=_mm256_add_epi32(vAcc2,_mm256_and_si256(_mm256_madd_epi16(v1,vEven),vKeep));
+        vAcc3=_mm256_add_epi32(vAcc3,_mm256_and_si256(_mm256_madd_epi16(v1,vOdd),vKeep));
+        vCount=_mm256_sub_epi32(vCount,vKeep);
+    }
+
+    uint32_t anLanes[8];
+    __m256i* apAcc[5]={&vAcc0,&vAcc1,&vAcc2,&vAcc3,&vCount};
+    for(int iacc=0; iacc<5; iacc++)
+    {
+        _mm256_storeu_si256((__m256i*)anLanes,*apAcc[iacc]);
+        uint64_t nTotal=0;
+        for(int ilane=0; ilane<8; ilane++)
+            nTotal+=anLanes[ilane];
+        if(iacc<4)
+            anSums[iacc]+=nTotal;
+        else
+            nQuads+=nTotal;
+    }
+
+    return iquad;
+}
+
+#else // Not x86: scalar only
+
+int EosAdimecBayer::DemosaicRowSse4(const BayerImage& raw, RgbPlanes& rgb,
+                                    const E_DEMOSAIC_METHOD eMethod, const int nRow,
+                                    const int nColBegin, const int nColEnd)
+{
+    return nColBegin;
+}
+
+int EosAdimecBayer::DemosaicRowAvx2(const BayerImage& raw, RgbPlanes& rgb,
+                                    const E_DEMOSAIC_METHOD eMethod, const int nRow,
+                                    const int nColBegin, const int nColEnd)
+{
+    return nColBegin;
+}
+
+int EosAdimecBayer::SumQuadsSse4(const uint16_t* pRow0, const uint16_t* pRow1,
+                                 const uint32_t nMask, const int nQuadBegin, const int nQuadEnd,
+                                 const uint32_t nMinQuadSum, const uint32_t nClipLevel,
+                                 uint64_t anSums[4], uint64_t& nQuads)
+{
+    return nQuadBegin;
+}
+
+int EosAdimecBayer::SumQuadsAvx2(const uint16_t* pRow0, const uint16_t* pRow1,
+                                 const uint32_t nMask, const int nQuadBegin, const int nQuadEnd,
+                                 const uint32_t nMinQuadSum, const uint32_t nClipLevel,
+                                 uint64_t anSums[4], uint64_t& nQuads)
+{
+    return nQuadBegin;
+}
+
+EosAdimecBayer::E_SIMD_LEVEL EosAdimecBayer::GetBestSimdLevel(void)
+{
+    return eSimdScalar;
+}
+
+#endif // EOS_ADIMEC_BAYER_X86
+
+std::string EosAdimecBayer::SimdLevelName(const E_SIMD_LEVEL eLevel)
+{
+    switch(eLevel)
+    {
+        case eSimdScalar: return "scalar";
+        case eSimdSse4:   return "sse4";
+        case eSimdAvx2:   return "avx2";
+        default:          return SimdLevelName(GetBestSimdLevel());
+    }
+}
+
+bool EosAdimecBayer::MethodFromString(const std::string& strMethod, E_DEMOSAIC_METHOD& eMethod)
+{
+    if(strMethod=="bilinear")
+    {
+        eMethod=eDemosaicBilinear;
+        return true;
+    }
+    if((strMethod=="edge") || (strMethod=="edge_aware"))
+    {
+        eMethod=eDemosaicEdgeAware;
+        return true;
+    }
+    return false;
+}
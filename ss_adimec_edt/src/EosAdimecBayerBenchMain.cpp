@@ -0,0 +1,421 @@
+/**
+   Benchmark for the EosAdimecBayer demosaic kernels.
+   Command-line args (all optional):
+   1) width          (default 1600)
+   2) height         (default 1200)
+   3) bit depth      (10 or 12, default 10)
+   4) iterations     (default 50)
+
+   Times each method at each SIMD level this CPU supports and checks
+   that every level matches the scalar reference bit for bit.  Then times
+   the fused Bayer --> I420/NV12 conversion (EosAdimecYuv) against the
+   two-pass path (full RGB frame, then YUV) and checks they agree, and
+   the white-balance channel sums (SumChannels()) at each SIMD level, the
+   8/10p/12p pack/unpack kernels (EosAdimecPack), and the tone-map LUT
+   lookup (EosAdimecToneMap) with the tone-mapped YUV conversion.
+   Exits non-zero on a mismatch.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <iostream>
+#include <iomanip>
+#include <vector>
+
+#include "EosAdimecBayer.h"
+#include "EosAdimecYuv.h"
+#include "EosAdimecPack.h"
+#include "EosAdimecToneMap.h"
+
+static double NowMs(void)
+{
+    struct timespec tsNow;
+    ::clock_gettime(CLOCK_MONOTONIC,&tsNow);
+    return (tsNow.tv_sec*1000.0)+(tsNow.tv_nsec/1.0e6);
+}
+
+// Smooth ramps, hard vertical/horizontal/diagonal edges, and noise,
+// with stray bits above the bit depth (the kernels must mask them).
+static void MakeTestImage(std::vector<uint16_t>& vRaw, const int nWidth, const int nHeight,
+                          const int nBitDepth)
+{
+    const uint32_t nMax=(1u<<nBitDepth)-1;
+    uint32_t nNoise=12345;
+
+    vRaw.resize((size_t)nWidth*nHeight);
+    for(int irow=0; irow<nHeight; irow++)
+    {
+        for(int icol=0; icol<nWidth; icol++)
+        {
+            uint32_t nValue=(uint32_t)(((uint64_t)(icol+irow)*nMax)/(nWidth+nHeight));
+            if(((icol/40)&1) ^ ((irow/40)&1))
+                nValue=nMax-nValue;
+            if(icol>irow)
+                nValue=(nValue*3)/4;
+
+            nNoise=nNoise*1664525u+1013904223u;
+            nValue=(nValue+(nNoise>>28))&nMax;
+            vRaw[(size_t)irow*nWidth+icol]=(uint16_t)(nValue|((nNoise&1)<<15));
+        }
+    }
+    return;
+}
+
+int main(int argc, char* argv[])
+{
+    int nWidth=(argc>1) ? ::atoi(argv[1]) : 1600;
+    int nHeight=(argc>2) ? ::atoi(argv[2]) : 1200;
+    int nBitDepth=(argc>3) ? ::atoi(argv[3]) : 10;
+    int nIterations=(argc>4) ? ::atoi(argv[4]) : 50;
+
+    if((nWidth<4) || (nHeight<4) || ((nBitDepth!=10) && (nBitDepth!=12)) || (nIterations<1))
+    {
+        std::cerr<<"Usage: "<<argv[0]<<" [width height bitdepth(10|12) iterations]"<<std::endl;
+        return 1;
+    }
+
+    std::vector<uint16_t> vRaw;
+    MakeTestImage(vRaw,nWidth,nHeight,nBitDepth);
+
+    size_t nPixels=(size_t)nWidth*nHeight;
+    std::vector<uint16_t> vRef(nPixels*3);
+    std::vector<uint16_t> vOut(nPixels*3);
+
+    EosAdimecBayer::E_SIMD_LEVEL eBest=EosAdimecBayer::GetBestSimdLevel();
+
+    std::cout<<nWidth<<"x"<<nHeight<<", "<<nBitDepth<<"-bit, "<<nIterations
+             <<" iterations, best SIMD level: "<<EosAdimecBayer::SimdLevelName(eBest)<<std::endl;
+
+    int nMismatches=0;
+
+    const EosAdimecBayer::E_DEMOSAIC_METHOD aeMethods[]=
+        {EosAdimecBayer::eDemosaicBilinear,EosAdimecBayer::eDemosaicEdgeAware};
+    const char* apcMethods[]={"bilinear","edge"};
+
+    // kbs_red_row_first/kbs_green_pixel_first: all four Bayer orders
+    for(int iorder=0; iorder<4; iorder++)
+    {
+        EosAdimecBayer::BayerImage raw;
+        raw.pData=vRaw.data();
+        raw.nWidth=nWidth;
+        raw.nHeight=nHeight;
+        raw.nStride=nWidth;
+        raw.nBitDepth=nBitDepth;
+        raw.bRedRowFirst=(0!=(iorder&2));
+        raw.bGreenPixelFirst=(0!=(iorder&1));
+
+        // Timings for the order our cam files use (1,1) only.
+        bool bTime=(3==iorder);
+
+        for(int imethod=0; imethod<2; imethod++)
+        {
+            EosAdimecBayer::RgbPlanes rgbRef={vRef.data(),vRef.data()+nPixels,
+                                             vRef.data()+2*nPixels,nWidth,0};
+            double dScalarMs=0.0;
+
+            for(int ilevel=EosAdimecBayer::eSimdScalar; ilevel<=eBest; ilevel++)
+            {
+                EosAdimecBayer::E_SIMD_LEVEL eLevel=(EosAdimecBayer::E_SIMD_LEVEL)ilevel;
+                EosAdimecBayer::RgbPlanes rgb=rgbRef;
+                if(ilevel!=EosAdimecBayer::eSimdScalar)
+                {
+                    rgb.pR=vOut.data();
+                    rgb.pG=vOut.data()+nPixels;
+                    rgb.pB=vOut.data()+2*nPixels;
+                }
+
+                int nRuns=bTime ? nIterations : 1;
+                double dStart=NowMs();
+                for(int irun=0; irun<nRuns; irun++)
+                    EosAdimecBayer::Demosaic(raw,rgb,aeMethods[imethod],eLevel);
+                double dMs=(NowMs()-dStart)/nRuns;
+
+                if(ilevel==EosAdimecBayer::eSimdScalar)
+                {
+                    dScalarMs=dMs;
+                }
+                else if(0!=::memcmp(vRef.data(),vOut.data(),vOut.size()*sizeof(uint16_t)))
+                {
+                    std::cerr<<"MISMATCH: "<<apcMethods[imethod]<<" "
+                             <<EosAdimecBayer::SimdLevelName(eLevel)<<" red_row_first="
+                             <<raw.bRedRowFirst<<" green_pixel_first="<<raw.bGreenPixelFirst
+                             <<std::endl;
+                    nMismatches++;
+                }
+
+                if(bTime)
+                {
+                    std::cout<<std::setw(9)<<apcMethods[imethod]<<" "
+                             <<std::setw(7)<<EosAdimecBayer::SimdLevelName(eLevel)<<": "
+                             <<std::fixed<<std::setprecision(2)<<std::setw(8)<<dMs<<" ms/frame  "
+                             <<std::setw(8)<<(nPixels/(dMs*1000.0))<<" Mpix/s  x"
+                             <<std::setprecision(1)<<(dScalarMs/dMs)<<std::endl;
+                }
+            }
+        }
+    }
+
+    if(nMismatches>0)
+    {
+        std::cerr<<nMismatches<<" SIMD/scalar mismatches"<<std::endl;
+        return 1;
+    }
+
+    std::cout<<"All SIMD levels match the scalar reference."<<std::endl;
+
+    if((nWidth&1) || (nHeight&1))
+        return 0;
+
+    // Fused vs. two-pass YUV, with non-trivial white balance.
+    EosAdimecBayer::BayerImage raw={vRaw.data(),nWidth,nHeight,nWidth,nBitDepth,true,true};
+    EosAdimecYuv::WbGains gains={(uint32_t)(1.6*EosAdimecYuv::GAIN_ONE),EosAdimecYuv::GAIN_ONE,
+                                 (uint32_t)(1.3*EosAdimecYuv::GAIN_ONE)};
+    size_t nYuvBytes=EosAdimecYuv::GetFrameBytes(nWidth,nHeight);
+    std::vector<uint8_t> vFused(nYuvBytes);
+    std::vector<uint8_t> vTwoPass(nYuvBytes);
+    std::vector<uint16_t> vScratch;
+
+    const EosAdimecYuv::E_YUV_FORMAT aeFormats[]={EosAdimecYuv::eYuvI420,EosAdimecYuv::eYuvNV12};
+    for(int iformat=0; iformat<2; iformat++)
+    {
+        EosAdimecYuv::E_YUV_FORMAT eFormat=aeFormats[iformat];
+        EosAdimecYuv::YuvImage yuvFused, yuvTwoPass;
+        EosAdimecYuv::SetPlanes(vFused.data(),nWidth,nHeight,eFormat,yuvFused);
+        EosAdimecYuv::SetPlanes(vTwoPass.data(),nWidth,nHeight,eFormat,yuvTwoPass);
+
+        double dStart=NowMs();
+        for(int irun=0; irun<nIterations; irun++)
+        {
+            EosAdimecBayer::RgbPlanes rgb={vRef.data(),vRef.data()+nPixels,
+                                          vRef.data()+2*nPixels,nWidth,0};
+            EosAdimecBayer::Demosaic(raw,rgb,EosAdimecBayer::eDemosaicEdgeAware);
+            EosAdimecYuv::ConvertRgb(rgb,nWidth,nBitDepth,0,nHeight,yuvTwoPass,eFormat,gains);
+        }
+        double dTwoPassMs=(NowMs()-dStart)/nIterations;
+
+        dStart=NowMs();
+        for(int irun=0; irun<nIterations; irun++)
+        {
+            EosAdimecYuv::ConvertBayer(raw,yuvFused,eFormat,gains,
+                                       EosAdimecBayer::eDemosaicEdgeAware,vScratch);
+        }
+        double dFusedMs=(NowMs()-dStart)/nIterations;
+
+        std::cout<<std::setw(9)<<EosAdimecYuv::FormatName(eFormat)<<" two-pass: "
+                 <<std::fixed<<std::setprecision(2)<<std::setw(8)<<dTwoPassMs<<" ms/frame  fused: "
+                 <<std::setw(8)<<dFusedMs<<" ms/frame  x"<<std::setprecision(1)
+                 <<(dTwoPassMs/dFusedMs)<<std::endl;
+
+        if(0!=::memcmp(vFused.data(),vTwoPass.data(),nYuvBytes))
+        {
+            std::cerr<<"MISMATCH: fused vs. two-pass "<<EosAdimecYuv::FormatName(eFormat)<<std::endl;
+            return 1;
+        }
+
+        // Scalar reference for the color conversion
+        EosAdimecBayer::RgbPlanes rgb={vRef.data(),vRef.data()+nPixels,
+                                      vRef.data()+2*nPixels,nWidth,0};
+        EosAdimecBayer::Demosaic(raw,rgb,EosAdimecBayer::eDemosaicEdgeAware);
+        EosAdimecYuv::ConvertRgb(rgb,nWidth,nBitDepth,0,nHeight,yuvTwoPass,eFormat,gains,
+                                 EosAdimecBayer::eSimdScalar);
+        if(0!=::memcmp(vFused.data(),vTwoPass.data(),nYuvBytes))
+        {
+            std::cerr<<"MISMATCH: fused vs. scalar "<<EosAdimecYuv::FormatName(eFormat)<<std::endl;
+            return 1;
+        }
+    }
+
+    std::cout<<"Fused, two-pass and scalar YUV match."<<std::endl;
+
+    // White-balance sums: gray world (every unclipped quad) and a
+    // white-patch style threshold.
+    const uint32_t nClip=(uint32_t)(0.98*((1<<nBitDepth)-1));
+    const uint32_t anMinQuadSum[]={0,3u<<nBitDepth};
+    for(int ithresh=0; ithresh<2; ithresh++)
+    {
+        EosAdimecBayer::ChannelSums sumsRef;
+        double dScalarMs=0.0;
+        for(int ilevel=EosAdimecBayer::eSimdScalar; ilevel<=eBest; ilevel++)
+        {
+            EosAdimecBayer::E_SIMD_LEVEL eLevel=(EosAdimecBayer::E_SIMD_LEVEL)ilevel;
+            EosAdimecBayer::ChannelSums sums;
+
+            double dStart=NowMs();
+            for(int irun=0; irun<nIterations; irun++)
+                EosAdimecBayer::SumChannels(raw,0,nHeight,anMinQuadSum[ithresh],nClip,sums,eLevel);
+            double dMs=(NowMs()-dStart)/nIterations;
+
+            if(ilevel==EosAdimecBayer::eSimdScalar)
+            {
+                sumsRef=sums;
+                dScalarMs=dMs;
+            }
+            else if((sums.nRed!=sumsRef.nRed) || (sums.nGreen!=sumsRef.nGreen) ||
+                    (sums.nBlue!=sumsRef.nBlue) || (sums.nQuads!=sumsRef.nQuads))
+            {
+                std::cerr<<"MISMATCH: channel sums "<<EosAdimecBayer::SimdLevelName(eLevel)
+                         <<" min_quad_sum="<<anMinQuadSum[ithresh]<<std::endl;
+                return 1;
+            }
+
+            std::cout<<std::setw(9)<<"wb sums"<<" "
+                     <<std::setw(7)<<EosAdimecBayer::SimdLevelName(eLevel)<<": "
+                     <<std::fixed<<std::setprecision(2)<<std::setw(8)<<dMs<<" ms/frame  "
+                     <<std::setw(8)<<(nPixels/(dMs*1000.0))<<" Mpix/s  x"
+                     <<std::setprecision(1)<<(dScalarMs/dMs)<<"  ("<<sums.nQuads<<" quads)"
+                     <<std::endl;
+        }
+    }
+
+    std::cout<<"Channel sums match the scalar reference."<<std::endl;
+
+    // Pack/unpack: every level against scalar, and the round trip against
+    // the test image with the bits above the format masked off.
+    const EosAdimecPack::E_PIXEL_FORMAT aePixelFormats[]=
+        {EosAdimecPack::ePixel8,EosAdimecPack::ePixel10p,EosAdimecPack::ePixel12p};
+    for(auto & ePixelFormat: aePixelFormats)
+    {
+        const size_t nPackedBytes=EosAdimecPack::PackedFrameBytes(nWidth,nHeight,ePixelFormat);
+        const uint16_t nMask=(uint16_t)((1u<<EosAdimecPack::FormatBits(ePixelFormat))-1);
+        std::vector<uint8_t> vPackedRef(nPackedBytes);
+        std::vector<uint8_t> vPacked(nPackedBytes);
+        std::vector<uint16_t> vUnpacked(nPixels);
+        double dScalarPackMs=0.0;
+        double dScalarUnpackMs=0.0;
+
+        for(int ilevel=EosAdimecBayer::eSimdScalar; ilevel<=eBest; ilevel++)
+        {
+            EosAdimecBayer::E_SIMD_LEVEL eLevel=(EosAdimecBayer::E_SIMD_LEVEL)ilevel;
+            std::vector<uint8_t>& vDst=(ilevel==EosAdimecBayer::eSimdScalar) ? vPackedRef : vPacked;
+
+            double dStart=NowMs();
+            for(int irun=0; irun<nIterations; irun++)
+                EosAdimecPack::Pack(vRaw.data(),nWidth,nHeight,nWidth,ePixelFormat,vDst.data(),eLevel);
+            double dPackMs=(NowMs()-dStart)/nIterations;
+
+            dStart=NowMs();
+            for(int irun=0; irun<nIterations; irun++)
+                EosAdimecPack::Unpack(vPackedRef.data(),nWidth,nHeight,ePixelFormat,vUnpacked.data(),
+                                      eLevel);
+            double dUnpackMs=(NowMs()-dStart)/nIterations;
+
+            if(ilevel==EosAdimecBayer::eSimdScalar)
+            {
+                dScalarPackMs=dPackMs;
+                dScalarUnpackMs=dUnpackMs;
+            }
+            else if(0!=::memcmp(vPacked.data(),vPackedRef.data(),nPackedBytes))
+            {
+                std::cerr<<"MISMATCH: pack "<<EosAdimecPack::FormatName(ePixelFormat)<<" "
+                         <<EosAdimecBayer::SimdLevelName(eLevel)<<std::endl;
+                return 1;
+            }
+
+            for(size_t ipx=0; ipx<nPixels; ipx++)
+            {
+                if(vUnpacked[ipx]!=(vRaw[ipx]&nMask))
+                {
+                    std::cerr<<"MISMATCH: unpack "<<EosAdimecPack::FormatName(ePixelFormat)<<" "
+                             <<EosAdimecBayer::SimdLevelName(eLevel)<<" pixel "<<ipx<<std::endl;
+                    return 1;
+                }
+            }
+
+            std::cout<<std::setw(9)<<("pack "+EosAdimecPack::FormatName(ePixelFormat))<<" "
+                     <<std::setw(7)<<EosAdimecBayer::SimdLevelName(eLevel)<<": "
+                     <<std::fixed<<std::setprecision(2)<<std::setw(8)<<dPackMs<<" ms/frame  x"
+                     <<std::setprecision(1)<<(dScalarPackMs/dPackMs)<<"  unpack: "
+                     <<std::setprecision(2)<<std::setw(8)<<dUnpackMs<<" ms/frame  x"
+                     <<std::setprecision(1)<<(dScalarUnpackMs/dUnpackMs)<<std::endl;
+        }
+    }
+
+    std::cout<<"Pack/unpack match the scalar reference and round-trip."<<std::endl;
+
+    // Tone map: the lookup at each level against scalar (on the raw frame,
+    // stray high bits included, so the clamp is exercised), then the
+    // tone-mapped fused conversion against the two-pass scalar path.
+    EosAdimecToneMap::ToneParams toneParams;
+    toneParams.eCurve=EosAdimecToneMap::eCurveGamma;
+    toneParams.dGamma=2.2;
+    toneParams.dLogStrength=100.0;
+    toneParams.dGain=1.5;
+    toneParams.dBlackPct=2.0;
+    std::vector<uint16_t> vLut;
+    EosAdimecToneMap::BuildCurve(toneParams,nBitDepth,vLut);
+    const uint32_t nLutMax=(1u<<nBitDepth)-1;
+
+    std::vector<uint16_t> vMappedRef;
+    double dScalarLutMs=0.0;
+    for(int ilevel=EosAdimecBayer::eSimdScalar; ilevel<=eBest; ilevel++)
+    {
+        EosAdimecBayer::E_SIMD_LEVEL eLevel=(EosAdimecBayer::E_SIMD_LEVEL)ilevel;
+        std::vector<uint16_t> vMapped;
+
+        double dMs=0.0;
+        for(int irun=0; irun<nIterations; irun++)
+        {
+            vMapped=vRaw;
+            double dStart=NowMs();
+            for(int irow=0; irow<nHeight; irow++)
+                EosAdimecToneMap::ApplyRow(vMapped.data()+(size_t)irow*nWidth,nWidth,vLut.data(),
+                                           nLutMax,eLevel);
+            dMs+=NowMs()-dStart;
+        }
+        dMs/=nIterations;
+
+        if(ilevel==EosAdimecBayer::eSimdScalar)
+        {
+            vMappedRef=vMapped;
+            dScalarLutMs=dMs;
+        }
+        else if(vMapped!=vMappedRef)
+        {
+            std::cerr<<"MISMATCH: tone map "<<EosAdimecBayer::SimdLevelName(eLevel)<<std::endl;
+            return 1;
+        }
+
+        std::cout<<std::setw(9)<<"tone map"<<" "
+                 <<std::setw(7)<<EosAdimecBayer::SimdLevelName(eLevel)<<": "
+                 <<std::fixed<<std::setprecision(2)<<std::setw(8)<<dMs<<" ms/frame  "
+                 <<std::setw(8)<<(nPixels/(dMs*1000.0))<<" Mpix/s  x"
+                 <<std::setprecision(1)<<(dScalarLutMs/dMs)<<std::endl;
+    }
+
+    for(int iformat=0; iformat<2; iformat++)
+    {
+        EosAdimecYuv::E_YUV_FORMAT eFormat=aeFormats[iformat];
+        EosAdimecYuv::YuvImage yuvFused, yuvTwoPass;
+        EosAdimecYuv::SetPlanes(vFused.data(),nWidth,nHeight,eFormat,yuvFused);
+        EosAdimecYuv::SetPlanes(vTwoPass.data(),nWidth,nHeight,eFormat,yuvTwoPass);
+
+        double dStart=NowMs();
+        for(int irun=0; irun<nIterations; irun++)
+        {
+            EosAdimecYuv::ConvertBayer(raw,yuvFused,eFormat,gains,EosAdimecBayer::eDemosaicEdgeAware,
+                                       vScratch,EosAdimecBayer::eSimdAuto,vLut.data());
+        }
+        double dFusedMs=(NowMs()-dStart)/nIterations;
+
+        EosAdimecBayer::RgbPlanes rgb={vRef.data(),vRef.data()+nPixels,
+                                      vRef.data()+2*nPixels,nWidth,0};
+        EosAdimecBayer::Demosaic(raw,rgb,EosAdimecBayer::eDemosaicEdgeAware);
+        EosAdimecYuv::ConvertRgb(rgb,nWidth,nBitDepth,0,nHeight,yuvTwoPass,eFormat,gains,
+                                 EosAdimecBayer::eSimdScalar,vLut.data());
+
+        std::cout<<std::setw(9)<<EosAdimecYuv::FormatName(eFormat)<<" tone-mapped fused: "
+                 <<std::fixed<<std::setprecision(2)<<std::setw(8)<<dFusedMs<<" ms/frame"<<std::endl;
+
+        if(0!=::memcmp(vFused.data(),vTwoPass.data(),nYuvBytes))
+        {
+            std::cerr<<"MISMATCH: tone-mapped fused vs. scalar "
+                     <<EosAdimecYuv::FormatName(eFormat)<<std::endl;
+            return 1;
+        }
+    }
+
+    std::cout<<"Tone map matches the scalar reference."<<std::endl;
+    return 0;
+}
@@ -0,0 +1,223 @@
+/**
+ * In-process frame capture engine.  See EosAdimecCapture.h
+ */
+
+#include <string.h>
+
+#include <iostream>
+
+#include <boost/bind.hpp>
+#include <boost/thread/locks.hpp>
+
+#include "EosDevice.h"
+#include "EosAdimecCapture.h"
+#include "EosAdimecThreadPlacement.h"
+
+EosAdimecCapture::EosAdimecCapture(EosAdimecFrameSource* pSource, const int nRingBuffers,
+                                   const int nTimeoutMs)
+{
+    m_pSource=pSource;
+    m_nRingBuffers=nRingBuffers;
+    m_nTimeoutMs=nTimeoutMs;
+    m_pSettingsTracker=NULL;
+    m_pCaptureThread=NULL;
+    m_abStop=false;
+    m_nNextConsumerId=1;
+
+    ::memset(&m_stats,0,sizeof(m_stats));
+
+    return;
+}
+
+EosAdimecCapture::~EosAdimecCapture(void)
+{
+    Stop();
+
+    if(m_pSource)
+    {
+        m_pSource->Close();
+        delete m_pSource;
+        m_pSource=NULL;
+    }
+
+    return;
+}
+
+int EosAdimecCapture::Start(const size_t nMaxRingBytes)
+{
+    if(m_pCaptureThread)
+        return UNIX_OK_STATUS;
+
+    if(NULL==m_pSource)
+        return UNIX_ERROR_STATUS;
+
+    // Checked before Open() allocates the ring (EDT: pdv_multibuf()).
+    size_t nRingBytes=m_pSource->ProbeFrameBytes()*m_nRingBuffers;
+    if(0==nRingBytes)
+    {
+        std::cerr<<__FUNCTION__<<"(): no frame geometry from "<<m_pSource->GetName()<<std::endl;
+        m_pSource->Close();
+        return UNIX_ERROR_STATUS;
+    }
+    if((nMaxRingBytes>0) && (nRingBytes>nMaxRingBytes))
+    {
+        std::cerr<<__FUNCTION__<<"(): "<<m_nRingBuffers<<" ring buffers need "
+                 <<(nRingBytes>>20)<<" MB; the limit is "<<(nMaxRingBytes>>20)<<" MB"<<std::endl;
+        m_pSource->Close();
+        return UNIX_ERROR_STATUS;
+    }
+
+    if(UNIX_OK_STATUS!=m_pSource->Open(m_nRingBuffers))
+        return UNIX_ERROR_STATUS;
+
+    if(UNIX_OK_STATUS!=m_pSource->Start())
+    {
+        m_pSource->Close();
+        return UNIX_ERROR_STATUS;
+    }
+
+    {
+        boost::lock_guard<boost::mutex> lock(m_mtxStats);
+        m_stats.bRunning=true;
+    }
+
+    m_abStop=false;
+    m_pCaptureThread=new boost::thread(boost::bind(&EosAdimecCapture::CaptureThread,this));
+
+    return UNIX_OK_STATUS;
+}
+
+void EosAdimecCapture::Stop(void)
+{
+    m_abStop=true;
+
+    if(m_pCaptureThread)
+    {
+        m_pCaptureThread->join();
+        delete m_pCaptureThread;
+        m_pCaptureThread=NULL;
+    }
+
+    if(m_pSource)
+        m_pSource->Stop();
+
+    boost::lock_guard<boost::mutex> lock(m_mtxStats);
+    m_stats.bRunning=false;
+
+    return;
+}
+
+void EosAdimecCapture::SetSettingsTracker(EosAdimecSettingsTracker* pTracker)
+{
+    m_pSettingsTracker=pTracker;
+    return;
+}
+
+int EosAdimecCapture::AddFrameConsumer(FrameConsumer fnConsumer)
+{
+    boost::lock_guard<boost::mutex> lock(m_mtxConsumers);
+    int nConsumerId=m_nNextConsumerId++;
+    m_mapConsumers[nConsumerId]=fnConsumer;
+    return nConsumerId;
+}
+
+// Blocks until a frame in progress has been through all consumers.
+void EosAdimecCapture::RemoveFrameConsumer(const int nConsumerId)
+{
+    boost::lock_guard<boost::mutex> lock(m_mtxConsumers);
+    m_mapConsumers.erase(nConsumerId);
+    return;
+}
+
+EosAdimecCapture::CaptureStats EosAdimecCapture::GetStats(void)
+{
+    boost::lock_guard<boost::mutex> lock(m_mtxStats);
+    return m_stats;
+}
+
+std::string EosAdimecCapture::GetSourceName(void)
+{
+    return m_pSource ? m_pSource->GetName() : std::string("none");
+}
+
+size_t EosAdimecCapture::GetFrameBytes(void)
+{
+    return m_pSource ? m_pSource->GetFrameBytes() : 0;
+}
+
+void EosAdimecCapture::CaptureThread(void)
+{
+    // Weight of the newest frame interval in the smoothed frame rate
+    static const double FPS_SMOOTHING=0.1;
+
+    EosAdimecThreadPlacement::Apply(EosAdimecThreadPlacement::eRoleCapture);
+
+    // How long to back off after a source error
+    static const int ERROR_BACKOFF_MS=100;
+
+    bool bFirst=true;
+    uint64_t nPrevTimeNs=0;
+
+    while(!m_abStop)
+    {
+        EosAdimecRawFrame frame;
+        int nResult=m_pSource->WaitFrame(frame,m_nTimeoutMs);
+
+        if(0==nResult)
+        {
+            boost::lock_guard<boost::mutex> lock(m_mtxStats);
+            m_stats.nTimeouts++;
+            continue;
+        }
+        if(nResult<0)
+        {
+            {
+                boost::lock_guard<boost::mutex> lock(m_mtxStats);
+                m_stats.nErrors++;
+            }
+            boost::this_thread::sleep(boost::posix_time::milliseconds(ERROR_BACKOFF_MS));
+            continue;
+        }
+
+        if(m_pSettingsTracker)
+        {
+            m_pSettingsTracker->TagFrame(frame);
+        }
+        else
+        {
+            ::memset(&frame.settings,0xff,sizeof(frame.settings));   // -1 = unknown
+            frame.settings.nVersion=0;
+            frame.bSettingsChanging=false;
+        }
+
+        {
+            boost::lock_guard<boost::mutex> lock(m_mtxConsumers);
+            for(auto & iconsumer: m_mapConsumers)
+                iconsumer.second(frame);
+        }
+
+        m_pSource->ReleaseFrame(frame);
+
+        boost::lock_guard<boost::mutex> lock(m_mtxStats);
+        m_stats.nFrames++;
+        if(frame.bOverrun)
+            m_stats.nOverruns++;
+        m_stats.nDropped+=frame.nDropped;
+        if(!bFirst)
+        {
+            if(frame.nTimeNs>nPrevTimeNs)
+            {
+                double dFps=1.0e9/(double)(frame.nTimeNs-nPrevTimeNs);
+                m_stats.dFps=(m_stats.dFps>0.0) ?
+                    ((1.0-FPS_SMOOTHING)*m_stats.dFps+FPS_SMOOTHING*dFps) : dFps;
+            }
+        }
+        m_stats.nLastSequence=frame.nSequence;
+        m_stats.nLastTimeNs=frame.nTimeNs;
+
+        bFirst=false;
+        nPrevTimeNs=frame.nTimeNs;
+    }
+
+    return;
+}
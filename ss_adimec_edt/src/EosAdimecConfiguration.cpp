@@ -0,0 +1,691 @@
+/**
+ * Adimec-only configuration keys.  See EosAdimecConfiguration.h
+ */
+
+#include <fstream>
+#include <vector>
+#include <boost/algorithm/string.hpp>
+#include <boost/lexical_cast.hpp>
+
+#include "EosException.h"
+#include "EosAdimecConfiguration.h"
+#include "EosAdimecYuv.h"
+#include "EosAdimecAutoWhiteBalance.h"
+#include "EosAdimecFocus.h"
+#include "EosAdimecPreview.h"
+#include "EosAdimecToneMap.h"
+#include "EosAdimecTileExecutor.h"
+#include "EosAdimecPipeline.h"
+
+const std::string EosAdimecConfiguration::TRANSPORT_NAMEDPIPE="namedpipe";
+const std::string EosAdimecConfiguration::TRANSPORT_UNIX_SEQPACKET="unix_seqpacket";
+const std::string EosAdimecConfiguration::CAPTURE_SOURCE_EDT="edt";
+const std::string EosAdimecConfiguration::CAPTURE_SOURCE_SYNTHETIC="synthetic";
+const std::string EosAdimecConfiguration::SECTION_CAMERA="slavecamera";
+const std::string EosAdimecConfiguration::SECTION_PIPELINE="pipeline";
+
+EosAdimecConfiguration::EosAdimecConfiguration(const std::string& strConfigFile)
+{
+    m_strConfigFile=strConfigFile;
+
+    ReadConfigFile();
+
+    return;
+}
+
+EosAdimecConfigInfo EosAdimecConfiguration::ExtractConfigInfo(void)
+{
+    EosAdimecConfigInfo configInfo;
+
+    // Before any stage key is read
+    ApplyPipelineParams();
+
+    configInfo.nDeviceId=GetInt(SECTION_CAMERA,"id",0);
+
+    configInfo.strScipTransport=
+        boost::to_lower_copy(GetString(SECTION_CAMERA,"scip_transport",
+                                       TRANSPORT_NAMEDPIPE));
+    if((configInfo.strScipTransport!=TRANSPORT_NAMEDPIPE) &&
+       (configInfo.strScipTransport!=TRANSPORT_UNIX_SEQPACKET))
+    {
+        ThrowBadValue(SECTION_CAMERA,"scip_transport",configInfo.strScipTransport,
+                      TRANSPORT_NAMEDPIPE+" or "+TRANSPORT_UNIX_SEQPACKET);
+    }
+
+    // Default socket path is derived from the device ID so that
+    // several controllers on one host don't collide.
+    char cBuf[64];
+    ::snprintf(cBuf,sizeof(cBuf)-1,"/tmp/eosadimec_ss%3.3d.sock",configInfo.nDeviceId);
+    configInfo.strScipSocketPath=GetString(SECTION_CAMERA,"scip_socket_path",cBuf);
+
+    // sun_path is 108 chars, including the terminating NUL.
+    if((configInfo.strScipSocketPath.size()<1) ||
+       (configInfo.strScipSocketPath.size()>107))
+    {
+        ThrowBadValue(SECTION_CAMERA,"scip_socket_path",configInfo.strScipSocketPath,
+                      "a path of 1-107 characters");
+    }
+
+    configInfo.nScipSocketMaxClients=
+        GetInt(SECTION_CAMERA,"scip_socket_max_clients",8,1,64);
+
+    configInfo.nScipOutputQueueDepth=
+        GetInt(SECTION_CAMERA,"scip_output_queue_depth",256,0,65536);
+
+    configInfo.nScipOutputLingerUs=
+        GetInt(SECTION_CAMERA,"scip_output_linger_us",1000,0,100000);
+
+    configInfo.strScipOutputOverflow=
+        boost::to_lower_copy(GetString(SECTION_CAMERA,"scip_output_overflow","drop_oldest"));
+    if((configInfo.strScipOutputOverflow!="drop_oldest") &&
+       (configInfo.strScipOutputOverflow!="drop_newest"))
+    {
+        ThrowBadValue(SECTION_CAMERA,"scip_output_overflow",configInfo.strScipOutputOverflow,
+                      "drop_oldest or drop_newest");
+    }
+
+    configInfo.nScipAsyncQueueDepth=
+        GetInt(SECTION_CAMERA,"scip_async_queue_depth",32,1,1024);
+
+    // "GETTEMP=2000, GETGAIN=500, *=0"
+    std::string strStale=GetString(SECTION_CAMERA,"scip_query_stale_ms","");
+    std::vector<std::string> vStrStale;
+    boost::split(vStrStale,strStale,boost::is_any_of(","),boost::token_compress_on);
+    for(auto & iitem: vStrStale)
+    {
+        std::string strItem=boost::trim_copy(iitem);
+        if(strItem.empty())
+            continue;
+
+        size_t nEq=strItem.find('=');
+        int nMs=-1;
+        if(nEq!=std::string::npos)
+        {
+            try
+            {
+                nMs=boost::lexical_cast<int>(boost::trim_copy(strItem.substr(nEq+1)));
+            }
+            catch(...)
+            {
+                nMs=-1;
+            }
+        }
+        if((nEq==std::string::npos) || (nEq==0) || (nMs<0))
+        {
+            ThrowBadValue(SECTION_CAMERA,"scip_query_stale_ms",strStale,
+                          "a list of COMMAND=ms items");
+        }
+        configInfo.mapQueryStaleMs[boost::to_upper_copy(boost::trim_copy(strItem.substr(0,nEq)))]=nMs;
+    }
+
+    configInfo.bCaptureEnable=GetBool(SECTION_CAMERA,"capture_enable",false);
+
+    configInfo.strCaptureSource=
+        boost::to_lower_copy(GetString(SECTION_CAMERA,"capture_source",CAPTURE_SOURCE_EDT));
+    if((configInfo.strCaptureSource!=CAPTURE_SOURCE_EDT) &&
+       (configInfo.strCaptureSource!=CAPTURE_SOURCE_SYNTHETIC))
+    {
+        ThrowBadValue(SECTION_CAMERA,"capture_source",configInfo.strCaptureSource,
+                      CAPTURE_SOURCE_EDT+" or "+CAPTURE_SOURCE_SYNTHETIC);
+    }
+
+    configInfo.nCaptureRingBuffers=GetInt(SECTION_CAMERA,"capture_ring_buffers",4,2,64);
+    configInfo.nCaptureTimeoutMs=GetInt(SECTION_CAMERA,"capture_timeout_ms",1000,10,60000);
+    configInfo.nCaptureEdtUnit=GetInt(SECTION_CAMERA,"capture_edt_unit",0,0,15);
+
+    configInfo.nCaptureSynthWidth=GetInt(SECTION_CAMERA,"capture_synthetic_width",1600,16,8192);
+    configInfo.nCaptureSynthHeight=GetInt(SECTION_CAMERA,"capture_synthetic_height",1200,16,8192);
+    configInfo.nCaptureSynthBitDepth=GetInt(SECTION_CAMERA,"capture_synthetic_bit_depth",10,10,12);
+    if((configInfo.nCaptureSynthBitDepth!=10) && (configInfo.nCaptureSynthBitDepth!=12))
+    {
+        ThrowBadValue(SECTION_CAMERA,"capture_synthetic_bit_depth",
+                      boost::lexical_cast<std::string>(configInfo.nCaptureSynthBitDepth),"10 or 12");
+    }
+    configInfo.nCaptureSynthFps=GetInt(SECTION_CAMERA,"capture_synthetic_fps",30,1,1000);
+    configInfo.bCaptureSynthRedRowFirst=
+        GetBool(SECTION_CAMERA,"capture_synthetic_red_row_first",true);
+    configInfo.bCaptureSynthGreenPixelFirst=
+        GetBool(SECTION_CAMERA,"capture_synthetic_green_pixel_first",true);
+
+    configInfo.nTileThreads=GetInt(SECTION_CAMERA,"tile_threads",0,0,64);
+    std::string strTileCpus=GetString(SECTION_CAMERA,"tile_cpus","");
+    if(!EosAdimecTileExecutor::ParseCpus(strTileCpus,configInfo.vnTileCpus))
+        ThrowBadValue(SECTION_CAMERA,"tile_cpus",strTileCpus,"a list of CPUs, e.g. 2,3,6-7");
+    configInfo.nTileKb=GetInt(SECTION_CAMERA,"tile_kb",256,16,16384);
+
+    configInfo.bFramePoolHugePages=GetBool(SECTION_CAMERA,"frame_pool_hugepages",false);
+    configInfo.bFramePoolMlock=GetBool(SECTION_CAMERA,"frame_pool_mlock",false);
+
+    for(int irole=0; irole<EosAdimecThreadPlacement::NUM_ROLES; irole++)
+    {
+        EosAdimecThreadPlacement::Placement& placement=configInfo.aThreadPlacements[irole];
+        std::string strKey="thread_"+
+            EosAdimecThreadPlacement::RoleName((EosAdimecThreadPlacement::E_ROLE)irole);
+
+        std::string strCpus=GetString(SECTION_CAMERA,strKey+"_cpus","");
+        if(!EosAdimecTileExecutor::ParseCpus(strCpus,placement.vnCpus))
+            ThrowBadValue(SECTION_CAMERA,strKey+"_cpus",strCpus,"a list of CPUs, e.g. 2,3,6-7");
+
+        std::string strPolicy=GetString(SECTION_CAMERA,strKey+"_policy","other");
+        if(!EosAdimecThreadPlacement::PolicyFromString(strPolicy,placement.ePolicy))
+            ThrowBadValue(SECTION_CAMERA,strKey+"_policy",strPolicy,"other or fifo");
+
+        placement.nPriority=GetInt(SECTION_CAMERA,strKey+"_priority",0,-20,99);
+        if(!EosAdimecThreadPlacement::IsValidPriority(placement.ePolicy,placement.nPriority))
+        {
+            ThrowBadValue(SECTION_CAMERA,strKey+"_priority",
+                          boost::lexical_cast<std::string>(placement.nPriority),
+                          (EosAdimecThreadPlacement::ePolicyFifo==placement.ePolicy) ?
+                          "1-99 for fifo" : "a nice value, -20 to 19, for other");
+        }
+    }
+
+    configInfo.bVideoOutputEnable=GetBool(SECTION_CAMERA,"video_output_enable",false);
+
+    ::snprintf(cBuf,sizeof(cBuf)-1,"/tmp/eosadimec_ss%3.3d_video.yuv",configInfo.nDeviceId);
+    configInfo.strVideoOutputFifo=GetString(SECTION_CAMERA,"video_output_fifo",cBuf);
+    if(configInfo.strVideoOutputFifo.empty())
+    {
+        ThrowBadValue(SECTION_CAMERA,"video_output_fifo",configInfo.strVideoOutputFifo,"a path");
+    }
+
+    EosAdimecYuv::E_YUV_FORMAT eFormat;
+    configInfo.strVideoOutputFormat=
+        boost::to_lower_copy(GetString(SECTION_CAMERA,"video_output_format","i420"));
+    if(!EosAdimecYuv::FormatFromString(configInfo.strVideoOutputFormat,eFormat))
+    {
+        ThrowBadValue(SECTION_CAMERA,"video_output_format",configInfo.strVideoOutputFormat,
+                      "i420 or nv12");
+    }
+
+    EosAdimecBayer::E_DEMOSAIC_METHOD eMethod;
+    configInfo.strVideoOutputDemosaic=
+        boost::to_lower_copy(GetString(SECTION_CAMERA,"video_output_demosaic","edge"));
+    if(!EosAdimecBayer::MethodFromString(configInfo.strVideoOutputDemosaic,eMethod))
+    {
+        ThrowBadValue(SECTION_CAMERA,"video_output_demosaic",configInfo.strVideoOutputDemosaic,
+                      "bilinear or edge");
+    }
+
+    // "R,G,B", each 0-8
+    std::string strGains=GetString(SECTION_CAMERA,"video_output_wb_gains","1.0,1.0,1.0");
+    std::vector<std::string> vStrGains;
+    boost::split(vStrGains,strGains,boost::is_any_of(","));
+    bool bGainsOk=(3==vStrGains.size());
+    for(size_t igain=0; bGainsOk && (igain<3); igain++)
+    {
+        uint32_t nGain;
+        try
+        {
+            configInfo.adVideoWbGains[igain]=
+                boost::lexical_cast<double>(boost::trim_copy(vStrGains[igain]));
+            bGainsOk=EosAdimecYuv::GainFromDouble(configInfo.adVideoWbGains[igain],nGain);
+        }
+        catch(...)
+        {
+            bGainsOk=false;
+        }
+    }
+    if(!bGainsOk)
+    {
+        ThrowBadValue(SECTION_CAMERA,"video_output_wb_gains",strGains,
+                      "three gains R,G,B between 0 and 8");
+    }
+
+    EosAdimecToneMap::E_CURVE eCurve;
+    configInfo.strVideoToneMap=
+        boost::to_lower_copy(GetString(SECTION_CAMERA,"video_output_tonemap","off"));
+    if(!EosAdimecToneMap::CurveFromString(configInfo.strVideoToneMap,eCurve))
+    {
+        ThrowBadValue(SECTION_CAMERA,"video_output_tonemap",configInfo.strVideoToneMap,
+                      "off, linear, gamma, log or equalize");
+    }
+    configInfo.dVideoToneGamma=GetDouble(SECTION_CAMERA,"video_output_tonemap_gamma",2.2,1.0,5.0);
+    configInfo.dVideoToneLog=GetDouble(SECTION_CAMERA,"video_output_tonemap_log",100.0,1.0,10000.0);
+    configInfo.dVideoToneGain=GetDouble(SECTION_CAMERA,"video_output_tonemap_gain",1.0,0.1,64.0);
+    configInfo.dVideoToneBlackPct=
+        GetDouble(SECTION_CAMERA,"video_output_tonemap_black",0.0,0.0,50.0);
+
+    configInfo.bFrameRingEnable=GetBool(SECTION_CAMERA,"frame_ring_enable",false);
+
+    ::snprintf(cBuf,sizeof(cBuf)-1,"/eosadimec_ss%3.3d_frames",configInfo.nDeviceId);
+    configInfo.strFrameRingShmName=GetString(SECTION_CAMERA,"frame_ring_shm_name",cBuf);
+    if((configInfo.strFrameRingShmName.size()<2) || (configInfo.strFrameRingShmName[0]!='/') ||
+       (configInfo.strFrameRingShmName.find('/',1)!=std::string::npos))
+    {
+        ThrowBadValue(SECTION_CAMERA,"frame_ring_shm_name",configInfo.strFrameRingShmName,
+                      "a name like /eosadimec_frames (one leading slash only)");
+    }
+
+    ::snprintf(cBuf,sizeof(cBuf)-1,"/tmp/eosadimec_ss%3.3d_frames.sock",configInfo.nDeviceId);
+    configInfo.strFrameRingSocketPath=GetString(SECTION_CAMERA,"frame_ring_socket",cBuf);
+    if((configInfo.strFrameRingSocketPath.size()<1) ||
+       (configInfo.strFrameRingSocketPath.size()>107))
+    {
+        ThrowBadValue(SECTION_CAMERA,"frame_ring_socket",configInfo.strFrameRingSocketPath,
+                      "a path of 1-107 characters");
+    }
+
+    configInfo.nFrameRingSlots=GetInt(SECTION_CAMERA,"frame_ring_slots",8,2,64);
+    configInfo.nFrameRingMaxReaders=GetInt(SECTION_CAMERA,"frame_ring_max_readers",8,1,32);
+    configInfo.bFrameRingPacked=GetBool(SECTION_CAMERA,"frame_ring_packed",false);
+
+    configInfo.nFrameSettingsTimeUnitUs=GetInt(SECTION_CAMERA,"frame_settings_time_unit_us",20,1,1000);
+    configInfo.nFrameSettingsMarginUs=GetInt(SECTION_CAMERA,"frame_settings_margin_us",500,0,100000);
+
+    configInfo.bAeEnable=GetBool(SECTION_CAMERA,"ae_enable",false);
+    configInfo.nAeTargetPct=GetInt(SECTION_CAMERA,"ae_target_pct",40,1,99);
+    configInfo.nAeRateHz=GetInt(SECTION_CAMERA,"ae_rate_hz",5,1,100);
+
+    GetRoi(SECTION_CAMERA,"ae_roi",configInfo.anAeRoi);
+
+    // "once" only makes sense as a command (AWB_ONCE[])
+    EosAdimecAutoWhiteBalance::E_AWB_MODE eAwbMode;
+    configInfo.strAwbMode=boost::to_lower_copy(GetString(SECTION_CAMERA,"awb_mode","off"));
+    if(!EosAdimecAutoWhiteBalance::ModeFromString(configInfo.strAwbMode,eAwbMode) ||
+       (EosAdimecAutoWhiteBalance::eAwbOnce==eAwbMode))
+    {
+        ThrowBadValue(SECTION_CAMERA,"awb_mode",configInfo.strAwbMode,"off or continuous");
+    }
+
+    EosAdimecAutoWhiteBalance::E_AWB_METHOD eAwbMethod;
+    configInfo.strAwbMethod=
+        boost::to_lower_copy(GetString(SECTION_CAMERA,"awb_method","gray_world"));
+    if(!EosAdimecAutoWhiteBalance::MethodFromString(configInfo.strAwbMethod,eAwbMethod))
+    {
+        ThrowBadValue(SECTION_CAMERA,"awb_method",configInfo.strAwbMethod,
+                      "gray_world or white_patch");
+    }
+
+    configInfo.nAwbHysteresisPct=GetInt(SECTION_CAMERA,"awb_hysteresis_pct",5,1,50);
+    configInfo.nAwbRateHz=GetInt(SECTION_CAMERA,"awb_rate_hz",2,1,100);
+    configInfo.nAwbBlackLevel=GetInt(SECTION_CAMERA,"awb_black_level",0,0,32767);
+
+    configInfo.bFrameStatsEnable=GetBool(SECTION_CAMERA,"frame_stats_enable",false);
+    configInfo.nFrameStatsDecimation=GetInt(SECTION_CAMERA,"frame_stats_decimation",10,1,10000);
+    configInfo.nFrameStatsPushMs=GetInt(SECTION_CAMERA,"frame_stats_push_ms",0,0,3600000);
+
+    configInfo.bFocusEnable=GetBool(SECTION_CAMERA,"focus_enable",false);
+
+    EosAdimecFocus::E_FOCUS_METHOD eFocusMethod;
+    configInfo.strFocusMethod=
+        boost::to_lower_copy(GetString(SECTION_CAMERA,"focus_method","tenengrad"));
+    if(!EosAdimecFocus::MethodFromString(configInfo.strFocusMethod,eFocusMethod))
+    {
+        ThrowBadValue(SECTION_CAMERA,"focus_method",configInfo.strFocusMethod,
+                      "tenengrad or laplacian");
+    }
+
+    GetRoi(SECTION_CAMERA,"focus_roi",configInfo.anFocusRoi);
+    configInfo.bFocusPush=GetBool(SECTION_CAMERA,"focus_push",false);
+
+    ::snprintf(cBuf,sizeof(cBuf)-1,"/eosadimec_ss%3.3d_focus",configInfo.nDeviceId);
+    configInfo.strFocusShmName=GetString(SECTION_CAMERA,"focus_shm_name",cBuf);
+    if((configInfo.strFocusShmName.size()<2) || (configInfo.strFocusShmName[0]!='/') ||
+       (configInfo.strFocusShmName.find('/',1)!=std::string::npos))
+    {
+        ThrowBadValue(SECTION_CAMERA,"focus_shm_name",configInfo.strFocusShmName,
+                      "a name like /eosadimec_focus (one leading slash only)");
+    }
+    configInfo.nFocusHistory=GetInt(SECTION_CAMERA,"focus_history",256,2,65536);
+
+    configInfo.bRecorderEnable=GetBool(SECTION_CAMERA,"recorder_enable",false);
+    configInfo.nRecorderSeconds=GetInt(SECTION_CAMERA,"recorder_seconds",10,1,3600);
+    configInfo.nRecorderMaxMb=GetInt(SECTION_CAMERA,"recorder_max_mb",0,0,1048576);
+    configInfo.nRecorderMaxPostS=GetInt(SECTION_CAMERA,"recorder_max_post_s",60,0,3600);
+    configInfo.bRecorderPacked=GetBool(SECTION_CAMERA,"recorder_packed",false);
+
+    ::snprintf(cBuf,sizeof(cBuf)-1,"/var/tmp/eosadimec_ss%3.3d_recordings",configInfo.nDeviceId);
+    configInfo.strRecorderDir=GetString(SECTION_CAMERA,"recorder_dir",cBuf);
+    if(configInfo.strRecorderDir.empty() || ('/'!=configInfo.strRecorderDir[0]))
+    {
+        ThrowBadValue(SECTION_CAMERA,"recorder_dir",configInfo.strRecorderDir,"an absolute path");
+    }
+
+    configInfo.bSnapshotEnable=GetBool(SECTION_CAMERA,"snapshot_enable",false);
+    configInfo.strSnapshotDemosaic=
+        boost::to_lower_copy(GetString(SECTION_CAMERA,"snapshot_demosaic","edge"));
+    if(!EosAdimecBayer::MethodFromString(configInfo.strSnapshotDemosaic,eMethod))
+    {
+        ThrowBadValue(SECTION_CAMERA,"snapshot_demosaic",configInfo.strSnapshotDemosaic,
+                      "bilinear or edge");
+    }
+    configInfo.nSnapshotJpegQuality=GetInt(SECTION_CAMERA,"snapshot_jpeg_quality",90,1,100);
+    configInfo.nSnapshotPngLevel=GetInt(SECTION_CAMERA,"snapshot_png_level",1,0,9);
+    configInfo.nSnapshotKeep=GetInt(SECTION_CAMERA,"snapshot_keep",8,1,10000);
+    configInfo.nSnapshotTimeoutMs=GetInt(SECTION_CAMERA,"snapshot_timeout_ms",2000,100,600000);
+    configInfo.strSnapshotTriggerMode=GetString(SECTION_CAMERA,"snapshot_trigger_mode","");
+    configInfo.strSnapshotStreamMode=GetString(SECTION_CAMERA,"snapshot_stream_mode","@MO4");
+
+    ::snprintf(cBuf,sizeof(cBuf)-1,"/dev/shm/eosadimec_ss%3.3d_snapshots",configInfo.nDeviceId);
+    configInfo.strSnapshotDir=GetString(SECTION_CAMERA,"snapshot_dir",cBuf);
+    if(configInfo.strSnapshotDir.empty() || ('/'!=configInfo.strSnapshotDir[0]))
+    {
+        ThrowBadValue(SECTION_CAMERA,"snapshot_dir",configInfo.strSnapshotDir,"an absolute path");
+    }
+
+    configInfo.bPreviewEnable=GetBool(SECTION_CAMERA,"preview_enable",false);
+    std::string strPreviewLevels=GetString(SECTION_CAMERA,"preview_levels","2,4,8");
+    if(!EosAdimecPreview::ScalesFromString(strPreviewLevels,configInfo.vnPreviewScales))
+    {
+        ThrowBadValue(SECTION_CAMERA,"preview_levels",strPreviewLevels,"a list of 2, 4 and 8");
+    }
+    configInfo.nPreviewDecimation=GetInt(SECTION_CAMERA,"preview_decimation",6,1,10000);
+    configInfo.strPreviewFormat=
+        boost::to_lower_copy(GetString(SECTION_CAMERA,"preview_format","i420"));
+    if(!EosAdimecYuv::FormatFromString(configInfo.strPreviewFormat,eFormat))
+    {
+        ThrowBadValue(SECTION_CAMERA,"preview_format",configInfo.strPreviewFormat,"i420 or nv12");
+    }
+
+    ::snprintf(cBuf,sizeof(cBuf)-1,"/eosadimec_ss%3.3d_preview",configInfo.nDeviceId);
+    configInfo.strPreviewShmName=GetString(SECTION_CAMERA,"preview_shm_name",cBuf);
+    if((configInfo.strPreviewShmName.size()<2) || (configInfo.strPreviewShmName[0]!='/') ||
+       (configInfo.strPreviewShmName.find('/',1)!=std::string::npos))
+    {
+        ThrowBadValue(SECTION_CAMERA,"preview_shm_name",configInfo.strPreviewShmName,
+                      "a name like /eosadimec_preview (one leading slash only)");
+    }
+
+    configInfo.bArchiveEnable=GetBool(SECTION_CAMERA,"archive_enable",false);
+    configInfo.nArchiveSegmentMb=GetInt(SECTION_CAMERA,"archive_segment_mb",256,16,4096);
+    configInfo.nArchiveMaxGb=GetInt(SECTION_CAMERA,"archive_max_gb",0,0,1048576);
+    configInfo.nArchiveStagingFrames=GetInt(SECTION_CAMERA,"archive_staging_frames",16,2,256);
+    configInfo.bArchivePacked=GetBool(SECTION_CAMERA,"archive_packed",false);
+
+    ::snprintf(cBuf,sizeof(cBuf)-1,"/var/tmp/eosadimec_ss%3.3d_archive",configInfo.nDeviceId);
+    configInfo.strArchiveDir=GetString(SECTION_CAMERA,"archive_dir",cBuf);
+    if(configInfo.strArchiveDir.empty() || ('/'!=configInfo.strArchiveDir[0]))
+    {
+        ThrowBadValue(SECTION_CAMERA,"archive_dir",configInfo.strArchiveDir,"an absolute path");
+    }
+
+    configInfo.bCorrectionEnable=GetBool(SECTION_CAMERA,"correction_enable",false);
+    configInfo.nCorrectionGainStep=GetInt(SECTION_CAMERA,"correction_gain_step",100,1,700);
+    configInfo.nCorrectionMaxFrames=GetInt(SECTION_CAMERA,"correction_max_frames",64,1,1024);
+
+    ::snprintf(cBuf,sizeof(cBuf)-1,"/var/tmp/eosadimec_ss%3.3d_correction",configInfo.nDeviceId);
+    configInfo.strCorrectionDir=GetString(SECTION_CAMERA,"correction_dir",cBuf);
+    if(configInfo.strCorrectionDir.empty() || ('/'!=configInfo.strCorrectionDir[0]))
+    {
+        ThrowBadValue(SECTION_CAMERA,"correction_dir",configInfo.strCorrectionDir,"an absolute path");
+    }
+
+    configInfo.nMaxMemMb=GetInt(SECTION_CAMERA,"max_mem_mb",350,1,1048576);
+
+    ExtractPipeline(configInfo);
+
+    return configInfo;
+}
+
+void EosAdimecConfiguration::ApplyPipelineParams(void)
+{
+    const std::string strPrefix=SECTION_PIPELINE+".";
+
+    std::map<std::string,std::string> mapParams;
+    for(auto & ixKey: m_mapKeyValue)
+    {
+        if(0!=ixKey.first.compare(0,strPrefix.size(),strPrefix))
+            continue;
+
+        std::string strKey=ixKey.first.substr(strPrefix.size());
+        size_t nDot=strKey.find('.');
+        if(std::string::npos==nDot)
+            continue;
+
+        std::string strStage=strKey.substr(0,nDot);
+        std::string strParam=strKey.substr(nDot+1);
+        EosAdimecPipeline::E_STAGE eStage;
+        if(!EosAdimecPipeline::StageFromString(strStage,eStage))
+            ThrowBadValue(SECTION_PIPELINE,strKey,ixKey.second,"a known stage before the '.'");
+        if(strParam!="input")
+            mapParams[SECTION_CAMERA+"."+strStage+"_"+strParam]=ixKey.second;
+    }
+
+    for(auto & ixParam: mapParams)
+        m_mapKeyValue[ixParam.first]=ixParam.second;
+
+    return;
+}
+
+void EosAdimecConfiguration::ExtractPipeline(EosAdimecConfigInfo& configInfo)
+{
+    std::string strStages=GetString(SECTION_PIPELINE,"stages","");
+    configInfo.bPipelineDeclared=!strStages.empty();
+    configInfo.mapPipeline.clear();
+
+    if(!configInfo.bPipelineDeclared)
+    {
+        // The graph before [pipeline]: everything after correction.
+        const char* const apszAlways[]={"correction","ae","awb","archive"};
+        for(auto & ipszStage: apszAlways)
+            configInfo.mapPipeline[ipszStage]="";
+        if(configInfo.bVideoOutputEnable)
+            configInfo.mapPipeline["video_output"]="";
+        if(configInfo.bFrameRingEnable)
+            configInfo.mapPipeline["frame_ring"]="";
+        if(configInfo.bFrameStatsEnable)
+            configInfo.mapPipeline["frame_stats"]="";
+        if(configInfo.bFocusEnable)
+            configInfo.mapPipeline["focus"]="";
+        if(configInfo.bRecorderEnable)
+            configInfo.mapPipeline["recorder"]="";
+        if(configInfo.bSnapshotEnable)
+            configInfo.mapPipeline["snapshot"]="";
+        if(configInfo.bPreviewEnable)
+            configInfo.mapPipeline["preview"]="";
+    }
+    else
+    {
+        std::vector<std::string> vStrStages;
+        boost::split(vStrStages,strStages,boost::is_any_of(", "),boost::token_compress_on);
+        for(auto & ixStage: vStrStages)
+        {
+            if(ixStage.empty())
+                continue;
+            std::string strStage=boost::to_lower_copy(ixStage);
+            configInfo.mapPipeline[strStage]=GetString(SECTION_PIPELINE,strStage+".input","");
+        }
+
+        // A stage not in the graph is off whatever its *_enable key says;
+        // one that is, is on (the archive still waits for archive_enable
+        // or SET_ARCHIVE[1]).
+        configInfo.bVideoOutputEnable=(configInfo.mapPipeline.count("video_output")>0);
+        configInfo.bFrameRingEnable=(configInfo.mapPipeline.count("frame_ring")>0);
+        configInfo.bFrameStatsEnable=(configInfo.mapPipeline.count("frame_stats")>0);
+        configInfo.bFocusEnable=(configInfo.mapPipeline.count("focus")>0);
+        configInfo.bRecorderEnable=(configInfo.mapPipeline.count("recorder")>0);
+        configInfo.bSnapshotEnable=(configInfo.mapPipeline.count("snapshot")>0);
+        configInfo.bPreviewEnable=(configInfo.mapPipeline.count("preview")>0);
+        configInfo.bArchiveEnable=configInfo.bArchiveEnable &&
+            (configInfo.mapPipeline.count("archive")>0);
+    }
+
+    EosAdimecPipeline::Graph graph;
+    std::string strError;
+    if(!EosAdimecPipeline::ParseGraph(configInfo.mapPipeline,graph,strError))
+        ThrowBadValue(SECTION_PIPELINE,"stages",strStages,"a valid graph: "+strError);
+
+    return;
+}
+
+// Load "key = value" pairs.  Comment lines start with '#' or ';'.
+void EosAdimecConfiguration::ReadConfigFile(void)
+{
+    std::ifstream ifs(m_strConfigFile.c_str());
+    if(!ifs.is_open())
+    {
+        EosException excp(1,"Could not open configuration file "+m_strConfigFile,
+                          __FILE__,__LINE__);
+        throw excp;
+    }
+
+    std::string strSection;
+    std::string strLine;
+    while(std::getline(ifs,strLine))
+    {
+        boost::trim(strLine);
+        if(strLine.empty() || (strLine[0]=='#') || (strLine[0]==';'))
+            continue;
+
+        if(strLine[0]=='[')
+        {
+            size_t nEnd=strLine.find(']');
+            if(nEnd!=std::string::npos)
+                strSection=boost::to_lower_copy(boost::trim_copy(strLine.substr(1,nEnd-1)));
+            continue;
+        }
+
+        size_t nEq=strLine.find('=');
+        if(nEq==std::string::npos)
+            continue;
+
+        std::string strKey=boost::to_lower_copy(boost::trim_copy(strLine.substr(0,nEq)));
+        std::string strValue=strLine.substr(nEq+1);
+
+        // Allow trailing comments on value lines
+        size_t nComment=strValue.find('#');
+        if(nComment!=std::string::npos)
+            strValue.erase(nComment);
+        boost::trim(strValue);
+
+        m_mapKeyValue[strSection+"."+strKey]=strValue;
+    }
+
+    return;
+}
+
+std::string EosAdimecConfiguration::GetString(const std::string& strSection,
+                                              const std::string& strKey,
+                                              const std::string& strDefault)
+{
+    std::map<std::string,std::string>::const_iterator imap=
+        m_mapKeyValue.find(strSection+"."+strKey);
+    if(imap==m_mapKeyValue.end())
+        return strDefault;
+
+    return imap->second;
+}
+
+int EosAdimecConfiguration::GetInt(const std::string& strSection,
+                                   const std::string& strKey,
+                                   const int nDefault)
+{
+    std::string strValue=GetString(strSection,strKey,"");
+    if(strValue.empty())
+        return nDefault;
+
+    int nValue=nDefault;
+    try
+    {
+        nValue=boost::lexical_cast<int>(strValue);
+    }
+    catch(...)
+    {
+        ThrowBadValue(strSection,strKey,strValue,"an integer");
+    }
+    return nValue;
+}
+
+int EosAdimecConfiguration::GetInt(const std::string& strSection,
+                                   const std::string& strKey,
+                                   const int nDefault,
+                                   const int nMin,
+                                   const int nMax)
+{
+    int nValue=GetInt(strSection,strKey,nDefault);
+    if((nValue<nMin) || (nValue>nMax))
+    {
+        ThrowBadValue(strSection,strKey,boost::lexical_cast<std::string>(nValue),
+                      boost::lexical_cast<std::string>(nMin)+"-"+
+                      boost::lexical_cast<std::string>(nMax));
+    }
+    return nValue;
+}
+
+double EosAdimecConfiguration::GetDouble(const std::string& strSection,
+                                         const std::string& strKey,
+                                         const double dDefault,
+                                         const double dMin,
+                                         const double dMax)
+{
+    std::string strValue=GetString(strSection,strKey,"");
+    if(strValue.empty())
+        return dDefault;
+
+    double dValue=dDefault;
+    try
+    {
+        dValue=boost::lexical_cast<double>(strValue);
+    }
+    catch(...)
+    {
+        ThrowBadValue(strSection,strKey,strValue,"a number");
+    }
+    if(!(dValue>=dMin) || (dValue>dMax))
+    {
+        ThrowBadValue(strSection,strKey,strValue,
+                      boost::lexical_cast<std::string>(dMin)+"-"+
+                      boost::lexical_cast<std::string>(dMax));
+    }
+    return dValue;
+}
+
+bool EosAdimecConfiguration::GetBool(const std::string& strSection,
+                                     const std::string& strKey,
+                                     const bool bDefault)
+{
+    std::string strValue=boost::to_lower_copy(GetString(strSection,strKey,""));
+    if(strValue.empty())
+        return bDefault;
+
+    if((strValue=="1")||(strValue=="y")||(strValue=="yes")||
+       (strValue=="true")||(strValue=="on"))
+        return true;
+
+    if((strValue=="0")||(strValue=="n")||(strValue=="no")||
+       (strValue=="false")||(strValue=="off"))
+        return false;
+
+    ThrowBadValue(strSection,strKey,strValue,"1/0, yes/no, true/false, or on/off");
+    return bDefault;
+}
+
+// "x,y,w,h", pixels, each >= 0 (w,h 0 = whole frame)
+void EosAdimecConfiguration::GetRoi(const std::string& strSection,
+                                    const std::string& strKey,
+                                    int anRoi[4])
+{
+    std::string strRoi=GetString(strSection,strKey,"0,0,0,0");
+    std::vector<std::string> vStrRoi;
+    boost::split(vStrRoi,strRoi,boost::is_any_of(","));
+    bool bRoiOk=(4==vStrRoi.size());
+    for(size_t iroi=0; bRoiOk && (iroi<4); iroi++)
+    {
+        try
+        {
+            anRoi[iroi]=boost::lexical_cast<int>(boost::trim_copy(vStrRoi[iroi]));
+            bRoiOk=(anRoi[iroi]>=0);
+        }
+        catch(...)
+        {
+            bRoiOk=false;
+        }
+    }
+    if(!bRoiOk)
+    {
+        ThrowBadValue(strSection,strKey,strRoi,"x,y,w,h in pixels, each >= 0");
+    }
+    return;
+}
+
+void EosAdimecConfiguration::ThrowBadValue(const std::string& strSection,
+                                           const std::string& strKey,
+                                           const std::string& strValue,
+                                           const std::string& strExpected)
+{
+    EosException excp(1,m_strConfigFile+": ["+strSection+"] "+strKey+" = "+strValue+
+                      " is invalid (expected "+strExpected+")",
+                      __FILE__,__LINE__);
+    throw excp;
+}
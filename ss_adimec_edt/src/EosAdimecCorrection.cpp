@@ -0,0 +1,863 @@
+/**
+ * Dark-frame and flat-field correction.  See EosAdimecCorrection.h
+ */
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include <algorithm>
+#include <iostream>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define EOS_ADIMEC_CORRECTION_X86
+#endif
+
+#include <boost/bind.hpp>
+#include <boost/thread/locks.hpp>
+
+#include "EosDevice.h"
+#include "EosAdimecCorrection.h"
+#include "EosAdimecThreadPlacement.h"
+#include "EosAdimecUtil.h"
+
+// Reference thread nice level: averaging a dark/flat and writing it out
+// can take seconds and must not take CPU from capture.
+static const int CORRECTION_THREAD_NICE=10;
+
+// Reference thread wakeup while no dark/flat capture is complete, for Stop()
+static const int CORRECTION_IDLE_WAIT_MS=200;
+
+// Gain 1.0 (Q12).  The largest, 65535, is just under 16.
+static const uint32_t CORRECTION_GAIN_ONE=4096;
+
+// Flat pixels under this share of their Bayer position's mean are
+// defects: left at gain 1 rather than amplified.
+static const double CORRECTION_FLAT_DEFECT=0.125;
+
+// A usable flat: every Bayer position's mean signal between these
+// shares of full scale.
+static const double CORRECTION_FLAT_MIN_LEVEL=0.02;
+static const double CORRECTION_FLAT_MAX_LEVEL=0.95;
+
+// Kernels need (raw - dark) << 4 to fit 16 bits.
+static const int CORRECTION_MAX_BIT_DEPTH=12;
+
+// out = min(((raw & mask) -sat dark) * gain (Q12), mask); pixels [nBegin, nWidth)
+static void CorrectRowScalar(const uint16_t* pRaw, const uint16_t* pDark, const uint16_t* pGain,
+                             const int nBegin, const int nWidth, const uint16_t nMask,
+                             uint16_t* pOut)
+{
+    for(int ipx=nBegin; ipx<nWidth; ipx++)
+    {
+        uint32_t nValue=pRaw[ipx]&nMask;
+        uint32_t nSignal=(nValue>pDark[ipx]) ? (nValue-pDark[ipx]) : 0;
+        uint32_t nCorrected=((nSignal<<4)*pGain[ipx])>>16;
+        pOut[ipx]=(uint16_t)std::min(nCorrected,(uint32_t)nMask);
+    }
+    return;
+}
+
+#ifdef EOS_ADIMEC_CORRECTION_X86
+
+// SSE4.1/AVX2: subtract with unsigned saturation, then the Q12 gain as
+// a high multiply of (signal << 4), which is the scalar product >> 16.
+// Each returns the first pixel it did not do.
+
+__attribute__((target("sse4.1")))
+static int CorrectRowSse4(const uint16_t* pRaw, const uint16_t* pDark, const uint16_t* pGain,
+                          const int nWidth, const uint16_t nMask, uint16_t* pOut)
+{
+    const __m128i vMask=_mm_set1_epi16((short)nMask);
+    int ipx=0;
+    for(; ipx+8<=nWidth; ipx+=8)
+    {
+        __m128i vRaw=_mm_and_si128(_mm_loadu_si128((const __m128i*)(pRaw+ipx)),vMask);
+        __m128i vSignal=_mm_subs_epu16(vRaw,_mm_loadu_si128((const __m128i*)(pDark+ipx)));
+        __m128i vCorrected=_mm_mulhi_epu16(_mm_slli_epi16(vSignal,4),
+                                           _mm_loadu_si128((const __m128i*)(pGain+ipx)));
+        _mm_storeu_si128((__m128i*)(pOut+ipx),_mm_min_epu16(vCorrected,vMask));
+    }
+    return ipx;
+}
+
+__attribute__((target("avx2")))
+static int CorrectRowAvx2(const uint16_t* pRaw, const uint16_t* pDark, const uint16_t* pGain,
+                          const int nWidth, const uint16_t nMask, uint16_t* pOut)
+{
+    const __m256i vMask=_mm256_set1_epi16((short)nMask);
+    int ipx=0;
+    for(; ipx+16<=nWidth; ipx+=16)
+    {
+        __m256i vRaw=_mm256_and_si256(_mm256_loadu_si256((const __m256i*)(pRaw+ipx)),vMask);
+        __m256i vSignal=_mm256_subs_epu16(vRaw,_mm256_loadu_si256((const __m256i*)(pDark+ipx)));
+        __m256i vCorrected=_mm256_mulhi_epu16(_mm256_slli_epi16(vSignal,4),
+                                              _mm256_loadu_si256((const __m256i*)(pGain+ipx)));
+        _mm256_storeu_si256((__m256i*)(pOut+ipx),_mm256_min_epu16(vCorrected,vMask));
+    }
+    return ipx;
+}
+
+#else
+
+static int CorrectRowSse4(const uint16_t* pRaw, const uint16_t* pDark, const uint16_t* pGain,
+                          const int nWidth, const uint16_t nMask, uint16_t* pOut)
+{
+    return 0;
+}
+
+static int CorrectRowAvx2(const uint16_t* pRaw, const uint16_t* pDark, const uint16_t* pGain,
+                          const int nWidth, const uint16_t nMask, uint16_t* pOut)
+{
+    return 0;
+}
+
+#endif
+
+EosAdimecCorrection::EosAdimecCorrection(DoneFn fnDone, const std::string& strDir,
+                                         const int nGainStep, EosAdimecTileExecutor* pExecutor)
+{
+    m_fnDone=fnDone;
+    m_strDir=strDir;
+    m_nGainStep=std::max(1,nGainStep);
+    m_pExecutor=pExecutor;
+
+    m_pReferenceThread=NULL;
+    m_bStop=false;
+
+    m_bEnable=false;
+    m_nGeneration=0;
+    m_capture.bActive=false;
+    m_capture.bComplete=false;
+    m_capture.eKind=eKindDark;
+    m_capture.nFrames=0;
+    m_capture.nDone=0;
+
+    m_pOutPool=NULL;
+    m_pOut=NULL;
+    m_nOutPixels=0;
+    m_nReservedBytes=0;
+    m_nPickedVersion=0;
+    m_nPickedGeneration=0;
+    m_nPickedWidth=0;
+    m_nPickedHeight=0;
+    m_nPickedBitDepth=0;
+    m_bPicked=false;
+    m_pickedBucket.nBitDepth=0;
+    m_pickedBucket.nGain=-1;
+    m_pickedBucket.nOctave=-1;
+    m_pDark=NULL;
+    m_pFlat=NULL;
+
+    m_nCorrected=0;
+    m_nUncorrected=0;
+    m_dApplyMs=0.0;
+
+    return;
+}
+
+EosAdimecCorrection::~EosAdimecCorrection(void)
+{
+    Stop();
+
+    for(auto & iref: m_mapDarks)
+        delete iref.second;
+    m_mapDarks.clear();
+    for(auto & iref: m_mapFlats)
+        delete iref.second;
+    m_mapFlats.clear();
+
+    EosAdimecFramePool::Unreserve(m_nReservedBytes);
+    m_nReservedBytes=0;
+
+    return;
+}
+
+int EosAdimecCorrection::Start(const size_t nFrameBytes)
+{
+    if(m_pReferenceThread)
+        return UNIX_OK_STATUS;
+
+    // Allocated here, so the capture thread never allocates to correct.
+    size_t nPixels=nFrameBytes/sizeof(uint16_t);
+    m_pOutPool=new EosAdimecFramePool("correction",nPixels*sizeof(uint16_t),1);
+    if(UNIX_OK_STATUS!=m_pOutPool->Start())
+    {
+        delete m_pOutPool;
+        m_pOutPool=NULL;
+        return UNIX_ERROR_STATUS;
+    }
+    m_pOut=(uint16_t*)m_pOutPool->GetSlot(m_pOutPool->Acquire());
+    m_nOutPixels=nPixels;
+
+    // The stand-in references count against the budget like real ones.
+    size_t nStandInBytes=2*nPixels*sizeof(uint16_t);
+    if(!EosAdimecFramePool::Reserve(nStandInBytes))
+    {
+        std::cerr<<__FUNCTION__<<"(): no frame-pool budget for the correction references"<<std::endl;
+        delete m_pOutPool;
+        m_pOutPool=NULL;
+        m_pOut=NULL;
+        m_nOutPixels=0;
+        return UNIX_ERROR_STATUS;
+    }
+    m_nReservedBytes+=nStandInBytes;
+    m_vZero.assign(nPixels,0);
+    m_vUnity.assign(nPixels,(uint16_t)CORRECTION_GAIN_ONE);
+
+    EosAdimecUtil::MakeDirs(m_strDir);
+    LoadReferences();
+
+    m_bStop=false;
+    m_pReferenceThread=new boost::thread(boost::bind(&EosAdimecCorrection::ReferenceThread,this));
+
+    return UNIX_OK_STATUS;
+}
+
+void EosAdimecCorrection::Stop(void)
+{
+    {
+        boost::lock_guard<boost::mutex> lock(m_mtxCorrection);
+        m_bStop=true;
+        m_cvCorrection.notify_all();
+    }
+
+    if(m_pReferenceThread)
+    {
+        m_pReferenceThread->join();
+        delete m_pReferenceThread;
+        m_pReferenceThread=NULL;
+    }
+
+    if(m_pOutPool)
+    {
+        delete m_pOutPool;
+        m_pOutPool=NULL;
+        m_pOut=NULL;
+        m_nOutPixels=0;
+
+        size_t nStandInBytes=(m_vZero.size()+m_vUnity.size())*sizeof(uint16_t);
+        std::vector<uint16_t>().swap(m_vZero);
+        std::vector<uint16_t>().swap(m_vUnity);
+        EosAdimecFramePool::Unreserve(nStandInBytes);
+        m_nReservedBytes-=nStandInBytes;
+    }
+
+    return;
+}
+
+void EosAdimecCorrection::SetEnable(const bool bEnable)
+{
+    boost::lock_guard<boost::mutex> lock(m_mtxCorrection);
+    m_bEnable=bEnable;
+    return;
+}
+
+std::string EosAdimecCorrection::BucketName(const int nBitDepth, const int nGainBucket,
+                                            const int nItOctave)
+{
+    char cBuf[64];
+    ::snprintf(cBuf,sizeof(cBuf),"b%d_g%d_o%d",nBitDepth,nGainBucket,nItOctave);
+    return std::string(cBuf);
+}
+
+std::string EosAdimecCorrection::KindName(const E_KIND eKind)
+{
+    return (eKindFlat==eKind) ? "flat" : "dark";
+}
+
+EosAdimecCorrection::Bucket EosAdimecCorrection::BucketOf(const EosAdimecRawFrame& frame) const
+{
+    Bucket bucket;
+    bucket.nBitDepth=frame.nBitDepth;
+
+    int nGain=frame.settings.nGain;
+    bucket.nGain=(nGain<0) ? -1 : (((nGain+m_nGainStep/2)/m_nGainStep)*m_nGainStep);
+
+    int nIt=frame.settings.nIntegrationTime;
+    bucket.nOctave=-1;
+    if(nIt>0)
+    {
+        bucket.nOctave=0;
+        while(nIt>1)
+        {
+            nIt>>=1;
+            bucket.nOctave++;
+        }
+    }
+
+    return bucket;
+}
+
+// Nearest: gain buckets first (they shift the dark level most), then octaves.
+const EosAdimecCorrection::Reference* EosAdimecCorrection::FindReference(
+    const RefMap& mapRefs, const Bucket& bucket, const int nWidth, const int nHeight)
+{
+    const Reference* pBest=NULL;
+    long nBestDistance=0;
+    for(auto & iref: mapRefs)
+    {
+        const EosAdimecCorrectionHeader& header=iref.second->header;
+        if((iref.first.nBitDepth!=bucket.nBitDepth) || (header.nWidth!=nWidth) ||
+           (header.nHeight!=nHeight))
+        {
+            continue;
+        }
+
+        long nDistance=(long)std::abs(iref.first.nGain-bucket.nGain)*1000+
+                       std::abs(iref.first.nOctave-bucket.nOctave);
+        if((NULL==pBest) || (nDistance<nBestDistance))
+        {
+            pBest=iref.second;
+            nBestDistance=nDistance;
+        }
+    }
+    return pBest;
+}
+
+void EosAdimecCorrection::OnFrame(EosAdimecRawFrame& frame)
+{
+    boost::lock_guard<boost::mutex> lock(m_mtxCorrection);
+
+    if(m_capture.bActive && !m_capture.bComplete)
+    {
+        Accumulate(frame);
+        return;
+    }
+    if(!m_bEnable)
+        return;
+
+    uint64_t nStartNs=EosAdimecUtil::MonotonicNs();
+    const size_t nPixels=(size_t)frame.nWidth*frame.nHeight;
+
+    // The references only change with the settings, the geometry, or a new reference.
+    if(!m_bPicked || (frame.settings.nVersion!=m_nPickedVersion) ||
+       (m_nGeneration!=m_nPickedGeneration) || (frame.nWidth!=m_nPickedWidth) ||
+       (frame.nHeight!=m_nPickedHeight) || (frame.nBitDepth!=m_nPickedBitDepth))
+    {
+        m_pickedBucket=BucketOf(frame);
+        m_pDark=FindReference(m_mapDarks,m_pickedBucket,frame.nWidth,frame.nHeight);
+        m_pFlat=FindReference(m_mapFlats,m_pickedBucket,frame.nWidth,frame.nHeight);
+        m_nPickedVersion=frame.settings.nVersion;
+        m_nPickedGeneration=m_nGeneration;
+        m_nPickedWidth=frame.nWidth;
+        m_nPickedHeight=frame.nHeight;
+        m_nPickedBitDepth=frame.nBitDepth;
+        m_bPicked=true;
+    }
+
+    if(((NULL==m_pDark) && (NULL==m_pFlat)) || (nPixels>m_nOutPixels) ||
+       (frame.nBitDepth>CORRECTION_MAX_BIT_DEPTH) || (frame.nBitDepth<1))
+    {
+        m_nUncorrected++;
+        return;
+    }
+
+    const uint16_t nMask=(uint16_t)((1u<<frame.nBitDepth)-1);
+    const uint16_t* pDark=m_pDark ? m_pDark->vData.data() : m_vZero.data();
+    const uint16_t* pGain=m_pFlat ? m_pFlat->vData.data() : m_vUnity.data();
+    EosAdimecBayer::E_SIMD_LEVEL eLevel=EosAdimecBayer::GetBestSimdLevel();
+
+    // Raw, dark, gain and output: 8 bytes a pixel
+    EosAdimecTileExecutor::JobSpec spec={frame.nHeight,(size_t)frame.nWidth*8,1,0};
+    if(m_pExecutor)
+    {
+        m_pExecutor->Run(spec,boost::bind(&EosAdimecCorrection::CorrectTile,this,&frame,
+                                          pDark,pGain,nMask,eLevel,_1));
+    }
+    else
+    {
+        EosAdimecTileExecutor::Tile tile={0,0,frame.nHeight,0,frame.nHeight,0};
+        CorrectTile(&frame,pDark,pGain,nMask,eLevel,tile);
+    }
+
+    frame.pData=m_pOut;
+    frame.nStride=frame.nWidth;
+
+    m_nCorrected++;
+    m_dApplyMs=(EosAdimecUtil::MonotonicNs()-nStartNs)/1.0e6;
+
+    return;
+}
+
+void EosAdimecCorrection::CorrectTile(const EosAdimecRawFrame* pFrame, const uint16_t* pDark,
+                                      const uint16_t* pGain, const uint16_t nMask,
+                                      const EosAdimecBayer::E_SIMD_LEVEL eLevel,
+                                      const EosAdimecTileExecutor::Tile& tile)
+{
+    const int nWidth=pFrame->nWidth;
+    for(int irow=tile.nRowBegin; irow<tile.nRowEnd; irow++)
+    {
+        const uint16_t* pRaw=pFrame->pData+(size_t)irow*pFrame->nStride;
+        size_t nOffset=(size_t)irow*nWidth;
+        uint16_t* pOut=m_pOut+nOffset;
+
+        int nDone=0;
+        if(EosAdimecBayer::eSimdAvx2==eLevel)
+            nDone=CorrectRowAvx2(pRaw,pDark+nOffset,pGain+nOffset,nWidth,nMask,pOut);
+        else if(EosAdimecBayer::eSimdSse4==eLevel)
+            nDone=CorrectRowSse4(pRaw,pDark+nOffset,pGain+nOffset,nWidth,nMask,pOut);
+        CorrectRowScalar(pRaw,pDark+nOffset,pGain+nOffset,nDone,nWidth,nMask,pOut);
+    }
+    return;
+}
+
+// A frame taken while a SET was in flight is left out; a change of
+// bucket or size part-way through spoils the capture.
+void EosAdimecCorrection::Accumulate(const EosAdimecRawFrame& frame)
+{
+    Capture& capture=m_capture;
+    if(frame.bSettingsChanging)
+        return;
+
+    Bucket bucket=BucketOf(frame);
+    if(0==capture.nDone)
+    {
+        capture.bucket=bucket;
+        capture.nWidth=frame.nWidth;
+        capture.nHeight=frame.nHeight;
+        capture.settings=frame.settings;
+        capture.vSum.assign((size_t)frame.nWidth*frame.nHeight,0);
+        if((frame.nBitDepth>CORRECTION_MAX_BIT_DEPTH) || (frame.nBitDepth<1))
+            capture.strError="bit_depth";
+    }
+    else if((bucket<capture.bucket) || (capture.bucket<bucket) ||
+            (frame.nWidth!=capture.nWidth) || (frame.nHeight!=capture.nHeight))
+    {
+        capture.strError="settings_changed";
+    }
+
+    if(capture.strError.empty())
+    {
+        const uint16_t nMask=(uint16_t)((1u<<frame.nBitDepth)-1);
+        for(int irow=0; irow<frame.nHeight; irow++)
+        {
+            const uint16_t* pRaw=frame.pData+(size_t)irow*frame.nStride;
+            uint32_t* pSum=capture.vSum.data()+(size_t)irow*frame.nWidth;
+            for(int icol=0; icol<frame.nWidth; icol++)
+                pSum[icol]+=pRaw[icol]&nMask;
+        }
+        capture.nDone++;
+    }
+
+    if(!capture.strError.empty() || (capture.nDone>=capture.nFrames))
+    {
+        capture.bComplete=true;
+        m_cvCorrection.notify_all();
+    }
+
+    return;
+}
+
+int EosAdimecCorrection::BeginCapture(const E_KIND eKind, const int nFrames,
+                                      std::string& strError)
+{
+    boost::lock_guard<boost::mutex> lock(m_mtxCorrection);
+
+    if(m_capture.bActive)
+    {
+        strError="busy";
+        return UNIX_ERROR_STATUS;
+    }
+
+    m_capture.bActive=true;
+    m_capture.bComplete=false;
+    m_capture.eKind=eKind;
+    m_capture.nFrames=std::max(1,nFrames);
+    m_capture.nDone=0;
+    m_capture.nWidth=0;
+    m_capture.nHeight=0;
+    m_capture.vSum.clear();
+    m_capture.strError.clear();
+
+    return UNIX_OK_STATUS;
+}
+
+EosAdimecCorrection::CorrectionStats EosAdimecCorrection::GetStats(void)
+{
+    boost::lock_guard<boost::mutex> lock(m_mtxCorrection);
+
+    CorrectionStats stats;
+    stats.bEnable=m_bEnable;
+    stats.nDarks=m_mapDarks.size();
+    stats.nFlats=m_mapFlats.size();
+    stats.nBytes=0;
+    for(auto & iref: m_mapDarks)
+        stats.nBytes+=iref.second->vData.size()*sizeof(uint16_t);
+    for(auto & iref: m_mapFlats)
+        stats.nBytes+=iref.second->vData.size()*sizeof(uint16_t);
+
+    stats.strBucket=m_bPicked ? BucketName(m_pickedBucket.nBitDepth,m_pickedBucket.nGain,
+                                           m_pickedBucket.nOctave) : "none";
+    stats.strDark="none";
+    stats.strFlat="none";
+    if(m_bPicked && m_pDark)
+    {
+        const EosAdimecCorrectionHeader& header=m_pDark->header;
+        stats.strDark=BucketName(header.nBitDepth,header.nGainBucket,header.nItOctave);
+    }
+    if(m_bPicked && m_pFlat)
+    {
+        const EosAdimecCorrectionHeader& header=m_pFlat->header;
+        stats.strFlat=BucketName(header.nBitDepth,header.nGainBucket,header.nItOctave);
+    }
+
+    stats.nCorrected=m_nCorrected;
+    stats.nUncorrected=m_nUncorrected;
+    stats.dApplyMs=m_dApplyMs;
+    stats.bCapturing=m_capture.bActive;
+    stats.eCapturing=m_capture.eKind;
+    stats.nCaptured=m_capture.nDone;
+    stats.nCaptureFrames=m_capture.nFrames;
+
+    return stats;
+}
+
+void EosAdimecCorrection::ReferenceThread(void)
+{
+    // Per-thread on Linux: only this thread is niced.
+    EosAdimecThreadPlacement::ApplyBackground(CORRECTION_THREAD_NICE);
+
+    boost::unique_lock<boost::mutex> lock(m_mtxCorrection);
+    while(!m_bStop)
+    {
+        if(!m_capture.bActive || !m_capture.bComplete)
+        {
+            m_cvCorrection.timed_wait(lock,boost::get_system_time()+
+                                      boost::posix_time::milliseconds(CORRECTION_IDLE_WAIT_MS));
+            continue;
+        }
+
+        CaptureResult result;
+        result.eKind=m_capture.eKind;
+        result.bOk=false;
+        result.strBucket=BucketName(m_capture.bucket.nBitDepth,m_capture.bucket.nGain,
+                                    m_capture.bucket.nOctave);
+        result.strError=m_capture.strError;
+        result.nFrames=m_capture.nDone;
+        result.dMean=0.0;
+
+        if(result.strError.empty())
+        {
+            // The capture thread leaves m_capture alone until bActive is cleared.
+            lock.unlock();
+            std::vector<uint16_t> vPixels;
+            Reference* pReference=BuildReference(vPixels,result.strError);
+            if(pReference && !SaveReference(*pReference,vPixels,result.strPath))
+                result.strError="write_failed";
+            lock.lock();
+
+            if(pReference)
+            {
+                result.dMean=pReference->header.dMean;
+                if(!Install(pReference))
+                    result.strError="no_memory";
+                result.bOk=result.strError.empty();
+            }
+        }
+
+        m_capture.bActive=false;
+        m_capture.vSum.clear();
+        m_capture.vSum.shrink_to_fit();
+
+        if(m_fnDone)
+        {
+            lock.unlock();
+            m_fnDone(result);
+            lock.lock();
+        }
+    }
+
+    if(m_capture.bActive)
+    {
+        CaptureResult result;
+        result.eKind=m_capture.eKind;
+        result.bOk=false;
+        result.strError="stopped";
+        result.nFrames=m_capture.nDone;
+        result.dMean=0.0;
+        m_capture.bActive=false;
+
+        if(m_fnDone)
+        {
+            lock.unlock();
+            m_fnDone(result);
+            lock.lock();
+        }
+    }
+
+    return;
+}
+
+EosAdimecCorrection::Reference* EosAdimecCorrection::BuildReference(std::vector<uint16_t>& vPixels,
+                                                                    std::string& strError)
+{
+    const Capture& capture=m_capture;
+    const size_t nPixels=capture.vSum.size();
+    const uint32_t nFullScale=(1u<<capture.bucket.nBitDepth)-1;
+
+    // Mean of the frames, rounded
+    vPixels.resize(nPixels);
+    for(size_t ipx=0; ipx<nPixels; ipx++)
+        vPixels[ipx]=(uint16_t)((capture.vSum[ipx]+capture.nDone/2)/capture.nDone);
+
+    Reference* pReference=new Reference;
+    EosAdimecCorrectionHeader& header=pReference->header;
+    ::memset(&header,0,sizeof(header));
+    header.nMagic=EosAdimecCorrectionConst::MAGIC;
+    header.nVersion=EosAdimecCorrectionConst::VERSION;
+    header.nHeaderBytes=sizeof(header);
+    header.nKind=capture.eKind;
+    header.nWidth=capture.nWidth;
+    header.nHeight=capture.nHeight;
+    header.nBitDepth=capture.bucket.nBitDepth;
+    header.nGainBucket=capture.bucket.nGain;
+    header.nItOctave=capture.bucket.nOctave;
+    header.nFrames=capture.nDone;
+    header.nWallSec=::time(NULL);
+    header.settings=capture.settings;
+
+    if(eKindFlat==capture.eKind)
+    {
+        // Less this bucket's own dark: the offset is not signal.
+        {
+            boost::lock_guard<boost::mutex> lock(m_mtxCorrection);
+            RefMap::const_iterator itDark=m_mapDarks.find(capture.bucket);
+            if((itDark==m_mapDarks.end()) || (itDark->second->vData.size()!=nPixels))
+            {
+                strError="no_dark";
+                delete pReference;
+                return NULL;
+            }
+            const uint16_t* pDark=itDark->second->vData.data();
+            for(size_t ipx=0; ipx<nPixels; ipx++)
+                vPixels[ipx]=(vPixels[ipx]>pDark[ipx]) ? (vPixels[ipx]-pDark[ipx]) : 0;
+        }
+
+        // Every Bayer position must be lit, and none clipped.
+        double adSum[4]={0.0,0.0,0.0,0.0};
+        for(int irow=0; irow<capture.nHeight; irow++)
+        {
+            const uint16_t* pRow=vPixels.data()+(size_t)irow*capture.nWidth;
+            for(int icol=0; icol<capture.nWidth; icol++)
+                adSum[((irow&1)<<1)|(icol&1)]+=pRow[icol];
+        }
+        double dPositionPixels=(double)nPixels/4.0;
+        for(auto & dSum: adSum)
+        {
+            double dMean=dSum/dPositionPixels;
+            if(dMean<CORRECTION_FLAT_MIN_LEVEL*nFullScale)
+                strError="too_dark";
+            else if(dMean>CORRECTION_FLAT_MAX_LEVEL*nFullScale)
+                strError="saturated";
+        }
+        if(!strError.empty())
+        {
+            delete pReference;
+            return NULL;
+        }
+
+        FlatToGain(vPixels.data(),capture.nWidth,capture.nHeight,pReference->vData);
+    }
+    else
+    {
+        pReference->vData=vPixels;
+    }
+
+    double dSum=0.0;
+    for(auto & nPixel: vPixels)
+        dSum+=nPixel;
+    header.dMean=(nPixels>0) ? (dSum/nPixels) : 0.0;
+
+    return pReference;
+}
+
+void EosAdimecCorrection::FlatToGain(const uint16_t* pFlat, const int nWidth, const int nHeight,
+                                     std::vector<uint16_t>& vGain)
+{
+    double adSum[4]={0.0,0.0,0.0,0.0};
+    double adCount[4]={0.0,0.0,0.0,0.0};
+    for(int irow=0; irow<nHeight; irow++)
+    {
+        const uint16_t* pRow=pFlat+(size_t)irow*nWidth;
+        for(int icol=0; icol<nWidth; icol++)
+        {
+            int nPos=((irow&1)<<1)|(icol&1);
+            adSum[nPos]+=pRow[icol];
+            adCount[nPos]+=1.0;
+        }
+    }
+
+    double adMean[4];
+    for(int ipos=0; ipos<4; ipos++)
+        adMean[ipos]=(adCount[ipos]>0.0) ? (adSum[ipos]/adCount[ipos]) : 0.0;
+
+    vGain.resize((size_t)nWidth*nHeight);
+    for(int irow=0; irow<nHeight; irow++)
+    {
+        const uint16_t* pRow=pFlat+(size_t)irow*nWidth;
+        uint16_t* pGain=vGain.data()+(size_t)irow*nWidth;
+        for(int icol=0; icol<nWidth; icol++)
+        {
+            double dMean=adMean[((irow&1)<<1)|(icol&1)];
+            double dGain=CORRECTION_GAIN_ONE;
+            if(pRow[icol]>=CORRECTION_FLAT_DEFECT*dMean)
+                dGain=(dMean*CORRECTION_GAIN_ONE)/pRow[icol]+0.5;
+            pGain[icol]=(uint16_t)std::min(dGain,65535.0);
+        }
+    }
+
+    return;
+}
+
+// The old reference of the bucket (if any) goes; the capture thread
+// picks again on its next frame.  Only the growth over the old one is
+// charged to the budget.
+bool EosAdimecCorrection::Install(Reference* pReference)
+{
+    Bucket bucket;
+    bucket.nBitDepth=pReference->header.nBitDepth;
+    bucket.nGain=pReference->header.nGainBucket;
+    bucket.nOctave=pReference->header.nItOctave;
+
+    RefMap& mapRefs=(EosAdimecCorrectionConst::KIND_FLAT==pReference->header.nKind) ?
+        m_mapFlats : m_mapDarks;
+    RefMap::iterator itRef=mapRefs.find(bucket);
+
+    size_t nNewBytes=pReference->vData.size()*sizeof(uint16_t);
+    size_t nOldBytes=(itRef!=mapRefs.end()) ? itRef->second->vData.size()*sizeof(uint16_t) : 0;
+    if(nNewBytes>nOldBytes)
+    {
+        if(!EosAdimecFramePool::Reserve(nNewBytes-nOldBytes))
+        {
+            delete pReference;
+            return false;
+        }
+    }
+    else
+    {
+        EosAdimecFramePool::Unreserve(nOldBytes-nNewBytes);
+    }
+    m_nReservedBytes=m_nReservedBytes+nNewBytes-nOldBytes;
+
+    if(itRef!=mapRefs.end())
+    {
+        delete itRef->second;
+        itRef->second=pReference;
+    }
+    else
+    {
+        mapRefs[bucket]=pReference;
+    }
+
+    m_nGeneration++;
+    m_bPicked=false;
+    m_pDark=NULL;
+    m_pFlat=NULL;
+
+    return true;
+}
+
+std::string EosAdimecCorrection::ReferencePath(const EosAdimecCorrectionHeader& header) const
+{
+    E_KIND eKind=(EosAdimecCorrectionConst::KIND_FLAT==header.nKind) ? eKindFlat : eKindDark;
+    return m_strDir+"/"+KindName(eKind)+"_"+
+           BucketName(header.nBitDepth,header.nGainBucket,header.nItOctave)+".ecor";
+}
+
+// Written to a temporary name and renamed, so a reference on disk is
+// always whole.
+bool EosAdimecCorrection::SaveReference(const Reference& reference,
+                                        const std::vector<uint16_t>& vPixels,
+                                        std::string& strPath)
+{
+    strPath=ReferencePath(reference.header);
+    std::string strTemp=strPath+".tmp";
+
+    int nFd=::open(strTemp.c_str(),O_WRONLY|O_CREAT|O_TRUNC|O_CLOEXEC,0640);
+    if(nFd<0)
+    {
+        std::cerr<<__FUNCTION__<<"(): "<<strTemp<<": "<<::strerror(errno)<<std::endl;
+        return false;
+    }
+
+    bool bOk=EosAdimecUtil::WriteAll(nFd,&reference.header,sizeof(reference.header)) &&
+             EosAdimecUtil::WriteAll(nFd,vPixels.data(),vPixels.size()*sizeof(uint16_t)) &&
+             (0==::fdatasync(nFd));
+    bOk=(0==::close(nFd)) && bOk;
+    bOk=bOk && (0==::rename(strTemp.c_str(),strPath.c_str()));
+    if(!bOk)
+    {
+        std::cerr<<__FUNCTION__<<"(): "<<strPath<<": "<<::strerror(errno)<<std::endl;
+        ::unlink(strTemp.c_str());
+    }
+
+    return bOk;
+}
+
+void EosAdimecCorrection::LoadReferences(void)
+{
+    DIR* pDir=::opendir(m_strDir.c_str());
+    if(NULL==pDir)
+        return;
+
+    std::vector<std::string> vPaths;
+    struct dirent* pEntry;
+    while(NULL!=(pEntry=::readdir(pDir)))
+    {
+        std::string strName=pEntry->d_name;
+        if((strName.size()>5) && (0==strName.compare(strName.size()-5,5,".ecor")))
+            vPaths.push_back(m_strDir+"/"+strName);
+    }
+    ::closedir(pDir);
+
+    for(auto & strPath: vPaths)
+    {
+        FILE* pFile=::fopen(strPath.c_str(),"rb");
+        if(NULL==pFile)
+            continue;
+
+        Reference* pReference=new Reference;
+        EosAdimecCorrectionHeader& header=pReference->header;
+        std::vector<uint16_t> vPixels;
+        bool bOk=(1==::fread(&header,sizeof(header),1,pFile)) &&
+                 (header.nMagic==EosAdimecCorrectionConst::MAGIC) &&
+                 (header.nVersion==EosAdimecCorrectionConst::VERSION) &&
+                 (header.nHeaderBytes>=sizeof(header)) &&
+                 (header.nKind<=EosAdimecCorrectionConst::KIND_FLAT) &&
+                 (header.nWidth>0) && (header.nHeight>0) &&
+                 (header.nBitDepth>=1) && (header.nBitDepth<=CORRECTION_MAX_BIT_DEPTH) &&
+                 (0==::fseek(pFile,header.nHeaderBytes,SEEK_SET));
+        if(bOk)
+        {
+            vPixels.resize((size_t)header.nWidth*header.nHeight);
+            bOk=(1==::fread(vPixels.data(),vPixels.size()*sizeof(uint16_t),1,pFile));
+        }
+        ::fclose(pFile);
+
+        if(!bOk)
+        {
+            std::cerr<<__FUNCTION__<<"(): "<<strPath<<" is not a reference, ignored"<<std::endl;
+            delete pReference;
+            continue;
+        }
+
+        if(EosAdimecCorrectionConst::KIND_FLAT==header.nKind)
+            FlatToGain(vPixels.data(),header.nWidth,header.nHeight,pReference->vData);
+        else
+            pReference->vData.swap(vPixels);
+
+        boost::lock_guard<boost::mutex> lock(m_mtxCorrection);
+        if(!Install(pReference))
+            std::cerr<<__FUNCTION__<<"(): "<<strPath<<" does not fit in the frame-pool budget, ignored"<<std::endl;
+    }
+
+    return;
+}
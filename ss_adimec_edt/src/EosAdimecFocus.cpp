@@ -0,0 +1,722 @@
+/**
+ * Per-frame focus score.  See EosAdimecFocus.h
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include <algorithm>
+#include <iostream>
+#include <new>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define EOS_ADIMEC_FOCUS_X86
+#endif
+
+#include <boost/bind.hpp>
+#include <boost/thread/locks.hpp>
+
+#include "EosDevice.h"
+#include "EosAdimecFocus.h"
+#include "EosAdimecThreadPlacement.h"
+
+// Green plane values: each green scaled to this many bits, two per quad.
+// Keeps every Sobel/Laplacian term inside 16 bits and each square sum
+// inside 32 bits, so the SIMD kernels can use madd.
+static const int FOCUS_GREEN_BITS=10;
+
+// Re-check for a pending push this often (also the stop latency)
+static const int FOCUS_IDLE_WAIT_MS=200;
+
+// One green plane row: the two greens of each quad, pRow0/pRow1 at the
+// quad's first column, nGreen0/nGreen1 the green column (0/1) in each.
+static void GreenRowScalar(const uint16_t* pRow0, const uint16_t* pRow1, const int nGreen0,
+                           const int nGreen1, const int nQuadBegin, const int nQuads,
+                           const uint32_t nMask, const int nShiftRight, const int nShiftLeft,
+                           int16_t* pGreen)
+{
+    for(int iquad=nQuadBegin; iquad<nQuads; iquad++)
+    {
+        uint32_t nG0=((pRow0[2*iquad+nGreen0]&nMask)>>nShiftRight)<<nShiftLeft;
+        uint32_t nG1=((pRow1[2*iquad+nGreen1]&nMask)>>nShiftRight)<<nShiftLeft;
+        pGreen[iquad]=(int16_t)(nG0+nG1);
+    }
+    return;
+}
+
+// Tenengrad over columns [nColBegin, nWidth-1) of the middle row: sum of
+// gx^2+gy^2.
+static uint64_t TenengradRowScalar(const int16_t* pAbove, const int16_t* pRow,
+                                   const int16_t* pBelow, const int nColBegin, const int nWidth)
+{
+    uint64_t nSum=0;
+    for(int icol=nColBegin; icol<nWidth-1; icol++)
+    {
+        int nGx=(pAbove[icol+1]-pAbove[icol-1])+2*(pRow[icol+1]-pRow[icol-1])+
+                (pBelow[icol+1]-pBelow[icol-1]);
+        int nGy=(pBelow[icol-1]+2*pBelow[icol]+pBelow[icol+1])-
+                (pAbove[icol-1]+2*pAbove[icol]+pAbove[icol+1]);
+        nSum+=(uint64_t)(nGx*nGx+nGy*nGy);
+    }
+    return nSum;
+}
+
+// Laplacian over columns [nColBegin, nWidth-1) of the middle row: sum
+// and sum of squares.
+static void LaplacianRowScalar(const int16_t* pAbove, const int16_t* pRow,
+                               const int16_t* pBelow, const int nColBegin, const int nWidth,
+                               int64_t& nSum, uint64_t& nSumSq)
+{
+    for(int icol=nColBegin; icol<nWidth-1; icol++)
+    {
+        int nLap=pAbove[icol]+pBelow[icol]+pRow[icol-1]+pRow[icol+1]-4*pRow[icol];
+        nSum+=nLap;
+        nSumSq+=(uint64_t)(nLap*nLap);
+    }
+    return;
+}
+
+#ifdef EOS_ADIMEC_FOCUS_X86
+
+// SSE4.1/AVX2: each returns the first quad/column it did not do; the
+// scalar loop finishes the row.  Greens come out of 32-bit lanes (one
+// quad row per lane): shift by 16 for the odd column, then mask.
+
+__attribute__((target("sse4.1")))
+static int GreenRowSse4(const uint16_t* pRow0, const uint16_t* pRow1, const int nGreen0,
+                        const int nGreen1, const int nQuads, const uint32_t nMask,
+                        const int nShiftRight, const int nShiftLeft, int16_t* pGreen)
+{
+    const __m128i vMask=_mm_set1_epi32((int)nMask);
+    const __m128i vPick0=_mm_cvtsi32_si128(16*nGreen0);
+    const __m128i vPick1=_mm_cvtsi32_si128(16*nGreen1);
+    const __m128i vRight=_mm_cvtsi32_si128(nShiftRight);
+    const __m128i vLeft=_mm_cvtsi32_si128(nShiftLeft);
+
+    int iquad=0;
+    for(; iquad+8<=nQuads; iquad+=8)
+    {
+        __m128i vG0Lo=_mm_loadu_si128((const __m128i*)(pRow0+2*iquad));
+        __m128i vG0Hi=_mm_loadu_si128((const __m128i*)(pRow0+2*iquad+8));
+        __m128i vG1Lo=_mm_loadu_si128((const __m128i*)(pRow1+2*iquad));
+        __m128i vG1Hi=_mm_loadu_si128((const __m128i*)(pRow1+2*iquad+8));
+
+        vG0Lo=_mm_sll_epi32(_mm_srl_epi32(_mm_and_si128(_mm_srl_epi32(vG0Lo,vPick0),vMask),vRight),vLeft);
+        vG0Hi=_mm_sll_epi32(_mm_srl_epi32(_mm_and_si128(_mm_srl_epi32(vG0Hi,vPick0),vMask),vRight),vLeft);
+        vG1Lo=_mm_sll_epi32(_mm_srl_epi32(_mm_and_si128(_mm_srl_epi32(vG1Lo,vPick1),vMask),vRight),vLeft);
+        vG1Hi=_mm_sll_epi32(_mm_srl_epi32(_mm_and_si128(_mm_srl_epi32(vG1Hi,vPick1),vMask),vRight),vLeft);
+
+        __m128i vSum=_mm_add_epi16(_mm_packus_epi32(vG0Lo,vG0Hi),_mm_packus_epi32(vG1Lo,vG1Hi));
+        _mm_storeu_si128((__m128i*)(pGreen+iquad),vSum);
+    }
+    return iquad;
+}
+
+__attribute__((target("sse4.1")))
+static int TenengradRowSse4(const int16_t* pAbove, const int16_t* pRow, const int16_t* pBelow,
+                            const int nWidth, uint64_t& nSum)
+{
+    const __m128i vZero=_mm_setzero_si128();
+    __m128i vAcc=_mm_setzero_si128();
+
+    int icol=1;
+    for(; icol+8<nWidth; icol+=8)
+    {
+        __m128i vA0=_mm_loadu_si128((const __m128i*)(pAbove+icol-1));
+        __m128i vA1=_mm_loadu_si128((const __m128i*)(pAbove+icol));
+        __m128i vA2=_mm_loadu_si128((const __m128i*)(pAbove+icol+1));
+        __m128i vB0=_mm_loadu_si128((const __m128i*)(pRow+icol-1));
+        __m128i vB2=_mm_loadu_si128((const __m128i*)(pRow+icol+1));
+        __m128i vC0=_mm_loadu_si128((const __m128i*)(pBelow+icol-1));
+        __m128i vC1=_mm_loadu_si128((const __m128i*)(pBelow+icol));
+        __m128i vC2=_mm_loadu_si128((const __m128i*)(pBelow+icol+1));
+
+        __m128i vB=_mm_sub_epi16(vB2,vB0);
+        __m128i vGx=_mm_add_epi16(_mm_add_epi16(_mm_sub_epi16(vA2,vA0),_mm_sub_epi16(vC2,vC0)),
+                                  _mm_add_epi16(vB,vB));
+        __m128i vGy=_mm_sub_epi16(_mm_add_epi16(_mm_add_epi16(vC0,vC2),_mm_add_epi16(vC1,vC1)),
+                                  _mm_add_epi16(_mm_add_epi16(vA0,vA2),_mm_add_epi16(vA1,vA1)));
+
+        __m128i vLo=_mm_unpacklo_epi16(vGx,vGy);
+        __m128i vHi=_mm_unpackhi_epi16(vGx,vGy);
+        __m128i vEnergy=_mm_add_epi32(_mm_madd_epi16(vLo,vLo),_mm_madd_epi16(vHi,vHi));
+        vAcc=_mm_add_epi64(vAcc,_mm_unpacklo_epi32(vEnergy,vZero));
+        vAcc=_mm_add_epi64(vAcc,_mm_unpackhi_epi32(vEnergy,vZero));
+    }
+
+    uint64_t anAcc[2];
+    _mm_storeu_si128((__m128i*)anAcc,vAcc);
+    nSum+=anAcc[0]+anAcc[1];
+    return icol;
+}
+
+__attribute__((target("sse4.1")))
+static int LaplacianRowSse4(const int16_t* pAbove, const int16_t* pRow, const int16_t* pBelow,
+                            const int nWidth, int64_t& nSum, uint64_t& nSumSq)
+{
+    const __m128i vZero=_mm_setzero_si128();
+    const __m128i vOne=_mm_set1_epi16(1);
+    __m128i vSum=_mm_setzero_si128();
+    __m128i vAccSq=_mm_setzero_si128();
+
+    int icol=1;
+    for(; icol+8<nWidth; icol+=8)
+    {
+        __m128i vA1=_mm_loadu_si128((const __m128i*)(pAbove+icol));
+        __m128i vB0=_mm_loadu_si128((const __m128i*)(pRow+icol-1));
+        __m128i vB1=_mm_loadu_si128((const __m128i*)(pRow+icol));
+        __m128i vB2=_mm_loadu_si128((const __m128i*)(pRow+icol+1));
+        __m128i vC1=_mm_loadu_si128((const __m128i*)(pBelow+icol));
+
+        __m128i vLap=_mm_sub_epi16(_mm_add_epi16(_mm_add_epi16(vA1,vC1),_mm_add_epi16(vB0,vB2)),
+                                   _mm_slli_epi16(vB1,2));
+
+        vSum=_mm_add_epi32(vSum,_mm_madd_epi16(vLap,vOne));
+        __m128i vSq=_mm_madd_epi16(vLap,vLap);
+        vAccSq=_mm_add_epi64(vAccSq,_mm_unpacklo_epi32(vSq,vZero));
+        vAccSq=_mm_add_epi64(vAccSq,_mm_unpackhi_epi32(vSq,vZero));
+    }
+
+    int32_t anSum[4];
+    uint64_t anSq[2];
+    _mm_storeu_si128((__m128i*)anSum,vSum);
+    _mm_storeu_si128((__m128i*)anSq,vAccSq);
+    nSum+=(int64_t)anSum[0]+anSum[1]+anSum[2]+anSum[3];
+    nSumSq+=anSq[0]+anSq[1];
+    return icol;
+}
+
+__attribute__((target("avx2")))
+static int GreenRowAvx2(const uint16_t* pRow0, const uint16_t* pRow1, const int nGreen0,
+                        const int nGreen1, const int nQuads, const uint32_t nMask,
+                        const int nShiftRight, const int nShiftLeft, int16_t* pGreen)
+{
+    const __m256i vMask=_mm256_set1_epi32((int)nMask);
+    const __m128i vPick0=_mm_cvtsi32_si128(16*nGreen0);
+    const __m128i vPick1=_mm_cvtsi32_si128(16*nGreen1);
+    const __m128i vRight=_mm_cvtsi32_si128(nShiftRight);
+    const __m128i vLeft=_mm_cvtsi32_si128(nShiftLeft);
+
+    int iquad=0;
+    for(; iquad+16<=nQuads; iquad+=16)
+    {
+        __m256i vG0Lo=_mm256_loadu_si256((const __m256i*)(pRow0+2*iquad));
+        __m256i vG0Hi=_mm256_loadu_si256((const __m256i*)(pRow0+2*iquad+16));
+        __m256i vG1Lo=_mm256_loadu_si256((const __m256i*)(pRow1+2*iquad));
+        __m256i vG1Hi=_mm256_loadu_si256((const __m256i*)(pRow1+2*iquad+16));
+
+        vG0Lo=_mm256_sll_epi32(_mm256_srl_epi32(_mm256_and_si256(_mm256_srl_epi32(vG0Lo,vPick0),vMask),vRight),vLeft);
+        vG0Hi=_mm256_sll_epi32(_mm256_srl_epi32(_mm256_and_si256(_mm256_srl_epi32(vG0Hi,vPick0),vMask),vRight),vLeft);
+        vG1Lo=_mm256_sll_epi32(_mm256_srl_epi32(_mm256_and_si256(_mm256_srl_epi32(vG1Lo,vPick1),vMask),vRight),vLeft);
+        vG1Hi=_mm256_sll_epi32(_mm256_srl_epi32(_mm256_and_si256(_mm256_srl_epi32(vG1Hi,vPick1),vMask),vRight),vLeft);
+
+        // packus works per 128-bit lane: put the quads back in order.
+        __m256i vSum=_mm256_add_epi16(_mm256_packus_epi32(vG0Lo,vG0Hi),
+                                      _mm256_packus_epi32(vG1Lo,vG1Hi));
+        vSum=_mm256_permute4x64_epi64(vSum,0xD8);
+        _mm256_storeu_si256((__m256i*)(pGreen+iquad),vSum);
+    }
+    return iquad;
+}
+
+__attribute__((target("avx2")))
+static int TenengradRowAvx2(const int16_t* pAbove, const int16_t* pRow, const int16_t* pBelow,
+                            const int nWidth, uint64_t& nSum)
+{
+    const __m256i vZero=_mm256_setzero_si256();
+    __m256i vAcc=_mm256_setzero_si256();
+
+    int icol=1;
+    for(; icol+16<nWidth; icol+=16)
+    {
+        __m256i vA0=_mm256_loadu_si256((const __m256i*)(pAbove+icol-1));
+        __m256i vA1=_mm256_loadu_si256((const __m256i*)(pAbove+icol));
+        __m256i vA2=_mm256_loadu_si256((const __m256i*)(pAbove+icol+1));
+        __m256i vB0=_mm256_loadu_si256((const __m256i*)(pRow+icol-1));
+        __m256i vB2=_mm256_loadu_si256((const __m256i*)(pRow+icol+1));
+        __m256i vC0=_mm256_loadu_si256((const __m256i*)(pBelow+icol-1));
+        __m256i vC1=_mm256_loadu_si256((const __m256i*)(pBelow+icol));
+        __m256i vC2=_mm256_loadu_si256((const __m256i*)(pBelow+icol+1));
+
+        __m256i vB=_mm256_sub_epi16(vB2,vB0);
+        __m256i vGx=_mm256_add_epi16(_mm256_add_epi16(_mm256_sub_epi16(vA2,vA0),
+                                                      _mm256_sub_epi16(vC2,vC0)),
+                                     _mm256_add_epi16(vB,vB));
+        __m256i vGy=_mm256_sub_epi16(_mm256_add_epi16(_mm256_add_epi16(vC0,vC2),
+                                                      _mm256_add_epi16(vC1,vC1)),
+                                     _mm256_add_epi16(_mm256_add_epi16(vA0,vA2),
+                                                      _mm256_add_epi16(vA1,vA1)));
+
+        __m256i vLo=_mm256_unpacklo_epi16(vGx,vGy);
+        __m256i vHi=_mm256_unpackhi_epi16(vGx,vGy);
+        __m256i vEnergy=_mm256_add_epi32(_mm256_madd_epi16(vLo,vLo),_mm256_madd_epi16(vHi,vHi));
+        vAcc=_mm256_add_epi64(vAcc,_mm256_unpacklo_epi32(vEnergy,vZero));
+        vAcc=_mm256_add_epi64(vAcc,_mm256_unpackhi_epi32(vEnergy,vZero));
+    }
+
+    uint64_t anAcc[4];
+    _mm256_storeu_si256((__m256i*)anAcc,vAcc);
+    nSum+=anAcc[0]+anAcc[1]+anAcc[2]+anAcc[3];
+    return icol;
+}
+
+__attribute__((target("avx2")))
+static int LaplacianRowAvx2(const int16_t* pAbove, const int16_t* pRow, const int16_t* pBelow,
+                            const int nWidth, int64_t& nSum, uint64_t& nSumSq)
+{
+    const __m256i vZero=_mm256_setzero_si256();
+    const __m256i vOne=_mm256_set1_epi16(1);
+    __m256i vSum=_mm256_setzero_si256();
+    __m256i vAccSq=_mm256_setzero_si256();
+
+    int icol=1;
+    for(; icol+16<nWidth; icol+=16)
+    {
+        __m256i vA1=_mm256_loadu_si256((const __m256i*)(pAbove+icol));
+        __m256i vB0=_mm256_loadu_si256((const __m256i*)(pRow+icol-1));
+        __m256i vB1=_mm256_loadu_si256((const __m256i*)(pRow+icol));
+        __m256i vB2=_mm256_loadu_si256((const __m256i*)(pRow+icol+1));
+        __m256i vC1=_mm256_loadu_si256((const __m256i*)(pBelow+icol));
+
+        __m256i vLap=_mm256_sub_epi16(_mm256_add_epi16(_mm256_add_epi16(vA1,vC1),
+                                                       _mm256_add_epi16(vB0,vB2)),
+                                      _mm256_slli_epi16(vB1,2));
+
+        vSum=_mm256_add_epi32(vSum,_mm256_madd_epi16(vLap,vOne));
+        __m256i vSq=_mm256_madd_epi16(vLap,vLap);
+        vAccSq=_mm256_add_epi64(vAccSq,_mm256_unpacklo_epi32(vSq,vZero));
+        vAccSq=_mm256_add_epi64(vAccSq,_mm256_unpackhi_epi32(vSq,vZero));
+    }
+
+    int32_t anSum[8];
+    uint64_t anSq[4];
+    _mm256_storeu_si256((__m256i*)anSum,vSum);
+    _mm256_storeu_si256((__m256i*)anSq,vAccSq);
+    for(int ilane=0; ilane<8; ilane++)
+        nSum+=anSum[ilane];
+    nSumSq+=anSq[0]+anSq[1]+anSq[2]+anSq[3];
+    return icol;
+}
+
+#else
+
+static int GreenRowSse4(const uint16_t*, const uint16_t*, const int, const int, const int,
+                        const uint32_t, const int, const int, int16_t*)
+{
+    return 0;
+}
+
+static int TenengradRowSse4(const int16_t*, const int16_t*, const int16_t*, const int, uint64_t&)
+{
+    return 1;
+}
+
+static int LaplacianRowSse4(const int16_t*, const int16_t*, const int16_t*, const int,
+                            int64_t&, uint64_t&)
+{
+    return 1;
+}
+
+static int GreenRowAvx2(const uint16_t*, const uint16_t*, const int, const int, const int,
+                        const uint32_t, const int, const int, int16_t*)
+{
+    return 0;
+}
+
+static int TenengradRowAvx2(const int16_t*, const int16_t*, const int16_t*, const int, uint64_t&)
+{
+    return 1;
+}
+
+static int LaplacianRowAvx2(const int16_t*, const int16_t*, const int16_t*, const int,
+                            int64_t&, uint64_t&)
+{
+    return 1;
+}
+
+#endif // EOS_ADIMEC_FOCUS_X86
+
+// Round up to a whole page
+static size_t PageRound(const size_t nBytes)
+{
+    size_t nPage=(size_t)::sysconf(_SC_PAGESIZE);
+    return ((nBytes+nPage-1)/nPage)*nPage;
+}
+
+EosAdimecFocus::EosAdimecFocus(PushFn fnPush, const std::string& strShmName, const int nHistory,
+                               const EosAdimecBayer::E_SIMD_LEVEL eLevel)
+{
+    m_fnPush=fnPush;
+    m_strShmName=strShmName;
+    m_nHistory=std::max(2,nHistory);
+    m_eLevel=(EosAdimecBayer::eSimdAuto==eLevel) ? EosAdimecBayer::GetBestSimdLevel() : eLevel;
+
+    m_nShmFd=-1;
+    m_nSegmentBytes=0;
+    m_pSegment=NULL;
+    m_pHeader=NULL;
+    m_pRecords=NULL;
+
+    m_pPushThread=NULL;
+    m_abStop=false;
+
+    m_params.eMethod=eFocusTenengrad;
+    m_params.nRoiX=0;
+    m_params.nRoiY=0;
+    m_params.nRoiW=0;
+    m_params.nRoiH=0;
+    m_params.bPush=false;
+    m_bHaveResult=false;
+    ::memset(&m_latest,0,sizeof(m_latest));
+    m_bPushPending=false;
+
+    return;
+}
+
+EosAdimecFocus::~EosAdimecFocus(void)
+{
+    Stop();
+    return;
+}
+
+// A segment that cannot be created is reported and left out; FOCUS[]
+// and the pushes still work.
+int EosAdimecFocus::Start(void)
+{
+    if(m_pPushThread)
+        return UNIX_OK_STATUS;
+
+    if(!m_strShmName.empty())
+        OpenSegment();
+
+    m_abStop=false;
+    m_pPushThread=new boost::thread(boost::bind(&EosAdimecFocus::PushThread,this));
+
+    return UNIX_OK_STATUS;
+}
+
+void EosAdimecFocus::Stop(void)
+{
+    {
+        boost::lock_guard<boost::mutex> lock(m_mtxFocus);
+        m_abStop=true;
+        m_cvFocus.notify_all();
+    }
+
+    if(m_pPushThread)
+    {
+        m_pPushThread->join();
+        delete m_pPushThread;
+        m_pPushThread=NULL;
+    }
+
+    CloseSegment();
+
+    return;
+}
+
+int EosAdimecFocus::OpenSegment(void)
+{
+    size_t nRecordOffset=(sizeof(EosAdimecFocusHeader)+63)&~(size_t)63;
+    m_nSegmentBytes=PageRound(nRecordOffset+m_nHistory*sizeof(EosAdimecFocusRecord));
+
+    // Left behind by a previous (crashed) controller: readers mapping it keep their copy.
+    ::shm_unlink(m_strShmName.c_str());
+    m_nShmFd=::shm_open(m_strShmName.c_str(),O_RDWR|O_CREAT|O_EXCL|O_CLOEXEC,0660);
+    if(m_nShmFd<0)
+    {
+        std::cerr<<__FUNCTION__<<"(): shm_open("<<m_strShmName<<") failed: "
+                 <<::strerror(errno)<<std::endl;
+        return UNIX_ERROR_STATUS;
+    }
+
+    void* pMap=MAP_FAILED;
+    if(0==::ftruncate(m_nShmFd,m_nSegmentBytes))
+        pMap=::mmap(NULL,m_nSegmentBytes,PROT_READ|PROT_WRITE,MAP_SHARED,m_nShmFd,0);
+    if(MAP_FAILED==pMap)
+    {
+        std::cerr<<__FUNCTION__<<"(): could not map "<<m_nSegmentBytes<<" bytes for "
+                 <<m_strShmName<<": "<<::strerror(errno)<<std::endl;
+        CloseSegment();
+        return UNIX_ERROR_STATUS;
+    }
+    m_pSegment=(uint8_t*)pMap;
+
+    m_pHeader=new(m_pSegment) EosAdimecFocusHeader;
+    m_pHeader->nMagic=EosAdimecFocusConst::MAGIC;
+    m_pHeader->nVersion=EosAdimecFocusConst::VERSION;
+    m_pHeader->nHistory=m_nHistory;
+    m_pHeader->nPublisherPid=::getpid();
+    m_pHeader->nRecordOffset=nRecordOffset;
+    m_pHeader->nPublished=0;
+
+    m_pRecords=(EosAdimecFocusRecord*)(m_pSegment+nRecordOffset);
+    for(int irecord=0; irecord<m_nHistory; irecord++)
+    {
+        EosAdimecFocusRecord* pRecord=new(&m_pRecords[irecord]) EosAdimecFocusRecord;
+        pRecord->nStamp=0;
+    }
+
+    return UNIX_OK_STATUS;
+}
+
+void EosAdimecFocus::CloseSegment(void)
+{
+    if(m_pSegment)
+    {
+        ::munmap(m_pSegment,m_nSegmentBytes);
+        m_pSegment=NULL;
+        m_pHeader=NULL;
+        m_pRecords=NULL;
+    }
+
+    if(m_nShmFd>=0)
+    {
+        ::close(m_nShmFd);
+        m_nShmFd=-1;
+        ::shm_unlink(m_strShmName.c_str());
+    }
+
+    return;
+}
+
+void EosAdimecFocus::OnFrame(const EosAdimecRawFrame& frame)
+{
+    FocusParams params;
+    {
+        boost::lock_guard<boost::mutex> lock(m_mtxFocus);
+        params=m_params;
+    }
+
+    EosAdimecBayer::BayerImage raw;
+    raw.pData=frame.pData;
+    raw.nWidth=frame.nWidth;
+    raw.nHeight=frame.nHeight;
+    raw.nStride=frame.nStride;
+    raw.nBitDepth=frame.nBitDepth;
+    raw.bRedRowFirst=frame.bRedRowFirst;
+    raw.bGreenPixelFirst=frame.bGreenPixelFirst;
+
+    struct timespec tsStart, tsEnd;
+    ::clock_gettime(CLOCK_MONOTONIC,&tsStart);
+
+    FocusResult result;
+    result.anRoi[0]=params.nRoiX;
+    result.anRoi[1]=params.nRoiY;
+    result.anRoi[2]=params.nRoiW;
+    result.anRoi[3]=params.nRoiH;
+    if(0!=Score(raw,result.anRoi,params.eMethod,m_eLevel,m_vGreen,result.dScore))
+        return;
+
+    ::clock_gettime(CLOCK_MONOTONIC,&tsEnd);
+    result.nSequence=frame.nSequence;
+    result.nTimeNs=frame.nTimeNs;
+    result.tsWall=frame.tsWall;
+    result.nSettingsVersion=frame.settings.nVersion;
+    result.bSettingsChanging=frame.bSettingsChanging;
+    result.eMethod=params.eMethod;
+    result.dComputeMs=(tsEnd.tv_sec-tsStart.tv_sec)*1000.0+(tsEnd.tv_nsec-tsStart.tv_nsec)/1.0e6;
+
+    PublishToSegment(result);
+
+    boost::lock_guard<boost::mutex> lock(m_mtxFocus);
+    m_latest=result;
+    m_bHaveResult=true;
+    if(params.bPush)
+    {
+        m_bPushPending=true;
+        m_cvFocus.notify_all();
+    }
+
+    return;
+}
+
+void EosAdimecFocus::PublishToSegment(const FocusResult& result)
+{
+    if(NULL==m_pHeader)
+        return;
+
+    uint64_t nStamp=m_pHeader->nPublished.load(std::memory_order_relaxed)+1;
+    EosAdimecFocusRecord& record=m_pRecords[(nStamp-1)%m_nHistory];
+
+    record.nStamp.store(0,std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    record.nSequence=result.nSequence;
+    record.nTimeNs=result.nTimeNs;
+    record.nWallSec=result.tsWall.tv_sec;
+    record.nWallNsec=result.tsWall.tv_nsec;
+    record.nSettingsVersion=result.nSettingsVersion;
+    record.bSettingsChanging=result.bSettingsChanging ? 1 : 0;
+    record.nMethod=(uint8_t)result.eMethod;
+    record.nPad=0;
+    for(int iroi=0; iroi<4; iroi++)
+        record.anRoi[iroi]=result.anRoi[iroi];
+    record.dScore=result.dScore;
+
+    record.nStamp.store(nStamp,std::memory_order_release);
+    m_pHeader->nPublished.store(nStamp,std::memory_order_release);
+
+    return;
+}
+
+void EosAdimecFocus::SetParams(const FocusParams& params)
+{
+    boost::lock_guard<boost::mutex> lock(m_mtxFocus);
+    m_params=params;
+    return;
+}
+
+EosAdimecFocus::FocusParams EosAdimecFocus::GetParams(void)
+{
+    boost::lock_guard<boost::mutex> lock(m_mtxFocus);
+    return m_params;
+}
+
+bool EosAdimecFocus::GetLatest(FocusResult& result)
+{
+    boost::lock_guard<boost::mutex> lock(m_mtxFocus);
+    if(m_bHaveResult)
+        result=m_latest;
+    return m_bHaveResult;
+}
+
+int EosAdimecFocus::Score(const EosAdimecBayer::BayerImage& raw, int anRoi[4],
+                          const E_FOCUS_METHOD eMethod, const EosAdimecBayer::E_SIMD_LEVEL eLevel,
+                          std::vector<int16_t>& vGreen, double& dScore)
+{
+    dScore=0.0;
+    if((NULL==raw.pData) || (raw.nWidth<2) || (raw.nHeight<2) || (raw.nStride<raw.nWidth) ||
+       (raw.nBitDepth<8) || (raw.nBitDepth>15))
+        return -1;
+
+    const EosAdimecBayer::E_SIMD_LEVEL eUse=
+        (EosAdimecBayer::eSimdAuto==eLevel) ? EosAdimecBayer::GetBestSimdLevel() : eLevel;
+
+    // ROI on whole 2x2 quads, clipped to the frame
+    int nX=std::max(0,std::min(anRoi[0],raw.nWidth-2))&~1;
+    int nY=std::max(0,std::min(anRoi[1],raw.nHeight-2))&~1;
+    int nW=(anRoi[2]>0) ? anRoi[2] : raw.nWidth;
+    int nH=(anRoi[3]>0) ? anRoi[3] : raw.nHeight;
+    int nQuadsX=std::min(nW,raw.nWidth-nX)/2;
+    int nQuadsY=std::min(nH,raw.nHeight-nY)/2;
+    anRoi[0]=nX;
+    anRoi[1]=nY;
+    anRoi[2]=2*std::max(nQuadsX,0);
+    anRoi[3]=2*std::max(nQuadsY,0);
+    if((nQuadsX<3) || (nQuadsY<3))
+        return -1;
+
+    // Green plane: one value per quad
+    const uint32_t nMask=(1u<<raw.nBitDepth)-1;
+    const int nShiftRight=std::max(0,raw.nBitDepth-FOCUS_GREEN_BITS);
+    const int nShiftLeft=std::max(0,FOCUS_GREEN_BITS-raw.nBitDepth);
+    if(vGreen.size()<(size_t)nQuadsX*nQuadsY)
+        vGreen.resize((size_t)nQuadsX*nQuadsY);
+
+    for(int iqy=0; iqy<nQuadsY; iqy++)
+    {
+        const int nRow=nY+2*iqy;
+        const uint16_t* pRow0=raw.pData+(size_t)nRow*raw.nStride+nX;
+        const uint16_t* pRow1=pRow0+raw.nStride;
+        const int nGreen0=EosAdimecBayer::IsGreenFirstInRow(raw,nRow) ? 0 : 1;
+        const int nGreen1=EosAdimecBayer::IsGreenFirstInRow(raw,nRow+1) ? 0 : 1;
+        int16_t* pGreen=&vGreen[(size_t)iqy*nQuadsX];
+
+        int nDone=0;
+        if(EosAdimecBayer::eSimdAvx2==eUse)
+            nDone=GreenRowAvx2(pRow0,pRow1,nGreen0,nGreen1,nQuadsX,nMask,nShiftRight,nShiftLeft,pGreen);
+        else if(EosAdimecBayer::eSimdSse4==eUse)
+            nDone=GreenRowSse4(pRow0,pRow1,nGreen0,nGreen1,nQuadsX,nMask,nShiftRight,nShiftLeft,pGreen);
+        GreenRowScalar(pRow0,pRow1,nGreen0,nGreen1,nDone,nQuadsX,nMask,nShiftRight,nShiftLeft,pGreen);
+    }
+
+    // Interior of the green plane
+    uint64_t nEnergy=0;
+    int64_t nSum=0;
+    uint64_t nSumSq=0;
+    for(int iqy=1; iqy<nQuadsY-1; iqy++)
+    {
+        const int16_t* pRow=&vGreen[(size_t)iqy*nQuadsX];
+        const int16_t* pAbove=pRow-nQuadsX;
+        const int16_t* pBelow=pRow+nQuadsX;
+
+        if(eFocusTenengrad==eMethod)
+        {
+            int nDone=1;
+            if(EosAdimecBayer::eSimdAvx2==eUse)
+                nDone=TenengradRowAvx2(pAbove,pRow,pBelow,nQuadsX,nEnergy);
+            else if(EosAdimecBayer::eSimdSse4==eUse)
+                nDone=TenengradRowSse4(pAbove,pRow,pBelow,nQuadsX,nEnergy);
+            nEnergy+=TenengradRowScalar(pAbove,pRow,pBelow,nDone,nQuadsX);
+        }
+        else
+        {
+            int nDone=1;
+            if(EosAdimecBayer::eSimdAvx2==eUse)
+                nDone=LaplacianRowAvx2(pAbove,pRow,pBelow,nQuadsX,nSum,nSumSq);
+            else if(EosAdimecBayer::eSimdSse4==eUse)
+                nDone=LaplacianRowSse4(pAbove,pRow,pBelow,nQuadsX,nSum,nSumSq);
+            LaplacianRowScalar(pAbove,pRow,pBelow,nDone,nQuadsX,nSum,nSumSq);
+        }
+    }
+
+    const double dCount=(double)(nQuadsX-2)*(nQuadsY-2);
+    if(eFocusTenengrad==eMethod)
+    {
+        dScore=(double)nEnergy/dCount;
+    }
+    else
+    {
+        double dMean=(double)nSum/dCount;
+        dScore=(double)nSumSq/dCount-dMean*dMean;
+    }
+
+    return 0;
+}
+
+bool EosAdimecFocus::MethodFromString(const std::string& strMethod, E_FOCUS_METHOD& eMethod)
+{
+    if(strMethod=="tenengrad")
+        eMethod=eFocusTenengrad;
+    else if(strMethod=="laplacian")
+        eMethod=eFocusLaplacian;
+    else
+        return false;
+    return true;
+}
+
+std::string EosAdimecFocus::MethodName(const E_FOCUS_METHOD eMethod)
+{
+    return (eFocusLaplacian==eMethod) ? "laplacian" : "tenengrad";
+}
+
+// Wakes on every score while pushes are on; a push that is still going
+// when more frames are scored sends only the newest of them next.
+void EosAdimecFocus::PushThread(void)
+{
+    EosAdimecThreadPlacement::Apply(EosAdimecThreadPlacement::eRoleProcessing);
+
+    boost::unique_lock<boost::mutex> lock(m_mtxFocus);
+    while(!m_abStop)
+    {
+        if(!m_bPushPending || !m_params.bPush || !m_fnPush)
+        {
+            m_cvFocus.timed_wait(lock,boost::get_system_time()+
+                                 boost::posix_time::milliseconds(FOCUS_IDLE_WAIT_MS));
+            continue;
+        }
+        FocusResult result=m_latest;
+        m_bPushPending=false;
+
+        // The PushFn takes the controller's dispatch lock: not under ours.
+        lock.unlock();
+        m_fnPush(result);
+        lock.lock();
+    }
+    return;
+}
@@ -0,0 +1,262 @@
+/**
+ * Preallocated frame buffers.  See EosAdimecFramePool.h
+ */
+
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include <algorithm>
+#include <iostream>
+
+#include <boost/thread/locks.hpp>
+
+#include "EosDevice.h"
+#include "EosAdimecFramePool.h"
+
+// MAP_HUGETLB mappings are whole huge pages (the x86-64 default size)
+static const size_t FRAME_POOL_HUGE_PAGE=2u<<20;
+
+boost::mutex EosAdimecFramePool::s_mtxBudget;
+size_t EosAdimecFramePool::s_nBudgetBytes=0;
+size_t EosAdimecFramePool::s_nPoolBytes=0;
+size_t EosAdimecFramePool::s_nReservedBytes=0;
+unsigned long EosAdimecFramePool::s_nRefused=0;
+bool EosAdimecFramePool::s_bHugePages=false;
+bool EosAdimecFramePool::s_bLock=false;
+std::vector<EosAdimecFramePool*> EosAdimecFramePool::s_vpPools;
+
+// Round up to a multiple of nUnit
+static size_t RoundUp(const size_t nBytes, const size_t nUnit)
+{
+    return ((nBytes+nUnit-1)/nUnit)*nUnit;
+}
+
+EosAdimecFramePool::EosAdimecFramePool(const std::string& strName, const size_t nSlotBytes,
+                                       const int nSlots)
+{
+    m_strName=strName;
+    m_nSlotBytes=SlotStride(nSlotBytes);
+    m_nSlots=std::max(nSlots,0);
+    m_nBytes=0;
+    m_pBase=NULL;
+    m_bHugePages=false;
+    m_bLocked=false;
+
+    m_nInUse=0;
+    m_nHighWater=0;
+    m_nAcquired=0;
+    m_nFailed=0;
+
+    return;
+}
+
+EosAdimecFramePool::~EosAdimecFramePool(void)
+{
+    if(NULL==m_pBase)
+        return;
+
+    {
+        boost::lock_guard<boost::mutex> lock(s_mtxBudget);
+        s_vpPools.erase(std::remove(s_vpPools.begin(),s_vpPools.end(),this),s_vpPools.end());
+        s_nPoolBytes-=std::min(s_nPoolBytes,m_nBytes);
+    }
+
+    // munmap() unlocks it too.
+    ::munmap(m_pBase,m_nBytes);
+    m_pBase=NULL;
+
+    return;
+}
+
+int EosAdimecFramePool::Start(void)
+{
+    if(m_pBase)
+        return UNIX_OK_STATUS;
+    if(0==m_nSlots)
+        return UNIX_ERROR_STATUS;
+
+    size_t nBytes=(size_t)m_nSlots*m_nSlotBytes;
+
+    boost::lock_guard<boost::mutex> lock(s_mtxBudget);
+
+    // Huge pages if asked for and the rounding still fits; else normal pages.
+    void* pMap=MAP_FAILED;
+    size_t nHugeBytes=RoundUp(nBytes,FRAME_POOL_HUGE_PAGE);
+    if(s_bHugePages && Charge(nHugeBytes))
+    {
+        pMap=::mmap(NULL,nHugeBytes,PROT_READ|PROT_WRITE,
+                    MAP_PRIVATE|MAP_ANONYMOUS|MAP_HUGETLB|MAP_POPULATE,-1,0);
+        if(MAP_FAILED==pMap)
+        {
+            std::cerr<<__FUNCTION__<<"(): "<<m_strName<<": no huge pages ("<<::strerror(errno)
+                     <<"), using normal pages"<<std::endl;
+            s_nPoolBytes-=nHugeBytes;
+        }
+        else
+        {
+            m_nBytes=nHugeBytes;
+            m_bHugePages=true;
+        }
+    }
+    if(MAP_FAILED==pMap)
+    {
+        if(!Charge(nBytes))
+        {
+            s_nRefused++;
+            std::cerr<<__FUNCTION__<<"(): "<<m_strName<<": "<<(nBytes>>20)
+                     <<" MB does not fit in the max_mem_mb budget"<<std::endl;
+            return UNIX_ERROR_STATUS;
+        }
+
+        // Faulted in now: the first copy into a slot must not page-fault.
+        pMap=::mmap(NULL,nBytes,PROT_READ|PROT_WRITE,
+                    MAP_PRIVATE|MAP_ANONYMOUS|MAP_POPULATE,-1,0);
+        if(MAP_FAILED==pMap)
+        {
+            std::cerr<<__FUNCTION__<<"(): "<<m_strName<<": no memory for "<<m_nSlots<<" x "
+                     <<(m_nSlotBytes>>10)<<" KB: "<<::strerror(errno)<<std::endl;
+            s_nPoolBytes-=nBytes;
+            return UNIX_ERROR_STATUS;
+        }
+        m_nBytes=nBytes;
+    }
+    m_pBase=(uint8_t*)pMap;
+
+    if(s_bLock)
+    {
+        m_bLocked=(0==::mlock(m_pBase,m_nBytes));
+        if(!m_bLocked)
+        {
+            std::cerr<<__FUNCTION__<<"(): "<<m_strName<<": mlock of "<<(m_nBytes>>20)
+                     <<" MB failed: "<<::strerror(errno)<<" (RLIMIT_MEMLOCK?)"<<std::endl;
+        }
+    }
+
+    {
+        boost::lock_guard<boost::mutex> lockPool(m_mtxPool);
+        m_vnFree.clear();
+        for(int islot=m_nSlots-1; islot>=0; islot--)
+            m_vnFree.push_back(islot);
+        m_nInUse=0;
+        m_nHighWater=0;
+    }
+    s_vpPools.push_back(this);
+
+    return UNIX_OK_STATUS;
+}
+
+int EosAdimecFramePool::Acquire(void)
+{
+    boost::lock_guard<boost::mutex> lock(m_mtxPool);
+    if(m_vnFree.empty())
+    {
+        m_nFailed++;
+        return -1;
+    }
+
+    int nSlot=m_vnFree.back();
+    m_vnFree.pop_back();
+    m_nInUse++;
+    m_nHighWater=std::max(m_nHighWater,m_nInUse);
+    m_nAcquired++;
+    return nSlot;
+}
+
+void EosAdimecFramePool::Release(const int nSlot)
+{
+    if((nSlot<0) || (nSlot>=m_nSlots))
+        return;
+
+    boost::lock_guard<boost::mutex> lock(m_mtxPool);
+    m_vnFree.push_back(nSlot);
+    m_nInUse--;
+    return;
+}
+
+EosAdimecFramePool::PoolStats EosAdimecFramePool::GetStats(void)
+{
+    PoolStats stats;
+    stats.strName=m_strName;
+    stats.nSlots=m_nSlots;
+    stats.nSlotBytes=m_nSlotBytes;
+    stats.nBytes=m_nBytes;
+    stats.bHugePages=m_bHugePages;
+    stats.bLocked=m_bLocked;
+
+    boost::lock_guard<boost::mutex> lock(m_mtxPool);
+    stats.nInUse=m_nInUse;
+    stats.nHighWater=m_nHighWater;
+    stats.nAcquired=m_nAcquired;
+    stats.nFailed=m_nFailed;
+    return stats;
+}
+
+void EosAdimecFramePool::Configure(const size_t nBudgetBytes, const bool bHugePages,
+                                   const bool bLock)
+{
+    boost::lock_guard<boost::mutex> lock(s_mtxBudget);
+    s_nBudgetBytes=nBudgetBytes;
+    s_bHugePages=bHugePages;
+    s_bLock=bLock;
+    return;
+}
+
+bool EosAdimecFramePool::Reserve(const size_t nBytes)
+{
+    boost::lock_guard<boost::mutex> lock(s_mtxBudget);
+    if(s_nPoolBytes+s_nReservedBytes+nBytes>s_nBudgetBytes)
+        return false;
+    s_nReservedBytes+=nBytes;
+    return true;
+}
+
+void EosAdimecFramePool::Unreserve(const size_t nBytes)
+{
+    boost::lock_guard<boost::mutex> lock(s_mtxBudget);
+    s_nReservedBytes-=std::min(s_nReservedBytes,nBytes);
+    return;
+}
+
+size_t EosAdimecFramePool::GetFreeBytes(void)
+{
+    boost::lock_guard<boost::mutex> lock(s_mtxBudget);
+    size_t nTaken=s_nPoolBytes+s_nReservedBytes;
+    return (s_nBudgetBytes>nTaken) ? (s_nBudgetBytes-nTaken) : 0;
+}
+
+size_t EosAdimecFramePool::SlotStride(const size_t nBytes)
+{
+    return RoundUp(std::max(nBytes,(size_t)1),(size_t)::sysconf(_SC_PAGESIZE));
+}
+
+std::vector<EosAdimecFramePool::PoolStats> EosAdimecFramePool::GetAllStats(void)
+{
+    std::vector<PoolStats> vStats;
+
+    boost::lock_guard<boost::mutex> lock(s_mtxBudget);
+    for(auto & ipool: s_vpPools)
+        vStats.push_back(ipool->GetStats());
+    return vStats;
+}
+
+EosAdimecFramePool::BudgetStats EosAdimecFramePool::GetBudgetStats(void)
+{
+    boost::lock_guard<boost::mutex> lock(s_mtxBudget);
+
+    BudgetStats stats;
+    stats.nBudgetBytes=s_nBudgetBytes;
+    stats.nPoolBytes=s_nPoolBytes;
+    stats.nReservedBytes=s_nReservedBytes;
+    stats.nRefused=s_nRefused;
+    return stats;
+}
+
+bool EosAdimecFramePool::Charge(const size_t nBytes)
+{
+    if(s_nPoolBytes+s_nReservedBytes+nBytes>s_nBudgetBytes)
+        return false;
+    s_nPoolBytes+=nBytes;
+    return true;
+}
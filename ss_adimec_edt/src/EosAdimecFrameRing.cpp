@@ -0,0 +1,448 @@
+/**
+ * Shared-memory frame ring publisher.  See EosAdimecFrameRing.h
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include <iostream>
+#include <new>
+
+#include <boost/bind.hpp>
+#include <boost/thread/locks.hpp>
+
+#include "EosDevice.h"
+#include "EosAdimecFrameRing.h"
+#include "EosAdimecThreadPlacement.h"
+#include "EosAdimecPack.h"
+
+// Round up to a whole page (slot data is page aligned for readers' mmap()).
+static size_t PageRound(const size_t nBytes)
+{
+    size_t nPage=(size_t)::sysconf(_SC_PAGESIZE);
+    return ((nBytes+nPage-1)/nPage)*nPage;
+}
+
+EosAdimecFrameRing::EosAdimecFrameRing(const std::string& strShmName,
+                                       const std::string& strSocketPath,
+                                       const int nNumSlots, const int nMaxReaders,
+                                       const bool bPacked)
+{
+    m_strShmName=strShmName;
+    m_strSocketPath=strSocketPath;
+    m_nNumSlots=(nNumSlots<2) ? 2 : nNumSlots;
+    m_nMaxReaders=nMaxReaders;
+    if(m_nMaxReaders<1)
+        m_nMaxReaders=1;
+    if(m_nMaxReaders>(int)EosAdimecFrameRingConst::MAX_READERS)
+        m_nMaxReaders=EosAdimecFrameRingConst::MAX_READERS;
+    m_bPacked=bPacked;
+
+    m_nShmFd=-1;
+    m_pSegment=NULL;
+    m_nSegmentBytes=0;
+    m_nSlotBytes=0;
+    m_pHeader=NULL;
+    m_pSlots=NULL;
+
+    m_nListenFd=-1;
+    m_pServerThread=NULL;
+    m_abStop=false;
+
+    ReaderInfo reader;
+    reader.nSocketFd=-1;
+    reader.nEventFd=-1;
+    m_vReaders.assign(m_nMaxReaders,reader);
+
+    m_anTooBig=0;
+
+    return;
+}
+
+EosAdimecFrameRing::~EosAdimecFrameRing(void)
+{
+    Close();
+    return;
+}
+
+size_t EosAdimecFrameRing::ComputeSegmentBytes(const int nNumSlots, const size_t nMaxFrameBytes)
+{
+    size_t nTable=sizeof(EosAdimecFrameRingHeader)+nNumSlots*sizeof(EosAdimecFrameSlot);
+    return PageRound(nTable)+nNumSlots*PageRound(nMaxFrameBytes);
+}
+
+int EosAdimecFrameRing::Open(const size_t nMaxFrameBytes)
+{
+    if(m_pSegment)
+        return UNIX_OK_STATUS;
+
+    m_nSlotBytes=PageRound(nMaxFrameBytes);
+    m_nSegmentBytes=ComputeSegmentBytes(m_nNumSlots,nMaxFrameBytes);
+
+    // A previous (crashed) controller may have left the segment behind;
+    // readers still mapping it keep their copy.
+    ::shm_unlink(m_strShmName.c_str());
+    m_nShmFd=::shm_open(m_strShmName.c_str(),O_RDWR|O_CREAT|O_EXCL|O_CLOEXEC,0660);
+    if(m_nShmFd<0)
+    {
+        std::cerr<<__FUNCTION__<<"(): shm_open("<<m_strShmName<<") failed: "
+                 <<::strerror(errno)<<std::endl;
+        return UNIX_ERROR_STATUS;
+    }
+
+    void* pMap=MAP_FAILED;
+    if(0==::ftruncate(m_nShmFd,m_nSegmentBytes))
+        pMap=::mmap(NULL,m_nSegmentBytes,PROT_READ|PROT_WRITE,MAP_SHARED,m_nShmFd,0);
+    if(MAP_FAILED==pMap)
+    {
+        std::cerr<<__FUNCTION__<<"(): could not map "<<(m_nSegmentBytes>>20)<<" MB for "
+                 <<m_strShmName<<": "<<::strerror(errno)<<std::endl;
+        Close();
+        return UNIX_ERROR_STATUS;
+    }
+    m_pSegment=(uint8_t*)pMap;
+
+    m_pHeader=new(m_pSegment) EosAdimecFrameRingHeader;
+    m_pHeader->nMagic=EosAdimecFrameRingConst::MAGIC;
+    m_pHeader->nVersion=EosAdimecFrameRingConst::VERSION;
+    m_pHeader->nNumSlots=m_nNumSlots;
+    m_pHeader->nMaxReaders=m_nMaxReaders;
+    m_pHeader->nSlotBytes=m_nSlotBytes;
+    m_pHeader->nSlotTableOffset=sizeof(EosAdimecFrameRingHeader);
+    m_pHeader->nDataOffset=m_nSegmentBytes-m_nNumSlots*m_nSlotBytes;
+    m_pHeader->nPublisherPid=::getpid();
+    m_pHeader->nPad=0;
+    m_pHeader->nLatestSlot=-1;
+    m_pHeader->nLatestSequence=0;
+    m_pHeader->nPublished=0;
+    m_pHeader->nSkipped=0;
+
+    m_pSlots=(EosAdimecFrameSlot*)(m_pSegment+m_pHeader->nSlotTableOffset);
+    for(int islot=0; islot<m_nNumSlots; islot++)
+    {
+        EosAdimecFrameSlot* pSlot=new(&m_pSlots[islot]) EosAdimecFrameSlot;
+        pSlot->nRefBits=0;
+        ::memset(&pSlot->meta,0,sizeof(pSlot->meta));
+    }
+
+    // Reader handshake socket
+    struct sockaddr_un addr;
+    ::memset(&addr,0,sizeof(addr));
+    addr.sun_family=AF_UNIX;
+    if(m_strSocketPath.size()>=sizeof(addr.sun_path))
+    {
+        std::cerr<<__FUNCTION__<<"(): socket path too long: "<<m_strSocketPath<<std::endl;
+        Close();
+        return UNIX_ERROR_STATUS;
+    }
+    ::strncpy(addr.sun_path,m_strSocketPath.c_str(),sizeof(addr.sun_path)-1);
+
+    m_nListenFd=::socket(AF_UNIX,SOCK_SEQPACKET|SOCK_CLOEXEC,0);
+    ::unlink(m_strSocketPath.c_str());
+    if((m_nListenFd<0) ||
+       (::bind(m_nListenFd,(struct sockaddr*)&addr,sizeof(addr))<0) ||
+       (::listen(m_nListenFd,m_nMaxReaders)<0))
+    {
+        std::cerr<<__FUNCTION__<<"(): could not listen on "<<m_strSocketPath<<": "
+                 <<::strerror(errno)<<std::endl;
+        Close();
+        return UNIX_ERROR_STATUS;
+    }
+
+    m_abStop=false;
+    m_pServerThread=new boost::thread(boost::bind(&EosAdimecFrameRing::ServerThread,this));
+
+    std::cout<<__FUNCTION__<<"(): frame ring "<<m_strShmName<<" ("<<m_nNumSlots<<" x "
+             <<(m_nSlotBytes>>10)<<" KB), readers connect to "<<m_strSocketPath<<std::endl;
+
+    return UNIX_OK_STATUS;
+}
+
+void EosAdimecFrameRing::Close(void)
+{
+    m_abStop=true;
+    if(m_pServerThread)
+    {
+        m_pServerThread->join();
+        delete m_pServerThread;
+        m_pServerThread=NULL;
+    }
+
+    {
+        boost::lock_guard<boost::mutex> lock(m_mtxReaders);
+        for(int ireader=0; ireader<m_nMaxReaders; ireader++)
+            DropReader(ireader);
+    }
+
+    if(m_nListenFd>=0)
+    {
+        ::close(m_nListenFd);
+        m_nListenFd=-1;
+        ::unlink(m_strSocketPath.c_str());
+    }
+
+    if(m_pSegment)
+    {
+        ::munmap(m_pSegment,m_nSegmentBytes);
+        m_pSegment=NULL;
+        m_pHeader=NULL;
+        m_pSlots=NULL;
+    }
+
+    if(m_nShmFd>=0)
+    {
+        ::close(m_nShmFd);
+        m_nShmFd=-1;
+        ::shm_unlink(m_strShmName.c_str());
+    }
+
+    return;
+}
+
+void EosAdimecFrameRing::Publish(const EosAdimecRawFrame& frame)
+{
+    if(NULL==m_pHeader)
+        return;
+
+    const EosAdimecPack::E_PIXEL_FORMAT eFormat=
+        m_bPacked ? EosAdimecPack::FormatForBitDepth(frame.nBitDepth) : EosAdimecPack::ePixel16;
+    size_t nDataBytes=EosAdimecPack::PackedFrameBytes(frame.nWidth,frame.nHeight,eFormat);
+    if(nDataBytes>m_nSlotBytes)
+    {
+        m_anTooBig++;
+        return;
+    }
+
+    int nSlot=ClaimSlot();
+    if(nSlot<0)
+    {
+        m_pHeader->nSkipped.fetch_add(1,std::memory_order_relaxed);
+        return;
+    }
+
+    EosAdimecFrameSlot& slot=m_pSlots[nSlot];
+    uint8_t* pData=m_pSegment+m_pHeader->nDataOffset+(size_t)nSlot*m_nSlotBytes;
+
+    EosAdimecPack::Pack(frame.pData,frame.nWidth,frame.nHeight,frame.nStride,eFormat,pData);
+
+    EosAdimecFrameSource::FillMeta(frame,eFormat,nDataBytes,slot.meta);
+
+    // Slot complete: let readers in, then make it the latest.
+    slot.nRefBits.fetch_and(~EosAdimecFrameRingConst::REF_WRITER_BIT,std::memory_order_release);
+    m_pHeader->nLatestSlot.store(nSlot,std::memory_order_release);
+    m_pHeader->nLatestSequence.store(frame.nSequence,std::memory_order_release);
+    m_pHeader->nPublished.fetch_add(1,std::memory_order_relaxed);
+
+    uint64_t nOne=1;
+    boost::lock_guard<boost::mutex> lock(m_mtxReaders);
+    for(auto & ireader: m_vReaders)
+    {
+        // Non-blocking: a reader that never reads just saturates its counter.
+        if(ireader.nEventFd>=0)
+        {
+            ssize_t nIgnored=::write(ireader.nEventFd,&nOne,sizeof(nOne));
+            (void)nIgnored;
+        }
+    }
+
+    return;
+}
+
+EosAdimecFrameRing::FrameRingStats EosAdimecFrameRing::GetStats(void)
+{
+    FrameRingStats stats;
+    ::memset(&stats,0,sizeof(stats));
+
+    {
+        boost::lock_guard<boost::mutex> lock(m_mtxReaders);
+        for(auto & ireader: m_vReaders)
+        {
+            if(ireader.nSocketFd>=0)
+                stats.nReaders++;
+        }
+    }
+
+    if(m_pHeader)
+    {
+        stats.nPublished=m_pHeader->nPublished.load(std::memory_order_relaxed);
+        stats.nSkipped=m_pHeader->nSkipped.load(std::memory_order_relaxed);
+    }
+    stats.nTooBig=m_anTooBig;
+
+    return stats;
+}
+
+int EosAdimecFrameRing::ClaimSlot(void)
+{
+    int nLatest=m_pHeader->nLatestSlot.load(std::memory_order_relaxed);
+
+    // Oldest first: start after the latest.
+    for(int itry=1; itry<=m_nNumSlots; itry++)
+    {
+        int nSlot=(nLatest+itry+m_nNumSlots)%m_nNumSlots;
+        if(nSlot==nLatest)
+            continue;
+
+        uint64_t nExpected=0;
+        if(m_pSlots[nSlot].nRefBits.compare_exchange_strong(nExpected,
+                                                            EosAdimecFrameRingConst::REF_WRITER_BIT,
+                                                            std::memory_order_acq_rel))
+            return nSlot;
+    }
+
+    return -1;
+}
+
+void EosAdimecFrameRing::ServerThread(void)
+{
+    // Poll interval, so Close() isn't held up
+    static const int SERVER_POLL_MS=200;
+
+    EosAdimecThreadPlacement::Apply(EosAdimecThreadPlacement::eRoleProcessing);
+
+    while(!m_abStop)
+    {
+        std::vector<struct pollfd> vPollFds;
+        std::vector<int> vnIndexes;
+        {
+            boost::lock_guard<boost::mutex> lock(m_mtxReaders);
+            struct pollfd pfd;
+            pfd.fd=m_nListenFd;
+            pfd.events=POLLIN;
+            pfd.revents=0;
+            vPollFds.push_back(pfd);
+            vnIndexes.push_back(-1);
+            for(int ireader=0; ireader<m_nMaxReaders; ireader++)
+            {
+                if(m_vReaders[ireader].nSocketFd<0)
+                    continue;
+                pfd.fd=m_vReaders[ireader].nSocketFd;
+                vPollFds.push_back(pfd);
+                vnIndexes.push_back(ireader);
+            }
+        }
+
+        int nReady=::poll(vPollFds.data(),vPollFds.size(),SERVER_POLL_MS);
+        if(nReady<=0)
+            continue;
+
+        for(size_t ipoll=1; ipoll<vPollFds.size(); ipoll++)
+        {
+            if(0==vPollFds[ipoll].revents)
+                continue;
+
+            // Readers don't send anything: any input or hangup means goodbye.
+            boost::lock_guard<boost::mutex> lock(m_mtxReaders);
+            if(m_vReaders[vnIndexes[ipoll]].nSocketFd==vPollFds[ipoll].fd)
+                DropReader(vnIndexes[ipoll]);
+        }
+
+        if(vPollFds[0].revents&POLLIN)
+            AcceptReader();
+    }
+
+    return;
+}
+
+void EosAdimecFrameRing::AcceptReader(void)
+{
+    int nSocketFd=::accept4(m_nListenFd,NULL,NULL,SOCK_CLOEXEC);
+    if(nSocketFd<0)
+        return;
+
+    boost::lock_guard<boost::mutex> lock(m_mtxReaders);
+
+    int nIndex=-1;
+    for(int ireader=0; ireader<m_nMaxReaders; ireader++)
+    {
+        if(m_vReaders[ireader].nSocketFd<0)
+        {
+            nIndex=ireader;
+            break;
+        }
+    }
+
+    int nEventFd=(nIndex>=0) ? ::eventfd(0,EFD_NONBLOCK|EFD_CLOEXEC) : -1;
+    if(nEventFd<0)
+    {
+        std::cerr<<__FUNCTION__<<"(): frame ring reader refused ("
+                 <<((nIndex<0) ? "too many readers" : ::strerror(errno))<<")"<<std::endl;
+        ::close(nSocketFd);
+        return;
+    }
+
+    EosAdimecFrameRingConst::Handshake handshake;
+    handshake.nMagic=EosAdimecFrameRingConst::MAGIC;
+    handshake.nVersion=EosAdimecFrameRingConst::VERSION;
+    handshake.nReaderIndex=nIndex;
+    handshake.nPad=0;
+    handshake.nSegmentBytes=m_nSegmentBytes;
+
+    int anFds[2]={m_nShmFd,nEventFd};
+    union
+    {
+        char cBuf[CMSG_SPACE(sizeof(anFds))];
+        struct cmsghdr align;
+    } control;
+    ::memset(&control,0,sizeof(control));
+
+    struct iovec iov;
+    iov.iov_base=&handshake;
+    iov.iov_len=sizeof(handshake);
+
+    struct msghdr msg;
+    ::memset(&msg,0,sizeof(msg));
+    msg.msg_iov=&iov;
+    msg.msg_iovlen=1;
+    msg.msg_control=control.cBuf;
+    msg.msg_controllen=sizeof(control.cBuf);
+
+    struct cmsghdr* pCmsg=CMSG_FIRSTHDR(&msg);
+    pCmsg->cmsg_level=SOL_SOCKET;
+    pCmsg->cmsg_type=SCM_RIGHTS;
+    pCmsg->cmsg_len=CMSG_LEN(sizeof(anFds));
+    ::memcpy(CMSG_DATA(pCmsg),anFds,sizeof(anFds));
+
+    if(::sendmsg(nSocketFd,&msg,MSG_NOSIGNAL)!=(ssize_t)sizeof(handshake))
+    {
+        ::close(nEventFd);
+        ::close(nSocketFd);
+        return;
+    }
+
+    // A previous reader with this index is gone; make sure it holds nothing.
+    for(int islot=0; islot<m_nNumSlots; islot++)
+        m_pSlots[islot].nRefBits.fetch_and(~(1ull<<nIndex),std::memory_order_acq_rel);
+
+    m_vReaders[nIndex].nSocketFd=nSocketFd;
+    m_vReaders[nIndex].nEventFd=nEventFd;
+
+    return;
+}
+
+void EosAdimecFrameRing::DropReader(const int nIndex)
+{
+    ReaderInfo& reader=m_vReaders[nIndex];
+    if(reader.nSocketFd<0)
+        return;
+
+    ::close(reader.nSocketFd);
+    ::close(reader.nEventFd);
+    reader.nSocketFd=-1;
+    reader.nEventFd=-1;
+
+    if(m_pSlots)
+    {
+        for(int islot=0; islot<m_nNumSlots; islot++)
+            m_pSlots[islot].nRefBits.fetch_and(~(1ull<<nIndex),std::memory_order_acq_rel);
+    }
+
+    return;
+}
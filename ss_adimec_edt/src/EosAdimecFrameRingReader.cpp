@@ -0,0 +1,229 @@
+/**
+ * Reader side of the shared-memory frame ring.  See EosAdimecFrameRingReader.h
+ */
+
+#include <errno.h>
+#include <poll.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "EosAdimecFrameRingReader.h"
+
+EosAdimecFrameRingReader::EosAdimecFrameRingReader(void)
+{
+    m_nSocketFd=-1;
+    m_nEventFd=-1;
+    m_nReaderIndex=-1;
+    m_pSegment=NULL;
+    m_nSegmentBytes=0;
+    m_pHeader=NULL;
+    m_pSlots=NULL;
+
+    return;
+}
+
+EosAdimecFrameRingReader::~EosAdimecFrameRingReader(void)
+{
+    Disconnect();
+    return;
+}
+
+int EosAdimecFrameRingReader::Connect(const std::string& strSocketPath)
+{
+    if(m_pSegment)
+        return 0;
+
+    struct sockaddr_un addr;
+    ::memset(&addr,0,sizeof(addr));
+    addr.sun_family=AF_UNIX;
+    if(strSocketPath.size()>=sizeof(addr.sun_path))
+        return -1;
+    ::strncpy(addr.sun_path,strSocketPath.c_str(),sizeof(addr.sun_path)-1);
+
+    m_nSocketFd=::socket(AF_UNIX,SOCK_SEQPACKET|SOCK_CLOEXEC,0);
+    if((m_nSocketFd<0) || (::connect(m_nSocketFd,(struct sockaddr*)&addr,sizeof(addr))<0))
+    {
+        Disconnect();
+        return -1;
+    }
+
+    // Handshake: reader index and segment size, with the shm and eventfd fds.
+    EosAdimecFrameRingConst::Handshake handshake;
+    int anFds[2]={-1,-1};
+    union
+    {
+        char cBuf[CMSG_SPACE(sizeof(anFds))];
+        struct cmsghdr align;
+    } control;
+
+    struct iovec iov;
+    iov.iov_base=&handshake;
+    iov.iov_len=sizeof(handshake);
+
+    struct msghdr msg;
+    ::memset(&msg,0,sizeof(msg));
+    msg.msg_iov=&iov;
+    msg.msg_iovlen=1;
+    msg.msg_control=control.cBuf;
+    msg.msg_controllen=sizeof(control.cBuf);
+
+    ssize_t nBytes=::recvmsg(m_nSocketFd,&msg,MSG_CMSG_CLOEXEC);
+    struct cmsghdr* pCmsg=CMSG_FIRSTHDR(&msg);
+    if((nBytes==(ssize_t)sizeof(handshake)) && pCmsg && (SOL_SOCKET==pCmsg->cmsg_level) &&
+       (SCM_RIGHTS==pCmsg->cmsg_type) && (pCmsg->cmsg_len==CMSG_LEN(sizeof(anFds))))
+    {
+        ::memcpy(anFds,CMSG_DATA(pCmsg),sizeof(anFds));
+    }
+
+    if((anFds[0]<0) || (anFds[1]<0) ||
+       (handshake.nMagic!=EosAdimecFrameRingConst::MAGIC) ||
+       (handshake.nVersion!=EosAdimecFrameRingConst::VERSION) ||
+       (handshake.nReaderIndex>=EosAdimecFrameRingConst::MAX_READERS))
+    {
+        if(anFds[0]>=0)
+            ::close(anFds[0]);
+        if(anFds[1]>=0)
+            ::close(anFds[1]);
+        Disconnect();
+        return -1;
+    }
+
+    m_nEventFd=anFds[1];
+    m_nReaderIndex=handshake.nReaderIndex;
+    m_nSegmentBytes=handshake.nSegmentBytes;
+
+    void* pMap=::mmap(NULL,m_nSegmentBytes,PROT_READ|PROT_WRITE,MAP_SHARED,anFds[0],0);
+    ::close(anFds[0]);
+    if(MAP_FAILED==pMap)
+    {
+        Disconnect();
+        return -1;
+    }
+
+    m_pSegment=(uint8_t*)pMap;
+    m_pHeader=(EosAdimecFrameRingHeader*)m_pSegment;
+    m_pSlots=(EosAdimecFrameSlot*)(m_pSegment+m_pHeader->nSlotTableOffset);
+
+    return 0;
+}
+
+void EosAdimecFrameRingReader::Disconnect(void)
+{
+    // The publisher clears our references when the socket closes.
+    if(m_pSegment)
+    {
+        ::munmap(m_pSegment,m_nSegmentBytes);
+        m_pSegment=NULL;
+        m_pHeader=NULL;
+        m_pSlots=NULL;
+    }
+    if(m_nEventFd>=0)
+    {
+        ::close(m_nEventFd);
+        m_nEventFd=-1;
+    }
+    if(m_nSocketFd>=0)
+    {
+        ::close(m_nSocketFd);
+        m_nSocketFd=-1;
+    }
+    m_nReaderIndex=-1;
+
+    return;
+}
+
+int EosAdimecFrameRingReader::WaitFrame(const int nTimeoutMs)
+{
+    if(NULL==m_pSegment)
+        return -1;
+
+    struct pollfd apfd[2];
+    apfd[0].fd=m_nEventFd;
+    apfd[0].events=POLLIN;
+    apfd[0].revents=0;
+    apfd[1].fd=m_nSocketFd;
+    apfd[1].events=POLLIN;
+    apfd[1].revents=0;
+
+    int nReady=::poll(apfd,2,nTimeoutMs);
+    if((nReady<0) && (EINTR!=errno))
+        return -1;
+    if(apfd[1].revents)
+        return -1;      // The publisher closed the socket
+    if(0==(apfd[0].revents&POLLIN))
+        return 0;
+
+    uint64_t nCount;
+    ssize_t nIgnored=::read(m_nEventFd,&nCount,sizeof(nCount));
+    (void)nIgnored;
+
+    return 1;
+}
+
+bool EosAdimecFrameRingReader::AcquireLatest(FrameView& view, const uint64_t nNewerThan)
+{
+    // Retries if the publisher claims the slot under us
+    static const int MAX_TRIES=4;
+
+    view.pData=NULL;
+    view.nSlot=-1;
+    if(NULL==m_pHeader)
+        return false;
+
+    const uint64_t nMyBit=(1ull<<m_nReaderIndex);
+
+    for(int itry=0; itry<MAX_TRIES; itry++)
+    {
+        int nSlot=m_pHeader->nLatestSlot.load(std::memory_order_acquire);
+        if((nSlot<0) || (nSlot>=(int)m_pHeader->nNumSlots))
+            return false;
+
+        EosAdimecFrameSlot& slot=m_pSlots[nSlot];
+        uint64_t nBits=slot.nRefBits.fetch_or(nMyBit,std::memory_order_acq_rel);
+        if(nBits&nMyBit)
+            return false;   // Already held by this reader
+        if(nBits&EosAdimecFrameRingConst::REF_WRITER_BIT)
+        {
+            // Being rewritten: no longer the latest.  Back off and look again.
+            slot.nRefBits.fetch_and(~nMyBit,std::memory_order_acq_rel);
+            continue;
+        }
+
+        if(slot.meta.nSequence<=nNewerThan)
+        {
+            slot.nRefBits.fetch_and(~nMyBit,std::memory_order_release);
+            return false;
+        }
+
+        view.meta=slot.meta;
+        view.pData=(const uint16_t*)(m_pSegment+m_pHeader->nDataOffset+
+                                     (size_t)nSlot*m_pHeader->nSlotBytes);
+        view.nSlot=nSlot;
+        return true;
+    }
+
+    return false;
+}
+
+void EosAdimecFrameRingReader::Release(FrameView& view)
+{
+    if(m_pSlots && (view.nSlot>=0) && (view.nSlot<(int)m_pHeader->nNumSlots))
+        m_pSlots[view.nSlot].nRefBits.fetch_and(~(1ull<<m_nReaderIndex),std::memory_order_release);
+
+    view.nSlot=-1;
+    view.pData=NULL;
+    return;
+}
+
+uint64_t EosAdimecFrameRingReader::GetPublished(void) const
+{
+    return m_pHeader ? m_pHeader->nPublished.load(std::memory_order_relaxed) : 0;
+}
+
+uint64_t EosAdimecFrameRingReader::GetSkipped(void) const
+{
+    return m_pHeader ? m_pHeader->nSkipped.load(std::memory_order_relaxed) : 0;
+}
@@ -0,0 +1,494 @@
+/**
+ * Frame sources for the in-process capture engine.
+ * See EosAdimecFrameSource.h
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include <iostream>
+#include <algorithm>
+
+#include "EosDevice.h"
+#include "EosAdimecFrameSource.h"
+
+#ifndef _BUILD_NO_EDT_
+//// See the warning in the Makefiles: full path, not -I/opt/EDTpdv.
+extern "C" {
+#include "/opt/EDTpdv/edtinc.h"
+}
+#endif
+
+// Ring buffers are page-aligned (DMA- and SIMD-friendly).
+static const size_t FRAME_ALIGN_BYTES=4096;
+
+void EosAdimecFrameSource::StampFrame(EosAdimecRawFrame& frame)
+{
+    struct timespec tsMono;
+    ::clock_gettime(CLOCK_MONOTONIC,&tsMono);
+    frame.nTimeNs=((uint64_t)tsMono.tv_sec*1000000000ULL)+tsMono.tv_nsec;
+    ::clock_gettime(CLOCK_REALTIME,&frame.tsWall);
+    return;
+}
+
+void EosAdimecFrameSource::FillMeta(const EosAdimecRawFrame& frame, const uint32_t nPixelFormat,
+                                    const uint64_t nDataBytes, EosAdimecFrameMeta& meta)
+{
+    meta.nSequence=frame.nSequence;
+    meta.nTimeNs=frame.nTimeNs;
+    meta.nWallSec=frame.tsWall.tv_sec;
+    meta.nWallNsec=frame.tsWall.tv_nsec;
+    meta.nWidth=frame.nWidth;
+    meta.nHeight=frame.nHeight;
+    meta.nBitDepth=frame.nBitDepth;
+    meta.bRedRowFirst=frame.bRedRowFirst ? 1 : 0;
+    meta.bGreenPixelFirst=frame.bGreenPixelFirst ? 1 : 0;
+    meta.bOverrun=frame.bOverrun ? 1 : 0;
+    meta.bSettingsChanging=frame.bSettingsChanging ? 1 : 0;
+    meta.nPixelFormat=nPixelFormat;
+    meta.nDropped=frame.nDropped;
+    meta.nDataBytes=nDataBytes;
+    meta.settings=frame.settings;
+    return;
+}
+
+#ifndef _BUILD_NO_EDT_
+
+// ######################## EDT (libpdv) ###################################
+
+EosAdimecFrameSourceEdt::EosAdimecFrameSourceEdt(const int nUnit, const int nChannel)
+{
+    m_nUnit=nUnit;
+    m_nChannel=nChannel;
+    m_pPdvDev=NULL;
+    m_nRingBuffers=0;
+    m_nTimeoutMs=-1;
+    m_bStarted=false;
+    m_nWidth=0;
+    m_nHeight=0;
+    m_nBitDepth=0;
+    m_bRedRowFirst=false;
+    m_bGreenPixelFirst=false;
+    m_nDoneCount=0;
+    m_nLastDoneNs=0;
+    m_nIntervalNs=0;
+    return;
+}
+
+EosAdimecFrameSourceEdt::~EosAdimecFrameSourceEdt(void)
+{
+    Close();
+    return;
+}
+
+int EosAdimecFrameSourceEdt::Open(const int nRingBuffers)
+{
+    if(m_pPdvDev && (m_nRingBuffers>0))
+        return UNIX_OK_STATUS;
+
+    // ProbeFrameBytes() may have opened the channel already.
+    if((NULL==m_pPdvDev) && (UNIX_OK_STATUS!=OpenChannel()))
+        return UNIX_ERROR_STATUS;
+
+    if(0!=pdv_multibuf((PdvDev*)m_pPdvDev,nRingBuffers))
+    {
+        std::cerr<<__FUNCTION__<<"(): pdv_multibuf("<<nRingBuffers<<") failed"<<std::endl;
+        Close();
+        return UNIX_ERROR_STATUS;
+    }
+
+    m_nRingBuffers=nRingBuffers;
+    m_nTimeoutMs=-1;
+    m_nDoneCount=0;
+    m_nLastDoneNs=0;
+    m_nIntervalNs=0;
+
+    return UNIX_OK_STATUS;
+}
+
+int EosAdimecFrameSourceEdt::OpenChannel(void)
+{
+    PdvDev* pPdv=pdv_open_channel(EDT_INTERFACE,m_nUnit,m_nChannel);
+    if(NULL==pPdv)
+    {
+        std::cerr<<__FUNCTION__<<"(): pdv_open_channel("<<m_nUnit<<","<<m_nChannel
+                 <<") failed"<<std::endl;
+        return UNIX_ERROR_STATUS;
+    }
+
+    m_nWidth=pdv_get_width(pPdv);
+    m_nHeight=pdv_get_height(pPdv);
+    m_nBitDepth=pdv_get_extdepth(pPdv);
+    m_bRedRowFirst=(0!=pPdv->dd_p->kbs_red_row_first);
+    m_bGreenPixelFirst=(0!=pPdv->dd_p->kbs_green_pixel_first);
+
+    // We do our own Bayer decoding: the raw DMA image must be one
+    // 16-bit word per pixel.
+    if((m_nBitDepth<9) || (m_nBitDepth>16) ||
+       (pdv_get_dmasize(pPdv)<(int)(m_nWidth*m_nHeight*sizeof(uint16_t))))
+    {
+        std::cerr<<__FUNCTION__<<"(): unsupported camera setup ("<<m_nWidth<<"x"<<m_nHeight
+                 <<", extdepth "<<m_nBitDepth<<", dmasize "<<pdv_get_dmasize(pPdv)<<")"<<std::endl;
+        pdv_close(pPdv);
+        return UNIX_ERROR_STATUS;
+    }
+
+    m_pPdvDev=pPdv;
+    m_nRingBuffers=0;
+
+    return UNIX_OK_STATUS;
+}
+
+void EosAdimecFrameSourceEdt::Close(void)
+{
+    if(NULL==m_pPdvDev)
+        return;
+
+    Stop();
+    pdv_close((PdvDev*)m_pPdvDev);
+    m_pPdvDev=NULL;
+    m_nRingBuffers=0;
+
+    return;
+}
+
+// Arm every ring buffer; ReleaseFrame() re-arms one per frame consumed,
+// so the grabber always has somewhere to put the next frame.
+int EosAdimecFrameSourceEdt::Start(void)
+{
+    if(NULL==m_pPdvDev)
+        return UNIX_ERROR_STATUS;
+
+    if(!m_bStarted)
+    {
+        pdv_flush_fifo((PdvDev*)m_pPdvDev);
+        pdv_start_images((PdvDev*)m_pPdvDev,m_nRingBuffers);
+        m_bStarted=true;
+    }
+
+    return UNIX_OK_STATUS;
+}
+
+void EosAdimecFrameSourceEdt::Stop(void)
+{
+    if(m_pPdvDev && m_bStarted)
+    {
+        edt_abort_dma((PdvDev*)m_pPdvDev);
+        m_bStarted=false;
+    }
+    return;
+}
+
+int EosAdimecFrameSourceEdt::WaitFrame(EosAdimecRawFrame& frame, const int nTimeoutMs)
+{
+    if((NULL==m_pPdvDev) || !m_bStarted)
+        return -1;
+
+    PdvDev* pPdv=(PdvDev*)m_pPdvDev;
+
+    if(nTimeoutMs!=m_nTimeoutMs)
+    {
+        pdv_set_timeout(pPdv,nTimeoutMs);
+        m_nTimeoutMs=nTimeoutMs;
+    }
+
+    int nTimeoutsBefore=pdv_timeouts(pPdv);
+
+    // Driver DMA-done time of the image: seconds, nanoseconds (CLOCK_REALTIME)
+    u_int anDoneTime[2]={0,0};
+    unsigned char* pImage=pdv_wait_images_timed_raw(pPdv,1,anDoneTime);
+
+    if(pdv_timeouts(pPdv)!=nTimeoutsBefore)
+    {
+        // Resynchronize the ring; the armed buffers stay armed.  The
+        // camera stopped, so the next gap in the stamps is not drops.
+        pdv_timeout_restart(pPdv,TRUE);
+        m_nLastDoneNs=0;
+        return 0;
+    }
+    if(NULL==pImage)
+        return -1;
+
+    frame.pData=(const uint16_t*)pImage;
+    frame.nWidth=m_nWidth;
+    frame.nHeight=m_nHeight;
+    frame.nStride=m_nWidth;
+    frame.nBitDepth=m_nBitDepth;
+    frame.bRedRowFirst=m_bRedRowFirst;
+    frame.bGreenPixelFirst=m_bGreenPixelFirst;
+    frame.nRingIndex=(int)(m_nDoneCount%m_nRingBuffers);
+    frame.nSequence=m_nDoneCount+1;
+    frame.bOverrun=(0!=pdv_overrun(pPdv));
+    StampFrame(frame);
+    StampFromDriver(frame,anDoneTime[0],anDoneTime[1]);
+    frame.nDropped=EstimateDropped(frame.nTimeNs);
+
+    m_nDoneCount++;
+
+    return 1;
+}
+
+// frame holds the wakeup time; move it back by how long ago (wall
+// clock) the driver says the DMA finished.  A stamp that is missing or
+// not in the last second is not trusted.
+void EosAdimecFrameSourceEdt::StampFromDriver(EosAdimecRawFrame& frame, const unsigned int nSec,
+                                              const unsigned int nNsec)
+{
+    static const int64_t MAX_STAMP_AGE_NS=1000000000LL;
+
+    if((0==nSec) || (nNsec>=1000000000u))
+        return;
+
+    int64_t nAgeNs=((int64_t)frame.tsWall.tv_sec-(int64_t)nSec)*1000000000LL+
+        ((int64_t)frame.tsWall.tv_nsec-(int64_t)nNsec);
+    if((nAgeNs<0) || (nAgeNs>MAX_STAMP_AGE_NS) || ((uint64_t)nAgeNs>frame.nTimeNs))
+        return;
+
+    frame.nTimeNs-=(uint64_t)nAgeNs;
+    frame.tsWall.tv_sec=nSec;
+    frame.tsWall.tv_nsec=nNsec;
+    return;
+}
+
+// Frames lost before this one: a done-to-done gap of n frame intervals
+// means n-1 frames came while no buffer was armed.  The interval is
+// learned from gaps with nothing lost.
+uint32_t EosAdimecFrameSourceEdt::EstimateDropped(const uint64_t nDoneNs)
+{
+    // Weight of the newest gap in the smoothed interval
+    static const uint64_t INTERVAL_SMOOTHING_DIV=16;
+
+    uint32_t nDropped=0;
+
+    if(m_nLastDoneNs && (nDoneNs>m_nLastDoneNs))
+    {
+        uint64_t nGapNs=nDoneNs-m_nLastDoneNs;
+        if(0==m_nIntervalNs)
+            m_nIntervalNs=nGapNs;
+        else if(2*nGapNs<3*m_nIntervalNs)
+            m_nIntervalNs=(m_nIntervalNs*(INTERVAL_SMOOTHING_DIV-1)+nGapNs)/INTERVAL_SMOOTHING_DIV;
+        else
+            nDropped=(uint32_t)((nGapNs+m_nIntervalNs/2)/m_nIntervalNs-1);
+    }
+    m_nLastDoneNs=nDoneNs;
+
+    return nDropped;
+}
+
+void EosAdimecFrameSourceEdt::ReleaseFrame(const EosAdimecRawFrame& frame)
+{
+    if(m_pPdvDev && m_bStarted)
+        pdv_start_image((PdvDev*)m_pPdvDev);
+    return;
+}
+
+size_t EosAdimecFrameSourceEdt::GetFrameBytes(void)
+{
+    if(NULL==m_pPdvDev)
+        return 0;
+    return pdv_get_dmasize((PdvDev*)m_pPdvDev);
+}
+
+// pdv_multibuf() allocates dmasize bytes per buffer, never less than the image.
+size_t EosAdimecFrameSourceEdt::ProbeFrameBytes(void)
+{
+    if((NULL==m_pPdvDev) && (UNIX_OK_STATUS!=OpenChannel()))
+        return 0;
+
+    PdvDev* pPdv=(PdvDev*)m_pPdvDev;
+    return (size_t)std::max(pdv_get_imagesize(pPdv),pdv_get_dmasize(pPdv));
+}
+
+#endif // _BUILD_NO_EDT_
+
+// ######################## SYNTHETIC #######################################
+
+EosAdimecFrameSourceSynthetic::EosAdimecFrameSourceSynthetic(const int nWidth,
+                                                             const int nHeight,
+                                                             const int nBitDepth,
+                                                             const int nFps,
+                                                             const bool bRedRowFirst,
+                                                             const bool bGreenPixelFirst)
+{
+    m_nWidth=nWidth;
+    m_nHeight=nHeight;
+    m_nBitDepth=nBitDepth;
+    m_nFps=(nFps>0) ? nFps : 1;
+    m_bRedRowFirst=bRedRowFirst;
+    m_bGreenPixelFirst=bGreenPixelFirst;
+    m_nNext=0;
+    m_bStarted=false;
+    m_nSequence=0;
+    m_nNextFrameNs=0;
+    return;
+}
+
+EosAdimecFrameSourceSynthetic::~EosAdimecFrameSourceSynthetic(void)
+{
+    Close();
+    return;
+}
+
+int EosAdimecFrameSourceSynthetic::Open(const int nRingBuffers)
+{
+    Close();
+
+    for(int ibuf=0; ibuf<nRingBuffers; ibuf++)
+    {
+        void* pBuf=NULL;
+        if(0!=::posix_memalign(&pBuf,FRAME_ALIGN_BYTES,GetFrameBytes()))
+        {
+            std::cerr<<__FUNCTION__<<"(): could not allocate frame buffer "<<ibuf<<std::endl;
+            Close();
+            return UNIX_ERROR_STATUS;
+        }
+        m_vpBuffers.push_back((uint16_t*)pBuf);
+        m_vbInUse.push_back(false);
+    }
+
+    m_nNext=0;
+    return UNIX_OK_STATUS;
+}
+
+void EosAdimecFrameSourceSynthetic::Close(void)
+{
+    Stop();
+    for(auto & ibuf: m_vpBuffers)
+        ::free(ibuf);
+    m_vpBuffers.clear();
+    m_vbInUse.clear();
+    return;
+}
+
+int EosAdimecFrameSourceSynthetic::Start(void)
+{
+    if(m_vpBuffers.empty())
+        return UNIX_ERROR_STATUS;
+
+    EosAdimecRawFrame frameNow;
+    StampFrame(frameNow);
+    m_nNextFrameNs=frameNow.nTimeNs+(1000000000ULL/m_nFps);
+    m_bStarted=true;
+
+    return UNIX_OK_STATUS;
+}
+
+void EosAdimecFrameSourceSynthetic::Stop(void)
+{
+    m_bStarted=false;
+    return;
+}
+
+int EosAdimecFrameSourceSynthetic::WaitFrame(EosAdimecRawFrame& frame, const int nTimeoutMs)
+{
+    if(!m_bStarted)
+        return -1;
+
+    const uint64_t nPeriodNs=1000000000ULL/m_nFps;
+
+    StampFrame(frame);
+    if(frame.nTimeNs<m_nNextFrameNs)
+    {
+        uint64_t nWaitNs=m_nNextFrameNs-frame.nTimeNs;
+        bool bTimeout=(nWaitNs>((uint64_t)nTimeoutMs*1000000ULL));
+        if(bTimeout)
+            nWaitNs=(uint64_t)nTimeoutMs*1000000ULL;
+
+        struct timespec tsWait;
+        tsWait.tv_sec=nWaitNs/1000000000ULL;
+        tsWait.tv_nsec=nWaitNs%1000000000ULL;
+        while((::nanosleep(&tsWait,&tsWait)<0) && (EINTR==errno))
+            ;
+
+        if(bTimeout)
+            return 0;
+    }
+
+    // A consumer that falls behind loses frames, as it would on the grabber.
+    StampFrame(frame);
+    uint64_t nMissed=0;
+    if(frame.nTimeNs>m_nNextFrameNs+nPeriodNs)
+        nMissed=(frame.nTimeNs-m_nNextFrameNs)/nPeriodNs;
+    m_nSequence+=nMissed+1;
+    m_nNextFrameNs+=(nMissed+1)*nPeriodNs;
+
+    // Next free buffer.  All of them held means ReleaseFrame() is being skipped.
+    size_t nBuf=m_nNext;
+    size_t nTries;
+    for(nTries=0; nTries<m_vpBuffers.size(); nTries++)
+    {
+        if(!m_vbInUse[nBuf])
+            break;
+        nBuf=(nBuf+1)%m_vpBuffers.size();
+    }
+    if(nTries==m_vpBuffers.size())
+        return -1;
+    m_nNext=(nBuf+1)%m_vpBuffers.size();
+    m_vbInUse[nBuf]=true;
+
+    Generate(m_vpBuffers[nBuf],m_nSequence);
+
+    frame.pData=m_vpBuffers[nBuf];
+    frame.nWidth=m_nWidth;
+    frame.nHeight=m_nHeight;
+    frame.nStride=m_nWidth;
+    frame.nBitDepth=m_nBitDepth;
+    frame.bRedRowFirst=m_bRedRowFirst;
+    frame.bGreenPixelFirst=m_bGreenPixelFirst;
+    frame.nRingIndex=(int)nBuf;
+    frame.nSequence=m_nSequence;
+    frame.nDropped=(uint32_t)nMissed;
+    frame.bOverrun=false;
+
+    return 1;
+}
+
+void EosAdimecFrameSourceSynthetic::ReleaseFrame(const EosAdimecRawFrame& frame)
+{
+    if((frame.nRingIndex>=0) && ((size_t)frame.nRingIndex<m_vbInUse.size()))
+        m_vbInUse[frame.nRingIndex]=false;
+    return;
+}
+
+size_t EosAdimecFrameSourceSynthetic::GetFrameBytes(void)
+{
+    return (size_t)m_nWidth*m_nHeight*sizeof(uint16_t);
+}
+
+// Red ramps left-to-right and scrolls with the frame count, blue ramps
+// top-to-bottom, green is a mid-level plateau with vertical bars (edges
+// for focus/demosaic checks).  A little deterministic noise on top.
+void EosAdimecFrameSourceSynthetic::Generate(uint16_t* pData, const uint64_t nSequence)
+{
+    const uint32_t nMax=(1u<<m_nBitDepth)-1;
+    uint32_t nNoise=(uint32_t)nSequence*2654435761u;
+
+    for(int irow=0; irow<m_nHeight; irow++)
+    {
+        uint16_t* pRow=pData+(size_t)irow*m_nWidth;
+        bool bRedRow=(((irow&1)==0)==m_bRedRowFirst);
+        uint32_t nBlue=(uint32_t)(((uint64_t)irow*nMax)/(m_nHeight>1 ? m_nHeight-1 : 1));
+
+        for(int icol=0; icol<m_nWidth; icol++)
+        {
+            bool bGreen=(((icol&1)==0)==m_bGreenPixelFirst);
+            if(!bRedRow)
+                bGreen=!bGreen;
+
+            uint32_t nValue;
+            if(bGreen)
+                nValue=((((icol+(int)nSequence)/32)&1) ? (nMax*3)/4 : nMax/4);
+            else if(bRedRow)
+                nValue=(uint32_t)((((uint64_t)icol+nSequence*4)%m_nWidth)*nMax/m_nWidth);
+            else
+                nValue=nBlue;
+
+            nNoise=nNoise*1664525u+1013904223u;
+            nValue+=(nNoise>>29);
+            pRow[icol]=(uint16_t)((nValue>nMax) ? nMax : nValue);
+        }
+    }
+
+    return;
+}
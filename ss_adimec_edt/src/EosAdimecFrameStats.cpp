@@ -0,0 +1,513 @@
+/**
+ * Per-frame image statistics.  See EosAdimecFrameStats.h
+ */
+
+#include <string.h>
+#include <time.h>
+
+#include <algorithm>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define EOS_ADIMEC_FRAME_STATS_X86
+#endif
+
+#include <boost/bind.hpp>
+#include <boost/thread/locks.hpp>
+
+#include "EosDevice.h"
+#include "EosAdimecFrameStats.h"
+#include "EosAdimecThreadPlacement.h"
+
+// Saturated: at or above this share of full scale.  Black: below this one.
+static const double STATS_SATURATED_LEVEL=0.98;
+static const double STATS_BLACK_LEVEL=0.02;
+
+// Re-check the push period this often while pushes are off
+static const int STATS_IDLE_WAIT_MS=200;
+
+/** One row's worth of running totals for its two Bayer positions (even/odd column) */
+struct StatsRow
+{
+    const uint32_t nMask;
+    const int nShift;
+    const uint32_t nSaturated;
+    const uint32_t nBlack;
+    uint64_t anSum[2];
+    uint64_t anSaturated[2];
+    uint64_t anBlack[2];
+    uint32_t anMin[2];
+    uint32_t anMax[2];
+    uint32_t* apHist[2];
+};
+
+// Columns [nColBegin, nWidth); nColBegin even.
+static void StatsRowScalar(const uint16_t* pRow, const int nColBegin, const int nWidth,
+                           StatsRow& row)
+{
+    for(int icol=nColBegin; icol<nWidth; icol++)
+    {
+        int nPos=icol&1;
+        uint32_t nValue=pRow[icol]&row.nMask;
+        row.anSum[nPos]+=nValue;
+        row.anMin[nPos]=std::min(row.anMin[nPos],nValue);
+        row.anMax[nPos]=std::max(row.anMax[nPos],nValue);
+        row.anSaturated[nPos]+=(nValue>=row.nSaturated) ? 1 : 0;
+        row.anBlack[nPos]+=(nValue<row.nBlack) ? 1 : 0;
+        row.apHist[nPos][nValue>>row.nShift]++;
+    }
+    return;
+}
+
+#ifdef EOS_ADIMEC_FRAME_STATS_X86
+
+// SSE4.1/AVX2: lane parity = column parity.  Each returns the first
+// column it did not do; the scalar loop finishes the row.
+
+__attribute__((target("sse4.1")))
+static int StatsRowSse4(const uint16_t* pRow, const int nWidth, StatsRow& row)
+{
+    const __m128i vMask=_mm_set1_epi16((short)row.nMask);
+    const __m128i vSatBelow=_mm_set1_epi16((short)(row.nSaturated-1));
+    const __m128i vBlack=_mm_set1_epi16((short)row.nBlack);
+    const __m128i vEven=_mm_set1_epi32(0x00000001);
+    const __m128i vOdd=_mm_set1_epi32(0x00010000);
+    const __m128i vShift=_mm_cvtsi32_si128(row.nShift);
+
+    __m128i vSumEven=_mm_setzero_si128(), vSumOdd=_mm_setzero_si128();
+    __m128i vMin=_mm_set1_epi16(-1), vMax=_mm_setzero_si128();
+    __m128i vSat=_mm_setzero_si128(), vBlk=_mm_setzero_si128();
+    uint16_t anBins[8] __attribute__((aligned(16)));
+    uint32_t* pHistEven=row.apHist[0];
+    uint32_t* pHistOdd=row.apHist[1];
+
+    int icol=0;
+    for(; icol+8<=nWidth; icol+=8)
+    {
+        __m128i v=_mm_and_si128(_mm_loadu_si128((const __m128i*)(pRow+icol)),vMask);
+
+        vSumEven=_mm_add_epi32(vSumEven,_mm_madd_epi16(v,vEven));
+        vSumOdd=_mm_add_epi32(vSumOdd,_mm_madd_epi16(v,vOdd));
+        vMin=_mm_min_epu16(vMin,v);
+        vMax=_mm_max_epu16(vMax,v);
+        vSat=_mm_sub_epi16(vSat,_mm_cmpgt_epi16(v,vSatBelow));
+        vBlk=_mm_sub_epi16(vBlk,_mm_cmpgt_epi16(vBlack,v));
+
+        _mm_store_si128((__m128i*)anBins,_mm_srl_epi16(v,vShift));
+        pHistEven[anBins[0]]++;
+        pHistOdd[anBins[1]]++;
+        pHistEven[anBins[2]]++;
+        pHistOdd[anBins[3]]++;
+        pHistEven[anBins[4]]++;
+        pHistOdd[anBins[5]]++;
+        pHistEven[anBins[6]]++;
+        pHistOdd[anBins[7]]++;
+    }
+
+    uint32_t anSumEven[4], anSumOdd[4];
+    uint16_t anMin[8], anMax[8], anSat[8], anBlk[8];
+    _mm_storeu_si128((__m128i*)anSumEven,vSumEven);
+    _mm_storeu_si128((__m128i*)anSumOdd,vSumOdd);
+    _mm_storeu_si128((__m128i*)anMin,vMin);
+    _mm_storeu_si128((__m128i*)anMax,vMax);
+    _mm_storeu_si128((__m128i*)anSat,vSat);
+    _mm_storeu_si128((__m128i*)anBlk,vBlk);
+    for(int ilane=0; ilane<8; ilane++)
+    {
+        int nPos=ilane&1;
+        row.anMin[nPos]=std::min(row.anMin[nPos],(uint32_t)anMin[ilane]);
+        row.anMax[nPos]=std::max(row.anMax[nPos],(uint32_t)anMax[ilane]);
+        row.anSaturated[nPos]+=anSat[ilane];
+        row.anBlack[nPos]+=anBlk[ilane];
+    }
+    for(int ilane=0; ilane<4; ilane++)
+    {
+        row.anSum[0]+=anSumEven[ilane];
+        row.anSum[1]+=anSumOdd[ilane];
+    }
+
+    return icol;
+}
+
+__attribute__((target("avx2")))
+static int StatsRowAvx2(const uint16_t* pRow, const int nWidth, StatsRow& row)
+{
+    const __m256i vMask=_mm256_set1_epi16((short)row.nMask);
+    const __m256i vSatBelow=_mm256_set1_epi16((short)(row.nSaturated-1));
+    const __m256i vBlack=_mm256_set1_epi16((short)row.nBlack);
+    const __m256i vEven=_mm256_set1_epi32(0x00000001);
+    const __m256i vOdd=_mm256_set1_epi32(0x00010000);
+    const __m128i vShift=_mm_cvtsi32_si128(row.nShift);
+
+    __m256i vSumEven=_mm256_setzero_si256(), vSumOdd=_mm256_setzero_si256();
+    __m256i vMin=_mm256_set1_epi16(-1), vMax=_mm256_setzero_si256();
+    __m256i vSat=_mm256_setzero_si256(), vBlk=_mm256_setzero_si256();
+    uint16_t anBins[16] __attribute__((aligned(32)));
+    uint32_t* pHistEven=row.apHist[0];
+    uint32_t* pHistOdd=row.apHist[1];
+
+    int icol=0;
+    for(; icol+16<=nWidth; icol+=16)
+    {
+        __m256i v=_mm256_and_si256(_mm256_loadu_si256((const __m256i*)(pRow+icol)),vMask);
+
+        vSumEven=_mm256_add_epi32(vSumEven,_mm256_madd_epi16(v,vEven));
+        vSumOdd=_mm256_add_epi32(vSumOdd,_mm256_madd_epi16(v,vOdd));
+        vMin=_mm256_min_epu16(vMin,v);
+        vMax=_mm256_max_epu16(vMax,v);
+        vSat=_mm256_sub_epi16(vSat,_mm256_cmpgt_epi16(v,vSatBelow));
+        vBlk=_mm256_sub_epi16(vBlk,_mm256_cmpgt_epi16(vBlack,v));
+
+        _mm256_store_si256((__m256i*)anBins,_mm256_srl_epi16(v,vShift));
+        pHistEven[anBins[0]]++;
+        pHistOdd[anBins[1]]++;
+        pHistEven[anBins[2]]++;
+        pHistOdd[anBins[3]]++;
+        pHistEven[anBins[4]]++;
+        pHistOdd[anBins[5]]++;
+        pHistEven[anBins[6]]++;
+        pHistOdd[anBins[7]]++;
+        pHistEven[anBins[8]]++;
+        pHistOdd[anBins[9]]++;
+        pHistEven[anBins[10]]++;
+        pHistOdd[anBins[11]]++;
+        pHistEven[anBins[12]]++;
+        pHistOdd[anBins[13]]++;
+        pHistEven[anBins[14]]++;
+        pHistOdd[anBins[15]]++;
+    }
+
+    uint32_t anSumEven[8], anSumOdd[8];
+    uint16_t anMin[16], anMax[16], anSat[16], anBlk[16];
+    _mm256_storeu_si256((__m256i*)anSumEven,vSumEven);
+    _mm256_storeu_si256((__m256i*)anSumOdd,vSumOdd);
+    _mm256_storeu_si256((__m256i*)anMin,vMin);
+    _mm256_storeu_si256((__m256i*)anMax,vMax);
+    _mm256_storeu_si256((__m256i*)anSat,vSat);
+    _mm256_storeu_si256((__m256i*)anBlk,vBlk);
+    for(int ilane=0; ilane<16; ilane++)
+    {
+        int nPos=ilane&1;
+        row.anMin[nPos]=std::min(row.anMin[nPos],(uint32_t)anMin[ilane]);
+        row.anMax[nPos]=std::max(row.anMax[nPos],(uint32_t)anMax[ilane]);
+        row.anSaturated[nPos]+=anSat[ilane];
+        row.anBlack[nPos]+=anBlk[ilane];
+    }
+    for(int ilane=0; ilane<8; ilane++)
+    {
+        row.anSum[0]+=anSumEven[ilane];
+        row.anSum[1]+=anSumOdd[ilane];
+    }
+
+    return icol;
+}
+
+#else
+
+static int StatsRowSse4(const uint16_t*, const int, StatsRow&)
+{
+    return 0;
+}
+
+static int StatsRowAvx2(const uint16_t*, const int, StatsRow&)
+{
+    return 0;
+}
+
+#endif // EOS_ADIMEC_FRAME_STATS_X86
+
+EosAdimecFrameStats::EosAdimecFrameStats(PushFn fnPush, EosAdimecTileExecutor* pExecutor,
+                                         const EosAdimecBayer::E_SIMD_LEVEL eLevel)
+{
+    m_fnPush=fnPush;
+    m_pExecutor=pExecutor;
+    m_eLevel=(EosAdimecBayer::eSimdAuto==eLevel) ? EosAdimecBayer::GetBestSimdLevel() : eLevel;
+
+    m_pPushThread=NULL;
+    m_abStop=false;
+
+    m_nFrameCount=0;
+
+    m_nDecimation=10;
+    m_nPushMs=0;
+    m_bHaveStats=false;
+    ::memset(&m_latest,0,sizeof(m_latest));
+    m_bPushPending=false;
+
+    return;
+}
+
+EosAdimecFrameStats::~EosAdimecFrameStats(void)
+{
+    Stop();
+    return;
+}
+
+int EosAdimecFrameStats::Start(void)
+{
+    if(m_pPushThread)
+        return UNIX_OK_STATUS;
+
+    m_abStop=false;
+    m_pPushThread=new boost::thread(boost::bind(&EosAdimecFrameStats::PushThread,this));
+
+    return UNIX_OK_STATUS;
+}
+
+void EosAdimecFrameStats::Stop(void)
+{
+    {
+        boost::lock_guard<boost::mutex> lock(m_mtxStats);
+        m_abStop=true;
+        m_cvStats.notify_all();
+    }
+
+    if(m_pPushThread)
+    {
+        m_pPushThread->join();
+        delete m_pPushThread;
+        m_pPushThread=NULL;
+    }
+
+    return;
+}
+
+void EosAdimecFrameStats::OnFrame(const EosAdimecRawFrame& frame)
+{
+    int nDecimation;
+    {
+        boost::lock_guard<boost::mutex> lock(m_mtxStats);
+        nDecimation=m_nDecimation;
+    }
+    if(0!=(m_nFrameCount++%nDecimation))
+        return;
+
+    EosAdimecBayer::BayerImage raw;
+    raw.pData=frame.pData;
+    raw.nWidth=frame.nWidth;
+    raw.nHeight=frame.nHeight;
+    raw.nStride=frame.nStride;
+    raw.nBitDepth=frame.nBitDepth;
+    raw.bRedRowFirst=frame.bRedRowFirst;
+    raw.bGreenPixelFirst=frame.bGreenPixelFirst;
+
+    FrameStats stats;
+    if(0!=Compute(raw,stats))
+        return;
+    stats.nSequence=frame.nSequence;
+    stats.tsWall=frame.tsWall;
+    stats.nSettingsVersion=frame.settings.nVersion;
+
+    boost::lock_guard<boost::mutex> lock(m_mtxStats);
+    m_latest=stats;
+    m_bHaveStats=true;
+    m_bPushPending=true;
+
+    return;
+}
+
+int EosAdimecFrameStats::Compute(const EosAdimecBayer::BayerImage& raw, FrameStats& stats)
+{
+    if((NULL==raw.pData) || (raw.nWidth<2) || (raw.nHeight<2) || (raw.nStride<raw.nWidth) ||
+       (raw.nBitDepth<8) || (raw.nBitDepth>15))
+        return -1;
+
+    struct timespec tsStart, tsEnd;
+    ::clock_gettime(CLOCK_MONOTONIC,&tsStart);
+
+    // Tiles start on even rows, so all have the same Bayer row parity.
+    EosAdimecTileExecutor::JobSpec spec={raw.nHeight,(size_t)raw.nWidth*sizeof(uint16_t),2,0};
+    int nTiles=1;
+    if(m_pExecutor)
+    {
+        nTiles=m_pExecutor->GetTileCount(spec);
+        if(m_vAccum.size()<(size_t)nTiles)
+            m_vAccum.resize(nTiles);
+        m_pExecutor->Run(spec,boost::bind(&EosAdimecFrameStats::AccumulateTile,this,&raw,_1));
+    }
+    else
+    {
+        m_vAccum.resize(std::max(m_vAccum.size(),(size_t)1));
+        AccumulateRows(raw,0,raw.nHeight,m_eLevel,m_vAccum[0]);
+    }
+
+    Accum total;
+    ::memset(&total,0,sizeof(total));
+    for(int ipos=0; ipos<4; ipos++)
+        total.anMin[ipos]=UINT32_MAX;
+    for(int itile=0; itile<nTiles; itile++)
+    {
+        const Accum& tile=m_vAccum[itile];
+        for(int ipos=0; ipos<4; ipos++)
+        {
+            total.anSum[ipos]+=tile.anSum[ipos];
+            total.anCount[ipos]+=tile.anCount[ipos];
+            total.anSaturated[ipos]+=tile.anSaturated[ipos];
+            total.anBlack[ipos]+=tile.anBlack[ipos];
+            total.anMin[ipos]=std::min(total.anMin[ipos],tile.anMin[ipos]);
+            total.anMax[ipos]=std::max(total.anMax[ipos],tile.anMax[ipos]);
+            for(int ibin=0; ibin<HIST_BINS; ibin++)
+                total.aanHist[ipos][ibin]+=tile.aanHist[ipos][ibin];
+        }
+    }
+
+    // Bayer positions --> channels: two greens, one red, one blue.
+    ::memset(&stats,0,sizeof(stats));
+    for(int ichan=0; ichan<NUM_CHANNELS; ichan++)
+        stats.aChannels[ichan].nMin=INT32_MAX;
+    for(int ipos=0; ipos<4; ipos++)
+    {
+        int nRowParity=ipos>>1;
+        bool bGreen=((ipos&1)==0)==EosAdimecBayer::IsGreenFirstInRow(raw,nRowParity);
+        E_CHANNEL eChannel=bGreen ? eChannelGreen :
+            (EosAdimecBayer::IsRedRow(raw,nRowParity) ? eChannelRed : eChannelBlue);
+
+        ChannelStats& chan=stats.aChannels[eChannel];
+        chan.nPixels+=total.anCount[ipos];
+        chan.dMean+=(double)total.anSum[ipos];
+        chan.dSaturatedPct+=(double)total.anSaturated[ipos];
+        chan.dBlackPct+=(double)total.anBlack[ipos];
+        chan.nMin=std::min(chan.nMin,(int)total.anMin[ipos]);
+        chan.nMax=std::max(chan.nMax,(int)total.anMax[ipos]);
+        for(int ibin=0; ibin<HIST_BINS; ibin++)
+            chan.anHist[ibin]+=total.aanHist[ipos][ibin];
+    }
+    for(int ichan=0; ichan<NUM_CHANNELS; ichan++)
+    {
+        ChannelStats& chan=stats.aChannels[ichan];
+        double dPixels=(double)std::max(chan.nPixels,(uint64_t)1);
+        chan.dMean/=dPixels;
+        chan.dSaturatedPct*=100.0/dPixels;
+        chan.dBlackPct*=100.0/dPixels;
+        if(0==chan.nPixels)
+            chan.nMin=0;
+    }
+
+    ::clock_gettime(CLOCK_MONOTONIC,&tsEnd);
+    stats.nWidth=raw.nWidth;
+    stats.nHeight=raw.nHeight;
+    stats.nBitDepth=raw.nBitDepth;
+    stats.dComputeMs=(tsEnd.tv_sec-tsStart.tv_sec)*1000.0+(tsEnd.tv_nsec-tsStart.tv_nsec)/1.0e6;
+
+    return 0;
+}
+
+bool EosAdimecFrameStats::GetLatest(FrameStats& stats)
+{
+    boost::lock_guard<boost::mutex> lock(m_mtxStats);
+    if(m_bHaveStats)
+        stats=m_latest;
+    return m_bHaveStats;
+}
+
+void EosAdimecFrameStats::SetDecimation(const int nDecimation)
+{
+    boost::lock_guard<boost::mutex> lock(m_mtxStats);
+    m_nDecimation=std::max(1,nDecimation);
+    return;
+}
+
+int EosAdimecFrameStats::GetDecimation(void)
+{
+    boost::lock_guard<boost::mutex> lock(m_mtxStats);
+    return m_nDecimation;
+}
+
+void EosAdimecFrameStats::SetPushMs(const int nPushMs)
+{
+    boost::lock_guard<boost::mutex> lock(m_mtxStats);
+    m_nPushMs=std::max(0,nPushMs);
+    m_cvStats.notify_all();
+    return;
+}
+
+int EosAdimecFrameStats::GetPushMs(void)
+{
+    boost::lock_guard<boost::mutex> lock(m_mtxStats);
+    return m_nPushMs;
+}
+
+void EosAdimecFrameStats::AccumulateRows(const EosAdimecBayer::BayerImage& raw,
+                                         const int nRowBegin, const int nRowEnd,
+                                         const EosAdimecBayer::E_SIMD_LEVEL eLevel,
+                                         Accum& accum)
+{
+    ::memset(&accum,0,sizeof(accum));
+    for(int ipos=0; ipos<4; ipos++)
+        accum.anMin[ipos]=UINT32_MAX;
+
+    const uint32_t nFullScale=(1u<<raw.nBitDepth)-1;
+
+    for(int irow=nRowBegin; irow<nRowEnd; irow++)
+    {
+        const uint16_t* pRow=raw.pData+(size_t)irow*raw.nStride;
+        const int nPos0=(irow&1)*2;
+
+        StatsRow row={nFullScale,raw.nBitDepth-8,
+                      std::max(1u,(uint32_t)(STATS_SATURATED_LEVEL*nFullScale+0.5)),
+                      (uint32_t)(STATS_BLACK_LEVEL*nFullScale+0.5),
+                      {0,0},{0,0},{0,0},{UINT32_MAX,UINT32_MAX},{0,0},
+                      {accum.aanHist[nPos0],accum.aanHist[nPos0+1]}};
+
+        int nCol=0;
+        if(EosAdimecBayer::eSimdAvx2==eLevel)
+            nCol=StatsRowAvx2(pRow,raw.nWidth,row);
+        else if(EosAdimecBayer::eSimdSse4==eLevel)
+            nCol=StatsRowSse4(pRow,raw.nWidth,row);
+        StatsRowScalar(pRow,nCol,raw.nWidth,row);
+
+        for(int ipar=0; ipar<2; ipar++)
+        {
+            int nPos=nPos0+ipar;
+            accum.anSum[nPos]+=row.anSum[ipar];
+            accum.anCount[nPos]+=(raw.nWidth+1-ipar)/2;
+            accum.anSaturated[nPos]+=row.anSaturated[ipar];
+            accum.anBlack[nPos]+=row.anBlack[ipar];
+            accum.anMin[nPos]=std::min(accum.anMin[nPos],row.anMin[ipar]);
+            accum.anMax[nPos]=std::max(accum.anMax[nPos],row.anMax[ipar]);
+        }
+    }
+
+    return;
+}
+
+void EosAdimecFrameStats::AccumulateTile(const EosAdimecBayer::BayerImage* pRaw,
+                                         const EosAdimecTileExecutor::Tile& tile)
+{
+    AccumulateRows(*pRaw,tile.nRowBegin,tile.nRowEnd,m_eLevel,m_vAccum[tile.nIndex]);
+    return;
+}
+
+void EosAdimecFrameStats::PushThread(void)
+{
+    EosAdimecThreadPlacement::Apply(EosAdimecThreadPlacement::eRoleProcessing);
+
+    boost::unique_lock<boost::mutex> lock(m_mtxStats);
+    while(!m_abStop)
+    {
+        int nPushMs=m_nPushMs;
+        if(nPushMs<=0)
+        {
+            m_cvStats.timed_wait(lock,boost::get_system_time()+
+                                 boost::posix_time::milliseconds(STATS_IDLE_WAIT_MS));
+            continue;
+        }
+
+        boost::system_time tNext=boost::get_system_time()+boost::posix_time::milliseconds(nPushMs);
+        while(!m_abStop && (m_nPushMs==nPushMs) && (boost::get_system_time()<tNext))
+            m_cvStats.timed_wait(lock,tNext);
+        if(m_abStop || (m_nPushMs!=nPushMs))
+            continue;
+
+        if(!m_bPushPending || !m_fnPush)
+            continue;
+        FrameStats stats=m_latest;
+        m_bPushPending=false;
+
+        // The PushFn takes the controller's dispatch lock: not under ours.
+        lock.unlock();
+        m_fnPush(stats);
+        lock.lock();
+    }
+    return;
+}
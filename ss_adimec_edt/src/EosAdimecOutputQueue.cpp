@@ -0,0 +1,634 @@
+/**
+ * Bounded, non-blocking SCIP response output queue.
+ * See EosAdimecOutputQueue.h
+ */
+
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <poll.h>
+#include <limits.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <time.h>
+
+#include <vector>
+#include <algorithm>
+#include <iostream>
+
+#include <boost/bind.hpp>
+#include <boost/thread/locks.hpp>
+
+#include "EosDevice.h"
+#include "EosAdimecOutputQueue.h"
+#include "EosAdimecThreadPlacement.h"
+
+EosAdimecOutputQueue::EosAdimecOutputQueue(const size_t nMaxDepth,
+                                           const E_OVERFLOW_POLICY ePolicy)
+{
+    m_nMaxDepth=(nMaxDepth>0) ? nMaxDepth : 1;
+    m_ePolicy=ePolicy;
+
+    ::memset(&m_stats,0,sizeof(m_stats));
+
+    m_nWakeFd=::eventfd(0,EFD_NONBLOCK|EFD_CLOEXEC);
+    m_abStop=false;
+    m_pFlushThread=NULL;
+
+    return;
+}
+
+EosAdimecOutputQueue::~EosAdimecOutputQueue(void)
+{
+    Stop();
+
+    boost::lock_guard<boost::mutex> lock(m_mtxQueue);
+    for(auto & ichan: m_mapChannels)
+        CloseChannelFd(ichan.second);
+    m_mapChannels.clear();
+
+    if(m_nWakeFd>=0)
+        ::close(m_nWakeFd);
+
+    return;
+}
+
+int EosAdimecOutputQueue::Start(void)
+{
+    if(m_pFlushThread)
+        return UNIX_OK_STATUS;
+
+    if(m_nWakeFd<0)
+    {
+        std::cerr<<__FUNCTION__<<"(): eventfd() failed: "<<::strerror(errno)<<std::endl;
+        return UNIX_ERROR_STATUS;
+    }
+
+    m_abStop=false;
+    m_pFlushThread=new boost::thread(boost::bind(&EosAdimecOutputQueue::FlushThread,this));
+
+    return UNIX_OK_STATUS;
+}
+
+void EosAdimecOutputQueue::Stop(void)
+{
+    m_abStop=true;
+    m_cvQueue.notify_all();
+    m_cvRoom.notify_all();
+    Wake();
+
+    if(m_pFlushThread)
+    {
+        m_pFlushThread->join();
+        delete m_pFlushThread;
+        m_pFlushThread=NULL;
+    }
+
+    return;
+}
+
+void EosAdimecOutputQueue::AddChannel(const int nChannelId, const E_CHANNEL_TYPE eType,
+                                      const int nFd, boost::function<int (void)> fnOpen)
+{
+    boost::lock_guard<boost::mutex> lock(m_mtxQueue);
+
+    OutputChannel& channel=m_mapChannels[nChannelId];
+    InitChannel(channel);
+    channel.eType=eType;
+    channel.nFd=nFd;
+    channel.fnOpen=fnOpen;
+
+    return;
+}
+
+void EosAdimecOutputQueue::AddChannel(const int nChannelId,
+                                      boost::function<int (const std::string&)> fnWrite)
+{
+    boost::lock_guard<boost::mutex> lock(m_mtxQueue);
+
+    OutputChannel& channel=m_mapChannels[nChannelId];
+    InitChannel(channel);
+    channel.fnWrite=fnWrite;
+
+    return;
+}
+
+void EosAdimecOutputQueue::RemoveChannel(const int nChannelId)
+{
+    boost::lock_guard<boost::mutex> lock(m_mtxQueue);
+
+    std::map<int,OutputChannel>::iterator ichan=m_mapChannels.find(nChannelId);
+    if(ichan==m_mapChannels.end())
+        return;
+
+    CloseChannelFd(ichan->second);
+    m_mapChannels.erase(ichan);
+    m_cvRoom.notify_all();
+
+    return;
+}
+
+void EosAdimecOutputQueue::InitChannel(OutputChannel& channel)
+{
+    channel.eType=eChannelStream;
+    channel.nFd=-1;
+    channel.bOwnsFd=false;
+    channel.fnOpen.clear();
+    channel.fnWrite.clear();
+    channel.tLastOpenTry=0;
+    channel.bBlocked=false;
+    channel.dqEntries.clear();
+    channel.nCorkDepth=0;
+    channel.tCorkUntil=boost::get_system_time();
+    channel.bCorkBreak=false;
+    return;
+}
+
+void EosAdimecOutputQueue::Cork(const int nChannelId)
+{
+    boost::lock_guard<boost::mutex> lock(m_mtxQueue);
+
+    std::map<int,OutputChannel>::iterator ichan=m_mapChannels.find(nChannelId);
+    if(ichan!=m_mapChannels.end())
+        ichan->second.nCorkDepth++;
+
+    return;
+}
+
+void EosAdimecOutputQueue::Uncork(const int nChannelId, const int nLingerUs)
+{
+    {
+        boost::lock_guard<boost::mutex> lock(m_mtxQueue);
+
+        std::map<int,OutputChannel>::iterator ichan=m_mapChannels.find(nChannelId);
+        if(ichan==m_mapChannels.end())
+            return;
+
+        OutputChannel& channel=ichan->second;
+        if(channel.nCorkDepth>0)
+            channel.nCorkDepth--;
+        if(nLingerUs>0)
+            channel.tCorkUntil=boost::get_system_time()+boost::posix_time::microseconds(nLingerUs);
+    }
+
+    m_cvQueue.notify_one();
+    Wake();
+
+    return;
+}
+
+int EosAdimecOutputQueue::Enqueue(const int nChannelId, const std::string& strMsg,
+                                  const E_MSG_CLASS eClass)
+{
+    {
+        boost::lock_guard<boost::mutex> lock(m_mtxQueue);
+
+        std::map<int,OutputChannel>::iterator ichan=m_mapChannels.find(nChannelId);
+        if(ichan==m_mapChannels.end())
+        {
+            if(eMsgReply==eClass)
+                m_stats.nRepliesDropped++;
+            return UNIX_ERROR_STATUS;
+        }
+
+        if(UNIX_OK_STATUS!=EnqueueEntry(ichan->second,strMsg,eClass))
+            return UNIX_ERROR_STATUS;
+    }
+
+    m_cvQueue.notify_one();
+    Wake();
+
+    return UNIX_OK_STATUS;
+}
+
+void EosAdimecOutputQueue::Broadcast(const std::string& strMsg, const E_MSG_CLASS eClass)
+{
+    {
+        boost::lock_guard<boost::mutex> lock(m_mtxQueue);
+
+        for(auto & ichan: m_mapChannels)
+            EnqueueEntry(ichan.second,strMsg,eClass);
+    }
+
+    m_cvQueue.notify_one();
+    Wake();
+
+    return;
+}
+
+int EosAdimecOutputQueue::EnqueueEntry(OutputChannel& channel, const std::string& strMsg,
+                                       const E_MSG_CLASS eClass)
+{
+    if(channel.dqEntries.size()>=m_nMaxDepth)
+    {
+        if(!MakeRoom(channel,eClass))
+        {
+            if(eMsgTelemetry==eClass)
+                m_stats.nTelemetryDropped++;
+            return UNIX_ERROR_STATUS;
+        }
+    }
+
+    OutputEntry entry;
+    entry.strMsg=strMsg;
+    entry.nOffset=0;
+    entry.eClass=eClass;
+    channel.dqEntries.push_back(entry);
+
+    m_stats.nEnqueued++;
+    if(channel.dqEntries.size()>m_stats.nHighWater)
+        m_stats.nHighWater=channel.dqEntries.size();
+
+    // Don't let a cork push telemetry out of a full channel.
+    if(channel.dqEntries.size()>=m_nMaxDepth)
+        channel.bCorkBreak=true;
+
+    return UNIX_OK_STATUS;
+}
+
+bool EosAdimecOutputQueue::IsReplyBacklogged(const int nChannelId)
+{
+    boost::lock_guard<boost::mutex> lock(m_mtxQueue);
+
+    std::map<int,OutputChannel>::iterator ichan=m_mapChannels.find(nChannelId);
+    return (ichan!=m_mapChannels.end()) && IsReplyBacklogged(ichan->second);
+}
+
+bool EosAdimecOutputQueue::WaitReplyRoom(const int nChannelId, const int nTimeoutMs)
+{
+    boost::system_time tUntil=boost::get_system_time()+boost::posix_time::milliseconds(nTimeoutMs);
+
+    boost::unique_lock<boost::mutex> lock(m_mtxQueue);
+    while(!m_abStop)
+    {
+        std::map<int,OutputChannel>::iterator ichan=m_mapChannels.find(nChannelId);
+        if((ichan==m_mapChannels.end()) || !IsReplyBacklogged(ichan->second))
+            return true;
+        if(!m_cvRoom.timed_wait(lock,tUntil))
+            return false;
+    }
+    return true;
+}
+
+bool EosAdimecOutputQueue::IsReplyBacklogged(const OutputChannel& channel) const
+{
+    const size_t nBacklog=m_nMaxDepth*REPLY_BACKLOG_FACTOR;
+    if(channel.dqEntries.size()<nBacklog)
+        return false;
+
+    size_t nReplies=0;
+    for(auto & ient: channel.dqEntries)
+    {
+        if(eMsgReply==ient.eClass)
+            nReplies++;
+    }
+    return nReplies>=nBacklog;
+}
+
+EosAdimecOutputQueue::OutputQueueStats EosAdimecOutputQueue::GetStats(void)
+{
+    boost::lock_guard<boost::mutex> lock(m_mtxQueue);
+
+    OutputQueueStats stats=m_stats;
+    stats.nDepth=0;
+    for(auto & ichan: m_mapChannels)
+        stats.nDepth+=ichan.second.dqEntries.size();
+
+    return stats;
+}
+
+bool EosAdimecOutputQueue::PolicyFromString(const std::string& strPolicy,
+                                            E_OVERFLOW_POLICY& ePolicy)
+{
+    if(strPolicy=="drop_oldest")
+    {
+        ePolicy=eDropOldestTelemetry;
+        return true;
+    }
+    if(strPolicy=="drop_newest")
+    {
+        ePolicy=eDropNewestTelemetry;
+        return true;
+    }
+    return false;
+}
+
+// Called with m_mtxQueue held.  Entries that are partially written
+// (nOffset>0) are never removed -- that would corrupt the stream --
+// and neither are replies.
+bool EosAdimecOutputQueue::MakeRoom(OutputChannel& channel, const E_MSG_CLASS eClass)
+{
+    if((eMsgTelemetry==eClass) && (eDropNewestTelemetry==m_ePolicy))
+        return false;
+
+    // Oldest droppable telemetry goes first, for replies and telemetry alike.
+    for(std::deque<OutputEntry>::iterator ient=channel.dqEntries.begin();
+        ient!=channel.dqEntries.end(); ++ient)
+    {
+        if((eMsgTelemetry==ient->eClass) && (0==ient->nOffset))
+        {
+            channel.dqEntries.erase(ient);
+            m_stats.nTelemetryDropped++;
+            return true;
+        }
+    }
+
+    // Nothing but replies queued.  Telemetry can't displace a reply; a
+    // reply runs past the depth (the caller throttles its input instead).
+    return (eMsgReply==eClass);
+}
+
+// Called with m_mtxQueue held.  Never blocks.  Everything queued on the
+// channel goes out in one system call (IOV_MAX/MAX_MSGS_PER_SEND permitting).
+void EosAdimecOutputQueue::FlushFdChannel(OutputChannel& channel)
+{
+    while(!channel.dqEntries.empty())
+    {
+        size_t nBatch;
+        size_t nRequested=0;
+        ssize_t nResult;
+
+        if(eChannelPacket==channel.eType)
+        {
+            // sendmmsg() keeps each entry its own SEQPACKET message.
+            nBatch=std::min(channel.dqEntries.size(),(size_t)MAX_MSGS_PER_SEND);
+            std::vector<struct iovec> vIov(nBatch);
+            std::vector<struct mmsghdr> vMsgs(nBatch);
+            ::memset(vMsgs.data(),0,nBatch*sizeof(struct mmsghdr));
+            for(size_t imsg=0; imsg<nBatch; imsg++)
+            {
+                OutputEntry& entry=channel.dqEntries[imsg];
+                vIov[imsg].iov_base=const_cast<char*>(entry.strMsg.data());
+                vIov[imsg].iov_len=entry.strMsg.size();
+                vMsgs[imsg].msg_hdr.msg_iov=&vIov[imsg];
+                vMsgs[imsg].msg_hdr.msg_iovlen=1;
+            }
+            nResult=::sendmmsg(channel.nFd,vMsgs.data(),nBatch,MSG_DONTWAIT|MSG_NOSIGNAL);
+        }
+        else
+        {
+            nBatch=std::min(channel.dqEntries.size(),(size_t)IOV_MAX);
+            std::vector<struct iovec> vIov(nBatch);
+            for(size_t imsg=0; imsg<nBatch; imsg++)
+            {
+                OutputEntry& entry=channel.dqEntries[imsg];
+                vIov[imsg].iov_base=const_cast<char*>(entry.strMsg.data())+entry.nOffset;
+                vIov[imsg].iov_len=entry.strMsg.size()-entry.nOffset;
+                nRequested+=vIov[imsg].iov_len;
+            }
+            nResult=::writev(channel.nFd,vIov.data(),nBatch);
+        }
+        m_stats.nWriteCalls++;
+
+        if(nResult<0)
+        {
+            if(EINTR==errno)
+                continue;
+            if((EAGAIN==errno)||(EWOULDBLOCK==errno))
+            {
+                channel.bBlocked=true;
+                m_stats.nStalls++;
+                return;
+            }
+
+            // EPIPE etc.: reader went away.  Our own fds get re-opened
+            // later (messages stay queued); socket clients get removed
+            // when the socket server notices the hang-up.
+            CloseChannelFd(channel);
+            return;
+        }
+
+        if(eChannelPacket==channel.eType)
+        {
+            // nResult = number of messages sent
+            for(ssize_t imsg=0; imsg<nResult; imsg++)
+            {
+                channel.dqEntries.pop_front();
+                m_stats.nWritten++;
+            }
+            if((size_t)nResult<nBatch)
+            {
+                channel.bBlocked=true;
+                m_stats.nStalls++;
+                return;
+            }
+            continue;
+        }
+
+        // nResult = number of bytes written; retire whole entries and
+        // leave the offset in the one that was cut short.
+        size_t nBytes=nResult;
+        while(nBytes>0)
+        {
+            OutputEntry& entry=channel.dqEntries.front();
+            size_t nRemaining=entry.strMsg.size()-entry.nOffset;
+            if(nBytes<nRemaining)
+            {
+                entry.nOffset+=nBytes;
+                break;
+            }
+            nBytes-=nRemaining;
+            channel.dqEntries.pop_front();
+            m_stats.nWritten++;
+        }
+        if((size_t)nResult<nRequested)
+        {
+            // Short write on a stream: the pipe is full.
+            channel.bBlocked=true;
+            m_stats.nStalls++;
+            return;
+        }
+    }
+
+    return;
+}
+
+void EosAdimecOutputQueue::CloseChannelFd(OutputChannel& channel)
+{
+    if(channel.bOwnsFd && (channel.nFd>=0))
+        ::close(channel.nFd);
+
+    channel.nFd=-1;
+    channel.bOwnsFd=false;
+    channel.bBlocked=false;
+
+    // A partially-written stream entry can't be resumed on a new fd.
+    if(!channel.dqEntries.empty() && (channel.dqEntries.front().nOffset>0))
+        channel.dqEntries.pop_front();
+
+    return;
+}
+
+void EosAdimecOutputQueue::Wake(void)
+{
+    if(m_nWakeFd>=0)
+    {
+        uint64_t nOne=1;
+        ssize_t nIgnored=::write(m_nWakeFd,&nOne,sizeof(nOne));
+        (void)nIgnored;
+    }
+    return;
+}
+
+void EosAdimecOutputQueue::FlushThread(void)
+{
+    // How often to retry opening a channel whose reader isn't there yet
+    static const int REOPEN_POLL_MS=250;
+
+    EosAdimecThreadPlacement::Apply(EosAdimecThreadPlacement::eRoleDispatch);
+
+    while(!m_abStop)
+    {
+        std::vector<struct pollfd> vPollFds;
+        std::vector<int> vnPollChannels;
+        std::vector<CallbackBatch> vCallbackWork;
+        bool bWaitingToOpen=false;
+        bool bLingering=false;              // A channel is held until tLingerEnd
+        boost::system_time tLingerEnd;
+
+        struct pollfd pfdWake;
+        pfdWake.fd=m_nWakeFd;
+        pfdWake.events=POLLIN;
+        pfdWake.revents=0;
+        vPollFds.push_back(pfdWake);
+        vnPollChannels.push_back(0);
+
+        {
+            boost::unique_lock<boost::mutex> lock(m_mtxQueue);
+            boost::system_time tNow=boost::get_system_time();
+
+            bool bPending=false;
+            for(auto & ichan: m_mapChannels)
+            {
+                OutputChannel& channel=ichan.second;
+                if(channel.dqEntries.empty())
+                    continue;
+
+                // Hold a channel while its dispatch cycle is in progress
+                // (or lingering), unless it filled up.
+                if(!channel.bCorkBreak && !m_abStop)
+                {
+                    if(channel.nCorkDepth>0)
+                        continue;   // Its Uncork() wakes us
+                    if(tNow<channel.tCorkUntil)
+                    {
+                        if(!bLingering || (channel.tCorkUntil<tLingerEnd))
+                            tLingerEnd=channel.tCorkUntil;
+                        bLingering=true;
+                        continue;
+                    }
+                }
+                channel.bCorkBreak=false;
+                bPending=true;
+
+                // Callback channel: take everything as one batch; write it
+                // without the lock.
+                if(channel.fnWrite)
+                {
+                    CallbackBatch batch;
+                    batch.fnWrite=channel.fnWrite;
+                    batch.nMsgs=channel.dqEntries.size();
+                    for(auto & ient: channel.dqEntries)
+                        batch.strBatch+=ient.strMsg;
+                    vCallbackWork.push_back(batch);
+                    channel.dqEntries.clear();
+                    continue;
+                }
+
+                if((channel.nFd<0) && channel.fnOpen)
+                {
+                    time_t tNow=::time(NULL);
+                    if(tNow!=channel.tLastOpenTry)
+                    {
+                        channel.tLastOpenTry=tNow;
+                        channel.nFd=channel.fnOpen();
+                        channel.bOwnsFd=(channel.nFd>=0);
+                        channel.bBlocked=false;
+                    }
+                }
+                if(channel.nFd<0)
+                {
+                    bWaitingToOpen=true;
+                    continue;
+                }
+
+                if(!channel.bBlocked)
+                    FlushFdChannel(channel);
+
+                if(channel.bBlocked && (channel.nFd>=0))
+                {
+                    struct pollfd pfd;
+                    pfd.fd=channel.nFd;
+                    pfd.events=POLLOUT;
+                    pfd.revents=0;
+                    vPollFds.push_back(pfd);
+                    vnPollChannels.push_back(ichan.first);
+                }
+            }
+
+            m_cvRoom.notify_all();
+
+            if(!bPending)
+            {
+                if(m_abStop)
+                    continue;
+                if(bLingering)
+                    m_cvQueue.timed_wait(lock,tLingerEnd);
+                else
+                    m_cvQueue.wait(lock);
+                continue;
+            }
+        }
+
+        for(auto & iwork: vCallbackWork)
+        {
+            int nStatus=iwork.fnWrite(iwork.strBatch);
+
+            boost::lock_guard<boost::mutex> lock(m_mtxQueue);
+            m_stats.nWriteCalls++;
+            if(UNIX_ERROR_STATUS!=nStatus)
+                m_stats.nWritten+=iwork.nMsgs;
+        }
+        if(!vCallbackWork.empty())
+            continue;
+
+        if((1==vPollFds.size()) && !bWaitingToOpen)
+            continue; // Everything flushed; go re-check for new work
+
+        // Come back in time for a lingering channel.
+        int nPollMs=REOPEN_POLL_MS;
+        if(bLingering)
+        {
+            long nLingerMs=(tLingerEnd-boost::get_system_time()).total_milliseconds()+1;
+            nPollMs=(int)std::max(0L,std::min((long)nPollMs,nLingerMs));
+        }
+        ::poll(vPollFds.data(),vPollFds.size(),nPollMs);
+
+        if(vPollFds[0].revents & POLLIN)
+        {
+            uint64_t nCount;
+            ssize_t nIgnored=::read(m_nWakeFd,&nCount,sizeof(nCount));
+            (void)nIgnored;
+        }
+
+        boost::lock_guard<boost::mutex> lock(m_mtxQueue);
+        for(size_t ipfd=1; ipfd<vPollFds.size(); ipfd++)
+        {
+            if(0==vPollFds[ipfd].revents)
+                continue;
+
+            std::map<int,OutputChannel>::iterator ichan=
+                m_mapChannels.find(vnPollChannels[ipfd]);
+            if((ichan==m_mapChannels.end()) || (ichan->second.nFd!=vPollFds[ipfd].fd))
+                continue; // Channel removed/re-opened while we were polling
+
+            if(vPollFds[ipfd].revents & (POLLERR|POLLHUP|POLLNVAL))
+                CloseChannelFd(ichan->second);
+            else
+                ichan->second.bBlocked=false;
+        }
+    }
+
+    return;
+}
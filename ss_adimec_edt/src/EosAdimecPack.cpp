@@ -0,0 +1,426 @@
+/**
+ * Packed pixel formats.  See EosAdimecPack.h
+ */
+
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define EOS_ADIMEC_PACK_X86
+#endif
+
+#include "EosAdimecPack.h"
+
+EosAdimecPack::E_PIXEL_FORMAT EosAdimecPack::FormatForBitDepth(const int nBitDepth)
+{
+    if(nBitDepth<=8)
+        return ePixel8;
+    if(nBitDepth<=10)
+        return ePixel10p;
+    if(nBitDepth<=12)
+        return ePixel12p;
+    return ePixel16;
+}
+
+int EosAdimecPack::FormatBits(const E_PIXEL_FORMAT eFormat)
+{
+    switch(eFormat)
+    {
+        case ePixel8:   return 8;
+        case ePixel10p: return 10;
+        case ePixel12p: return 12;
+        default:        return 16;
+    }
+}
+
+size_t EosAdimecPack::PackedRowBytes(const int nWidth, const E_PIXEL_FORMAT eFormat)
+{
+    return ((size_t)nWidth*FormatBits(eFormat)+7)/8;
+}
+
+size_t EosAdimecPack::PackedFrameBytes(const int nWidth, const int nHeight,
+                                       const E_PIXEL_FORMAT eFormat)
+{
+    return PackedRowBytes(nWidth,eFormat)*nHeight;
+}
+
+size_t EosAdimecPack::MaxPackedBytes(const size_t nFrameBytes)
+{
+    return (nFrameBytes/4)*3+3;
+}
+
+std::string EosAdimecPack::FormatName(const E_PIXEL_FORMAT eFormat)
+{
+    switch(eFormat)
+    {
+        case ePixel8:   return "8";
+        case ePixel10p: return "10p";
+        case ePixel12p: return "12p";
+        default:        return "16";
+    }
+}
+
+size_t EosAdimecPack::Pack(const uint16_t* pSrc, const int nWidth, const int nHeight,
+                           const int nStride, const E_PIXEL_FORMAT eFormat, uint8_t* pDst,
+                           const EosAdimecBayer::E_SIMD_LEVEL eLevel)
+{
+    const size_t nRowBytes=PackedRowBytes(nWidth,eFormat);
+    EosAdimecBayer::E_SIMD_LEVEL eUse=
+        (EosAdimecBayer::eSimdAuto==eLevel) ? EosAdimecBayer::GetBestSimdLevel() : eLevel;
+
+    if((ePixel16==eFormat) && (nStride==nWidth))
+    {
+        ::memcpy(pDst,pSrc,nRowBytes*nHeight);
+        return nRowBytes*nHeight;
+    }
+
+    for(int irow=0; irow<nHeight; irow++)
+    {
+        const uint16_t* pRow=pSrc+(size_t)irow*nStride;
+        uint8_t* pOut=pDst+irow*nRowBytes;
+
+        if(ePixel16==eFormat)
+        {
+            ::memcpy(pOut,pRow,nRowBytes);
+            continue;
+        }
+
+        int nDone=0;
+        if(EosAdimecBayer::eSimdAvx2==eUse)
+            nDone=PackRowAvx2(pRow,nWidth,eFormat,pOut);
+        else if(EosAdimecBayer::eSimdSse4==eUse)
+            nDone=PackRowSse4(pRow,nWidth,eFormat,pOut);
+        PackRowScalar(pRow,nDone,nWidth,eFormat,pOut);
+    }
+
+    return nRowBytes*nHeight;
+}
+
+size_t EosAdimecPack::Unpack(const uint8_t* pSrc, const int nWidth, const int nHeight,
+                             const E_PIXEL_FORMAT eFormat, uint16_t* pDst,
+                             const EosAdimecBayer::E_SIMD_LEVEL eLevel)
+{
+    const size_t nRowBytes=PackedRowBytes(nWidth,eFormat);
+    EosAdimecBayer::E_SIMD_LEVEL eUse=
+        (EosAdimecBayer::eSimdAuto==eLevel) ? EosAdimecBayer::GetBestSimdLevel() : eLevel;
+
+    if(ePixel16==eFormat)
+    {
+        ::memcpy(pDst,pSrc,nRowBytes*nHeight);
+        return nRowBytes*nHeight;
+    }
+
+    for(int irow=0; irow<nHeight; irow++)
+    {
+        const uint8_t* pRow=pSrc+irow*nRowBytes;
+        uint16_t* pOut=pDst+(size_t)irow*nWidth;
+
+        int nDone=0;
+        if(EosAdimecBayer::eSimdAvx2==eUse)
+            nDone=UnpackRowAvx2(pRow,nWidth,eFormat,pOut);
+        else if(EosAdimecBayer::eSimdSse4==eUse)
+            nDone=UnpackRowSse4(pRow,nWidth,eFormat,pOut);
+        UnpackRowScalar(pRow,nDone,nWidth,eFormat,pOut);
+    }
+
+    return nRowBytes*nHeight;
+}
+
+// nPixelBegin is a whole number of groups (4 for 10p, 2 for 12p), so it
+// starts on a byte.
+void EosAdimecPack::PackRowScalar(const uint16_t* pSrc, const int nPixelBegin, const int nWidth,
+                                  const E_PIXEL_FORMAT eFormat, uint8_t* pDst)
+{
+    const int nBits=FormatBits(eFormat);
+    const uint32_t nMask=(1u<<nBits)-1;
+    uint8_t* pOut=pDst+PackedRowBytes(nPixelBegin,eFormat);
+
+    uint64_t nAcc=0;
+    int nAccBits=0;
+    for(int ipx=nPixelBegin; ipx<nWidth; ipx++)
+    {
+        nAcc|=(uint64_t)(pSrc[ipx]&nMask)<<nAccBits;
+        nAccBits+=nBits;
+        while(nAccBits>=8)
+        {
+            *pOut++=(uint8_t)nAcc;
+            nAcc>>=8;
+            nAccBits-=8;
+        }
+    }
+    if(nAccBits>0)
+        *pOut=(uint8_t)nAcc;
+
+    return;
+}
+
+void EosAdimecPack::UnpackRowScalar(const uint8_t* pSrc, const int nPixelBegin, const int nWidth,
+                                    const E_PIXEL_FORMAT eFormat, uint16_t* pDst)
+{
+    const int nBits=FormatBits(eFormat);
+    const uint32_t nMask=(1u<<nBits)-1;
+    const uint8_t* pIn=pSrc+PackedRowBytes(nPixelBegin,eFormat);
+
+    uint64_t nAcc=0;
+    int nAccBits=0;
+    for(int ipx=nPixelBegin; ipx<nWidth; ipx++)
+    {
+        while(nAccBits<nBits)
+        {
+            nAcc|=(uint64_t)(*pIn++)<<nAccBits;
+            nAccBits+=8;
+        }
+        pDst[ipx]=(uint16_t)(nAcc&nMask);
+        nAcc>>=nBits;
+        nAccBits-=nBits;
+    }
+
+    return;
+}
+
+#ifdef EOS_ADIMEC_PACK_X86
+
+// Pack: madd joins each pixel pair into one 32-bit lane (p0 | p1<<N);
+// 10p joins lane pairs again into 40 bits per 64-bit lane; a byte
+// shuffle then drops the empty bytes.  Stores are 16 bytes wide with
+// only 12 (12p) or 10 (10p) valid, so every step keeps 16 bytes of room
+// in the row; the next step or the scalar loop overwrites the rest.
+
+__attribute__((target("sse4.1")))
+int EosAdimecPack::PackRowSse4(const uint16_t* pSrc, const int nWidth,
+                               const E_PIXEL_FORMAT eFormat, uint8_t* pDst)
+{
+    const size_t nRowBytes=PackedRowBytes(nWidth,eFormat);
+    int ipx=0;
+
+    if(ePixel8==eFormat)
+    {
+        const __m128i vMask=_mm_set1_epi16(0x00ff);
+        for(; ipx+16<=nWidth; ipx+=16)
+        {
+            __m128i vLo=_mm_and_si128(_mm_loadu_si128((const __m128i*)(pSrc+ipx)),vMask);
+            __m128i vHi=_mm_and_si128(_mm_loadu_si128((const __m128i*)(pSrc+ipx+8)),vMask);
+            _mm_storeu_si128((__m128i*)(pDst+ipx),_mm_packus_epi16(vLo,vHi));
+        }
+    }
+    else if(ePixel12p==eFormat)
+    {
+        const __m128i vMask=_mm_set1_epi16(0x0fff);
+        const __m128i vJoin=_mm_set1_epi32(0x10000001);         // p0*1 + p1*4096
+        const __m128i vShuffle=_mm_setr_epi8(0,1,2,4,5,6,8,9,10,12,13,14,-1,-1,-1,-1);
+        for(; (ipx+8<=nWidth) && ((size_t)(ipx/2)*3+16<=nRowBytes); ipx+=8)
+        {
+            __m128i vPix=_mm_and_si128(_mm_loadu_si128((const __m128i*)(pSrc+ipx)),vMask);
+            __m128i vPairs=_mm_madd_epi16(vPix,vJoin);
+            _mm_storeu_si128((__m128i*)(pDst+(ipx/2)*3),_mm_shuffle_epi8(vPairs,vShuffle));
+        }
+    }
+    else if(ePixel10p==eFormat)
+    {
+        const __m128i vMask=_mm_set1_epi16(0x03ff);
+        const __m128i vJoin=_mm_set1_epi32(0x04000001);         // p0*1 + p1*1024
+        const __m128i vLowLane=_mm_set1_epi64x(0x00000000ffffffffll);
+        const __m128i vShuffle=_mm_setr_epi8(0,1,2,3,4,8,9,10,11,12,-1,-1,-1,-1,-1,-1);
+        for(; (ipx+8<=nWidth) && ((size_t)(ipx/4)*5+16<=nRowBytes); ipx+=8)
+        {
+            __m128i vPix=_mm_and_si128(_mm_loadu_si128((const __m128i*)(pSrc+ipx)),vMask);
+            __m128i vPairs=_mm_madd_epi16(vPix,vJoin);
+            __m128i vQuads=_mm_or_si128(_mm_and_si128(vPairs,vLowLane),
+                                        _mm_srli_epi64(_mm_andnot_si128(vLowLane,vPairs),12));
+            _mm_storeu_si128((__m128i*)(pDst+(ipx/4)*5),_mm_shuffle_epi8(vQuads,vShuffle));
+        }
+    }
+
+    return ipx;
+}
+
+__attribute__((target("avx2")))
+int EosAdimecPack::PackRowAvx2(const uint16_t* pSrc, const int nWidth,
+                               const E_PIXEL_FORMAT eFormat, uint8_t* pDst)
+{
+    const size_t nRowBytes=PackedRowBytes(nWidth,eFormat);
+    int ipx=0;
+
+    if(ePixel8==eFormat)
+    {
+        const __m256i vMask=_mm256_set1_epi16(0x00ff);
+        for(; ipx+32<=nWidth; ipx+=32)
+        {
+            __m256i vLo=_mm256_and_si256(_mm256_loadu_si256((const __m256i*)(pSrc+ipx)),vMask);
+            __m256i vHi=_mm256_and_si256(_mm256_loadu_si256((const __m256i*)(pSrc+ipx+16)),vMask);
+            // packus works per 128-bit lane: put the quarters back in order.
+            __m256i vBytes=_mm256_permute4x64_epi64(_mm256_packus_epi16(vLo,vHi),0xd8);
+            _mm256_storeu_si256((__m256i*)(pDst+ipx),vBytes);
+        }
+    }
+    else if(ePixel12p==eFormat)
+    {
+        // 16 pixels: 12 bytes per 128-bit lane
+        const __m256i vMask=_mm256_set1_epi16(0x0fff);
+        const __m256i vJoin=_mm256_set1_epi32(0x10000001);
+        const __m256i vShuffle=_mm256_setr_epi8(0,1,2,4,5,6,8,9,10,12,13,14,-1,-1,-1,-1,
+                                                0,1,2,4,5,6,8,9,10,12,13,14,-1,-1,-1,-1);
+        for(; (ipx+16<=nWidth) && ((size_t)(ipx/2)*3+28<=nRowBytes); ipx+=16)
+        {
+            __m256i vPix=_mm256_and_si256(_mm256_loadu_si256((const __m256i*)(pSrc+ipx)),vMask);
+            __m256i vBytes=_mm256_shuffle_epi8(_mm256_madd_epi16(vPix,vJoin),vShuffle);
+            uint8_t* pOut=pDst+(ipx/2)*3;
+            _mm_storeu_si128((__m128i*)pOut,_mm256_castsi256_si128(vBytes));
+            _mm_storeu_si128((__m128i*)(pOut+12),_mm256_extracti128_si256(vBytes,1));
+        }
+    }
+    else if(ePixel10p==eFormat)
+    {
+        // 16 pixels: 10 bytes per 128-bit lane
+        const __m256i vMask=_mm256_set1_epi16(0x03ff);
+        const __m256i vJoin=_mm256_set1_epi32(0x04000001);
+        const __m256i vLowLane=_mm256_set1_epi64x(0x00000000ffffffffll);
+        const __m256i vShuffle=_mm256_setr_epi8(0,1,2,3,4,8,9,10,11,12,-1,-1,-1,-1,-1,-1,
+                                                0,1,2,3,4,8,9,10,11,12,-1,-1,-1,-1,-1,-1);
+        for(; (ipx+16<=nWidth) && ((size_t)(ipx/4)*5+26<=nRowBytes); ipx+=16)
+        {
+            __m256i vPix=_mm256_and_si256(_mm256_loadu_si256((const __m256i*)(pSrc+ipx)),vMask);
+            __m256i vPairs=_mm256_madd_epi16(vPix,vJoin);
+            __m256i vQuads=_mm256_or_si256(_mm256_and_si256(vPairs,vLowLane),
+                                           _mm256_srli_epi64(_mm256_andnot_si256(vLowLane,vPairs),12));
+            __m256i vBytes=_mm256_shuffle_epi8(vQuads,vShuffle);
+            uint8_t* pOut=pDst+(ipx/4)*5;
+            _mm_storeu_si128((__m128i*)pOut,_mm256_castsi256_si128(vBytes));
+            _mm_storeu_si128((__m128i*)(pOut+10),_mm256_extracti128_si256(vBytes,1));
+        }
+    }
+
+    return ipx;
+}
+
+// Unpack: a byte shuffle puts the two bytes holding each pixel in its
+// 16-bit lane; then 12p masks even pixels and shifts odd ones by 4, and
+// 10p shifts each pixel (offset 0/2/4/6 in its lane) up to bit 6 with a
+// multiply and back down by 6.  Loads are 16 bytes wide, so every step
+// keeps 16 bytes of room in the row.
+
+__attribute__((target("sse4.1")))
+int EosAdimecPack::UnpackRowSse4(const uint8_t* pSrc, const int nWidth,
+                                 const E_PIXEL_FORMAT eFormat, uint16_t* pDst)
+{
+    const size_t nRowBytes=PackedRowBytes(nWidth,eFormat);
+    int ipx=0;
+
+    if(ePixel8==eFormat)
+    {
+        for(; ipx+8<=nWidth; ipx+=8)
+        {
+            __m128i vBytes=_mm_loadl_epi64((const __m128i*)(pSrc+ipx));
+            _mm_storeu_si128((__m128i*)(pDst+ipx),_mm_cvtepu8_epi16(vBytes));
+        }
+    }
+    else if(ePixel12p==eFormat)
+    {
+        const __m128i vMask=_mm_set1_epi16(0x0fff);
+        const __m128i vShuffle=_mm_setr_epi8(0,1,1,2,3,4,4,5,6,7,7,8,9,10,10,11);
+        for(; (ipx+8<=nWidth) && ((size_t)(ipx/2)*3+16<=nRowBytes); ipx+=8)
+        {
+            __m128i vWords=_mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(pSrc+(ipx/2)*3)),
+                                            vShuffle);
+            __m128i vEven=_mm_and_si128(vWords,vMask);
+            __m128i vOdd=_mm_srli_epi16(vWords,4);
+            _mm_storeu_si128((__m128i*)(pDst+ipx),_mm_blend_epi16(vEven,vOdd,0xaa));
+        }
+    }
+    else if(ePixel10p==eFormat)
+    {
+        const __m128i vShuffle=_mm_setr_epi8(0,1,1,2,2,3,3,4,5,6,6,7,7,8,8,9);
+        const __m128i vAlign=_mm_setr_epi16(64,16,4,1,64,16,4,1);
+        for(; (ipx+8<=nWidth) && ((size_t)(ipx/4)*5+16<=nRowBytes); ipx+=8)
+        {
+            __m128i vWords=_mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(pSrc+(ipx/4)*5)),
+                                            vShuffle);
+            __m128i vPix=_mm_srli_epi16(_mm_mullo_epi16(vWords,vAlign),6);
+            _mm_storeu_si128((__m128i*)(pDst+ipx),vPix);
+        }
+    }
+
+    return ipx;
+}
+
+__attribute__((target("avx2")))
+int EosAdimecPack::UnpackRowAvx2(const uint8_t* pSrc, const int nWidth,
+                                 const E_PIXEL_FORMAT eFormat, uint16_t* pDst)
+{
+    const size_t nRowBytes=PackedRowBytes(nWidth,eFormat);
+    int ipx=0;
+
+    if(ePixel8==eFormat)
+    {
+        for(; ipx+16<=nWidth; ipx+=16)
+        {
+            __m128i vBytes=_mm_loadu_si128((const __m128i*)(pSrc+ipx));
+            _mm256_storeu_si256((__m256i*)(pDst+ipx),_mm256_cvtepu8_epi16(vBytes));
+        }
+    }
+    else if(ePixel12p==eFormat)
+    {
+        // 16 pixels: 12 bytes into each 128-bit lane
+        const __m256i vMask=_mm256_set1_epi16(0x0fff);
+        const __m256i vShuffle=_mm256_setr_epi8(0,1,1,2,3,4,4,5,6,7,7,8,9,10,10,11,
+                                                0,1,1,2,3,4,4,5,6,7,7,8,9,10,10,11);
+        for(; (ipx+16<=nWidth) && ((size_t)(ipx/2)*3+28<=nRowBytes); ipx+=16)
+        {
+            const uint8_t* pIn=pSrc+(ipx/2)*3;
+            __m256i vBytes=_mm256_inserti128_si256(
+                _mm256_castsi128_si256(_mm_loadu_si128((const __m128i*)pIn)),
+                _mm_loadu_si128((const __m128i*)(pIn+12)),1);
+            __m256i vWords=_mm256_shuffle_epi8(vBytes,vShuffle);
+            __m256i vEven=_mm256_and_si256(vWords,vMask);
+            __m256i vOdd=_mm256_srli_epi16(vWords,4);
+            _mm256_storeu_si256((__m256i*)(pDst+ipx),_mm256_blend_epi16(vEven,vOdd,0xaa));
+        }
+    }
+    else if(ePixel10p==eFormat)
+    {
+        // 16 pixels: 10 bytes into each 128-bit lane
+        const __m256i vShuffle=_mm256_setr_epi8(0,1,1,2,2,3,3,4,5,6,6,7,7,8,8,9,
+                                                0,1,1,2,2,3,3,4,5,6,6,7,7,8,8,9);
+        const __m256i vAlign=_mm256_setr_epi16(64,16,4,1,64,16,4,1,64,16,4,1,64,16,4,1);
+        for(; (ipx+16<=nWidth) && ((size_t)(ipx/4)*5+26<=nRowBytes); ipx+=16)
+        {
+            const uint8_t* pIn=pSrc+(ipx/4)*5;
+            __m256i vBytes=_mm256_inserti128_si256(
+                _mm256_castsi128_si256(_mm_loadu_si128((const __m128i*)pIn)),
+                _mm_loadu_si128((const __m128i*)(pIn+10)),1);
+            __m256i vWords=_mm256_shuffle_epi8(vBytes,vShuffle);
+            __m256i vPix=_mm256_srli_epi16(_mm256_mullo_epi16(vWords,vAlign),6);
+            _mm256_storeu_si256((__m256i*)(pDst+ipx),vPix);
+        }
+    }
+
+    return ipx;
+}
+
+#else
+
+int EosAdimecPack::PackRowSse4(const uint16_t* pSrc, const int nWidth,
+                               const E_PIXEL_FORMAT eFormat, uint8_t* pDst)
+{
+    return 0;
+}
+
+int EosAdimecPack::PackRowAvx2(const uint16_t* pSrc, const int nWidth,
+                               const E_PIXEL_FORMAT eFormat, uint8_t* pDst)
+{
+    return 0;
+}
+
+int EosAdimecPack::UnpackRowSse4(const uint8_t* pSrc, const int nWidth,
+                                 const E_PIXEL_FORMAT eFormat, uint16_t* pDst)
+{
+    return 0;
+}
+
+int EosAdimecPack::UnpackRowAvx2(const uint8_t* pSrc, const int nWidth,
+                                 const E_PIXEL_FORMAT eFormat, uint16_t* pDst)
+{
+    return 0;
+}
+
+#endif
@@ -0,0 +1,287 @@
+/**
+ * Per-frame processing graph.  See EosAdimecPipeline.h
+ */
+
+#include <string.h>
+#include <time.h>
+
+#include <boost/algorithm/string.hpp>
+#include <boost/thread/locks.hpp>
+
+#include "EosAdimecPipeline.h"
+#include "EosAdimecUtil.h"
+
+// Weight of the newest frame in the smoothed rate and time
+static const double PIPELINE_SMOOTHING=0.1;
+
+static const char* const PIPELINE_INPUT_CAPTURE="capture";
+
+EosAdimecPipeline::EosAdimecPipeline(const Graph& graph)
+{
+    for(int istage=0; istage<NUM_STAGES; istage++)
+    {
+        int nInput=(istage<(int)graph.size()) ? graph[istage] : NOT_IN_GRAPH;
+        m_aStages[istage].nInput=nInput;
+        if(INPUT_CAPTURE==nInput)
+            m_vnCaptureChildren.push_back(istage);
+        else if(nInput>=0)
+            m_aStages[nInput].vnChildren.push_back(istage);
+    }
+
+    ::memset(m_abAttached,0,sizeof(m_abAttached));
+    ::memset(m_anFrames,0,sizeof(m_anFrames));
+    ::memset(m_anLastNs,0,sizeof(m_anLastNs));
+    for(int istage=0; istage<NUM_STAGES; istage++)
+    {
+        m_adFps[istage]=0.0;
+        m_adMs[istage]=0.0;
+    }
+
+    return;
+}
+
+EosAdimecPipeline::~EosAdimecPipeline(void)
+{
+    return;
+}
+
+bool EosAdimecPipeline::HasStage(const E_STAGE eStage) const
+{
+    return (eStage>=0) && (eStage<NUM_STAGES) && (NOT_IN_GRAPH!=m_aStages[eStage].nInput);
+}
+
+bool EosAdimecPipeline::Attach(const E_STAGE eStage, EosAdimecCapture::FrameConsumer fnConsumer)
+{
+    if(!HasStage(eStage) || IsTransform(eStage))
+        return false;
+
+    {
+        boost::lock_guard<boost::mutex> lock(m_mtxStages);
+        m_aStages[eStage].fnConsumer=fnConsumer;
+    }
+    boost::lock_guard<boost::mutex> lock(m_mtxStats);
+    m_abAttached[eStage]=true;
+    return true;
+}
+
+bool EosAdimecPipeline::AttachFilter(const E_STAGE eStage, FrameFilter fnFilter)
+{
+    if(!HasStage(eStage) || !IsTransform(eStage))
+        return false;
+
+    {
+        boost::lock_guard<boost::mutex> lock(m_mtxStages);
+        m_aStages[eStage].fnFilter=fnFilter;
+    }
+    boost::lock_guard<boost::mutex> lock(m_mtxStats);
+    m_abAttached[eStage]=true;
+    return true;
+}
+
+void EosAdimecPipeline::Detach(const E_STAGE eStage)
+{
+    if(!HasStage(eStage))
+        return;
+
+    {
+        boost::lock_guard<boost::mutex> lock(m_mtxStages);
+        m_aStages[eStage].fnConsumer=EosAdimecCapture::FrameConsumer();
+        m_aStages[eStage].fnFilter=FrameFilter();
+    }
+    boost::lock_guard<boost::mutex> lock(m_mtxStats);
+    m_abAttached[eStage]=false;
+    return;
+}
+
+void EosAdimecPipeline::OnFrame(const EosAdimecRawFrame& frame)
+{
+    boost::lock_guard<boost::mutex> lock(m_mtxStages);
+    Deliver(INPUT_CAPTURE,frame);
+    return;
+}
+
+std::vector<EosAdimecPipeline::StageStats> EosAdimecPipeline::GetStats(void)
+{
+    std::vector<StageStats> vStats;
+
+    boost::lock_guard<boost::mutex> lock(m_mtxStats);
+    for(int istage=0; istage<NUM_STAGES; istage++)
+    {
+        if(NOT_IN_GRAPH==m_aStages[istage].nInput)
+            continue;
+
+        StageStats stats;
+        stats.eStage=(E_STAGE)istage;
+        stats.nInput=m_aStages[istage].nInput;
+        stats.bAttached=m_abAttached[istage];
+        stats.nFrames=m_anFrames[istage];
+        stats.dFps=m_adFps[istage];
+        stats.dMs=m_adMs[istage];
+        vStats.push_back(stats);
+    }
+    return vStats;
+}
+
+bool EosAdimecPipeline::ParseGraph(const GraphSpec& spec, Graph& graph, std::string& strError)
+{
+    graph.assign(NUM_STAGES,NOT_IN_GRAPH);
+
+    for(auto & ixStage: spec)
+    {
+        E_STAGE eStage;
+        if(!StageFromString(ixStage.first,eStage))
+        {
+            strError="unknown stage "+ixStage.first;
+            return false;
+        }
+        graph[eStage]=INPUT_CAPTURE;
+    }
+
+    // Inputs, once every stage is known
+    for(auto & ixStage: spec)
+    {
+        E_STAGE eStage;
+        StageFromString(ixStage.first,eStage);
+
+        std::string strInput=boost::to_lower_copy(boost::trim_copy(ixStage.second));
+        if(strInput.empty())
+        {
+            bool bCorrected=(eStageCorrection!=eStage) && (NOT_IN_GRAPH!=graph[eStageCorrection]);
+            graph[eStage]=bCorrected ? (int)eStageCorrection : INPUT_CAPTURE;
+            continue;
+        }
+        if(strInput==PIPELINE_INPUT_CAPTURE)
+        {
+            graph[eStage]=INPUT_CAPTURE;
+            continue;
+        }
+
+        E_STAGE eInput;
+        if(!StageFromString(strInput,eInput))
+        {
+            strError=ixStage.first+": unknown input "+strInput;
+            return false;
+        }
+        if(spec.end()==spec.find(StageName(eInput)))
+        {
+            strError=ixStage.first+": input "+strInput+" is not in the stages";
+            return false;
+        }
+        if(!IsTransform(eInput))
+        {
+            strError=ixStage.first+": input "+strInput+" has no output frames";
+            return false;
+        }
+        graph[eStage]=eInput;
+    }
+
+    // Every chain of inputs must reach the capture node.
+    for(int istage=0; istage<NUM_STAGES; istage++)
+    {
+        int nNode=graph[istage];
+        for(int istep=0; (nNode>=0) && (istep<=NUM_STAGES); istep++)
+            nNode=graph[nNode];
+        if(nNode>=0)
+        {
+            strError=StageName((E_STAGE)istage)+": inputs form a cycle";
+            return false;
+        }
+    }
+
+    return true;
+}
+
+bool EosAdimecPipeline::IsTransform(const E_STAGE eStage)
+{
+    return eStageCorrection==eStage;
+}
+
+std::string EosAdimecPipeline::StageName(const E_STAGE eStage)
+{
+    switch(eStage)
+    {
+        case eStageCorrection:          return "correction";
+        case eStageVideoOutput:         return "video_output";
+        case eStageFrameRing:           return "frame_ring";
+        case eStageAutoExposure:        return "ae";
+        case eStageAutoWhiteBalance:    return "awb";
+        case eStageFrameStats:          return "frame_stats";
+        case eStageFocus:               return "focus";
+        case eStageArchive:             return "archive";
+        case eStageRecorder:            return "recorder";
+        case eStageSnapshot:            return "snapshot";
+        case eStagePreview:             return "preview";
+        default:                        return "";
+    }
+}
+
+bool EosAdimecPipeline::StageFromString(const std::string& strStage, E_STAGE& eStage)
+{
+    std::string strLower=boost::to_lower_copy(boost::trim_copy(strStage));
+    for(int istage=0; istage<NUM_STAGES; istage++)
+    {
+        if(strLower==StageName((E_STAGE)istage))
+        {
+            eStage=(E_STAGE)istage;
+            return true;
+        }
+    }
+    return false;
+}
+
+std::string EosAdimecPipeline::InputName(const int nInput)
+{
+    if(nInput>=0)
+        return StageName((E_STAGE)nInput);
+    return PIPELINE_INPUT_CAPTURE;
+}
+
+void EosAdimecPipeline::Deliver(const int nNode, const EosAdimecRawFrame& frame)
+{
+    const std::vector<int>& vnChildren=
+        (INPUT_CAPTURE==nNode) ? m_vnCaptureChildren : m_aStages[nNode].vnChildren;
+
+    for(auto & ichild: vnChildren)
+    {
+        Stage& stage=m_aStages[ichild];
+        if(IsTransform((E_STAGE)ichild))
+        {
+            // Its children get the transformed copy; detached, the frame as it is.
+            EosAdimecRawFrame out=frame;
+            if(stage.fnFilter)
+            {
+                uint64_t nStartNs=EosAdimecUtil::MonotonicNs();
+                stage.fnFilter(out);
+                Count((E_STAGE)ichild,nStartNs,EosAdimecUtil::MonotonicNs());
+            }
+            Deliver(ichild,out);
+        }
+        else if(stage.fnConsumer)
+        {
+            uint64_t nStartNs=EosAdimecUtil::MonotonicNs();
+            stage.fnConsumer(frame);
+            Count((E_STAGE)ichild,nStartNs,EosAdimecUtil::MonotonicNs());
+        }
+    }
+
+    return;
+}
+
+void EosAdimecPipeline::Count(const E_STAGE eStage, const uint64_t nStartNs, const uint64_t nEndNs)
+{
+    double dMs=(nEndNs-nStartNs)/1.0e6;
+
+    boost::lock_guard<boost::mutex> lock(m_mtxStats);
+    if(m_anLastNs[eStage] && (nStartNs>m_anLastNs[eStage]))
+    {
+        double dFps=1.0e9/(nStartNs-m_anLastNs[eStage]);
+        m_adFps[eStage]=(m_adFps[eStage]>0.0) ?
+            ((1.0-PIPELINE_SMOOTHING)*m_adFps[eStage]+PIPELINE_SMOOTHING*dFps) : dFps;
+    }
+    m_adMs[eStage]=(m_anFrames[eStage]>0) ?
+        ((1.0-PIPELINE_SMOOTHING)*m_adMs[eStage]+PIPELINE_SMOOTHING*dMs) : dMs;
+    m_anLastNs[eStage]=nStartNs;
+    m_anFrames[eStage]++;
+
+    return;
+}
@@ -0,0 +1,641 @@
+/**
+ * Downscaled previews.  See EosAdimecPreview.h
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include <algorithm>
+#include <iostream>
+#include <new>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define EOS_ADIMEC_PREVIEW_X86
+#endif
+
+#include <boost/thread/locks.hpp>
+#include <boost/algorithm/string.hpp>
+#include <boost/lexical_cast.hpp>
+
+#include "EosDevice.h"
+#include "EosAdimecPreview.h"
+
+static const double PREVIEW_MS_SMOOTHING=0.1;
+
+// One row of quads --> R, G, B.  Quad position 0/1 is the even/odd
+// column of the first row, 2/3 of the second; anPick is the position of
+// R, the two greens and B.  G is the rounded mean of the greens.
+static void BinRowScalar(const uint16_t* pRow0, const uint16_t* pRow1, const int anPick[4],
+                         const int nQuadBegin, const int nQuads, const uint32_t nMask,
+                         uint16_t* pR, uint16_t* pG, uint16_t* pB)
+{
+    for(int iquad=nQuadBegin; iquad<nQuads; iquad++)
+    {
+        uint32_t anQuad[4];
+        anQuad[0]=pRow0[2*iquad]&nMask;
+        anQuad[1]=pRow0[2*iquad+1]&nMask;
+        anQuad[2]=pRow1[2*iquad]&nMask;
+        anQuad[3]=pRow1[2*iquad+1]&nMask;
+        pR[iquad]=(uint16_t)anQuad[anPick[0]];
+        pG[iquad]=(uint16_t)((anQuad[anPick[1]]+anQuad[anPick[2]]+1)>>1);
+        pB[iquad]=(uint16_t)anQuad[anPick[3]];
+    }
+    return;
+}
+
+// One output row of a halved plane: mean of each pair across, then of
+// the two rows (rounded each time, as _mm_avg_epu16).
+static void HalveRowScalar(const uint16_t* pAbove, const uint16_t* pBelow, const int nColBegin,
+                           const int nWidth, uint16_t* pOut)
+{
+    for(int icol=nColBegin; icol<nWidth; icol++)
+    {
+        uint32_t nAbove=(pAbove[2*icol]+pAbove[2*icol+1]+1u)>>1;
+        uint32_t nBelow=(pBelow[2*icol]+pBelow[2*icol+1]+1u)>>1;
+        pOut[icol]=(uint16_t)((nAbove+nBelow+1)>>1);
+    }
+    return;
+}
+
+#ifdef EOS_ADIMEC_PREVIEW_X86
+
+// SSE4.1/AVX2: each returns the first quad/column it did not do; the
+// scalar loop finishes the row.  Even and odd columns come out of 32-bit
+// lanes (mask, or shift by 16) and are packed back to 16 bits.
+
+__attribute__((target("sse4.1")))
+static int BinRowSse4(const uint16_t* pRow0, const uint16_t* pRow1, const int anPick[4],
+                      const int nQuads, const uint32_t nMask,
+                      uint16_t* pR, uint16_t* pG, uint16_t* pB)
+{
+    const __m128i vMask=_mm_set1_epi32((int)nMask);
+
+    int iquad=0;
+    for(; iquad+8<=nQuads; iquad+=8)
+    {
+        __m128i v0Lo=_mm_loadu_si128((const __m128i*)(pRow0+2*iquad));
+        __m128i v0Hi=_mm_loadu_si128((const __m128i*)(pRow0+2*iquad+8));
+        __m128i v1Lo=_mm_loadu_si128((const __m128i*)(pRow1+2*iquad));
+        __m128i v1Hi=_mm_loadu_si128((const __m128i*)(pRow1+2*iquad+8));
+
+        __m128i avQuad[4];
+        avQuad[0]=_mm_packus_epi32(_mm_and_si128(v0Lo,vMask),_mm_and_si128(v0Hi,vMask));
+        avQuad[1]=_mm_packus_epi32(_mm_and_si128(_mm_srli_epi32(v0Lo,16),vMask),
+                                   _mm_and_si128(_mm_srli_epi32(v0Hi,16),vMask));
+        avQuad[2]=_mm_packus_epi32(_mm_and_si128(v1Lo,vMask),_mm_and_si128(v1Hi,vMask));
+        avQuad[3]=_mm_packus_epi32(_mm_and_si128(_mm_srli_epi32(v1Lo,16),vMask),
+                                   _mm_and_si128(_mm_srli_epi32(v1Hi,16),vMask));
+
+        _mm_storeu_si128((__m128i*)(pR+iquad),avQuad[anPick[0]]);
+        _mm_storeu_si128((__m128i*)(pG+iquad),_mm_avg_epu16(avQuad[anPick[1]],avQuad[anPick[2]]));
+        _mm_storeu_si128((__m128i*)(pB+iquad),avQuad[anPick[3]]);
+    }
+    return iquad;
+}
+
+__attribute__((target("sse4.1")))
+static int HalveRowSse4(const uint16_t* pAbove, const uint16_t* pBelow, const int nWidth,
+                        uint16_t* pOut)
+{
+    const __m128i vLow16=_mm_set1_epi32(0xffff);
+
+    int icol=0;
+    for(; icol+8<=nWidth; icol+=8)
+    {
+        __m128i vALo=_mm_loadu_si128((const __m128i*)(pAbove+2*icol));
+        __m128i vAHi=_mm_loadu_si128((const __m128i*)(pAbove+2*icol+8));
+        __m128i vBLo=_mm_loadu_si128((const __m128i*)(pBelow+2*icol));
+        __m128i vBHi=_mm_loadu_si128((const __m128i*)(pBelow+2*icol+8));
+
+        __m128i vAbove=_mm_avg_epu16(
+            _mm_packus_epi32(_mm_and_si128(vALo,vLow16),_mm_and_si128(vAHi,vLow16)),
+            _mm_packus_epi32(_mm_srli_epi32(vALo,16),_mm_srli_epi32(vAHi,16)));
+        __m128i vBelow=_mm_avg_epu16(
+            _mm_packus_epi32(_mm_and_si128(vBLo,vLow16),_mm_and_si128(vBHi,vLow16)),
+            _mm_packus_epi32(_mm_srli_epi32(vBLo,16),_mm_srli_epi32(vBHi,16)));
+        _mm_storeu_si128((__m128i*)(pOut+icol),_mm_avg_epu16(vAbove,vBelow));
+    }
+    return icol;
+}
+
+__attribute__((target("avx2")))
+static int BinRowAvx2(const uint16_t* pRow0, const uint16_t* pRow1, const int anPick[4],
+                      const int nQuads, const uint32_t nMask,
+                      uint16_t* pR, uint16_t* pG, uint16_t* pB)
+{
+    const __m256i vMask=_mm256_set1_epi32((int)nMask);
+
+    int iquad=0;
+    for(; iquad+16<=nQuads; iquad+=16)
+    {
+        __m256i v0Lo=_mm256_loadu_si256((const __m256i*)(pRow0+2*iquad));
+        __m256i v0Hi=_mm256_loadu_si256((const __m256i*)(pRow0+2*iquad+16));
+        __m256i v1Lo=_mm256_loadu_si256((const __m256i*)(pRow1+2*iquad));
+        __m256i v1Hi=_mm256_loadu_si256((const __m256i*)(pRow1+2*iquad+16));
+
+        // packus works per 128-bit lane: put the quads back in order.
+        __m256i avQuad[4];
+        avQuad[0]=_mm256_packus_epi32(_mm256_and_si256(v0Lo,vMask),_mm256_and_si256(v0Hi,vMask));
+        avQuad[1]=_mm256_packus_epi32(_mm256_and_si256(_mm256_srli_epi32(v0Lo,16),vMask),
+                                      _mm256_and_si256(_mm256_srli_epi32(v0Hi,16),vMask));
+        avQuad[2]=_mm256_packus_epi32(_mm256_and_si256(v1Lo,vMask),_mm256_and_si256(v1Hi,vMask));
+        avQuad[3]=_mm256_packus_epi32(_mm256_and_si256(_mm256_srli_epi32(v1Lo,16),vMask),
+                                      _mm256_and_si256(_mm256_srli_epi32(v1Hi,16),vMask));
+        for(int ipos=0; ipos<4; ipos++)
+            avQuad[ipos]=_mm256_permute4x64_epi64(avQuad[ipos],0xD8);
+
+        _mm256_storeu_si256((__m256i*)(pR+iquad),avQuad[anPick[0]]);
+        _mm256_storeu_si256((__m256i*)(pG+iquad),
+                            _mm256_avg_epu16(avQuad[anPick[1]],avQuad[anPick[2]]));
+        _mm256_storeu_si256((__m256i*)(pB+iquad),avQuad[anPick[3]]);
+    }
+    return iquad;
+}
+
+__attribute__((target("avx2")))
+static int HalveRowAvx2(const uint16_t* pAbove, const uint16_t* pBelow, const int nWidth,
+                        uint16_t* pOut)
+{
+    const __m256i vLow16=_mm256_set1_epi32(0xffff);
+
+    int icol=0;
+    for(; icol+16<=nWidth; icol+=16)
+    {
+        __m256i vALo=_mm256_loadu_si256((const __m256i*)(pAbove+2*icol));
+        __m256i vAHi=_mm256_loadu_si256((const __m256i*)(pAbove+2*icol+16));
+        __m256i vBLo=_mm256_loadu_si256((const __m256i*)(pBelow+2*icol));
+        __m256i vBHi=_mm256_loadu_si256((const __m256i*)(pBelow+2*icol+16));
+
+        __m256i vAbove=_mm256_avg_epu16(
+            _mm256_packus_epi32(_mm256_and_si256(vALo,vLow16),_mm256_and_si256(vAHi,vLow16)),
+            _mm256_packus_epi32(_mm256_srli_epi32(vALo,16),_mm256_srli_epi32(vAHi,16)));
+        __m256i vBelow=_mm256_avg_epu16(
+            _mm256_packus_epi32(_mm256_and_si256(vBLo,vLow16),_mm256_and_si256(vBHi,vLow16)),
+            _mm256_packus_epi32(_mm256_srli_epi32(vBLo,16),_mm256_srli_epi32(vBHi,16)));
+        __m256i vOut=_mm256_permute4x64_epi64(_mm256_avg_epu16(vAbove,vBelow),0xD8);
+        _mm256_storeu_si256((__m256i*)(pOut+icol),vOut);
+    }
+    return icol;
+}
+
+#else
+
+static int BinRowSse4(const uint16_t*, const uint16_t*, const int*, const int, const uint32_t,
+                      uint16_t*, uint16_t*, uint16_t*)
+{
+    return 0;
+}
+
+static int HalveRowSse4(const uint16_t*, const uint16_t*, const int, uint16_t*)
+{
+    return 0;
+}
+
+static int BinRowAvx2(const uint16_t*, const uint16_t*, const int*, const int, const uint32_t,
+                      uint16_t*, uint16_t*, uint16_t*)
+{
+    return 0;
+}
+
+static int HalveRowAvx2(const uint16_t*, const uint16_t*, const int, uint16_t*)
+{
+    return 0;
+}
+
+#endif // EOS_ADIMEC_PREVIEW_X86
+
+// Round up to a whole page
+static size_t PageRound(const size_t nBytes)
+{
+    size_t nPage=(size_t)::sysconf(_SC_PAGESIZE);
+    return ((nBytes+nPage-1)/nPage)*nPage;
+}
+
+// Scale 2, 4, 8 --> its place in the 1/2, 1/4, 1/8 chain
+static int ChainIndex(const int nScale)
+{
+    int nIndex=0;
+    while((2<<nIndex)<nScale)
+        nIndex++;
+    return nIndex;
+}
+
+// Round up to a cache line
+static size_t LineRound(const size_t nBytes)
+{
+    return (nBytes+63)&~(size_t)63;
+}
+
+EosAdimecPreview::EosAdimecPreview(const std::string& strShmName, const std::vector<int>& vnScales,
+                                   const int nDecimation, const EosAdimecYuv::E_YUV_FORMAT eFormat,
+                                   const EosAdimecYuv::WbGains& gains,
+                                   const EosAdimecBayer::E_SIMD_LEVEL eLevel)
+{
+    m_strShmName=strShmName;
+    m_vnScales=vnScales;
+    if(m_vnScales.empty() || (m_vnScales.size()>EosAdimecPreviewConst::MAX_LEVELS))
+        m_vnScales.assign(1,4);
+    m_eFormat=eFormat;
+    m_gains=gains;
+    m_eLevel=(EosAdimecBayer::eSimdAuto==eLevel) ? EosAdimecBayer::GetBestSimdLevel() : eLevel;
+    m_anDecimation=std::max(1,nDecimation);
+
+    m_nShmFd=-1;
+    m_nSegmentBytes=0;
+    m_pSegment=NULL;
+    m_pHeader=NULL;
+
+    m_pPool=NULL;
+    m_pPlanes=NULL;
+    m_nFramePixels=0;
+
+    m_nFrames=0;
+
+    ::memset(&m_stats,0,sizeof(m_stats));
+    m_stats.nDecimation=m_anDecimation;
+
+    return;
+}
+
+EosAdimecPreview::~EosAdimecPreview(void)
+{
+    Stop();
+    return;
+}
+
+int EosAdimecPreview::Start(const size_t nFrameBytes)
+{
+    if(m_pHeader)
+        return UNIX_OK_STATUS;
+
+    // Planes of 1/2, 1/4, ... down to the smallest level published
+    m_nFramePixels=nFrameBytes/sizeof(uint16_t);
+    size_t nPlaneValues=0;
+    for(int nScale=2; nScale<=m_vnScales.back(); nScale*=2)
+        nPlaneValues+=3*(m_nFramePixels/(nScale*nScale));
+
+    m_pPool=new EosAdimecFramePool("preview",nPlaneValues*sizeof(uint16_t),1);
+    if(UNIX_OK_STATUS!=m_pPool->Start())
+    {
+        delete m_pPool;
+        m_pPool=NULL;
+        return UNIX_ERROR_STATUS;
+    }
+    m_pPlanes=(uint16_t*)m_pPool->GetSlot(m_pPool->Acquire());
+
+    if(UNIX_OK_STATUS!=OpenSegment(m_nFramePixels))
+    {
+        Stop();
+        return UNIX_ERROR_STATUS;
+    }
+
+    m_nFrames=0;
+
+    return UNIX_OK_STATUS;
+}
+
+void EosAdimecPreview::Stop(void)
+{
+    CloseSegment();
+
+    if(m_pPool)
+    {
+        m_pPlanes=NULL;
+        delete m_pPool;
+        m_pPool=NULL;
+    }
+
+    return;
+}
+
+// Level slots, each sized for the largest frame.  @return segment bytes
+size_t EosAdimecPreview::LayoutLevels(const std::vector<int>& vnScales, const size_t nFramePixels,
+                                      EosAdimecPreviewLevel aLevels[])
+{
+    size_t nOffset=LineRound(sizeof(EosAdimecPreviewHeader));
+    for(size_t ilevel=0; ilevel<vnScales.size(); ilevel++)
+    {
+        const size_t nScale=vnScales[ilevel];
+        aLevels[ilevel].nScale=(uint32_t)nScale;
+        aLevels[ilevel].nPad=0;
+        aLevels[ilevel].nMaxBytes=(nFramePixels/(nScale*nScale))*3/2;
+        aLevels[ilevel].nDataOffset=LineRound(sizeof(EosAdimecPreviewFrame));
+        aLevels[ilevel].nSlotBytes=LineRound(aLevels[ilevel].nDataOffset+aLevels[ilevel].nMaxBytes);
+        aLevels[ilevel].nSlotOffset=nOffset;
+        nOffset+=SLOTS*aLevels[ilevel].nSlotBytes;
+    }
+    return PageRound(nOffset);
+}
+
+size_t EosAdimecPreview::ComputeSegmentBytes(const std::vector<int>& vnScales,
+                                             const size_t nFrameBytes)
+{
+    EosAdimecPreviewLevel aLevels[EosAdimecPreviewConst::MAX_LEVELS];
+    return LayoutLevels(vnScales,nFrameBytes/sizeof(uint16_t),aLevels);
+}
+
+int EosAdimecPreview::OpenSegment(const size_t nFramePixels)
+{
+    EosAdimecPreviewLevel aLevels[EosAdimecPreviewConst::MAX_LEVELS];
+    m_nSegmentBytes=LayoutLevels(m_vnScales,nFramePixels,aLevels);
+
+    // Left behind by a previous (crashed) controller: readers mapping it keep their copy.
+    ::shm_unlink(m_strShmName.c_str());
+    m_nShmFd=::shm_open(m_strShmName.c_str(),O_RDWR|O_CREAT|O_EXCL|O_CLOEXEC,0660);
+    if(m_nShmFd<0)
+    {
+        std::cerr<<__FUNCTION__<<"(): shm_open("<<m_strShmName<<") failed: "
+                 <<::strerror(errno)<<std::endl;
+        return UNIX_ERROR_STATUS;
+    }
+
+    void* pMap=MAP_FAILED;
+    if(0==::ftruncate(m_nShmFd,m_nSegmentBytes))
+        pMap=::mmap(NULL,m_nSegmentBytes,PROT_READ|PROT_WRITE,MAP_SHARED,m_nShmFd,0);
+    if(MAP_FAILED==pMap)
+    {
+        std::cerr<<__FUNCTION__<<"(): could not map "<<m_nSegmentBytes<<" bytes for "
+                 <<m_strShmName<<": "<<::strerror(errno)<<std::endl;
+        CloseSegment();
+        return UNIX_ERROR_STATUS;
+    }
+    m_pSegment=(uint8_t*)pMap;
+
+    m_pHeader=new(m_pSegment) EosAdimecPreviewHeader;
+    m_pHeader->nMagic=EosAdimecPreviewConst::MAGIC;
+    m_pHeader->nVersion=EosAdimecPreviewConst::VERSION;
+    m_pHeader->nLevels=(uint32_t)m_vnScales.size();
+    m_pHeader->nSlots=SLOTS;
+    m_pHeader->nPublisherPid=::getpid();
+    m_pHeader->nPad=0;
+    m_pHeader->nPublished=0;
+
+    for(size_t ilevel=0; ilevel<m_vnScales.size(); ilevel++)
+    {
+        m_pHeader->aLevels[ilevel]=aLevels[ilevel];
+        for(int islot=0; islot<SLOTS; islot++)
+        {
+            uint8_t* pSlot=m_pSegment+aLevels[ilevel].nSlotOffset+islot*aLevels[ilevel].nSlotBytes;
+            EosAdimecPreviewFrame* pFrame=new(pSlot) EosAdimecPreviewFrame;
+            pFrame->nStamp=0;
+        }
+    }
+
+    return UNIX_OK_STATUS;
+}
+
+void EosAdimecPreview::CloseSegment(void)
+{
+    if(m_pSegment)
+    {
+        ::munmap(m_pSegment,m_nSegmentBytes);
+        m_pSegment=NULL;
+        m_pHeader=NULL;
+    }
+
+    if(m_nShmFd>=0)
+    {
+        ::close(m_nShmFd);
+        m_nShmFd=-1;
+        ::shm_unlink(m_strShmName.c_str());
+    }
+
+    return;
+}
+
+void EosAdimecPreview::OnFrame(const EosAdimecRawFrame& frame)
+{
+    if(0!=(m_nFrames++%(unsigned long)m_anDecimation))
+        return;
+    if((NULL==m_pHeader) || (NULL==m_pPlanes))
+        return;
+
+    // Level sizes: 1/2 from the quads, each next one half of the last
+    const int nSmallest=m_vnScales.back();
+    int anWidth[EosAdimecPreviewConst::MAX_LEVELS];
+    int anHeight[EosAdimecPreviewConst::MAX_LEVELS];
+    int nLevels=0;
+    for(int nScale=2; nScale<=nSmallest; nScale*=2, nLevels++)
+    {
+        anWidth[nLevels]=((nLevels ? anWidth[nLevels-1] : frame.nWidth)/2)&~1;
+        anHeight[nLevels]=((nLevels ? anHeight[nLevels-1] : frame.nHeight)/2)&~1;
+    }
+
+    if((frame.nBitDepth<8) || (frame.nBitDepth>12) ||
+       ((size_t)frame.nWidth*frame.nHeight>m_nFramePixels) || (frame.nStride<frame.nWidth) ||
+       (anWidth[nLevels-1]<2) || (anHeight[nLevels-1]<2))
+    {
+        boost::lock_guard<boost::mutex> lock(m_mtxPreview);
+        m_stats.nSkipped++;
+        return;
+    }
+
+    struct timespec tsStart, tsEnd;
+    ::clock_gettime(CLOCK_MONOTONIC,&tsStart);
+
+    EosAdimecBayer::BayerImage raw;
+    raw.pData=frame.pData;
+    raw.nWidth=frame.nWidth;
+    raw.nHeight=frame.nHeight;
+    raw.nStride=frame.nStride;
+    raw.nBitDepth=frame.nBitDepth;
+    raw.bRedRowFirst=frame.bRedRowFirst;
+    raw.bGreenPixelFirst=frame.bGreenPixelFirst;
+
+    // All levels first: the conversion applies the gains to the planes in place.
+    EosAdimecBayer::RgbPlanes argb[EosAdimecPreviewConst::MAX_LEVELS];
+    uint16_t* pPlane=m_pPlanes;
+    for(int ilevel=0; ilevel<nLevels; ilevel++)
+    {
+        const size_t nValues=(size_t)anWidth[ilevel]*anHeight[ilevel];
+        argb[ilevel].pR=pPlane;
+        argb[ilevel].pG=pPlane+nValues;
+        argb[ilevel].pB=pPlane+2*nValues;
+        argb[ilevel].nStride=anWidth[ilevel];
+        argb[ilevel].nFirstRow=0;
+        pPlane+=3*nValues;
+
+        if(0==ilevel)
+            BinQuads(raw,anWidth[0],anHeight[0],argb[0],m_eLevel);
+        else
+            Halve(argb[ilevel-1],anWidth[ilevel],anHeight[ilevel],argb[ilevel],m_eLevel);
+    }
+
+    uint64_t nStamp=m_pHeader->nPublished.load(std::memory_order_relaxed)+1;
+    for(size_t ipub=0; ipub<m_vnScales.size(); ipub++)
+    {
+        const int ilevel=ChainIndex(m_vnScales[ipub]);
+        PublishLevel((int)ipub,nStamp,argb[ilevel],anWidth[ilevel],anHeight[ilevel],frame);
+    }
+    m_pHeader->nPublished.store(nStamp,std::memory_order_release);
+
+    ::clock_gettime(CLOCK_MONOTONIC,&tsEnd);
+    double dMs=(tsEnd.tv_sec-tsStart.tv_sec)*1000.0+(tsEnd.tv_nsec-tsStart.tv_nsec)/1.0e6;
+
+    boost::lock_guard<boost::mutex> lock(m_mtxPreview);
+    m_stats.dMs=m_stats.nPublished ?
+        ((1.0-PREVIEW_MS_SMOOTHING)*m_stats.dMs+PREVIEW_MS_SMOOTHING*dMs) : dMs;
+    m_stats.nPublished++;
+    for(size_t ipub=0; ipub<m_vnScales.size(); ipub++)
+    {
+        const int ilevel=ChainIndex(m_vnScales[ipub]);
+        m_stats.anWidth[ipub]=anWidth[ilevel];
+        m_stats.anHeight[ipub]=anHeight[ilevel];
+    }
+
+    return;
+}
+
+void EosAdimecPreview::PublishLevel(const int nLevel, const uint64_t nStamp,
+                                    EosAdimecBayer::RgbPlanes& rgb, const int nWidth,
+                                    const int nHeight, const EosAdimecRawFrame& frame)
+{
+    const EosAdimecPreviewLevel& level=m_pHeader->aLevels[nLevel];
+    uint8_t* pSlot=m_pSegment+level.nSlotOffset+((nStamp-1)%SLOTS)*level.nSlotBytes;
+    EosAdimecPreviewFrame& slot=*(EosAdimecPreviewFrame*)pSlot;
+
+    slot.nStamp.store(0,std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    slot.nSequence=frame.nSequence;
+    slot.nTimeNs=frame.nTimeNs;
+    slot.nWallSec=frame.tsWall.tv_sec;
+    slot.nWallNsec=frame.tsWall.tv_nsec;
+    slot.nSettingsVersion=frame.settings.nVersion;
+    slot.bSettingsChanging=frame.bSettingsChanging ? 1 : 0;
+    slot.nFormat=(uint8_t)m_eFormat;
+    slot.nBitDepth=(uint16_t)frame.nBitDepth;
+    slot.nWidth=nWidth;
+    slot.nHeight=nHeight;
+    slot.nBytes=EosAdimecYuv::GetFrameBytes(nWidth,nHeight);
+
+    EosAdimecYuv::YuvImage yuv;
+    EosAdimecYuv::SetPlanes(pSlot+level.nDataOffset,nWidth,nHeight,m_eFormat,yuv);
+    EosAdimecYuv::ConvertRgb(rgb,nWidth,frame.nBitDepth,0,nHeight,yuv,m_eFormat,m_gains,m_eLevel);
+
+    slot.nStamp.store(nStamp,std::memory_order_release);
+
+    return;
+}
+
+void EosAdimecPreview::SetDecimation(const int nDecimation)
+{
+    m_anDecimation=std::max(1,nDecimation);
+    return;
+}
+
+EosAdimecPreview::PreviewStats EosAdimecPreview::GetStats(void)
+{
+    boost::lock_guard<boost::mutex> lock(m_mtxPreview);
+    PreviewStats stats=m_stats;
+    stats.nDecimation=m_anDecimation;
+    return stats;
+}
+
+int EosAdimecPreview::BinQuads(const EosAdimecBayer::BayerImage& raw, const int nWidth,
+                               const int nHeight, EosAdimecBayer::RgbPlanes& rgb,
+                               const EosAdimecBayer::E_SIMD_LEVEL eLevel)
+{
+    if((raw.nBitDepth<8) || (raw.nBitDepth>15))
+        return -1;
+
+    const EosAdimecBayer::E_SIMD_LEVEL eUse=
+        (EosAdimecBayer::eSimdAuto==eLevel) ? EosAdimecBayer::GetBestSimdLevel() : eLevel;
+    const uint32_t nMask=(1u<<raw.nBitDepth)-1;
+
+    // Every quad starts on an even row, so R, B and the greens sit in
+    // the same places in all of them.
+    const int nRedRow=EosAdimecBayer::IsRedRow(raw,0) ? 0 : 1;
+    const int nRedCol=EosAdimecBayer::IsGreenFirstInRow(raw,nRedRow) ? 1 : 0;
+    const int nBlueCol=EosAdimecBayer::IsGreenFirstInRow(raw,1-nRedRow) ? 1 : 0;
+    int anPick[4];
+    anPick[0]=2*nRedRow+nRedCol;
+    anPick[3]=2*(1-nRedRow)+nBlueCol;
+    int nGreen=1;
+    for(int ipos=0; ipos<4; ipos++)
+    {
+        if((ipos!=anPick[0]) && (ipos!=anPick[3]))
+            anPick[nGreen++]=ipos;
+    }
+
+    for(int iqy=0; iqy<nHeight; iqy++)
+    {
+        const uint16_t* pRow0=raw.pData+(size_t)(2*iqy)*raw.nStride;
+        const uint16_t* pRow1=pRow0+raw.nStride;
+        uint16_t* pR=rgb.pR+(size_t)iqy*rgb.nStride;
+        uint16_t* pG=rgb.pG+(size_t)iqy*rgb.nStride;
+        uint16_t* pB=rgb.pB+(size_t)iqy*rgb.nStride;
+
+        int nDone=0;
+        if(EosAdimecBayer::eSimdAvx2==eUse)
+            nDone=BinRowAvx2(pRow0,pRow1,anPick,nWidth,nMask,pR,pG,pB);
+        else if(EosAdimecBayer::eSimdSse4==eUse)
+            nDone=BinRowSse4(pRow0,pRow1,anPick,nWidth,nMask,pR,pG,pB);
+        BinRowScalar(pRow0,pRow1,anPick,nDone,nWidth,nMask,pR,pG,pB);
+    }
+
+    return 0;
+}
+
+void EosAdimecPreview::Halve(const EosAdimecBayer::RgbPlanes& rgbIn, const int nWidth,
+                             const int nHeight, EosAdimecBayer::RgbPlanes& rgbOut,
+                             const EosAdimecBayer::E_SIMD_LEVEL eLevel)
+{
+    const EosAdimecBayer::E_SIMD_LEVEL eUse=
+        (EosAdimecBayer::eSimdAuto==eLevel) ? EosAdimecBayer::GetBestSimdLevel() : eLevel;
+    const uint16_t* apIn[3]={rgbIn.pR,rgbIn.pG,rgbIn.pB};
+    uint16_t* apOut[3]={rgbOut.pR,rgbOut.pG,rgbOut.pB};
+
+    for(int iplane=0; iplane<3; iplane++)
+    {
+        for(int irow=0; irow<nHeight; irow++)
+        {
+            const uint16_t* pAbove=apIn[iplane]+(size_t)(2*irow)*rgbIn.nStride;
+            const uint16_t* pBelow=pAbove+rgbIn.nStride;
+            uint16_t* pOut=apOut[iplane]+(size_t)irow*rgbOut.nStride;
+
+            int nDone=0;
+            if(EosAdimecBayer::eSimdAvx2==eUse)
+                nDone=HalveRowAvx2(pAbove,pBelow,nWidth,pOut);
+            else if(EosAdimecBayer::eSimdSse4==eUse)
+                nDone=HalveRowSse4(pAbove,pBelow,nWidth,pOut);
+            HalveRowScalar(pAbove,pBelow,nDone,nWidth,pOut);
+        }
+    }
+
+    return;
+}
+
+bool EosAdimecPreview::ScalesFromString(const std::string& strScales, std::vector<int>& vnScales)
+{
+    std::vector<std::string> vStrScales;
+    boost::split(vStrScales,strScales,boost::is_any_of(", "),boost::token_compress_on);
+
+    vnScales.clear();
+    for(auto & ixScale: vStrScales)
+    {
+        if(ixScale.empty())
+            continue;
+        int nScale=0;
+        try
+        {
+            nScale=boost::lexical_cast<int>(ixScale);
+        }
+        catch(...)
+        {
+            return false;
+        }
+        if((2!=nScale) && (4!=nScale) && (8!=nScale))
+            return false;
+        vnScales.push_back(nScale);
+    }
+
+    std::sort(vnScales.begin(),vnScales.end());
+    vnScales.erase(std::unique(vnScales.begin(),vnScales.end()),vnScales.end());
+    return !vnScales.empty();
+}
@@ -0,0 +1,474 @@
+/**
+ * Pre-trigger RAM recorder.  See EosAdimecRecorder.h
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include <algorithm>
+#include <iostream>
+
+#include <boost/bind.hpp>
+#include <boost/thread/locks.hpp>
+
+#include "EosDevice.h"
+#include "EosAdimecRecorder.h"
+#include "EosAdimecThreadPlacement.h"
+#include "EosAdimecPack.h"
+#include "EosAdimecUtil.h"
+
+// Saver nice level: a save writes the whole pre-trigger buffer, seconds of
+// frames, and must not starve the capture thread while it does.
+static const int RECORDER_SAVER_NICE=10;
+
+// Close a recording this long after the post-trigger window if no later
+// frame comes in to end it (capture stopped or stalled).
+static const int RECORDER_POST_GRACE_MS=1000;
+
+// Saver wakeup while no save is pending or the post-trigger frames are
+// still coming in (also bounds the RECORDER_POST_GRACE_MS check)
+static const int RECORDER_IDLE_WAIT_MS=200;
+
+EosAdimecRecorder::EosAdimecRecorder(DoneFn fnDone, const std::string& strDir,
+                                     const std::string& strPrefix, const int nSeconds,
+                                     const size_t nMaxBytes, const bool bPacked)
+{
+    m_fnDone=fnDone;
+    m_strDir=strDir;
+    m_strPrefix=strPrefix;
+    m_nSpanNs=(uint64_t)std::max(1,nSeconds)*1000000000ull;
+    m_nMaxBytes=nMaxBytes;
+    m_bPacked=bPacked;
+
+    m_nSlotBytes=0;
+    m_pPool=NULL;
+
+    m_pSaverThread=NULL;
+    m_abStop=false;
+
+    m_nSlotsUsed=0;
+    m_nRecorded=0;
+    m_nSkipped=0;
+    m_nTooBig=0;
+    m_nNextTriggerId=1;
+    m_bSaving=false;
+    ::memset(&m_save.header,0,sizeof(m_save.header));
+    m_save.nEndNs=0;
+    m_save.bPostDone=true;
+    m_nSaves=0;
+    m_nSaveErrors=0;
+
+    return;
+}
+
+EosAdimecRecorder::~EosAdimecRecorder(void)
+{
+    Stop();
+    return;
+}
+
+int EosAdimecRecorder::Start(const size_t nFrameBytes)
+{
+    if(m_pSaverThread)
+        return UNIX_OK_STATUS;
+
+    m_nSlotBytes=EosAdimecFramePool::SlotStride(nFrameBytes);
+    size_t nMaxSlots=m_nMaxBytes/m_nSlotBytes;
+    if(nMaxSlots<2)
+    {
+        std::cerr<<__FUNCTION__<<"(): "<<(m_nMaxBytes>>20)<<" MB does not hold two "
+                 <<(m_nSlotBytes>>10)<<" KB frames"<<std::endl;
+        return UNIX_ERROR_STATUS;
+    }
+
+    m_pPool=new EosAdimecFramePool("recorder",nFrameBytes,(int)nMaxSlots);
+    if(UNIX_OK_STATUS!=m_pPool->Start())
+    {
+        delete m_pPool;
+        m_pPool=NULL;
+        return UNIX_ERROR_STATUS;
+    }
+
+    {
+        boost::lock_guard<boost::mutex> lock(m_mtxRecorder);
+        m_vSlots.resize(nMaxSlots);
+        for(size_t islot=0; islot<nMaxSlots; islot++)
+        {
+            Slot& slot=m_vSlots[islot];
+            ::memset(&slot.meta,0,sizeof(slot.meta));
+            slot.pData=NULL;
+            slot.bValid=false;
+            slot.bHeld=false;
+        }
+        m_nSlotsUsed=0;
+    }
+
+    EosAdimecUtil::MakeDirs(m_strDir);
+
+    m_abStop=false;
+    m_pSaverThread=new boost::thread(boost::bind(&EosAdimecRecorder::SaverThread,this));
+
+    return UNIX_OK_STATUS;
+}
+
+// A save in progress is cut off at the post-trigger window, but what is
+// already held still goes to disk before the saver thread exits.
+void EosAdimecRecorder::Stop(void)
+{
+    {
+        boost::lock_guard<boost::mutex> lock(m_mtxRecorder);
+        m_abStop=true;
+        m_cvRecorder.notify_all();
+    }
+
+    if(m_pSaverThread)
+    {
+        m_pSaverThread->join();
+        delete m_pSaverThread;
+        m_pSaverThread=NULL;
+    }
+
+    {
+        boost::lock_guard<boost::mutex> lock(m_mtxRecorder);
+        m_vSlots.clear();
+        m_nSlotsUsed=0;
+    }
+
+    if(m_pPool)
+    {
+        delete m_pPool;
+        m_pPool=NULL;
+    }
+
+    return;
+}
+
+// Grow while the slots cover less than the span (or every used slot is
+// busy); otherwise reuse the oldest frame nobody holds.
+int EosAdimecRecorder::ClaimSlot(void)
+{
+    int nReuse=-1;
+    uint64_t nOldestNs=UINT64_MAX;
+    uint64_t nNewestNs=0;
+    uint64_t nReuseNs=UINT64_MAX;
+    for(int islot=0; islot<m_nSlotsUsed; islot++)
+    {
+        const Slot& slot=m_vSlots[islot];
+        if(!slot.bValid)
+            continue;
+        nOldestNs=std::min(nOldestNs,slot.meta.nTimeNs);
+        nNewestNs=std::max(nNewestNs,slot.meta.nTimeNs);
+        if(!slot.bHeld && (slot.meta.nTimeNs<nReuseNs))
+        {
+            nReuse=islot;
+            nReuseNs=slot.meta.nTimeNs;
+        }
+    }
+
+    bool bShort=(nNewestNs<nOldestNs) || ((nNewestNs-nOldestNs)<m_nSpanNs);
+    if((m_nSlotsUsed<(int)m_vSlots.size()) && (bShort || (nReuse<0)))
+    {
+        int nPoolSlot=m_pPool->Acquire();
+        if(nPoolSlot>=0)
+        {
+            m_vSlots[m_nSlotsUsed].pData=m_pPool->GetSlot(nPoolSlot);
+            return m_nSlotsUsed++;
+        }
+    }
+
+    return nReuse;
+}
+
+void EosAdimecRecorder::OnFrame(const EosAdimecRawFrame& frame)
+{
+    const EosAdimecPack::E_PIXEL_FORMAT eFormat=
+        m_bPacked ? EosAdimecPack::FormatForBitDepth(frame.nBitDepth) : EosAdimecPack::ePixel16;
+    size_t nDataBytes=EosAdimecPack::PackedFrameBytes(frame.nWidth,frame.nHeight,eFormat);
+
+    int nSlot=-1;
+    {
+        boost::lock_guard<boost::mutex> lock(m_mtxRecorder);
+        if(m_vSlots.empty())
+            return;
+        if(nDataBytes>m_nSlotBytes)
+        {
+            m_nTooBig++;
+            return;
+        }
+
+        nSlot=ClaimSlot();
+        if(nSlot<0)
+        {
+            m_nSkipped++;
+            if(m_bSaving && !m_save.bPostDone && (frame.nTimeNs<=m_save.nEndNs))
+                m_save.header.nDropped++;
+            return;
+        }
+        m_vSlots[nSlot].bValid=false;
+    }
+
+    // Outside the lock: the saver and queries don't wait on the copy.
+    Slot& slot=m_vSlots[nSlot];
+    EosAdimecPack::Pack(frame.pData,frame.nWidth,frame.nHeight,frame.nStride,eFormat,slot.pData);
+
+    EosAdimecFrameSource::FillMeta(frame,eFormat,nDataBytes,slot.meta);
+
+    boost::lock_guard<boost::mutex> lock(m_mtxRecorder);
+    slot.bValid=true;
+    m_nRecorded++;
+
+    if(m_bSaving && !m_save.bPostDone)
+    {
+        const EosAdimecRecordingHeader& header=m_save.header;
+        if(frame.nTimeNs>m_save.nEndNs)
+        {
+            m_save.bPostDone=true;
+            m_cvRecorder.notify_all();
+        }
+        else if(frame.nTimeNs+(uint64_t)header.nPreMs*1000000ull>=header.nTriggerTimeNs)
+        {
+            if(frame.nTimeNs<header.nTriggerTimeNs)
+                m_save.header.nPreFrames++;
+            slot.bHeld=true;
+            m_save.dqSlots.push_back(nSlot);
+            m_cvRecorder.notify_all();
+        }
+    }
+
+    return;
+}
+
+int EosAdimecRecorder::TriggerSave(const double dPreSec, const double dPostSec,
+                                   uint64_t& nTriggerId, std::string& strPath,
+                                   unsigned long& nPreFrames, std::string& strError)
+{
+    struct timespec tsWall;
+    ::clock_gettime(CLOCK_REALTIME,&tsWall);
+    uint64_t nNowNs=EosAdimecUtil::MonotonicNs();
+
+    boost::lock_guard<boost::mutex> lock(m_mtxRecorder);
+    if(m_vSlots.empty())
+    {
+        strError="not_started";
+        return UNIX_ERROR_STATUS;
+    }
+    if(m_bSaving)
+    {
+        strError="busy";
+        return UNIX_ERROR_STATUS;
+    }
+
+    uint32_t nPreMs=(uint32_t)std::max(0.0,dPreSec*1000.0);
+    uint32_t nPostMs=(uint32_t)std::max(0.0,dPostSec*1000.0);
+    uint64_t nStartNs=nNowNs-std::min(nNowNs,(uint64_t)nPreMs*(uint64_t)1000000);
+
+    std::vector<std::pair<uint64_t,int> > vPre;
+    for(int islot=0; islot<m_nSlotsUsed; islot++)
+    {
+        const Slot& slot=m_vSlots[islot];
+        if(slot.bValid && (slot.meta.nTimeNs>=nStartNs))
+            vPre.push_back(std::make_pair(slot.meta.nSequence,islot));
+    }
+    if(vPre.empty() && (0==nPostMs))
+    {
+        strError="no_frames";
+        return UNIX_ERROR_STATUS;
+    }
+    std::sort(vPre.begin(),vPre.end());
+
+    nTriggerId=m_nNextTriggerId++;
+
+    struct tm tmWall;
+    ::gmtime_r(&tsWall.tv_sec,&tmWall);
+    char cBuf[64];
+    ::strftime(cBuf,sizeof(cBuf),"%Y%m%d_%H%M%S",&tmWall);
+    strPath=m_strDir+"/"+m_strPrefix+"_"+cBuf+"_"+std::to_string(nTriggerId)+".eraw";
+
+    ::memset(&m_save.header,0,sizeof(m_save.header));
+    EosAdimecRecordingHeader& header=m_save.header;
+    header.nMagic=EosAdimecRecordingConst::MAGIC;
+    header.nVersion=EosAdimecRecordingConst::VERSION;
+    header.nHeaderBytes=sizeof(EosAdimecRecordingHeader);
+    header.nFrameMetaBytes=sizeof(EosAdimecFrameMeta);
+    header.nTriggerId=nTriggerId;
+    header.nTriggerTimeNs=nNowNs;
+    header.nTriggerWallSec=tsWall.tv_sec;
+    header.nTriggerWallNsec=tsWall.tv_nsec;
+    header.nPreMs=nPreMs;
+    header.nPostMs=nPostMs;
+    header.nPreFrames=vPre.size();
+
+    m_save.strPath=strPath;
+    m_save.nEndNs=nNowNs+(uint64_t)nPostMs*1000000ull;
+    m_save.bPostDone=(0==nPostMs);
+    m_save.dqSlots.clear();
+    for(auto & ipre: vPre)
+    {
+        m_vSlots[ipre.second].bHeld=true;
+        m_save.dqSlots.push_back(ipre.second);
+    }
+
+    nPreFrames=vPre.size();
+    m_bSaving=true;
+    m_cvRecorder.notify_all();
+
+    return UNIX_OK_STATUS;
+}
+
+EosAdimecRecorder::RecorderStats EosAdimecRecorder::GetStats(void)
+{
+    RecorderStats stats;
+    ::memset(&stats,0,sizeof(stats));
+
+    boost::lock_guard<boost::mutex> lock(m_mtxRecorder);
+    stats.nMaxSlots=(int)m_vSlots.size();
+    stats.nSlots=m_nSlotsUsed;
+    uint64_t nOldestNs=UINT64_MAX;
+    uint64_t nNewestNs=0;
+    for(int islot=0; islot<m_nSlotsUsed; islot++)
+    {
+        const Slot& slot=m_vSlots[islot];
+        if(slot.bHeld)
+            stats.nHeld++;
+        if(slot.bValid)
+        {
+            nOldestNs=std::min(nOldestNs,slot.meta.nTimeNs);
+            nNewestNs=std::max(nNewestNs,slot.meta.nTimeNs);
+        }
+    }
+    if(nNewestNs>=nOldestNs)
+        stats.dSpanSec=(nNewestNs-nOldestNs)/1.0e9;
+    stats.nBytes=(size_t)m_nSlotsUsed*m_nSlotBytes;
+    stats.nRecorded=m_nRecorded;
+    stats.nSkipped=m_nSkipped;
+    stats.nTooBig=m_nTooBig;
+    stats.bSaving=m_bSaving;
+    stats.nSaves=m_nSaves;
+    stats.nSaveErrors=m_nSaveErrors;
+
+    return stats;
+}
+
+void EosAdimecRecorder::SaverThread(void)
+{
+    // Per-thread on Linux: only the saver is niced.
+    EosAdimecThreadPlacement::ApplyBackground(RECORDER_SAVER_NICE);
+
+    boost::unique_lock<boost::mutex> lock(m_mtxRecorder);
+    while(!m_abStop || m_bSaving)
+    {
+        if(!m_bSaving)
+        {
+            m_cvRecorder.timed_wait(lock,boost::get_system_time()+
+                                    boost::posix_time::milliseconds(RECORDER_IDLE_WAIT_MS));
+            continue;
+        }
+
+        SaveResult result;
+        WriteSave(lock,result);
+        m_bSaving=false;
+        m_nSaves++;
+        if(!result.bOk)
+            m_nSaveErrors++;
+
+        if(m_fnDone)
+        {
+            lock.unlock();
+            m_fnDone(result);
+            lock.lock();
+        }
+    }
+    return;
+}
+
+void EosAdimecRecorder::WriteSave(boost::unique_lock<boost::mutex>& lock, SaveResult& result)
+{
+    result.nTriggerId=m_save.header.nTriggerId;
+    result.bOk=true;
+    result.strPath=m_save.strPath;
+    result.nFrames=0;
+    result.nPreFrames=0;
+    result.nDropped=0;
+    result.dWriteSec=0.0;
+
+    EosAdimecRecordingHeader header=m_save.header;
+    const std::string strPath=m_save.strPath;
+
+    lock.unlock();
+    int nFd=::open(strPath.c_str(),O_WRONLY|O_CREAT|O_EXCL|O_CLOEXEC,0640);
+    bool bOk=(nFd>=0) && EosAdimecUtil::WriteAll(nFd,&header,sizeof(header));
+    if(!bOk)
+        result.strError=std::string(nFd<0 ? "open: " : "write: ")+::strerror(errno);
+    lock.lock();
+
+    uint64_t nFrames=0;
+    while(bOk)
+    {
+        if(m_save.dqSlots.empty())
+        {
+            uint64_t nCloseNs=m_save.nEndNs+(uint64_t)RECORDER_POST_GRACE_MS*1000000ull;
+            if(m_save.bPostDone || m_abStop || (EosAdimecUtil::MonotonicNs()>=nCloseNs))
+                break;
+            m_cvRecorder.timed_wait(lock,boost::get_system_time()+
+                                    boost::posix_time::milliseconds(RECORDER_IDLE_WAIT_MS));
+            continue;
+        }
+
+        int nSlot=m_save.dqSlots.front();
+        m_save.dqSlots.pop_front();
+        Slot& slot=m_vSlots[nSlot];
+
+        // Held: the capture thread leaves the slot alone until we let go.
+        lock.unlock();
+        bOk=EosAdimecUtil::WriteAll(nFd,&slot.meta,sizeof(slot.meta)) &&
+            EosAdimecUtil::WriteAll(nFd,slot.pData,slot.meta.nDataBytes);
+        if(!bOk)
+            result.strError=std::string("write: ")+::strerror(errno);
+        lock.lock();
+
+        slot.bHeld=false;
+        if(bOk)
+            nFrames++;
+    }
+
+    // Done or failed: no more post-trigger frames, and nothing stays held.
+    m_save.bPostDone=true;
+    for(auto & islot: m_save.dqSlots)
+        m_vSlots[islot].bHeld=false;
+    m_save.dqSlots.clear();
+
+    header.nFrames=nFrames;
+    header.nPreFrames=std::min((uint64_t)m_save.header.nPreFrames,nFrames);
+    header.nDropped=m_save.header.nDropped;
+
+    lock.unlock();
+    if(nFd>=0)
+    {
+        if(bOk && (::pwrite(nFd,&header,sizeof(header),0)!=(ssize_t)sizeof(header)))
+        {
+            bOk=false;
+            result.strError=std::string("write: ")+::strerror(errno);
+        }
+        if(bOk && (0!=::fdatasync(nFd)))
+        {
+            bOk=false;
+            result.strError=std::string("fdatasync: ")+::strerror(errno);
+        }
+        // On disk now: don't let the recording crowd the page cache.
+        ::posix_fadvise(nFd,0,0,POSIX_FADV_DONTNEED);
+        ::close(nFd);
+    }
+    lock.lock();
+
+    result.bOk=bOk;
+    result.nFrames=nFrames;
+    result.nPreFrames=header.nPreFrames;
+    result.nDropped=header.nDropped;
+    result.dWriteSec=(EosAdimecUtil::MonotonicNs()-header.nTriggerTimeNs)/1.0e9;
+
+    return;
+}
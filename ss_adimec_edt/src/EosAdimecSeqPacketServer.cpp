@@ -0,0 +1,334 @@
+/**
+ * AF_UNIX SOCK_SEQPACKET transport for SCIP command/response traffic.
+ * See EosAdimecSeqPacketServer.h
+ */
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <poll.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+
+#include <iostream>
+#include <algorithm>
+
+#include <boost/thread/locks.hpp>
+
+#include "EosDevice.h"
+#include "EosAdimecSeqPacketServer.h"
+
+EosAdimecSeqPacketServer::EosAdimecSeqPacketServer(const std::string& strSocketPath,
+                                                   const int nMaxClients)
+{
+    m_strSocketPath=strSocketPath;
+    m_nMaxClients=nMaxClients;
+    m_nListenFd=-1;
+
+    return;
+}
+
+EosAdimecSeqPacketServer::~EosAdimecSeqPacketServer(void)
+{
+    Close();
+
+    return;
+}
+
+int EosAdimecSeqPacketServer::Open(void)
+{
+    if(m_nListenFd>=0)
+        return UNIX_OK_STATUS;
+
+    struct sockaddr_un addr;
+    ::memset(&addr,0,sizeof(addr));
+    addr.sun_family=AF_UNIX;
+    if(m_strSocketPath.size()>=sizeof(addr.sun_path))
+    {
+        std::cerr<<__FUNCTION__<<"(): socket path too long: "<<m_strSocketPath<<std::endl;
+        return UNIX_ERROR_STATUS;
+    }
+    ::strncpy(addr.sun_path,m_strSocketPath.c_str(),sizeof(addr.sun_path)-1);
+
+    m_nListenFd=::socket(AF_UNIX,SOCK_SEQPACKET|SOCK_CLOEXEC,0);
+    if(m_nListenFd<0)
+    {
+        std::cerr<<__FUNCTION__<<"(): socket() failed: "<<::strerror(errno)<<std::endl;
+        return UNIX_ERROR_STATUS;
+    }
+
+    // A previous (crashed) controller may have left the socket file behind.
+    ::unlink(m_strSocketPath.c_str());
+
+    if(::bind(m_nListenFd,(struct sockaddr*)&addr,sizeof(addr))<0)
+    {
+        std::cerr<<__FUNCTION__<<"(): bind("<<m_strSocketPath<<") failed: "
+                 <<::strerror(errno)<<std::endl;
+        ::close(m_nListenFd);
+        m_nListenFd=-1;
+        return UNIX_ERROR_STATUS;
+    }
+
+    if(::listen(m_nListenFd,m_nMaxClients)<0)
+    {
+        std::cerr<<__FUNCTION__<<"(): listen() failed: "<<::strerror(errno)<<std::endl;
+        Close();
+        return UNIX_ERROR_STATUS;
+    }
+
+    std::cout<<__FUNCTION__<<"(): SCIP seqpacket socket listening on "
+             <<m_strSocketPath<<std::endl;
+
+    return UNIX_OK_STATUS;
+}
+
+void EosAdimecSeqPacketServer::Close(void)
+{
+    boost::lock_guard<boost::mutex> lock(m_mtxClients);
+
+    for(auto & ifd: m_vnClientFds)
+        ::close(ifd);
+    m_vnClientFds.clear();
+
+    if(m_nListenFd>=0)
+    {
+        ::close(m_nListenFd);
+        m_nListenFd=-1;
+        ::unlink(m_strSocketPath.c_str());
+    }
+
+    return;
+}
+
+int EosAdimecSeqPacketServer::Poll(std::vector<EosAdimecSeqPacketMsg>& vMsgs,
+                                   const int nTimeoutMs)
+{
+    if(m_nListenFd<0)
+        return UNIX_ERROR_STATUS;
+
+    // Snapshot the client list -- don't hold the lock across poll().
+    std::vector<int> vnClientFds;
+    boost::function<bool (int)> fnCanRead;
+    {
+        boost::lock_guard<boost::mutex> lock(m_mtxClients);
+        vnClientFds=m_vnClientFds;
+        fnCanRead=m_fnCanRead;
+    }
+
+    std::vector<struct pollfd> vPollFds;
+    struct pollfd pfd;
+    pfd.fd=m_nListenFd;
+    pfd.events=POLLIN;
+    pfd.revents=0;
+    vPollFds.push_back(pfd);
+    for(auto & ifd: vnClientFds)
+    {
+        // A held client is only watched for hang-ups.
+        pfd.fd=ifd;
+        pfd.events=(fnCanRead && !fnCanRead(ifd)) ? 0 : POLLIN;
+        vPollFds.push_back(pfd);
+    }
+
+    int nReady=::poll(vPollFds.data(),vPollFds.size(),nTimeoutMs);
+    if(nReady<0)
+    {
+        if(EINTR==errno)
+            return 0;
+        return UNIX_ERROR_STATUS;
+    }
+    if(0==nReady)
+        return 0;
+
+    int nMsgs=0;
+    std::vector<char> vBuf(MAX_MSG_SIZE);
+    for(size_t ipfd=1; ipfd<vPollFds.size(); ipfd++)
+    {
+        if(0==vPollFds[ipfd].revents)
+            continue;
+
+        int nFd=vPollFds[ipfd].fd;
+        if(vPollFds[ipfd].revents & (POLLERR|POLLNVAL))
+        {
+            DropClient(nFd);
+            continue;
+        }
+        if(0==vPollFds[ipfd].events)
+        {
+            // Held: its commands stay queued, but a hung-up client goes.
+            if(vPollFds[ipfd].revents & POLLHUP)
+                DropClient(nFd);
+            continue;
+        }
+
+        struct iovec iov;
+        iov.iov_base=vBuf.data();
+        iov.iov_len=vBuf.size();
+        struct msghdr msg;
+        ::memset(&msg,0,sizeof(msg));
+        msg.msg_iov=&iov;
+        msg.msg_iovlen=1;
+
+        ssize_t nBytes=::recvmsg(nFd,&msg,MSG_DONTWAIT);
+        if(nBytes<0)
+        {
+            if((EAGAIN==errno)||(EINTR==errno))
+                continue;
+            DropClient(nFd);
+            continue;
+        }
+        if(0==nBytes)
+        {
+            // Orderly shutdown by the client
+            DropClient(nFd);
+            continue;
+        }
+        if(msg.msg_flags & MSG_TRUNC)
+        {
+            // Don't try to execute a truncated command.
+            std::cerr<<__FUNCTION__<<"(): discarding oversize client message (>"
+                     <<MAX_MSG_SIZE<<" bytes)"<<std::endl;
+            continue;
+        }
+
+        EosAdimecSeqPacketMsg seqMsg;
+        seqMsg.nClientFd=nFd;
+        seqMsg.strMsg.assign(vBuf.data(),nBytes);
+        vMsgs.push_back(seqMsg);
+        nMsgs++;
+    }
+
+    if(vPollFds[0].revents & POLLIN)
+        AcceptClient();
+
+    return nMsgs;
+}
+
+int EosAdimecSeqPacketServer::Send(const int nClientFd, const std::string& strMsg)
+{
+    boost::lock_guard<boost::mutex> lock(m_mtxClients);
+
+    // The client may have hung up since it sent the command.
+    if(std::find(m_vnClientFds.begin(),m_vnClientFds.end(),nClientFd)==m_vnClientFds.end())
+        return UNIX_ERROR_STATUS;
+
+    return SendOrEvict(nClientFd,strMsg);
+}
+
+int EosAdimecSeqPacketServer::Broadcast(const std::string& strMsg)
+{
+    boost::lock_guard<boost::mutex> lock(m_mtxClients);
+
+    int nSent=0;
+    for(auto & ifd: m_vnClientFds)
+    {
+        if(UNIX_OK_STATUS==SendOrEvict(ifd,strMsg))
+            nSent++;
+    }
+    return nSent;
+}
+
+size_t EosAdimecSeqPacketServer::GetNumClients(void)
+{
+    boost::lock_guard<boost::mutex> lock(m_mtxClients);
+    return m_vnClientFds.size();
+}
+
+std::vector<int> EosAdimecSeqPacketServer::GetClientFds(void)
+{
+    boost::lock_guard<boost::mutex> lock(m_mtxClients);
+    return m_vnClientFds;
+}
+
+void EosAdimecSeqPacketServer::SetClientCallbacks(boost::function<void (int)> fnAccepted,
+                                                  boost::function<void (int)> fnDropped)
+{
+    boost::lock_guard<boost::mutex> lock(m_mtxClients);
+    m_fnClientAccepted=fnAccepted;
+    m_fnClientDropped=fnDropped;
+    return;
+}
+
+void EosAdimecSeqPacketServer::SetReadFilter(boost::function<bool (int)> fnCanRead)
+{
+    boost::lock_guard<boost::mutex> lock(m_mtxClients);
+    m_fnCanRead=fnCanRead;
+    return;
+}
+
+// Called with m_mtxClients held.  Never blocks: a client whose socket
+// buffer is full has stopped reading, so it is shut down; Poll() then
+// sees the hang-up and drops it like any other.
+int EosAdimecSeqPacketServer::SendOrEvict(const int nClientFd, const std::string& strMsg)
+{
+    ssize_t nBytes;
+    do
+    {
+        nBytes=::send(nClientFd,strMsg.data(),strMsg.size(),MSG_DONTWAIT|MSG_NOSIGNAL);
+    } while((nBytes<0) && (EINTR==errno));
+
+    if(nBytes==(ssize_t)strMsg.size())
+        return UNIX_OK_STATUS;
+
+    if((nBytes<0) && ((EAGAIN==errno)||(EWOULDBLOCK==errno)))
+    {
+        std::cerr<<__FUNCTION__<<"(): SCIP socket client "<<nClientFd
+                 <<" is not reading, disconnecting it"<<std::endl;
+    }
+    ::shutdown(nClientFd,SHUT_RDWR);
+
+    return UNIX_ERROR_STATUS;
+}
+
+void EosAdimecSeqPacketServer::AcceptClient(void)
+{
+    // Non-blocking: neither a recv() nor a send() may ever wait on a client.
+    int nFd=::accept4(m_nListenFd,NULL,NULL,SOCK_NONBLOCK|SOCK_CLOEXEC);
+    if(nFd<0)
+        return;
+
+    boost::function<void (int)> fnAccepted;
+    {
+        boost::lock_guard<boost::mutex> lock(m_mtxClients);
+        if((int)m_vnClientFds.size()>=m_nMaxClients)
+        {
+            std::cerr<<__FUNCTION__<<"(): too many SCIP socket clients (max "
+                     <<m_nMaxClients<<"), rejecting connection"<<std::endl;
+            ::close(nFd);
+            return;
+        }
+        fnAccepted=m_fnClientAccepted;
+    }
+
+    // Not under m_mtxClients: the owner's locks come before it (its
+    // sends take m_mtxClients).  Only this thread accepts, so the client
+    // count cannot change meanwhile.
+    if(fnAccepted)
+        fnAccepted(nFd);
+
+    boost::lock_guard<boost::mutex> lock(m_mtxClients);
+    m_vnClientFds.push_back(nFd);
+
+    return;
+}
+
+void EosAdimecSeqPacketServer::DropClient(const int nClientFd)
+{
+    boost::function<void (int)> fnDropped;
+    {
+        boost::lock_guard<boost::mutex> lock(m_mtxClients);
+        std::vector<int>::iterator ifd=
+            std::find(m_vnClientFds.begin(),m_vnClientFds.end(),nClientFd);
+        if(ifd==m_vnClientFds.end())
+            return;
+        m_vnClientFds.erase(ifd);
+        fnDropped=m_fnClientDropped;
+    }
+
+    // Let the owner forget about this fd before it can be re-used: the
+    // callback runs unlocked (see AcceptClient()), the close after it.
+    if(fnDropped)
+        fnDropped(nClientFd);
+    ::close(nClientFd);
+
+    return;
+}
@@ -0,0 +1,177 @@
+/**
+ * Per-frame camera settings.  See EosAdimecSettingsTracker.h
+ */
+
+#include <string.h>
+#include <time.h>
+
+#include <algorithm>
+
+#include <boost/thread/locks.hpp>
+
+#include "EosAdimecSettingsTracker.h"
+
+EosAdimecSettingsTracker::EosAdimecSettingsTracker(const EosAdimecFrameSettings& initial,
+                                                   const uint64_t nTimeUnitNs,
+                                                   const uint64_t nMarginNs)
+{
+    m_nTimeUnitNs=nTimeUnitNs;
+    m_nMarginNs=nMarginNs;
+
+    Entry entry;
+    ::memset(&entry,0,sizeof(entry));
+    entry.settings=initial;
+    m_dqHistory.push_back(entry);
+
+    m_nPendingSendNs=0;
+    m_nPrevTagVersion=initial.nVersion;
+    m_nPrevFrameNs=0;
+    m_nFrameIntervalNs=0;
+
+    return;
+}
+
+EosAdimecSettingsTracker::~EosAdimecSettingsTracker(void)
+{
+    return;
+}
+
+// A SET written in several commands stays pending from the first.
+void EosAdimecSettingsTracker::BeginChange(const uint64_t nSendNs)
+{
+    boost::lock_guard<boost::mutex> lock(m_mtxHistory);
+    if((0==m_nPendingSendNs) || (nSendNs<m_nPendingSendNs))
+        m_nPendingSendNs=nSendNs;
+    return;
+}
+
+void EosAdimecSettingsTracker::Commit(const EosAdimecFrameSettings& settings,
+                                      const uint64_t nSendNs, const uint64_t nAckNs)
+{
+    boost::lock_guard<boost::mutex> lock(m_mtxHistory);
+
+    uint64_t nPendingNs=m_nPendingSendNs;
+    m_nPendingSendNs=0;
+
+    if(settings.nVersion<=m_dqHistory.back().settings.nVersion)
+        return;
+
+    Entry entry;
+    ::memset(&entry,0,sizeof(entry));
+    entry.settings=settings;
+    entry.nSendNs=(nPendingNs && (nPendingNs<nSendNs)) ? nPendingNs : nSendNs;
+    entry.nAckNs=std::max(nAckNs,nSendNs);
+    m_dqHistory.push_back(entry);
+
+    while(m_dqHistory.size()>MAX_HISTORY)
+        m_dqHistory.pop_front();
+
+    return;
+}
+
+void EosAdimecSettingsTracker::AbandonChange(void)
+{
+    boost::lock_guard<boost::mutex> lock(m_mtxHistory);
+    m_nPendingSendNs=0;
+    return;
+}
+
+void EosAdimecSettingsTracker::TagFrame(EosAdimecRawFrame& frame)
+{
+    boost::lock_guard<boost::mutex> lock(m_mtxHistory);
+
+    if((m_nPrevFrameNs>0) && (frame.nTimeNs>m_nPrevFrameNs))
+        m_nFrameIntervalNs=frame.nTimeNs-m_nPrevFrameNs;
+    m_nPrevFrameNs=frame.nTimeNs;
+
+    // Candidates: from the previous frame's version (versions never go
+    // back) to the last one sent before this frame was done.
+    size_t nFirst=0;
+    while((nFirst+1<m_dqHistory.size()) &&
+          (m_dqHistory[nFirst+1].settings.nVersion<=m_nPrevTagVersion))
+        nFirst++;
+
+    size_t nLast=nFirst;
+    uint64_t nSpanNs=GetSpanNs(m_dqHistory[nFirst].settings);
+    for(size_t ientry=nFirst+1; ientry<m_dqHistory.size(); ientry++)
+    {
+        if(m_dqHistory[ientry].nSendNs>=frame.nTimeNs)
+            break;
+        nLast=ientry;
+        nSpanNs=std::max(nSpanNs,GetSpanNs(m_dqHistory[ientry].settings));
+    }
+
+    // Earliest the exposure can have started, with the longest candidate.
+    uint64_t nStartNs=(frame.nTimeNs>nSpanNs+m_nMarginNs) ?
+        (frame.nTimeNs-nSpanNs-m_nMarginNs) : 0;
+
+    size_t nEffective=nFirst;
+    for(size_t ientry=nLast; ientry>nFirst; ientry--)
+    {
+        if(m_dqHistory[ientry].nAckNs<=nStartNs)
+        {
+            nEffective=ientry;
+            break;
+        }
+    }
+
+    frame.settings=m_dqHistory[nEffective].settings;
+    frame.bSettingsChanging=(nLast>nEffective) ||
+        (m_nPendingSendNs && (m_nPendingSendNs<frame.nTimeNs));
+    m_nPrevTagVersion=frame.settings.nVersion;
+
+    if(!frame.bSettingsChanging)
+    {
+        // Versions are cumulative: this is also the first frame of any
+        // earlier version no frame has shown on its own.
+        for(size_t ientry=nEffective+1; ientry-->0; )
+        {
+            Entry& entry=m_dqHistory[ientry];
+            if(entry.bSeen)
+                break;
+            entry.bSeen=true;
+            entry.first.nSequence=frame.nSequence;
+            entry.first.nTimeNs=frame.nTimeNs;
+            entry.first.tsWall=frame.tsWall;
+            entry.first.nAckNs=entry.nAckNs;
+        }
+    }
+
+    return;
+}
+
+EosAdimecSettingsTracker::E_FIRST_FRAME
+EosAdimecSettingsTracker::GetFirstFrame(const uint32_t nVersion, FirstFrameInfo& info)
+{
+    boost::lock_guard<boost::mutex> lock(m_mtxHistory);
+
+    for(auto & ientry: m_dqHistory)
+    {
+        if(ientry.settings.nVersion!=nVersion)
+            continue;
+        if(!ientry.bSeen)
+            return eFirstFramePending;
+        info=ientry.first;
+        return eFirstFrameFound;
+    }
+
+    return eFirstFrameUnknown;
+}
+
+uint32_t EosAdimecSettingsTracker::GetVersion(void)
+{
+    boost::lock_guard<boost::mutex> lock(m_mtxHistory);
+    return m_dqHistory.back().settings.nVersion;
+}
+
+// Unknown (-1) frame period: the measured frame interval.  Unknown
+// integration time: a whole frame period.
+uint64_t EosAdimecSettingsTracker::GetSpanNs(const EosAdimecFrameSettings& settings)
+{
+    uint64_t nPeriodNs=(settings.nFramePeriod>0) ?
+        ((uint64_t)settings.nFramePeriod*m_nTimeUnitNs) : m_nFrameIntervalNs;
+    uint64_t nItNs=(settings.nIntegrationTime>0) ?
+        ((uint64_t)settings.nIntegrationTime*m_nTimeUnitNs) : nPeriodNs;
+
+    return nPeriodNs+nItNs;
+}
@@ -0,0 +1,526 @@
+/**
+ * Single still frames on demand.  See EosAdimecSnapshot.h
+ */
+
+#include <errno.h>
+#include <setjmp.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include <algorithm>
+#include <iostream>
+
+#include <boost/bind.hpp>
+#include <boost/algorithm/string.hpp>
+#include <boost/thread/locks.hpp>
+
+#include <png.h>
+#include <jpeglib.h>
+
+#include "EosDevice.h"
+#include "EosAdimecSnapshot.h"
+#include "EosAdimecThreadPlacement.h"
+#include "EosAdimecUtil.h"
+
+// libjpeg calls error_exit() on any error and expects it not to return.
+struct SnapshotJpegError
+{
+    struct jpeg_error_mgr mgr;
+    jmp_buf jmpBuf;
+};
+
+static void SnapshotJpegErrorExit(j_common_ptr pInfo)
+{
+    (*pInfo->err->output_message)(pInfo);
+    ::longjmp(((SnapshotJpegError*)pInfo->err)->jmpBuf,1);
+}
+
+EosAdimecSnapshot::EosAdimecSnapshot(DoneFn fnDone, const std::string& strDir,
+                                     const std::string& strPrefix,
+                                     const EosAdimecBayer::E_DEMOSAIC_METHOD eMethod,
+                                     const int nJpegQuality, const int nPngLevel,
+                                     const int nKeep, const int nTimeoutMs)
+{
+    m_fnDone=fnDone;
+    m_strDir=strDir;
+    m_strPrefix=strPrefix;
+    m_eMethod=eMethod;
+    m_nJpegQuality=std::min(std::max(nJpegQuality,1),100);
+    m_nPngLevel=std::min(std::max(nPngLevel,0),9);
+    m_nKeep=std::max(nKeep,1);
+    m_nTimeoutMs=std::max(nTimeoutMs,1);
+
+    m_pEncoderThread=NULL;
+    m_abStop=false;
+
+    m_pPool=NULL;
+    m_pFrame=NULL;
+    m_nFrameBytes=0;
+
+    m_nPrevFrameNs=0;
+    m_nFrameIntervalNs=0;
+
+    m_aeState=eStateIdle;
+    m_nNextId=1;
+    m_nArmNs=0;
+    ::memset(&m_frame,0,sizeof(m_frame));
+    ::memset(&m_stats,0,sizeof(m_stats));
+
+    return;
+}
+
+EosAdimecSnapshot::~EosAdimecSnapshot(void)
+{
+    Stop();
+    return;
+}
+
+int EosAdimecSnapshot::Start(const size_t nFrameBytes)
+{
+    if(m_pEncoderThread)
+        return UNIX_OK_STATUS;
+
+    EosAdimecUtil::MakeDirs(m_strDir);
+
+    m_pPool=new EosAdimecFramePool("snapshot",nFrameBytes,1);
+    if(UNIX_OK_STATUS!=m_pPool->Start())
+    {
+        delete m_pPool;
+        m_pPool=NULL;
+        return UNIX_ERROR_STATUS;
+    }
+    m_pFrame=(uint16_t*)m_pPool->GetSlot(m_pPool->Acquire());
+    m_nFrameBytes=m_pPool->GetSlotBytes();
+
+    m_abStop=false;
+    m_pEncoderThread=new boost::thread(boost::bind(&EosAdimecSnapshot::EncoderThread,this));
+
+    return UNIX_OK_STATUS;
+}
+
+void EosAdimecSnapshot::Stop(void)
+{
+    {
+        boost::lock_guard<boost::mutex> lock(m_mtxSnapshot);
+        m_abStop=true;
+        m_cvSnapshot.notify_all();
+    }
+
+    if(m_pEncoderThread)
+    {
+        m_pEncoderThread->join();
+        delete m_pEncoderThread;
+        m_pEncoderThread=NULL;
+    }
+
+    m_aeState=eStateIdle;
+    if(m_pPool)
+    {
+        m_pFrame=NULL;
+        delete m_pPool;
+        m_pPool=NULL;
+    }
+
+    return;
+}
+
+void EosAdimecSnapshot::OnFrame(const EosAdimecRawFrame& frame)
+{
+    uint64_t nPrevNs=m_nPrevFrameNs;
+    m_nPrevFrameNs=frame.nTimeNs;
+    if(nPrevNs && (frame.nTimeNs>nPrevNs))
+        m_nFrameIntervalNs=frame.nTimeNs-nPrevNs;
+
+    // The common case: nobody is waiting.
+    if(eStateArmed!=m_aeState)
+        return;
+
+    boost::lock_guard<boost::mutex> lock(m_mtxSnapshot);
+    if((eStateArmed!=m_aeState) || (NULL==m_pFrame))
+        return;
+
+    // Free running, a frame done less than a frame interval after the
+    // request was already exposing when it came in.
+    uint64_t nEarliestNs=m_nArmNs+(m_request.bTriggered ? 0 : m_nFrameIntervalNs);
+    if((frame.nTimeNs<=nEarliestNs) || frame.bOverrun || frame.bSettingsChanging)
+    {
+        m_stats.nSkipped++;
+        return;
+    }
+
+    m_request.nSequence=frame.nSequence;
+    m_request.tsWall=frame.tsWall;
+    m_request.dWaitMs=(frame.nTimeNs-m_nArmNs)/1.0e6;
+
+    size_t nRowBytes=(size_t)frame.nWidth*sizeof(uint16_t);
+    if((frame.nWidth<4) || (frame.nHeight<4) || (nRowBytes*frame.nHeight>m_nFrameBytes))
+    {
+        m_request.strError="bad frame size";
+    }
+    else
+    {
+        // Only the rows, packed: the encoder reads it with stride = width.
+        for(int irow=0; irow<frame.nHeight; irow++)
+        {
+            ::memcpy(m_pFrame+(size_t)irow*frame.nWidth,frame.pData+(size_t)irow*frame.nStride,
+                     nRowBytes);
+        }
+        m_frame=frame;
+        m_frame.pData=m_pFrame;
+        m_frame.nStride=frame.nWidth;
+    }
+
+    m_aeState=eStateEncoding;
+    m_cvSnapshot.notify_all();
+
+    return;
+}
+
+int EosAdimecSnapshot::Request(const E_FORMAT eFormat, const bool bTriggered, uint64_t& nId,
+                               std::string& strError)
+{
+    boost::lock_guard<boost::mutex> lock(m_mtxSnapshot);
+    if(NULL==m_pEncoderThread)
+    {
+        strError="not started";
+        return UNIX_ERROR_STATUS;
+    }
+    if(eStateIdle!=m_aeState)
+    {
+        strError="snapshot in progress";
+        return UNIX_ERROR_STATUS;
+    }
+
+    nId=m_nNextId++;
+    m_request.nId=nId;
+    m_request.bOk=false;
+    m_request.strPath.clear();
+    m_request.strError.clear();
+    m_request.eFormat=eFormat;
+    m_request.bTriggered=bTriggered;
+    m_request.nSequence=0;
+    m_request.tsWall.tv_sec=0;
+    m_request.tsWall.tv_nsec=0;
+    m_request.dWaitMs=0.0;
+    m_request.dEncodeMs=0.0;
+    m_nArmNs=EosAdimecUtil::MonotonicNs();
+
+    m_aeState=eStateArmed;
+    m_cvSnapshot.notify_all();
+
+    return UNIX_OK_STATUS;
+}
+
+EosAdimecSnapshot::SnapshotStats EosAdimecSnapshot::GetStats(void)
+{
+    boost::lock_guard<boost::mutex> lock(m_mtxSnapshot);
+    SnapshotStats stats=m_stats;
+    stats.bBusy=(eStateIdle!=m_aeState);
+    return stats;
+}
+
+bool EosAdimecSnapshot::FormatFromString(const std::string& strFormat, E_FORMAT& eFormat)
+{
+    std::string strLower=boost::to_lower_copy(boost::trim_copy(strFormat));
+    if(strLower=="png")
+        eFormat=eFormatPng;
+    else if((strLower=="jpeg") || (strLower=="jpg"))
+        eFormat=eFormatJpeg;
+    else
+        return false;
+    return true;
+}
+
+std::string EosAdimecSnapshot::FormatName(const E_FORMAT eFormat)
+{
+    return (eFormatJpeg==eFormat) ? "jpeg" : "png";
+}
+
+void EosAdimecSnapshot::EncoderThread(void)
+{
+    EosAdimecThreadPlacement::Apply(EosAdimecThreadPlacement::eRoleProcessing);
+
+    boost::unique_lock<boost::mutex> lock(m_mtxSnapshot);
+    while(!m_abStop)
+    {
+        if(eStateIdle==m_aeState)
+        {
+            m_cvSnapshot.wait(lock);
+            continue;
+        }
+
+        if(eStateArmed==m_aeState)
+        {
+            uint64_t nDeadlineNs=m_nArmNs+(uint64_t)m_nTimeoutMs*1000000ull;
+            uint64_t nNowNs=EosAdimecUtil::MonotonicNs();
+            if(nNowNs<nDeadlineNs)
+            {
+                m_cvSnapshot.timed_wait(lock,boost::get_system_time()+
+                    boost::posix_time::microseconds((nDeadlineNs-nNowNs+999)/1000));
+                continue;
+            }
+            m_request.strError="no frame in time";
+            m_aeState=eStateEncoding;           // OnFrame() leaves it alone now
+        }
+
+        // Encoding, or timed out
+        SnapshotResult result=m_request;
+        if(result.strError.empty())
+        {
+            lock.unlock();
+
+            uint64_t nStartNs=EosAdimecUtil::MonotonicNs();
+            char cName[64];
+            ::snprintf(cName,sizeof(cName)-1,"_snap_%llu.%s",(unsigned long long)result.nSequence,
+                       (eFormatJpeg==result.eFormat) ? "jpg" : "png");
+            result.strPath=m_strDir+"/"+m_strPrefix+cName;
+            std::string strTmpPath=result.strPath+".tmp";
+
+            result.bOk=(eFormatJpeg==result.eFormat) ? WriteJpeg(strTmpPath,result.strError) :
+                                                       WritePng(strTmpPath,result.strError);
+            if(result.bOk && (0!=::rename(strTmpPath.c_str(),result.strPath.c_str())))
+            {
+                result.strError="rename: "+std::string(::strerror(errno));
+                result.bOk=false;
+            }
+            if(result.bOk)
+                Prune(result.strPath);
+            else
+                ::unlink(strTmpPath.c_str());
+            result.dEncodeMs=(EosAdimecUtil::MonotonicNs()-nStartNs)/1.0e6;
+
+            lock.lock();
+        }
+
+        if(result.bOk)
+        {
+            m_stats.nTaken++;
+            m_stats.dEncodeMs=result.dEncodeMs;
+        }
+        else
+        {
+            m_stats.nFailed++;
+        }
+
+        // Idle only once the outcome is out, so replies stay in order.
+        if(m_fnDone)
+        {
+            lock.unlock();
+            m_fnDone(result);
+            lock.lock();
+        }
+        m_aeState=eStateIdle;
+    }
+
+    return;
+}
+
+int EosAdimecSnapshot::DemosaicBand(const EosAdimecBayer::BayerImage& raw, const int nRowBegin,
+                                    const int nRowEnd)
+{
+    size_t nPlane=(size_t)BAND_ROWS*raw.nWidth;
+    if(m_vBand.size()<3*nPlane)
+        m_vBand.resize(3*nPlane);
+
+    EosAdimecBayer::RgbPlanes rgb;
+    rgb.pR=&m_vBand[0];
+    rgb.pG=&m_vBand[nPlane];
+    rgb.pB=&m_vBand[2*nPlane];
+    rgb.nStride=raw.nWidth;
+    rgb.nFirstRow=nRowBegin;
+    return EosAdimecBayer::DemosaicRows(raw,rgb,m_eMethod,nRowBegin,nRowEnd);
+}
+
+// libpng errors longjmp() back to the setjmp(): nothing with a destructor
+// may be live between the two.
+bool EosAdimecSnapshot::WritePng(const std::string& strPath, std::string& strError)
+{
+    FILE* pFile=::fopen(strPath.c_str(),"wb");
+    if(NULL==pFile)
+    {
+        strError="open: "+std::string(::strerror(errno));
+        return false;
+    }
+
+    png_structp pPng=::png_create_write_struct(PNG_LIBPNG_VER_STRING,NULL,NULL,NULL);
+    png_infop pInfo=pPng ? ::png_create_info_struct(pPng) : NULL;
+    if(NULL==pInfo)
+    {
+        ::png_destroy_write_struct(&pPng,NULL);
+        ::fclose(pFile);
+        strError="png: no memory";
+        return false;
+    }
+
+    EosAdimecBayer::BayerImage raw;
+    raw.pData=m_frame.pData;
+    raw.nWidth=m_frame.nWidth;
+    raw.nHeight=m_frame.nHeight;
+    raw.nStride=m_frame.nStride;
+    raw.nBitDepth=m_frame.nBitDepth;
+    raw.bRedRowFirst=m_frame.bRedRowFirst;
+    raw.bGreenPixelFirst=m_frame.bGreenPixelFirst;
+    m_vRow.resize((size_t)raw.nWidth*6);
+
+    if(setjmp(png_jmpbuf(pPng)))
+    {
+        ::png_destroy_write_struct(&pPng,&pInfo);
+        ::fclose(pFile);
+        strError="png encoder failed";
+        return false;
+    }
+
+    ::png_init_io(pPng,pFile);
+    ::png_set_compression_level(pPng,m_nPngLevel);
+    ::png_set_filter(pPng,0,PNG_FILTER_SUB);
+    ::png_set_IHDR(pPng,pInfo,raw.nWidth,raw.nHeight,16,PNG_COLOR_TYPE_RGB,PNG_INTERLACE_NONE,
+                   PNG_COMPRESSION_TYPE_DEFAULT,PNG_FILTER_TYPE_DEFAULT);
+    png_color_8 sigBits;
+    ::memset(&sigBits,0,sizeof(sigBits));
+    sigBits.red=raw.nBitDepth;
+    sigBits.green=raw.nBitDepth;
+    sigBits.blue=raw.nBitDepth;
+    ::png_set_sBIT(pPng,pInfo,&sigBits);
+    ::png_write_info(pPng,pInfo);
+
+    // To 16 bits with the top bits repeated below, so full scale is 65535.
+    const int nShift=16-raw.nBitDepth;
+    const int nFill=std::max(raw.nBitDepth-nShift,0);
+    for(int iband=0; iband<raw.nHeight; iband+=BAND_ROWS)
+    {
+        int nBandEnd=std::min(iband+BAND_ROWS,raw.nHeight);
+        if(0!=DemosaicBand(raw,iband,nBandEnd))
+        {
+            ::png_destroy_write_struct(&pPng,&pInfo);
+            ::fclose(pFile);
+            strError="demosaic failed";
+            return false;
+        }
+
+        size_t nPlane=(size_t)BAND_ROWS*raw.nWidth;
+        for(int irow=iband; irow<nBandEnd; irow++)
+        {
+            const uint16_t* pR=&m_vBand[(size_t)(irow-iband)*raw.nWidth];
+            const uint16_t* pG=pR+nPlane;
+            const uint16_t* pB=pG+nPlane;
+            uint8_t* pOut=&m_vRow[0];
+            for(int icol=0; icol<raw.nWidth; icol++)
+            {
+                uint16_t nR=(pR[icol]<<nShift)|(pR[icol]>>nFill);
+                uint16_t nG=(pG[icol]<<nShift)|(pG[icol]>>nFill);
+                uint16_t nB=(pB[icol]<<nShift)|(pB[icol]>>nFill);
+                pOut[0]=nR>>8;  pOut[1]=nR&0xff;        // PNG is big-endian
+                pOut[2]=nG>>8;  pOut[3]=nG&0xff;
+                pOut[4]=nB>>8;  pOut[5]=nB&0xff;
+                pOut+=6;
+            }
+            ::png_write_row(pPng,&m_vRow[0]);
+        }
+    }
+
+    ::png_write_end(pPng,pInfo);
+    ::png_destroy_write_struct(&pPng,&pInfo);
+    if(0!=::fclose(pFile))
+    {
+        strError="close: "+std::string(::strerror(errno));
+        return false;
+    }
+    return true;
+}
+
+// As WritePng(): jerr.jmpBuf is where libjpeg errors land.
+bool EosAdimecSnapshot::WriteJpeg(const std::string& strPath, std::string& strError)
+{
+    FILE* pFile=::fopen(strPath.c_str(),"wb");
+    if(NULL==pFile)
+    {
+        strError="open: "+std::string(::strerror(errno));
+        return false;
+    }
+
+    EosAdimecBayer::BayerImage raw;
+    raw.pData=m_frame.pData;
+    raw.nWidth=m_frame.nWidth;
+    raw.nHeight=m_frame.nHeight;
+    raw.nStride=m_frame.nStride;
+    raw.nBitDepth=m_frame.nBitDepth;
+    raw.bRedRowFirst=m_frame.bRedRowFirst;
+    raw.bGreenPixelFirst=m_frame.bGreenPixelFirst;
+    m_vRow.resize((size_t)raw.nWidth*3);
+
+    struct jpeg_compress_struct cinfo;
+    SnapshotJpegError jerr;
+    cinfo.err=::jpeg_std_error(&jerr.mgr);
+    jerr.mgr.error_exit=SnapshotJpegErrorExit;
+    if(setjmp(jerr.jmpBuf))
+    {
+        ::jpeg_destroy_compress(&cinfo);
+        ::fclose(pFile);
+        strError="jpeg encoder failed";
+        return false;
+    }
+
+    ::jpeg_create_compress(&cinfo);
+    ::jpeg_stdio_dest(&cinfo,pFile);
+    cinfo.image_width=raw.nWidth;
+    cinfo.image_height=raw.nHeight;
+    cinfo.input_components=3;
+    cinfo.in_color_space=JCS_RGB;
+    ::jpeg_set_defaults(&cinfo);
+    ::jpeg_set_quality(&cinfo,m_nJpegQuality,TRUE);
+    ::jpeg_start_compress(&cinfo,TRUE);
+
+    const int nShift=std::max(raw.nBitDepth-8,0);
+    for(int iband=0; iband<raw.nHeight; iband+=BAND_ROWS)
+    {
+        int nBandEnd=std::min(iband+BAND_ROWS,raw.nHeight);
+        if(0!=DemosaicBand(raw,iband,nBandEnd))
+        {
+            ::jpeg_destroy_compress(&cinfo);
+            ::fclose(pFile);
+            strError="demosaic failed";
+            return false;
+        }
+
+        size_t nPlane=(size_t)BAND_ROWS*raw.nWidth;
+        for(int irow=iband; irow<nBandEnd; irow++)
+        {
+            const uint16_t* pR=&m_vBand[(size_t)(irow-iband)*raw.nWidth];
+            const uint16_t* pG=pR+nPlane;
+            const uint16_t* pB=pG+nPlane;
+            uint8_t* pOut=&m_vRow[0];
+            for(int icol=0; icol<raw.nWidth; icol++)
+            {
+                pOut[0]=pR[icol]>>nShift;
+                pOut[1]=pG[icol]>>nShift;
+                pOut[2]=pB[icol]>>nShift;
+                pOut+=3;
+            }
+            JSAMPROW pRow=&m_vRow[0];
+            ::jpeg_write_scanlines(&cinfo,&pRow,1);
+        }
+    }
+
+    ::jpeg_finish_compress(&cinfo);
+    ::jpeg_destroy_compress(&cinfo);
+    if(0!=::fclose(pFile))
+    {
+        strError="close: "+std::string(::strerror(errno));
+        return false;
+    }
+    return true;
+}
+
+void EosAdimecSnapshot::Prune(const std::string& strPath)
+{
+    m_dqFiles.push_back(strPath);
+    while((int)m_dqFiles.size()>m_nKeep)
+    {
+        ::unlink(m_dqFiles.front().c_str());
+        m_dqFiles.pop_front();
+    }
+    return;
+}
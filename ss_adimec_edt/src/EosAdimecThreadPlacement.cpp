@@ -0,0 +1,267 @@
+/**
+ * CPU affinity and scheduling policy per thread role.  See EosAdimecThreadPlacement.h
+ */
+
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+
+#include <iostream>
+
+#include <boost/algorithm/string.hpp>
+#include <boost/thread/locks.hpp>
+
+#include "EosAdimecThreadPlacement.h"
+
+static const int PLACEMENT_MIN_NICE=-20;
+static const int PLACEMENT_MAX_NICE=19;
+static const int PLACEMENT_MIN_FIFO=1;
+static const int PLACEMENT_MAX_FIFO=99;
+
+boost::mutex EosAdimecThreadPlacement::s_mtxPlacement;
+bool EosAdimecThreadPlacement::s_bConfigured=false;
+std::vector<int> EosAdimecThreadPlacement::s_vnProcessCpus;
+EosAdimecThreadPlacement::Placement EosAdimecThreadPlacement::s_aPlacements[NUM_ROLES];
+EosAdimecThreadPlacement::Effective EosAdimecThreadPlacement::s_aEffective[NUM_ROLES];
+
+static pid_t GetTid(void)
+{
+    return (pid_t)::syscall(SYS_gettid);
+}
+
+static void CpusToSet(const std::vector<int>& vnCpus, cpu_set_t& cpuSet)
+{
+    CPU_ZERO(&cpuSet);
+    for(auto & icpu: vnCpus)
+    {
+        if((icpu>=0) && (icpu<CPU_SETSIZE))
+            CPU_SET(icpu,&cpuSet);
+    }
+    return;
+}
+
+// {0,1,2,3,6} --> "0-3+6" (no commas: it goes in a STATS[] value)
+static std::string FormatCpus(const cpu_set_t& cpuSet)
+{
+    std::string strCpus;
+    for(int icpu=0; icpu<CPU_SETSIZE; icpu++)
+    {
+        if(!CPU_ISSET(icpu,&cpuSet))
+            continue;
+        int nLast=icpu;
+        while((nLast+1<CPU_SETSIZE) && CPU_ISSET(nLast+1,&cpuSet))
+            nLast++;
+
+        if(!strCpus.empty())
+            strCpus+="+";
+        strCpus+=std::to_string(icpu);
+        if(nLast>icpu)
+            strCpus+="-"+std::to_string(nLast);
+        icpu=nLast;
+    }
+    return strCpus;
+}
+
+void EosAdimecThreadPlacement::Configure(const E_ROLE eRole, const Placement& placement)
+{
+    if((eRole<0) || (eRole>=NUM_ROLES))
+        return;
+
+    boost::lock_guard<boost::mutex> lock(s_mtxPlacement);
+    if(!s_bConfigured)
+    {
+        // Before any thread is placed: what the process was started with
+        cpu_set_t cpuSet;
+        CPU_ZERO(&cpuSet);
+        s_vnProcessCpus.clear();
+        if(0==::sched_getaffinity(0,sizeof(cpuSet),&cpuSet))
+        {
+            for(int icpu=0; icpu<CPU_SETSIZE; icpu++)
+            {
+                if(CPU_ISSET(icpu,&cpuSet))
+                    s_vnProcessCpus.push_back(icpu);
+            }
+        }
+        for(int irole=0; irole<NUM_ROLES; irole++)
+        {
+            s_aPlacements[irole].vnCpus.clear();
+            s_aPlacements[irole].ePolicy=ePolicyOther;
+            s_aPlacements[irole].nPriority=0;
+        }
+        s_bConfigured=true;
+    }
+    s_aPlacements[eRole]=placement;
+    return;
+}
+
+bool EosAdimecThreadPlacement::Apply(const E_ROLE eRole)
+{
+    if((eRole<0) || (eRole>=NUM_ROLES))
+        return false;
+
+    Placement placement;
+    std::vector<int> vnProcessCpus;
+    {
+        boost::lock_guard<boost::mutex> lock(s_mtxPlacement);
+        if(!s_bConfigured)
+            return true;
+        placement=s_aPlacements[eRole];
+        vnProcessCpus=s_vnProcessCpus;
+    }
+
+    std::string strError;
+
+    // Always set, so a thread does not keep its creator's CPUs.
+    cpu_set_t cpuSet;
+    CpusToSet(placement.vnCpus.empty() ? vnProcessCpus : placement.vnCpus,cpuSet);
+    int nErr=::pthread_setaffinity_np(::pthread_self(),sizeof(cpuSet),&cpuSet);
+    if(0!=nErr)
+        strError="affinity: "+std::string(::strerror(nErr));
+
+    struct sched_param param;
+    ::memset(&param,0,sizeof(param));
+    int nPolicy=SCHED_OTHER;
+    if(ePolicyFifo==placement.ePolicy)
+    {
+        nPolicy=SCHED_FIFO;
+        param.sched_priority=placement.nPriority;
+    }
+    nErr=::pthread_setschedparam(::pthread_self(),nPolicy,&param);
+    if(0!=nErr)
+        strError="policy: "+std::string(::strerror(nErr));
+
+    if(ePolicyOther==placement.ePolicy)
+    {
+        // Per-thread on Linux.  Left alone if it is already right:
+        // lowering nice takes privilege even back to where it was.
+        errno=0;
+        int nNice=::getpriority(PRIO_PROCESS,(id_t)GetTid());
+        if(((0!=errno) || (nNice!=placement.nPriority)) &&
+           (0!=::setpriority(PRIO_PROCESS,(id_t)GetTid(),placement.nPriority)))
+            strError="nice: "+std::string(::strerror(errno));
+    }
+
+    // What it really got
+    Effective effective;
+    effective.ePolicy=ePolicyOther;
+    effective.nPriority=0;
+    int nGotPolicy=SCHED_OTHER;
+    struct sched_param paramGot;
+    ::memset(&paramGot,0,sizeof(paramGot));
+    if(0==::pthread_getschedparam(::pthread_self(),&nGotPolicy,&paramGot))
+    {
+        if(SCHED_FIFO==nGotPolicy)
+        {
+            effective.ePolicy=ePolicyFifo;
+            effective.nPriority=paramGot.sched_priority;
+        }
+        else
+        {
+            errno=0;
+            int nNice=::getpriority(PRIO_PROCESS,(id_t)GetTid());
+            effective.nPriority=(0==errno) ? nNice : 0;
+        }
+    }
+    CPU_ZERO(&cpuSet);
+    ::pthread_getaffinity_np(::pthread_self(),sizeof(cpuSet),&cpuSet);
+    effective.strCpus=FormatCpus(cpuSet);
+
+    if(!strError.empty())
+    {
+        std::cerr<<__FUNCTION__<<"(): "<<RoleName(eRole)<<" thread "<<GetTid()<<": "<<strError
+                 <<std::endl;
+    }
+
+    boost::lock_guard<boost::mutex> lock(s_mtxPlacement);
+    Effective& stored=s_aEffective[eRole];
+    stored.nThreads++;
+    stored.ePolicy=effective.ePolicy;
+    stored.nPriority=effective.nPriority;
+    stored.strCpus=effective.strCpus;
+    if(!strError.empty())
+    {
+        stored.nFailed++;
+        stored.strError=strError;
+    }
+
+    return strError.empty();
+}
+
+void EosAdimecThreadPlacement::ApplyBackground(const int nNice)
+{
+    std::vector<int> vnProcessCpus;
+    bool bConfigured;
+    {
+        boost::lock_guard<boost::mutex> lock(s_mtxPlacement);
+        bConfigured=s_bConfigured;
+        vnProcessCpus=s_vnProcessCpus;
+    }
+
+    if(bConfigured)
+    {
+        struct sched_param param;
+        ::memset(&param,0,sizeof(param));
+        ::pthread_setschedparam(::pthread_self(),SCHED_OTHER,&param);
+
+        cpu_set_t cpuSet;
+        CpusToSet(vnProcessCpus,cpuSet);
+        ::pthread_setaffinity_np(::pthread_self(),sizeof(cpuSet),&cpuSet);
+    }
+
+    ::setpriority(PRIO_PROCESS,(id_t)GetTid(),nNice);
+    return;
+}
+
+EosAdimecThreadPlacement::Effective EosAdimecThreadPlacement::GetEffective(const E_ROLE eRole)
+{
+    Effective effective;
+    effective.nThreads=0;
+    effective.nFailed=0;
+    effective.ePolicy=ePolicyOther;
+    effective.nPriority=0;
+    if((eRole<0) || (eRole>=NUM_ROLES))
+        return effective;
+
+    boost::lock_guard<boost::mutex> lock(s_mtxPlacement);
+    return s_aEffective[eRole];
+}
+
+bool EosAdimecThreadPlacement::IsValidPriority(const E_POLICY ePolicy, const int nPriority)
+{
+    if(ePolicyFifo==ePolicy)
+        return (nPriority>=PLACEMENT_MIN_FIFO) && (nPriority<=PLACEMENT_MAX_FIFO);
+    return (nPriority>=PLACEMENT_MIN_NICE) && (nPriority<=PLACEMENT_MAX_NICE);
+}
+
+std::string EosAdimecThreadPlacement::RoleName(const E_ROLE eRole)
+{
+    switch(eRole)
+    {
+        case eRoleDispatch:     return "dispatch";
+        case eRoleSerial:       return "serial";
+        case eRoleCapture:      return "capture";
+        case eRoleProcessing:   return "processing";
+        default:                return "";
+    }
+}
+
+std::string EosAdimecThreadPlacement::PolicyName(const E_POLICY ePolicy)
+{
+    return (ePolicyFifo==ePolicy) ? "fifo" : "other";
+}
+
+bool EosAdimecThreadPlacement::PolicyFromString(const std::string& strPolicy, E_POLICY& ePolicy)
+{
+    std::string strLower=boost::to_lower_copy(boost::trim_copy(strPolicy));
+    if(strLower=="other")
+        ePolicy=ePolicyOther;
+    else if(strLower=="fifo")
+        ePolicy=ePolicyFifo;
+    else
+        return false;
+    return true;
+}
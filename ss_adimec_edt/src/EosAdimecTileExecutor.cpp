@@ -0,0 +1,424 @@
+/**
+ * Work-stealing tile executor.  See EosAdimecTileExecutor.h
+ */
+
+#include <pthread.h>
+#include <sched.h>
+#include <string.h>
+#include <time.h>
+
+#include <algorithm>
+#include <iostream>
+
+#include <boost/algorithm/string.hpp>
+#include <boost/bind.hpp>
+#include <boost/lexical_cast.hpp>
+#include <boost/thread/locks.hpp>
+
+#include "EosDevice.h"
+#include "EosAdimecTileExecutor.h"
+#include "EosAdimecThreadPlacement.h"
+#include "EosAdimecUtil.h"
+
+// Most workers
+static const int TILE_MAX_WORKERS=64;
+
+// Highest CPU number tile_cpus may name
+static const int TILE_MAX_CPU=1023;
+
+// Weight of the newest job in the smoothed job time
+static const double TILE_JOB_MS_SMOOTHING=0.1;
+
+EosAdimecTileExecutor::EosAdimecTileExecutor(const int nWorkers, const std::vector<int>& vnCpus,
+                                             const size_t nTileBytes)
+{
+    m_nWorkers=nWorkers;
+    if(m_nWorkers<1)
+        m_nWorkers=std::max(0,(int)boost::thread::hardware_concurrency()-1);
+    m_nWorkers=std::min(m_nWorkers,TILE_MAX_WORKERS);
+    m_vnCpus=vnCpus;
+    m_nTileBytes=std::max(nTileBytes,(size_t)1024);
+
+    m_abStop=false;
+    m_anQueued=0;
+    m_bDelivering=false;
+
+    ::memset(&m_stats,0,sizeof(m_stats));
+    m_stats.nWorkers=m_nWorkers;
+
+    return;
+}
+
+EosAdimecTileExecutor::~EosAdimecTileExecutor(void)
+{
+    Stop();
+    return;
+}
+
+int EosAdimecTileExecutor::Start(void)
+{
+    if(!m_vpWorkers.empty() || (0==m_nWorkers))
+        return UNIX_OK_STATUS;
+
+    m_abStop=false;
+    for(int iworker=0; iworker<m_nWorkers; iworker++)
+        m_vpQueues.push_back(new TileQueue);
+    for(int iworker=0; iworker<m_nWorkers; iworker++)
+    {
+        m_vpWorkers.push_back(
+            new boost::thread(boost::bind(&EosAdimecTileExecutor::WorkerThread,this,iworker)));
+    }
+
+    return UNIX_OK_STATUS;
+}
+
+void EosAdimecTileExecutor::Stop(void)
+{
+    {
+        boost::lock_guard<boost::mutex> lock(m_mtxWork);
+        m_abStop=true;
+        m_cvWork.notify_all();
+    }
+
+    for(auto & ipWorker: m_vpWorkers)
+    {
+        ipWorker->join();
+        delete ipWorker;
+    }
+    m_vpWorkers.clear();
+
+    // Nothing should be left; a stage still submitting would be a bug.
+    for(auto & ipQueue: m_vpQueues)
+        delete ipQueue;
+    m_vpQueues.clear();
+    m_anQueued=0;
+
+    boost::lock_guard<boost::mutex> lock(m_mtxOrder);
+    for(auto & ipJob: m_dqJobs)
+    {
+        if(!ipJob->bWaited)
+            delete ipJob;
+    }
+    m_dqJobs.clear();
+
+    return;
+}
+
+void EosAdimecTileExecutor::Submit(const JobSpec& spec, TileFn fnTile, DoneFn fnDone)
+{
+    Enqueue(NewJob(spec,fnTile,fnDone,false));
+    return;
+}
+
+void EosAdimecTileExecutor::Run(const JobSpec& spec, TileFn fnTile)
+{
+    Job* pJob=NewJob(spec,fnTile,DoneFn(),true);
+    Enqueue(pJob);
+
+    // Help until the deques are empty; what is left is running on workers.
+    const int nSlot=m_nWorkers;
+    TileRef ref;
+    while(!m_vpQueues.empty() && TakeTile(nSlot,ref))
+        RunTile(ref,nSlot);
+
+    {
+        boost::unique_lock<boost::mutex> lock(m_mtxOrder);
+        while(!pJob->bDelivered)
+            m_cvOrder.wait(lock);
+    }
+    delete pJob;
+
+    return;
+}
+
+int EosAdimecTileExecutor::GetTileCount(const JobSpec& spec) const
+{
+    if(spec.nHeight<=0)
+        return 0;
+    int nRows=RowsPerTile(spec);
+    return (spec.nHeight+nRows-1)/nRows;
+}
+
+EosAdimecTileExecutor::ExecutorStats EosAdimecTileExecutor::GetStats(void)
+{
+    boost::lock_guard<boost::mutex> lock(m_mtxStats);
+    return m_stats;
+}
+
+bool EosAdimecTileExecutor::ParseCpus(const std::string& strCpus, std::vector<int>& vnCpus)
+{
+    vnCpus.clear();
+    if(boost::trim_copy(strCpus).empty())
+        return true;
+
+    std::vector<std::string> vStrRanges;
+    boost::split(vStrRanges,strCpus,boost::is_any_of(","));
+    for(auto & ixRange: vStrRanges)
+    {
+        std::vector<std::string> vStrEnds;
+        boost::split(vStrEnds,ixRange,boost::is_any_of("-"));
+        if(vStrEnds.size()>2)
+            return false;
+
+        int nFirst=-1, nLast=-1;
+        try
+        {
+            nFirst=boost::lexical_cast<int>(boost::trim_copy(vStrEnds.front()));
+            nLast=boost::lexical_cast<int>(boost::trim_copy(vStrEnds.back()));
+        }
+        catch(...)
+        {
+            return false;
+        }
+        if((nFirst<0) || (nLast<nFirst) || (nLast>TILE_MAX_CPU))
+            return false;
+
+        for(int icpu=nFirst; icpu<=nLast; icpu++)
+            vnCpus.push_back(icpu);
+    }
+
+    return true;
+}
+
+// Tiles of about m_nTileBytes, but at least two per thread where the
+// frame allows, so there is something left to steal.
+int EosAdimecTileExecutor::RowsPerTile(const JobSpec& spec) const
+{
+    const int nAlign=std::max(1,spec.nAlign);
+    const int nSlots=GetNumSlots();
+
+    int nRows=(int)std::min((size_t)spec.nHeight,m_nTileBytes/std::max(spec.nRowBytes,(size_t)1));
+    nRows=std::min(nRows,(spec.nHeight+2*nSlots-1)/(2*nSlots));
+    return std::max(nAlign,(nRows/nAlign)*nAlign);
+}
+
+EosAdimecTileExecutor::Job* EosAdimecTileExecutor::NewJob(const JobSpec& spec, TileFn fnTile,
+                                                          DoneFn fnDone, const bool bWaited)
+{
+    Job* pJob=new Job;
+    pJob->spec=spec;
+    pJob->fnTile=fnTile;
+    pJob->fnDone=fnDone;
+    pJob->nRowsPerTile=(spec.nHeight>0) ? RowsPerTile(spec) : 1;
+    pJob->nTiles=GetTileCount(spec);
+    pJob->anLeft=pJob->nTiles;
+    pJob->bDone=false;
+    pJob->bDelivered=false;
+    pJob->bWaited=bWaited;
+    pJob->nSubmitNs=EosAdimecUtil::MonotonicNs();
+    return pJob;
+}
+
+void EosAdimecTileExecutor::Enqueue(Job* pJob)
+{
+    {
+        boost::lock_guard<boost::mutex> lock(m_mtxOrder);
+        m_dqJobs.push_back(pJob);
+    }
+
+    if(0==pJob->nTiles)
+    {
+        FinishJob(pJob);
+        return;
+    }
+
+    // No workers (or not started): everything on this thread.
+    if(m_vpQueues.empty())
+    {
+        for(int itile=0; itile<pJob->nTiles; itile++)
+        {
+            TileRef ref={pJob,itile,m_nWorkers};
+            RunTile(ref,m_nWorkers);
+        }
+        return;
+    }
+
+    // Contiguous runs, one per worker
+    const int nQueues=(int)m_vpQueues.size();
+    for(int iqueue=0; iqueue<nQueues; iqueue++)
+    {
+        int nFirst=(pJob->nTiles*iqueue)/nQueues;
+        int nEnd=(pJob->nTiles*(iqueue+1))/nQueues;
+        if(nFirst==nEnd)
+            continue;
+
+        TileQueue& queue=*m_vpQueues[iqueue];
+        boost::lock_guard<boost::mutex> lock(queue.mtx);
+        for(int itile=nFirst; itile<nEnd; itile++)
+        {
+            TileRef ref={pJob,itile,iqueue};
+            queue.dqTiles.push_back(ref);
+        }
+    }
+
+    {
+        boost::lock_guard<boost::mutex> lock(m_mtxWork);
+        m_anQueued+=pJob->nTiles;
+        m_cvWork.notify_all();
+    }
+
+    return;
+}
+
+bool EosAdimecTileExecutor::TakeTile(const int nSlot, TileRef& ref)
+{
+    const int nQueues=(int)m_vpQueues.size();
+
+    // Own deque: the back, the tile dealt last (its neighbour is still in cache)
+    if(nSlot<nQueues)
+    {
+        TileQueue& queue=*m_vpQueues[nSlot];
+        boost::lock_guard<boost::mutex> lock(queue.mtx);
+        if(!queue.dqTiles.empty())
+        {
+            ref=queue.dqTiles.back();
+            queue.dqTiles.pop_back();
+            m_anQueued--;
+            return true;
+        }
+    }
+
+    // Steal: another deque's front, furthest from where its owner works
+    for(int ivictim=1; ivictim<=nQueues; ivictim++)
+    {
+        int nVictim=(nSlot+ivictim)%nQueues;
+        if(nVictim==nSlot)
+            continue;
+
+        TileQueue& queue=*m_vpQueues[nVictim];
+        boost::lock_guard<boost::mutex> lock(queue.mtx);
+        if(!queue.dqTiles.empty())
+        {
+            ref=queue.dqTiles.front();
+            queue.dqTiles.pop_front();
+            m_anQueued--;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void EosAdimecTileExecutor::RunTile(const TileRef& ref, const int nSlot)
+{
+    Job* pJob=ref.pJob;
+    const JobSpec& spec=pJob->spec;
+
+    Tile tile;
+    tile.nIndex=ref.nTile;
+    tile.nRowBegin=ref.nTile*pJob->nRowsPerTile;
+    tile.nRowEnd=std::min(spec.nHeight,tile.nRowBegin+pJob->nRowsPerTile);
+    tile.nHaloBegin=std::max(0,tile.nRowBegin-spec.nHalo);
+    tile.nHaloEnd=std::min(spec.nHeight,tile.nRowEnd+spec.nHalo);
+    tile.nSlot=nSlot;
+
+    pJob->fnTile(tile);
+
+    {
+        boost::lock_guard<boost::mutex> lock(m_mtxStats);
+        m_stats.nTiles++;
+        if(ref.nDealtTo!=nSlot)
+            m_stats.nStolen++;
+        if(nSlot==m_nWorkers)
+            m_stats.nCallerTiles++;
+    }
+
+    if(1==pJob->anLeft.fetch_sub(1))
+        FinishJob(pJob);
+
+    return;
+}
+
+// Whoever finishes a job delivers it if it is at the head, and then any
+// finished jobs behind it; a job finishing during a DoneFn is left to
+// the thread already delivering.
+void EosAdimecTileExecutor::FinishJob(Job* pJob)
+{
+    double dJobMs=(EosAdimecUtil::MonotonicNs()-pJob->nSubmitNs)/1.0e6;
+    {
+        boost::lock_guard<boost::mutex> lock(m_mtxStats);
+        m_stats.nJobs++;
+        m_stats.dJobMs=(m_stats.dJobMs>0.0) ?
+            ((1.0-TILE_JOB_MS_SMOOTHING)*m_stats.dJobMs+TILE_JOB_MS_SMOOTHING*dJobMs) : dJobMs;
+    }
+
+    boost::unique_lock<boost::mutex> lock(m_mtxOrder);
+    pJob->bDone=true;
+    if(m_bDelivering)
+        return;
+
+    m_bDelivering=true;
+    while(!m_dqJobs.empty() && m_dqJobs.front()->bDone)
+    {
+        Job* pHead=m_dqJobs.front();
+        m_dqJobs.pop_front();
+
+        if(pHead->fnDone)
+        {
+            lock.unlock();
+            pHead->fnDone();
+            lock.lock();
+        }
+
+        if(pHead->bWaited)
+        {
+            pHead->bDelivered=true;
+            m_cvOrder.notify_all();
+        }
+        else
+        {
+            delete pHead;
+        }
+    }
+    m_bDelivering=false;
+
+    return;
+}
+
+void EosAdimecTileExecutor::WorkerThread(const int nSlot)
+{
+    // The role's policy and CPUs; tile_cpus then narrows it to one CPU.
+    EosAdimecThreadPlacement::Apply(EosAdimecThreadPlacement::eRoleProcessing);
+
+    if(!m_vnCpus.empty())
+    {
+        int nCpu=m_vnCpus[nSlot%m_vnCpus.size()];
+        cpu_set_t cpuSet;
+        CPU_ZERO(&cpuSet);
+        CPU_SET(nCpu,&cpuSet);
+        int nErr=::pthread_setaffinity_np(::pthread_self(),sizeof(cpuSet),&cpuSet);
+        if(0==nErr)
+        {
+            boost::lock_guard<boost::mutex> lock(m_mtxStats);
+            m_stats.nPinned++;
+        }
+        else
+        {
+            std::cerr<<__FUNCTION__<<"(): tile worker "<<nSlot<<" not pinned to CPU "<<nCpu
+                     <<": "<<::strerror(nErr)<<std::endl;
+        }
+    }
+
+    while(!m_abStop)
+    {
+        TileRef ref;
+        if(TakeTile(nSlot,ref))
+        {
+            RunTile(ref,nSlot);
+            continue;
+        }
+
+        boost::unique_lock<boost::mutex> lock(m_mtxWork);
+        if(m_anQueued>0)
+        {
+            // Another thread is between taking a tile and counting it.
+            lock.unlock();
+            boost::this_thread::yield();
+            continue;
+        }
+        while(!m_abStop && (m_anQueued<=0))
+            m_cvWork.wait(lock);
+    }
+
+    return;
+}
@@ -0,0 +1,306 @@
+/**
+ * Tone mapping to 8 bits.  See EosAdimecToneMap.h
+ */
+
+#include <math.h>
+#include <string.h>
+#include <time.h>
+
+#include <algorithm>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define EOS_ADIMEC_TONEMAP_X86
+#endif
+
+#include <boost/algorithm/string.hpp>
+#include <boost/thread/locks.hpp>
+
+#include "EosAdimecToneMap.h"
+
+static void ApplyRowScalar(uint16_t* pRow, const int nColBegin, const int nWidth,
+                           const uint16_t* pLut, const uint32_t nMax)
+{
+    for(int icol=nColBegin; icol<nWidth; icol++)
+    {
+        uint32_t nValue=pRow[icol];
+        pRow[icol]=pLut[(nValue<nMax) ? nValue : nMax];
+    }
+    return;
+}
+
+#ifdef EOS_ADIMEC_TONEMAP_X86
+
+// 16 pixels a step: two 8-lane gathers.  Each gather reads 32 bits at
+// pLut+index (2-byte scale), so the entry is the low half and the LUT
+// needs one entry of padding past nMax.  Returns the first column not done.
+__attribute__((target("avx2")))
+static int ApplyRowAvx2(uint16_t* pRow, const int nWidth, const uint16_t* pLut,
+                        const uint32_t nMax)
+{
+    const __m256i vMax=_mm256_set1_epi16((short)nMax);
+    const __m256i vLow=_mm256_set1_epi32(0xffff);
+
+    int icol=0;
+    for(; icol+16<=nWidth; icol+=16)
+    {
+        __m256i vIn=_mm256_min_epu16(_mm256_loadu_si256((const __m256i*)(pRow+icol)),vMax);
+        __m256i vIdx0=_mm256_cvtepu16_epi32(_mm256_castsi256_si128(vIn));
+        __m256i vIdx1=_mm256_cvtepu16_epi32(_mm256_extracti128_si256(vIn,1));
+        __m256i vOut0=_mm256_and_si256(_mm256_i32gather_epi32((const int*)pLut,vIdx0,2),vLow);
+        __m256i vOut1=_mm256_and_si256(_mm256_i32gather_epi32((const int*)pLut,vIdx1,2),vLow);
+
+        // packus works per 128-bit lane: put the quarters back in order
+        __m256i vOut=_mm256_permute4x64_epi64(_mm256_packus_epi32(vOut0,vOut1),0xd8);
+        _mm256_storeu_si256((__m256i*)(pRow+icol),vOut);
+    }
+    return icol;
+}
+
+#else
+
+static int ApplyRowAvx2(uint16_t*, const int, const uint16_t*, const uint32_t)
+{
+    return 0;
+}
+
+#endif // EOS_ADIMEC_TONEMAP_X86
+
+EosAdimecToneMap::EosAdimecToneMap(void)
+{
+    m_params.eCurve=eCurveOff;
+    m_params.dGamma=2.2;
+    m_params.dLogStrength=100.0;
+    m_params.dGain=1.0;
+    m_params.dBlackPct=0.0;
+    m_nParamsVersion=1;
+
+    ::memset(&m_stats,0,sizeof(m_stats));
+
+    m_nLutVersion=0;
+    m_nLutBitDepth=0;
+    m_eLutCurve=eCurveOff;
+    m_nSettingsGain=-1;
+    m_nSettingsIt=-1;
+
+    return;
+}
+
+EosAdimecToneMap::~EosAdimecToneMap(void)
+{
+    return;
+}
+
+void EosAdimecToneMap::SetParams(const ToneParams& params)
+{
+    boost::lock_guard<boost::mutex> lock(m_mtxParams);
+    m_params=params;
+    m_nParamsVersion++;
+    return;
+}
+
+EosAdimecToneMap::ToneParams EosAdimecToneMap::GetParams(void)
+{
+    boost::lock_guard<boost::mutex> lock(m_mtxParams);
+    return m_params;
+}
+
+EosAdimecToneMap::ToneStats EosAdimecToneMap::GetStats(void)
+{
+    boost::lock_guard<boost::mutex> lock(m_mtxParams);
+    return m_stats;
+}
+
+const uint16_t* EosAdimecToneMap::Update(const EosAdimecRawFrame& frame)
+{
+    ToneParams params;
+    uint64_t nVersion;
+    {
+        boost::lock_guard<boost::mutex> lock(m_mtxParams);
+        params=m_params;
+        nVersion=m_nParamsVersion;
+    }
+
+    if((eCurveOff==params.eCurve) || (frame.nBitDepth<8) || (frame.nBitDepth>MAX_BIT_DEPTH))
+    {
+        if(m_nLutBitDepth)
+        {
+            m_nLutBitDepth=0;
+            boost::lock_guard<boost::mutex> lock(m_mtxParams);
+            m_stats.nBitDepth=0;
+        }
+        return NULL;
+    }
+
+    const bool bNewLut=(nVersion!=m_nLutVersion) || (frame.nBitDepth!=m_nLutBitDepth) ||
+        (params.eCurve!=m_eLutCurve);
+    const bool bEqualize=(eCurveEqualize==params.eCurve);
+    if(!bNewLut && !bEqualize)
+        return m_vLut.data();
+
+    struct timespec tsStart, tsEnd;
+    ::clock_gettime(CLOCK_MONOTONIC,&tsStart);
+
+    bool bSettingsReset=false;
+    if(bEqualize)
+    {
+        bSettingsReset=!bNewLut && ((frame.settings.nGain!=m_nSettingsGain) ||
+                                    (frame.settings.nIntegrationTime!=m_nSettingsIt));
+        Histogram(frame);
+        BuildEqualize(bNewLut || bSettingsReset);
+    }
+    else
+    {
+        BuildCurve(params,frame.nBitDepth,m_vLut);
+    }
+
+    m_nSettingsGain=frame.settings.nGain;
+    m_nSettingsIt=frame.settings.nIntegrationTime;
+    m_nLutVersion=nVersion;
+    m_nLutBitDepth=frame.nBitDepth;
+    m_eLutCurve=params.eCurve;
+
+    ::clock_gettime(CLOCK_MONOTONIC,&tsEnd);
+    {
+        boost::lock_guard<boost::mutex> lock(m_mtxParams);
+        m_stats.nBitDepth=frame.nBitDepth;
+        m_stats.nBuilds++;
+        m_stats.dBuildMs=(tsEnd.tv_sec-tsStart.tv_sec)*1000.0+
+            (tsEnd.tv_nsec-tsStart.tv_nsec)/1.0e6;
+        if(bSettingsReset)
+            m_stats.nResets++;
+    }
+
+    return m_vLut.data();
+}
+
+void EosAdimecToneMap::ApplyRow(uint16_t* pRow, const int nWidth, const uint16_t* pLut,
+                                const uint32_t nMax, const EosAdimecBayer::E_SIMD_LEVEL eLevel)
+{
+    EosAdimecBayer::E_SIMD_LEVEL eUse=
+        (EosAdimecBayer::eSimdAuto==eLevel) ? EosAdimecBayer::GetBestSimdLevel() : eLevel;
+
+    // SSE4.1 has no gather; below AVX2 the scalar loop is as fast.
+    int nCol=(EosAdimecBayer::eSimdAvx2==eUse) ? ApplyRowAvx2(pRow,nWidth,pLut,nMax) : 0;
+    ApplyRowScalar(pRow,nCol,nWidth,pLut,nMax);
+    return;
+}
+
+void EosAdimecToneMap::BuildCurve(const ToneParams& params, const int nBitDepth,
+                                  std::vector<uint16_t>& vLut)
+{
+    const int nEntries=1<<nBitDepth;
+    const double dFull=nEntries-1;
+    const double dBlack=params.dBlackPct/100.0;
+    const double dLogNorm=::log1p(params.dLogStrength);
+
+    vLut.resize(nEntries+1);
+    for(int ientry=0; ientry<nEntries; ientry++)
+    {
+        double dX=(ientry/dFull-dBlack)*params.dGain;
+        dX=std::min(1.0,std::max(0.0,dX));
+
+        double dY;
+        switch(params.eCurve)
+        {
+            case eCurveGamma:   dY=::pow(dX,1.0/params.dGamma);                    break;
+            case eCurveLog:     dY=::log1p(params.dLogStrength*dX)/dLogNorm;      break;
+            default:            dY=dX;                                             break;
+        }
+        vLut[ientry]=(uint16_t)(dY*255.0+0.5);
+    }
+    vLut[nEntries]=vLut[nEntries-1];
+
+    return;
+}
+
+void EosAdimecToneMap::Histogram(const EosAdimecRawFrame& frame)
+{
+    const int nEntries=1<<frame.nBitDepth;
+    const uint16_t nMask=(uint16_t)(nEntries-1);
+
+    m_vHist.assign(nEntries,0);
+    uint32_t* pHist=m_vHist.data();
+    for(int irow=0; irow<frame.nHeight; irow+=EQ_ROW_STEP)
+    {
+        const uint16_t* pRow=frame.pData+(size_t)irow*frame.nStride;
+        for(int icol=0; icol<frame.nWidth; icol++)
+            pHist[pRow[icol]&nMask]++;
+    }
+    return;
+}
+
+// Clip-limited equalization: bins above EQ_CLIP times the mean are cut
+// and the excess spread evenly, then each entry maps to the middle of
+// its bin in the cumulative histogram.
+void EosAdimecToneMap::BuildEqualize(const bool bReset)
+{
+    const size_t nEntries=m_vHist.size();
+
+    uint64_t nTotal=0;
+    for(auto & ix: m_vHist)
+        nTotal+=ix;
+    const uint64_t nClip=std::max<uint64_t>(1,(EQ_CLIP*nTotal)/nEntries);
+
+    uint64_t nExcess=0;
+    for(auto & ix: m_vHist)
+    {
+        if(ix>nClip)
+        {
+            nExcess+=ix-nClip;
+            ix=(uint32_t)nClip;
+        }
+    }
+
+    if(bReset || (m_vEqualize.size()!=nEntries))
+        m_vEqualize.assign(nEntries,-1.0f);
+
+    const double dScale=(nTotal>0) ? 255.0/nTotal : 0.0;
+    const double dSpread=(double)nExcess/nEntries;
+    const float fRate=EQ_RATE_PCT/100.0f;
+    double dCumulative=0.0;
+    m_vLut.resize(nEntries+1);
+    for(size_t ientry=0; ientry<nEntries; ientry++)
+    {
+        double dBin=m_vHist[ientry]+dSpread;
+        float fY=(float)((dCumulative+dBin/2.0)*dScale);
+        dCumulative+=dBin;
+
+        float& fSmooth=m_vEqualize[ientry];
+        fSmooth=(fSmooth<0.0f) ? fY : (fSmooth+(fY-fSmooth)*fRate);
+        m_vLut[ientry]=(uint16_t)std::min(255.0f,fSmooth+0.5f);
+    }
+    m_vLut[nEntries]=m_vLut[nEntries-1];
+
+    return;
+}
+
+bool EosAdimecToneMap::CurveFromString(const std::string& strCurve, E_CURVE& eCurve)
+{
+    std::string strLower=boost::to_lower_copy(strCurve);
+    if(strLower=="off")
+        eCurve=eCurveOff;
+    else if(strLower=="linear")
+        eCurve=eCurveLinear;
+    else if(strLower=="gamma")
+        eCurve=eCurveGamma;
+    else if(strLower=="log")
+        eCurve=eCurveLog;
+    else if(strLower=="equalize")
+        eCurve=eCurveEqualize;
+    else
+        return false;
+    return true;
+}
+
+std::string EosAdimecToneMap::CurveName(const E_CURVE eCurve)
+{
+    switch(eCurve)
+    {
+        case eCurveLinear:      return "linear";
+        case eCurveGamma:       return "gamma";
+        case eCurveLog:         return "log";
+        case eCurveEqualize:    return "equalize";
+        default:                return "off";
+    }
+}
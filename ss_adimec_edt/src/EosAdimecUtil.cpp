@@ -0,0 +1,46 @@
+/**
+ * Shared helpers.  See EosAdimecUtil.h
+ */
+
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "EosAdimecUtil.h"
+
+uint64_t EosAdimecUtil::MonotonicNs(void)
+{
+    struct timespec tsNow;
+    ::clock_gettime(CLOCK_MONOTONIC,&tsNow);
+    return ((uint64_t)tsNow.tv_sec*1000000000ULL)+tsNow.tv_nsec;
+}
+
+bool EosAdimecUtil::WriteAll(const int nFd, const void* pData, const size_t nBytes)
+{
+    const uint8_t* pByte=(const uint8_t*)pData;
+    size_t nLeft=nBytes;
+    while(nLeft>0)
+    {
+        ssize_t nWritten=::write(nFd,pByte,nLeft);
+        if(nWritten<0)
+        {
+            if(EINTR==errno)
+                continue;
+            return false;
+        }
+        pByte+=nWritten;
+        nLeft-=nWritten;
+    }
+    return true;
+}
+
+void EosAdimecUtil::MakeDirs(const std::string& strDir)
+{
+    for(size_t ipos=1; ipos<=strDir.size(); ipos++)
+    {
+        if((ipos==strDir.size()) || ('/'==strDir[ipos]))
+            ::mkdir(strDir.substr(0,ipos).c_str(),0750);
+    }
+    return;
+}
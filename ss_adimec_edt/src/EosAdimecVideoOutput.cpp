@@ -0,0 +1,375 @@
+/**
+ * YUV frames for the linked_video streamer.  See EosAdimecVideoOutput.h
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include <iostream>
+
+#include <boost/bind.hpp>
+#include <boost/thread/locks.hpp>
+
+#include "EosDevice.h"
+#include "EosAdimecVideoOutput.h"
+#include "EosAdimecThreadPlacement.h"
+
+EosAdimecVideoOutput::EosAdimecVideoOutput(const std::string& strFifoPath,
+                                           const EosAdimecYuv::E_YUV_FORMAT eFormat,
+                                           const EosAdimecBayer::E_DEMOSAIC_METHOD eMethod,
+                                           EosAdimecTileExecutor* pExecutor)
+{
+    m_strFifoPath=strFifoPath;
+    m_eFormat=eFormat;
+    m_eMethod=eMethod;
+    m_pExecutor=pExecutor;
+    m_vvScratch.resize(m_pExecutor ? m_pExecutor->GetNumSlots() : 1);
+    m_anTileErrors=0;
+
+    m_pWriterThread=NULL;
+    m_abStop=false;
+    m_abReaderConnected=false;
+
+    m_pPool=NULL;
+    ::memset(m_apFrames,0,sizeof(m_apFrames));
+    ::memset(m_anFrameBytes,0,sizeof(m_anFrameBytes));
+    m_nFillIndex=0;
+    m_nPendingIndex=-1;
+    m_nWritingIndex=-1;
+
+    m_gains.nR=EosAdimecYuv::GAIN_ONE;
+    m_gains.nG=EosAdimecYuv::GAIN_ONE;
+    m_gains.nB=EosAdimecYuv::GAIN_ONE;
+
+    ::memset(&m_stats,0,sizeof(m_stats));
+
+    return;
+}
+
+EosAdimecVideoOutput::~EosAdimecVideoOutput(void)
+{
+    Stop();
+    return;
+}
+
+int EosAdimecVideoOutput::Start(const size_t nMaxPixels)
+{
+    if(m_pWriterThread)
+        return UNIX_OK_STATUS;
+
+    if((0!=::mkfifo(m_strFifoPath.c_str(),0666)) && (EEXIST!=errno))
+    {
+        std::cerr<<__FUNCTION__<<"(): mkfifo("<<m_strFifoPath<<") failed: "
+                 <<::strerror(errno)<<std::endl;
+        return UNIX_ERROR_STATUS;
+    }
+
+    struct stat statFifo;
+    if((0!=::stat(m_strFifoPath.c_str(),&statFifo)) || !S_ISFIFO(statFifo.st_mode))
+    {
+        std::cerr<<__FUNCTION__<<"(): "<<m_strFifoPath<<" exists and is not a FIFO"<<std::endl;
+        return UNIX_ERROR_STATUS;
+    }
+
+    // I420 and NV12 are both 12 bits a pixel.
+    m_pPool=new EosAdimecFramePool("video_output",(nMaxPixels*3)/2,NUM_BUFFERS);
+    if(UNIX_OK_STATUS!=m_pPool->Start())
+    {
+        delete m_pPool;
+        m_pPool=NULL;
+        return UNIX_ERROR_STATUS;
+    }
+    for(int ibuf=0; ibuf<NUM_BUFFERS; ibuf++)
+    {
+        m_apFrames[ibuf]=m_pPool->GetSlot(m_pPool->Acquire());
+        m_anFrameBytes[ibuf]=0;
+    }
+
+    m_abStop=false;
+    m_pWriterThread=new boost::thread(boost::bind(&EosAdimecVideoOutput::WriterThread,this));
+
+    return UNIX_OK_STATUS;
+}
+
+void EosAdimecVideoOutput::Stop(void)
+{
+    {
+        boost::lock_guard<boost::mutex> lock(m_mtxFrames);
+        m_abStop=true;
+    }
+    m_cvFrames.notify_all();
+
+    if(m_pWriterThread)
+    {
+        m_pWriterThread->join();
+        delete m_pWriterThread;
+        m_pWriterThread=NULL;
+    }
+
+    if(m_pPool)
+    {
+        ::memset(m_apFrames,0,sizeof(m_apFrames));
+        delete m_pPool;
+        m_pPool=NULL;
+    }
+
+    return;
+}
+
+void EosAdimecVideoOutput::OnFrame(const EosAdimecRawFrame& frame)
+{
+    // Weight of the newest frame in the smoothed conversion time
+    static const double CONVERT_MS_SMOOTHING=0.1;
+
+    if(!m_abReaderConnected || (frame.nWidth&1) || (frame.nHeight&1) || (NULL==m_pPool))
+        return;
+
+    EosAdimecYuv::WbGains gains;
+    int nFill;
+    {
+        boost::lock_guard<boost::mutex> lock(m_mtxFrames);
+        gains=m_gains;
+        nFill=m_nFillIndex;
+    }
+
+    // Only the capture thread touches the fill buffer.
+    size_t nFrameBytes=EosAdimecYuv::GetFrameBytes(frame.nWidth,frame.nHeight);
+    if(nFrameBytes>m_pPool->GetSlotBytes())
+    {
+        boost::lock_guard<boost::mutex> lock(m_mtxFrames);
+        m_stats.nErrors++;
+        return;
+    }
+    m_anFrameBytes[nFill]=nFrameBytes;
+
+    EosAdimecBayer::BayerImage raw;
+    raw.pData=frame.pData;
+    raw.nWidth=frame.nWidth;
+    raw.nHeight=frame.nHeight;
+    raw.nStride=frame.nStride;
+    raw.nBitDepth=frame.nBitDepth;
+    raw.bRedRowFirst=frame.bRedRowFirst;
+    raw.bGreenPixelFirst=frame.bGreenPixelFirst;
+
+    EosAdimecYuv::YuvImage yuv;
+    EosAdimecYuv::SetPlanes(m_apFrames[nFill],frame.nWidth,frame.nHeight,m_eFormat,yuv);
+
+    struct timespec tsStart, tsEnd;
+    ::clock_gettime(CLOCK_MONOTONIC,&tsStart);
+    const uint16_t* pToneLut=m_toneMap.Update(frame);
+    int nResult;
+    if(m_pExecutor)
+    {
+        // Two rows of halo: the demosaic reads a row each side of its band.
+        EosAdimecTileExecutor::JobSpec spec={frame.nHeight,(size_t)frame.nWidth*8,2,2};
+        m_anTileErrors=0;
+        m_pExecutor->Run(spec,boost::bind(&EosAdimecVideoOutput::ConvertTile,this,&raw,&yuv,
+                                          gains,pToneLut,_1));
+        nResult=(0==m_anTileErrors) ? 0 : -1;
+    }
+    else
+    {
+        nResult=EosAdimecYuv::ConvertBayer(raw,yuv,m_eFormat,gains,m_eMethod,m_vvScratch[0],
+                                           EosAdimecBayer::eSimdAuto,pToneLut);
+    }
+    ::clock_gettime(CLOCK_MONOTONIC,&tsEnd);
+    double dMs=(tsEnd.tv_sec-tsStart.tv_sec)*1000.0+(tsEnd.tv_nsec-tsStart.tv_nsec)/1.0e6;
+
+    {
+        boost::lock_guard<boost::mutex> lock(m_mtxFrames);
+        if(0!=nResult)
+        {
+            m_stats.nErrors++;
+            return;
+        }
+
+        m_stats.nConverted++;
+        m_stats.dConvertMs=(m_stats.dConvertMs>0.0) ?
+            ((1.0-CONVERT_MS_SMOOTHING)*m_stats.dConvertMs+CONVERT_MS_SMOOTHING*dMs) : dMs;
+
+        if(m_nPendingIndex>=0)
+        {
+            // The writer hasn't taken the previous frame: replace it.
+            m_stats.nDropped++;
+            std::swap(m_nFillIndex,m_nPendingIndex);
+        }
+        else
+        {
+            m_nPendingIndex=m_nFillIndex;
+            for(int ibuf=0; ibuf<NUM_BUFFERS; ibuf++)
+            {
+                if((ibuf!=m_nPendingIndex) && (ibuf!=m_nWritingIndex))
+                {
+                    m_nFillIndex=ibuf;
+                    break;
+                }
+            }
+        }
+    }
+    m_cvFrames.notify_one();
+
+    return;
+}
+
+void EosAdimecVideoOutput::ConvertTile(const EosAdimecBayer::BayerImage* pRaw,
+                                       EosAdimecYuv::YuvImage* pYuv,
+                                       const EosAdimecYuv::WbGains gains,
+                                       const uint16_t* pToneLut,
+                                       const EosAdimecTileExecutor::Tile& tile)
+{
+    if(0!=EosAdimecYuv::ConvertBayerRows(*pRaw,*pYuv,m_eFormat,gains,m_eMethod,tile.nRowBegin,
+                                         tile.nRowEnd,m_vvScratch[tile.nSlot],
+                                         EosAdimecBayer::eSimdAuto,pToneLut))
+        m_anTileErrors++;
+    return;
+}
+
+void EosAdimecVideoOutput::SetWbGains(const EosAdimecYuv::WbGains& gains)
+{
+    boost::lock_guard<boost::mutex> lock(m_mtxFrames);
+    m_gains=gains;
+    return;
+}
+
+EosAdimecYuv::WbGains EosAdimecVideoOutput::GetWbGains(void)
+{
+    boost::lock_guard<boost::mutex> lock(m_mtxFrames);
+    return m_gains;
+}
+
+void EosAdimecVideoOutput::SetToneParams(const EosAdimecToneMap::ToneParams& params)
+{
+    m_toneMap.SetParams(params);
+    return;
+}
+
+EosAdimecToneMap::ToneParams EosAdimecVideoOutput::GetToneParams(void)
+{
+    return m_toneMap.GetParams();
+}
+
+EosAdimecToneMap::ToneStats EosAdimecVideoOutput::GetToneStats(void)
+{
+    return m_toneMap.GetStats();
+}
+
+EosAdimecVideoOutput::VideoOutputStats EosAdimecVideoOutput::GetStats(void)
+{
+    boost::lock_guard<boost::mutex> lock(m_mtxFrames);
+    VideoOutputStats stats=m_stats;
+    stats.bReaderConnected=m_abReaderConnected;
+    return stats;
+}
+
+void EosAdimecVideoOutput::WriterThread(void)
+{
+    // How often to look for a reader while nobody has the FIFO open
+    static const int READER_POLL_MS=500;
+
+    EosAdimecThreadPlacement::Apply(EosAdimecThreadPlacement::eRoleProcessing);
+
+    int nFd=-1;
+
+    while(!m_abStop)
+    {
+        if(nFd<0)
+        {
+            nFd=OpenFifo();
+            if(nFd<0)
+            {
+                boost::this_thread::sleep(boost::posix_time::milliseconds(READER_POLL_MS));
+                continue;
+            }
+            m_abReaderConnected=true;
+        }
+
+        int nWriting;
+        {
+            boost::unique_lock<boost::mutex> lock(m_mtxFrames);
+            while(!m_abStop && (m_nPendingIndex<0))
+                m_cvFrames.wait(lock);
+            if(m_abStop)
+                break;
+
+            m_nWritingIndex=m_nPendingIndex;
+            m_nPendingIndex=-1;
+            nWriting=m_nWritingIndex;
+        }
+
+        bool bWritten=WriteFrame(nFd,m_apFrames[nWriting],m_anFrameBytes[nWriting]);
+
+        {
+            boost::lock_guard<boost::mutex> lock(m_mtxFrames);
+            m_nWritingIndex=-1;
+            if(bWritten)
+                m_stats.nWritten++;
+            else if(!m_abStop)
+                m_stats.nErrors++;
+        }
+
+        if(!bWritten)
+        {
+            // Reader gone: wait for the next one.
+            m_abReaderConnected=false;
+            ::close(nFd);
+            nFd=-1;
+        }
+    }
+
+    m_abReaderConnected=false;
+    if(nFd>=0)
+        ::close(nFd);
+
+    return;
+}
+
+// O_NONBLOCK open of a FIFO for writing fails with ENXIO until a reader
+// opens it, so this never blocks.
+int EosAdimecVideoOutput::OpenFifo(void)
+{
+    return ::open(m_strFifoPath.c_str(),O_WRONLY|O_NONBLOCK);
+}
+
+bool EosAdimecVideoOutput::WriteFrame(const int nFd, const uint8_t* pFrame,
+                                      const size_t nFrameBytes)
+{
+    // Poll interval, so Stop() isn't held up by a stalled reader
+    static const int WRITE_POLL_MS=200;
+
+    size_t nOffset=0;
+    while(nOffset<nFrameBytes)
+    {
+        if(m_abStop)
+            return false;
+
+        ssize_t nBytes=::write(nFd,pFrame+nOffset,nFrameBytes-nOffset);
+        if(nBytes>0)
+        {
+            nOffset+=nBytes;
+            continue;
+        }
+        if((nBytes<0) && (EINTR==errno))
+            continue;
+        if((nBytes<0) && ((EAGAIN==errno) || (EWOULDBLOCK==errno)))
+        {
+            struct pollfd pfd;
+            pfd.fd=nFd;
+            pfd.events=POLLOUT;
+            pfd.revents=0;
+            ::poll(&pfd,1,WRITE_POLL_MS);
+            if(pfd.revents&(POLLERR|POLLHUP))
+                return false;
+            continue;
+        }
+
+        // EPIPE (SIGPIPE is ignored) or another error
+        return false;
+    }
+
+    return true;
+}
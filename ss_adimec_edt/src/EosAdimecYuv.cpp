@@ -0,0 +1,369 @@
+/**
+ * Fused Bayer --> I420/NV12 conversion.  See EosAdimecYuv.h
+ *
+ * BT.601 limited range, integer.  With s = bit depth - 8:
+ *    Y = ((66R + 129G + 25B + (128<<s)) >> (8+s)) + 16
+ * and, from the 2x2 sums R4/G4/B4,
+ *    U = (-38R4 - 74G4 + 112B4 + (128<<(10+s)) + (1<<(9+s))) >> (10+s)
+ *    V = (112R4 - 94G4 - 18B4 + (128<<(10+s)) + (1<<(9+s))) >> (10+s)
+ * The offset keeps the sums positive, so the shifts round to nearest.
+ * After a tone-map LUT the values are 8-bit already: s = 0.
+ */
+
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define EOS_ADIMEC_YUV_X86
+#endif
+
+#include <boost/algorithm/string.hpp>
+
+#include "EosAdimecYuv.h"
+#include "EosAdimecToneMap.h"
+
+// Apply Q12 gains in place, clipping at full scale.
+static void ApplyGainsRow(uint16_t* pRow, const int nColBegin, const int nWidth,
+                          const uint32_t nGain, const uint32_t nMax)
+{
+    for(int icol=nColBegin; icol<nWidth; icol++)
+    {
+        uint32_t nValue=(pRow[icol]*nGain+(EosAdimecYuv::GAIN_ONE/2))>>12;
+        pRow[icol]=(uint16_t)((nValue<nMax) ? nValue : nMax);
+    }
+    return;
+}
+
+static void LumaRow(const uint16_t* pR, const uint16_t* pG, const uint16_t* pB,
+                    const int nColBegin, const int nWidth, const int nShift, uint8_t* pY)
+{
+    const uint32_t nRound=128u<<nShift;
+    for(int icol=nColBegin; icol<nWidth; icol++)
+    {
+        uint32_t nSum=66u*pR[icol]+129u*pG[icol]+25u*pB[icol]+nRound;
+        pY[icol]=(uint8_t)((nSum>>(8+nShift))+16);
+    }
+    return;
+}
+
+// One chroma row from two RGB rows; nUVStep is 1 (I420) or 2 (NV12).
+// nColBegin/nWidth are input columns (even).
+static void ChromaRow(const uint16_t* pR0, const uint16_t* pG0, const uint16_t* pB0,
+                      const uint16_t* pR1, const uint16_t* pG1, const uint16_t* pB1,
+                      const int nColBegin, const int nWidth, const int nShift,
+                      uint8_t* pU, uint8_t* pV, const int nUVStep)
+{
+    const int nTotalShift=10+nShift;
+    const int32_t nOffset=(128<<nTotalShift)+(1<<(nTotalShift-1));
+
+    for(int nCol=nColBegin; nCol<nWidth; nCol+=2)
+    {
+        int32_t nR4=pR0[nCol]+pR0[nCol+1]+pR1[nCol]+pR1[nCol+1];
+        int32_t nG4=pG0[nCol]+pG0[nCol+1]+pG1[nCol]+pG1[nCol+1];
+        int32_t nB4=pB0[nCol]+pB0[nCol+1]+pB1[nCol]+pB1[nCol+1];
+
+        int nOut=(nCol/2)*nUVStep;
+        pU[nOut]=(uint8_t)((-38*nR4-74*nG4+112*nB4+nOffset)>>nTotalShift);
+        pV[nOut]=(uint8_t)((112*nR4-94*nG4-18*nB4+nOffset)>>nTotalShift);
+    }
+    return;
+}
+
+#ifdef EOS_ADIMEC_YUV_X86
+
+// SSE4.1 versions of the above, bit-identical.  Each returns the first
+// column it did not do; the scalar loops finish the row.
+
+__attribute__((target("sse4.1")))
+static int ApplyGainsRowSse4(uint16_t* pRow, const int nWidth, const uint32_t nGain,
+                             const uint32_t nMax)
+{
+    const __m128i vGain=_mm_set1_epi16((short)nGain);
+    const __m128i vRound=_mm_set1_epi32(EosAdimecYuv::GAIN_ONE/2);
+    const __m128i vMax=_mm_set1_epi16((short)nMax);
+
+    int icol=0;
+    for(; icol+8<=nWidth; icol+=8)
+    {
+        __m128i vIn=_mm_loadu_si128((const __m128i*)(pRow+icol));
+        __m128i vLo=_mm_mullo_epi16(vIn,vGain);
+        __m128i vHi=_mm_mulhi_epu16(vIn,vGain);
+        __m128i vProd0=_mm_srli_epi32(_mm_add_epi32(_mm_unpacklo_epi16(vLo,vHi),vRound),12);
+        __m128i vProd1=_mm_srli_epi32(_mm_add_epi32(_mm_unpackhi_epi16(vLo,vHi),vRound),12);
+        __m128i vOut=_mm_min_epu16(_mm_packus_epi32(vProd0,vProd1),vMax);
+        _mm_storeu_si128((__m128i*)(pRow+icol),vOut);
+    }
+    return icol;
+}
+
+__attribute__((target("sse4.1")))
+static int LumaRowSse4(const uint16_t* pR, const uint16_t* pG, const uint16_t* pB,
+                       const int nWidth, const int nShift, uint8_t* pY)
+{
+    const __m128i vCoefRG=_mm_set1_epi32((129<<16)|66);
+    const __m128i vCoefB1=_mm_set1_epi32((1<<16)|25);
+    const __m128i vRound=_mm_set1_epi16((short)(128<<nShift));
+    const __m128i vShift=_mm_cvtsi32_si128(8+nShift);
+    const __m128i vBlack=_mm_set1_epi16(16);
+
+    int icol=0;
+    for(; icol+8<=nWidth; icol+=8)
+    {
+        __m128i vR=_mm_loadu_si128((const __m128i*)(pR+icol));
+        __m128i vG=_mm_loadu_si128((const __m128i*)(pG+icol));
+        __m128i vB=_mm_loadu_si128((const __m128i*)(pB+icol));
+
+        __m128i vSum0=_mm_add_epi32(_mm_madd_epi16(_mm_unpacklo_epi16(vR,vG),vCoefRG),
+                                    _mm_madd_epi16(_mm_unpacklo_epi16(vB,vRound),vCoefB1));
+        __m128i vSum1=_mm_add_epi32(_mm_madd_epi16(_mm_unpackhi_epi16(vR,vG),vCoefRG),
+                                    _mm_madd_epi16(_mm_unpackhi_epi16(vB,vRound),vCoefB1));
+        __m128i vY=_mm_add_epi16(_mm_packus_epi32(_mm_srl_epi32(vSum0,vShift),
+                                                  _mm_srl_epi32(vSum1,vShift)),vBlack);
+        _mm_storel_epi64((__m128i*)(pY+icol),_mm_packus_epi16(vY,vY));
+    }
+    return icol;
+}
+
+__attribute__((target("sse4.1")))
+static int ChromaRowSse4(const uint16_t* pR0, const uint16_t* pG0, const uint16_t* pB0,
+                         const uint16_t* pR1, const uint16_t* pG1, const uint16_t* pB1,
+                         const int nWidth, const int nShift,
+                         uint8_t* pU, uint8_t* pV, const bool bInterleaved)
+{
+    const int nTotalShift=10+nShift;
+    const __m128i vOnes=_mm_set1_epi16(1);
+    const __m128i vCoefU=_mm_set1_epi32((int)(((uint32_t)(uint16_t)-74<<16)|(uint16_t)-38));
+    const __m128i vCoefV=_mm_set1_epi32((int)(((uint32_t)(uint16_t)-94<<16)|112));
+    const __m128i vCoefUB=_mm_set1_epi32(112);
+    const __m128i vCoefVB=_mm_set1_epi32((uint16_t)-18);
+    const __m128i vOffset=_mm_set1_epi32((128<<nTotalShift)+(1<<(nTotalShift-1)));
+    const __m128i vShift=_mm_cvtsi32_si128(nTotalShift);
+
+    // 2x2 sums of 8 columns --> 4 x 32-bit
+    #define SUM4(p0,p1) _mm_madd_epi16(_mm_add_epi16(_mm_loadu_si128((const __m128i*)((p0)+icol)), \
+                                                     _mm_loadu_si128((const __m128i*)((p1)+icol))),vOnes)
+
+    int icol=0;
+    for(; icol+8<=nWidth; icol+=8)
+    {
+        __m128i vR4=SUM4(pR0,pR1);
+        __m128i vG4=SUM4(pG0,pG1);
+        __m128i vB4=SUM4(pB0,pB1);
+
+        // (R4,G4) pairs; the sums are at most 4*4095 so they fit in 16 bits.
+        __m128i vRG=_mm_or_si128(vR4,_mm_slli_epi32(vG4,16));
+        __m128i vU=_mm_add_epi32(_mm_add_epi32(_mm_madd_epi16(vRG,vCoefU),
+                                               _mm_madd_epi16(vB4,vCoefUB)),vOffset);
+        __m128i vV=_mm_add_epi32(_mm_add_epi32(_mm_madd_epi16(vRG,vCoefV),
+                                               _mm_madd_epi16(vB4,vCoefVB)),vOffset);
+
+        // 16-bit U0-3,V0-3
+        __m128i vUV=_mm_packs_epi32(_mm_sra_epi32(vU,vShift),_mm_sra_epi32(vV,vShift));
+        int nOut=icol/2;
+        if(bInterleaved)
+        {
+            __m128i vPairs=_mm_unpacklo_epi16(vUV,_mm_srli_si128(vUV,8));
+            _mm_storel_epi64((__m128i*)(pU+2*nOut),_mm_packus_epi16(vPairs,vPairs));
+        }
+        else
+        {
+            __m128i vBytes=_mm_packus_epi16(vUV,vUV);
+            uint32_t nU=(uint32_t)_mm_cvtsi128_si32(vBytes);
+            uint32_t nV=(uint32_t)_mm_extract_epi32(vBytes,1);
+            ::memcpy(pU+nOut,&nU,4);
+            ::memcpy(pV+nOut,&nV,4);
+        }
+    }
+    #undef SUM4
+
+    return icol;
+}
+
+#else
+
+static int ApplyGainsRowSse4(uint16_t*, const int, const uint32_t, const uint32_t)
+{
+    return 0;
+}
+
+static int LumaRowSse4(const uint16_t*, const uint16_t*, const uint16_t*,
+                       const int, const int, uint8_t*)
+{
+    return 0;
+}
+
+static int ChromaRowSse4(const uint16_t*, const uint16_t*, const uint16_t*,
+                         const uint16_t*, const uint16_t*, const uint16_t*,
+                         const int, const int, uint8_t*, uint8_t*, const bool)
+{
+    return 0;
+}
+
+#endif // EOS_ADIMEC_YUV_X86
+
+int EosAdimecYuv::ConvertBayer(const EosAdimecBayer::BayerImage& raw, YuvImage& yuv,
+                               const E_YUV_FORMAT eFormat, const WbGains& gains,
+                               const EosAdimecBayer::E_DEMOSAIC_METHOD eMethod,
+                               std::vector<uint16_t>& vScratch,
+                               const EosAdimecBayer::E_SIMD_LEVEL eLevel,
+                               const uint16_t* pToneLut)
+{
+    return ConvertBayerRows(raw,yuv,eFormat,gains,eMethod,0,raw.nHeight,vScratch,eLevel,pToneLut);
+}
+
+int EosAdimecYuv::ConvertBayerRows(const EosAdimecBayer::BayerImage& raw, YuvImage& yuv,
+                                   const E_YUV_FORMAT eFormat, const WbGains& gains,
+                                   const EosAdimecBayer::E_DEMOSAIC_METHOD eMethod,
+                                   const int nRowBegin, const int nRowEnd,
+                                   std::vector<uint16_t>& vScratch,
+                                   const EosAdimecBayer::E_SIMD_LEVEL eLevel,
+                                   const uint16_t* pToneLut)
+{
+    if((raw.nWidth&1) || (raw.nHeight&1) || (raw.nBitDepth<8) || (nRowBegin&1) ||
+       (nRowEnd&1) || (nRowBegin<0) || (nRowEnd>raw.nHeight))
+        return -1;
+
+    // One band of R, G and B rows.
+    size_t nPlane=(size_t)BAND_ROWS*raw.nWidth;
+    if(vScratch.size()<3*nPlane)
+        vScratch.resize(3*nPlane);
+
+    EosAdimecBayer::RgbPlanes band;
+    band.pR=vScratch.data();
+    band.pG=band.pR+nPlane;
+    band.pB=band.pG+nPlane;
+    band.nStride=raw.nWidth;
+
+    for(int irow=nRowBegin; irow<nRowEnd; irow+=BAND_ROWS)
+    {
+        int nBandEnd=(irow+BAND_ROWS<nRowEnd) ? irow+BAND_ROWS : nRowEnd;
+        band.nFirstRow=irow;
+
+        if((0!=EosAdimecBayer::DemosaicRows(raw,band,eMethod,irow,nBandEnd,eLevel)) ||
+           (0!=ConvertRgb(band,raw.nWidth,raw.nBitDepth,irow,nBandEnd,yuv,eFormat,gains,eLevel,
+                          pToneLut)))
+            return -1;
+    }
+
+    return 0;
+}
+
+int EosAdimecYuv::ConvertRgb(EosAdimecBayer::RgbPlanes& rgb, const int nWidth, const int nBitDepth,
+                             const int nRowBegin, const int nRowEnd, YuvImage& yuv,
+                             const E_YUV_FORMAT eFormat, const WbGains& gains,
+                             const EosAdimecBayer::E_SIMD_LEVEL eLevel,
+                             const uint16_t* pToneLut)
+{
+    if((nWidth&1) || (nRowBegin&1) || (nRowEnd&1) || (nRowBegin<rgb.nFirstRow) ||
+       (nBitDepth<8) || (nBitDepth>12) ||
+       (gains.nR>GAIN_MAX) || (gains.nG>GAIN_MAX) || (gains.nB>GAIN_MAX) ||
+       (NULL==yuv.pY) || (NULL==yuv.pU) || ((eYuvI420==eFormat) && (NULL==yuv.pV)))
+        return -1;
+
+    EosAdimecBayer::E_SIMD_LEVEL eUse=(EosAdimecBayer::eSimdAuto==eLevel) ?
+        EosAdimecBayer::GetBestSimdLevel() : eLevel;
+    const bool bSimd=(eUse>=EosAdimecBayer::eSimdSse4);
+
+    const uint32_t nMax=(1u<<nBitDepth)-1;
+    const int nShift=pToneLut ? 0 : nBitDepth-8;     // The LUT gives 8-bit values
+    const uint32_t anGains[3]={gains.nR,gains.nG,gains.nB};
+    uint16_t* apPlanes[3]={rgb.pR,rgb.pG,rgb.pB};
+    const bool bNV12=(eYuvNV12==eFormat);
+
+    for(int irow=nRowBegin; irow<nRowEnd; irow+=2)
+    {
+        size_t anOff[2];
+        anOff[0]=(size_t)(irow-rgb.nFirstRow)*rgb.nStride;
+        anOff[1]=anOff[0]+rgb.nStride;
+
+        for(int ipair=0; ipair<2; ipair++)
+        {
+            for(int iplane=0; iplane<3; iplane++)
+            {
+                if(GAIN_ONE==anGains[iplane])
+                    continue;
+                uint16_t* pRow=apPlanes[iplane]+anOff[ipair];
+                int nCol=bSimd ? ApplyGainsRowSse4(pRow,nWidth,anGains[iplane],nMax) : 0;
+                ApplyGainsRow(pRow,nCol,nWidth,anGains[iplane],nMax);
+            }
+            if(pToneLut)
+            {
+                for(int iplane=0; iplane<3; iplane++)
+                    EosAdimecToneMap::ApplyRow(apPlanes[iplane]+anOff[ipair],nWidth,pToneLut,
+                                               nMax,eUse);
+            }
+
+            size_t nOff=anOff[ipair];
+            uint8_t* pY=yuv.pY+(size_t)(irow+ipair)*yuv.nStrideY;
+            int nCol=bSimd ? LumaRowSse4(rgb.pR+nOff,rgb.pG+nOff,rgb.pB+nOff,nWidth,nShift,pY) : 0;
+            LumaRow(rgb.pR+nOff,rgb.pG+nOff,rgb.pB+nOff,nCol,nWidth,nShift,pY);
+        }
+
+        size_t nOff0=anOff[0];
+        size_t nOff1=anOff[1];
+        uint8_t* pU=yuv.pU+(size_t)(irow/2)*yuv.nStrideUV;
+        uint8_t* pV=bNV12 ? pU+1 : yuv.pV+(size_t)(irow/2)*yuv.nStrideUV;
+
+        int nCol=bSimd ? ChromaRowSse4(rgb.pR+nOff0,rgb.pG+nOff0,rgb.pB+nOff0,
+                                       rgb.pR+nOff1,rgb.pG+nOff1,rgb.pB+nOff1,
+                                       nWidth,nShift,pU,pV,bNV12) : 0;
+        ChromaRow(rgb.pR+nOff0,rgb.pG+nOff0,rgb.pB+nOff0,
+                  rgb.pR+nOff1,rgb.pG+nOff1,rgb.pB+nOff1,
+                  nCol,nWidth,nShift,pU,pV,bNV12 ? 2 : 1);
+    }
+
+    return 0;
+}
+
+size_t EosAdimecYuv::GetFrameBytes(const int nWidth, const int nHeight)
+{
+    return ((size_t)nWidth*nHeight*3)/2;
+}
+
+void EosAdimecYuv::SetPlanes(uint8_t* pFrame, const int nWidth, const int nHeight,
+                             const E_YUV_FORMAT eFormat, YuvImage& yuv)
+{
+    size_t nLuma=(size_t)nWidth*nHeight;
+
+    yuv.pY=pFrame;
+    yuv.pU=pFrame+nLuma;
+    yuv.nStrideY=nWidth;
+
+    if(eYuvNV12==eFormat)
+    {
+        yuv.pV=NULL;
+        yuv.nStrideUV=nWidth;
+    }
+    else
+    {
+        yuv.pV=yuv.pU+nLuma/4;
+        yuv.nStrideUV=nWidth/2;
+    }
+
+    return;
+}
+
+bool EosAdimecYuv::GainFromDouble(const double dGain, uint32_t& nGain)
+{
+    if(!(dGain>=0.0) || (dGain>(double)GAIN_MAX/GAIN_ONE))
+        return false;
+    nGain=(uint32_t)(dGain*GAIN_ONE+0.5);
+    return true;
+}
+
+bool EosAdimecYuv::FormatFromString(const std::string& strFormat, E_YUV_FORMAT& eFormat)
+{
+    std::string strLower=boost::to_lower_copy(strFormat);
+    if(strLower=="i420")
+        eFormat=eYuvI420;
+    else if(strLower=="nv12")
+        eFormat=eYuvNV12;
+    else
+        return false;
+    return true;
+}
+
+std::string EosAdimecYuv::FormatName(const E_YUV_FORMAT eFormat)
+{
+    return (eYuvNV12==eFormat) ? "nv12" : "i420";
+}